@@ -175,6 +175,88 @@ function appendLog(text) {
   logsEl.scrollTop = logsEl.scrollHeight;
 }
 
+// =======================
+// WEBSOCKET TELEMETRY
+// =======================
+// Binary batches from /ws/telemetry (ws_fanout.h), little-endian:
+// [seq u32][dropped u32] then records [channel u8][len u16][udp frame]
+// channel 0 = sensor frame [type][esp_id][timestamp u32]..., 1 = log frame
+// [esp_id][timestamp u32][level][tag_len][tag][msg]
+const wsHostInput  = document.getElementById("wsHost");
+const wsConnectBtn = document.getElementById("wsConnectBtn");
+const wsStatusEl   = document.getElementById("wsStatus");
+const wsStatsEl    = document.getElementById("wsStats");
+const wsSensorsEl  = document.getElementById("wsSensors");
+const wsLogsEl     = document.getElementById("wsLogs");
+
+let telemetrySocket = null;
+const wsCounters = { batches: 0, records: 0, dropped: 0, lastSeq: -1, perType: {} };
+const wsDecoder = new TextDecoder();
+
+function parseTelemetryBatch(buf) {
+  const view = new DataView(buf);
+  if (view.byteLength < 8) return;
+  const seq = view.getUint32(0, true);
+  wsCounters.dropped += view.getUint32(4, true);
+  wsCounters.lastSeq = seq;
+  wsCounters.batches++;
+
+  let off = 8;
+  while (off + 3 <= view.byteLength) {
+    const channel = view.getUint8(off);
+    const len = view.getUint16(off + 1, true);
+    off += 3;
+    if (off + len > view.byteLength) break;
+    const frame = new Uint8Array(buf, off, len);
+    off += len;
+    wsCounters.records++;
+
+    if (channel === 0 && len >= 6) {
+      const type = frame[0];
+      wsCounters.perType[type] = (wsCounters.perType[type] || 0) + 1;
+    } else if (channel === 1 && len >= 7) {
+      const tagLen = frame[6];
+      const tag = wsDecoder.decode(frame.subarray(7, 7 + tagLen));
+      const msg = wsDecoder.decode(frame.subarray(7 + tagLen));
+      wsLogsEl.textContent += `[${tag}] ${msg}\n`;
+      if (wsLogsEl.textContent.length > 20000) {
+        wsLogsEl.textContent = wsLogsEl.textContent.slice(-10000);
+      }
+      wsLogsEl.scrollTop = wsLogsEl.scrollHeight;
+    }
+  }
+}
+
+setInterval(() => {
+  if (!telemetrySocket) return;
+  wsStatsEl.textContent = `batches ${wsCounters.batches}, records ${wsCounters.records}, ` +
+    `dropped by the ESP ${wsCounters.dropped}, seq ${wsCounters.lastSeq}`;
+  wsSensorsEl.textContent = Object.entries(wsCounters.perType)
+    .map(([type, count]) => `sensor type ${type}: ${count} frames`).join("\n");
+}, 500);
+
+wsConnectBtn.onclick = () => {
+  if (telemetrySocket) {
+    telemetrySocket.close();
+    return;
+  }
+  const host = wsHostInput.value.trim();
+  if (!host) return;
+
+  telemetrySocket = new WebSocket(`ws://${host}/ws/telemetry`);
+  telemetrySocket.binaryType = "arraybuffer";
+  telemetrySocket.onopen = () => {
+    wsStatusEl.textContent = "Connected";
+    wsConnectBtn.textContent = "Disconnect";
+  };
+  telemetrySocket.onmessage = (event) => parseTelemetryBatch(event.data);
+  telemetrySocket.onclose = () => {
+    wsStatusEl.textContent = "Disconnected";
+    wsConnectBtn.textContent = "Connect";
+    telemetrySocket = null;
+  };
+};
+
 // =======================
 // SEND COMMAND
 // =======================
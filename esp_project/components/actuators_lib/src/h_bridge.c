@@ -9,11 +9,16 @@
 #include <stdatomic.h>
 #include "esp_timer.h"
 #include "log_lib.h"
+#include "nvs_lib.h"
 
 #if CONFIG_WRITE_MOTOR_SCREEN
 #include "screen_lib.h"
 #endif
 
+#if CONFIG_USE_LVGL_SCREEN
+#include "lcd_lvgl_lib.h"
+#endif
+
 #if CONFIG_USE_UDPLIB && CONFIG_USE_SENSORS
 #include "udp_lib.h"
 #include "sensors_lib.h"
@@ -84,6 +89,12 @@ static int64_t timestamp_force_motor = 0;
 static bool last_current_motor_sign_positive = false;
 
 static drive_profile_config_t cfg = { CURVE_COSINE, 180, 190 };
+// Runtime tuning (apply_config) survives reboots, as a record through the NVS write-back cache
+#define DRIVE_PROFILE_NVS_KEY "drive_profile"
+#define DRIVE_PROFILE_VERSION 1
+// 0 never moves (linear/exp step 0); cosine ramps over 200 - param ticks
+#define DRIVE_PARAM_MIN 1
+#define DRIVE_COSINE_PARAM_MAX 199
 static int32_t ramp_start_motor = 0;
 static uint32_t ramp_tick = 0;
 static uint32_t timeout_breaking = 0;
@@ -262,6 +273,25 @@ static void apply_target_motor(void *args) {
 #if CONFIG_USE_UDPLIB && CONFIG_USE_SENSORS
     send_motor_telemetry();
 #endif
+
+#if CONFIG_USE_LVGL_SCREEN
+    // unchanged values do not wake the dashboard up
+    bool front = false, rear = false;
+    get_front_blocked(&front);
+    get_rear_blocked(&rear);
+    set_bar_motor(current_motor / 10);
+    lcd_set_obstacle(atomic_load(&breaking_lock), front, rear);
+#endif
+}
+
+/**
+ * Check a drive profile before it drives the motor (station input or NVS)
+ */
+static bool drive_profile_valid(const drive_profile_config_t *profile) {
+    uint8_t param_max = (profile->curve_type == CURVE_COSINE) ? DRIVE_COSINE_PARAM_MAX : UINT8_MAX;
+    return profile->curve_type <= CURVE_COSINE
+        && profile->accel_param >= DRIVE_PARAM_MIN && profile->accel_param <= param_max
+        && profile->decel_param >= DRIVE_PARAM_MIN && profile->decel_param <= param_max;
 }
 
 esp_err_t apply_config(uint8_t *buf, uint8_t len) {
@@ -272,17 +302,41 @@ esp_err_t apply_config(uint8_t *buf, uint8_t len) {
         return ESP_ERR_INVALID_SIZE;
     }
 
-    cfg.curve_type = buf[0];
-    cfg.accel_param = buf[1];
-    cfg.decel_param = buf[2];
+    drive_profile_config_t profile = { buf[0], buf[1], buf[2] };
+    if (!drive_profile_valid(&profile)) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "Drive profile rejected: curve %u, accel %u, decel %u",
+            profile.curve_type, profile.accel_param, profile.decel_param);
+        return ESP_ERR_INVALID_ARG;
+    }
+    cfg = profile;
     ramp_tick = 0;
     ramp_start_motor = current_motor;
+
+    // RAM only: committed later, tuning bursts cost one flash write
+    esp_err_t err = nvs_cache_set_record(DRIVE_PROFILE_NVS_KEY, NVS_RECORD_DRIVE_PROFILE, DRIVE_PROFILE_VERSION,
+        &cfg, sizeof(cfg));
+    if (err != ESP_OK) {
+        log_msg(TAG, "Error (%s) saving drive profile", esp_err_to_name(err));
+    }
     return ESP_OK;
 }
 
 esp_err_t init_bts(void) {
     esp_err_t err;
 
+    // last applied drive profile, defaults kept if none, stale, corrupted or out of range
+    drive_profile_config_t profile = cfg;
+    err = nvs_cache_get_record(DRIVE_PROFILE_NVS_KEY, NVS_RECORD_DRIVE_PROFILE, DRIVE_PROFILE_VERSION,
+        &profile, sizeof(profile));
+    if (err == ESP_OK && !drive_profile_valid(&profile)) {
+        err = ESP_ERR_INVALID_ARG;
+    }
+    if (err == ESP_OK) {
+        cfg = profile;
+    } else {
+        log_msg(TAG, "Error (%s) loading drive profile, using defaults", esp_err_to_name(err));
+    }
+
     err = ledc_timer_config(&ledc_timer_bts);
     if (err != ESP_OK) {
         log_msg(TAG, "Error (%s) configuring BTS7960 timer", esp_err_to_name(err));
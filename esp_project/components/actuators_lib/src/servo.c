@@ -10,6 +10,10 @@
 #include "screen_lib.h"
 #endif
 
+#if CONFIG_USE_LVGL_SCREEN
+#include "lcd_lvgl_lib.h"
+#endif
+
 static const char *TAG = "servo_library";
 
 ledc_timer_config_t ledc_timer_mg = {
@@ -104,6 +108,10 @@ esp_err_t ledc_angle(int16_t angle) {
     ssd1306_draw_string(tmp, 0, 2);
 #endif
 
+#if CONFIG_USE_LVGL_SCREEN
+    set_bar_steer((current_angle - 90) * 100 / 90);
+#endif
+
     return ESP_OK;
 }
 
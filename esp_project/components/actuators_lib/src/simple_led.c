@@ -43,11 +43,13 @@ esp_err_t led_init(void) {
 
 #if CONFIG_SAVE_LED
     // Restore last saved state from NVS
-    err = load_nvs_int("led_state", (int*)&led_state);
+    int saved_state = 0;
+    err = nvs_cache_get_int("led_state", &saved_state);
     if (err != ESP_OK) {
         log_msg(TAG, "Error (%s) loading NVS int: led_state", esp_err_to_name(err));
         return err;
     }
+    led_state = (saved_state != 0);
 #endif
 
     err = gpio_set_level(LED_PIN, led_state);
@@ -81,7 +83,7 @@ esp_err_t led_on(void) {
                 return err;
             }
 #if CONFIG_SAVE_LED
-            err = save_nvs_int("led_state", led_state);
+            err = nvs_cache_set_int("led_state", led_state);
             if (err != ESP_OK) {
                 log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) saving led_state in NVS", esp_err_to_name(err));
                 xSemaphoreGive(xMutex);
@@ -116,7 +118,7 @@ esp_err_t led_off(void) {
                 return err;
             }
 #if CONFIG_SAVE_LED
-            err = save_nvs_int("led_state", led_state);
+            err = nvs_cache_set_int("led_state", led_state);
             if (err != ESP_OK) {
                 log_msg(TAG, "Error (%s) saving led_state in NVS", esp_err_to_name(err));
                 xSemaphoreGive(xMutex);
@@ -150,7 +152,7 @@ esp_err_t led_toggle(void) {
             return err;
         }
 #if CONFIG_SAVE_LED
-        err = save_nvs_int("led_state", led_state);
+        err = nvs_cache_set_int("led_state", led_state);
         if (err != ESP_OK) {
             log_msg(TAG, "Error (%s) saving led_state in NVS", esp_err_to_name(err));
             xSemaphoreGive(xMutex);
@@ -5,6 +5,8 @@
 #endif
 
 #include "log_lib.h"
+#include "ota_lib.h"
+#include "nvs_lib.h"
 #include "esp_camera.h"
 #include "esp_timer.h"
 
@@ -57,6 +59,10 @@
 #define CAMCFG_OFF_LENC            29  // u8
 #define CAMCFG_OFF_SPECIAL_EFFECT  30  // u8
 
+// Last settings received from the station, restored at boot
+#define CAMERA_CONFIG_KEY "CAM_CFG"
+#define CAMERA_CONFIG_VERSION 1 // payload: the CAMCFG_FRAME_SIZE bytes wire format
+
 // Guard contre les fonctions non implémentées par certains drivers de capteur (varie selon OV2640/OV2660/OV3660)
 #define CALL_IF(fn, ...) do { if ((fn) != NULL) { (fn)(__VA_ARGS__); } } while (0)
 
@@ -170,6 +176,22 @@ static camera_config_t camera_config = {
     .grab_mode = CAMERA_GRAB_LATEST // Sets when buffers should be filled
 };
 
+// Offset of each camera_config_field_t bit in the wire format, in bit order,
+// end of frame last: field i spans [offsets[i], offsets[i + 1])
+static const uint8_t field_offsets[] = {
+    CAMCFG_OFF_FRAMESIZE, CAMCFG_OFF_BRIGHTNESS, CAMCFG_OFF_CONTRAST, CAMCFG_OFF_SATURATION,
+    CAMCFG_OFF_SHARPNESS, CAMCFG_OFF_DENOISE, CAMCFG_OFF_QUALITY, CAMCFG_OFF_GAINCEILING,
+    CAMCFG_OFF_COLORBAR, CAMCFG_OFF_WHITEBAL, CAMCFG_OFF_AWB_GAIN, CAMCFG_OFF_WB_MODE,
+    CAMCFG_OFF_EXPOSURE_CTRL, CAMCFG_OFF_AEC2, CAMCFG_OFF_AE_LEVEL, CAMCFG_OFF_AEC_VALUE,
+    CAMCFG_OFF_GAIN_CTRL, CAMCFG_OFF_AGC_GAIN, CAMCFG_OFF_HMIRROR, CAMCFG_OFF_VFLIP,
+    CAMCFG_OFF_DCW, CAMCFG_OFF_BPC, CAMCFG_OFF_WPC, CAMCFG_OFF_RAW_GMA,
+    CAMCFG_OFF_LENC, CAMCFG_OFF_SPECIAL_EFFECT, CAMCFG_FRAME_SIZE,
+};
+#define CAMCFG_FIELDS (sizeof(field_offsets) - 1)
+
+// every field ever set, in wire format (mask = union of the masks received)
+static uint8_t saved_config[CAMCFG_FRAME_SIZE];
+
 static void deserialize_camera_config(const uint8_t *buffer, size_t len, camera_config_t_app *out) {
 
     uint16_t aec_value;
@@ -210,7 +232,33 @@ static void deserialize_camera_config(const uint8_t *buffer, size_t len, camera_
 
 }
 
-void apply_camera_config(const uint8_t *buffer, size_t len) {
+/**
+ * Merge the fields set in buffer into saved_config
+ * @return true if a value changed
+ */
+static bool merge_saved_config(const uint8_t *buffer) {
+    uint32_t mask, saved_mask;
+    memcpy(&mask, &buffer[CAMCFG_OFF_MASK], sizeof(mask));
+    memcpy(&saved_mask, &saved_config[CAMCFG_OFF_MASK], sizeof(saved_mask));
+
+    bool changed = (saved_mask | mask) != saved_mask;
+    for (size_t i = 0; i < CAMCFG_FIELDS; i++) {
+        if (!(mask & (1u << i))) {
+            continue;
+        }
+        uint8_t off = field_offsets[i];
+        uint8_t size = field_offsets[i + 1] - off;
+        if (memcmp(&saved_config[off], &buffer[off], size) != 0) {
+            memcpy(&saved_config[off], &buffer[off], size);
+            changed = true;
+        }
+    }
+    saved_mask |= mask;
+    memcpy(&saved_config[CAMCFG_OFF_MASK], &saved_mask, sizeof(saved_mask));
+    return changed;
+}
+
+static void apply_settings(const uint8_t *buffer, size_t len) {
     camera_config_t_app cfg;
 
     deserialize_camera_config(buffer, len, &cfg);
@@ -251,6 +299,37 @@ void apply_camera_config(const uint8_t *buffer, size_t len) {
     log_msg(TAG, "Config applied, mask=0x%08lx", (unsigned long)cfg.field_mask);
 }
 
+void apply_camera_config(const uint8_t *buffer, size_t len) {
+    if (len < CAMCFG_FRAME_SIZE) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Camera config too short (%u bytes)", (unsigned)len);
+        return;
+    }
+    apply_settings(buffer, len);
+
+    //written only when a value changed: the station may resend the same config
+    if (merge_saved_config(buffer)) {
+        esp_err_t err = save_nvs_record(CAMERA_CONFIG_KEY, NVS_RECORD_CAMERA_CONFIG, CAMERA_CONFIG_VERSION,
+            saved_config, sizeof(saved_config));
+        if (err != ESP_OK) {
+            log_msg_lvl(ESP_LOG_WARN, TAG, "Error (%s) saving camera config", esp_err_to_name(err));
+        }
+    }
+}
+
+/**
+ * Restore the settings saved by apply_camera_config
+ * -Missing or rejected record (older layout, corrupted): driver defaults
+ */
+static void restore_camera_config() {
+    esp_err_t err = load_nvs_record(CAMERA_CONFIG_KEY, NVS_RECORD_CAMERA_CONFIG, CAMERA_CONFIG_VERSION,
+        saved_config, sizeof(saved_config));
+    if (err != ESP_OK) {
+        memset(saved_config, 0, sizeof(saved_config));
+        return;
+    }
+    apply_settings(saved_config, sizeof(saved_config));
+}
+
 
 static void jpg_stream_udp(void *param){
     camera_fb_t * fb = NULL;
@@ -261,6 +340,12 @@ static void jpg_stream_udp(void *param){
 
 
     while(true){
+        //paused during an OTA: frames would be dropped anyway, leave it the CPU and PSRAM bandwidth
+        if (atomic_load(&ota_lock)) {
+            vTaskDelay(pdMS_TO_TICKS(200));
+            continue;
+        }
+
         fb = esp_camera_fb_get();
         if (!fb) {
             log_msg_lvl(ESP_LOG_ERROR, TAG, "Camera capture failed");
@@ -300,6 +385,7 @@ esp_err_t camera_init(){
         log_msg_lvl(ESP_LOG_ERROR, TAG, "Camera Init Failed");
         return err;
     }
+    restore_camera_config();
 
     BaseType_t res = xTaskCreate(jpg_stream_udp, "jpg_stream_udp", 8192, NULL, 4, NULL);
     if (res != pdPASS) {
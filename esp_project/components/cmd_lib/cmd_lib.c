@@ -2,6 +2,10 @@
 #include "actuators_lib.h"
 #include "log_lib.h"
 
+#if CONFIG_USE_LVGL_SCREEN
+#include "lcd_lvgl_lib.h"
+#endif
+
 #define BUFFER_SIZE_PAYLOAD_GAMEPAD 7 //6 axes, 8 buttons in 1 byte
 #define BUFFER_SIZE_PAYLOAD_ANDROID 2 //2 axes
 
@@ -151,6 +155,7 @@ esp_err_t apply_gamepad_commands(const gamepad_t *gamepad) {
     bool current_dpadup = (gamepad->buttons & 0b10000000);
     bool current_dpaddown = (gamepad->buttons & 0b00010000);
 
+#if CONFIG_CMD_DEBUG
     log_msg(TAG, "buttons: 0b%c%c%c%c%c%c%c%c | L:%d R:%d U:%d D:%d",
         (gamepad->buttons & 0x80) ? '1' : '0',
         (gamepad->buttons & 0x40) ? '1' : '0',
@@ -165,6 +170,7 @@ esp_err_t apply_gamepad_commands(const gamepad_t *gamepad) {
         current_dpadup,
         current_dpaddown
     );
+#endif
 
     if (!last_dpadleft && current_dpadleft) {
         if (drive_mode > DEFAULT) {
@@ -189,6 +195,10 @@ esp_err_t apply_gamepad_commands(const gamepad_t *gamepad) {
         }
     }
 
+#if CONFIG_USE_LVGL_SCREEN
+    lcd_set_drive_mode((uint8_t)drive_mode);
+#endif
+
     last_dpadleft = current_dpadleft;
     last_dpadright = current_dpadright;
 
@@ -240,7 +250,9 @@ esp_err_t apply_gamepad_commands(const gamepad_t *gamepad) {
     int16_t final_speed = (int16_t)((float)target_speed * speed_factor);
 
     final_speed *= 10;
+#if CONFIG_CMD_DEBUG
     log_msg(TAG, "Sending speed target controller: %d", final_speed);
+#endif
 
     // 4. Envoi de la commande finale bridée au moteur
     ledc_motor(final_speed);
@@ -335,6 +347,20 @@ esp_err_t cmd_dispatch(const int8_t *data) {
     return err;
 }
 
+esp_err_t cmd_dispatch_stop(const int8_t *data) {
+    command_type_t type = CMD_TYPE_MAX;
+    esp_err_t err = get_cmd_type(data, &type);
+    if (err != ESP_OK || type != CMD_GAMEPAD) {
+        return err;
+    }
+    gamepad_t gamepad;
+    err = gamepad_from_buffer(data, &gamepad);
+    if (err == ESP_OK && (gamepad.buttons & 0b10000000)) { //dpad up, as in apply_gamepad_commands
+        force_motor_stop();
+    }
+    return err;
+}
+
 void reset_command() {
     ledc_motor(0);
     ledc_angle(90);
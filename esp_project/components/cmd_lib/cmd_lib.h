@@ -76,6 +76,12 @@ void dump_android(const android_t *android);
 
 esp_err_t cmd_dispatch(const int8_t *data);
 
+/**
+ * Stop button only (gamepad dpad up), everything else in the command is
+ * ignored: used while an OTA runs in safety mode.
+ */
+esp_err_t cmd_dispatch_stop(const int8_t *data);
+
 void reset_command();
 
 drive_mode_e get_drive_mode();
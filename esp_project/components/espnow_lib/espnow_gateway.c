@@ -0,0 +1,119 @@
+#include "espnow_gateway.h"
+#include <string.h>
+
+void espnow_gw_peers_init(espnow_gw_peer_table_t *table) {
+    memset(table, 0, sizeof(*table));
+}
+
+uint8_t espnow_gw_peers_find(const espnow_gw_peer_table_t *table, const uint8_t *mac) {
+    for (uint8_t i = 0; i < ESPNOW_GW_PEERS_MAX; i++) {
+        if (table->peers[i].used && memcmp(table->peers[i].mac, mac, ESPNOW_GW_MAC_LEN) == 0) {
+            return i;
+        }
+    }
+    return ESPNOW_GW_NODE_NONE;
+}
+
+uint8_t espnow_gw_peers_touch(espnow_gw_peer_table_t *table, const uint8_t *mac, uint32_t len,
+    uint32_t now_ms, bool *is_new) {
+    if (is_new != NULL) {
+        *is_new = false;
+    }
+
+    uint8_t id = espnow_gw_peers_find(table, mac);
+    if (id == ESPNOW_GW_NODE_NONE) {
+        for (uint8_t i = 0; i < ESPNOW_GW_PEERS_MAX; i++) {
+            if (!table->peers[i].used) {
+                id = i;
+                break;
+            }
+        }
+        if (id == ESPNOW_GW_NODE_NONE) {
+            table->rejected++;
+            return ESPNOW_GW_NODE_NONE;
+        }
+        memset(&table->peers[id], 0, sizeof(table->peers[id]));
+        table->peers[id].used = true;
+        memcpy(table->peers[id].mac, mac, ESPNOW_GW_MAC_LEN);
+        if (is_new != NULL) {
+            *is_new = true;
+        }
+    }
+
+    espnow_gw_peer_t *peer = &table->peers[id];
+    peer->last_seen_ms = now_ms;
+    peer->frames++;
+    peer->bytes += len;
+    return id;
+}
+
+bool espnow_gw_peers_expire(espnow_gw_peer_table_t *table, uint32_t now_ms, uint8_t *mac) {
+    for (uint8_t i = 0; i < ESPNOW_GW_PEERS_MAX; i++) {
+        espnow_gw_peer_t *peer = &table->peers[i];
+        if (peer->used && (now_ms - peer->last_seen_ms) > ESPNOW_GW_PEER_TIMEOUT_MS) {
+            if (mac != NULL) {
+                memcpy(mac, peer->mac, ESPNOW_GW_MAC_LEN);
+            }
+            peer->used = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t espnow_gw_peers_count(const espnow_gw_peer_table_t *table) {
+    size_t count = 0;
+    for (size_t i = 0; i < ESPNOW_GW_PEERS_MAX; i++) {
+        count += table->peers[i].used ? 1 : 0;
+    }
+    return count;
+}
+
+void espnow_gw_batch_init(espnow_gw_batch_t *batch, uint8_t *buf, size_t capacity) {
+    memset(batch, 0, sizeof(*batch));
+    batch->buf = buf;
+    batch->capacity = capacity;
+}
+
+bool espnow_gw_batch_add(espnow_gw_batch_t *batch, size_t header_size, uint8_t node_id,
+    const uint8_t *frame, uint16_t len, uint32_t now_ms) {
+    size_t start = (batch->len == 0) ? header_size : batch->len;
+    if (batch->buf == NULL || start + ESPNOW_GW_RECORD_HEADER_SIZE + len > batch->capacity) {
+        return false;
+    }
+
+    if (batch->len == 0) {
+        batch->started_ms = now_ms;
+    }
+    uint8_t *rec = &batch->buf[start];
+    rec[0] = node_id;
+    memcpy(&rec[1], &len, sizeof(uint16_t)); // little-endian
+    memcpy(&rec[ESPNOW_GW_RECORD_HEADER_SIZE], frame, len);
+
+    batch->len = start + ESPNOW_GW_RECORD_HEADER_SIZE + len;
+    batch->records++;
+    return true;
+}
+
+bool espnow_gw_batch_due(const espnow_gw_batch_t *batch, uint32_t now_ms, uint32_t max_age_ms) {
+    return batch->records > 0 && (now_ms - batch->started_ms) >= max_age_ms;
+}
+
+bool espnow_gw_batch_next(const uint8_t *buf, size_t len, size_t *offset, uint8_t *node_id,
+    const uint8_t **frame, uint16_t *frame_len) {
+    if (*offset + ESPNOW_GW_RECORD_HEADER_SIZE > len) {
+        return false;
+    }
+    const uint8_t *rec = &buf[*offset];
+    uint16_t rec_len;
+    memcpy(&rec_len, &rec[1], sizeof(uint16_t));
+    if (*offset + ESPNOW_GW_RECORD_HEADER_SIZE + rec_len > len) {
+        return false;
+    }
+
+    *node_id = rec[0];
+    *frame = &rec[ESPNOW_GW_RECORD_HEADER_SIZE];
+    *frame_len = rec_len;
+    *offset += ESPNOW_GW_RECORD_HEADER_SIZE + rec_len;
+    return true;
+}
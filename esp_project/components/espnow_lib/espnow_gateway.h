@@ -0,0 +1,101 @@
+#ifndef ESPNOW_GATEWAY_H_
+#define ESPNOW_GATEWAY_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Building blocks of the ESP-NOW -> UDP gateway:
+// - a peer table fed by discovery, giving every remote node a small node ID
+//   (its slot) for as long as it keeps talking,
+// - a batch builder packing sensor frames of many nodes into one UDP
+//   datagram, each record tagged with the node ID of its sender.
+// Pure code (no ESP-NOW, no FreeRTOS, no lwIP) so it can be run on the host.
+
+#define ESPNOW_GW_MAC_LEN 6
+#define ESPNOW_GW_PEERS_MAX 12
+#define ESPNOW_GW_PEER_TIMEOUT_MS 10000 // node forgotten after this long without a frame
+#define ESPNOW_GW_NODE_NONE 0xFF
+
+// Batch datagram (sensors UDP port), little-endian:
+// [0..5] = usual sensor header, type SENSOR_TYPE_GATEWAY, gateway esp_id,
+//          timestamp of the flush,
+// then records: [node ID][frame length (uint16_t)][frame], the frame being
+// the node's own telemetry frame (with its own sensor header).
+#define ESPNOW_GW_RECORD_HEADER_SIZE (sizeof(uint8_t) + sizeof(uint16_t))
+
+typedef struct {
+    bool used;
+    uint8_t mac[ESPNOW_GW_MAC_LEN];
+    uint8_t esp_id;     // announced by the node, 0 until its hello came
+    uint32_t last_seen_ms;
+    uint32_t frames;
+    uint32_t bytes;
+} espnow_gw_peer_t;
+
+typedef struct {
+    espnow_gw_peer_t peers[ESPNOW_GW_PEERS_MAX];
+    uint32_t rejected; // frames from new nodes while the table was full
+} espnow_gw_peer_table_t;
+
+void espnow_gw_peers_init(espnow_gw_peer_table_t *table);
+
+/**
+ * Account one frame from `mac`, adding the node if it is new.
+ *
+ * @param is_new  set when the node was just added (may be NULL)
+ * @return node ID, or ESPNOW_GW_NODE_NONE if the table is full
+ */
+uint8_t espnow_gw_peers_touch(espnow_gw_peer_table_t *table, const uint8_t *mac, uint32_t len,
+    uint32_t now_ms, bool *is_new);
+
+/** @return node ID of `mac`, or ESPNOW_GW_NODE_NONE if unknown */
+uint8_t espnow_gw_peers_find(const espnow_gw_peer_table_t *table, const uint8_t *mac);
+
+/**
+ * Remove one node silent for longer than ESPNOW_GW_PEER_TIMEOUT_MS.
+ *
+ * @param mac  written with the MAC of the removed node
+ * @return true if a node was removed (call again until false)
+ */
+bool espnow_gw_peers_expire(espnow_gw_peer_table_t *table, uint32_t now_ms, uint8_t *mac);
+
+size_t espnow_gw_peers_count(const espnow_gw_peer_table_t *table);
+
+typedef struct {
+    uint8_t *buf;        // caller-provided storage, header included
+    size_t capacity;
+    size_t len;          // 0 when empty, header size once a record is in
+    uint16_t records;
+    uint32_t started_ms; // time of the first record, for the flush deadline
+} espnow_gw_batch_t;
+
+/**
+ * Attach an empty batch to its storage. A flushed batch is attached to a
+ * new buffer, the previous one being owned by the UDP client from then on.
+ */
+void espnow_gw_batch_init(espnow_gw_batch_t *batch, uint8_t *buf, size_t capacity);
+
+/**
+ * Append one frame. The header area ([0..header_size)) is left to the
+ * caller, written before the batch is sent.
+ *
+ * @return false if the record does not fit: flush, then add it again
+ */
+bool espnow_gw_batch_add(espnow_gw_batch_t *batch, size_t header_size, uint8_t node_id,
+    const uint8_t *frame, uint16_t len, uint32_t now_ms);
+
+/** @return true once the first record is older than `max_age_ms` */
+bool espnow_gw_batch_due(const espnow_gw_batch_t *batch, uint32_t now_ms, uint32_t max_age_ms);
+
+/**
+ * Walk the records of a batch, as the station does.
+ *
+ * @param offset  in: position of the record (header_size for the first one),
+ *                out: position of the next one
+ * @return false once there is no complete record left
+ */
+bool espnow_gw_batch_next(const uint8_t *buf, size_t len, size_t *offset, uint8_t *node_id,
+    const uint8_t **frame, uint16_t *frame_len);
+
+#endif // ESPNOW_GATEWAY_H_
@@ -13,18 +13,31 @@
 #include "esp_mac.h"
 #include "esp_now.h"
 #include "esp_crc.h"
+#include "esp_timer.h"
 
 #include "espnow_lib.h"
+#include "espnow_reassembly.h"
+#include "espnow_gateway.h"
 #include "log_lib.h"
 #if CONFIG_USE_UDPLIB
 #include "udp_lib.h"
+#include "sensors_lib.h"
 #else
 #include "cmd_lib.h"
 #endif
 
-#define ESPNOW_MAXDELAY 512
 #define ESPNOW_RX_QUEUE_SIZE  10
 #define ESPNOW_TX_QUEUE_SIZE  10
+#if CONFIG_USE_UDPLIB
+#define ESPNOW_RX_POOL_SIZE   24 // forwarded frames also wait in the UDP queues
+#else
+#define ESPNOW_RX_POOL_SIZE   ESPNOW_RX_QUEUE_SIZE // one buffer per queued frame
+#endif
+#define ESPNOW_RX_EXPIRE_MS   50 // how often stale reassembly slots are checked when idle
+
+#define ESPNOW_GW_BATCH_MS        20    // max age of a sensor batch before it is sent
+#define ESPNOW_GW_BATCH_BUFFERS   3     // batch being filled + datagrams waiting in udp_lib
+#define ESPNOW_GW_STATS_PERIOD_MS 10000
 
 
 static const char* TAG = "espnow_library";
@@ -32,25 +45,33 @@ static const char* TAG = "espnow_library";
 static QueueHandle_t espnow_queue_rx = NULL;
 static QueueHandle_t espnow_queue_tx = NULL;
 static QueueHandle_t espnow_queue_send = NULL;
+static QueueHandle_t espnow_queue_rx_free = NULL; // indexes of free rx_pool buffers
+#if CONFIG_USE_UDPLIB
+static QueueHandle_t gw_batch_free = NULL; // indexes of free gw_batch_pool buffers
+#endif
 
-static SemaphoreHandle_t espnow_tx_sem = NULL;
+static TaskHandle_t espnow_send_task_handle = NULL;
 
 static uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
 
-#if CONFIG_USE_UDPLIB
-//sensor mac
-static uint8_t mac_esp_peer[ESP_NOW_ETH_ALEN] = { 0xB0, 0xCB, 0xD8, 0xE8, 0x68, 0x39 };
-#else
-//udp mac
-static uint8_t mac_esp_peer[ESP_NOW_ETH_ALEN] = { 0xA4, 0xF0, 0x0F, 0x66, 0xB8, 0x51 };
-#endif
+// Target of send_espnow_msg, set by discovery: the gateway on a node, the
+// first node heard on the gateway.
+static uint8_t default_peer[ESP_NOW_ETH_ALEN];
+static bool default_peer_known = false;
+static uint32_t default_peer_seen_ms = 0; // last beacon of the gateway (nodes)
+static portMUX_TYPE default_peer_lock = portMUX_INITIALIZER_UNLOCKED;
 
 typedef struct {
     uint8_t mac_addr[ESP_NOW_ETH_ALEN];
-    uint8_t *data;
+    uint8_t pool_idx;
     int data_len;
 } espnow_rx_event_t;
 
+// Received frames are copied once, from the Wi-Fi task, into a buffer of
+// this fixed pool instead of a malloc per frame; the RX task gives the
+// buffer back once the frame is handled.
+static uint8_t rx_pool[ESPNOW_RX_POOL_SIZE][ESPNOW_MSG_SIZE];
+
 typedef struct {
     uint8_t mac_addr[ESP_NOW_ETH_ALEN];
     esp_now_send_status_t status;
@@ -69,13 +90,16 @@ static void espnow_send_cb(const esp_now_send_info_t *tx_info, esp_now_send_stat
         log_msg_lvl(ESP_LOG_ERROR, TAG, "Send cb arg error");
         return;
     }
-    xSemaphoreGiveFromISR(espnow_tx_sem, NULL);
 
     memcpy(evt.mac_addr, tx_info->des_addr, ESP_NOW_ETH_ALEN);
     evt.status = status;
-    if (xQueueSend(espnow_queue_tx, &evt, ESPNOW_MAXDELAY) != pdTRUE) {
+    if (xQueueSend(espnow_queue_tx, &evt, 0) != pdTRUE) {
+        // The send task times the frame out instead.
         log_msg_lvl(ESP_LOG_WARN, TAG, "Send send queue fail");
     }
+    if (espnow_send_task_handle != NULL) {
+        xTaskNotifyGive(espnow_send_task_handle);
+    }
 }
 
 static void espnow_header_serialize(header_espnow_frame_t *hd, uint8_t *data) {
@@ -121,215 +145,830 @@ static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *
 {
     espnow_rx_event_t evt = {0};
     uint8_t * mac_addr = recv_info->src_addr;
-    uint8_t * des_addr = recv_info->des_addr;
 
-    if (mac_addr == NULL || data == NULL || len <= 0) {
+    if (mac_addr == NULL || data == NULL || len <= 0 || len > ESPNOW_MSG_SIZE) {
         log_msg_lvl(ESP_LOG_ERROR, TAG, "Receive cb arg error");
         return;
     }
 
-    memcpy(evt.mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
-    evt.data = malloc(len);
-    if (evt.data == NULL) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Malloc receive data fail");
+    // Runs in the Wi-Fi task: never block here, drop the frame instead.
+    if (xQueueReceive(espnow_queue_rx_free, &evt.pool_idx, 0) != pdTRUE) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "No free receive buffer, frame dropped");
         return;
     }
-    memcpy(evt.data, data, len);
+
+    memcpy(evt.mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
+    memcpy(rx_pool[evt.pool_idx], data, len);
     evt.data_len = len;
-    if (xQueueSend(espnow_queue_rx, &evt, ESPNOW_MAXDELAY) != pdTRUE) {
+    if (xQueueSend(espnow_queue_rx, &evt, 0) != pdTRUE) {
         log_msg_lvl(ESP_LOG_WARN, TAG, "Send receive queue fail");
-        free(evt.data);
+        xQueueSend(espnow_queue_rx_free, &evt.pool_idx, 0);
     }
 }
 
-#define DEFRAG_BUFFER_MAX_SIZE 2048
+static espnow_reasm_t reasm; // static: ESPNOW_REASM_SLOTS buffers of ESPNOW_REASM_MAX_SIZE
+
+static uint32_t espnow_now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static esp_err_t espnow_add_peer(const uint8_t *mac) {
+    if (esp_now_is_peer_exist(mac)) {
+        return ESP_OK;
+    }
+    esp_now_peer_info_t peer = {0};
+    peer.channel = 1;
+#if CONFIG_USE_AP_MODE
+    peer.ifidx = WIFI_IF_AP;
+#else
+    peer.ifidx = WIFI_IF_AP;
+#endif
+    peer.encrypt = false;
+    memcpy(peer.peer_addr, mac, ESP_NOW_ETH_ALEN);
+    return esp_now_add_peer(&peer);
+}
+
+static void default_peer_set(const uint8_t *mac, uint32_t now_ms) {
+    taskENTER_CRITICAL(&default_peer_lock);
+    if (mac != NULL) {
+        memcpy(default_peer, mac, ESP_NOW_ETH_ALEN);
+        default_peer_seen_ms = now_ms;
+    }
+    default_peer_known = (mac != NULL);
+    taskEXIT_CRITICAL(&default_peer_lock);
+}
+
+esp_err_t espnow_get_default_peer(uint8_t *mac) {
+    if (mac == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&default_peer_lock);
+    bool known = default_peer_known;
+    if (known) {
+        memcpy(mac, default_peer, ESP_NOW_ETH_ALEN);
+    }
+    taskEXIT_CRITICAL(&default_peer_lock);
+    return known ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+static void espnow_send_discovery(const uint8_t *mac, espnow_role_t role) {
+    header_espnow_frame_t hd = { .flags = 0, .packet_type = DISCOVERY };
+    uint8_t payload[ESPNOW_DISCOVERY_SIZE] = { (uint8_t)role, (uint8_t)CONFIG_ESP_ID };
+    send_espnow_msg_to(mac, &hd, payload, sizeof(payload));
+}
+
+#if CONFIG_USE_UDPLIB
+// --- Gateway: ESP-NOW nodes -> UDP ---
+//
+// Every node gets a node ID from the peer table (espnow_gateway.h). Sensor
+// frames with the UDP dispatch flag are packed, tagged with their node ID,
+// into one SENSOR_TYPE_GATEWAY datagram sent when full or ESPNOW_GW_BATCH_MS
+// after its first frame. Other single-frame messages are handed to udp_lib
+// in their RX pool buffer, which comes back to the pool once sent: no copy,
+// no allocation. Batches are built the same way in a small static pool.
+// Reassembled messages are copied once, their slot being needed for the next
+// message.
 
 typedef struct {
-    uint8_t buffer[DEFRAG_BUFFER_MAX_SIZE];
-    uint32_t current_frag_id;
-    uint32_t bytes_received;
-    uint8_t frags_received_count;
-} defrag_ctx_t;
+    uint32_t batches;
+    uint32_t batched_frames;
+    uint32_t zero_copy;  // frames sent from their RX pool buffer
+    uint32_t copied;     // reassembled messages
+    uint32_t dropped;
+} espnow_gw_stats_t;
+
+static espnow_gw_peer_table_t gw_peers;
+static espnow_gw_batch_t gw_batch;
+static uint8_t gw_batch_idx; // gw_batch_pool buffer of gw_batch
+static uint8_t gw_batch_pool[ESPNOW_GW_BATCH_BUFFERS][UDP_MAX_SIZE];
+static espnow_gw_stats_t gw_stats;
+
+static void rx_pool_release(uint8_t *data, void *ctx) {
+    (void)data;
+    uint8_t pool_idx = (uint8_t)(uintptr_t)ctx;
+    xQueueSend(espnow_queue_rx_free, &pool_idx, 0);
+}
+
+static void gw_batch_release(uint8_t *data, void *ctx) {
+    (void)data;
+    uint8_t idx = (uint8_t)(uintptr_t)ctx;
+    xQueueSend(gw_batch_free, &idx, 0);
+}
+
+static void gw_batch_open(void) {
+    // Owned by udp_lib once sent, back in the pool once out. None free means
+    // udp_lib is behind: no batch, frames are dropped until one comes back.
+    if (xQueueReceive(gw_batch_free, &gw_batch_idx, 0) != pdTRUE) {
+        espnow_gw_batch_init(&gw_batch, NULL, 0);
+        return;
+    }
+    espnow_gw_batch_init(&gw_batch, gw_batch_pool[gw_batch_idx], UDP_MAX_SIZE);
+}
+
+static void gw_batch_flush(void) {
+    if (gw_batch.records == 0) {
+        return;
+    }
+    header_sensor_t header = {0};
+    header.type = SENSOR_TYPE_GATEWAY;
+    header.esp_id = (uint8_t)CONFIG_ESP_ID;
+    header.timestamp = espnow_now_ms();
+    serialize_header(&header, gw_batch.buf);
+
+    gw_stats.batches++;
+    gw_stats.batched_frames += gw_batch.records;
+    send_udp_buffer(UDP_CHANNEL_SENSORS, gw_batch.buf, (uint32_t)gw_batch.len,
+        gw_batch_release, (void *)(uintptr_t)gw_batch_idx);
+    gw_batch_open();
+}
+
+static void gw_forward_sensor(uint8_t node_id, const uint8_t *data, uint32_t len) {
+    uint32_t now = espnow_now_ms();
+    if (gw_batch.buf == NULL) {
+        gw_batch_open();
+    }
+    if (len > UINT16_MAX) {
+        gw_stats.dropped++;
+        return;
+    }
+    if (espnow_gw_batch_add(&gw_batch, HEADER_SENSOR_SIZE, node_id, data, (uint16_t)len, now)) {
+        return;
+    }
+    // Batch full: send it and start the next one with this frame.
+    gw_batch_flush();
+    if (!espnow_gw_batch_add(&gw_batch, HEADER_SENSOR_SIZE, node_id, data, (uint16_t)len, now)) {
+        gw_stats.dropped++; // larger than a datagram, or no free batch buffer
+    }
+}
+
+static bool gw_udp_channel(espnow_virtual_port port, udp_channel_t *channel) {
+    switch (port) {
+        case DUMP:
+            *channel = UDP_CHANNEL_DUMP;
+            return true;
+        case LOGS:
+            *channel = UDP_CHANNEL_LOGS;
+            return true;
+        case VIDEO:
+            *channel = UDP_CHANNEL_VIDEO;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Forward a message flagged for UDP dispatch.
+ * @return true if the RX pool buffer `pool_idx` was handed to udp_lib
+ */
+static bool gw_forward(const header_espnow_frame_t *hd, const uint8_t *mac, uint8_t *data, uint32_t len, int pool_idx) {
+    if (hd->packet_type == SENSORS) {
+        gw_forward_sensor(espnow_gw_peers_find(&gw_peers, mac), data, len);
+        return false;
+    }
+
+    udp_channel_t channel;
+    if (!gw_udp_channel(hd->packet_type, &channel)) {
+        return false;
+    }
+    if (pool_idx >= 0) {
+        gw_stats.zero_copy++;
+        send_udp_buffer(channel, data, len, rx_pool_release, (void *)(uintptr_t)pool_idx);
+        return true;
+    }
+
+    uint8_t *copy = malloc(len);
+    if (copy == NULL) {
+        gw_stats.dropped++;
+        return false;
+    }
+    memcpy(copy, data, len);
+    gw_stats.copied++;
+    send_udp_buffer(channel, copy, len, NULL, NULL);
+    return false;
+}
+
+static void gw_periodic(uint32_t now_ms) {
+    static uint32_t last_beacon_ms = 0;
+    static uint32_t last_stats_ms = 0;
+
+    if (espnow_gw_batch_due(&gw_batch, now_ms, ESPNOW_GW_BATCH_MS)) {
+        gw_batch_flush();
+    }
+
+    if (now_ms - last_beacon_ms >= ESPNOW_DISCOVERY_PERIOD_MS) {
+        last_beacon_ms = now_ms;
+        espnow_send_discovery(broadcast_mac, ESPNOW_ROLE_GATEWAY);
+    }
+
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    while (espnow_gw_peers_expire(&gw_peers, now_ms, mac)) {
+        log_msg(TAG, "Node "MACSTR" left", MAC2STR(mac));
+        esp_now_del_peer(mac);
+
+        uint8_t current[ESP_NOW_ETH_ALEN];
+        if (espnow_get_default_peer(current) == ESP_OK && memcmp(current, mac, ESP_NOW_ETH_ALEN) == 0) {
+            default_peer_set(NULL, now_ms);
+        }
+    }
+
+    if (now_ms - last_stats_ms >= ESPNOW_GW_STATS_PERIOD_MS) {
+        last_stats_ms = now_ms;
+        if (gw_stats.batches > 0 || gw_stats.zero_copy > 0 || gw_stats.copied > 0) {
+            log_msg(TAG, "Gateway: %u nodes, %" PRIu32 " batches (%" PRIu32 " frames), %" PRIu32
+                " zero-copy, %" PRIu32 " copied, %" PRIu32 " dropped, %" PRIu32 " rejected",
+                (unsigned)espnow_gw_peers_count(&gw_peers), gw_stats.batches, gw_stats.batched_frames,
+                gw_stats.zero_copy, gw_stats.copied, gw_stats.dropped, gw_peers.rejected);
+        }
+    }
+}
+#endif
+
+static void espnow_discovery_handle(const uint8_t *mac, const uint8_t *data, uint32_t len) {
+    if (len < ESPNOW_DISCOVERY_SIZE) {
+        return;
+    }
+#if CONFIG_USE_UDPLIB
+    if (data[0] == ESPNOW_ROLE_NODE) {
+        uint8_t node_id = espnow_gw_peers_find(&gw_peers, mac);
+        if (node_id != ESPNOW_GW_NODE_NONE) {
+            gw_peers.peers[node_id].esp_id = data[1];
+        }
+    }
+#else
+    if (data[0] != ESPNOW_ROLE_GATEWAY) {
+        return;
+    }
+    uint8_t current[ESP_NOW_ETH_ALEN];
+    bool known = (espnow_get_default_peer(current) == ESP_OK);
+    if (!known || memcmp(current, mac, ESP_NOW_ETH_ALEN) != 0) {
+        if (known) {
+            return; // keep the current gateway while its beacons come
+        }
+        esp_err_t err = espnow_add_peer(mac);
+        if (err != ESP_OK) {
+            log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) while adding gateway", esp_err_to_name(err));
+            return;
+        }
+        log_msg(TAG, "Gateway "MACSTR" (esp %u) found", MAC2STR(mac), data[1]);
+    }
+    default_peer_set(mac, espnow_now_ms());
+    espnow_send_discovery(mac, ESPNOW_ROLE_NODE); // hello, keeps this node in its table
+#endif
+}
+
+/**
+ * Handle a complete message. `pool_idx` is the RX pool buffer holding a
+ * single-frame message, -1 for a reassembled one.
+ * @return true if the pool buffer was handed over (given back by its new owner)
+ */
+static bool espnow_dispatch(const header_espnow_frame_t *hd, const uint8_t *mac, uint8_t *data, uint32_t len, int pool_idx)
+{
+    bool handed_over = false;
+#if CONFIG_USE_UDPLIB
+    //udp dispatch
+    if (hd->flags & 0b00000001) {
+        handed_over = gw_forward(hd, mac, data, len, pool_idx);
+    }
+#else
+    (void)pool_idx;
+#endif
+    switch (hd->packet_type) {
+        case DUMP:
+            break;
+        case LOGS:
+            break;
+        case SENSORS:
+            break;
+        case VIDEO:
+            break;
+        case CMD:
+            //cmd_dispatch(data);
+            break;
+        case DISCOVERY:
+            espnow_discovery_handle(mac, data, len);
+            break;
+        default:
+            break;
+    }
+    return handed_over;
+}
+
+static void espnow_periodic(uint32_t now_ms)
+{
+#if CONFIG_USE_UDPLIB
+    gw_periodic(now_ms);
+#else
+    uint8_t gateway[ESP_NOW_ETH_ALEN];
+    if (espnow_get_default_peer(gateway) == ESP_OK
+        && (now_ms - default_peer_seen_ms) > ESPNOW_GW_PEER_TIMEOUT_MS) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "Gateway "MACSTR" lost", MAC2STR(gateway));
+        default_peer_set(NULL, now_ms);
+    }
+#endif
+}
 
 static void espnow_task_rx(void *pvParameter)
 {
-    esp_err_t err;
     espnow_rx_event_t evt;
-    defrag_ctx_t defrag_ctx = {0};
-
-    while (xQueueReceive(espnow_queue_rx, &evt, portMAX_DELAY) == pdTRUE) {
-        log_msg(TAG, "Receive unicast data from: "MACSTR", len: %d", MAC2STR(evt.mac_addr), evt.data_len);
-
-        header_espnow_frame_t hd = {0};
-        espnow_header_deserialize(&hd, evt.data);
-        if (!hd.needs_frag)
-        {
-
-    #if CONFIG_USE_UDPLIB
-            //udp dispatch
-            if (hd.flags & 0b00000001) {
-                switch (hd.packet_type) {
-                    case DUMP: 
-                        send_udp_dump(&evt.data[HEADER_ESPNOW_SIZE], evt.data_len - HEADER_ESPNOW_SIZE);
-                        break;
-                    case LOGS: 
-                        send_udp_log(&evt.data[HEADER_ESPNOW_SIZE], evt.data_len - HEADER_ESPNOW_SIZE);
-                        break;
-                    case SENSORS: 
-                        send_udp_sensor(&evt.data[HEADER_ESPNOW_SIZE], evt.data_len - HEADER_ESPNOW_SIZE);
-                        break;
-                    case VIDEO: 
-                        send_udp_jpeg(&evt.data[HEADER_ESPNOW_SIZE], evt.data_len - HEADER_ESPNOW_SIZE);
-                        break;
-                    default:
-                        break;
-                }
-            }
-    #endif
-            switch (hd.packet_type) {
-                case DUMP: 
-                    break;
-                case LOGS: 
-                    break;
-                case SENSORS: 
-                    break;
-                case VIDEO: 
-                    break;
-                case CMD:
-                    //cmd_dispatch(&evt.data[HEADER_ESPNOW_SIZE]);
-                    break;
-                default:
-                    break;
-            }
+    espnow_reasm_stats_t logged_stats = {0};
 
+    espnow_reasm_init(&reasm, MAX_FRAG_PAYLOAD_SIZE, ESPNOW_REASM_TIMEOUT_MS);
+#if CONFIG_USE_UDPLIB
+    espnow_gw_peers_init(&gw_peers);
+    gw_batch_open();
+#endif
+
+    while (true) {
+        TickType_t wait = pdMS_TO_TICKS(ESPNOW_RX_EXPIRE_MS);
+#if CONFIG_USE_UDPLIB
+        if (gw_batch.records > 0) {
+            wait = pdMS_TO_TICKS(ESPNOW_GW_BATCH_MS);
+        }
+#endif
+        if (xQueueReceive(espnow_queue_rx, &evt, wait) != pdTRUE) {
+            espnow_reasm_expire(&reasm, espnow_now_ms());
         } else {
-            
-            header_frag_t hd_frag = {0};
-            header_fragment_deserialize(&hd_frag, &evt.data[HEADER_ESPNOW_SIZE]);
+            uint8_t *data = rx_pool[evt.pool_idx];
+            bool handed_over = false;
+            log_msg(TAG, "Receive unicast data from: "MACSTR", len: %d", MAC2STR(evt.mac_addr), evt.data_len);
 
-            const uint8_t *payload = &evt.data[HEADER_ESPNOW_FRAG_SIZE + HEADER_ESPNOW_SIZE];
-            int payload_len = evt.data_len - HEADER_ESPNOW_SIZE - HEADER_ESPNOW_FRAG_SIZE;
+#if CONFIG_USE_UDPLIB
+            bool is_new = false;
+            uint8_t node_id = espnow_gw_peers_touch(&gw_peers, evt.mac_addr, evt.data_len, espnow_now_ms(), &is_new);
+            if (is_new) {
+                esp_err_t err = espnow_add_peer(evt.mac_addr);
+                log_msg(TAG, "Node %u: "MACSTR" (%s)", node_id, MAC2STR(evt.mac_addr), esp_err_to_name(err));
+                uint8_t current[ESP_NOW_ETH_ALEN];
+                if (espnow_get_default_peer(current) != ESP_OK) {
+                    default_peer_set(evt.mac_addr, espnow_now_ms());
+                }
+            }
+#endif
 
-            if (hd_frag.frag_idx == 0) {
-                defrag_ctx.current_frag_id = hd_frag.frag_id;
-                defrag_ctx.bytes_received = 0;
-                defrag_ctx.frags_received_count = 0;
+            header_espnow_frame_t hd = {0};
+            if (evt.data_len >= HEADER_ESPNOW_SIZE) {
+                espnow_header_deserialize(&hd, data);
             }
 
-            if (defrag_ctx.current_frag_id != hd_frag.frag_id) {
-                log_msg_lvl(ESP_LOG_WARN, TAG, "Orphaned or out-of-sync fragment dropped (ID: %u)", hd_frag.frag_id);
-                break;
+            if (evt.data_len < HEADER_ESPNOW_SIZE) {
+                log_msg_lvl(ESP_LOG_WARN, TAG, "Frame too short (%d bytes), dropped", evt.data_len);
+            } else if (!hd.needs_frag) {
+                handed_over = espnow_dispatch(&hd, evt.mac_addr, &data[HEADER_ESPNOW_SIZE],
+                    evt.data_len - HEADER_ESPNOW_SIZE, evt.pool_idx);
+            } else if (evt.data_len <= HEADER_ESPNOW_SIZE + HEADER_ESPNOW_FRAG_SIZE) {
+                log_msg_lvl(ESP_LOG_WARN, TAG, "Fragment too short (%d bytes), dropped", evt.data_len);
+            } else {
+                header_frag_t hd_frag = {0};
+                header_fragment_deserialize(&hd_frag, &data[HEADER_ESPNOW_SIZE]);
+
+                espnow_reasm_slot_t *slot = NULL;
+                espnow_reasm_result_t res = espnow_reasm_push(&reasm, evt.mac_addr, (uint8_t)hd.packet_type,
+                    hd_frag.frag_id, hd_frag.frag_total, hd_frag.frag_idx,
+                    &data[HEADER_ESPNOW_SIZE + HEADER_ESPNOW_FRAG_SIZE],
+                    evt.data_len - HEADER_ESPNOW_SIZE - HEADER_ESPNOW_FRAG_SIZE,
+                    espnow_now_ms(), &slot);
+
+                if (res == ESPNOW_REASM_COMPLETE) {
+                    espnow_dispatch(&hd, evt.mac_addr, slot->buffer, espnow_reasm_length(&reasm, slot), -1);
+                    espnow_reasm_release(&reasm, slot);
+                }
             }
 
-            uint32_t write_offset = hd_frag.frag_idx * MAX_FRAG_PAYLOAD_SIZE;
-            if ((write_offset + payload_len) > DEFRAG_BUFFER_MAX_SIZE) {
-                log_msg_lvl(ESP_LOG_ERROR, TAG, "Defrag buffer overflow prevented! Packet too large.");
-                defrag_ctx.current_frag_id = 0;
-                break;
+            if (!handed_over) {
+                xQueueSend(espnow_queue_rx_free, &evt.pool_idx, 0);
             }
-            memcpy(&defrag_ctx.buffer[write_offset], payload, payload_len);
-
-            defrag_ctx.bytes_received += payload_len;
-            defrag_ctx.frags_received_count++;
-
-            if (defrag_ctx.frags_received_count == hd_frag.frag_total) {
-    #if CONFIG_USE_UDPLIB
-            //udp dispatch
-            if (hd.flags & 0b00000001) {
-                switch (hd.packet_type) {
-                    case DUMP: 
-                        send_udp_dump(defrag_ctx.buffer, defrag_ctx.bytes_received);
-                        break;
-                    case LOGS: 
-                        send_udp_log(defrag_ctx.buffer, defrag_ctx.bytes_received);
-                        break;
-                    case SENSORS: 
-                        send_udp_sensor(defrag_ctx.buffer, defrag_ctx.bytes_received);
-                        break;
-                    case VIDEO: 
-                        send_udp_jpeg(defrag_ctx.buffer, defrag_ctx.bytes_received);
-                        break;
-                    default:
-                        break;
-                }
+        }
+
+        espnow_periodic(espnow_now_ms());
+
+        // Only report reassembly trouble when something new happened.
+        if (reasm.stats.timed_out != logged_stats.timed_out || reasm.stats.evicted != logged_stats.evicted
+            || reasm.stats.invalid != logged_stats.invalid) {
+            log_msg_lvl(ESP_LOG_WARN, TAG, "Reassembly: %" PRIu32 " completed, %" PRIu32 " timed out, %" PRIu32
+                " evicted, %" PRIu32 " duplicates, %" PRIu32 " invalid",
+                reasm.stats.completed, reasm.stats.timed_out, reasm.stats.evicted,
+                reasm.stats.duplicates, reasm.stats.invalid);
+            logged_stats = reasm.stats;
+        }
+    }
+}
+
+// --- TX: per-peer window ---
+//
+// Every peer gets a window of frames in flight. A frame leaves the window
+// when its send callback comes back (ESP-NOW reports them in send order
+// for a given peer), or after ESPNOW_TX_TIMEOUT_MS if the callback got
+// lost. Callbacks carry no tag, so each frame gets the number of its send
+// and the n-th callback of a peer is matched with its n-th frame: the late
+// callback of a frame that already timed out is dropped instead of closing
+// whichever frame is at the head by then. New frames only go out while the
+// window is open, so a long fragmented message can no longer flood the
+// driver. The broadcast address (discovery) has a window of its own, it
+// never takes one from a unicast peer. Frames of reliable
+// ports (DUMP, CMD) are kept until acknowledged and only the failed ones
+// are sent again; the other ports are fire-and-forget.
+
+typedef struct {
+    uint8_t frame[ESPNOW_MSG_SIZE]; // copy kept for reliable frames only
+    uint8_t len;
+    bool reliable;
+    uint8_t retries;
+    uint32_t seq;    // send number, matched against the callbacks
+    int64_t sent_us;
+} espnow_inflight_t;
+
+typedef struct {
+    bool used;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    espnow_inflight_t inflight[ESPNOW_TX_WINDOW_MAX]; // FIFO, oldest at head
+    uint8_t head;
+    uint8_t count;
+    uint32_t seq_sent;       // frames accepted by esp_now_send
+    uint32_t seq_done;       // send callbacks received
+    int64_t owed_since_us;   // a timed-out frame still owes its callback since, 0 = none
+    espnow_tx_stats_t stats;
+    uint64_t bytes_acked_at_period_start;
+} espnow_tx_peer_t;
+
+#define TX_BROADCAST_SLOT ESPNOW_TX_PEERS
+#define TX_SLOTS (ESPNOW_TX_PEERS + 1)
+
+static espnow_tx_peer_t tx_peers[TX_SLOTS];
+static portMUX_TYPE tx_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool espnow_port_is_reliable(espnow_virtual_port port) {
+    return port == DUMP || port == CMD;
+}
+
+static void tx_peer_reset(espnow_tx_peer_t *peer, const uint8_t *mac) {
+    // under the stats lock: espnow_get_tx_stats never sees a half-reused peer
+    taskENTER_CRITICAL(&tx_stats_lock);
+    memset(peer, 0, sizeof(*peer));
+    peer->used = true;
+    memcpy(peer->mac, mac, ESP_NOW_ETH_ALEN);
+    taskEXIT_CRITICAL(&tx_stats_lock);
+}
+
+/**
+ * Window of a peer. When all slots are taken, a new peer takes over one
+ * with nothing in flight (its stats restart): a gateway talks to more
+ * nodes than it has windows, just not to all of them at once.
+ */
+static espnow_tx_peer_t *tx_peer_find(const uint8_t *mac, bool create) {
+    if (memcmp(mac, broadcast_mac, ESP_NOW_ETH_ALEN) == 0) {
+        espnow_tx_peer_t *broadcast = &tx_peers[TX_BROADCAST_SLOT];
+        if (!broadcast->used && create) {
+            tx_peer_reset(broadcast, mac);
+        }
+        return broadcast->used ? broadcast : NULL;
+    }
+
+    espnow_tx_peer_t *free_peer = NULL;
+    espnow_tx_peer_t *idle_peer = NULL;
+    for (size_t i = 0; i < ESPNOW_TX_PEERS; i++) {
+        if (tx_peers[i].used) {
+            if (memcmp(tx_peers[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+                return &tx_peers[i];
             }
-    #endif
-                defrag_ctx.current_frag_id = 0;
+            if (idle_peer == NULL && tx_peers[i].count == 0) {
+                idle_peer = &tx_peers[i];
             }
+        } else if (free_peer == NULL) {
+            free_peer = &tx_peers[i];
+        }
+    }
+    if (free_peer == NULL) {
+        free_peer = idle_peer;
+    }
+    if (!create || free_peer == NULL) {
+        return NULL;
+    }
+    tx_peer_reset(free_peer, mac);
+    return free_peer;
+}
 
-            break;
+static bool tx_window_open(const espnow_tx_peer_t *peer) {
+    return peer->count < CONFIG_ESPNOW_TX_WINDOW;
+}
+
+/**
+ * Hand one frame to the driver and track it in the peer's window.
+ * @return false if the driver has no room left (try again later)
+ */
+static bool tx_send_frame(espnow_tx_peer_t *peer, const uint8_t *frame, uint8_t len, bool reliable, uint8_t retries) {
+    esp_err_t err = esp_now_send(peer->mac, frame, len);
+    if (err == ESP_ERR_ESPNOW_NO_MEM) {
+        return false;
+    }
+
+    taskENTER_CRITICAL(&tx_stats_lock);
+    if (err != ESP_OK) {
+        peer->stats.failures++;
+    } else {
+        peer->stats.frames_sent++;
+    }
+    taskEXIT_CRITICAL(&tx_stats_lock);
+
+    if (err != ESP_OK) {
+        //using serial because otherwise infinite loop of same message
+        ESP_LOGW(TAG, "Error (%s) sending espnow message", esp_err_to_name(err));
+        return true; // dropped, not retried
+    }
+
+    espnow_inflight_t *entry = &peer->inflight[(peer->head + peer->count) % ESPNOW_TX_WINDOW_MAX];
+    entry->len = len;
+    entry->reliable = reliable;
+    entry->retries = retries;
+    entry->seq = peer->seq_sent++;
+    entry->sent_us = esp_timer_get_time();
+    if (reliable) {
+        memcpy(entry->frame, frame, len);
+    }
+    peer->count++;
+    return true;
+}
+
+/** Oldest frame in flight for this peer is done: acknowledged or not. */
+static void tx_complete(espnow_tx_peer_t *peer, bool acked) {
+    if (peer->count == 0) {
+        return;
+    }
+    // Copied out: a retry goes back to the tail, which may be this slot.
+    espnow_inflight_t entry = peer->inflight[peer->head];
+    peer->head = (peer->head + 1) % ESPNOW_TX_WINDOW_MAX;
+    peer->count--;
+
+    if (!acked && entry.reliable && entry.retries < ESPNOW_TX_MAX_RETRIES) {
+        taskENTER_CRITICAL(&tx_stats_lock);
+        peer->stats.retries++;
+        taskEXIT_CRITICAL(&tx_stats_lock);
+        if (tx_send_frame(peer, entry.frame, entry.len, true, entry.retries + 1)) {
+            return;
         }
-        free(evt.data);
+        // Driver full: counted as a failure below.
+    }
 
+    taskENTER_CRITICAL(&tx_stats_lock);
+    if (acked) {
+        peer->stats.frames_acked++;
+        peer->stats.bytes_acked += entry.len;
+    } else {
+        peer->stats.failures++;
     }
+    taskEXIT_CRITICAL(&tx_stats_lock);
 }
 
-static void espnow_task_tx(void *pvParameter)
-{
-    espnow_tx_event_t evt;
+/** Send number of the next callback that closes a frame still in the window. */
+static uint32_t tx_next_seq(const espnow_tx_peer_t *peer) {
+    return (peer->count > 0) ? peer->inflight[peer->head].seq : peer->seq_sent;
+}
+
+/** Send callback of a peer: ESP-NOW calls back once per accepted frame, in send order. */
+static void tx_callback(espnow_tx_peer_t *peer, bool acked) {
+    uint32_t seq = peer->seq_done;
+    if ((int32_t)(seq - peer->seq_sent) >= 0) {
+        return; // callback of a frame sent before the window was reset
+    }
+    peer->seq_done++;
+    if (peer->seq_done == tx_next_seq(peer)) {
+        peer->owed_since_us = 0; // caught up with the window
+    }
 
-    //task to monitor that tx is doing well
-    while (xQueueReceive(espnow_queue_tx, &evt, portMAX_DELAY) == pdTRUE) {
-        log_msg(TAG, "Send data to "MACSTR", status1: %d", MAC2STR(evt.mac_addr), evt.status); 
+    if (peer->count == 0 || peer->inflight[peer->head].seq != seq) {
+        ESP_LOGD(TAG, "Late send callback from "MACSTR" ignored", MAC2STR(peer->mac));
+        return; // its frame already timed out
     }
+    tx_complete(peer, acked);
 }
 
-static void espnow_send_fragmented(espnow_msg_t *msg, uint32_t *running_frag_id) {
-    uint32_t total_size_payload = msg->len;
-    header_frag_t hd = {0};
-    uint8_t buf[ESPNOW_MSG_SIZE];
-    
-    hd.frag_id = *running_frag_id;
-    hd.frag_total = (total_size_payload + MAX_FRAG_PAYLOAD_SIZE - 1) / MAX_FRAG_PAYLOAD_SIZE;
-
-    for (uint16_t i = 0; i < hd.frag_total; i++) {
-        uint32_t offset = i * MAX_FRAG_PAYLOAD_SIZE;
-        hd.frag_idx = i;
-        uint16_t payload_size = (i == hd.frag_total - 1) ? (total_size_payload - offset) : MAX_FRAG_PAYLOAD_SIZE;
-
-        header_fragment_serialize(&hd, &buf[HEADER_ESPNOW_SIZE]);
-        memcpy(&buf[HEADER_ESPNOW_SIZE + HEADER_ESPNOW_FRAG_SIZE], msg->data + offset, payload_size);
-        
-        int err = esp_now_send(mac_esp_peer, buf, payload_size + HEADER_ESPNOW_FRAG_SIZE);
-        if (err != ESP_OK) {
-            //using serial because otherwise infinite loop of same message
-            ESP_LOGW(TAG, "Error (%s) sending espnow message", esp_err_to_name(err));
-        } else {
-            ESP_LOGD(TAG, "Sending message (len: %u)", payload_size);
+static void tx_check_timeouts(void) {
+    int64_t now = esp_timer_get_time();
+    for (size_t i = 0; i < TX_SLOTS; i++) {
+        espnow_tx_peer_t *peer = &tx_peers[i];
+        while (peer->used && peer->count > 0
+            && (now - peer->inflight[peer->head].sent_us) > (int64_t)ESPNOW_TX_TIMEOUT_MS * 1000) {
+            if (peer->owed_since_us == 0) {
+                peer->owed_since_us = now;
+            }
+            tx_complete(peer, false);
+        }
+        // Callbacks that never came at all: stop waiting for them, or every
+        // later callback would be matched with the frame before its own.
+        if (peer->owed_since_us != 0 && (now - peer->owed_since_us) > (int64_t)ESPNOW_TX_CALLBACK_LOST_MS * 1000) {
+            peer->seq_done = tx_next_seq(peer);
+            peer->owed_since_us = 0;
         }
     }
+}
+
+static void tx_update_stats(int64_t period_us) {
+    for (size_t i = 0; i < TX_SLOTS; i++) {
+        espnow_tx_peer_t *peer = &tx_peers[i];
+        if (!peer->used) {
+            continue;
+        }
+        taskENTER_CRITICAL(&tx_stats_lock);
+        uint64_t acked = peer->stats.bytes_acked - peer->bytes_acked_at_period_start;
+        peer->stats.throughput_bps = (uint32_t)((acked * 1000000ULL) / (uint64_t)period_us);
+        peer->bytes_acked_at_period_start = peer->stats.bytes_acked;
+        espnow_tx_stats_t stats = peer->stats;
+        taskEXIT_CRITICAL(&tx_stats_lock);
+
+        if (stats.frames_sent > 0) {
+            ESP_LOGI(TAG, "TX "MACSTR": %" PRIu32 " B/s, %" PRIu32 " sent, %" PRIu32 " acked, %" PRIu32
+                " retries, %" PRIu32 " failures", MAC2STR(peer->mac), stats.throughput_bps,
+                stats.frames_sent, stats.frames_acked, stats.retries, stats.failures);
+        }
+    }
+}
+
+/**
+ * Build frame `index` of a message: [base header][payload] when it fits in
+ * one frame, otherwise [base header][fragment header][chunk].
+ */
+static uint8_t espnow_build_frame(const espnow_msg_t *msg, uint32_t index, uint32_t frag_id, uint8_t *buf) {
+    header_espnow_frame_t hd = msg->hd;
+    hd.needs_frag = (msg->len + HEADER_ESPNOW_SIZE) > ESPNOW_MSG_SIZE;
+    espnow_header_serialize(&hd, buf);
+
+    if (!hd.needs_frag) {
+        memcpy(&buf[HEADER_ESPNOW_SIZE], msg->data, msg->len);
+        return (uint8_t)(HEADER_ESPNOW_SIZE + msg->len);
+    }
 
-    (*running_frag_id)++;
+    header_frag_t hd_frag = {
+        .frag_id = frag_id,
+        .frag_total = (uint8_t)((msg->len + MAX_FRAG_PAYLOAD_SIZE - 1) / MAX_FRAG_PAYLOAD_SIZE),
+        .frag_idx = (uint8_t)index,
+    };
+    uint32_t offset = index * MAX_FRAG_PAYLOAD_SIZE;
+    uint32_t chunk = (msg->len - offset > MAX_FRAG_PAYLOAD_SIZE) ? MAX_FRAG_PAYLOAD_SIZE : msg->len - offset;
+
+    header_fragment_serialize(&hd_frag, &buf[HEADER_ESPNOW_SIZE]);
+    memcpy(&buf[HEADER_ESPNOW_SIZE + HEADER_ESPNOW_FRAG_SIZE], msg->data + offset, chunk);
+    return (uint8_t)(HEADER_ESPNOW_SIZE + HEADER_ESPNOW_FRAG_SIZE + chunk);
+}
+
+static uint32_t espnow_frame_count(const espnow_msg_t *msg) {
+    if (msg->len + HEADER_ESPNOW_SIZE <= ESPNOW_MSG_SIZE) {
+        return 1;
+    }
+    return (msg->len + MAX_FRAG_PAYLOAD_SIZE - 1) / MAX_FRAG_PAYLOAD_SIZE;
 }
 
 static void espnow_task_send(void *pvParameter)
 {
-    esp_err_t err;
     espnow_msg_t msg;
-    uint32_t local_frag_id = 0;
+    bool has_msg = false;
+    uint32_t next_frame = 0;
+    uint32_t frame_total = 0;
+    uint32_t frag_id = 0;
+    espnow_tx_peer_t *peer = NULL;
+    int64_t stats_start_us = esp_timer_get_time();
+    uint8_t buf[ESPNOW_MSG_SIZE];
 
-    while (xQueueReceive(espnow_queue_send, &msg, portMAX_DELAY) == pdTRUE) {
-        //check if message needs fragmentation
-        if (msg.len > ESPNOW_MSG_SIZE) {
-            espnow_send_fragmented(&msg, &local_frag_id);
-        } else {
-            xSemaphoreTake(espnow_tx_sem, pdMS_TO_TICKS(100));
-            err = esp_now_send(mac_esp_peer, msg.data, msg.len);
-            if (err != ESP_OK) {
-                //using serial because otherwise infinite loop of same message
-                ESP_LOGW(TAG, "Error (%s) sending espnow message", esp_err_to_name(err));
-            } else {
-                ESP_LOGD(TAG, "Sending message (len: %u)", msg.len);
+    while (true) {
+        // Woken by a send callback or a new message, or periodically for timeouts.
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ESPNOW_TX_TIMEOUT_MS));
+
+        espnow_tx_event_t evt;
+        while (xQueueReceive(espnow_queue_tx, &evt, 0) == pdTRUE) {
+            espnow_tx_peer_t *done_peer = tx_peer_find(evt.mac_addr, false);
+            if (done_peer != NULL) {
+                tx_callback(done_peer, evt.status == ESP_NOW_SEND_SUCCESS);
+            }
+        }
+        tx_check_timeouts();
+
+        // Push frames while the current peer's window is open.
+        while (true) {
+            if (!has_msg) {
+                if (xQueueReceive(espnow_queue_send, &msg, 0) != pdTRUE) {
+                    break;
+                }
+                peer = tx_peer_find(msg.mac_addr, true);
+                if (peer == NULL || msg.len > ESPNOW_REASM_MAX_SIZE) {
+                    log_msg_lvl(ESP_LOG_WARN, TAG, "Message to "MACSTR" dropped (%s)", MAC2STR(msg.mac_addr),
+                        peer == NULL ? "too many peers" : "too large");
+                    free(msg.data);
+                    continue;
+                }
+                has_msg = true;
+                next_frame = 0;
+                frame_total = espnow_frame_count(&msg);
+                if (frame_total > 1) {
+                    frag_id++;
+                }
+            }
+
+            if (!tx_window_open(peer)) {
+                break; // wait for callbacks
             }
+
+            uint8_t len = espnow_build_frame(&msg, next_frame, frag_id, buf);
+            if (!tx_send_frame(peer, buf, len, espnow_port_is_reliable(msg.hd.packet_type), 0)) {
+                break; // driver queue full, retry on the next callback
+            }
+            ESP_LOGD(TAG, "Sending frame %" PRIu32 "/%" PRIu32 " (len: %u)", next_frame + 1, frame_total, len);
+
+            if (++next_frame == frame_total) {
+                free(msg.data);
+                has_msg = false;
+            }
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (now - stats_start_us >= (int64_t)ESPNOW_TX_STATS_PERIOD_MS * 1000) {
+            tx_update_stats(now - stats_start_us);
+            stats_start_us = now;
         }
-        free(msg.data);
     }
 }
 
+esp_err_t espnow_get_tx_stats(const uint8_t *mac, espnow_tx_stats_t *stats) {
+    if (mac == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // looked up under the lock: the sender task may reuse the slot for another peer
+    taskENTER_CRITICAL(&tx_stats_lock);
+    espnow_tx_peer_t *peer = tx_peer_find(mac, false);
+    if (peer != NULL) {
+        *stats = peer->stats;
+    }
+    taskEXIT_CRITICAL(&tx_stats_lock);
+    return peer == NULL ? ESP_ERR_NOT_FOUND : ESP_OK;
+}
+
+esp_err_t espnow_get_queue_fill(espnow_queue_t queue, uint8_t *waiting, uint8_t *length) {
+    QueueHandle_t handles[ESPNOW_QUEUE_COUNT] = {
+        [ESPNOW_QUEUE_RX] = espnow_queue_rx,
+        [ESPNOW_QUEUE_RX_FREE] = espnow_queue_rx_free,
+        [ESPNOW_QUEUE_TX_EVENTS] = espnow_queue_tx,
+        [ESPNOW_QUEUE_SEND] = espnow_queue_send,
+    };
+    if (queue >= ESPNOW_QUEUE_COUNT || waiting == NULL || length == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handles[queue] == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    UBaseType_t used = uxQueueMessagesWaiting(handles[queue]);
+    UBaseType_t total = used + uxQueueSpacesAvailable(handles[queue]);
+    *waiting = (uint8_t)(used > UINT8_MAX ? UINT8_MAX : used);
+    *length = (uint8_t)(total > UINT8_MAX ? UINT8_MAX : total);
+    return ESP_OK;
+}
+
+#if CONFIG_ESPNOW_TX_BENCHMARK
+#define ESPNOW_BENCH_MSG_SIZE 1024
+#define ESPNOW_BENCH_DURATION_MS 10000
+
+// Streams DUMP messages (reliable port) to the peer for a fixed duration
+// and reports the acknowledged throughput; run it on one ESP32 with the
+// other one simply receiving.
+static void espnow_benchmark_task(void *pvParameter)
+{
+    static uint8_t payload[ESPNOW_BENCH_MSG_SIZE];
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)i;
+    }
+    uint8_t peer[ESP_NOW_ETH_ALEN];
+    while (espnow_get_default_peer(peer) != ESP_OK) {
+        vTaskDelay(pdMS_TO_TICKS(ESPNOW_DISCOVERY_PERIOD_MS)); // wait for discovery
+    }
+
+    espnow_tx_stats_t before = {0};
+    espnow_get_tx_stats(peer, &before);
+    int64_t start = esp_timer_get_time();
+    uint32_t queued = 0;
+
+    while (esp_timer_get_time() - start < (int64_t)ESPNOW_BENCH_DURATION_MS * 1000) {
+        if (uxQueueSpacesAvailable(espnow_queue_send) == 0) {
+            vTaskDelay(1);
+            continue;
+        }
+        header_espnow_frame_t hd = { .flags = 0, .packet_type = DUMP };
+        send_espnow_msg_to(peer, &hd, payload, sizeof(payload));
+        queued++;
+    }
+    vTaskDelay(pdMS_TO_TICKS(ESPNOW_TX_TIMEOUT_MS * 2)); // drain the window
+
+    espnow_tx_stats_t after = {0};
+    espnow_get_tx_stats(peer, &after);
+    int64_t elapsed_ms = (esp_timer_get_time() - start) / 1000;
+    uint64_t acked = after.bytes_acked - before.bytes_acked;
+    log_msg(TAG, "Benchmark: %" PRIu32 " msgs of %d B, %" PRIu64 " B acked in %" PRId64 " ms (%" PRIu64
+        " B/s, window %d), %" PRIu32 " retries, %" PRIu32 " failures",
+        queued, ESPNOW_BENCH_MSG_SIZE, acked, elapsed_ms, elapsed_ms > 0 ? acked * 1000 / elapsed_ms : 0,
+        CONFIG_ESPNOW_TX_WINDOW, after.retries - before.retries, after.failures - before.failures);
+    vTaskDelete(NULL);
+}
+#endif
+
 void espnow_init(void)
 {
     esp_err_t err;
-    esp_now_peer_info_t peer = {0};
 
     if (espnow_queue_send != NULL || espnow_queue_rx != NULL || espnow_queue_tx != NULL) {
         log_msg_lvl(ESP_LOG_WARN, TAG, "ESP-NOW already initialized");
@@ -337,22 +976,37 @@ void espnow_init(void)
         return;
     }
 
-    espnow_tx_sem = xSemaphoreCreateBinary();
-    if (espnow_tx_sem == NULL) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Create tx semaphore fail");
+    espnow_queue_rx = xQueueCreate(ESPNOW_RX_QUEUE_SIZE, sizeof(espnow_rx_event_t));
+    if (espnow_queue_rx == NULL) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Create rx queue fail");
         espnow_deinit();
         return;
     }
-    xSemaphoreGive(espnow_tx_sem);
 
-    espnow_queue_rx = xQueueCreate(ESPNOW_RX_QUEUE_SIZE, sizeof(espnow_rx_event_t));
-    if (espnow_queue_rx == NULL) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Create rx queue fail");
+    espnow_queue_rx_free = xQueueCreate(ESPNOW_RX_POOL_SIZE, sizeof(uint8_t));
+    if (espnow_queue_rx_free == NULL) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Create rx free queue fail");
         espnow_deinit();
         return;
     }
+    for (uint8_t i = 0; i < ESPNOW_RX_POOL_SIZE; i++) {
+        xQueueSend(espnow_queue_rx_free, &i, 0);
+    }
 
-    espnow_queue_tx = xQueueCreate(ESPNOW_TX_QUEUE_SIZE, sizeof(espnow_tx_event_t));
+#if CONFIG_USE_UDPLIB
+    gw_batch_free = xQueueCreate(ESPNOW_GW_BATCH_BUFFERS, sizeof(uint8_t));
+    if (gw_batch_free == NULL) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Create gateway batch queue fail");
+        espnow_deinit();
+        return;
+    }
+    for (uint8_t i = 0; i < ESPNOW_GW_BATCH_BUFFERS; i++) {
+        xQueueSend(gw_batch_free, &i, 0);
+    }
+#endif
+
+    // One send callback per frame in flight, for every peer
+    espnow_queue_tx = xQueueCreate(TX_SLOTS * ESPNOW_TX_WINDOW_MAX, sizeof(espnow_tx_event_t));
     if (espnow_queue_tx == NULL) {
         log_msg_lvl(ESP_LOG_ERROR, TAG, "Create tx queue fail");
         espnow_deinit();
@@ -393,32 +1047,8 @@ void espnow_init(void)
         return;
     }
 
-    peer.channel = 1;
-#if CONFIG_USE_AP_MODE
-    peer.ifidx = WIFI_IF_AP;
-#else
-    peer.ifidx = WIFI_IF_AP;
-#endif
-    peer.encrypt = false;
-    memcpy(peer.peer_addr, broadcast_mac, ESP_NOW_ETH_ALEN);
-    err = esp_now_add_peer(&peer);
-    if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) while adding peer", esp_err_to_name(err));
-        espnow_deinit();
-        return;
-    }
-
-    /* Add ESP sensor peer information to peer list. */
-    memset(&peer, 0, sizeof(esp_now_peer_info_t));
-    peer.channel = 1;
-#if CONFIG_USE_AP_MODE
-    peer.ifidx = WIFI_IF_AP;
-#else
-    peer.ifidx = WIFI_IF_AP;
-#endif
-    peer.encrypt = false;
-    memcpy(peer.peer_addr, mac_esp_peer, ESP_NOW_ETH_ALEN);
-    err = esp_now_add_peer(&peer);
+    /* Broadcast peer, for discovery. Gateway and nodes are added as they are discovered. */
+    err = espnow_add_peer(broadcast_mac);
     if (err != ESP_OK) {
         log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) while adding peer", esp_err_to_name(err));
         espnow_deinit();
@@ -426,8 +1056,10 @@ void espnow_init(void)
     }
 
     xTaskCreate(espnow_task_rx, "espnow_task_rx", 4096, NULL, 4, NULL);
-    xTaskCreate(espnow_task_tx, "espnow_task_tx", 2048, NULL, 4, NULL);
-    xTaskCreate(espnow_task_send, "espnow_task_send", 4096, NULL, 4, NULL);
+    xTaskCreate(espnow_task_send, "espnow_task_send", 4096, NULL, 4, &espnow_send_task_handle);
+#if CONFIG_ESPNOW_TX_BENCHMARK
+    xTaskCreate(espnow_benchmark_task, "espnow_bench", 3072, NULL, 3, NULL);
+#endif
 
     log_msg(TAG, "ESP-NOW initialized");
 }
@@ -438,32 +1070,53 @@ static void espnow_deinit()
     if (espnow_queue_rx) { vQueueDelete(espnow_queue_rx); espnow_queue_rx = NULL; }
     if (espnow_queue_tx) { vQueueDelete(espnow_queue_tx); espnow_queue_tx = NULL; }
     if (espnow_queue_send) { vQueueDelete(espnow_queue_send); espnow_queue_send = NULL; }
+    if (espnow_queue_rx_free) { vQueueDelete(espnow_queue_rx_free); espnow_queue_rx_free = NULL; }
+#if CONFIG_USE_UDPLIB
+    if (gw_batch_free) { vQueueDelete(gw_batch_free); gw_batch_free = NULL; }
+#endif
     esp_now_deinit();
 }
 
-void send_espnow_msg(header_espnow_frame_t *hd, const uint8_t * data, uint32_t len){
+void send_espnow_msg_to(const uint8_t *mac, header_espnow_frame_t *hd, const uint8_t * data, uint32_t len){
 
-    if (data == NULL || espnow_queue_send == NULL) {
+    if (mac == NULL || hd == NULL || data == NULL || espnow_queue_send == NULL) {
         log_msg_lvl(ESP_LOG_ERROR, TAG, "Invalid args send espnow");
         return;
     }
+    if (len > ESPNOW_REASM_MAX_SIZE) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Message too large for ESP-NOW (%" PRIu32 " bytes)", len);
+        return;
+    }
     hd->needs_frag = (len + HEADER_ESPNOW_SIZE) > ESPNOW_MSG_SIZE;
 
-    uint8_t *buf_cpy = malloc(len + HEADER_ESPNOW_SIZE);
+    // Only the payload is copied; headers are written per frame by the send task.
+    uint8_t *buf_cpy = malloc(len);
     if (buf_cpy != NULL) {
-
-        espnow_header_serialize(hd, buf_cpy);
-        memcpy(buf_cpy + HEADER_ESPNOW_SIZE, data, len);
+        memcpy(buf_cpy, data, len);
 
         espnow_msg_t msg = {0};
+        memcpy(msg.mac_addr, mac, ESP_NOW_ETH_ALEN);
+        msg.hd = *hd;
         msg.data = buf_cpy;
-        msg.len = len + HEADER_ESPNOW_SIZE;
+        msg.len = (uint16_t)len;
     
         if (xQueueSend(espnow_queue_send, &msg, 0) != pdTRUE) {
             log_msg_lvl(ESP_LOG_WARN, TAG, "Queue full, freeing data");
             free(msg.data);
+        } else if (espnow_send_task_handle != NULL) {
+            xTaskNotifyGive(espnow_send_task_handle);
         }
     } else {
         log_msg_lvl(ESP_LOG_ERROR, TAG, "Failed allocating buf cpy");
     }
-}
\ No newline at end of file
+}
+
+void send_espnow_msg(header_espnow_frame_t *hd, const uint8_t * data, uint32_t len){
+    uint8_t peer[ESP_NOW_ETH_ALEN];
+    if (espnow_get_default_peer(peer) != ESP_OK) {
+        //using serial because otherwise infinite loop of same message
+        ESP_LOGD(TAG, "No peer discovered yet, message dropped");
+        return;
+    }
+    send_espnow_msg_to(peer, hd, data, len);
+}
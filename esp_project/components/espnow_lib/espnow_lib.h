@@ -2,8 +2,11 @@
 #define ESPNOW_LIB_H_
 
 #define ESPNOW_MSG_SIZE 250
+#define ESPNOW_MAC_LEN 6
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <esp_err.h>
 
 typedef enum espnow_virtual_port_e {
     DUMP = 0,
@@ -11,12 +14,22 @@ typedef enum espnow_virtual_port_e {
     SENSORS = 2,
     VIDEO = 3,
     CMD = 4,
+    DISCOVERY = 5,
 } espnow_virtual_port;
 
-typedef struct espnow_msg_st {
-    uint8_t *data;
-    uint8_t len;
-} espnow_msg_t;
+// --- Discovery ---
+// The gateway (node with CONFIG_USE_UDPLIB) broadcasts a DISCOVERY beacon
+// every ESPNOW_DISCOVERY_PERIOD_MS; nodes take the first gateway they hear
+// as their default peer and answer every beacon with a hello, which keeps
+// them in the gateway's peer table (espnow_gateway.h).
+// DISCOVERY payload: [0] = role, [1] = esp_id.
+#define ESPNOW_DISCOVERY_PERIOD_MS 1000
+#define ESPNOW_DISCOVERY_SIZE 2
+
+typedef enum {
+    ESPNOW_ROLE_NODE = 0,
+    ESPNOW_ROLE_GATEWAY = 1,
+} espnow_role_t;
 
 #define HEADER_ESPNOW_SIZE (3 * sizeof(uint8_t))
 
@@ -26,9 +39,76 @@ typedef struct header_espnow_frame_st {
     uint8_t needs_frag;
 } header_espnow_frame_t;
 
+// Message waiting in the send queue: payload only, the headers are written
+// frame by frame when it is sent.
+typedef struct espnow_msg_st {
+    uint8_t mac_addr[ESPNOW_MAC_LEN];
+    header_espnow_frame_t hd;
+    uint8_t *data;
+    uint16_t len;
+} espnow_msg_t;
+
+// --- TX flow control ---
+// Frames in flight per peer are capped by CONFIG_ESPNOW_TX_WINDOW (at most
+// ESPNOW_TX_WINDOW_MAX). DUMP and CMD frames are sent again when their send
+// callback reports a failure, up to ESPNOW_TX_MAX_RETRIES times; other
+// ports are fire-and-forget.
+#define ESPNOW_TX_PEERS 4              // unicast windows, the broadcast address has its own
+#define ESPNOW_TX_WINDOW_MAX 8
+#define ESPNOW_TX_MAX_RETRIES 3
+#define ESPNOW_TX_TIMEOUT_MS 100       // frame given up if its callback never comes
+#define ESPNOW_TX_CALLBACK_LOST_MS 1000 // callbacks of timed-out frames still expected this long
+#define ESPNOW_TX_STATS_PERIOD_MS 10000
+
+typedef struct {
+    uint32_t frames_sent;    // handed to the driver, retries included
+    uint32_t frames_acked;
+    uint32_t retries;
+    uint32_t failures;       // frames lost for good
+    uint64_t bytes_acked;
+    uint32_t throughput_bps; // acked bytes/s over the last stats period
+} espnow_tx_stats_t;
 
 void espnow_init(void);
 
+/**
+ * Queue a message for the default peer (the gateway on a node, the first
+ * node heard on the gateway). Dropped while no peer was discovered yet.
+ */
 void send_espnow_msg(header_espnow_frame_t *hd, const uint8_t * data, uint32_t len);
 
-#endif
\ No newline at end of file
+/**
+ * Queue a message for a given peer (must already be registered with ESP-NOW).
+ */
+void send_espnow_msg_to(const uint8_t *mac, header_espnow_frame_t *hd, const uint8_t * data, uint32_t len);
+
+/**
+ * MAC of the default peer.
+ *
+ * @return ESP_ERR_NOT_FOUND while no peer was discovered
+ */
+esp_err_t espnow_get_default_peer(uint8_t *mac);
+
+/**
+ * TX counters of a peer, since boot.
+ *
+ * @return ESP_ERR_NOT_FOUND if nothing was ever sent to this peer
+ */
+esp_err_t espnow_get_tx_stats(const uint8_t *mac, espnow_tx_stats_t *stats);
+
+typedef enum {
+    ESPNOW_QUEUE_RX = 0,    // received frames waiting for the rx task
+    ESPNOW_QUEUE_RX_FREE,   // free rx buffers (low = rx task behind)
+    ESPNOW_QUEUE_TX_EVENTS, // send callbacks waiting for the tx task
+    ESPNOW_QUEUE_SEND,      // messages waiting to be sent
+    ESPNOW_QUEUE_COUNT,
+} espnow_queue_t;
+
+/**
+ * Fill level of an internal queue.
+ *
+ * @return ESP_ERR_INVALID_STATE before espnow_init
+ */
+esp_err_t espnow_get_queue_fill(espnow_queue_t queue, uint8_t *waiting, uint8_t *length);
+
+#endif
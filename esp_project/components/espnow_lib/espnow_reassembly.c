@@ -0,0 +1,161 @@
+#include "espnow_reassembly.h"
+#include <string.h>
+
+void espnow_reasm_init(espnow_reasm_t *reasm, uint32_t frag_payload_size, uint32_t timeout_ms) {
+    memset(reasm, 0, sizeof(*reasm));
+    reasm->frag_payload_size = frag_payload_size;
+    reasm->timeout_ms = timeout_ms;
+}
+
+static bool slot_matches(const espnow_reasm_slot_t *slot, const uint8_t *mac, uint8_t port, uint32_t frag_id) {
+    return slot->used && slot->frag_id == frag_id && slot->port == port
+        && memcmp(slot->mac, mac, ESPNOW_REASM_MAC_LEN) == 0;
+}
+
+static bool recently_completed(const espnow_reasm_t *reasm, const uint8_t *mac, uint8_t port,
+    uint32_t frag_id, uint32_t now_ms) {
+    for (size_t i = 0; i < ESPNOW_REASM_RECENT; i++) {
+        const espnow_reasm_recent_t *recent = &reasm->recent[i];
+        if (recent->used && recent->frag_id == frag_id && recent->port == port
+            && memcmp(recent->mac, mac, ESPNOW_REASM_MAC_LEN) == 0
+            && (now_ms - recent->completed_ms) < reasm->timeout_ms) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void remember_completed(espnow_reasm_t *reasm, const espnow_reasm_slot_t *slot, uint32_t now_ms) {
+    espnow_reasm_recent_t *recent = &reasm->recent[reasm->recent_next];
+    reasm->recent_next = (uint8_t)((reasm->recent_next + 1) % ESPNOW_REASM_RECENT);
+    recent->used = true;
+    memcpy(recent->mac, slot->mac, ESPNOW_REASM_MAC_LEN);
+    recent->port = slot->port;
+    recent->frag_id = slot->frag_id;
+    recent->completed_ms = now_ms;
+}
+
+static uint32_t full_mask(uint8_t frag_total) {
+    return (frag_total >= 32) ? UINT32_MAX : ((1u << frag_total) - 1);
+}
+
+/**
+ * Free slot, or the oldest incomplete one (evicted) if the pool is full.
+ * Completed slots waiting for their release are never taken over.
+ */
+static espnow_reasm_slot_t *claim_slot(espnow_reasm_t *reasm, uint32_t now_ms) {
+    espnow_reasm_slot_t *oldest = NULL;
+    for (size_t i = 0; i < ESPNOW_REASM_SLOTS; i++) {
+        espnow_reasm_slot_t *slot = &reasm->slots[i];
+        if (!slot->used) {
+            return slot;
+        }
+        if (slot->received_mask == full_mask(slot->frag_total)) {
+            continue;
+        }
+        if (oldest == NULL || (now_ms - slot->started_ms) > (now_ms - oldest->started_ms)) {
+            oldest = slot;
+        }
+    }
+    if (oldest != NULL) {
+        reasm->stats.evicted++;
+    }
+    return oldest;
+}
+
+espnow_reasm_result_t espnow_reasm_push(espnow_reasm_t *reasm, const uint8_t *mac, uint8_t port,
+    uint32_t frag_id, uint8_t frag_total, uint8_t frag_idx, const uint8_t *payload, uint32_t len,
+    uint32_t now_ms, espnow_reasm_slot_t **slot) {
+    espnow_reasm_expire(reasm, now_ms);
+
+    bool is_last = (frag_idx == frag_total - 1);
+    uint32_t offset = (uint32_t)frag_idx * reasm->frag_payload_size;
+    if (frag_total == 0 || frag_total > ESPNOW_REASM_MAX_FRAGS || frag_idx >= frag_total
+        || len == 0 || len > reasm->frag_payload_size
+        || (!is_last && len != reasm->frag_payload_size)
+        || offset + len > ESPNOW_REASM_MAX_SIZE) {
+        reasm->stats.invalid++;
+        return ESPNOW_REASM_INVALID;
+    }
+
+    espnow_reasm_slot_t *target = NULL;
+    for (size_t i = 0; i < ESPNOW_REASM_SLOTS; i++) {
+        if (slot_matches(&reasm->slots[i], mac, port, frag_id)) {
+            target = &reasm->slots[i];
+            break;
+        }
+    }
+
+    if (target == NULL) {
+        // Late copy of a fragment whose message was already delivered.
+        if (recently_completed(reasm, mac, port, frag_id, now_ms)) {
+            reasm->stats.duplicates++;
+            return ESPNOW_REASM_DUPLICATE;
+        }
+        target = claim_slot(reasm, now_ms);
+        if (target == NULL) {
+            reasm->stats.invalid++;
+            return ESPNOW_REASM_INVALID;
+        }
+        target->used = true;
+        memcpy(target->mac, mac, ESPNOW_REASM_MAC_LEN);
+        target->port = port;
+        target->frag_id = frag_id;
+        target->frag_total = frag_total;
+        target->received_mask = 0;
+        target->last_len = 0;
+        target->started_ms = now_ms;
+    } else if (target->frag_total != frag_total) {
+        reasm->stats.invalid++;
+        return ESPNOW_REASM_INVALID;
+    }
+
+    uint32_t bit = 1u << frag_idx;
+    if (target->received_mask & bit) {
+        reasm->stats.duplicates++;
+        return ESPNOW_REASM_DUPLICATE;
+    }
+
+    memcpy(&target->buffer[offset], payload, len);
+    target->received_mask |= bit;
+    if (is_last) {
+        target->last_len = len;
+    }
+
+    if (target->received_mask != full_mask(frag_total)) {
+        return ESPNOW_REASM_INCOMPLETE;
+    }
+
+    reasm->stats.completed++;
+    remember_completed(reasm, target, now_ms);
+    if (slot != NULL) {
+        *slot = target;
+    }
+    return ESPNOW_REASM_COMPLETE;
+}
+
+uint32_t espnow_reasm_length(const espnow_reasm_t *reasm, const espnow_reasm_slot_t *slot) {
+    return (uint32_t)(slot->frag_total - 1) * reasm->frag_payload_size + slot->last_len;
+}
+
+void espnow_reasm_release(espnow_reasm_t *reasm, espnow_reasm_slot_t *slot) {
+    (void)reasm;
+    slot->used = false;
+}
+
+uint32_t espnow_reasm_expire(espnow_reasm_t *reasm, uint32_t now_ms) {
+    uint32_t expired = 0;
+    for (size_t i = 0; i < ESPNOW_REASM_SLOTS; i++) {
+        espnow_reasm_slot_t *slot = &reasm->slots[i];
+        if (!slot->used || slot->frag_total == 0) {
+            continue;
+        }
+        // A completed slot waiting for its release is not expired.
+        if (slot->received_mask != full_mask(slot->frag_total) && (now_ms - slot->started_ms) >= reasm->timeout_ms) {
+            slot->used = false;
+            expired++;
+        }
+    }
+    reasm->stats.timed_out += expired;
+    return expired;
+}
@@ -0,0 +1,97 @@
+#ifndef ESPNOW_REASSEMBLY_H_
+#define ESPNOW_REASSEMBLY_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Reassembly of fragmented ESP-NOW messages. Every message in flight gets
+// a slot keyed by (source MAC, virtual port, frag_id), so fragments of
+// several messages - from several peers - can interleave, arrive out of
+// order or twice. A bitmap tracks which fragments landed, and a slot whose
+// message did not complete within the timeout is recycled. The last
+// completed messages are remembered for one timeout, so a fragment repeated
+// after its message was consumed is not taken for the start of a new one. Slots come from
+// a fixed pool inside the table, nothing is allocated.
+// Pure code (no ESP-NOW, no FreeRTOS) so it can be run on the host with
+// shuffled, duplicated and lost fragments.
+
+#define ESPNOW_REASM_MAC_LEN 6
+#define ESPNOW_REASM_SLOTS 4
+#define ESPNOW_REASM_MAX_SIZE 2048
+#define ESPNOW_REASM_MAX_FRAGS 32 // bitmap width
+#define ESPNOW_REASM_TIMEOUT_MS 200
+#define ESPNOW_REASM_RECENT 8     // completed messages remembered against late duplicates
+
+typedef enum {
+    ESPNOW_REASM_INCOMPLETE = 0, // stored, message still missing fragments
+    ESPNOW_REASM_COMPLETE,       // message ready, release the slot once consumed
+    ESPNOW_REASM_DUPLICATE,      // fragment already received, ignored
+    ESPNOW_REASM_INVALID,        // inconsistent header or message too large, ignored
+} espnow_reasm_result_t;
+
+typedef struct {
+    bool used;
+    uint8_t mac[ESPNOW_REASM_MAC_LEN];
+    uint8_t port;
+    uint32_t frag_id;
+    uint8_t frag_total;
+    uint32_t received_mask;
+    uint32_t last_len;   // payload length of the last fragment, once received
+    uint32_t started_ms;
+    uint8_t buffer[ESPNOW_REASM_MAX_SIZE];
+} espnow_reasm_slot_t;
+
+typedef struct {
+    bool used;
+    uint8_t mac[ESPNOW_REASM_MAC_LEN];
+    uint8_t port;
+    uint32_t frag_id;
+    uint32_t completed_ms;
+} espnow_reasm_recent_t;
+
+typedef struct {
+    uint32_t completed;
+    uint32_t timed_out;  // slots recycled because a fragment never came
+    uint32_t evicted;    // slots taken over while still waiting (pool full)
+    uint32_t duplicates;
+    uint32_t invalid;
+} espnow_reasm_stats_t;
+
+typedef struct {
+    uint32_t frag_payload_size; // payload carried by every fragment but the last
+    uint32_t timeout_ms;
+    espnow_reasm_slot_t slots[ESPNOW_REASM_SLOTS];
+    espnow_reasm_recent_t recent[ESPNOW_REASM_RECENT];
+    uint8_t recent_next;
+    espnow_reasm_stats_t stats;
+} espnow_reasm_t;
+
+/**
+ * @param frag_payload_size  payload size of a full fragment
+ * @param timeout_ms         lifetime of an incomplete message
+ */
+void espnow_reasm_init(espnow_reasm_t *reasm, uint32_t frag_payload_size, uint32_t timeout_ms);
+
+/**
+ * Store one fragment. On ESPNOW_REASM_COMPLETE, `slot` points to the slot
+ * holding the message (buffer, length from espnow_reasm_length()); it stays
+ * reserved until espnow_reasm_release(), so it can be consumed in place.
+ */
+espnow_reasm_result_t espnow_reasm_push(espnow_reasm_t *reasm, const uint8_t *mac, uint8_t port,
+    uint32_t frag_id, uint8_t frag_total, uint8_t frag_idx, const uint8_t *payload, uint32_t len,
+    uint32_t now_ms, espnow_reasm_slot_t **slot);
+
+/** Length of a completed message. */
+uint32_t espnow_reasm_length(const espnow_reasm_t *reasm, const espnow_reasm_slot_t *slot);
+
+void espnow_reasm_release(espnow_reasm_t *reasm, espnow_reasm_slot_t *slot);
+
+/**
+ * Recycle the slots of messages older than the timeout.
+ *
+ * @return number of slots recycled
+ */
+uint32_t espnow_reasm_expire(espnow_reasm_t *reasm, uint32_t now_ms);
+
+#endif // ESPNOW_REASSEMBLY_H_
@@ -0,0 +1,170 @@
+#include "dash_mailbox.h"
+#include <string.h>
+
+void dash_mailbox_init(dash_mailbox_t *mb) {
+    memset(mb, 0, sizeof(*mb));
+    for (unsigned i = 0; i < DASH_MAILBOX_SLOTS; i++) {
+        atomic_init(&mb->slots[i].seq, 0);
+        atomic_init(&mb->slots[i].pending_seq, 0);
+        atomic_init(&mb->slots[i].has_pending, false);
+    }
+    atomic_init(&mb->changed, 0);
+    atomic_init(&mb->writes, 0);
+    atomic_init(&mb->unchanged, 0);
+    atomic_init(&mb->pending, 0);
+    atomic_init(&mb->busy, 0);
+    atomic_init(&mb->read_retries, 0);
+    atomic_init(&mb->read_failures, 0);
+}
+
+/**
+ * Enter a seqlock (even to odd), false if a writer is inside
+ */
+static bool seq_enter(atomic_uint *seq_p, unsigned *seq) {
+    *seq = atomic_load_explicit(seq_p, memory_order_relaxed);
+    if ((*seq & 1) || !atomic_compare_exchange_strong_explicit(seq_p, seq, *seq + 1,
+            memory_order_relaxed, memory_order_relaxed)) {
+        return false;
+    }
+    // odd sequence visible before any byte of the value changes
+    atomic_thread_fence(memory_order_release);
+    return true;
+}
+
+/**
+ * Write the value of an entered slot and leave it, true if it changed
+ */
+static bool slot_put(dash_mailbox_t *mb, unsigned slot, unsigned seq, const void *data, size_t len) {
+    dash_slot_t *s = &mb->slots[slot];
+
+    if (s->len == len && memcmp(s->data, data, len) == 0) {
+        // nothing written: a reader that saw `seq` before still read a consistent value
+        atomic_store_explicit(&s->seq, seq, memory_order_release);
+        atomic_fetch_add_explicit(&mb->unchanged, 1, memory_order_relaxed);
+        return false;
+    }
+    memcpy(s->data, data, len);
+    s->len = (uint8_t)len;
+    atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+
+    atomic_fetch_or_explicit(&mb->changed, 1u << slot, memory_order_release);
+    atomic_fetch_add_explicit(&mb->writes, 1, memory_order_relaxed);
+    return true;
+}
+
+/**
+ * Leave the value in the pending copy, false if another writer is writing it
+ */
+static bool pending_put(dash_slot_t *s, const void *data, size_t len) {
+    unsigned seq;
+    if (!seq_enter(&s->pending_seq, &seq)) {
+        return false;
+    }
+    memcpy(s->pending_data, data, len);
+    s->pending_len = (uint8_t)len;
+    atomic_store_explicit(&s->pending_seq, seq + 2, memory_order_release);
+    atomic_store(&s->has_pending, true);
+    return true;
+}
+
+/**
+ * Take the pending copy, by the writer in the slot. A copy being rewritten is
+ * left: its writer flags it again, then enters the slot or leaves it to us
+ */
+static bool pending_take(dash_slot_t *s, uint8_t *out, size_t *len) {
+    if (!atomic_exchange(&s->has_pending, false)) {
+        return false;
+    }
+    unsigned before = atomic_load_explicit(&s->pending_seq, memory_order_acquire);
+    if (before & 1) {
+        return false;
+    }
+    *len = s->pending_len;
+    if (*len > DASH_MAILBOX_SLOT_SIZE) {
+        *len = DASH_MAILBOX_SLOT_SIZE;      // torn length, rejected below
+    }
+    memcpy(out, s->pending_data, *len);
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&s->pending_seq, memory_order_relaxed) == before;
+}
+
+bool dash_mailbox_write(dash_mailbox_t *mb, unsigned slot, const void *data, size_t len) {
+    if (slot >= DASH_MAILBOX_SLOTS || len > DASH_MAILBOX_SLOT_SIZE) {
+        return false;
+    }
+    dash_slot_t *s = &mb->slots[slot];
+    uint8_t pending[DASH_MAILBOX_SLOT_SIZE];
+    bool changed = false;
+    bool have_value = true;
+    unsigned seq;
+
+    if (!seq_enter(&s->seq, &seq)) {
+        if (!pending_put(s, data, len)) {
+            atomic_fetch_add_explicit(&mb->busy, 1, memory_order_relaxed);
+            return false;
+        }
+        atomic_fetch_add_explicit(&mb->pending, 1, memory_order_relaxed);
+        // pending flag set before the slot is checked again, and the writer inside
+        // checks the flag after leaving: one of the two publishes the value
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!seq_enter(&s->seq, &seq)) {
+            return false;
+        }
+        have_value = pending_take(s, pending, &len);
+        data = pending;
+    }
+
+    while (true) {
+        if (have_value) {
+            changed |= slot_put(mb, slot, seq, data, len);
+        } else {
+            atomic_store_explicit(&s->seq, seq, memory_order_release);
+        }
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!atomic_load(&s->has_pending) || !seq_enter(&s->seq, &seq)) {
+            return changed;
+        }
+        have_value = pending_take(s, pending, &len);
+        data = pending;
+    }
+}
+
+uint32_t dash_mailbox_take_changed(dash_mailbox_t *mb) {
+    return atomic_exchange_explicit(&mb->changed, 0, memory_order_acquire);
+}
+
+size_t dash_mailbox_read(dash_mailbox_t *mb, unsigned slot, void *out) {
+    if (slot >= DASH_MAILBOX_SLOTS) {
+        return 0;
+    }
+    dash_slot_t *s = &mb->slots[slot];
+
+    for (unsigned i = 0; i < DASH_MAILBOX_READ_RETRIES; i++) {
+        unsigned before = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if ((before & 1) == 0) {
+            size_t len = s->len;
+            if (len > DASH_MAILBOX_SLOT_SIZE) {
+                len = DASH_MAILBOX_SLOT_SIZE;   // torn length, rejected below
+            }
+            memcpy(out, s->data, len);
+            // copy done before the sequence is checked again
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&s->seq, memory_order_relaxed) == before) {
+                return len;
+            }
+        }
+        atomic_fetch_add_explicit(&mb->read_retries, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&mb->read_failures, 1, memory_order_relaxed);
+    atomic_fetch_or_explicit(&mb->changed, 1u << slot, memory_order_relaxed);
+    return 0;
+}
+
+void dash_mailbox_get_stats(dash_mailbox_t *mb, dash_mailbox_stats_t *stats) {
+    stats->writes = atomic_load_explicit(&mb->writes, memory_order_relaxed);
+    stats->unchanged = atomic_load_explicit(&mb->unchanged, memory_order_relaxed);
+    stats->pending = atomic_load_explicit(&mb->pending, memory_order_relaxed);
+    stats->busy = atomic_load_explicit(&mb->busy, memory_order_relaxed);
+    stats->read_retries = atomic_load_explicit(&mb->read_retries, memory_order_relaxed);
+    stats->read_failures = atomic_load_explicit(&mb->read_failures, memory_order_relaxed);
+}
@@ -0,0 +1,82 @@
+#ifndef DASH_MAILBOX_H_
+#define DASH_MAILBOX_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Latest-value mailbox between the dashboard producers (control loop, sensors)
+// and the UI task, one seqlock slot per value group:
+// - a writer never waits: it enters a slot by moving its sequence from even to
+//   odd. If another writer is inside, it leaves its value in the slot's pending
+//   copy instead, and whichever writer holds the slot next publishes it (the
+//   writer inside checks for a pending value before it returns),
+// - a write of the value already held does not count as a change,
+// - a reader copies the slot and retries if the sequence moved meanwhile,
+// - the slots written since the last read are flagged in one changed mask, so
+//   the reader only copies what changed.
+// Pure code (no LVGL, no FreeRTOS) so it can be run on the host.
+
+#define DASH_MAILBOX_SLOTS 8            // changed mask bits
+#define DASH_MAILBOX_SLOT_SIZE 32
+#define DASH_MAILBOX_READ_RETRIES 8     // then the slot stays flagged for the next read
+
+typedef struct {
+    atomic_uint seq;                    // odd: a write is in progress
+    uint8_t len;
+    uint8_t data[DASH_MAILBOX_SLOT_SIZE];
+    atomic_uint pending_seq;            // same for the pending copy
+    atomic_bool has_pending;            // pending copy not published yet
+    uint8_t pending_len;
+    uint8_t pending_data[DASH_MAILBOX_SLOT_SIZE];
+} dash_slot_t;
+
+typedef struct {
+    uint32_t writes;        // changes published
+    uint32_t unchanged;     // writes of the value already held
+    uint32_t pending;       // writes handed over to the writer in the slot
+    uint32_t busy;          // writes given up, slot and pending copy both being written
+    uint32_t read_retries;
+    uint32_t read_failures; // reads given up after DASH_MAILBOX_READ_RETRIES
+} dash_mailbox_stats_t;
+
+typedef struct {
+    dash_slot_t slots[DASH_MAILBOX_SLOTS];
+    atomic_uint changed;
+    atomic_uint writes;
+    atomic_uint unchanged;
+    atomic_uint pending;
+    atomic_uint busy;
+    atomic_uint read_retries;
+    atomic_uint read_failures;
+} dash_mailbox_t;
+
+void dash_mailbox_init(dash_mailbox_t *mb);
+
+/**
+ * Publish the value of `slot`, without waiting. Given up only when the slot and
+ * its pending copy are both being written: the value of that other writer,
+ * published after this one, is the latest.
+ *
+ * @return true if the value changed (the reader should be woken up)
+ */
+bool dash_mailbox_write(dash_mailbox_t *mb, unsigned slot, const void *data, size_t len);
+
+/**
+ * Slots written since the previous call, as a bit mask; their flags are cleared.
+ */
+uint32_t dash_mailbox_take_changed(dash_mailbox_t *mb);
+
+/**
+ * Consistent copy of `slot`. On failure (writers kept it busy) the slot is
+ * flagged again as changed.
+ *
+ * @param out  DASH_MAILBOX_SLOT_SIZE bytes
+ * @return length of the value, 0 if the read failed or nothing was written
+ */
+size_t dash_mailbox_read(dash_mailbox_t *mb, unsigned slot, void *out);
+
+void dash_mailbox_get_stats(dash_mailbox_t *mb, dash_mailbox_stats_t *stats);
+
+#endif
@@ -1,5 +1,7 @@
 #include "lcd_lvgl_lib.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/lock.h>
 #include <sys/param.h>
@@ -21,6 +23,12 @@
 #include "lvgl.h"
 #include "esp_timer.h"
 #include "freertos/idf_additions.h"
+#include "ssd1306_pack.h"
+#include "dash_mailbox.h"
+
+#if CONFIG_USE_WIFI
+#include "wifi_lib.h"
+#endif
 
 #define I2C_BUS_PORT  0
 #define EXAMPLE_LCD_PIXEL_CLOCK_HZ    (400 * 1000)
@@ -35,60 +43,147 @@
 #define EXAMPLE_LCD_CMD_BITS           8
 #define EXAMPLE_LCD_PARAM_BITS         8
 
-#define EXAMPLE_LVGL_TICK_PERIOD_MS    5
 #define EXAMPLE_LVGL_TASK_STACK_SIZE   (4 * 1024)
 #define EXAMPLE_LVGL_TASK_PRIORITY     2
 #define EXAMPLE_LVGL_PALETTE_SIZE      8
 #define EXAMPLE_LVGL_TASK_MAX_DELAY_MS 500
 #define EXAMPLE_LVGL_TASK_MIN_DELAY_MS 1000 / CONFIG_FREERTOS_HZ
+// at most one refresh (and one I2C flush) per frame
+#define LCD_FRAME_MS                   (1000 / CONFIG_LCD_MAX_FPS)
 
 #define MAX_VALUE 100
 #define MIN_VALUE -100
 
-// To use LV_COLOR_FORMAT_I1, we need an extra buffer to hold the converted data
+// Dashboard values, one mailbox slot (and one producer) each
+typedef enum {
+    DASH_MOTOR = 0,     // int16_t, MIN_VALUE..MAX_VALUE
+    DASH_STEER,         // int16_t, MIN_VALUE..MAX_VALUE
+    DASH_POWER,         // dash_power_t
+    DASH_LINK,          // int16_t RSSI (dBm), 0: no link
+    DASH_MODE,          // uint8_t drive_mode_e of cmd_lib
+    DASH_OBSTACLE,      // uint8_t DASH_OBSTACLE_* flags
+    DASH_IP,            // text
+} dash_slot_e;
+
+typedef struct {
+    int16_t centivolts; // 10 mV steps: a value changes when its text does
+    int16_t centiamps;
+} dash_power_t;
+
+#define DASH_OBSTACLE_BRAKING 0x01
+#define DASH_OBSTACLE_FRONT   0x02
+#define DASH_OBSTACLE_REAR    0x04
+
+static const char *drive_mode_names[] = { "DEF", "MID", "ADV", "EXP" };
+
+// To use LV_COLOR_FORMAT_I1, we need an extra buffer to hold the converted data (pages of the flushed area)
 static uint8_t oled_buffer[EXAMPLE_LCD_H_RES * EXAMPLE_LCD_V_RES / 8];
-// LVGL library is not thread-safe, this example will call LVGL APIs from different tasks, so use a mutex to protect it
+// LVGL library is not thread-safe: only the LVGL task and lcd_init call LVGL APIs, under this mutex
 static _lock_t lvgl_api_lock;
 
+// Producers only write here and wake the LVGL task up, they never take lvgl_api_lock
+// (zeroed: empty, values written before lcd_init are shown at start)
+static dash_mailbox_t mailbox;
+static TaskHandle_t lvgl_task_handle = NULL;
+
+static volatile uint32_t stat_wakeups = 0;
+static volatile uint32_t stat_applies = 0;
+static volatile uint32_t stat_flushes = 0;
+static volatile uint32_t stat_flush_bytes = 0;
+
 lv_obj_t * bar_motor = NULL;
 lv_obj_t * bar_steer = NULL;
 lv_obj_t * label_ip = NULL;
+lv_obj_t * label_status = NULL;
+lv_obj_t * label_power = NULL;
+lv_obj_t * label_obstacle = NULL;
 
-volatile int32_t ui_bar_steer = 0;
-volatile int32_t ui_bar_motor = 0;
-int32_t last_ui_bar_steer = 0;
-int32_t last_ui_bar_motor = 0;
-
-volatile uint8_t label_ip_text_changed = 0;
-volatile char label_ip_text[32] = "Waiting for Wifi startup";
+// values shown, owned by the LVGL task
+static uint8_t ui_mode = 0;
+static int16_t ui_rssi = 0;
 
 static const char * TAG = "lcd_lvgl_library";
 
-void set_bar_motor(const int32_t v)
+/**
+ * Publish a dashboard value: never blocks, the LVGL task is woken up only if it changed
+ */
+static void dash_publish(dash_slot_e slot, const void *data, size_t len)
 {
-    if (bar_motor != NULL){
-        ui_bar_motor = v;
+    if (dash_mailbox_write(&mailbox, slot, data, len) && lvgl_task_handle != NULL) {
+        xTaskNotifyGive(lvgl_task_handle);
     }
 }
 
+static int16_t clamp_bar(const int32_t v)
+{
+    return (int16_t)MIN(MAX(v, MIN_VALUE), MAX_VALUE);
+}
+
+void set_bar_motor(const int32_t v)
+{
+    int16_t value = clamp_bar(v);
+    dash_publish(DASH_MOTOR, &value, sizeof(value));
+}
+
 void set_bar_steer(const int32_t v)
 {
-    if (bar_steer != NULL){
-        ui_bar_steer = v;
-    }
+    int16_t value = clamp_bar(v);
+    dash_publish(DASH_STEER, &value, sizeof(value));
 }
 
 void set_label_ip(const char* ip_str) {
-    if (label_ip != NULL) {
-        if (strcmp((char*)label_ip_text, ip_str) != 0) {
-            snprintf((char*)label_ip_text, sizeof(label_ip_text), "%s", ip_str);
-            label_ip_text[sizeof(label_ip_text) - 1] = '\0'; //security if out of bounds
-            label_ip_text_changed = 1;
-            _lock_acquire(&lvgl_api_lock);
-            lv_label_set_text(label_ip, (char*)label_ip_text);
-            _lock_release(&lvgl_api_lock);
-        }
+    if (ip_str == NULL) {
+        return;
+    }
+    char text[DASH_MAILBOX_SLOT_SIZE];
+    snprintf(text, sizeof(text), "%s", ip_str);
+    dash_publish(DASH_IP, text, strlen(text));
+}
+
+void lcd_set_power(const int32_t millivolts, const int32_t milliamps)
+{
+    dash_power_t power = {
+        .centivolts = (int16_t)(millivolts / 10),
+        .centiamps = (int16_t)(milliamps / 10),
+    };
+    dash_publish(DASH_POWER, &power, sizeof(power));
+}
+
+void lcd_set_rssi(const int32_t rssi)
+{
+    int16_t value = (int16_t)rssi;
+    dash_publish(DASH_LINK, &value, sizeof(value));
+}
+
+void lcd_set_drive_mode(const uint8_t mode)
+{
+    dash_publish(DASH_MODE, &mode, sizeof(mode));
+}
+
+void lcd_set_obstacle(const bool braking, const bool front, const bool rear)
+{
+    uint8_t flags = (braking ? DASH_OBSTACLE_BRAKING : 0) | (front ? DASH_OBSTACLE_FRONT : 0)
+        | (rear ? DASH_OBSTACLE_REAR : 0);
+    dash_publish(DASH_OBSTACLE, &flags, sizeof(flags));
+}
+
+esp_err_t lcd_get_stats(lcd_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
+    dash_mailbox_stats_t mb;
+    dash_mailbox_get_stats(&mailbox, &mb);
+    stats->writes = mb.writes;
+    stats->unchanged = mb.unchanged;
+    stats->pending = mb.pending;
+    stats->busy = mb.busy;
+    stats->read_failures = mb.read_failures;
+    stats->wakeups = stat_wakeups;
+    stats->applies = stat_applies;
+    stats->flushes = stat_flushes;
+    stats->flush_bytes = stat_flush_bytes;
+    return ESP_OK;
 }
 
 static void event_cb(lv_event_t * e)
@@ -137,6 +232,20 @@ static void event_cb(lv_event_t * e)
     lv_draw_label(layer, &label_dsc, &txt_area);
 }
 
+/**
+ * Drive mode and link quality, both on the status line
+ */
+static void update_label_status(void)
+{
+    const char *mode = ui_mode < sizeof(drive_mode_names) / sizeof(drive_mode_names[0])
+        ? drive_mode_names[ui_mode] : "?";
+    if (ui_rssi == 0) {
+        lv_label_set_text_fmt(label_status, "%s no link", mode);
+    } else {
+        lv_label_set_text_fmt(label_status, "%s %ddBm", mode, ui_rssi);
+    }
+}
+
 /**
  * Example Text Scrolling Circular using LVGL
  * Screen : lv_obj, like "root" in JavaFX, the parent
@@ -150,7 +259,7 @@ void example_lvgl_demo_ui(lv_display_t *disp)
     lv_obj_t *scr = lv_display_get_screen_active(disp);
     label_ip = lv_label_create(scr);
     lv_label_set_long_mode(label_ip, LV_LABEL_LONG_SCROLL_CIRCULAR); /* Circular scroll */
-    lv_label_set_text(label_ip, (char*)label_ip_text);
+    lv_label_set_text(label_ip, "Waiting for Wifi startup");
     
     /* Size of the screen (if you use rotation 90 or 270, please use lv_display_get_vertical_resolution) */
     lv_obj_set_width(label_ip, lv_display_get_horizontal_resolution(disp));
@@ -175,7 +284,7 @@ void example_lvgl_demo_ui(lv_display_t *disp)
 
     lv_obj_align_to(bar_motor, label_ip, LV_ALIGN_OUT_BOTTOM_MID, 0, 5);
     lv_obj_add_event_cb(bar_motor, event_cb, LV_EVENT_DRAW_MAIN_END, NULL);
-    set_bar_motor(0);
+    lv_bar_set_value(bar_motor, 0, LV_ANIM_OFF);
 
     bar_steer = lv_bar_create(scr);
     lv_bar_set_range(bar_steer, MIN_VALUE, MAX_VALUE);
@@ -196,7 +305,87 @@ void example_lvgl_demo_ui(lv_display_t *disp)
 
     lv_obj_align_to(bar_steer, bar_motor, LV_ALIGN_OUT_BOTTOM_MID, 0, 5);
     lv_obj_add_event_cb(bar_steer, event_cb, LV_EVENT_DRAW_MAIN_END, NULL);
-    set_bar_steer(0);
+    lv_bar_set_value(bar_steer, 0, LV_ANIM_OFF);
+
+    /* two text lines of 8 pixels at the bottom: drive mode, link, obstacle / battery */
+    label_status = lv_label_create(scr);
+    lv_obj_set_style_text_font(label_status, &lv_font_unscii_8, LV_PART_MAIN);
+    lv_obj_align(label_status, LV_ALIGN_BOTTOM_LEFT, 0, -8);
+
+    label_power = lv_label_create(scr);
+    lv_obj_set_style_text_font(label_power, &lv_font_unscii_8, LV_PART_MAIN);
+    lv_label_set_text(label_power, "");
+    lv_obj_align(label_power, LV_ALIGN_BOTTOM_LEFT, 0, 0);
+
+    /* inverted, white on ssd1306 */
+    label_obstacle = lv_label_create(scr);
+    lv_obj_set_style_text_font(label_obstacle, &lv_font_unscii_8, LV_PART_MAIN);
+    lv_obj_set_style_bg_color(label_obstacle, lv_color_black(), LV_PART_MAIN);
+    lv_obj_set_style_bg_opa(label_obstacle, LV_OPA_COVER, LV_PART_MAIN);
+    lv_obj_set_style_text_color(label_obstacle, lv_color_white(), LV_PART_MAIN);
+    lv_label_set_text(label_obstacle, "");
+    lv_obj_align(label_obstacle, LV_ALIGN_BOTTOM_RIGHT, 0, -8);
+
+    update_label_status();
+}
+
+/**
+ * Show the mailbox slots written since the last call (LVGL task, lvgl_api_lock held)
+ */
+static void dash_apply(uint32_t changed)
+{
+    uint8_t value[DASH_MAILBOX_SLOT_SIZE + 1];
+    int16_t v16;
+
+    if ((changed & (1u << DASH_MOTOR)) && dash_mailbox_read(&mailbox, DASH_MOTOR, value) == sizeof(v16)) {
+        memcpy(&v16, value, sizeof(v16));
+        lv_bar_set_value(bar_motor, v16, LV_ANIM_OFF);
+    }
+    if ((changed & (1u << DASH_STEER)) && dash_mailbox_read(&mailbox, DASH_STEER, value) == sizeof(v16)) {
+        memcpy(&v16, value, sizeof(v16));
+        lv_bar_set_value(bar_steer, v16, LV_ANIM_OFF);
+    }
+    if ((changed & (1u << DASH_POWER)) && dash_mailbox_read(&mailbox, DASH_POWER, value) == sizeof(dash_power_t)) {
+        dash_power_t power;
+        memcpy(&power, value, sizeof(power));
+        int cv = power.centivolts;
+        int ca = power.centiamps;
+        lv_label_set_text_fmt(label_power, "%d.%02dV %s%d.%02dA", cv / 100, abs(cv % 100),
+            ca < 0 ? "-" : "", abs(ca / 100), abs(ca % 100));
+    }
+    bool status = false;
+    if ((changed & (1u << DASH_LINK)) && dash_mailbox_read(&mailbox, DASH_LINK, value) == sizeof(v16)) {
+        memcpy(&ui_rssi, value, sizeof(ui_rssi));
+        status = true;
+    }
+    if ((changed & (1u << DASH_MODE)) && dash_mailbox_read(&mailbox, DASH_MODE, value) == sizeof(uint8_t)) {
+        ui_mode = value[0];
+        status = true;
+    }
+    if (status) {
+        update_label_status();
+    }
+    if ((changed & (1u << DASH_OBSTACLE)) && dash_mailbox_read(&mailbox, DASH_OBSTACLE, value) == sizeof(uint8_t)) {
+        uint8_t flags = value[0];
+        const char *text = "";
+        if (flags & DASH_OBSTACLE_BRAKING) {
+            text = "BRAKE";
+        } else if ((flags & DASH_OBSTACLE_FRONT) && (flags & DASH_OBSTACLE_REAR)) {
+            text = "F+R";
+        } else if (flags & DASH_OBSTACLE_FRONT) {
+            text = "FRONT";
+        } else if (flags & DASH_OBSTACLE_REAR) {
+            text = "REAR";
+        }
+        lv_label_set_text(label_obstacle, text);
+    }
+    if (changed & (1u << DASH_IP)) {
+        size_t len = dash_mailbox_read(&mailbox, DASH_IP, value);
+        if (len > 0) {
+            value[len] = '\0';
+            lv_label_set_text(label_ip, (char *)value);
+        }
+    }
 }
 
 /**
@@ -209,10 +398,23 @@ static bool example_notify_lvgl_flush_ready(esp_lcd_panel_io_handle_t io_panel,
     return false;
 }
 
+/**
+ * Round every invalidated area to 8x8 blocks: whole SSD1306 pages, whole LVGL bytes
+ */
+static void example_lvgl_rounder_cb(lv_event_t *e)
+{
+    lv_area_t *area = lv_event_get_param(e);
+    area->x1 = area->x1 & ~7;
+    area->x2 = area->x2 | 7;
+    area->y1 = area->y1 & ~7;
+    area->y2 = area->y2 | 7;
+}
+
 /**
  * Callback when the flush is done on LVGL
  * 
- * Going through the area & copy the pixel map of LVGL to ESP's LCD Driver
+ * Convert the rendered area (partial render mode: px_map only holds the area) to SSD1306
+ * pages and send only these pages to ESP's LCD Driver
  */
 static void example_lvgl_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map)
 {
@@ -222,93 +424,87 @@ static void example_lvgl_flush_cb(lv_display_t *disp, const lv_area_t *area, uin
     // More information about the monochrome, please refer to https://docs.lvgl.io/9.2/porting/display.html#monochrome-displays
     px_map += EXAMPLE_LVGL_PALETTE_SIZE;
 
-    uint16_t hor_res = lv_display_get_physical_horizontal_resolution(disp);
     //area : 1 : left top, 2 : right bottom
     int x1 = area->x1;
     int x2 = area->x2;
     int y1 = area->y1;
     int y2 = area->y2;
-
-    //going through the area line by line
-    for (int y = y1; y <= y2; y++) {
-        for (int x = x1; x <= x2; x++) {
-            //LVGL : bytes displayed horizontally
-            /* The order of bits is MSB first
-                        MSB           LSB
-               bits      7 6 5 4 3 2 1 0
-               pixels    0 1 2 3 4 5 6 7
-                        Left         Right
-            */
-            // index (x,y) in px_map (bytesArray) : hor_res/8 (bytes/line) * y + offset x / 8 (current byte)
-            // bit position in MSB byte : (7 - x % 8) (x = 11 --> pos = 4)
-            // 1 << x : mask to isolate pixel value in byte (x = 4 --> 00010000 = pixel mask )
-            bool chroma_color = (px_map[(hor_res >> 3) * y  + (x >> 3)] & 1 << (7 - x % 8));
-
-            /* Write to the buffer as required for the display.
-            * It writes only 1-bit for monochrome displays mapped vertically.*/
-            //SSD1306 :  bytes displayed vertically at each horizontal page
-            //takes the right address of byte
-            uint8_t *buf = oled_buffer + hor_res * (y >> 3) + (x);
-            //address value updated according to current bit in vertical byte by mask
-            if (chroma_color) {
-                (*buf) &= ~(1 << (y % 8)); //put to 0 (on)
-            } else {
-                (*buf) |= (1 << (y % 8)); //put to 1 (off)
-            }
-        }
+    int w = x2 - x1 + 1;
+    int h = y2 - y1 + 1;
+    uint32_t stride = lv_draw_buf_width_to_stride(w, LV_COLOR_FORMAT_I1);
+
+    //LVGL : bytes displayed horizontally, MSB = left pixel
+    //SSD1306 : bytes displayed vertically at each horizontal page, LSB = top pixel
+    if (((x1 | w | y1 | h) & 7) == 0) {
+        //rounded area (example_lvgl_rounder_cb): 8x8 blocks transposed at once
+        ssd1306_pack_i1(px_map, stride, w, h, oled_buffer);
+    } else {
+        ssd1306_pack_i1_pixels(px_map, stride, 0, w, h, oled_buffer);
     }
-    // pass the draw buffer to the driver
+    // pass the pages of the area to the driver
     esp_lcd_panel_draw_bitmap(panel_handle, x1, y1, x2 + 1, y2 + 1, oled_buffer);
+    stat_flushes++;
+    stat_flush_bytes += w * h / 8;
 }
 
 /**
- * Periodic call for LVGL
+ * LVGL tick read from esp_timer when needed, no periodic tick interrupt to keep the CPU awake
  */
-static void example_increase_lvgl_tick(void *arg)
+static uint32_t example_lvgl_tick_cb(void)
 {
-    /* Tell LVGL how many milliseconds has elapsed */
-    lv_tick_inc(EXAMPLE_LVGL_TICK_PERIOD_MS);
+    return (uint32_t)(esp_timer_get_time() / 1000);
 }
 
 /**
  * Start LVGL task
  * 
- * Call LVGL timer to update LVGL periodically
+ * Sleep until a producer publishes a change or until the next LVGL deadline (animation, refresh),
+ * apply the changed values, then call LVGL timer. Changes coming within a frame are applied together.
  */
 static void example_lvgl_port_task(void *arg)
 {
     ESP_LOGI(TAG, "Starting LVGL task");
     uint32_t time_till_next_ms = 0;
+    int64_t last_apply_us = 0;
     while (1) {
-        _lock_acquire(&lvgl_api_lock);
-
-        if (ui_bar_motor != last_ui_bar_motor) {
-            lv_bar_set_value(bar_motor, ui_bar_motor, LV_ANIM_OFF);
-            last_ui_bar_motor = ui_bar_motor;
-        }
-        
-        if (ui_bar_steer != last_ui_bar_steer) {
-            lv_bar_set_value(bar_steer, ui_bar_steer, LV_ANIM_OFF);
-            last_ui_bar_steer = ui_bar_steer;
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(time_till_next_ms)) > 0) {
+            stat_wakeups++;
+            int64_t since_ms = (esp_timer_get_time() - last_apply_us) / 1000;
+            if (since_ms < LCD_FRAME_MS) {
+                vTaskDelay(pdMS_TO_TICKS(LCD_FRAME_MS - since_ms));
+            }
         }
+        uint32_t changed = dash_mailbox_take_changed(&mailbox);
 
-        /*
-        if (label_ip_text_changed) {
-            lv_label_set_text(label_ip, (char*)label_ip_text);
-            label_ip_text_changed = 0;
+        _lock_acquire(&lvgl_api_lock);
+        if (changed != 0) {
+            dash_apply(changed);
+            last_apply_us = esp_timer_get_time();
+            stat_applies++;
         }
-            */
-
         time_till_next_ms = lv_timer_handler();
         _lock_release(&lvgl_api_lock);
         // in case of triggering a task watch dog time out
         time_till_next_ms = MAX(time_till_next_ms, EXAMPLE_LVGL_TASK_MIN_DELAY_MS);
-        // in case of lvgl display not ready yet
+        // nothing scheduled (LV_NO_TIMER_READY), or lvgl display not ready yet
         time_till_next_ms = MIN(time_till_next_ms, EXAMPLE_LVGL_TASK_MAX_DELAY_MS);
-        usleep(1000 * time_till_next_ms);
     }
 }
 
+#if CONFIG_USE_WIFI
+/**
+ * Link producer (esp_timer callback): station RSSI, 0 when not connected
+ */
+static void lcd_link_sample(void *arg)
+{
+    int rssi = 0;
+    if (sta_get_rssi(&rssi) != ESP_OK) {
+        rssi = 0;
+    }
+    lcd_set_rssi(rssi);
+}
+#endif
+
 /**
  * Initialize LCD
  * 
@@ -317,8 +513,8 @@ static void example_lvgl_port_task(void *arg)
  * Init LVGL, associate panel driver ESP - display LVGL, create buffer (calloc of bytes in RAM)
  * Set Color format (monochrome), LVGL buffer
  * Register callbacks : on flush LVGL copy buffer on ESP, on transition done on ESP notify LVGL
- * Setup ESP timer periodic task to update LVGL tick
- * Start the LVGL task 
+ * Read LVGL tick from ESP timer, cap the refresh rate to CONFIG_LCD_MAX_FPS
+ * Build the dashboard, start the LVGL task (and the link sampler)
  */
 void lcd_init()
 {
@@ -414,7 +610,9 @@ void lcd_init()
     // LVGL9 suooprt new monochromatic format.
     lv_display_set_color_format(display, LV_COLOR_FORMAT_I1);
     // initialize LVGL draw buffers
-    lv_display_set_buffers(display, buf, NULL, draw_buffer_sz, LV_DISPLAY_RENDER_MODE_FULL);
+    // partial : only the invalidated areas are rendered and flushed, rounded to 8x8 blocks
+    lv_display_set_buffers(display, buf, NULL, draw_buffer_sz, LV_DISPLAY_RENDER_MODE_PARTIAL);
+    lv_display_add_event_cb(display, example_lvgl_rounder_cb, LV_EVENT_INVALIDATE_AREA, NULL);
     // set the callback which can copy the rendered image to an area of the display
     lv_display_set_flush_cb(display, example_lvgl_flush_cb);
 
@@ -429,31 +627,41 @@ void lcd_init()
         return;
     }
 
-    log_msg(TAG, "Use esp_timer as LVGL tick timer");
-    const esp_timer_create_args_t lvgl_tick_timer_args = {
-        .callback = &example_increase_lvgl_tick,
-        .name = "lvgl_tick"
+    log_msg(TAG, "Use esp_timer as LVGL tick");
+    lv_tick_set_cb(example_lvgl_tick_cb);
+    // frame rate cap: the refresh timer renders (and flushes) the invalidated areas once per period
+    lv_timer_set_period(lv_display_get_refr_timer(display), LCD_FRAME_MS);
+
+    log_msg(TAG, "Display LVGL dashboard");
+    // Lock the mutex due to the LVGL APIs are not thread-safe
+    _lock_acquire(&lvgl_api_lock);
+    example_lvgl_demo_ui(display);
+    _lock_release(&lvgl_api_lock);
+
+    // widgets exist before the task applies the first values
+    log_msg(TAG, "Create LVGL task");
+    if (xTaskCreatePinnedToCore(example_lvgl_port_task, "LVGL", EXAMPLE_LVGL_TASK_STACK_SIZE,
+            NULL, EXAMPLE_LVGL_TASK_PRIORITY, &lvgl_task_handle, 1) != pdPASS) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "failed to create LVGL task");
+        return;
+    }
+    //xTaskCreate(example_lvgl_port_task, "LVGL", EXAMPLE_LVGL_TASK_STACK_SIZE, NULL, EXAMPLE_LVGL_TASK_PRIORITY, NULL);
+
+#if CONFIG_USE_WIFI
+    const esp_timer_create_args_t link_timer_args = {
+        .callback = &lcd_link_sample,
+        .name = "lcd_link"
     };
-    esp_timer_handle_t lvgl_tick_timer = NULL;
-    err = esp_timer_create(&lvgl_tick_timer_args, &lvgl_tick_timer);
+    esp_timer_handle_t link_timer = NULL;
+    err = esp_timer_create(&link_timer_args, &link_timer);
     if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "failed to create esp timer instance");
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "failed to create link timer");
         return;
     }
-    err = esp_timer_start_periodic(lvgl_tick_timer, EXAMPLE_LVGL_TICK_PERIOD_MS * 1000);
+    err = esp_timer_start_periodic(link_timer, CONFIG_LCD_LINK_PERIOD_MS * 1000);
     if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "failed to start periodic timer");
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "failed to start link timer");
         return;
     }
-
-    log_msg(TAG, "Create LVGL task");
-    xTaskCreatePinnedToCore(example_lvgl_port_task, "LVGL", EXAMPLE_LVGL_TASK_STACK_SIZE,
-        NULL, EXAMPLE_LVGL_TASK_PRIORITY, NULL, 1);
-    //xTaskCreate(example_lvgl_port_task, "LVGL", EXAMPLE_LVGL_TASK_STACK_SIZE, NULL, EXAMPLE_LVGL_TASK_PRIORITY, NULL);
-
-    log_msg(TAG, "Display LVGL Scroll Text");
-    // Lock the mutex due to the LVGL APIs are not thread-safe
-    _lock_acquire(&lvgl_api_lock);
-    example_lvgl_demo_ui(display);
-    _lock_release(&lvgl_api_lock);
-}
\ No newline at end of file
+#endif
+}
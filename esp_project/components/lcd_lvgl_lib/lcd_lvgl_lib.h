@@ -2,13 +2,47 @@
 #define LCD_LVGL_LIB_H_
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+// Dashboard producers: never block (no LVGL lock, no I2C), callable from the
+// control path; the LVGL task is woken up only when a shown value changes.
+// Several tasks may write the same value (commands come from UDP, WS and ESP-NOW):
+// a writer finding the value being written hands it over to that writer.
+
+typedef struct {
+    uint32_t writes;        // values changed
+    uint32_t unchanged;     // writes of the value already shown
+    uint32_t pending;       // writes handed over, written concurrently
+    uint32_t busy;          // writes superseded by a concurrent later one
+    uint32_t read_failures;
+    uint32_t wakeups;       // LVGL task woken up by a change
+    uint32_t applies;       // batches of changes applied to the widgets
+    uint32_t flushes;       // areas sent to the screen
+    uint32_t flush_bytes;
+} lcd_stats_t;
 
 void lcd_init();
 
+// -100..100
 void set_bar_steer(const int32_t v);
 
+// -100..100
 void set_bar_motor(const int32_t v);
 
 void set_label_ip(const char* ip_str);
 
-#endif
\ No newline at end of file
+// battery (INA226), shown with 10 mV / 10 mA steps
+void lcd_set_power(const int32_t millivolts, const int32_t milliamps);
+
+// station RSSI in dBm, 0: no link
+void lcd_set_rssi(const int32_t rssi);
+
+// drive_mode_e of cmd_lib
+void lcd_set_drive_mode(const uint8_t mode);
+
+void lcd_set_obstacle(const bool braking, const bool front, const bool rear);
+
+esp_err_t lcd_get_stats(lcd_stats_t *stats);
+
+#endif
@@ -0,0 +1,62 @@
+#include "ssd1306_pack.h"
+
+/**
+ * Transpose one block: rows[i * stride] = row i (MSB = left), out[k * step] =
+ * column k (LSB = top), inverted
+ */
+static inline void pack_block(const uint8_t *rows, size_t stride, uint8_t *out, size_t step) {
+    //rows loaded bottom first, so that the transposed columns come out LSB = top
+    uint32_t x = ((uint32_t)rows[7 * stride] << 24) | ((uint32_t)rows[6 * stride] << 16)
+        | ((uint32_t)rows[5 * stride] << 8) | rows[4 * stride];
+    uint32_t y = ((uint32_t)rows[3 * stride] << 24) | ((uint32_t)rows[2 * stride] << 16)
+        | ((uint32_t)rows[1 * stride] << 8) | rows[0];
+    uint32_t t;
+
+    //swap 1x1, then 2x2 bit blocks, then 4x4 between x and y
+    t = (x ^ (x >> 7)) & 0x00AA00AA;
+    x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AA;
+    y = y ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC;
+    x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCC;
+    y = y ^ t ^ (t << 14);
+    t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+    y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+    x = ~t;
+    y = ~y;
+
+    out[0]        = (uint8_t)(x >> 24);
+    out[step]     = (uint8_t)(x >> 16);
+    out[2 * step] = (uint8_t)(x >> 8);
+    out[3 * step] = (uint8_t)x;
+    out[4 * step] = (uint8_t)(y >> 24);
+    out[5 * step] = (uint8_t)(y >> 16);
+    out[6 * step] = (uint8_t)(y >> 8);
+    out[7 * step] = (uint8_t)y;
+}
+
+void ssd1306_pack_i1(const uint8_t *px, size_t stride, int w, int h, uint8_t *out) {
+    for (int page = 0; page < h / 8; page++) {
+        const uint8_t *rows = &px[(size_t)page * 8 * stride];
+        uint8_t *dst = &out[page * w];
+        for (int bx = 0; bx < w / 8; bx++) {
+            pack_block(&rows[bx], stride, &dst[bx * 8], 1);
+        }
+    }
+}
+
+void ssd1306_pack_i1_pixels(const uint8_t *px, size_t stride, int x, int w, int h, uint8_t *out) {
+    for (int row = 0; row < h; row++) {
+        for (int col = 0; col < w; col++) {
+            int px_x = x + col;
+            bool chroma_color = px[stride * row + (px_x >> 3)] & (1 << (7 - px_x % 8));
+            uint8_t *buf = &out[w * (row >> 3) + col];
+            if (chroma_color) {
+                *buf &= ~(1 << (row % 8)); //put to 0 (on)
+            } else {
+                *buf |= (1 << (row % 8)); //put to 1 (off)
+            }
+        }
+    }
+}
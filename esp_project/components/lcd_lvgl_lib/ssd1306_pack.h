@@ -0,0 +1,30 @@
+#ifndef SSD1306_PACK_H_
+#define SSD1306_PACK_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// LVGL 1 bpp (LV_COLOR_FORMAT_I1) to SSD1306 layout.
+// LVGL: rows of bytes, MSB = leftmost pixel, bit set = chroma (drawn).
+// SSD1306: pages of 8 rows, one byte per column, LSB = top row, bit clear = drawn.
+// An area aligned on 8 pixels both ways is converted 8x8 blocks at a time, each
+// block transposed with 32-bit operations; `out` holds its pages one after the
+// other (w bytes each), as esp_lcd_panel_draw_bitmap expects for that area.
+// Pure code (no LVGL, no esp_lcd) so it can be run on the host.
+
+/**
+ * @param px      first byte of the area's first row
+ * @param stride  bytes from a row to the next
+ * @param w, h    area size, multiples of 8
+ * @param out     w * h / 8 bytes
+ */
+void ssd1306_pack_i1(const uint8_t *px, size_t stride, int w, int h, uint8_t *out);
+
+/**
+ * Pixel by pixel version, any area size (`x`: first column of the area in the
+ * row bytes of `px`). Only the area's bits of `out` are written.
+ */
+void ssd1306_pack_i1_pixels(const uint8_t *px, size_t stride, int x, int w, int h, uint8_t *out);
+
+#endif
@@ -0,0 +1,353 @@
+#include "mqtt_batch.h"
+#include <string.h>
+
+#define RING_RECORD_HEADER_SIZE (sizeof(uint8_t) + sizeof(uint16_t))
+#define ZRLE_RUN_MAX 255
+
+// --- Ring of closed batches ---
+
+static void ring_write(mqtt_batch_t *b, const uint8_t *src, size_t len) {
+    size_t first = b->ring_capacity - b->head;
+    first = (len < first) ? len : first;
+    memcpy(&b->ring[b->head], src, first);
+    memcpy(b->ring, &src[first], len - first);
+    b->head = (b->head + len) % b->ring_capacity;
+    b->used += len;
+}
+
+static void ring_read_at(const mqtt_batch_t *b, size_t pos, uint8_t *dst, size_t len) {
+    size_t first = b->ring_capacity - pos;
+    first = (len < first) ? len : first;
+    memcpy(dst, &b->ring[pos], first);
+    memcpy(&dst[first], b->ring, len - first);
+}
+
+/**
+ * Length of the oldest record, header included
+ */
+static size_t ring_peek(const mqtt_batch_t *b, uint8_t *topic) {
+    uint8_t hdr[RING_RECORD_HEADER_SIZE];
+    ring_read_at(b, b->tail, hdr, sizeof(hdr));
+    uint16_t len;
+    memcpy(&len, &hdr[1], sizeof(len));
+    if (topic != NULL) {
+        *topic = hdr[0];
+    }
+    return RING_RECORD_HEADER_SIZE + len;
+}
+
+static void ring_drop_oldest(mqtt_batch_t *b) {
+    size_t len = ring_peek(b, NULL);
+    b->tail = (b->tail + len) % b->ring_capacity;
+    b->used -= len;
+    b->records--;
+    b->first_seq++;
+}
+
+static void ring_push(mqtt_batch_t *b, uint8_t topic, const uint8_t *payload, size_t len) {
+    size_t size = RING_RECORD_HEADER_SIZE + len;
+    if (size > b->ring_capacity || len > UINT16_MAX) {
+        b->stats.batches_dropped++;
+        return;
+    }
+    while (b->ring_capacity - b->used < size) {
+        ring_drop_oldest(b);
+        b->stats.batches_dropped++;
+    }
+    uint8_t hdr[RING_RECORD_HEADER_SIZE];
+    uint16_t len16 = (uint16_t)len;
+    hdr[0] = topic;
+    memcpy(&hdr[1], &len16, sizeof(len16));
+    ring_write(b, hdr, sizeof(hdr));
+    ring_write(b, payload, len);
+    b->records++;
+    if (b->used > b->stats.ring_peak) {
+        b->stats.ring_peak = b->used;
+    }
+}
+
+// --- Compression: XOR with the previous frame, then zero runs ---
+
+typedef struct {
+    uint8_t *out;
+    size_t capacity;
+    size_t len;
+    uint8_t run;    // pending zeros
+    bool overflow;
+} zrle_t;
+
+static void zrle_emit(zrle_t *z, uint8_t byte) {
+    if (z->len >= z->capacity) {
+        z->overflow = true;
+        return;
+    }
+    z->out[z->len++] = byte;
+}
+
+static void zrle_end_run(zrle_t *z) {
+    if (z->run > 0) {
+        zrle_emit(z, 0);
+        zrle_emit(z, z->run);
+        z->run = 0;
+    }
+}
+
+static void zrle_put(zrle_t *z, uint8_t byte) {
+    if (byte == 0) {
+        if (++z->run == ZRLE_RUN_MAX) {
+            zrle_end_run(z);
+        }
+        return;
+    }
+    zrle_end_run(z);
+    zrle_emit(z, byte);
+}
+
+/**
+ * Coded body of the batch in `slot`, written after the header in `out`
+ *
+ * @return coded length, 0 if not smaller than the raw body
+ */
+static size_t compress_body(const mqtt_batch_slot_t *slot, uint8_t *out, size_t capacity) {
+    const uint8_t *body = &slot->buf[MQTT_BATCH_HEADER_SIZE];
+    size_t body_len = slot->len - MQTT_BATCH_HEADER_SIZE;
+    zrle_t z = { .out = out, .capacity = (body_len < capacity) ? body_len : capacity };
+
+    const uint8_t *prev = NULL;
+    uint16_t prev_len = 0;
+    size_t offset = 0;
+    const uint8_t *frame;
+    uint16_t frame_len;
+    while (!z.overflow && mqtt_batch_next(body, body_len, &offset, &frame, &frame_len)) {
+        zrle_put(&z, frame[-2]);
+        zrle_put(&z, frame[-1]);
+        for (size_t i = 0; i < frame_len; i++) {
+            zrle_put(&z, (prev != NULL && prev_len == frame_len) ? frame[i] ^ prev[i] : frame[i]);
+        }
+        prev = frame;
+        prev_len = frame_len;
+    }
+    zrle_end_run(&z);
+    return (z.overflow || z.len >= body_len) ? 0 : z.len;
+}
+
+// --- Batches ---
+
+void mqtt_batch_init(mqtt_batch_t *batch, uint8_t *slot_storage, size_t slot_size,
+    uint8_t *ring_storage, size_t ring_size, bool compress) {
+    memset(batch, 0, sizeof(*batch));
+    batch->slot_size = slot_size;
+    for (size_t i = 0; i < MQTT_BATCH_SLOTS; i++) {
+        batch->slots[i].buf = &slot_storage[i * slot_size];
+    }
+    batch->scratch = &slot_storage[MQTT_BATCH_SLOTS * slot_size];
+    batch->compress = compress;
+    batch->ring = ring_storage;
+    batch->ring_capacity = ring_size;
+}
+
+bool mqtt_batch_set_topic(mqtt_batch_t *batch, uint8_t topic, mqtt_batch_policy_t policy, uint8_t qos) {
+    if (topic >= MQTT_BATCH_TOPICS_MAX) {
+        return false;
+    }
+    batch->topics[topic].policy = (uint8_t)policy;
+    batch->topics[topic].qos = qos;
+    return true;
+}
+
+static void slot_open(mqtt_batch_slot_t *slot, uint8_t topic, uint32_t now_ms) {
+    slot->used = true;
+    slot->topic = topic;
+    slot->count = 0;
+    slot->len = MQTT_BATCH_HEADER_SIZE;
+    slot->opened_ms = now_ms;
+}
+
+static void slot_close(mqtt_batch_t *b, mqtt_batch_slot_t *slot) {
+    slot->used = false;
+    if (slot->count == 0) {
+        return;
+    }
+    uint16_t count = slot->count;
+    uint16_t body_len = (uint16_t)(slot->len - MQTT_BATCH_HEADER_SIZE);
+    uint8_t hdr[MQTT_BATCH_HEADER_SIZE] = {0};
+    memcpy(&hdr[1], &count, sizeof(count));
+    memcpy(&hdr[3], &body_len, sizeof(body_len));
+
+    const uint8_t *payload = slot->buf;
+    size_t len = slot->len;
+    size_t coded = b->compress
+        ? compress_body(slot, &b->scratch[MQTT_BATCH_HEADER_SIZE], b->slot_size - MQTT_BATCH_HEADER_SIZE)
+        : 0;
+    if (coded > 0) {
+        hdr[0] = MQTT_BATCH_FLAG_COMPRESSED;
+        memcpy(b->scratch, hdr, sizeof(hdr));
+        payload = b->scratch;
+        len = MQTT_BATCH_HEADER_SIZE + coded;
+    } else {
+        memcpy(slot->buf, hdr, sizeof(hdr));
+    }
+
+    b->stats.batches++;
+    b->stats.bytes_raw += slot->len;
+    b->stats.bytes_out += len;
+    ring_push(b, slot->topic, payload, len);
+}
+
+static mqtt_batch_slot_t *slot_for(mqtt_batch_t *b, uint8_t topic, uint32_t now_ms) {
+    mqtt_batch_slot_t *oldest = NULL;
+    mqtt_batch_slot_t *free_slot = NULL;
+    for (size_t i = 0; i < MQTT_BATCH_SLOTS; i++) {
+        mqtt_batch_slot_t *slot = &b->slots[i];
+        if (!slot->used) {
+            free_slot = (free_slot == NULL) ? slot : free_slot;
+        } else if (slot->topic == topic) {
+            return slot;
+        } else if (oldest == NULL || (int32_t)(slot->opened_ms - oldest->opened_ms) < 0) {
+            oldest = slot;
+        }
+    }
+    if (free_slot == NULL) {
+        //more topics than slots: the oldest batch goes out early
+        slot_close(b, oldest);
+        free_slot = oldest;
+    }
+    slot_open(free_slot, topic, now_ms);
+    return free_slot;
+}
+
+bool mqtt_batch_push(mqtt_batch_t *batch, uint8_t topic, const uint8_t *data, size_t len,
+    uint32_t now_ms, bool online) {
+    size_t size = MQTT_BATCH_FRAME_HEADER_SIZE + len;
+    if (topic >= MQTT_BATCH_TOPICS_MAX || data == NULL || MQTT_BATCH_HEADER_SIZE + size > batch->slot_size) {
+        batch->stats.frames_dropped++;
+        return false;
+    }
+
+    mqtt_batch_slot_t *slot = slot_for(batch, topic, now_ms);
+    if (!online && batch->topics[topic].policy == MQTT_BATCH_COALESCE_LATEST) {
+        batch->stats.frames_coalesced += slot->count;
+        slot_open(slot, topic, now_ms);
+    } else if (slot->len + size > batch->slot_size) {
+        slot_close(batch, slot);
+        slot_open(slot, topic, now_ms);
+    }
+
+    uint16_t len16 = (uint16_t)len;
+    memcpy(&slot->buf[slot->len], &len16, sizeof(len16));
+    memcpy(&slot->buf[slot->len + MQTT_BATCH_FRAME_HEADER_SIZE], data, len);
+    slot->len += size;
+    slot->count++;
+    batch->stats.frames++;
+    return true;
+}
+
+size_t mqtt_batch_flush(mqtt_batch_t *batch, uint32_t now_ms, uint32_t max_age_ms, bool online) {
+    size_t closed = 0;
+    for (size_t i = 0; i < MQTT_BATCH_SLOTS; i++) {
+        mqtt_batch_slot_t *slot = &batch->slots[i];
+        if (!slot->used || (now_ms - slot->opened_ms) < max_age_ms) {
+            continue;
+        }
+        if (!online && batch->topics[slot->topic].policy == MQTT_BATCH_COALESCE_LATEST) {
+            continue;
+        }
+        closed += (slot->count > 0) ? 1 : 0;
+        slot_close(batch, slot);
+    }
+    return closed;
+}
+
+size_t mqtt_batch_peek(const mqtt_batch_t *batch, uint8_t *out, size_t capacity, uint8_t *topic, uint32_t *seq) {
+    if (batch->records == 0) {
+        return 0;
+    }
+    size_t len = ring_peek(batch, topic) - RING_RECORD_HEADER_SIZE;
+    if (len > capacity) {
+        return 0;
+    }
+    ring_read_at(batch, (batch->tail + RING_RECORD_HEADER_SIZE) % batch->ring_capacity, out, len);
+    *seq = batch->first_seq;
+    return len;
+}
+
+bool mqtt_batch_pop(mqtt_batch_t *batch, uint32_t seq) {
+    if (batch->records == 0 || batch->first_seq != seq) {
+        return false;
+    }
+    ring_drop_oldest(batch);
+    return true;
+}
+
+size_t mqtt_batch_decode(const uint8_t *payload, size_t len, uint8_t *out, size_t capacity) {
+    if (len < MQTT_BATCH_HEADER_SIZE) {
+        return 0;
+    }
+    uint16_t body_len;
+    memcpy(&body_len, &payload[3], sizeof(body_len));
+    if (body_len > capacity) {
+        return 0;
+    }
+    const uint8_t *in = &payload[MQTT_BATCH_HEADER_SIZE];
+    size_t in_len = len - MQTT_BATCH_HEADER_SIZE;
+    if (!(payload[0] & MQTT_BATCH_FLAG_COMPRESSED)) {
+        if (in_len != body_len) {
+            return 0;
+        }
+        memcpy(out, in, body_len);
+        return body_len;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < in_len; i++) {
+        if (in[i] != 0) {
+            if (n >= body_len) {
+                return 0;
+            }
+            out[n++] = in[i];
+            continue;
+        }
+        if (i + 1 >= in_len || in[i + 1] == 0 || n + in[i + 1] > body_len) {
+            return 0;
+        }
+        memset(&out[n], 0, in[i + 1]);
+        n += in[i + 1];
+        i++;
+    }
+    if (n != body_len) {
+        return 0;
+    }
+
+    //undo the XOR, frame by frame from the first one
+    const uint8_t *prev = NULL;
+    uint16_t prev_len = 0;
+    size_t offset = 0;
+    const uint8_t *frame;
+    uint16_t frame_len;
+    while (mqtt_batch_next(out, n, &offset, &frame, &frame_len)) {
+        if (prev != NULL && prev_len == frame_len) {
+            uint8_t *cur = (uint8_t *)frame;
+            for (size_t i = 0; i < frame_len; i++) {
+                cur[i] ^= prev[i];
+            }
+        }
+        prev = frame;
+        prev_len = frame_len;
+    }
+    return (offset == n) ? n : 0;
+}
+
+bool mqtt_batch_next(const uint8_t *body, size_t len, size_t *offset, const uint8_t **frame, uint16_t *frame_len) {
+    if (*offset + MQTT_BATCH_FRAME_HEADER_SIZE > len) {
+        return false;
+    }
+    uint16_t n;
+    memcpy(&n, &body[*offset], sizeof(n));
+    if (*offset + MQTT_BATCH_FRAME_HEADER_SIZE + n > len) {
+        return false;
+    }
+    *frame = &body[*offset + MQTT_BATCH_FRAME_HEADER_SIZE];
+    *frame_len = n;
+    *offset += MQTT_BATCH_FRAME_HEADER_SIZE + n;
+    return true;
+}
@@ -0,0 +1,136 @@
+#ifndef MQTT_BATCH_H_
+#define MQTT_BATCH_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Telemetry frames batched per topic for MQTT, and kept while the broker is
+// unreachable:
+// - frames of a topic are appended to an open batch (one of MQTT_BATCH_SLOTS),
+//   closed when full, when too old, or when its slot is needed by another topic,
+// - closed batches wait in one bounded ring (drop-oldest when full) until
+//   published, so a disconnection only costs the oldest data,
+// - a MQTT_BATCH_COALESCE_LATEST topic (state: motor, ping...) keeps only its
+//   latest frame while offline instead of filling the ring.
+// Records are removed from the ring only once published (peek, then pop).
+// Pure code (no esp-mqtt, no FreeRTOS) so it can be run on the host.
+
+#define MQTT_BATCH_TOPICS_MAX 64
+#define MQTT_BATCH_SLOTS 8
+
+// Payload of a published batch, little-endian:
+// [0] = flags, [1..2] = frame count, [3..4] = body length (decoded),
+// then the body: frames as [length (uint16_t)][frame].
+// MQTT_BATCH_FLAG_COMPRESSED: the body is coded, every frame XORed with the
+// previous one when they have the same length, then zero runs written as
+// [0x00][run length (1..255)]. Used only when it makes the batch smaller.
+#define MQTT_BATCH_HEADER_SIZE (sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint16_t))
+#define MQTT_BATCH_FRAME_HEADER_SIZE sizeof(uint16_t)
+#define MQTT_BATCH_FLAG_COMPRESSED 0x01
+
+typedef enum {
+    MQTT_BATCH_DROP_OLDEST = 0,
+    MQTT_BATCH_COALESCE_LATEST,
+} mqtt_batch_policy_t;
+
+typedef struct {
+    uint8_t policy;     // mqtt_batch_policy_t
+    uint8_t qos;        // for the publisher, not used here
+} mqtt_batch_topic_t;
+
+typedef struct {
+    bool used;
+    uint8_t topic;
+    uint16_t count;
+    size_t len;         // header included
+    uint32_t opened_ms;
+    uint8_t *buf;
+} mqtt_batch_slot_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t frames_dropped;    // too large, or topic out of range
+    uint32_t frames_coalesced;  // replaced by a later frame while offline
+    uint32_t batches;
+    uint32_t batches_dropped;   // oldest batches pushed out of a full ring
+    uint32_t bytes_raw;         // batch payloads before compression
+    uint32_t bytes_out;         // and as queued
+    size_t ring_peak;
+} mqtt_batch_stats_t;
+
+typedef struct {
+    mqtt_batch_topic_t topics[MQTT_BATCH_TOPICS_MAX];
+    mqtt_batch_slot_t slots[MQTT_BATCH_SLOTS];
+    size_t slot_size;
+    uint8_t *scratch;   // slot_size bytes, compressed batch
+    bool compress;
+    //ring of closed batches: [topic][length (uint16_t)][payload]
+    uint8_t *ring;
+    size_t ring_capacity;
+    size_t head;
+    size_t tail;
+    size_t used;
+    uint32_t records;
+    uint32_t first_seq; // sequence number of the oldest record
+    mqtt_batch_stats_t stats;
+} mqtt_batch_t;
+
+/**
+ * Empty batcher, every topic MQTT_BATCH_DROP_OLDEST at QoS 0.
+ *
+ * @param slot_storage  (MQTT_BATCH_SLOTS + 1) * slot_size bytes
+ * @param ring_storage  ring_size bytes (PSRAM is fine)
+ */
+void mqtt_batch_init(mqtt_batch_t *batch, uint8_t *slot_storage, size_t slot_size,
+    uint8_t *ring_storage, size_t ring_size, bool compress);
+
+bool mqtt_batch_set_topic(mqtt_batch_t *batch, uint8_t topic, mqtt_batch_policy_t policy, uint8_t qos);
+
+/**
+ * Append a frame to the open batch of `topic`.
+ *
+ * @param online  false: a coalesced topic keeps this frame only
+ * @return false if the frame was dropped
+ */
+bool mqtt_batch_push(mqtt_batch_t *batch, uint8_t topic, const uint8_t *data, size_t len,
+    uint32_t now_ms, bool online);
+
+/**
+ * Close the batches opened `max_age_ms` ago or more (0: all of them) into the
+ * ring. Coalesced topics stay open while offline.
+ *
+ * @return batches closed
+ */
+size_t mqtt_batch_flush(mqtt_batch_t *batch, uint32_t now_ms, uint32_t max_age_ms, bool online);
+
+/**
+ * Copy the oldest closed batch, left in the ring until mqtt_batch_pop.
+ *
+ * @return payload length, 0 if the ring is empty or `capacity` too small
+ */
+size_t mqtt_batch_peek(const mqtt_batch_t *batch, uint8_t *out, size_t capacity, uint8_t *topic, uint32_t *seq);
+
+/**
+ * Remove the batch returned by mqtt_batch_peek once published.
+ *
+ * @return false if it was pushed out of the ring in the meantime
+ */
+bool mqtt_batch_pop(mqtt_batch_t *batch, uint32_t seq);
+
+/**
+ * Body of a batch payload, decompressed if needed.
+ *
+ * @return body length, 0 if the payload is malformed or `capacity` too small
+ */
+size_t mqtt_batch_decode(const uint8_t *payload, size_t len, uint8_t *out, size_t capacity);
+
+/**
+ * Walk the frames of a decoded body.
+ *
+ * @param offset  start at 0, advanced past the frame
+ * @return false at the end of the body or on a truncated frame
+ */
+bool mqtt_batch_next(const uint8_t *body, size_t len, size_t *offset, const uint8_t **frame, uint16_t *frame_len);
+
+#endif
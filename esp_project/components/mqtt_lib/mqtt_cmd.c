@@ -0,0 +1,353 @@
+#include "mqtt_cmd.h"
+#include <string.h>
+
+#define MQTT_CMD_BIN_VALUE_SIZE (1 + sizeof(int16_t))
+#define MQTT_CMD_BIN_SCREEN_SIZE 3
+#define MQTT_CMD_NAME_MAX 24    // longer than any command name
+
+static const mqtt_cmd_info_t cmd_infos[MQTT_CMD_MAX] = {
+    [MQTT_CMD_NONE]             = { "",                 MQTT_CMD_ARG_NONE,   NULL },
+    [MQTT_CMD_LED_ON]           = { "LED_ON",           MQTT_CMD_ARG_NONE,   NULL },
+    [MQTT_CMD_LED_OFF]          = { "LED_OFF",          MQTT_CMD_ARG_NONE,   NULL },
+    [MQTT_CMD_LED_TOGGLE]       = { "LED_TOGGLE",       MQTT_CMD_ARG_NONE,   NULL },
+    [MQTT_CMD_SERVO_DUTY]       = { "SERVO_DUTY",       MQTT_CMD_ARG_VALUE,  "duty" },
+    [MQTT_CMD_MOTOR_DUTY_FWD]   = { "MOTOR_DUTY_FWD",   MQTT_CMD_ARG_VALUE,  "duty" },
+    [MQTT_CMD_MOTOR_DUTY_BWD]   = { "MOTOR_DUTY_BWD",   MQTT_CMD_ARG_VALUE,  "duty" },
+    [MQTT_CMD_SET_MOTOR]        = { "SET_MOTOR",        MQTT_CMD_ARG_VALUE,  "percent" },
+    [MQTT_CMD_SET_ANGLE]        = { "SET_ANGLE",        MQTT_CMD_ARG_VALUE,  "angle" },
+    [MQTT_CMD_WIFI_SCAN]        = { "WIFI_SCAN",        MQTT_CMD_ARG_NONE,   NULL },
+    [MQTT_CMD_ESP_WIFI_INFO]    = { "ESP_WIFI_INFO",    MQTT_CMD_ARG_NONE,   NULL },
+    [MQTT_CMD_CHIP_INFO]        = { "CHIP_INFO",        MQTT_CMD_ARG_NONE,   NULL },
+    [MQTT_CMD_LIST_NVS_STORAGE] = { "LIST_NVS_STORAGE", MQTT_CMD_ARG_NONE,   NULL },
+    [MQTT_CMD_NVS_STATS]        = { "NVS_STATS",        MQTT_CMD_ARG_NONE,   NULL },
+    [MQTT_CMD_OTA_UPDATE]       = { "OTA_UPDATE",       MQTT_CMD_ARG_NONE,   NULL },
+    [MQTT_CMD_CLEAR_SCREEN]     = { "CLEAR_SCREEN",     MQTT_CMD_ARG_NONE,   NULL },
+    [MQTT_CMD_WRITE_SCREEN]     = { "WRITE_SCREEN",     MQTT_CMD_ARG_SCREEN, NULL },
+};
+
+const mqtt_cmd_info_t *mqtt_cmd_info(mqtt_cmd_op_t op) {
+    return (op > MQTT_CMD_NONE && op < MQTT_CMD_MAX) ? &cmd_infos[op] : NULL;
+}
+
+/** strnlen, which is not in C11 */
+static size_t text_len(const char *text, size_t max) {
+    const char *nul = memchr(text, '\0', max);
+    return (nul != NULL) ? (size_t)(nul - text) : max;
+}
+
+static void set_text(mqtt_cmd_t *cmd, const char *text, size_t len) {
+    len = (len > MQTT_CMD_TEXT_MAX) ? MQTT_CMD_TEXT_MAX : len;
+    memcpy(cmd->text, text, len);
+    cmd->text[len] = '\0';
+}
+
+mqtt_cmd_status_t mqtt_cmd_parse_bin(const uint8_t *buf, size_t len, mqtt_cmd_t *cmd) {
+    if (buf == NULL || len == 0) {
+        return MQTT_CMD_ERR_SIZE;
+    }
+    const mqtt_cmd_info_t *info = mqtt_cmd_info((mqtt_cmd_op_t)buf[0]);
+    if (info == NULL) {
+        return MQTT_CMD_ERR_UNKNOWN;
+    }
+    cmd->op = (mqtt_cmd_op_t)buf[0];
+
+    switch (info->arg) {
+    case MQTT_CMD_ARG_VALUE:
+        if (len != MQTT_CMD_BIN_VALUE_SIZE) {
+            return MQTT_CMD_ERR_SIZE;
+        }
+        memcpy(&cmd->value, &buf[1], sizeof(int16_t));
+        break;
+    case MQTT_CMD_ARG_SCREEN:
+        if (len < MQTT_CMD_BIN_SCREEN_SIZE || len > MQTT_CMD_BIN_SCREEN_SIZE + MQTT_CMD_TEXT_MAX) {
+            return MQTT_CMD_ERR_SIZE;
+        }
+        cmd->x = buf[1];
+        cmd->page = buf[2];
+        set_text(cmd, (const char *)&buf[3], len - MQTT_CMD_BIN_SCREEN_SIZE);
+        break;
+    default:
+        if (len != 1) {
+            return MQTT_CMD_ERR_SIZE;
+        }
+        break;
+    }
+    return MQTT_CMD_OK;
+}
+
+size_t mqtt_cmd_encode_bin(const mqtt_cmd_t *cmd, uint8_t *buf, size_t capacity) {
+    const mqtt_cmd_info_t *info = mqtt_cmd_info(cmd->op);
+    if (info == NULL || capacity < 1) {
+        return 0;
+    }
+    buf[0] = (uint8_t)cmd->op;
+    switch (info->arg) {
+    case MQTT_CMD_ARG_VALUE:
+        if (capacity < MQTT_CMD_BIN_VALUE_SIZE) {
+            return 0;
+        }
+        memcpy(&buf[1], &cmd->value, sizeof(int16_t));
+        return MQTT_CMD_BIN_VALUE_SIZE;
+    case MQTT_CMD_ARG_SCREEN: {
+        size_t n = text_len(cmd->text, MQTT_CMD_TEXT_MAX);
+        if (capacity < MQTT_CMD_BIN_SCREEN_SIZE + n) {
+            return 0;
+        }
+        buf[1] = cmd->x;
+        buf[2] = cmd->page;
+        memcpy(&buf[3], cmd->text, n);
+        return MQTT_CMD_BIN_SCREEN_SIZE + n;
+    }
+    default:
+        return 1;
+    }
+}
+
+// --- Flat JSON object, read in place ---
+
+typedef enum {
+    JSON_NONE = 0,
+    JSON_STRING,    // str/len: raw content between the quotes, see json_unescape
+    JSON_NUMBER,    // num: integer part
+    JSON_LITERAL,   // true, false, null
+} json_kind_t;
+
+typedef struct {
+    json_kind_t kind;
+    const char *str;
+    size_t len;
+    int32_t num;
+} json_value_t;
+
+static const char *skip_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+static const char *scan_string(const char *p, const char *end, const char **str, size_t *len) {
+    if (p >= end || *p != '"') {
+        return NULL;
+    }
+    const char *start = ++p;
+    while (p < end && *p != '"') {
+        p += (*p == '\\') ? 2 : 1;
+    }
+    if (p >= end) {
+        return NULL;
+    }
+    *str = start;
+    *len = (size_t)(p - start);
+    return p + 1;
+}
+
+static const char *scan_value(const char *p, const char *end, json_value_t *v) {
+    if (p >= end) {
+        return NULL;
+    }
+    if (*p == '"') {
+        v->kind = JSON_STRING;
+        return scan_string(p, end, &v->str, &v->len);
+    }
+    if (*p == '-' || (*p >= '0' && *p <= '9')) {
+        bool neg = (*p == '-');
+        p += neg ? 1 : 0;
+        if (p >= end || *p < '0' || *p > '9') {
+            return NULL;
+        }
+        int64_t n = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            n = (n < INT32_MAX) ? n * 10 + (*p - '0') : n;
+            p++;
+        }
+        //fraction / exponent: integer part kept, as cJSON valueint
+        while (p < end && (*p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-'
+            || (*p >= '0' && *p <= '9'))) {
+            p++;
+        }
+        n = neg ? -n : n;
+        v->kind = JSON_NUMBER;
+        v->num = (n > INT32_MAX) ? INT32_MAX : (n < INT32_MIN) ? INT32_MIN : (int32_t)n;
+        return p;
+    }
+    static const char *literals[] = { "true", "false", "null" };
+    for (size_t i = 0; i < sizeof(literals) / sizeof(literals[0]); i++) {
+        size_t n = strlen(literals[i]);
+        if ((size_t)(end - p) >= n && memcmp(p, literals[i], n) == 0) {
+            v->kind = JSON_LITERAL;
+            return p + n;
+        }
+    }
+    return NULL; //nested objects and arrays are not commands
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * Decode the escapes of a string's raw content. \uXXXX is only taken for
+ * ASCII (the screen font has nothing else). Whatever does not fit in
+ * `capacity` is dropped, but still checked.
+ *
+ * @param out_len  decoded length, capped to `capacity`
+ * @return false on a malformed or unsupported escape
+ */
+static bool json_unescape(const char *str, size_t len, char *out, size_t capacity, size_t *out_len) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = str[i];
+        if (c == '\\') {
+            if (++i >= len) {
+                return false;
+            }
+            switch (str[i]) {
+            case '"': case '\\': case '/': c = str[i]; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u': {
+                int code = 0;
+                for (int k = 0; k < 4; k++) {
+                    int d = (++i < len) ? hex_digit(str[i]) : -1;
+                    if (d < 0) {
+                        return false;
+                    }
+                    code = code * 16 + d;
+                }
+                if (code == 0 || code > 0x7F) {
+                    return false;
+                }
+                c = (char)code;
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        if (n < capacity) {
+            out[n++] = c;
+        }
+    }
+    *out_len = n;
+    return true;
+}
+
+static bool key_is(const char *key, size_t len, const char *name) {
+    return name != NULL && strlen(name) == len && memcmp(key, name, len) == 0;
+}
+
+static int16_t clamp16(int32_t v) {
+    return (v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : (int16_t)v;
+}
+
+mqtt_cmd_status_t mqtt_cmd_parse_json(const char *buf, size_t len, mqtt_cmd_t *cmd) {
+    if (buf == NULL || len == 0 || len > MQTT_CMD_JSON_MAX) {
+        return MQTT_CMD_ERR_SIZE;
+    }
+    const char *end = buf + len;
+    const char *p = skip_ws(buf, end);
+    if (p >= end || *p != '{') {
+        return MQTT_CMD_ERR_FORMAT;
+    }
+    p = skip_ws(p + 1, end);
+
+    //fields are kept as found, the command may come after its arguments
+    json_value_t command = {0}, value = {0}, text = {0}, x = {0}, page = {0};
+    const char *value_keys[] = { "duty", "percent", "angle" };
+    const char *value_key = NULL;
+
+    while (p < end && *p != '}') {
+        const char *key;
+        size_t key_len;
+        json_value_t v = {0};
+        p = scan_string(p, end, &key, &key_len);
+        p = (p != NULL) ? skip_ws(p, end) : NULL;
+        if (p == NULL || p >= end || *p != ':') {
+            return MQTT_CMD_ERR_FORMAT;
+        }
+        p = scan_value(skip_ws(p + 1, end), end, &v);
+        if (p == NULL) {
+            return MQTT_CMD_ERR_FORMAT;
+        }
+
+        if (key_is(key, key_len, "command")) {
+            command = v;
+        } else if (key_is(key, key_len, "text")) {
+            text = v;
+        } else if (key_is(key, key_len, "x")) {
+            x = v;
+        } else if (key_is(key, key_len, "page")) {
+            page = v;
+        } else {
+            for (size_t i = 0; i < sizeof(value_keys) / sizeof(value_keys[0]); i++) {
+                if (key_is(key, key_len, value_keys[i])) {
+                    value = v;
+                    value_key = value_keys[i];
+                }
+            }
+        }
+
+        p = skip_ws(p, end);
+        if (p < end && *p == ',') {
+            p = skip_ws(p + 1, end);
+        }
+    }
+    if (p >= end || command.kind != JSON_STRING) {
+        return MQTT_CMD_ERR_FORMAT;
+    }
+
+    char name[MQTT_CMD_NAME_MAX];
+    size_t name_len;
+    if (!json_unescape(command.str, command.len, name, sizeof(name), &name_len)) {
+        return MQTT_CMD_ERR_FORMAT;
+    }
+    const mqtt_cmd_info_t *info = NULL;
+    for (int op = MQTT_CMD_NONE + 1; op < MQTT_CMD_MAX && name_len < sizeof(name); op++) {
+        if (key_is(name, name_len, cmd_infos[op].name)) {
+            info = &cmd_infos[op];
+            cmd->op = (mqtt_cmd_op_t)op;
+            break;
+        }
+    }
+    if (info == NULL) {
+        return MQTT_CMD_ERR_UNKNOWN;
+    }
+
+    switch (info->arg) {
+    case MQTT_CMD_ARG_VALUE:
+        if (value.kind != JSON_NUMBER || !key_is(value_key, strlen(value_key), info->value_key)) {
+            return MQTT_CMD_ERR_FORMAT;
+        }
+        cmd->value = clamp16(value.num);
+        break;
+    case MQTT_CMD_ARG_SCREEN: {
+        if (text.kind != JSON_STRING || x.kind != JSON_NUMBER || page.kind != JSON_NUMBER) {
+            return MQTT_CMD_ERR_FORMAT;
+        }
+        size_t n;
+        if (!json_unescape(text.str, text.len, cmd->text, MQTT_CMD_TEXT_MAX, &n)) {
+            return MQTT_CMD_ERR_FORMAT;
+        }
+        cmd->text[n] = '\0';
+        cmd->x = (uint8_t)x.num;
+        cmd->page = (uint8_t)page.num;
+        break;
+    }
+    default:
+        break;
+    }
+    return MQTT_CMD_OK;
+}
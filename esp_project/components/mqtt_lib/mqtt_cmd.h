@@ -0,0 +1,88 @@
+#ifndef MQTT_CMD_H_
+#define MQTT_CMD_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Remote commands received over MQTT, in two payload formats parsed into the
+// same mqtt_cmd_t:
+// - binary (topic /commands/bin), little-endian:
+//   [0] = opcode (mqtt_cmd_op_t), then by opcode
+//     SERVO_DUTY, MOTOR_DUTY_FWD, MOTOR_DUTY_BWD, SET_MOTOR, SET_ANGLE: [1..2] = int16_t value
+//     WRITE_SCREEN: [1] = x, [2] = page, [3..] = text (no terminator, MQTT_CMD_TEXT_MAX max)
+//     others: nothing
+// - JSON (topic /commands, compatibility with the dashboard):
+//   {"command":"SET_MOTOR","percent":40}, value key by command as in mqtt_cmd_info_t.
+//   Flat objects only, read in place (no allocation). Escapes of the command
+//   and text values are decoded, \uXXXX for ASCII only: anything else is
+//   MQTT_CMD_ERR_FORMAT. Keys are compared as sent.
+// Pure code (no esp-mqtt, no cJSON) so it can be run on the host.
+
+#define MQTT_CMD_TEXT_MAX 32
+#define MQTT_CMD_JSON_MAX 256   // longest JSON payload accepted
+
+typedef enum {
+    MQTT_CMD_NONE = 0,
+    MQTT_CMD_LED_ON,
+    MQTT_CMD_LED_OFF,
+    MQTT_CMD_LED_TOGGLE,
+    MQTT_CMD_SERVO_DUTY,
+    MQTT_CMD_MOTOR_DUTY_FWD,
+    MQTT_CMD_MOTOR_DUTY_BWD,
+    MQTT_CMD_SET_MOTOR,
+    MQTT_CMD_SET_ANGLE,
+    MQTT_CMD_WIFI_SCAN,
+    MQTT_CMD_ESP_WIFI_INFO,
+    MQTT_CMD_CHIP_INFO,
+    MQTT_CMD_LIST_NVS_STORAGE,
+    MQTT_CMD_NVS_STATS,
+    MQTT_CMD_OTA_UPDATE,
+    MQTT_CMD_CLEAR_SCREEN,
+    MQTT_CMD_WRITE_SCREEN,
+
+    MQTT_CMD_MAX
+} mqtt_cmd_op_t;
+
+typedef enum {
+    MQTT_CMD_OK = 0,
+    MQTT_CMD_ERR_SIZE,      // payload too short / too long for its opcode
+    MQTT_CMD_ERR_UNKNOWN,   // no such command
+    MQTT_CMD_ERR_FORMAT,    // malformed JSON, missing or mistyped field
+} mqtt_cmd_status_t;
+
+typedef enum {
+    MQTT_CMD_ARG_NONE = 0,
+    MQTT_CMD_ARG_VALUE,     // one int16_t
+    MQTT_CMD_ARG_SCREEN,    // x, page, text
+} mqtt_cmd_arg_t;
+
+typedef struct {
+    const char *name;       // JSON "command"
+    mqtt_cmd_arg_t arg;
+    const char *value_key;  // JSON key of the value, MQTT_CMD_ARG_VALUE only
+} mqtt_cmd_info_t;
+
+typedef struct {
+    mqtt_cmd_op_t op;
+    int16_t value;
+    uint8_t x;
+    uint8_t page;
+    char text[MQTT_CMD_TEXT_MAX + 1];
+} mqtt_cmd_t;
+
+/** @return name and arguments of `op`, NULL if out of range */
+const mqtt_cmd_info_t *mqtt_cmd_info(mqtt_cmd_op_t op);
+
+mqtt_cmd_status_t mqtt_cmd_parse_bin(const uint8_t *buf, size_t len, mqtt_cmd_t *cmd);
+
+mqtt_cmd_status_t mqtt_cmd_parse_json(const char *buf, size_t len, mqtt_cmd_t *cmd);
+
+/**
+ * Binary payload of `cmd` (e.g. for a sender or a test).
+ *
+ * @return payload length, 0 if `capacity` is too small
+ */
+size_t mqtt_cmd_encode_bin(const mqtt_cmd_t *cmd, uint8_t *buf, size_t capacity);
+
+#endif
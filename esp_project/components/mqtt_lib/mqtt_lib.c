@@ -21,6 +21,7 @@
 #include <esp_crt_bundle.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 #include "actuators_lib.h"
 #include "nvs_lib.h"
@@ -28,7 +29,13 @@
 #include "ota_lib.h"
 #include "wifi_lib.h"
 #include "screen_lib.h"
-#include "cJSON.h"
+#include "mqtt_cmd.h"
+#include "mqtt_router.h"
+#include "mqtt_batch.h"
+#include "udp_lib.h"
+#include "sensors_lib.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "cmd_lib.h"
 #include "log_lib.h"
 
@@ -37,162 +44,140 @@
 //command to add dependency
 //idf.py add-dependency espressif/mqtt
 
-#define QUEUE_SIZE 256
+#define MQTT_TOPIC_COMMANDS "/commands"             // JSON commands
+#define MQTT_TOPIC_COMMANDS_BIN "/commands/bin"     // binary commands (mqtt_cmd.h)
+#define MQTT_TOPIC_GAMEPAD "windowscontrols/gamepad"
 
-#define USE_QUEUE_LOGS 0
+#define MQTT_GAMEPAD_FRAME_SIZE 9 // [type][size][payload (7)]
 
 static const char *TAG = "mqtt_library";
 
 static esp_mqtt_client_handle_t client = NULL;
 
-static QueueHandle_t xQueue = NULL;
-
-static bool mqtt_connected = false;
+static volatile bool mqtt_connected = false;
 
 static bool initialized = 0;
 
-typedef struct {
-    char topic[64];
-    char payload[256];
-    int qos;
-    bool retain;
-} mqtt_msg_t;
-
-static void handle_mqtt_data(const char *data, size_t len) {
-    char buf[256];
-    if (len >= sizeof(buf)) len = sizeof(buf)-1;
-    memcpy(buf, data, len);
-    buf[len] = '\0';
-
-    cJSON *root = cJSON_Parse(buf);
-    if (!root) {
-        log_msg(TAG, "JSON parse error");
-        return;
-    }
-
-    cJSON *cmd = cJSON_GetObjectItem(root, "command");
-    if (!cJSON_IsString(cmd)) {
-        log_msg(TAG, "No command string found");
-        cJSON_Delete(root);
-        return;
-    }
-
-    if (strcmp(cmd->valuestring, "LED_ON") == 0) {
+static void execute_command(const mqtt_cmd_t *cmd) {
+    switch (cmd->op) {
+    case MQTT_CMD_LED_ON:
         log_msg(TAG, "Start Led On");
         led_on();
-    } else if (strcmp(cmd->valuestring, "LED_OFF") == 0) {
+        break;
+    case MQTT_CMD_LED_OFF:
         log_msg(TAG, "Start Led Off");
         led_off();
-    } else if (strcmp(cmd->valuestring, "LED_TOGGLE") == 0) {
+        break;
+    case MQTT_CMD_LED_TOGGLE:
         log_msg(TAG, "Toggling LED");
         led_toggle();
-    } else if (strcmp(cmd->valuestring, "SERVO_DUTY") == 0) {
-        cJSON *duty = cJSON_GetObjectItem(root, "duty");
-
-        if (cJSON_IsNumber(duty)) {
-            log_msg(TAG, "Updating servo duty : %d",
-                     duty->valueint);
-            ledc_angle(duty->valueint);
-        } else {
-            log_msg(TAG, "Invalid SERVO_DUTY JSON");
-        }
-
-    } else if (strcmp(cmd->valuestring, "MOTOR_DUTY_FWD") == 0) {
-        cJSON *duty = cJSON_GetObjectItem(root, "duty");
-
-        if (cJSON_IsNumber(duty)) {
-            log_msg(TAG, "Updating motor fwd duty : %d",
-                     duty->valueint);
-            ledc_motor(duty->valueint);
-        } else {
-            log_msg(TAG, "Invalid MOTOR_DUTY_FWD JSON");
-        }
-
-    } else if (strcmp(cmd->valuestring, "MOTOR_DUTY_BWD") == 0) {
-        cJSON *duty = cJSON_GetObjectItem(root, "duty");
-
-        if (cJSON_IsNumber(duty)) {
-            log_msg(TAG, "Updating motor bwd duty : %d",
-                     duty->valueint);
-            ledc_motor(duty->valueint);
-        } else {
-            log_msg(TAG, "Invalid MOTOR_DUTY_BWD JSON");
-        }
-
-    } else if (strcmp(cmd->valuestring, "SET_MOTOR") == 0) {
-        cJSON *percent = cJSON_GetObjectItem(root, "percent");
-
-        if (cJSON_IsNumber(percent)) {
-            log_msg(TAG, "Updating motor percent : %d",
-                     percent->valueint);
-            ledc_motor(percent->valueint);
-        } else {
-            log_msg(TAG, "Invalid SET_MOTOR JSON");
-        }
-
-    } else if (strcmp(cmd->valuestring, "SET_ANGLE") == 0) {
-        cJSON *angle = cJSON_GetObjectItem(root, "angle");
-
-        if (cJSON_IsNumber(angle)) {
-            log_msg(TAG, "Updating servo angle : %d",
-                     angle->valueint);
-            ledc_angle(angle->valueint);
-        } else {
-            log_msg(TAG, "Invalid SET_ANGLE JSON");
-        }
-
-    } else if (strcmp(cmd->valuestring, "WIFI_SCAN") == 0) {
+        break;
+    //actuator commands come in streams, no log per command
+    case MQTT_CMD_SERVO_DUTY:
+    case MQTT_CMD_SET_ANGLE:
+#if CONFIG_CMD_DEBUG
+        log_msg(TAG, "Updating servo angle : %d", cmd->value);
+#endif
+        ledc_angle(cmd->value);
+        break;
+    case MQTT_CMD_MOTOR_DUTY_FWD:
+    case MQTT_CMD_MOTOR_DUTY_BWD:
+    case MQTT_CMD_SET_MOTOR:
+#if CONFIG_CMD_DEBUG
+        log_msg(TAG, "Updating motor : %d", cmd->value);
+#endif
+        ledc_motor(cmd->value);
+        break;
+    case MQTT_CMD_WIFI_SCAN:
         log_msg(TAG, "Starting Wifi Scan");
 #if DEBUG_WIFI
         wifi_scan_aps();
 #else
         log_msg(TAG, "Wifi debug not activated");
 #endif
-    } else if (strcmp(cmd->valuestring, "ESP_WIFI_INFO") == 0) {
+        break;
+    case MQTT_CMD_ESP_WIFI_INFO:
         log_msg(TAG, "Starting ESP Scan");
 #if DEBUG_WIFI
         wifi_scan_esp();
 #else
         log_msg(TAG, "Wifi debug not activated");
 #endif
-    } else if (strcmp(cmd->valuestring, "CHIP_INFO") == 0) {
+        break;
+    case MQTT_CMD_CHIP_INFO:
         log_msg(TAG, "Printing chip info");
         print_chip_info();
-    } else if (strcmp(cmd->valuestring, "LIST_NVS_STORAGE") == 0) {
+        break;
+    case MQTT_CMD_LIST_NVS_STORAGE:
         log_msg(TAG, "Listing NVS storage");
         list_storage();
-    } else if (strcmp(cmd->valuestring, "NVS_STATS") == 0) {
+        break;
+    case MQTT_CMD_NVS_STATS:
         log_msg(TAG, "Showing NVS statistics");
         show_nvs_stats();
-    } else if (strcmp(cmd->valuestring, "OTA_UPDATE") == 0) {
+        break;
+    case MQTT_CMD_OTA_UPDATE:
         log_msg(TAG, "Starting OTA update");
         ota_init();
-    } else if (strcmp(cmd->valuestring, "CLEAR_SCREEN") == 0) {
+        break;
+    case MQTT_CMD_CLEAR_SCREEN:
         log_msg(TAG, "Clearing screen");
         screen_full_off();
-    } else if (strcmp(cmd->valuestring, "WRITE_SCREEN") == 0) {
-        cJSON *text = cJSON_GetObjectItem(root, "text");
-        cJSON *x = cJSON_GetObjectItem(root, "x");
-        cJSON *page = cJSON_GetObjectItem(root, "page");
-
-        if (cJSON_IsString(text) && cJSON_IsNumber(x) && cJSON_IsNumber(page)) {
-            log_msg(TAG, "Write screen: '%s' at x=%d page=%d",
-                     text->valuestring, x->valueint, page->valueint);
-            ssd1306_draw_string(text->valuestring, x->valueint, page->valueint);
-        } else {
-            log_msg(TAG, "Invalid WRITE_SCREEN JSON");
-        }
-        
-    } else {
+        break;
+    case MQTT_CMD_WRITE_SCREEN:
+        log_msg(TAG, "Write screen: '%s' at x=%d page=%d", cmd->text, cmd->x, cmd->page);
+        ssd1306_draw_string(cmd->text, cmd->x, cmd->page);
+        break;
+    default:
+        log_msg(TAG, "Event unkown");
+        break;
+    }
+}
+
+static void handle_command_status(mqtt_cmd_status_t status, const char *format) {
+    switch (status) {
+    case MQTT_CMD_ERR_SIZE:
+        log_msg(TAG, "Invalid %s command size", format);
+        break;
+    case MQTT_CMD_ERR_UNKNOWN:
         log_msg(TAG, "Event unkown");
+        break;
+    default:
+        log_msg(TAG, "Invalid %s command", format);
+        break;
     }
+}
 
-    cJSON_Delete(root);
+static void handle_mqtt_bin(const char *data, size_t len, void *arg) {
+    mqtt_cmd_t cmd;
+    mqtt_cmd_status_t status = mqtt_cmd_parse_bin((const uint8_t *)data, len, &cmd);
+    if (status != MQTT_CMD_OK) {
+        handle_command_status(status, "binary");
+        return;
+    }
+    execute_command(&cmd);
 }
 
-static void handle_mqtt_controller(const char *data, size_t len) {
+#if CONFIG_MQTT_JSON_COMMANDS
+static void handle_mqtt_json(const char *data, size_t len, void *arg) {
+    mqtt_cmd_t cmd;
+    mqtt_cmd_status_t status = mqtt_cmd_parse_json(data, len, &cmd);
+    if (status != MQTT_CMD_OK) {
+        handle_command_status(status, "JSON");
+        return;
+    }
+    execute_command(&cmd);
+}
+#endif
+
+static void handle_mqtt_controller(const char *data, size_t len, void *arg) {
     int8_t *payload = (int8_t *)data; /*from -128 to 127*/
 
+    if (len < MQTT_GAMEPAD_FRAME_SIZE) {
+        log_msg(TAG, "Invalid gamepad size %u", (unsigned)len);
+        return;
+    }
+
     esp_err_t err;
     gamepad_t gamepad;
     err = gamepad_from_buffer(payload, &gamepad);
@@ -202,7 +187,9 @@ static void handle_mqtt_controller(const char *data, size_t len) {
         return;
     }
 
+#if CONFIG_CMD_DEBUG
     dump_gamepad(&gamepad);
+#endif
 
     err = apply_gamepad_commands(&gamepad);
     if (err != ESP_OK) {
@@ -213,29 +200,50 @@ static void handle_mqtt_controller(const char *data, size_t len) {
 
 }
 
+//topics subscribed on connection, looked up through `router` on every message
+static const struct {
+    const char *topic;
+    mqtt_route_cb_t handler;
+} routes[] = {
+#if CONFIG_MQTT_JSON_COMMANDS
+    { MQTT_TOPIC_COMMANDS, handle_mqtt_json },
+#endif
+    { MQTT_TOPIC_COMMANDS_BIN, handle_mqtt_bin },
+    { MQTT_TOPIC_GAMEPAD, handle_mqtt_controller },
+};
+
+static mqtt_router_t router;
+
+static void init_router(void) {
+    mqtt_router_init(&router);
+    for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+        if (!mqtt_router_add(&router, routes[i].topic, routes[i].handler, NULL)) {
+            log_msg(TAG, "Router full, %s not routed", routes[i].topic);
+        }
+    }
+}
 
 static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event)
 {
     client = event->client;
     int msg_id;
-    char topic[event->topic_len + 1];
     // your_context_t *context = event->context;
     switch (event->event_id) {
     case MQTT_EVENT_CONNECTED:
         //ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
         log_msg(TAG, "MQTT_EVENT_CONNECTED");
 
-        msg_id = esp_mqtt_client_subscribe(client, "/commands/#", 0);
-        msg_id = esp_mqtt_client_subscribe(client, "windowscontrols/gamepad", 0);
-        //ESP_LOGI(TAG, "sent subscribe successful, msg_id=%d", msg_id);
+        for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+            msg_id = esp_mqtt_client_subscribe(client, routes[i].topic, 0);
+            log_msg(TAG, "Sent subscribe to %s successful, msg_id=%d", routes[i].topic, msg_id);
+        }
         //esp_mqtt_client_publish(client, "/commands/qos1", "commence", 0, 1, 0);
-        log_msg(TAG, "Sent subscribe to /commands/# successful, msg_id=%d", msg_id);
-        log_msg(TAG, "Sent subscribe to windowscontrols/gamepad successful, msg_id=%d", msg_id);
 
         break;
     case MQTT_EVENT_DISCONNECTED:
         //ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
         log_msg(TAG, "MQTT_EVENT_DISCONNECTED");
+        mqtt_connected = false; //telemetry kept in the ring until reconnected
         break;
 
     case MQTT_EVENT_SUBSCRIBED:
@@ -251,21 +259,18 @@ static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event)
             "MQTT_EVENT_UNSUBSCRIBED, msg_id=%d", event->msg_id);
         break;
     case MQTT_EVENT_PUBLISHED:
-        //ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
-        log_msg(TAG,
-            "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+        //one per QoS 1 publish, logs included: logging it would feed the log batch forever
+    #if CONFIG_MQTT_DEBUG_EVENTS
+        ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+    #endif
         break;
     case MQTT_EVENT_DATA:
-        //ESP_LOGI(TAG, "MQTT_EVENT_DATA");
-        //log_msg(TAG, "MQTT_EVENT_DATA");
-        
-        memcpy(topic, event->topic, event->topic_len);
-        topic[event->topic_len] = '\0';
-        if (strcmp(topic, "/commands") == 0) {
-            handle_mqtt_data(event->data, event->data_len);
-        } else if (strcmp(topic, "windowscontrols/gamepad") == 0 ){
-            handle_mqtt_controller(event->data, event->data_len);
+        //commands are small, a message split over several events is not one
+        if (event->current_data_offset != 0 || event->data_len != event->total_data_len) {
+            break;
         }
+        //topic and data used in place, no copy
+        mqtt_router_dispatch(&router, event->topic, event->topic_len, event->data, event->data_len);
         break;
     case MQTT_EVENT_ERROR:
         //ESP_LOGI(TAG, "MQTT_EVENT_ERROR");
@@ -284,110 +289,203 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 {
     /* The argument passed to esp_mqtt_client_register_event can de accessed as handler_args*/
     //ESP_LOGD(TAG, "Event dispatched from event loop base=%s, event_id=%" PRIi32, base, event_id);
+#if CONFIG_MQTT_DEBUG_EVENTS
     log_msg(TAG,
             "Event dispatched from event loop base=%s, event_id=%" PRIi32, base, event_id);
+#endif
     mqtt_event_handler_cb(event_data);
 }
 
-static void log_task(void *pvParameters) {
-    mqtt_msg_t m;
+#if CONFIG_MQTT_TELEMETRY
+/*
+ * Telemetry publisher: the sensor and log frames udp_lib sends (udp_add_tap) are batched per
+ * topic (mqtt_batch.h) and published every MQTT_TELEMETRY_INTERVAL_MS as
+ * rc/<esp id>/sensors/<sensor type> and rc/<esp id>/logs. While the broker is unreachable the
+ * closed batches wait in a ring in PSRAM, oldest dropped first, and are replayed on reconnection
+ * MQTT_TELEMETRY_REPLAY_BURST at a time. State frames (motor, ping, esp) only keep the latest.
+ */
+
+#define MQTT_TELEMETRY_INTERVAL_MS CONFIG_MQTT_TELEMETRY_INTERVAL_MS
+#define MQTT_TELEMETRY_BATCH_SIZE CONFIG_MQTT_TELEMETRY_BATCH_SIZE
+#define MQTT_TELEMETRY_RING_SIZE CONFIG_MQTT_TELEMETRY_RING_SIZE
+#define MQTT_TELEMETRY_RING_FALLBACK_SIZE 16384 // internal RAM, when there is no PSRAM
+#define MQTT_TELEMETRY_REPLAY_BURST 16 // batches per tick, a replay must not flood the outbox
+#define MQTT_TELEMETRY_STATS_MS 60000
+#define MQTT_TELEMETRY_TOPIC_LOGS SENSOR_TYPE_MAX // batch topic of the log frames
+#define MQTT_TELEMETRY_TOPIC_PREFIX "rc"
+
+#if CONFIG_MQTT_TELEMETRY_COMPRESS
+#define MQTT_TELEMETRY_COMPRESS true
+#else
+#define MQTT_TELEMETRY_COMPRESS false
+#endif
 
-    while (1) {
-        if (mqtt_connected && xQueue != NULL) {
-            #if USE_QUEUE_LOGS 
-                if (xQueueReceive(xQueue, &m, portMAX_DELAY) == pdTRUE) {
-                //log_msg(TAG, "Trying MQQT publish: %s", m.payload);
-                    if (esp_mqtt_client_publish(client, m.topic, m.payload, strlen(m.payload), m.qos, m.retain) < 0) {
-                        ESP_LOGE(TAG, "MQTT publish failed: %s", m.payload);
-                    }
-                }
-            #else
-                //empty the whole queue
-                while (xQueueReceive(xQueue, &m, 0) == pdTRUE) {
-                    if (esp_mqtt_client_publish(client, m.topic, m.payload,
-                                                strlen(m.payload), m.qos, m.retain) < 0) {
-                        ESP_LOGE(TAG, "MQTT publish failed: %s", m.payload);
-                    }
-                }
-
-                // if queue empty, delete task & queue
-                if (uxQueueMessagesWaiting(xQueue) == 0) {
-                    vQueueDelete(xQueue);
-                    xQueue = NULL;
-                    ESP_LOGI(TAG, "Queue deleted, all pending logs sent");
-                    vTaskDelete(NULL);
-                }
-            #endif
+static mqtt_batch_t batcher;
+static SemaphoreHandle_t batch_mutex = NULL;
+static uint8_t *publish_buf = NULL;
+static size_t ring_size = 0;
+static uint32_t published = 0;
+static uint32_t publish_errors = 0;
+static atomic_uint lock_drops = 0;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/**
+ * Log frame ([esp id][timestamp][level][tag length][tag][msg], log_lib) of this library:
+ * publishing it would log again (events, errors), each log feeding the next batch
+ */
+static bool own_log(const uint8_t *data, uint32_t len) {
+    const uint32_t tag_offset = 1 + sizeof(uint32_t) + 1 + 1;
+    size_t tag_len = strlen(TAG);
+    return len >= tag_offset + tag_len && data[tag_offset - 1] == tag_len
+        && memcmp(&data[tag_offset], TAG, tag_len) == 0;
+}
+
+/**
+ * udp_lib tap: runs in the publisher's task (the motor esp_timer for the motor frames),
+ * never waits, a busy lock drops the frame
+ */
+static void telemetry_tap(udp_channel_t channel, const uint8_t *data, uint32_t len) {
+    uint8_t topic;
+    if (channel == UDP_CHANNEL_LOGS && !own_log(data, len)) {
+        topic = MQTT_TELEMETRY_TOPIC_LOGS;
+    } else if (channel == UDP_CHANNEL_SENSORS && len >= HEADER_SENSOR_SIZE && data[0] < SENSOR_TYPE_MAX) {
+        topic = data[0];
+    } else {
+        return;
+    }
+
+    if (xSemaphoreTake(batch_mutex, 0) != pdTRUE) {
+        atomic_fetch_add(&lock_drops, 1);
+        return;
+    }
+    mqtt_batch_push(&batcher, topic, data, len, now_ms(), mqtt_connected);
+    xSemaphoreGive(batch_mutex);
+}
+
+static void telemetry_topic(uint8_t topic, char *name, size_t size) {
+    if (topic == MQTT_TELEMETRY_TOPIC_LOGS) {
+        snprintf(name, size, MQTT_TELEMETRY_TOPIC_PREFIX "/%d/logs", CONFIG_ESP_ID);
+    } else {
+        snprintf(name, size, MQTT_TELEMETRY_TOPIC_PREFIX "/%d/sensors/%u", CONFIG_ESP_ID, topic);
+    }
+}
+
+/**
+ * Publish the oldest batches, each one left in the ring until the client took it
+ */
+static void telemetry_publish(void) {
+    for (int i = 0; i < MQTT_TELEMETRY_REPLAY_BURST && mqtt_connected; i++) {
+        uint8_t topic = 0;
+        uint32_t seq = 0;
+        xSemaphoreTake(batch_mutex, portMAX_DELAY);
+        size_t len = mqtt_batch_peek(&batcher, publish_buf, MQTT_TELEMETRY_BATCH_SIZE, &topic, &seq);
+        if (len == 0) {
+            xSemaphoreGive(batch_mutex);
+            return; //ring empty, topic not written
         }
-        vTaskDelay((TickType_t)5);
+        uint8_t qos = batcher.topics[topic].qos;
+        xSemaphoreGive(batch_mutex);
+
+        char name[48];
+        telemetry_topic(topic, name, sizeof(name));
+        if (esp_mqtt_client_publish(client, name, (const char *)publish_buf, len, qos, 0) < 0) {
+            publish_errors++;
+            return; //kept for the next tick
+        }
+
+        xSemaphoreTake(batch_mutex, portMAX_DELAY);
+        mqtt_batch_pop(&batcher, seq);
+        xSemaphoreGive(batch_mutex);
+        published++;
     }
 }
 
-/*
-void log_msg(mqtt_log_level lvl, const char * tag, bool mqtt, const char* fmt, ...) {
-    char buf[256];
-    va_list args;
+static void telemetry_task(void *pvParameters) {
+    uint32_t last_stats = now_ms();
 
-    if (lvl < LOG_LEVEL) {
-        return;
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(MQTT_TELEMETRY_INTERVAL_MS));
+
+        xSemaphoreTake(batch_mutex, portMAX_DELAY);
+        mqtt_batch_flush(&batcher, now_ms(), MQTT_TELEMETRY_INTERVAL_MS, mqtt_connected);
+        xSemaphoreGive(batch_mutex);
+
+        telemetry_publish();
+
+        if (now_ms() - last_stats >= MQTT_TELEMETRY_STATS_MS) {
+            last_stats = now_ms();
+            mqtt_telemetry_stats_t stats;
+            mqtt_get_telemetry_stats(&stats);
+            log_msg(TAG, "Telemetry: %" PRIu32 " frames, %" PRIu32 " batches published, %" PRIu32 " dropped, "
+                "%u/%u bytes queued, %" PRIu32 "%% compressed size",
+                stats.batch.frames, stats.published, stats.batch.batches_dropped,
+                (unsigned)stats.ring_used, (unsigned)stats.ring_size,
+                stats.batch.bytes_raw ? (uint32_t)(100ULL * stats.batch.bytes_out / stats.batch.bytes_raw) : 100);
+        }
     }
+}
 
-    va_start(args, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, args);
-    va_end(args);
+static esp_err_t telemetry_init(void) {
+    batch_mutex = xSemaphoreCreateMutex();
+    uint8_t *slots = malloc((MQTT_BATCH_SLOTS + 1) * MQTT_TELEMETRY_BATCH_SIZE);
+    publish_buf = malloc(MQTT_TELEMETRY_BATCH_SIZE);
+    ring_size = MQTT_TELEMETRY_RING_SIZE;
+    uint8_t *ring = heap_caps_malloc(ring_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (ring == NULL) {
+        ring_size = MQTT_TELEMETRY_RING_FALLBACK_SIZE;
+        ring = malloc(ring_size);
+        log_msg(TAG, "No PSRAM for the telemetry ring, %u bytes in internal RAM", (unsigned)ring_size);
+    }
+    if (batch_mutex == NULL || slots == NULL || publish_buf == NULL || ring == NULL) {
+        free(slots);
+        free(publish_buf);
+        free(ring);
+        publish_buf = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    mqtt_batch_init(&batcher, slots, MQTT_TELEMETRY_BATCH_SIZE, ring, ring_size, MQTT_TELEMETRY_COMPRESS);
+    for (uint8_t type = 0; type < SENSOR_TYPE_MAX; type++) {
+        mqtt_batch_set_topic(&batcher, type, MQTT_BATCH_DROP_OLDEST, CONFIG_MQTT_TELEMETRY_QOS);
+    }
+    mqtt_batch_set_topic(&batcher, SENSOR_TYPE_MOTOR, MQTT_BATCH_COALESCE_LATEST, CONFIG_MQTT_TELEMETRY_QOS);
+    mqtt_batch_set_topic(&batcher, SENSOR_TYPE_PING, MQTT_BATCH_COALESCE_LATEST, CONFIG_MQTT_TELEMETRY_QOS);
+    mqtt_batch_set_topic(&batcher, SENSOR_TYPE_ESP, MQTT_BATCH_COALESCE_LATEST, CONFIG_MQTT_TELEMETRY_QOS);
+    mqtt_batch_set_topic(&batcher, MQTT_TELEMETRY_TOPIC_LOGS, MQTT_BATCH_DROP_OLDEST, 1);
 
-    // Print on UART
-    switch (lvl) {
-        case LOG_INFO:  ESP_LOGI(tag, "%s", buf); break;
-        case LOG_WARN:  ESP_LOGW(tag, "%s", buf); break;
-        case LOG_ERROR: ESP_LOGE(tag, "%s", buf); break;
-        case LOG_DEBUG: ESP_LOGD(tag, "%s", buf); break;
+    if (xTaskCreate(telemetry_task, "mqtt_telemetry", 4096, NULL, 3, NULL) != pdPASS) {
+        return ESP_FAIL;
     }
+    return udp_add_tap(telemetry_tap);
+}
 
-    // Send MQTT if activated
-    if (mqtt) {
-        #if USE_QUEUE_LOGS
-            if (xQueue != NULL) {
-                mqtt_msg_t m;
-                m.qos = 0;
-                m.retain = false;
-                snprintf(m.topic, sizeof(m.topic), "/logs/%s", tag);
-                snprintf(m.payload, sizeof(m.payload), "[%s] %.200s", tag, buf);
-                if (xQueueSend(xQueue, &m, 0) != pdTRUE) {
-                    ESP_LOGE(TAG, "Fail to send message to Queue");
-                }
-            } else {
-                ESP_LOGD(TAG, "Queue not initialized");
-            }
-        #else
-            if (!mqtt_connected) {
-                if (xQueue != NULL) {
-                    mqtt_msg_t m;
-                    m.qos = 0;
-                    m.retain = false;
-                    snprintf(m.topic, sizeof(m.topic), "/logs/%s", tag);
-                    snprintf(m.payload, sizeof(m.payload), "[%s] %.200s", tag, buf);
-                    if (xQueueSend(xQueue, &m, 0) != pdTRUE) {
-                        ESP_LOGE(TAG, "Fail to send message to Queue");
-                    }
-                } else {
-                    ESP_LOGD(TAG, "Queue not initialized");
-                }
-            } else {
-                mqtt_msg_t m;
-                m.qos = 0;
-                m.retain = false;
-                snprintf(m.topic, sizeof(m.topic), "/logs/%s", tag);
-                snprintf(m.payload, sizeof(m.payload), "[%s] %.200s", tag, buf);
-                if (esp_mqtt_client_publish(client, m.topic, m.payload, strlen(m.payload), m.qos, m.retain) < 0) {
-                    ESP_LOGE(TAG, "MQTT publish failed: %s", m.payload);
-                }
-            }
-        #endif
-        
+esp_err_t mqtt_get_telemetry_stats(mqtt_telemetry_stats_t *stats) {
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
+    if (batch_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(batch_mutex, portMAX_DELAY);
+    stats->batch = batcher.stats;
+    stats->ring_used = batcher.used;
+    stats->ring_batches = batcher.records;
+    xSemaphoreGive(batch_mutex);
+    stats->ring_size = ring_size;
+    stats->published = published;
+    stats->publish_errors = publish_errors;
+    stats->lock_drops = atomic_load(&lock_drops);
+    stats->connected = mqtt_connected;
+    return ESP_OK;
+}
+#else
+esp_err_t mqtt_get_telemetry_stats(mqtt_telemetry_stats_t *stats) {
+    return ESP_ERR_NOT_SUPPORTED;
 }
-    */
+#endif
 
 void mqtt_start()
 {
@@ -397,6 +495,8 @@ void mqtt_start()
     }
     initialized = 1;
 
+    init_router();
+
     esp_err_t err;
 
 /*
@@ -435,19 +535,19 @@ void mqtt_start()
     char broker_uri[100];
     char broker_username[32];
     char broker_password[32];
-    err = load_nvs_str("MQTT_URI", broker_uri);
+    err = load_nvs_strn("MQTT_URI", broker_uri, sizeof(broker_uri));
     if (err != ESP_OK) {
         log_msg(TAG, "Error (%s) on loading MQTT_URI to NVS",
             esp_err_to_name(err));
     } else {
         log_msg(TAG, "MQTT_URI loaded");
     }
-    err = load_nvs_str("MQTT_USERNAME", broker_username);
+    err = load_nvs_strn("MQTT_USERNAME", broker_username, sizeof(broker_username));
     if (err != ESP_OK) {
         log_msg(TAG, "Error (%s) on loading MQTT_USERNAME to NVS",
             esp_err_to_name(err));
     }
-    err = load_nvs_str("MQTT_PASSWORD", broker_password);
+    err = load_nvs_strn("MQTT_PASSWORD", broker_password, sizeof(broker_password));
     if (err != ESP_OK) {
         log_msg(TAG, "Error (%s) on loading MQTT_PASSWORD to NVS",
             esp_err_to_name(err));
@@ -469,32 +569,11 @@ void mqtt_start()
     esp_mqtt_client_start(client);
 
     //TODO : error check here
-}
-
-void init_queue_mqtt() {
-
-    if (xQueue != NULL) {
-        return;
-    }
 
-    xQueue = xQueueCreate(QUEUE_SIZE, sizeof(mqtt_msg_t));
-    if (xQueue == NULL) {
-        ESP_LOGE(TAG, "Failed to create MQTT queue");
-        return;
-    }
-
-    BaseType_t result = xTaskCreate(
-        log_task,          // function pointer
-        "mqtt_log_task",   // task name
-        4096,              // stack size
-        NULL,              // task parameter
-        5,                 // priority
-        NULL               // task handle
-    );
-
-    if (result != pdPASS) {
-        log_msg(TAG, "Failed to create log task");
+#if CONFIG_MQTT_TELEMETRY
+    err = telemetry_init();
+    if (err != ESP_OK) {
+        log_msg(TAG, "Error (%s) starting the telemetry publisher", esp_err_to_name(err));
     }
+#endif
 }
-
-
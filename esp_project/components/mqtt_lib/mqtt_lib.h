@@ -1,10 +1,29 @@
 #ifndef MQTT_LIB_H_
 #define MQTT_LIB_H_
 
-//init queue for debug messages
-void init_queue_mqtt();
+#include <stdbool.h>
+#include <esp_err.h>
+#include "mqtt_batch.h"
+
+typedef struct {
+    mqtt_batch_stats_t batch;
+    size_t ring_used;       // bytes of batches waiting to be published
+    uint32_t ring_batches;
+    size_t ring_size;
+    uint32_t published;     // batches
+    uint32_t publish_errors;
+    uint32_t lock_drops;    // frames not batched, the lock was busy (taps never wait)
+    bool connected;
+} mqtt_telemetry_stats_t;
 
 //init mqtt
 void mqtt_start();
 
-#endif
\ No newline at end of file
+/**
+ * Telemetry publisher counters (CONFIG_MQTT_TELEMETRY)
+ *
+ * @return ESP_ERR_NOT_SUPPORTED if disabled, ESP_ERR_INVALID_STATE if not started
+ */
+esp_err_t mqtt_get_telemetry_stats(mqtt_telemetry_stats_t *stats);
+
+#endif
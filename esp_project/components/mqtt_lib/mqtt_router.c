@@ -0,0 +1,69 @@
+#include "mqtt_router.h"
+#include <string.h>
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+uint32_t mqtt_router_hash(const char *topic, size_t len) {
+    uint32_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)topic[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+void mqtt_router_init(mqtt_router_t *router) {
+    memset(router, 0, sizeof(*router));
+}
+
+/**
+ * Slot holding `topic`, or the free slot ending its probe sequence
+ */
+static size_t probe(const mqtt_router_t *router, uint32_t hash, const char *topic, size_t len) {
+    size_t i = hash & (MQTT_ROUTER_SLOTS - 1);
+    for (;;) {
+        const mqtt_route_t *route = &router->slots[i];
+        if (route->topic == NULL || (route->hash == hash && route->topic_len == len
+            && memcmp(route->topic, topic, len) == 0)) {
+            return i;
+        }
+        i = (i + 1) & (MQTT_ROUTER_SLOTS - 1);
+    }
+}
+
+bool mqtt_router_add(mqtt_router_t *router, const char *topic, mqtt_route_cb_t handler, void *arg) {
+    size_t len = strlen(topic);
+    uint32_t hash = mqtt_router_hash(topic, len);
+    mqtt_route_t *route = &router->slots[probe(router, hash, topic, len)];
+    if (route->topic == NULL) {
+        if (router->count >= MQTT_ROUTER_SLOTS / 2) {
+            return false;
+        }
+        router->count++;
+    }
+    route->hash = hash;
+    route->topic = topic;
+    route->topic_len = len;
+    route->handler = handler;
+    route->arg = arg;
+    return true;
+}
+
+const mqtt_route_t *mqtt_router_find(const mqtt_router_t *router, const char *topic, size_t len) {
+    if (topic == NULL) {
+        return NULL;
+    }
+    const mqtt_route_t *route = &router->slots[probe(router, mqtt_router_hash(topic, len), topic, len)];
+    return (route->topic != NULL) ? route : NULL;
+}
+
+bool mqtt_router_dispatch(const mqtt_router_t *router, const char *topic, size_t topic_len,
+    const char *data, size_t data_len) {
+    const mqtt_route_t *route = mqtt_router_find(router, topic, topic_len);
+    if (route == NULL) {
+        return false;
+    }
+    route->handler(data, data_len, route->arg);
+    return true;
+}
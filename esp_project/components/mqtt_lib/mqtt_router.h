@@ -0,0 +1,49 @@
+#ifndef MQTT_ROUTER_H_
+#define MQTT_ROUTER_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Exact-match topic -> handler table, open addressing on the FNV-1a hash of
+// the topic. Topics are looked up as received (pointer + length, no
+// terminator, no copy); the table only keeps pointers to the registered
+// topic strings, which must outlive it.
+// Pure code (no esp-mqtt, no FreeRTOS) so it can be run on the host.
+
+#define MQTT_ROUTER_SLOTS 16    // power of 2, at most half full for short probes
+
+typedef void (*mqtt_route_cb_t)(const char *data, size_t len, void *arg);
+
+typedef struct {
+    uint32_t hash;
+    const char *topic;  // NULL: free slot
+    size_t topic_len;
+    mqtt_route_cb_t handler;
+    void *arg;
+} mqtt_route_t;
+
+typedef struct {
+    mqtt_route_t slots[MQTT_ROUTER_SLOTS];
+    size_t count;
+} mqtt_router_t;
+
+uint32_t mqtt_router_hash(const char *topic, size_t len);
+
+void mqtt_router_init(mqtt_router_t *router);
+
+/**
+ * Register (or replace) the handler of `topic` (NUL-terminated).
+ *
+ * @return false if the table is half full
+ */
+bool mqtt_router_add(mqtt_router_t *router, const char *topic, mqtt_route_cb_t handler, void *arg);
+
+/** @return route of `topic`, NULL if none */
+const mqtt_route_t *mqtt_router_find(const mqtt_router_t *router, const char *topic, size_t len);
+
+/** @return false if no route matched */
+bool mqtt_router_dispatch(const mqtt_router_t *router, const char *topic, size_t topic_len,
+    const char *data, size_t data_len);
+
+#endif
@@ -0,0 +1,421 @@
+#include "nvs_cache.h"
+#include "nvs_lib.h"
+#include "log_lib.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    NVS_CACHE_FREE = 0,
+    NVS_CACHE_INT,
+    NVS_CACHE_BLOB,
+    NVS_CACHE_RECORD,
+} nvs_cache_type_t;
+
+typedef struct {
+    char key[NVS_CACHE_KEY_LEN];
+    nvs_cache_type_t type;
+    bool dirty;
+    int32_t value;   // NVS_CACHE_INT
+    uint8_t *data;   // NVS_CACHE_BLOB / NVS_CACHE_RECORD, heap
+    size_t length;
+    uint8_t schema;  // NVS_CACHE_RECORD
+    uint8_t version;
+} nvs_cache_entry_t;
+
+static const char *TAG = "nvs_cache";
+
+static nvs_cache_entry_t entries[NVS_CACHE_MAX_ENTRIES];
+static nvs_cache_stats_t stats = {0};
+
+//entries and stats; never held during a flash access
+static SemaphoreHandle_t cache_mutex = NULL;
+//one flush at a time (commit task, OTA, shutdown)
+static SemaphoreHandle_t flush_mutex = NULL;
+static TaskHandle_t commit_task_handle = NULL;
+
+/**
+ * Find a key, or take a free slot for it
+ * @details call with cache_mutex taken
+ */
+static nvs_cache_entry_t *entry_get(const char *key, nvs_cache_type_t type, bool create) {
+    nvs_cache_entry_t *free_slot = NULL;
+    for (int i = 0; i < NVS_CACHE_MAX_ENTRIES; i++) {
+        nvs_cache_entry_t *e = &entries[i];
+        if (e->type == NVS_CACHE_FREE) {
+            if (free_slot == NULL) {
+                free_slot = e;
+            }
+        } else if (strncmp(e->key, key, NVS_CACHE_KEY_LEN) == 0) {
+            return (e->type == type) ? e : NULL;
+        }
+    }
+    if (!create || free_slot == NULL) {
+        return NULL;
+    }
+    memset(free_slot, 0, sizeof(*free_slot));
+    strncpy(free_slot->key, key, NVS_CACHE_KEY_LEN - 1);
+    free_slot->type = type;
+    return free_slot;
+}
+
+static void commit_notify() {
+    if (commit_task_handle != NULL) {
+        xTaskNotifyGive(commit_task_handle);
+    }
+}
+
+static void commit_task(void *pvParameters) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        //debounce: wait for writes to stop, bounded so a steady stream still commits
+        TickType_t first = xTaskGetTickCount();
+        while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NVS_CACHE_DEBOUNCE_MS)) > 0
+            && (xTaskGetTickCount() - first) < pdMS_TO_TICKS(NVS_CACHE_MAX_DELAY_MS)) {
+        }
+        nvs_cache_flush();
+    }
+}
+
+static void shutdown_flush() {
+    nvs_cache_flush();
+}
+
+esp_err_t nvs_cache_init() {
+
+    if (cache_mutex != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    cache_mutex = xSemaphoreCreateMutex();
+    flush_mutex = xSemaphoreCreateMutex();
+    if (cache_mutex == NULL || flush_mutex == NULL) {
+        log_msg(TAG, "Error in mutex creation");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreate(commit_task, "nvs_commit_task", 3072, NULL, 2, &commit_task_handle) != pdPASS) {
+        log_msg(TAG, "Error creating commit task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = esp_register_shutdown_handler(shutdown_flush);
+    if (err != ESP_OK) {
+        log_msg(TAG, "Error (%s) registering shutdown flush", esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t nvs_cache_get_int(const char *key, int *val) {
+
+    if (key == NULL || val == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cache_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    nvs_cache_entry_t *e = entry_get(key, NVS_CACHE_INT, false);
+    if (e != NULL) {
+        *val = e->value;
+        xSemaphoreGive(cache_mutex);
+        return ESP_OK;
+    }
+    xSemaphoreGive(cache_mutex);
+
+    //miss: read flash without holding the cache
+    esp_err_t err = load_nvs_int(key, val);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    e = entry_get(key, NVS_CACHE_INT, true);
+    if (e == NULL) {
+        log_msg(TAG, "Cache full, %s read from flash", key);
+    } else if (!e->dirty) {
+        e->value = *val;
+    } else {
+        *val = e->value; //set meanwhile
+    }
+    xSemaphoreGive(cache_mutex);
+    return ESP_OK;
+}
+
+esp_err_t nvs_cache_set_int(const char *key, int value) {
+
+    if (key == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cache_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    nvs_cache_entry_t *e = entry_get(key, NVS_CACHE_INT, false);
+    bool cached = (e != NULL);
+    if (!cached) {
+        e = entry_get(key, NVS_CACHE_INT, true);
+    }
+    if (e == NULL) {
+        xSemaphoreGive(cache_mutex);
+        log_msg(TAG, "Cache full, %s written through", key);
+        return save_nvs_int(key, value);
+    }
+    bool changed = !cached || e->value != value;
+    if (changed) {
+        e->value = value;
+        e->dirty = true;
+        stats.sets++;
+    } else {
+        stats.unchanged++;
+    }
+    xSemaphoreGive(cache_mutex);
+
+    if (changed) {
+        commit_notify();
+    }
+    return ESP_OK;
+}
+
+/**
+ * Read flash for a blob or record entry
+ */
+static esp_err_t load_data(const char *key, nvs_cache_type_t type, uint8_t schema, uint8_t version,
+    uint8_t *val, size_t length) {
+    if (type == NVS_CACHE_RECORD) {
+        return load_nvs_record(key, schema, version, val, length);
+    }
+    return load_nvs_blob(key, val, length);
+}
+
+/**
+ * Write a blob or record entry to flash
+ */
+static esp_err_t save_data(const char *key, nvs_cache_type_t type, uint8_t schema, uint8_t version,
+    const uint8_t *val, size_t length) {
+    if (type == NVS_CACHE_RECORD) {
+        return save_nvs_record(key, schema, version, val, length);
+    }
+    return save_nvs_blob(key, (uint8_t *)val, length);
+}
+
+static esp_err_t get_data(const char *key, nvs_cache_type_t type, uint8_t schema, uint8_t version,
+    uint8_t *val, size_t length) {
+
+    if (key == NULL || val == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cache_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    nvs_cache_entry_t *e = entry_get(key, type, false);
+    if (e != NULL) {
+        memcpy(val, e->data, e->length < length ? e->length : length);
+        xSemaphoreGive(cache_mutex);
+        return ESP_OK;
+    }
+    xSemaphoreGive(cache_mutex);
+
+    esp_err_t err = load_data(key, type, schema, version, val, length);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    uint8_t *copy = malloc(length);
+    if (copy == NULL) {
+        return ESP_OK; //value read, just not cached
+    }
+    memcpy(copy, val, length);
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    e = entry_get(key, type, false);
+    if (e != NULL) {
+        //set meanwhile
+        memcpy(val, e->data, e->length < length ? e->length : length);
+        free(copy);
+    } else if ((e = entry_get(key, type, true)) != NULL) {
+        e->data = copy;
+        e->length = length;
+        e->schema = schema;
+        e->version = version;
+    } else {
+        free(copy);
+        log_msg(TAG, "Cache full, %s read from flash", key);
+    }
+    xSemaphoreGive(cache_mutex);
+    return ESP_OK;
+}
+
+static esp_err_t set_data(const char *key, nvs_cache_type_t type, uint8_t schema, uint8_t version,
+    const uint8_t *val, size_t length) {
+
+    if (key == NULL || val == NULL || length == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cache_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    nvs_cache_entry_t *e = entry_get(key, type, false);
+    //same bytes under another schema or version is still a new record to write
+    if (e != NULL && e->length == length && e->schema == schema && e->version == version
+        && memcmp(e->data, val, length) == 0) {
+        stats.unchanged++;
+        xSemaphoreGive(cache_mutex);
+        return ESP_OK;
+    }
+
+    if (e == NULL || e->length != length) {
+        uint8_t *data = malloc(length);
+        if (data == NULL) {
+            xSemaphoreGive(cache_mutex);
+            return ESP_ERR_NO_MEM;
+        }
+        if (e == NULL) {
+            e = entry_get(key, type, true);
+        }
+        if (e == NULL) {
+            xSemaphoreGive(cache_mutex);
+            free(data);
+            log_msg(TAG, "Cache full, %s written through", key);
+            return save_data(key, type, schema, version, val, length);
+        }
+        free(e->data);
+        e->data = data;
+        e->length = length;
+    }
+    memcpy(e->data, val, length);
+    e->schema = schema;
+    e->version = version;
+    e->dirty = true;
+    stats.sets++;
+    xSemaphoreGive(cache_mutex);
+
+    commit_notify();
+    return ESP_OK;
+}
+
+esp_err_t nvs_cache_get_blob(const char *key, uint8_t *val, size_t length) {
+    return get_data(key, NVS_CACHE_BLOB, 0, 0, val, length);
+}
+
+esp_err_t nvs_cache_set_blob(const char *key, const uint8_t *val, size_t length) {
+    return set_data(key, NVS_CACHE_BLOB, 0, 0, val, length);
+}
+
+esp_err_t nvs_cache_get_record(const char *key, uint8_t schema, uint8_t version, void *val, size_t length) {
+    return get_data(key, NVS_CACHE_RECORD, schema, version, val, length);
+}
+
+esp_err_t nvs_cache_set_record(const char *key, uint8_t schema, uint8_t version, const void *val, size_t length) {
+    return set_data(key, NVS_CACHE_RECORD, schema, version, val, length);
+}
+
+esp_err_t nvs_cache_flush() {
+
+    if (cache_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(flush_mutex, portMAX_DELAY);
+    int64_t start = esp_timer_get_time();
+    uint32_t written = 0;
+    bool retry = false;
+    esp_err_t result = ESP_OK;
+
+    nvs_batch_begin();
+    for (int i = 0; i < NVS_CACHE_MAX_ENTRIES; i++) {
+        nvs_cache_entry_t *e = &entries[i];
+
+        //snapshot the value, so setters are not blocked by the flash write
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        if (e->type == NVS_CACHE_FREE || !e->dirty) {
+            xSemaphoreGive(cache_mutex);
+            continue;
+        }
+        char key[NVS_CACHE_KEY_LEN];
+        memcpy(key, e->key, sizeof(key));
+        nvs_cache_type_t type = e->type;
+        int32_t value = e->value;
+        size_t length = e->length;
+        uint8_t schema = e->schema;
+        uint8_t version = e->version;
+        uint8_t *data = NULL;
+        if (type != NVS_CACHE_INT) {
+            data = malloc(length);
+            if (data == NULL) {
+                xSemaphoreGive(cache_mutex);
+                result = ESP_ERR_NO_MEM;
+                retry = true;
+                continue;
+            }
+            memcpy(data, e->data, length);
+        }
+        e->dirty = false;
+        xSemaphoreGive(cache_mutex);
+
+        esp_err_t err = (type == NVS_CACHE_INT) ? save_nvs_int(key, value)
+            : save_data(key, type, schema, version, data, length);
+        free(data);
+
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        if (err != ESP_OK) {
+            e->dirty = true; //slot never freed: still this key
+            stats.write_errors++;
+            result = err;
+            retry = true;
+        } else {
+            stats.flash_writes++;
+            stats.flash_bytes += (type == NVS_CACHE_INT) ? sizeof(int32_t) : length;
+            written++;
+        }
+        xSemaphoreGive(cache_mutex);
+    }
+    esp_err_t err = nvs_batch_end();
+    if (result == ESP_OK) {
+        result = err;
+    }
+    //keys left dirty: without a new set nothing would wake the commit task,
+    //so it is woken for another try one debounce period later
+    if (retry) {
+        commit_notify();
+    }
+
+    if (written > 0) {
+        uint32_t latency = (uint32_t)(esp_timer_get_time() - start);
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        stats.commits++;
+        stats.last_commit_us = latency;
+        if (latency > stats.max_commit_us) {
+            stats.max_commit_us = latency;
+        }
+        xSemaphoreGive(cache_mutex);
+        log_msg_lvl(ESP_LOG_DEBUG, TAG, "Committed %" PRIu32 " values in %" PRIu32 " us", written, latency);
+    }
+    xSemaphoreGive(flush_mutex);
+    return result;
+}
+
+esp_err_t nvs_cache_get_stats(nvs_cache_stats_t *out) {
+
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cache_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(cache_mutex);
+    return ESP_OK;
+}
@@ -0,0 +1,99 @@
+#ifndef NVS_CACHE_H_
+#define NVS_CACHE_H_
+
+#include <esp_err.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+// Write-back cache over NVS, for values changed at runtime (LED state,
+// drive profile..): reads are RAM lookups once a key was read or written,
+// writes only update RAM and mark the key dirty. A commit task writes the
+// dirty keys to flash once writes have been quiet for NVS_CACHE_DEBOUNCE_MS
+// (NVS_CACHE_MAX_DELAY_MS at most), so a burst of changes costs one flash
+// write per key. Flushed before OTA and on esp_restart.
+
+#define NVS_CACHE_MAX_ENTRIES 16
+#define NVS_CACHE_KEY_LEN 16        // NVS key limit, end character included
+#define NVS_CACHE_DEBOUNCE_MS 2000
+#define NVS_CACHE_MAX_DELAY_MS 10000
+
+typedef struct {
+    uint32_t sets;           // writes that changed a value
+    uint32_t unchanged;      // writes of the value already cached (nothing to do)
+    uint32_t flash_writes;   // values written to NVS (wear)
+    uint32_t flash_bytes;
+    uint32_t commits;        // flushes that wrote something
+    uint32_t write_errors;   // failed writes, key kept dirty and retried NVS_CACHE_DEBOUNCE_MS later
+    uint32_t last_commit_us; // commit latency
+    uint32_t max_commit_us;
+} nvs_cache_stats_t;
+
+/**
+ * Start the commit task and register the shutdown flush
+ * @details called by nvs_init
+ */
+esp_err_t nvs_cache_init();
+
+/**
+ * Get an int, from RAM once cached (first read loads it, see load_nvs_int)
+ * @param key key string nvs
+ * @param val int pointer to update value
+ */
+esp_err_t nvs_cache_get_int(const char *key, int *val);
+
+/**
+ * Set an int in RAM, written to NVS by the commit task
+ * @param key key string nvs
+ * @param value int value to put
+ */
+esp_err_t nvs_cache_set_int(const char *key, int value);
+
+/**
+ * Get a blob, from RAM once cached (first read loads it, see load_nvs_blob)
+ * @param key key string nvs
+ * @param val blob pointer to update, its content is the default if missing
+ * @param length length of val
+ */
+esp_err_t nvs_cache_get_blob(const char *key, uint8_t *val, size_t length);
+
+/**
+ * Set a blob in RAM (copied), written to NVS by the commit task
+ * @param key key string nvs
+ * @param val blob pointer to put
+ * @param length length of blob to put
+ */
+esp_err_t nvs_cache_set_blob(const char *key, const uint8_t *val, size_t length);
+
+/**
+ * Get a record (see load_nvs_record), from RAM once cached
+ * @details val untouched if missing or rejected (older layout, corrupted):
+ * the caller keeps its defaults, written as a record by the next set
+ * @param key key string nvs
+ * @param schema nvs_record_schema_t expected
+ * @param version layout version expected
+ * @param val struct to update
+ * @param length size of val
+ */
+esp_err_t nvs_cache_get_record(const char *key, uint8_t schema, uint8_t version, void *val, size_t length);
+
+/**
+ * Set a record in RAM (copied), written to NVS by the commit task
+ * @param key key string nvs
+ * @param schema nvs_record_schema_t of val
+ * @param version layout version of val
+ * @param val struct to put
+ * @param length size of val
+ */
+esp_err_t nvs_cache_set_record(const char *key, uint8_t schema, uint8_t version, const void *val, size_t length);
+
+/**
+ * Write every dirty key now, in one batch (before OTA, reboot..)
+ */
+esp_err_t nvs_cache_flush();
+
+/**
+ * Get cache metrics
+ */
+esp_err_t nvs_cache_get_stats(nvs_cache_stats_t *stats);
+
+#endif
@@ -1,4 +1,5 @@
 #include "nvs_lib.h"
+#include "nvs_record.h"
 #include "log_lib.h"
 #include <nvs_flash.h>
 #include <nvs.h>
@@ -23,6 +24,10 @@ static const char* partition_name = "nvs"; //name from custom partition
 //handle to access nvs
 static nvs_handle_t my_handle;
 
+//write batching (nvs_batch_begin/end), protected by xMutex
+static uint8_t batch_depth = 0;
+static bool batch_dirty = false;
+
 #if NVS_DEBUG
 //struct to convert types into string to print them
 typedef struct {
@@ -65,6 +70,18 @@ static const char *type_to_str(nvs_type_t type) {
 }
 #endif
 
+/**
+ * Commit, or defer it to the end of the current batch
+ * @details call with xMutex taken
+ */
+static esp_err_t commit_locked() {
+    if (batch_depth > 0) {
+        batch_dirty = true;
+        return ESP_OK;
+    }
+    return nvs_commit(my_handle);
+}
+
 /**
  * Initalize NVS
  * -Create Mutex (do it once)
@@ -118,8 +135,11 @@ esp_err_t nvs_init() {
     err = nvs_open(namespace, NVS_READWRITE, &my_handle);
     if (err != ESP_OK) {
         log_msg(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+        return err;
     }
-    return err;
+
+    //write-back cache for runtime values
+    return nvs_cache_init();
 }
 
 /**
@@ -278,7 +298,7 @@ esp_err_t save_nvs_blob(const char *key, uint8_t* value, size_t length) {
 #if NVS_DEBUG
         log_msg(TAG, "Committing updates in NVS...");
 #endif
-        err = nvs_commit(my_handle);
+        err = commit_locked();
         if (err != ESP_OK) {
             log_msg(TAG, "Failed to commit NVS changes!");
         }
@@ -391,7 +411,7 @@ esp_err_t save_nvs_str(const char *key, const char* value) {
 #if NVS_DEBUG
         log_msg(TAG, "Committing updates in NVS...");
 #endif
-        err = nvs_commit(my_handle);
+        err = commit_locked();
         if (err != ESP_OK) {
             log_msg(TAG, "Failed to commit NVS changes!");
         }
@@ -433,7 +453,7 @@ esp_err_t save_nvs_int(const char *key, const int value) {
 #if NVS_DEBUG
         log_msg(TAG, "Committing updates in NVS...");
 #endif
-        err = nvs_commit(my_handle);
+        err = commit_locked();
         if (err != ESP_OK) {
             log_msg(TAG, "Failed to commit NVS changes!");
         }
@@ -443,6 +463,229 @@ esp_err_t save_nvs_int(const char *key, const int value) {
     return ESP_ERR_INVALID_STATE;
 }
 
+/**
+ * Function to load a string in nvs, bounded
+ * -Take mutex, read nvs straight into val (fails instead of overflowing), init if needed
+ * @param key str key
+ * @param val string updated
+ * @param size size of val, end character included
+ */
+esp_err_t load_nvs_strn(const char *key, char *val, size_t size) {
+
+    int need_init = 0;
+
+    if (val == NULL || size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    //if mutex destroyed or not initialized
+    if (xMutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = ESP_ERR_TIMEOUT;
+
+    //wait to take mutex
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE) {
+
+#if NVS_DEBUG
+        log_msg(TAG, "Reading %s from NVS...", key);
+#endif
+        size_t required_size = size;
+        err = nvs_get_str(my_handle, key, val, &required_size);
+
+        switch (err) {
+            case ESP_OK:
+                break;
+            // not found : initialize value to "" (default)
+            case ESP_ERR_NVS_NOT_FOUND:
+                need_init = 1;
+                log_msg(TAG, "The value is not initialized yet!");
+                break;
+            // stored string longer than val
+            case ESP_ERR_NVS_INVALID_LENGTH:
+                log_msg(TAG, "%s does not fit in %u bytes!", key, (unsigned)size);
+                val[0] = '\0';
+                break;
+            //other : error
+            default:
+                log_msg(TAG, "Error (%s) reading!", esp_err_to_name(err));
+        }
+        //free mutex
+        xSemaphoreGive(xMutex);
+    }
+
+    //if init is needed (here because avoids deadlock mutex)
+    if (need_init) {
+        val[0] = '\0';
+        return save_nvs_str(key, val); // Init key to "" (default)
+    }
+
+    return err;
+}
+
+/**
+ * Function to load a record (see nvs_record.h) in nvs
+ * -Take mutex, read the whole blob once, check it, copy the payload
+ * -No init if missing: the caller keeps its defaults
+ * @param key str key
+ * @param schema nvs_record_schema_t expected
+ * @param version layout version of val expected
+ * @param val struct updated, untouched on error
+ * @param length size of val
+ */
+esp_err_t load_nvs_record(const char *key, uint8_t schema, uint8_t version, void *val, size_t length) {
+
+    if (val == NULL || length > NVS_RECORD_MAX_PAYLOAD) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xMutex == NULL) {
+        log_msg(TAG, "Mutex not initalized!");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    size_t size = NVS_RECORD_HEADER_SIZE + length;
+    uint8_t *buf = malloc(size);
+    if (!buf) {
+        log_msg(TAG, "Memory allocation failed for record %s", key);
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE) {
+        //size in = buffer size, fails with INVALID_LENGTH if the blob is bigger
+        err = nvs_get_blob(my_handle, key, buf, &size);
+        xSemaphoreGive(xMutex);
+    }
+
+    if (err == ESP_OK) {
+        nvs_record_status_t status = nvs_record_decode(buf, size, schema, version, val, length);
+        switch (status) {
+            case NVS_RECORD_OK:
+                break;
+            case NVS_RECORD_ERR_VERSION:
+                err = ESP_ERR_INVALID_VERSION;
+                break;
+            case NVS_RECORD_ERR_CRC:
+                err = ESP_ERR_INVALID_CRC;
+                break;
+            default:
+                err = ESP_ERR_INVALID_SIZE;
+        }
+        if (err != ESP_OK) {
+            log_msg(TAG, "Record %s rejected (%s)", key, esp_err_to_name(err));
+        }
+    } else if (err == ESP_ERR_NVS_INVALID_LENGTH) {
+        log_msg(TAG, "Record %s bigger than expected", key);
+        err = ESP_ERR_INVALID_SIZE;
+    } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+        log_msg(TAG, "Error (%s) reading!", esp_err_to_name(err));
+    }
+
+    free(buf);
+    return err;
+}
+
+/**
+ * Function to save a record (see nvs_record.h) in nvs
+ * -Encode, take mutex, set blob and commit (or defer to end of batch)
+ * @param key str key
+ * @param schema nvs_record_schema_t of val
+ * @param version layout version of val
+ * @param val struct to save
+ * @param length size of val
+ */
+esp_err_t save_nvs_record(const char *key, uint8_t schema, uint8_t version, const void *val, size_t length) {
+
+    if (val == NULL || length > NVS_RECORD_MAX_PAYLOAD) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xMutex == NULL) {
+        log_msg(TAG, "Mutex not initalized!");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    size_t size = NVS_RECORD_HEADER_SIZE + length;
+    uint8_t *buf = malloc(size);
+    if (!buf) {
+        log_msg(TAG, "Memory allocation failed for record %s", key);
+        return ESP_ERR_NO_MEM;
+    }
+    size = nvs_record_encode(schema, version, val, length, buf, size);
+
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE) {
+#if NVS_DEBUG
+        log_msg(TAG, "Writing record %s (%u bytes) to NVS...", key, (unsigned)size);
+#endif
+        err = nvs_set_blob(my_handle, key, buf, size);
+        if (err != ESP_OK) {
+            log_msg(TAG, "Failed to write record %s!", key);
+        } else {
+            err = commit_locked();
+            if (err != ESP_OK) {
+                log_msg(TAG, "Failed to commit NVS changes!");
+            }
+        }
+        xSemaphoreGive(xMutex);
+    }
+
+    free(buf);
+    return err;
+}
+
+/**
+ * Function to start a write batch
+ * -Saves until nvs_batch_end only set values, one commit at the end
+ * -Nestable
+ * -nvs_set_* already writes flash: this saves commits, not writes
+ */
+esp_err_t nvs_batch_begin() {
+
+    if (xMutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    esp_err_t err = ESP_OK;
+    if (batch_depth == UINT8_MAX) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        batch_depth++;
+    }
+    xSemaphoreGive(xMutex);
+    return err;
+}
+
+/**
+ * Function to end a write batch
+ * -Commit once every value saved since the outermost nvs_batch_begin
+ */
+esp_err_t nvs_batch_end() {
+
+    if (xMutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xSemaphoreTake(xMutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    esp_err_t err = ESP_OK;
+    if (batch_depth == 0) {
+        err = ESP_ERR_INVALID_STATE;
+    } else if (--batch_depth == 0 && batch_dirty) {
+        batch_dirty = false;
+#if NVS_DEBUG
+        log_msg(TAG, "Committing batch in NVS...");
+#endif
+        err = nvs_commit(my_handle);
+        if (err != ESP_OK) {
+            log_msg(TAG, "Failed to commit NVS changes!");
+        }
+    }
+    xSemaphoreGive(xMutex);
+    return err;
+}
+
 /**
  * Function to close nvs
  * -Close nvs handle, delete mutex
@@ -3,6 +3,9 @@
 
 #include <esp_err.h>
 #include <inttypes.h>
+#include <stddef.h>
+#include "nvs_record.h"
+#include "nvs_cache.h"
 
 /**
  * Initialize nvs
@@ -32,6 +35,15 @@ esp_err_t save_nvs_int(const char *key, const int value);
  */
 esp_err_t load_nvs_str(const char *key, char *val);
 
+/**
+ * Load string in NVS, bounded
+ * @details fails (val = "") instead of overflowing if the stored string is longer
+ * @param key key string nvs
+ * @param val string to update value
+ * @param size size of val, end character included
+ */
+esp_err_t load_nvs_strn(const char *key, char *val, size_t size);
+
 /**
  * Save a str in NVS
  * @param key key string nvs
@@ -56,6 +68,41 @@ esp_err_t load_nvs_blob(const char *key, uint8_t *val, size_t length);
  */
 esp_err_t save_nvs_blob(const char *key, uint8_t * value, size_t length);
 
+/**
+ * Load a record (versioned, CRC-checked blob, see nvs_record.h) in one read
+ * @details not initialized if missing (ESP_ERR_NVS_NOT_FOUND), val untouched on error
+ * @param key key string nvs
+ * @param schema nvs_record_schema_t expected
+ * @param version layout version expected
+ * @param val struct to update
+ * @param length size of val, must match the stored one (ESP_ERR_INVALID_SIZE)
+ */
+esp_err_t load_nvs_record(const char *key, uint8_t schema, uint8_t version, void *val, size_t length);
+
+/**
+ * Save a record (versioned, CRC-checked blob, see nvs_record.h)
+ * @param key key string nvs
+ * @param schema nvs_record_schema_t of val
+ * @param version layout version of val
+ * @param val struct to put
+ * @param length size of val
+ */
+esp_err_t save_nvs_record(const char *key, uint8_t schema, uint8_t version, const void *val, size_t length);
+
+/**
+ * Start a write batch: save_nvs_* calls until nvs_batch_end only set values,
+ * and nvs_commit is called once at the end
+ * @details nestable, applies to saves from every task meanwhile. Each set
+ * still writes its own NVS entry: values that must change in one flash write
+ * belong in one record (save_nvs_record)
+ */
+esp_err_t nvs_batch_begin();
+
+/**
+ * End a write batch, committing it if it was the outermost one
+ */
+esp_err_t nvs_batch_end();
+
 /**
  * Print a nvs namespace's list
  * @details require debug
@@ -0,0 +1,77 @@
+#include "nvs_record.h"
+#include <string.h>
+
+//nibble table: 64 bytes instead of 1 KiB, records are small and rarely read
+static const uint32_t crc32_nibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t nvs_record_crc32(uint32_t crc, const uint8_t *data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static uint32_t record_crc(const uint8_t *header, const uint8_t *payload, size_t len) {
+    uint32_t crc = nvs_record_crc32(0, header, 6);
+    return nvs_record_crc32(crc, payload, len);
+}
+
+size_t nvs_record_encode(uint8_t schema, uint8_t version, const void *payload, size_t len,
+    uint8_t *out, size_t capacity) {
+    if (len > NVS_RECORD_MAX_PAYLOAD || capacity < NVS_RECORD_HEADER_SIZE + len) {
+        return 0;
+    }
+
+    uint16_t magic = NVS_RECORD_MAGIC;
+    uint16_t len16 = (uint16_t)len;
+    memcpy(&out[0], &magic, sizeof(magic));
+    out[2] = schema;
+    out[3] = version;
+    memcpy(&out[4], &len16, sizeof(len16));
+    memcpy(&out[NVS_RECORD_HEADER_SIZE], payload, len);
+
+    uint32_t crc = record_crc(out, &out[NVS_RECORD_HEADER_SIZE], len);
+    memcpy(&out[6], &crc, sizeof(crc));
+    return NVS_RECORD_HEADER_SIZE + len;
+}
+
+nvs_record_status_t nvs_record_decode(const uint8_t *buf, size_t buf_len, uint8_t schema,
+    uint8_t version, void *payload, size_t len) {
+    if (buf_len < NVS_RECORD_HEADER_SIZE) {
+        return NVS_RECORD_ERR_SIZE;
+    }
+
+    uint16_t magic;
+    uint16_t stored_len;
+    uint32_t stored_crc;
+    memcpy(&magic, &buf[0], sizeof(magic));
+    memcpy(&stored_len, &buf[4], sizeof(stored_len));
+    memcpy(&stored_crc, &buf[6], sizeof(stored_crc));
+
+    if (magic != NVS_RECORD_MAGIC) {
+        return NVS_RECORD_ERR_MAGIC;
+    }
+    if (buf[2] != schema) {
+        return NVS_RECORD_ERR_SCHEMA;
+    }
+    if (buf[3] != version) {
+        return NVS_RECORD_ERR_VERSION;
+    }
+    if (stored_len != len || buf_len < NVS_RECORD_HEADER_SIZE + len) {
+        return NVS_RECORD_ERR_SIZE;
+    }
+    if (record_crc(buf, &buf[NVS_RECORD_HEADER_SIZE], len) != stored_crc) {
+        return NVS_RECORD_ERR_CRC;
+    }
+
+    memcpy(payload, &buf[NVS_RECORD_HEADER_SIZE], len);
+    return NVS_RECORD_OK;
+}
@@ -0,0 +1,64 @@
+#ifndef NVS_RECORD_H_
+#define NVS_RECORD_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Binary record format for structured configs stored as one NVS blob, so a
+// whole config (e.g. every known Wi-Fi network) is read in a single
+// nvs_get_blob instead of one call per field.
+// Pure code (no NVS, no FreeRTOS) so it can be run on the host.
+//
+// Layout, little-endian:
+// [0..1] = magic, [2] = schema, [3] = schema version, [4..5] = payload
+// length, [6..9] = CRC-32 of bytes [0..5] then of the payload,
+// then the payload (the config struct, as is).
+#define NVS_RECORD_MAGIC 0x4352 // "RC"
+#define NVS_RECORD_HEADER_SIZE 10
+#define NVS_RECORD_MAX_PAYLOAD 0xFFFF
+
+// What a record holds. Values are stored in flash: never renumber or reuse.
+typedef enum {
+    NVS_RECORD_NONE          = 0,
+    NVS_RECORD_WIFI_NETWORKS = 1,
+    NVS_RECORD_OTA_RESUME    = 2,
+    NVS_RECORD_CAMERA_CONFIG = 3,
+    NVS_RECORD_CALIBRATION   = 4,
+    NVS_RECORD_DRIVE_PROFILE = 5,
+    NVS_RECORD_WIFI_FAST_AP  = 6,
+} nvs_record_schema_t;
+
+typedef enum {
+    NVS_RECORD_OK = 0,
+    NVS_RECORD_ERR_SIZE,    // buffer too small, or stored length != expected length
+    NVS_RECORD_ERR_MAGIC,   // not a record
+    NVS_RECORD_ERR_SCHEMA,  // record of another config
+    NVS_RECORD_ERR_VERSION, // older/newer layout of this config
+    NVS_RECORD_ERR_CRC,     // corrupted
+} nvs_record_status_t;
+
+/**
+ * CRC-32 (IEEE 802.3, reflected), chainable: start with crc = 0.
+ */
+uint32_t nvs_record_crc32(uint32_t crc, const uint8_t *data, size_t len);
+
+/**
+ * Encode a record.
+ *
+ * @param out  receives NVS_RECORD_HEADER_SIZE + len bytes
+ * @return bytes written, 0 if `out` is too small or the payload too long
+ */
+size_t nvs_record_encode(uint8_t schema, uint8_t version, const void *payload, size_t len,
+    uint8_t *out, size_t capacity);
+
+/**
+ * Check a record and copy its payload out. Nothing is written to `payload`
+ * unless the record is valid.
+ *
+ * @param len  exact payload length expected for this schema version
+ */
+nvs_record_status_t nvs_record_decode(const uint8_t *buf, size_t buf_len, uint8_t schema,
+    uint8_t version, void *payload, size_t len);
+
+#endif // NVS_RECORD_H_
@@ -0,0 +1,189 @@
+#include "delta_patch.h"
+#include <string.h>
+
+enum {
+    STATE_HEADER = 0,
+    STATE_OP,
+    STATE_ARG,
+    STATE_TOKEN,
+    STATE_LITERAL,
+    STATE_ZERO_RUN,
+    STATE_DONE,
+};
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static delta_patch_status_t flush_out(delta_patch_t *patch) {
+    if (patch->out_len > 0 && patch->write_new(patch->arg_cb, patch->out_buf, patch->out_len) != 0) {
+        return DELTA_PATCH_ERR_IO;
+    }
+    patch->out_len = 0;
+    return DELTA_PATCH_OK;
+}
+
+/**
+ * Emit `count` new bytes from data byte `d` (same value for a zero run)
+ */
+static delta_patch_status_t emit(delta_patch_t *patch, uint8_t d, uint32_t count) {
+    if (count > patch->op_left || count > patch->new_size - patch->new_pos) {
+        return DELTA_PATCH_ERR_RANGE;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t b = d;
+        if (patch->op == DELTA_OP_ADD) {
+            if (patch->old_pos >= patch->old_size) {
+                return DELTA_PATCH_ERR_RANGE;
+            }
+            if (patch->old_pos < patch->old_buf_start
+                || patch->old_pos >= patch->old_buf_start + patch->old_buf_len) {
+                uint32_t n = patch->old_size - patch->old_pos;
+                n = (n < DELTA_PATCH_BUF_SIZE) ? n : DELTA_PATCH_BUF_SIZE;
+                if (patch->read_old(patch->arg_cb, patch->old_pos, patch->old_buf, n) != 0) {
+                    return DELTA_PATCH_ERR_IO;
+                }
+                patch->old_buf_start = patch->old_pos;
+                patch->old_buf_len = n;
+            }
+            b = (uint8_t)(patch->old_buf[patch->old_pos - patch->old_buf_start] + d);
+            patch->old_pos++;
+        }
+
+        patch->out_buf[patch->out_len++] = b;
+        if (patch->out_len == DELTA_PATCH_BUF_SIZE) {
+            delta_patch_status_t status = flush_out(patch);
+            if (status != DELTA_PATCH_OK) {
+                return status;
+            }
+        }
+    }
+
+    patch->new_pos += count;
+    patch->op_left -= count;
+    return DELTA_PATCH_OK;
+}
+
+static delta_patch_status_t parse_header(delta_patch_t *patch) {
+    const uint8_t *h = patch->header;
+    if (memcmp(h, DELTA_PATCH_MAGIC, 4) != 0 || h[4] != DELTA_PATCH_VERSION) {
+        return DELTA_PATCH_ERR_MAGIC;
+    }
+    patch->old_size = get_u32(&h[5]);
+    memcpy(patch->old_sha, &h[9], DELTA_PATCH_SHA_LEN);
+    patch->new_size = get_u32(&h[41]);
+    memcpy(patch->new_sha, &h[45], DELTA_PATCH_SHA_LEN);
+    patch->header_done = true;
+    return DELTA_PATCH_OK;
+}
+
+static delta_patch_status_t run_arg(delta_patch_t *patch) {
+    uint32_t v = get_u32(patch->arg);
+    if (patch->op == DELTA_OP_SEEK) {
+        int64_t pos = (int64_t)patch->old_pos + (int32_t)v;
+        if (pos < 0 || pos > patch->old_size) {
+            return DELTA_PATCH_ERR_RANGE;
+        }
+        patch->old_pos = (uint32_t)pos;
+        patch->state = STATE_OP;
+    } else {
+        patch->op_left = v;
+        patch->state = (v == 0) ? STATE_OP : STATE_TOKEN;
+    }
+    return DELTA_PATCH_OK;
+}
+
+void delta_patch_init(delta_patch_t *patch, delta_patch_read_fn read_old,
+    delta_patch_write_fn write_new, void *arg) {
+    memset(patch, 0, sizeof(*patch));
+    patch->read_old = read_old;
+    patch->write_new = write_new;
+    patch->arg_cb = arg;
+}
+
+delta_patch_status_t delta_patch_feed(delta_patch_t *patch, const uint8_t *data, size_t len) {
+
+    size_t i = 0;
+    while (patch->status == DELTA_PATCH_OK && i < len) {
+        switch (patch->state) {
+        case STATE_HEADER: {
+            size_t n = DELTA_PATCH_HEADER_SIZE - patch->fill;
+            n = (n < len - i) ? n : len - i;
+            memcpy(&patch->header[patch->fill], &data[i], n);
+            patch->fill += n;
+            i += n;
+            if (patch->fill == DELTA_PATCH_HEADER_SIZE) {
+                patch->status = parse_header(patch);
+                patch->state = STATE_OP;
+            }
+            break;
+        }
+        case STATE_OP:
+            patch->op = data[i++];
+            patch->fill = 0;
+            if (patch->op == DELTA_OP_END) {
+                patch->state = STATE_DONE;
+            } else if (patch->op <= DELTA_OP_INSERT) {
+                patch->state = STATE_ARG;
+            } else {
+                patch->status = DELTA_PATCH_ERR_FORMAT;
+            }
+            break;
+        case STATE_ARG:
+            patch->arg[patch->fill++] = data[i++];
+            if (patch->fill == sizeof(patch->arg)) {
+                patch->status = run_arg(patch);
+            }
+            break;
+        case STATE_TOKEN: {
+            uint8_t token = data[i++];
+            if (token == 0xFF) {
+                patch->fill = 0;
+                patch->state = STATE_ZERO_RUN;
+            } else if (token & 0x80) {
+                patch->status = emit(patch, 0, (uint32_t)(token & 0x7F) + 1);
+                if (patch->op_left == 0) {
+                    patch->state = STATE_OP;
+                }
+            } else {
+                patch->literal_left = token + 1;
+                patch->state = STATE_LITERAL;
+            }
+            break;
+        }
+        case STATE_ZERO_RUN:
+            patch->arg[patch->fill++] = data[i++];
+            if (patch->fill == 2) {
+                patch->status = emit(patch, 0, (uint32_t)patch->arg[0] | ((uint32_t)patch->arg[1] << 8));
+                patch->state = (patch->op_left == 0) ? STATE_OP : STATE_TOKEN;
+            }
+            break;
+        case STATE_LITERAL:
+            patch->status = emit(patch, data[i++], 1);
+            if (--patch->literal_left == 0) {
+                patch->state = (patch->op_left == 0) ? STATE_OP : STATE_TOKEN;
+            } else if (patch->op_left == 0) {
+                patch->status = DELTA_PATCH_ERR_FORMAT;
+            }
+            break;
+        default:
+            //bytes after DELTA_OP_END
+            patch->status = DELTA_PATCH_ERR_FORMAT;
+            break;
+        }
+    }
+    return patch->status;
+}
+
+delta_patch_status_t delta_patch_finish(delta_patch_t *patch) {
+    if (patch->status != DELTA_PATCH_OK) {
+        return patch->status;
+    }
+    if (patch->state != STATE_DONE || patch->new_pos != patch->new_size) {
+        patch->status = DELTA_PATCH_ERR_INCOMPLETE;
+        return patch->status;
+    }
+    patch->status = flush_out(patch);
+    return patch->status;
+}
@@ -0,0 +1,100 @@
+#ifndef DELTA_PATCH_H_
+#define DELTA_PATCH_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Streaming applier of delta OTA patches (made by the station, delta.rs):
+// the new image is rebuilt from the running one and a patch holding only
+// what changed. Patch bytes can be fed in chunks of any size; RAM use is
+// the delta_patch_t itself, whatever the image size.
+// Pure code (no flash, no FreeRTOS) so it can be run on the host.
+//
+// Patch layout, little-endian:
+// [0..3] = magic "RCDP", [4] = format version, [5..8] = old image size,
+// [9..40] = SHA-256 of the old image, [41..44] = new image size,
+// [45..76] = SHA-256 of the new image, then commands:
+// - DELTA_OP_SEEK, int32_t: move the old image position
+// - DELTA_OP_ADD, uint32_t n, data: n new bytes = old bytes + data bytes
+//   (mod 256), old position advances by n (bsdiff style: moved code with
+//   shifted addresses gives mostly zero data)
+// - DELTA_OP_INSERT, uint32_t n, data: n new bytes = data bytes
+// - DELTA_OP_END
+// The data of ADD/INSERT is run-length coded, token by token:
+// 0x80 | (k - 1) = k zero bytes (k < 128), 0xFF + uint16_t k = k zero
+// bytes, k - 1 = k literal bytes following.
+#define DELTA_PATCH_MAGIC "RCDP"
+#define DELTA_PATCH_VERSION 1
+#define DELTA_PATCH_HEADER_SIZE 77
+#define DELTA_PATCH_SHA_LEN 32
+#define DELTA_PATCH_BUF_SIZE 512 // old image read / new image write chunk
+
+typedef enum {
+    DELTA_OP_END    = 0,
+    DELTA_OP_SEEK   = 1,
+    DELTA_OP_ADD    = 2,
+    DELTA_OP_INSERT = 3,
+} delta_op_t;
+
+typedef enum {
+    DELTA_PATCH_OK = 0,
+    DELTA_PATCH_ERR_MAGIC,      // not a patch, or another format version
+    DELTA_PATCH_ERR_FORMAT,     // bad command or run
+    DELTA_PATCH_ERR_RANGE,      // reads outside the old image / writes past the new size
+    DELTA_PATCH_ERR_IO,         // read or write callback failed
+    DELTA_PATCH_ERR_INCOMPLETE, // patch ended before DELTA_OP_END / the new size
+} delta_patch_status_t;
+
+// Callbacks return 0 on success.
+typedef int (*delta_patch_read_fn)(void *arg, uint32_t offset, uint8_t *buf, size_t len);
+typedef int (*delta_patch_write_fn)(void *arg, const uint8_t *buf, size_t len);
+
+typedef struct {
+    //header, valid once header_done
+    bool header_done;
+    uint32_t old_size;
+    uint32_t new_size;
+    uint8_t old_sha[DELTA_PATCH_SHA_LEN];
+    uint8_t new_sha[DELTA_PATCH_SHA_LEN];
+
+    //parser
+    uint8_t state;
+    uint8_t op;
+    uint8_t header[DELTA_PATCH_HEADER_SIZE];
+    uint8_t arg[4];
+    uint8_t fill;           // bytes of header / arg / long run received
+    uint32_t op_left;       // data bytes left in the current command
+    uint8_t literal_left;   // literal bytes left in the current token
+    delta_patch_status_t status;
+
+    //images
+    uint32_t old_pos;
+    uint32_t new_pos;
+    uint32_t old_buf_start;
+    uint32_t old_buf_len;
+    uint8_t old_buf[DELTA_PATCH_BUF_SIZE];
+    uint32_t out_len;
+    uint8_t out_buf[DELTA_PATCH_BUF_SIZE];
+
+    delta_patch_read_fn read_old;
+    delta_patch_write_fn write_new;
+    void *arg_cb;
+} delta_patch_t;
+
+void delta_patch_init(delta_patch_t *patch, delta_patch_read_fn read_old,
+    delta_patch_write_fn write_new, void *arg);
+
+/**
+ * Feed the next patch bytes. New image bytes go out through write_new.
+ * Once an error is returned, every later call returns it too.
+ */
+delta_patch_status_t delta_patch_feed(delta_patch_t *patch, const uint8_t *data, size_t len);
+
+/**
+ * End of the patch: writes the last buffered bytes, checks the new image
+ * is complete (its hash is the caller's job, see new_sha).
+ */
+delta_patch_status_t delta_patch_finish(delta_patch_t *patch);
+
+#endif // DELTA_PATCH_H_
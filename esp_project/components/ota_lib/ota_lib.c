@@ -1,70 +1,120 @@
 #include "ota_lib.h"
 #include <esp_log.h>
-#include <esp_https_ota.h>
 #include <string.h>
 #include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/event_groups.h"
 #include "esp_system.h"
-#include "esp_event.h"
-#include "esp_check.h"
 #include "esp_ota_ops.h"
+#include "esp_partition.h"
 #include "esp_http_client.h"
-#include "esp_https_ota.h"
+#include "esp_timer.h"
+#include "esp_app_format.h"
+#include "esp_image_format.h"
+#include "psa/crypto.h"
 #include <esp_crt_bundle.h>
 #include "log_lib.h"
+#include "nvs_lib.h"
+#include "delta_patch.h"
+#include "ota_udp_rx.h"
+#include "lwip/sockets.h"
 
+/**
+ * OTA library
+ *
+ * Download engine (esp_http_client + esp_ota_write, no esp_https_ota):
+ * - image streamed to the next OTA partition through a CONFIG_OTA_BUF_SIZE buffer,
+ *   partition erased sector by sector as written (no up-front erase of 2 MB)
+ * - SHA-256 computed while streaming, checked against <url>.sha256 if served
+ * - resume: a failed attempt retries with "Range: bytes=<written>-" (and If-Range
+ *   on the ETag, so a changed image restarts from 0), up to CONFIG_OTA_MAX_ATTEMPTS.
+ *   The offset is also kept in NVS: a later ota_init (even after a reboot) resumes
+ *   the same image, re-hashing what the partition already holds
+ * - delta (CONFIG_OTA_DELTA): first asks the station for a patch against the running
+ *   image (<url>.patch?from=<sha256 of the running image>, see delta_patch.h), applied
+ *   while streaming: old bytes read from the running partition, new ones written to
+ *   the next one. Falls back to the full image when there is no patch
+ * - UDP (CONFIG_OTA_UDP, ota_udp_start): the station pushes the image to
+ *   CONFIG_OTA_UDP_PORT with a sliding window and selective acks, see ota_udp_rx.h
+ * - QoS (ota_set_qos): exclusive, or safety where the task runs at a low priority and
+ *   HTTP / delta downloads are paced to a byte rate, so control, stop commands and the
+ *   safety telemetry filtered through by udp_lib keep their share of CPU and air time
+ * - throughput / ETA, see ota_get_progress
+ */
 
 static const char *TAG = "ota_library";
 
-#define FIRMWARE_UPGRADE_URL "http://192.168.1.163:8070/firmware.bin"
+#define FIRMWARE_UPGRADE_URL CONFIG_OTA_URL
 //"https://raw.githubusercontent.com/FireVirtuozz/ESP32/main/server/build/server.bin"
 
 #define USE_TLS 0
 #define SKIP_VERSION_CHECK 1
 #define OTA_RECV_TIMEOUT 5000
-#define OTA_BUF_SIZE 1024
+#define OTA_BUF_SIZE CONFIG_OTA_BUF_SIZE        // download / flash write chunk
+#define OTA_HTTP_BUF_SIZE 2048                  // http client rx buffer (headers)
+#define OTA_MAX_ATTEMPTS CONFIG_OTA_MAX_ATTEMPTS
+#define OTA_RETRY_DELAY_MS 500                  // doubled per failed attempt
+#define OTA_RETRY_DELAY_MAX_MS 8000
+#define OTA_SECTOR_SIZE 4096
+#define OTA_RESUME_SAVE_BYTES (16 * OTA_SECTOR_SIZE) // NVS resume point period
+#define OTA_PROGRESS_PERIOD_US 1000000
+#define OTA_SHA256_LEN 32
+#define OTA_TASK_PRIORITY 5                     // exclusive mode
+#define OTA_QOS_BURST_US 1000000                // pacing debt forgiven past this (after a retry wait)
 
-/* Event handler for catching system events */
-static void event_handler(void* arg, esp_event_base_t event_base,
-                          int32_t event_id, void* event_data)
-{
-    if (event_base == ESP_HTTPS_OTA_EVENT) {
-        switch (event_id) {
-            case ESP_HTTPS_OTA_START:
-                log_msg(TAG, "OTA started");
-                break;
-            case ESP_HTTPS_OTA_CONNECTED:
-                log_msg(TAG, "Connected to server");
-                break;
-            case ESP_HTTPS_OTA_GET_IMG_DESC:
-                log_msg(TAG, "Reading Image Description");
-                break;
-            case ESP_HTTPS_OTA_VERIFY_CHIP_ID:
-                log_msg(TAG, "Verifying chip id of new image: %d", *(esp_chip_id_t *)event_data);
-                break;
-            case ESP_HTTPS_OTA_VERIFY_CHIP_REVISION:
-                log_msg(TAG, "Verifying chip revision of new image: %d", *(esp_chip_id_t *)event_data);
-                break;
-            case ESP_HTTPS_OTA_DECRYPT_CB:
-                log_msg(TAG, "Callback to decrypt function");
-                break;
-            case ESP_HTTPS_OTA_WRITE_FLASH:
-                log_msg(TAG, "Writing to flash: %d written", *(int *)event_data);
-                break;
-            case ESP_HTTPS_OTA_UPDATE_BOOT_PARTITION:
-                log_msg(TAG, "Boot partition updated. Next Partition: %d", *(esp_partition_subtype_t *)event_data);
-                break;
-            case ESP_HTTPS_OTA_FINISH:
-                log_msg(TAG, "OTA finish");
-                break;
-            case ESP_HTTPS_OTA_ABORT:
-                log_msg(TAG, "OTA abort");
-                break;
-        }
-    }
-}
+//Resume point, NVS record
+#define OTA_RESUME_KEY "OTA_RESUME"
+#define OTA_RESUME_VERSION 1
+
+typedef struct {
+    uint32_t url_crc;           // image URL the offset belongs to
+    uint32_t partition_address;
+    uint32_t image_size;
+    uint32_t written;           // sector aligned: bytes known to be in flash
+    char etag[64];              // server validator, "" if none
+} ota_resume_t;
+
+typedef struct {
+    const esp_partition_t *partition;
+    const esp_partition_t *running;
+    esp_ota_handle_t handle;
+    bool handle_open;           // written bytes are in the handle and the hash
+    bool desc_checked;
+    psa_hash_operation_t sha;
+    bool expected_sha_valid;
+    uint8_t expected_sha[OTA_SHA256_LEN];
+    ota_resume_t resume;
+    uint8_t *buf;
+    //throughput window
+    int64_t window_start_us;
+    uint32_t window_bytes;
+    //rate limit
+    ota_qos_t qos;
+    int64_t pace_start_us;
+    uint32_t pace_bytes;
+} ota_ctx_t;
+
+atomic_bool ota_lock = false;
+
+static ota_progress_t progress = {0};
+static portMUX_TYPE progress_mux = portMUX_INITIALIZER_UNLOCKED;
+static atomic_bool ota_running = false;
+
+#if CONFIG_OTA_QOS_SAFETY
+static ota_qos_t qos = {
+    .mode = OTA_QOS_SAFETY,
+    .rate_limit_bps = CONFIG_OTA_QOS_RATE_LIMIT,
+    .task_priority = CONFIG_OTA_QOS_PRIORITY,
+};
+#else
+static ota_qos_t qos = {
+    .mode = OTA_QOS_EXCLUSIVE,
+    .rate_limit_bps = 0,
+    .task_priority = OTA_TASK_PRIORITY,
+};
+#endif
 
 static esp_err_t validate_image_header(esp_app_desc_t *new_app_info)
 {
@@ -89,20 +139,255 @@ static esp_err_t validate_image_header(esp_app_desc_t *new_app_info)
     return ESP_OK;
 }
 
-static esp_err_t _http_client_init_cb(esp_http_client_handle_t http_client)
-{
-    esp_err_t err = ESP_OK;
-    /* Uncomment to add custom headers to HTTP request */
-    err = esp_http_client_set_header(http_client, "User-Agent", "ESP32-OTA");
-    return err;
+static void progress_set_state(ota_state_t state) {
+    taskENTER_CRITICAL(&progress_mux);
+    progress.state = state;
+    taskEXIT_CRITICAL(&progress_mux);
 }
 
-void advanced_ota_example_task(void *pvParameter)
-{
-    log_msg(TAG, "Starting Advanced OTA");
+/**
+ * Account downloaded bytes, log throughput and ETA once per period
+ */
+static void progress_update(ota_ctx_t *ctx, uint32_t n) {
+    ctx->window_bytes += n;
+    int64_t now = esp_timer_get_time();
+    int64_t elapsed = now - ctx->window_start_us;
+
+    taskENTER_CRITICAL(&progress_mux);
+    progress.written = ctx->resume.written;
+    progress.image_size = ctx->resume.image_size;
+    if (elapsed >= OTA_PROGRESS_PERIOD_US) {
+        uint32_t bps = (uint32_t)((int64_t)ctx->window_bytes * 1000000 / elapsed);
+        //smoothed: one slow window should not make the ETA jump
+        progress.throughput_bps = (progress.throughput_bps == 0) ? bps : (progress.throughput_bps * 3 + bps) / 4;
+        progress.eta_s = (progress.throughput_bps == 0) ? 0 :
+            (progress.image_size - progress.written) / progress.throughput_bps;
+    }
+    ota_progress_t snapshot = progress;
+    taskEXIT_CRITICAL(&progress_mux);
+
+    if (elapsed >= OTA_PROGRESS_PERIOD_US) {
+        ctx->window_start_us = now;
+        ctx->window_bytes = 0;
+        log_msg(TAG, "%" PRIu32 "/%" PRIu32 " KB, %" PRIu32 " KB/s, ETA %" PRIu32 " s",
+            snapshot.written / 1024, snapshot.image_size / 1024,
+            snapshot.throughput_bps / 1024, snapshot.eta_s);
+    }
+}
+
+/**
+ * Sleep while the download is ahead of the QoS rate limit. The lost time is
+ * kept (throttled_ms) to weigh the cost of the safety mode on the update
+ */
+static void qos_pace(ota_ctx_t *ctx, uint32_t n) {
+    if (ctx->qos.rate_limit_bps == 0) {
+        return;
+    }
+    ctx->pace_bytes += n;
+    int64_t now = esp_timer_get_time();
+    int64_t due = ctx->pace_start_us + (int64_t)ctx->pace_bytes * 1000000 / ctx->qos.rate_limit_bps;
+
+    //below a tick the sleep would be 0: wait for the debt to add up
+    if (due - now >= (int64_t)portTICK_PERIOD_MS * 1000) {
+        uint32_t ms = (uint32_t)((due - now) / 1000);
+        vTaskDelay(pdMS_TO_TICKS(ms));
+        taskENTER_CRITICAL(&progress_mux);
+        progress.throttled_ms += ms;
+        taskEXIT_CRITICAL(&progress_mux);
+    } else if (now - due > OTA_QOS_BURST_US) {
+        //slower than the limit (or back from a retry wait): no burst to catch up
+        ctx->pace_start_us = now;
+        ctx->pace_bytes = 0;
+    }
+}
+
+/**
+ * Whole-update figures, same for every transport so they compare
+ */
+static void progress_done(int64_t start_us) {
+    taskENTER_CRITICAL(&progress_mux);
+    progress.state = OTA_STATE_DONE;
+    progress.elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    ota_progress_t snapshot = progress;
+    taskEXIT_CRITICAL(&progress_mux);
+
+    uint32_t ms = (snapshot.elapsed_ms > 0) ? snapshot.elapsed_ms : 1;
+    log_msg(TAG, "%" PRIu32 " KB in %" PRIu32 " ms (%" PRIu32 " KB/s), %s mode, %" PRIu32 " ms throttled",
+        snapshot.written / 1024, snapshot.elapsed_ms, (uint32_t)((uint64_t)snapshot.written * 1000 / 1024 / ms),
+        (snapshot.qos_mode == OTA_QOS_SAFETY) ? "safety" : "exclusive", snapshot.throttled_ms);
+}
+
+static void resume_save(ota_ctx_t *ctx, uint32_t written) {
+    ota_resume_t r = ctx->resume;
+    r.written = written;
+    esp_err_t err = save_nvs_record(OTA_RESUME_KEY, NVS_RECORD_OTA_RESUME, OTA_RESUME_VERSION, &r, sizeof(r));
+    if (err != ESP_OK) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "Error (%s) saving resume point", esp_err_to_name(err));
+    }
+}
+
+static void resume_clear() {
+    ota_resume_t r = {0};
+    save_nvs_record(OTA_RESUME_KEY, NVS_RECORD_OTA_RESUME, OTA_RESUME_VERSION, &r, sizeof(r));
+}
+
+static int hex_nibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Get the published digest of the image, <url>.sha256 ("sha256sum" format)
+ */
+static esp_err_t fetch_expected_sha(ota_ctx_t *ctx) {
+
+    char url[sizeof(FIRMWARE_UPGRADE_URL) + 8];
+    snprintf(url, sizeof(url), "%s.sha256", FIRMWARE_UPGRADE_URL);
+
+    esp_http_client_config_t config = {
+        .url = url,
+    #if USE_TLS
+        .crt_bundle_attach = esp_crt_bundle_attach,
+    #else
+        .use_global_ca_store = true,
+    #endif
+        .timeout_ms = OTA_RECV_TIMEOUT,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return ESP_FAIL;
+    }
+
+    char hex[2 * OTA_SHA256_LEN];
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err == ESP_OK) {
+        esp_http_client_fetch_headers(client);
+        if (esp_http_client_get_status_code(client) != 200
+            || esp_http_client_read(client, hex, sizeof(hex)) != sizeof(hex)) {
+            err = ESP_ERR_NOT_FOUND;
+        }
+    }
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    for (int i = 0; i < OTA_SHA256_LEN; i++) {
+        int hi = hex_nibble(hex[2 * i]);
+        int lo = hex_nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        ctx->expected_sha[i] = (uint8_t)((hi << 4) | lo);
+    }
+    ctx->expected_sha_valid = true;
+    return ESP_OK;
+}
+
+/**
+ * Open the OTA handle at resume.written: new image, or resume of one partly
+ * in the partition (its content is hashed again)
+ */
+static esp_err_t ota_handle_open(ota_ctx_t *ctx) {
 
     esp_err_t err;
-    esp_err_t ota_finish_err = ESP_OK;
+    ctx->sha = psa_hash_operation_init();
+    if (psa_hash_setup(&ctx->sha, PSA_ALG_SHA_256) != PSA_SUCCESS) {
+        return ESP_FAIL;
+    }
+
+    if (ctx->resume.written == 0) {
+        err = esp_ota_begin(ctx->partition, OTA_WITH_SEQUENTIAL_WRITES, &ctx->handle);
+    } else {
+        //bytes after the resume point may be there from the interrupted run: erase
+        //that sector, the following ones are erased as they are written
+        err = esp_partition_erase_range(ctx->partition, ctx->resume.written, OTA_SECTOR_SIZE);
+        if (err == ESP_OK) {
+            err = esp_ota_resume(ctx->partition, OTA_WITH_SEQUENTIAL_WRITES, ctx->resume.written, &ctx->handle);
+        }
+        for (uint32_t off = 0; err == ESP_OK && off < ctx->resume.written; off += OTA_BUF_SIZE) {
+            uint32_t n = ctx->resume.written - off;
+            n = (n < OTA_BUF_SIZE) ? n : OTA_BUF_SIZE;
+            err = esp_partition_read(ctx->partition, off, ctx->buf, n);
+            if (err == ESP_OK && psa_hash_update(&ctx->sha, ctx->buf, n) != PSA_SUCCESS) {
+                err = ESP_FAIL;
+            }
+        }
+    }
+    if (err != ESP_OK) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) opening OTA at %" PRIu32,
+            esp_err_to_name(err), ctx->resume.written);
+        psa_hash_abort(&ctx->sha);
+        return err;
+    }
+    ctx->handle_open = true;
+    return ESP_OK;
+}
+
+static void ota_handle_close(ota_ctx_t *ctx) {
+    if (ctx->handle_open) {
+        esp_ota_abort(ctx->handle);
+        psa_hash_abort(&ctx->sha);
+        ctx->handle_open = false;
+    }
+}
+
+/**
+ * Check the response of a (range) request, restart from 0 if the server
+ * sent the whole image
+ */
+static esp_err_t ota_check_response(ota_ctx_t *ctx, esp_http_client_handle_t client, int64_t content_length) {
+
+    int status = esp_http_client_get_status_code(client);
+    char *etag = NULL;
+    esp_http_client_get_header(client, "ETag", &etag);
+
+    if (status == 206 && ctx->resume.written > 0) {
+        char *range = NULL;
+        uint32_t start = 0, total = 0;
+        if (esp_http_client_get_header(client, "Content-Range", &range) != ESP_OK || range == NULL
+            || sscanf(range, "bytes %" SCNu32 "-%*u/%" SCNu32, &start, &total) != 2
+            || start != ctx->resume.written || total != ctx->resume.image_size) {
+            log_msg_lvl(ESP_LOG_ERROR, TAG, "Unexpected Content-Range %s", range ? range : "(none)");
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        log_msg(TAG, "Resuming at %" PRIu32 "/%" PRIu32, start, total);
+        taskENTER_CRITICAL(&progress_mux);
+        progress.resumed_from = start;
+        progress.resumes++;
+        taskEXIT_CRITICAL(&progress_mux);
+        return ESP_OK;
+    }
+
+    if (status != 200 || content_length <= 0 || content_length > ctx->partition->size) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "HTTP status %d, length %" PRId64, status, content_length);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    //whole image: new download (or the image changed, If-Range)
+    if (ctx->resume.written > 0) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "Server sent the whole image, restarting from 0");
+    }
+    ota_handle_close(ctx);
+    ctx->desc_checked = false;
+    ctx->resume.written = 0;
+    ctx->resume.image_size = (uint32_t)content_length;
+    memset(ctx->resume.etag, 0, sizeof(ctx->resume.etag));
+    if (etag != NULL) {
+        strncpy(ctx->resume.etag, etag, sizeof(ctx->resume.etag) - 1);
+    }
+    resume_save(ctx, 0);
+    return ESP_OK;
+}
+
+/**
+ * One download attempt, from resume.written to the end of the image
+ */
+static esp_err_t ota_download(ota_ctx_t *ctx) {
+
     esp_http_client_config_t config = {
         .url = FIRMWARE_UPGRADE_URL,
     #if USE_TLS
@@ -112,93 +397,687 @@ void advanced_ota_example_task(void *pvParameter)
     #endif
         .timeout_ms = OTA_RECV_TIMEOUT,
         .keep_alive_enable = true,
-        .buffer_size = OTA_BUF_SIZE,
+        .buffer_size = OTA_HTTP_BUF_SIZE,
         };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return ESP_FAIL;
+    }
+    esp_http_client_set_header(client, "User-Agent", "ESP32-OTA");
 
-    esp_https_ota_config_t ota_config = {
-        .http_config = &config,
-        .http_client_init_cb = _http_client_init_cb,
-        };
+    if (ctx->resume.written > 0) {
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%" PRIu32 "-", ctx->resume.written);
+        esp_http_client_set_header(client, "Range", range);
+        if (ctx->resume.etag[0] != '\0') {
+            esp_http_client_set_header(client, "If-Range", ctx->resume.etag);
+        }
+    }
 
-    esp_https_ota_handle_t https_ota_handle = NULL;
-    err = esp_https_ota_begin(&ota_config, &https_ota_handle);
-    if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "ESP HTTPS OTA Begin failed");
-        atomic_store(&ota_lock, false);
-        vTaskDelete(NULL);
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err == ESP_OK) {
+        err = ota_check_response(ctx, client, esp_http_client_fetch_headers(client));
+    }
+    if (err == ESP_OK && !ctx->handle_open) {
+        err = ota_handle_open(ctx);
+    }
+
+    ctx->window_start_us = esp_timer_get_time();
+    ctx->window_bytes = 0;
+    uint32_t saved = ctx->resume.written;
+    while (err == ESP_OK && ctx->resume.written < ctx->resume.image_size) {
+        int n = esp_http_client_read(client, (char *)ctx->buf, OTA_BUF_SIZE);
+        if (n <= 0) {
+            //0 before the announced length: connection closed
+            log_msg_lvl(ESP_LOG_WARN, TAG, "Connection lost at %" PRIu32 "/%" PRIu32,
+                ctx->resume.written, ctx->resume.image_size);
+            err = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        if (ctx->resume.written + n > ctx->resume.image_size) {
+            err = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+
+        err = esp_ota_write(ctx->handle, ctx->buf, n);
+        if (err != ESP_OK) {
+            log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) writing flash", esp_err_to_name(err));
+            break;
+        }
+        if (psa_hash_update(&ctx->sha, ctx->buf, n) != PSA_SUCCESS) {
+            err = ESP_FAIL;
+            break;
+        }
+        ctx->resume.written += n;
+
+        //app description is right after the image and first segment headers
+        if (!ctx->desc_checked && ctx->resume.written >=
+            sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
+            esp_app_desc_t app_desc;
+            err = esp_partition_read(ctx->partition,
+                sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), &app_desc, sizeof(app_desc));
+            if (err == ESP_OK) {
+                err = validate_image_header(&app_desc);
+            }
+            if (err != ESP_OK) {
+                log_msg_lvl(ESP_LOG_ERROR, TAG, "image header verification failed");
+                err = ESP_ERR_OTA_VALIDATE_FAILED;
+                break;
+            }
+            ctx->desc_checked = true;
+        }
+
+        uint32_t aligned = ctx->resume.written & ~(uint32_t)(OTA_SECTOR_SIZE - 1);
+        if (aligned - saved >= OTA_RESUME_SAVE_BYTES) {
+            resume_save(ctx, aligned);
+            saved = aligned;
+        }
+        progress_update(ctx, n);
+        qos_pace(ctx, n);
+    }
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+#if CONFIG_OTA_DELTA || CONFIG_OTA_UDP
+/**
+ * Image bytes in order, from a delta patch or UDP chunks
+ */
+static int write_hashed(void *arg, const uint8_t *buf, size_t len) {
+    ota_ctx_t *ctx = arg;
+    if (esp_ota_write(ctx->handle, buf, len) != ESP_OK
+        || psa_hash_update(&ctx->sha, buf, len) != PSA_SUCCESS) {
+        return -1;
     }
+    ctx->resume.written += len;
+    progress_update(ctx, len);
+    return 0;
+}
+#endif
+
+#if CONFIG_OTA_DELTA
+static int delta_read_old(void *arg, uint32_t offset, uint8_t *buf, size_t len) {
+    ota_ctx_t *ctx = arg;
+    return (esp_partition_read(ctx->running, offset, buf, len) == ESP_OK) ? 0 : -1;
+}
 
-    esp_app_desc_t app_desc = {};
-    err = esp_https_ota_get_img_desc(https_ota_handle, &app_desc);
+/**
+ * SHA-256 of the running image (as the file the station served), names the
+ * image a patch applies to
+ */
+static esp_err_t running_image_sha(ota_ctx_t *ctx, uint8_t *sha, uint32_t *image_len) {
+
+    esp_partition_pos_t pos = {
+        .offset = ctx->running->address,
+        .size = ctx->running->size,
+    };
+    esp_image_metadata_t meta;
+    esp_err_t err = esp_image_get_metadata(&pos, &meta);
     if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "esp_https_ota_get_img_desc failed");
-        goto ota_end;
+        return err;
+    }
+
+    psa_hash_operation_t op = psa_hash_operation_init();
+    if (psa_hash_setup(&op, PSA_ALG_SHA_256) != PSA_SUCCESS) {
+        return ESP_FAIL;
     }
-    err = validate_image_header(&app_desc);
+    for (uint32_t off = 0; err == ESP_OK && off < meta.image_len; off += OTA_BUF_SIZE) {
+        uint32_t n = meta.image_len - off;
+        n = (n < OTA_BUF_SIZE) ? n : OTA_BUF_SIZE;
+        err = esp_partition_read(ctx->running, off, ctx->buf, n);
+        if (err == ESP_OK && psa_hash_update(&op, ctx->buf, n) != PSA_SUCCESS) {
+            err = ESP_FAIL;
+        }
+    }
+    size_t sha_len = 0;
+    if (err != ESP_OK || psa_hash_finish(&op, sha, OTA_SHA256_LEN, &sha_len) != PSA_SUCCESS) {
+        psa_hash_abort(&op);
+        return (err != ESP_OK) ? err : ESP_FAIL;
+    }
+    *image_len = meta.image_len;
+    return ESP_OK;
+}
+
+/**
+ * Update from a patch against the running image. ESP_ERR_NOT_FOUND when the
+ * station has none (it only knows images it served)
+ */
+static esp_err_t ota_delta_update(ota_ctx_t *ctx) {
+
+    uint8_t old_sha[OTA_SHA256_LEN];
+    uint32_t old_len = 0;
+    esp_err_t err = running_image_sha(ctx, old_sha, &old_len);
     if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "image header verification failed");
-        goto ota_end;
+        return err;
     }
 
-    while (1) {
+    char url[sizeof(FIRMWARE_UPGRADE_URL) + 13 + 2 * OTA_SHA256_LEN];
+    int pos = snprintf(url, sizeof(url), "%s.patch?from=", FIRMWARE_UPGRADE_URL);
+    for (int i = 0; i < OTA_SHA256_LEN; i++) {
+        pos += snprintf(&url[pos], sizeof(url) - pos, "%02x", old_sha[i]);
+    }
 
-        err = esp_https_ota_perform(https_ota_handle);
-        if (err != ESP_ERR_HTTPS_OTA_IN_PROGRESS) {
-            break;
+    esp_http_client_config_t config = {
+        .url = url,
+    #if USE_TLS
+        .crt_bundle_attach = esp_crt_bundle_attach,
+    #else
+        .use_global_ca_store = true,
+    #endif
+        .timeout_ms = OTA_RECV_TIMEOUT,
+        .buffer_size = OTA_HTTP_BUF_SIZE,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    delta_patch_t *patch = malloc(sizeof(delta_patch_t));
+    if (client == NULL || patch == NULL) {
+        if (client != NULL) {
+            esp_http_client_cleanup(client);
         }
+        free(patch);
+        return ESP_ERR_NO_MEM;
+    }
+    esp_http_client_set_header(client, "User-Agent", "ESP32-OTA");
 
-        // esp_https_ota_perform returns after every read operation which gives user the ability to
-        // monitor the status of OTA upgrade by calling esp_https_ota_get_image_len_read, which gives length of image
-        // data read so far.
-        const size_t len = esp_https_ota_get_image_len_read(https_ota_handle);
-        log_msg_lvl(ESP_LOG_DEBUG, TAG, "Image bytes read: %d", len);
+    int64_t patch_size = 0;
+    err = esp_http_client_open(client, 0);
+    if (err == ESP_OK) {
+        patch_size = esp_http_client_fetch_headers(client);
+        if (esp_http_client_get_status_code(client) != 200 || patch_size <= DELTA_PATCH_HEADER_SIZE) {
+            err = ESP_ERR_NOT_FOUND;
+        }
     }
 
-    if (esp_https_ota_is_complete_data_received(https_ota_handle) != true) {
-        // the OTA image was not completely received and user can customise the response to this situation.
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Complete data was not received.");
+    int64_t start = esp_timer_get_time();
+    ctx->resume.written = 0;
+    ctx->resume.image_size = 0;
+    ctx->window_start_us = start;
+    ctx->window_bytes = 0;
+    delta_patch_init(patch, delta_read_old, write_hashed, ctx);
+    if (err == ESP_OK) {
+        err = ota_handle_open(ctx);
+    }
+
+    int64_t patch_read = 0;
+    while (err == ESP_OK && patch_read < patch_size) {
+        int n = esp_http_client_read(client, (char *)ctx->buf, OTA_BUF_SIZE);
+        if (n <= 0) {
+            err = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        patch_read += n;
+        if (delta_patch_feed(patch, ctx->buf, n) != DELTA_PATCH_OK) {
+            log_msg_lvl(ESP_LOG_ERROR, TAG, "Bad patch (%d) at %" PRId64, patch->status, patch_read);
+            err = ESP_ERR_INVALID_RESPONSE;
+            break;
+        }
+        //header in: check the patch is for this image before anything is read from it
+        if (patch->header_done && ctx->resume.image_size == 0) {
+            //an empty image is never valid (and image_size 0 means "header not checked yet")
+            if (patch->old_size != old_len || memcmp(patch->old_sha, old_sha, OTA_SHA256_LEN) != 0
+                || patch->new_size == 0 || patch->new_size > ctx->partition->size) {
+                err = ESP_ERR_INVALID_VERSION;
+                break;
+            }
+            ctx->resume.image_size = patch->new_size;
+        }
+        qos_pace(ctx, n);
+    }
+    if (err == ESP_OK && delta_patch_finish(patch) != DELTA_PATCH_OK) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Incomplete patch (%d)", patch->status);
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    uint32_t apply_ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+
+    if (err == ESP_OK) {
+        //the hash checked by ota_finish is the one of the rebuilt image
+        memcpy(ctx->expected_sha, patch->new_sha, OTA_SHA256_LEN);
+        ctx->expected_sha_valid = true;
+        log_msg(TAG, "Delta update: patch %" PRId64 " B vs image %" PRIu32 " B (%" PRIu32 "%%), applied in %" PRIu32 " ms",
+            patch_size, patch->new_size,
+            patch->new_size > 0 ? (uint32_t)(patch_size * 100 / patch->new_size) : 0, apply_ms);
+        taskENTER_CRITICAL(&progress_mux);
+        progress.patch_size = (uint32_t)patch_size;
+        progress.apply_ms = apply_ms;
+        taskEXIT_CRITICAL(&progress_mux);
     } else {
+        ota_handle_close(ctx);
+        ctx->resume.written = 0;
+        ctx->resume.image_size = 0;
+    }
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    free(patch);
+    return err;
+}
+#endif
+
+/**
+ * Complete image: digest, image validation, boot partition
+ */
+static esp_err_t ota_finish(ota_ctx_t *ctx) {
+
+    progress_set_state(OTA_STATE_VERIFYING);
 
-        ota_finish_err = esp_https_ota_finish(https_ota_handle);
-        
-        if ((err == ESP_OK) && (ota_finish_err == ESP_OK)) {
-            log_msg(TAG, "ESP_HTTPS_OTA upgrade successful. Rebooting ...");
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            esp_restart();
-        } else {
+    uint8_t sha[OTA_SHA256_LEN];
+    size_t sha_len = 0;
+    psa_status_t status = psa_hash_finish(&ctx->sha, sha, sizeof(sha), &sha_len);
+    esp_err_t err = esp_ota_end(ctx->handle);
+    ctx->handle_open = false;
+    if (status != PSA_SUCCESS) {
+        return ESP_FAIL;
+    }
+    if (ctx->expected_sha_valid && memcmp(sha, ctx->expected_sha, OTA_SHA256_LEN) != 0) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "SHA-256 mismatch, image is corrupted");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    if (err != ESP_OK) {
+        if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+            log_msg_lvl(ESP_LOG_ERROR, TAG, "Image validation failed, image is corrupted");
+        }
+        return err;
+    }
+    return esp_ota_set_boot_partition(ctx->partition);
+}
 
-            if (ota_finish_err == ESP_ERR_OTA_VALIDATE_FAILED) {
-                log_msg_lvl(ESP_LOG_ERROR, TAG, "Image validation failed, image is corrupted");
+/**
+ * Resume point of an earlier ota_init, if it is for this URL and partition
+ */
+static void resume_load(ota_ctx_t *ctx) {
+
+    uint32_t url_crc = nvs_record_crc32(0, (const uint8_t *)FIRMWARE_UPGRADE_URL, strlen(FIRMWARE_UPGRADE_URL));
+    ota_resume_t r;
+    if (load_nvs_record(OTA_RESUME_KEY, NVS_RECORD_OTA_RESUME, OTA_RESUME_VERSION, &r, sizeof(r)) == ESP_OK
+        && r.url_crc == url_crc && r.partition_address == ctx->partition->address
+        && r.written > 0 && r.written < r.image_size && r.image_size <= ctx->partition->size) {
+        r.etag[sizeof(r.etag) - 1] = '\0';
+        ctx->resume = r;
+        log_msg(TAG, "Resume point %" PRIu32 "/%" PRIu32, r.written, r.image_size);
+        return;
+    }
+    memset(&ctx->resume, 0, sizeof(ctx->resume));
+    ctx->resume.url_crc = url_crc;
+    ctx->resume.partition_address = ctx->partition->address;
+}
+
+static void ota_task(void *pvParameter)
+{
+    log_msg(TAG, "Starting OTA from %s", FIRMWARE_UPGRADE_URL);
+    int64_t start_us = esp_timer_get_time();
+
+    ota_ctx_t *ctx = calloc(1, sizeof(ota_ctx_t));
+    uint8_t *buf = malloc(OTA_BUF_SIZE);
+    esp_err_t err = (ctx == NULL || buf == NULL) ? ESP_ERR_NO_MEM : ESP_OK;
+
+    if (err == ESP_OK) {
+        ctx->buf = buf;
+        ctx->qos = qos;
+        ctx->pace_start_us = start_us;
+        ctx->partition = esp_ota_get_next_update_partition(NULL);
+        ctx->running = esp_ota_get_running_partition();
+        if (ctx->partition == NULL || psa_crypto_init() != PSA_SUCCESS) {
+            err = ESP_FAIL;
+        }
+    }
+    if (err == ESP_OK) {
+        resume_load(ctx);
+        if (fetch_expected_sha(ctx) != ESP_OK) {
+            log_msg_lvl(ESP_LOG_WARN, TAG, "No %s.sha256, relying on image validation only", FIRMWARE_UPGRADE_URL);
+        }
+
+        taskENTER_CRITICAL(&progress_mux);
+        memset(&progress, 0, sizeof(progress));
+        progress.state = OTA_STATE_DOWNLOADING;
+        progress.qos_mode = ctx->qos.mode;
+        taskEXIT_CRITICAL(&progress_mux);
+
+        bool delta_done = false;
+#if CONFIG_OTA_DELTA
+        //an interrupted full download is resumed instead
+        if (ctx->resume.written == 0) {
+            err = ota_delta_update(ctx);
+            delta_done = (err == ESP_OK);
+            if (!delta_done) {
+                log_msg_lvl(ESP_LOG_WARN, TAG, "No delta update (%s), downloading the full image", esp_err_to_name(err));
+                err = ESP_OK;
             }
+        }
+#endif
+
+        uint32_t delay_ms = OTA_RETRY_DELAY_MS;
+        for (int attempt = 1; !delta_done && attempt <= OTA_MAX_ATTEMPTS; attempt++) {
+            taskENTER_CRITICAL(&progress_mux);
+            progress.attempts = attempt;
+            taskEXIT_CRITICAL(&progress_mux);
 
-            log_msg_lvl(ESP_LOG_ERROR, TAG, "ESP_HTTPS_OTA upgrade failed 0x%x", ota_finish_err);
-            atomic_store(&ota_lock, false);
-            vTaskDelete(NULL);
+            err = ota_download(ctx);
+            if (err == ESP_OK || err == ESP_ERR_OTA_VALIDATE_FAILED) {
+                break;
+            }
+            log_msg_lvl(ESP_LOG_WARN, TAG, "Attempt %d failed (%s), retry in %" PRIu32 " ms",
+                attempt, esp_err_to_name(err), delay_ms);
+            vTaskDelay(pdMS_TO_TICKS(delay_ms));
+            delay_ms = (delay_ms * 2 > OTA_RETRY_DELAY_MAX_MS) ? OTA_RETRY_DELAY_MAX_MS : delay_ms * 2;
         }
+        if (err == ESP_OK) {
+            err = ota_finish(ctx);
+        }
+    }
+
+    if (err == ESP_OK) {
+        resume_clear();
+        progress_done(start_us);
+        log_msg(TAG, "OTA upgrade successful. Rebooting ...");
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        esp_restart();
     }
 
-ota_end:
-    esp_https_ota_abort(https_ota_handle);
-    log_msg_lvl(ESP_LOG_ERROR, TAG, "ESP_HTTPS_OTA upgrade failed");
+    //a bad image is not resumed, an interrupted download is
+    if (ctx != NULL) {
+        ota_handle_close(ctx);
+        if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+            resume_clear();
+        }
+    }
+    progress_set_state(OTA_STATE_FAILED);
+    log_msg_lvl(ESP_LOG_ERROR, TAG, "OTA upgrade failed (%s)", esp_err_to_name(err));
+    free(buf);
+    free(ctx);
     atomic_store(&ota_lock, false);
+    atomic_store(&ota_running, false);
     vTaskDelete(NULL);
 }
 
-void ota_init() {
+#if CONFIG_OTA_UDP
+#define OTA_UDP_PORT CONFIG_OTA_UDP_PORT
+#define OTA_UDP_RECV_TIMEOUT_MS 20      // pending chunks acked after this much silence
+#define OTA_UDP_ACK_EVERY 4             // in-order chunks per ack
+#define OTA_UDP_START_TIMEOUT_MS 10000  // wait for the station's START
+#define OTA_UDP_IDLE_TIMEOUT_MS 5000    // session given up after this long without a packet
+#define OTA_UDP_FINAL_ACKS 3            // final status sent a few times, it may be lost
 
-    log_msg(TAG, "OTA start");
+static void udp_send_ack(int sock, const ota_udp_rx_t *rx, uint32_t session, uint8_t status,
+    const struct sockaddr_storage *to, socklen_t to_len) {
+    uint8_t ack[OTA_UDP_ACK_SIZE];
+    ota_udp_rx_ack(rx, session, status, ack);
+    sendto(sock, ack, sizeof(ack), 0, (const struct sockaddr *)to, to_len);
+}
 
-    esp_err_t err = esp_event_handler_register(ESP_HTTPS_OTA_EVENT,
-        ESP_EVENT_ANY_ID, &event_handler, NULL);
-    if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) registering handler", esp_err_to_name(err));
-        atomic_store(&ota_lock, false);
+static int udp_open_socket() {
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        return -1;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(OTA_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct timeval tv = {
+        .tv_sec = 0,
+        .tv_usec = OTA_UDP_RECV_TIMEOUT_MS * 1000,
+    };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/**
+ * One UDP session: START opens the OTA handle, chunks go through the
+ * receive window to flash, END checks the image and reboots
+ */
+static void ota_udp_task(void *pvParameter)
+{
+    int64_t start_us = esp_timer_get_time();
+    ota_ctx_t *ctx = calloc(1, sizeof(ota_ctx_t));
+    ota_udp_rx_t *rx = calloc(1, sizeof(ota_udp_rx_t));
+    uint8_t *packet = malloc(OTA_UDP_DATA_HEADER_SIZE + OTA_UDP_CHUNK_MAX);
+    uint8_t *slots = NULL;
+    int sock = -1;
+    esp_err_t err = (ctx == NULL || rx == NULL || packet == NULL) ? ESP_ERR_NO_MEM : ESP_OK;
+
+    if (err == ESP_OK) {
+        ctx->partition = esp_ota_get_next_update_partition(NULL);
+        sock = udp_open_socket();
+        if (ctx->partition == NULL || sock < 0 || psa_crypto_init() != PSA_SUCCESS) {
+            err = ESP_FAIL;
+        }
+    }
+
+    //no pacing here: the station sets the rate, the QoS is the task priority
+    taskENTER_CRITICAL(&progress_mux);
+    memset(&progress, 0, sizeof(progress));
+    progress.state = OTA_STATE_DOWNLOADING;
+    progress.attempts = 1;
+    progress.qos_mode = qos.mode;
+    taskEXIT_CRITICAL(&progress_mux);
+    log_msg(TAG, "Waiting for UDP OTA on port %d", OTA_UDP_PORT);
+
+    struct sockaddr_storage station;
+    socklen_t station_len = sizeof(station);
+    uint32_t session = 0;
+    bool started = false;
+    bool finished = false;
+    uint32_t unacked = 0;
+    uint32_t idle_ms = 0;
+
+    while (err == ESP_OK && !finished) {
+        struct sockaddr_storage from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, packet, OTA_UDP_DATA_HEADER_SIZE + OTA_UDP_CHUNK_MAX, 0,
+            (struct sockaddr *)&from, &from_len);
+
+        if (len < 0) {
+            idle_ms += OTA_UDP_RECV_TIMEOUT_MS;
+            if (idle_ms >= (started ? OTA_UDP_IDLE_TIMEOUT_MS : OTA_UDP_START_TIMEOUT_MS)) {
+                err = ESP_ERR_TIMEOUT;
+            } else if (unacked > 0) {
+                udp_send_ack(sock, rx, session, OTA_UDP_STATUS_RECEIVING, &station, station_len);
+                unacked = 0;
+            }
+            continue;
+        }
+        uint32_t id;
+        if (len < 5) {
+            continue;
+        }
+        memcpy(&id, &packet[1], sizeof(id));
+        if (started && id != session) {
+            continue;
+        }
+        idle_ms = 0;
+
+        switch (packet[0]) {
+        case OTA_UDP_START:
+            if (len < OTA_UDP_START_SIZE) {
+                break;
+            }
+            if (!started) {
+                uint32_t image_size;
+                uint16_t chunk_size;
+                memcpy(&image_size, &packet[5], sizeof(image_size));
+                memcpy(&chunk_size, &packet[41], sizeof(chunk_size));
+                session = id;
+                station = from;
+                station_len = from_len;
+                if (chunk_size > 0 && chunk_size <= OTA_UDP_CHUNK_MAX) {
+                    slots = malloc(OTA_UDP_WINDOW * chunk_size);
+                }
+                if (image_size > ctx->partition->size
+                    || !ota_udp_rx_init(rx, slots, chunk_size, image_size, write_hashed, ctx)) {
+                    udp_send_ack(sock, rx, session, OTA_UDP_STATUS_ERROR, &station, station_len);
+                    err = ESP_ERR_INVALID_SIZE;
+                    break;
+                }
+                memcpy(ctx->expected_sha, &packet[9], OTA_SHA256_LEN);
+                ctx->expected_sha_valid = true;
+                ctx->resume.image_size = image_size;
+                err = ota_handle_open(ctx);
+                if (err != ESP_OK) {
+                    udp_send_ack(sock, rx, session, OTA_UDP_STATUS_ERROR, &station, station_len);
+                    break;
+                }
+                started = true;
+                ctx->window_start_us = esp_timer_get_time();
+                log_msg(TAG, "UDP OTA session %08" PRIx32 ": %" PRIu32 " bytes, %u byte chunks",
+                    session, image_size, chunk_size);
+            }
+            //START sent again: our ack was lost
+            udp_send_ack(sock, rx, session, OTA_UDP_STATUS_RECEIVING, &station, station_len);
+            break;
+
+        case OTA_UDP_DATA: {
+            if (!started || len < OTA_UDP_DATA_HEADER_SIZE) {
+                break;
+            }
+            uint32_t seq;
+            memcpy(&seq, &packet[5], sizeof(seq));
+            ota_udp_rx_result_t res = ota_udp_rx_push(rx, seq, &packet[OTA_UDP_DATA_HEADER_SIZE],
+                len - OTA_UDP_DATA_HEADER_SIZE);
+            if (res == OTA_UDP_RX_WRITE_ERROR) {
+                udp_send_ack(sock, rx, session, OTA_UDP_STATUS_ERROR, &station, station_len);
+                err = ESP_FAIL;
+                break;
+            }
+            //a gap or a repeat is reported at once, so the station resends early
+            if (++unacked >= OTA_UDP_ACK_EVERY || res != OTA_UDP_RX_STORED || rx->mask != 0) {
+                udp_send_ack(sock, rx, session, OTA_UDP_STATUS_RECEIVING, &station, station_len);
+                unacked = 0;
+            }
+            break;
+        }
+
+        case OTA_UDP_END:
+            if (!started || !ota_udp_rx_complete(rx)) {
+                udp_send_ack(sock, rx, session, OTA_UDP_STATUS_RECEIVING, &station, station_len);
+                break;
+            }
+            err = ota_finish(ctx);
+            for (int i = 0; i < OTA_UDP_FINAL_ACKS; i++) {
+                udp_send_ack(sock, rx, session, (err == ESP_OK) ? OTA_UDP_STATUS_DONE : OTA_UDP_STATUS_ERROR,
+                    &station, station_len);
+            }
+            finished = true;
+            break;
+
+        case OTA_UDP_ABORT:
+            err = ESP_ERR_INVALID_STATE;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if (sock >= 0) {
+        close(sock);
+    }
+
+    if (err == ESP_OK) {
+        progress_done(start_us);
+        log_msg(TAG, "UDP OTA successful (%" PRIu32 " reordered, %" PRIu32 " duplicates). Rebooting ...",
+            rx->stats.reordered, rx->stats.duplicates);
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        esp_restart();
+    }
+
+    if (ctx != NULL) {
+        ota_handle_close(ctx);
+    }
+    progress_set_state(OTA_STATE_FAILED);
+    log_msg_lvl(ESP_LOG_ERROR, TAG, "UDP OTA failed (%s)", esp_err_to_name(err));
+    free(slots);
+    free(packet);
+    free(rx);
+    free(ctx);
+    atomic_store(&ota_lock, false);
+    atomic_store(&ota_running, false);
+    vTaskDelete(NULL);
+}
+#endif
+
+esp_err_t ota_get_progress(ota_progress_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&progress_mux);
+    *out = progress;
+    taskEXIT_CRITICAL(&progress_mux);
+    return ESP_OK;
+}
+
+esp_err_t ota_set_qos(const ota_qos_t *in) {
+    if (in == NULL || in->mode > OTA_QOS_SAFETY || in->task_priority >= configMAX_PRIORITIES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (atomic_load(&ota_running)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    taskENTER_CRITICAL(&progress_mux);
+    qos = *in;
+    taskEXIT_CRITICAL(&progress_mux);
+    log_msg(TAG, "QoS: %s, %" PRIu32 " B/s limit, priority %u",
+        (in->mode == OTA_QOS_SAFETY) ? "safety" : "exclusive", in->rate_limit_bps, in->task_priority);
+    return ESP_OK;
+}
+
+esp_err_t ota_get_qos(ota_qos_t *out) {
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&progress_mux);
+    *out = qos;
+    taskEXIT_CRITICAL(&progress_mux);
+    return ESP_OK;
+}
+
+esp_err_t ota_qos_apply_config(const uint8_t *buf, size_t len) {
+    if (buf == NULL || len < OTA_QOS_CONFIG_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    ota_qos_t in = {
+        .mode = (ota_qos_mode_t)buf[0],
+    };
+    memcpy(&in.rate_limit_bps, &buf[1], sizeof(in.rate_limit_bps));
+    in.task_priority = (in.mode == OTA_QOS_SAFETY) ? CONFIG_OTA_QOS_PRIORITY : OTA_TASK_PRIORITY;
+    return ota_set_qos(&in);
+}
+
+static void ota_start(TaskFunction_t task, const char *name) {
+
+    if (atomic_exchange(&ota_running, true)) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "OTA already running");
         return;
     }
 
+    log_msg(TAG, "OTA start");
+
+    //pending config writes must not be lost if the update ends in a reboot
+    esp_err_t flush_err = nvs_cache_flush();
+    if (flush_err != ESP_OK) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "Error (%s) flushing NVS cache", esp_err_to_name(flush_err));
+    }
+
     // esp_wifi_set_ps(WIFI_PS_NONE);
 
-    xTaskCreate(&advanced_ota_example_task,
-        "advanced_ota_example_task", 1024 * 8, NULL, 5, NULL);
+    if (xTaskCreate(task, name, 1024 * 8, NULL, qos.task_priority, NULL) != pdPASS) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error creating OTA task");
+        atomic_store(&ota_lock, false);
+        atomic_store(&ota_running, false);
+    }
+}
 
+void ota_init() {
+    ota_start(&ota_task, "ota_task");
+}
+
+#if CONFIG_OTA_UDP
+void ota_udp_start() {
+    ota_start(&ota_udp_task, "ota_udp_task");
 }
+#endif
@@ -2,8 +2,87 @@
 #define OTA_LIB_H_
 
 #include <stdatomic.h>
-static atomic_bool ota_lock = false;
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <esp_err.h>
 
+// Set while an update runs (commands and telemetry are cut or filtered, see
+// ota_qos_t), cleared again when it fails. Defined in ota_lib.c: one flag
+// shared by every component
+extern atomic_bool ota_lock;
+
+// What keeps running next to the download
+typedef enum {
+    OTA_QOS_EXCLUSIVE = 0,  // everything stops, download at full speed
+    OTA_QOS_SAFETY,         // stop commands, ping, battery and motor telemetry stay alive,
+                            // download paced at rate_limit_bps in a low priority task
+} ota_qos_mode_t;
+
+typedef struct {
+    ota_qos_mode_t mode;
+    uint32_t rate_limit_bps;    // download cap in bytes/s, 0 for none (HTTP and delta only)
+    uint8_t task_priority;      // of the OTA task
+} ota_qos_t;
+
+// Optional QoS block after commands 3 and 5 of the UDP config port (little-endian):
+// [0] = mode, [1..4] = rate limit bytes/s
+#define OTA_QOS_CONFIG_SIZE 5
+
+typedef enum {
+    OTA_STATE_IDLE = 0,
+    OTA_STATE_DOWNLOADING,
+    OTA_STATE_VERIFYING,
+    OTA_STATE_DONE,         // rebooting into the new image
+    OTA_STATE_FAILED,
+} ota_state_t;
+
+typedef struct {
+    ota_state_t state;
+    uint32_t image_size;        // 0 until the server answered
+    uint32_t written;           // bytes in flash, resumed part included
+    uint32_t resumed_from;      // offset of the last range resume, 0 if none
+    uint32_t resumes;           // range requests answered with 206
+    uint32_t throughput_bps;    // bytes/s, smoothed over 1 s windows
+    uint32_t eta_s;
+    uint8_t attempts;           // download attempts of this update
+    uint32_t patch_size;        // delta update: patch bytes, 0 for a full image
+    uint32_t apply_ms;          // delta update: download + apply time
+    uint32_t elapsed_ms;        // whole update, set once done
+    uint32_t throttled_ms;      // time slept by the rate limit
+    ota_qos_mode_t qos_mode;    // of this update
+} ota_progress_t;
+
+/**
+ * Start the update from CONFIG_OTA_URL in its own task: resumes a download
+ * interrupted earlier, reboots into the new image on success.
+ */
 void ota_init();
 
-#endif
\ No newline at end of file
+/**
+ * Receive the next image over UDP instead (CONFIG_OTA_UDP_PORT, protocol in
+ * ota_udp_rx.h): waits for the station to open a session, reboots into the
+ * new image on success.
+ */
+void ota_udp_start();
+
+/**
+ * QoS of the updates, defaults from CONFIG_OTA_QOS_*. ESP_ERR_INVALID_STATE
+ * while one runs: what ota_get_qos returns is then the one in effect.
+ */
+esp_err_t ota_set_qos(const ota_qos_t *qos);
+
+esp_err_t ota_get_qos(ota_qos_t *qos);
+
+/**
+ * Parse a QoS block (see OTA_QOS_CONFIG_SIZE) and apply it with ota_set_qos;
+ * the task priority stays the configured one.
+ */
+esp_err_t ota_qos_apply_config(const uint8_t *buf, size_t len);
+
+/**
+ * Snapshot of the current (or last) update progress.
+ */
+esp_err_t ota_get_progress(ota_progress_t *progress);
+
+#endif
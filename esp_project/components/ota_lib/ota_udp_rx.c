@@ -0,0 +1,90 @@
+#include "ota_udp_rx.h"
+#include <string.h>
+
+static uint32_t chunk_len(const ota_udp_rx_t *rx, uint32_t seq) {
+    uint32_t start = seq * rx->chunk_size;
+    uint32_t left = rx->image_size - start;
+    return (left < rx->chunk_size) ? left : rx->chunk_size;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+bool ota_udp_rx_init(ota_udp_rx_t *rx, uint8_t *slots, uint32_t chunk_size, uint32_t image_size,
+    ota_udp_write_fn write, void *arg) {
+    memset(rx, 0, sizeof(*rx));
+    if (slots == NULL || chunk_size == 0 || chunk_size > OTA_UDP_CHUNK_MAX || image_size == 0) {
+        return false;
+    }
+    rx->slots = slots;
+    rx->chunk_size = chunk_size;
+    rx->image_size = image_size;
+    rx->chunks = (image_size + chunk_size - 1) / chunk_size;
+    rx->write = write;
+    rx->arg = arg;
+    return true;
+}
+
+ota_udp_rx_result_t ota_udp_rx_push(ota_udp_rx_t *rx, uint32_t seq, const uint8_t *data, size_t len) {
+
+    if (seq >= rx->chunks || len != chunk_len(rx, seq)) {
+        return OTA_UDP_RX_INVALID;
+    }
+    if (seq < rx->next) {
+        rx->stats.duplicates++;
+        return OTA_UDP_RX_DUPLICATE;
+    }
+    if (seq - rx->next >= OTA_UDP_WINDOW) {
+        rx->stats.out_of_window++;
+        return OTA_UDP_RX_OUT_OF_WINDOW;
+    }
+    rx->stats.received++;
+
+    if (seq > rx->next) {
+        uint32_t bit = 1u << (seq - rx->next - 1);
+        if (rx->mask & bit) {
+            rx->stats.received--;
+            rx->stats.duplicates++;
+            return OTA_UDP_RX_DUPLICATE;
+        }
+        memcpy(&rx->slots[(seq % OTA_UDP_WINDOW) * rx->chunk_size], data, len);
+        rx->lens[seq % OTA_UDP_WINDOW] = (uint16_t)len;
+        rx->mask |= bit;
+        rx->stats.reordered++;
+        return OTA_UDP_RX_STORED;
+    }
+
+    //next chunk: straight from the packet, then whatever it unblocks
+    if (rx->write(rx->arg, data, len) != 0) {
+        return OTA_UDP_RX_WRITE_ERROR;
+    }
+    rx->next++;
+    while (rx->mask & 1u) {
+        rx->mask >>= 1;
+        uint32_t slot = rx->next % OTA_UDP_WINDOW;
+        if (rx->write(rx->arg, &rx->slots[slot * rx->chunk_size], rx->lens[slot]) != 0) {
+            return OTA_UDP_RX_WRITE_ERROR;
+        }
+        rx->next++;
+    }
+    rx->mask >>= 1;
+    return OTA_UDP_RX_STORED;
+}
+
+bool ota_udp_rx_complete(const ota_udp_rx_t *rx) {
+    return rx->chunks > 0 && rx->next == rx->chunks;
+}
+
+size_t ota_udp_rx_ack(const ota_udp_rx_t *rx, uint32_t session, uint8_t status, uint8_t *buf) {
+    buf[0] = OTA_UDP_ACK;
+    put_u32(&buf[1], session);
+    put_u32(&buf[5], rx->next);
+    put_u32(&buf[9], rx->mask);
+    buf[13] = status;
+    buf[14] = OTA_UDP_WINDOW;
+    return OTA_UDP_ACK_SIZE;
+}
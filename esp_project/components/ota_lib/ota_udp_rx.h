@@ -0,0 +1,98 @@
+#ifndef OTA_UDP_RX_H_
+#define OTA_UDP_RX_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// UDP OTA transport (no HTTP server): the station pushes the image in
+// numbered chunks with a sliding window, the ESP acknowledges with a
+// cumulative sequence plus a selective-ack bitmap, so only lost chunks
+// are sent again. Chunks arriving out of order wait in a window of
+// OTA_UDP_WINDOW slots until the ones before them came, since
+// esp_ota_write needs the image in order.
+// Pure code (no socket, no flash) so it can be run on the host.
+//
+// Packets, little-endian, [0] = type, [1..4] = session id:
+// - OTA_UDP_START (station): [5..8] = image size, [9..40] = SHA-256 of the
+//   image, [41..42] = chunk size
+// - OTA_UDP_DATA (station): [5..8] = chunk sequence, then the chunk
+//   (chunk size bytes, the last one shorter); chunk n is at n * chunk size
+// - OTA_UDP_END (station): image sent, asks for the final status
+// - OTA_UDP_ABORT (station)
+// - OTA_UDP_ACK (ESP): [5..8] = next chunk expected (all before it are in
+//   flash), [9..12] = bitmap, bit i = chunk next + 1 + i received,
+//   [13] = ota_udp_status_t, [14] = window in chunks
+#define OTA_UDP_WINDOW 16
+#define OTA_UDP_CHUNK_MAX 1400 // fits the usual 1500 bytes MTU with headers
+#define OTA_UDP_SHA_LEN 32
+#define OTA_UDP_START_SIZE 43
+#define OTA_UDP_DATA_HEADER_SIZE 9
+#define OTA_UDP_ACK_SIZE 15
+
+typedef enum {
+    OTA_UDP_START = 1,
+    OTA_UDP_DATA  = 2,
+    OTA_UDP_END   = 3,
+    OTA_UDP_ABORT = 4,
+    OTA_UDP_ACK   = 0x81,
+} ota_udp_packet_t;
+
+typedef enum {
+    OTA_UDP_STATUS_RECEIVING = 0,
+    OTA_UDP_STATUS_DONE      = 1, // image verified, rebooting into it
+    OTA_UDP_STATUS_ERROR     = 2, // session failed, stop sending
+} ota_udp_status_t;
+
+typedef enum {
+    OTA_UDP_RX_STORED = 0,  // in order (written) or buffered
+    OTA_UDP_RX_DUPLICATE,   // already had it
+    OTA_UDP_RX_OUT_OF_WINDOW,
+    OTA_UDP_RX_INVALID,     // bad sequence or length
+    OTA_UDP_RX_WRITE_ERROR, // write callback failed
+} ota_udp_rx_result_t;
+
+// In-order image bytes, returns 0 on success.
+typedef int (*ota_udp_write_fn)(void *arg, const uint8_t *data, size_t len);
+
+typedef struct {
+    uint32_t received;
+    uint32_t duplicates;
+    uint32_t out_of_window;
+    uint32_t reordered;     // chunks buffered before being written
+} ota_udp_rx_stats_t;
+
+typedef struct {
+    uint32_t chunk_size;
+    uint32_t image_size;
+    uint32_t chunks;
+    uint32_t next;          // next chunk to write
+    uint32_t mask;          // bit i: chunk next + 1 + i buffered
+    uint16_t lens[OTA_UDP_WINDOW];
+    uint8_t *slots;         // OTA_UDP_WINDOW * chunk_size bytes, chunk n in slot n % OTA_UDP_WINDOW
+    ota_udp_write_fn write;
+    void *arg;
+    ota_udp_rx_stats_t stats;
+} ota_udp_rx_t;
+
+/**
+ * @param slots  OTA_UDP_WINDOW * chunk_size bytes
+ * @return false if chunk_size / image_size are not usable
+ */
+bool ota_udp_rx_init(ota_udp_rx_t *rx, uint8_t *slots, uint32_t chunk_size, uint32_t image_size,
+    ota_udp_write_fn write, void *arg);
+
+/**
+ * Take one chunk: written right away when it is the next one (with the
+ * buffered ones following it), kept in its slot otherwise.
+ */
+ota_udp_rx_result_t ota_udp_rx_push(ota_udp_rx_t *rx, uint32_t seq, const uint8_t *data, size_t len);
+
+bool ota_udp_rx_complete(const ota_udp_rx_t *rx);
+
+/**
+ * Build an OTA_UDP_ACK packet (OTA_UDP_ACK_SIZE bytes) of the current state.
+ */
+size_t ota_udp_rx_ack(const ota_udp_rx_t *rx, uint32_t session, uint8_t status, uint8_t *buf);
+
+#endif // OTA_UDP_RX_H_
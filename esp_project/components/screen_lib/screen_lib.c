@@ -9,6 +9,13 @@
 #include "esp_log.h"
 #include "log_lib.h"
 #include "nvs_lib.h"
+#include "ssd1306_fb.h"
+
+/*
+ * Drawing only touches the shadow framebuffer (ssd1306_fb.h) under the mutex, then wakes the
+ * display task which sends the changed bytes over I2C: callers (like the motor timer with
+ * CONFIG_WRITE_MOTOR_SCREEN) never wait for the bus.
+ */
 
 // I2C pins
 #define I2C_MASTER_SDA_IO 22
@@ -19,10 +26,18 @@
 
 static const char * TAG = "screen_library";
 
-static uint8_t screen[128*8];
+#define SCREEN_TASK_PRIORITY 2
+
+static ssd1306_fb_t fb;
 
 static SemaphoreHandle_t xMutex = NULL;
 
+static TaskHandle_t screen_task_handle = NULL;
+
+static uint32_t updates = 0;
+
+static uint32_t send_errors = 0;
+
 static bool i2c_initialized = false;
 
 // Police 5x8 pour A-Z (chaque caractère = 5 colonnes)
@@ -198,23 +213,60 @@ static esp_err_t ssd1306_send_data(i2c_master_dev_handle_t handle,
     return i2c_master_multi_buffer_transmit(handle, multi_buffer, 2, -1);
 }
 
-static void ssd1306_flush_screen()
+/**
+ * @brief Send one span: column/page address window, then its bytes
+ */
+static esp_err_t ssd1306_send_span(const ssd1306_span_t *span, uint8_t *data)
 {
-    for (int page = 0; page < 8; page++) {
-        uint8_t cmd[] = {0xB0 | page, 0x00, 0x10};
-        esp_err_t err = ssd1306_send_cmd(dev_handle, cmd, sizeof(cmd));
-        if (err != ESP_OK) {
-            log_msg(TAG, "Error (%s) sending command", esp_err_to_name(err));
-            return;
-        }
+    uint8_t cmd[] = {
+        0x21, span->col, span->col + span->len - 1, // column window
+        0x22, span->page, span->page                // page window
+    };
+    esp_err_t err = ssd1306_send_cmd(dev_handle, cmd, sizeof(cmd));
+    if (err != ESP_OK) {
+        return err;
+    }
+    return ssd1306_send_data(dev_handle, data, span->len);
+}
 
-        err = ssd1306_send_data(dev_handle, &screen[page * 128], 128);
-        if (err != ESP_OK) {
-            log_msg(TAG, "Error (%s) sending data", esp_err_to_name(err));
-            return;
+static void screen_task(void *pvParameters)
+{
+    uint8_t data[SSD1306_FB_WIDTH];
+    ssd1306_span_t span;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        bool sent = false;
+        while (1) {
+            xSemaphoreTake(xMutex, portMAX_DELAY);
+            bool found = ssd1306_fb_take_span(&fb, &span, data);
+            xSemaphoreGive(xMutex);
+            if (!found) {
+                break;
+            }
+
+            esp_err_t err = ssd1306_send_span(&span, data);
+            if (err != ESP_OK) {
+                //screen content unknown: all of it goes again on the next update
+                send_errors++;
+                xSemaphoreTake(xMutex, portMAX_DELAY);
+                ssd1306_fb_invalidate(&fb);
+                xSemaphoreGive(xMutex);
+                log_msg(TAG, "Error (%s) sending screen update", esp_err_to_name(err));
+                break;
+            }
+            sent = true;
         }
+        updates += sent ? 1 : 0;
+    }
+}
+
+static void screen_update()
+{
+    if (screen_task_handle != NULL) {
+        xTaskNotifyGive(screen_task_handle);
     }
-    //save_nvs_blob("screen", screen, sizeof(screen));
 }
 
 // transmit one buffer data : sending 5 commands in a row
@@ -237,9 +289,7 @@ static void ssd1306_draw_char(char c, int x, int page) {
 
     if (index == -1) return; // caractère non supporté
 
-    for (int i = 0; i < 5; i++) {
-        screen[page * 128 + x + i] = font5x8[index][i];
-    }
+    ssd1306_fb_write(&fb, page, x, font5x8[index], 5);
 }
 
 void ssd1306_draw_string(const char *str, int x, int page) {
@@ -249,12 +299,10 @@ void ssd1306_draw_string(const char *str, int x, int page) {
     }
 
     if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE) {
+#if CONFIG_SCREEN_DEBUG
         log_msg(TAG, "Drawing : %s, offset %d, page %d", str, x, page); 
-        uint8_t a = 0;
-        while (a < 128) {
-            screen[page * 128 + a] = 0x00;
-            a++;
-        }
+#endif
+        ssd1306_fb_fill_page(&fb, page, 0x00);
         while (*str) {
             char c = *str++;
             if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
@@ -265,8 +313,8 @@ void ssd1306_draw_string(const char *str, int x, int page) {
             if (x > 127) break;
         }
 
-        ssd1306_flush_screen();
         xSemaphoreGive(xMutex);
+        screen_update();
     }
 }
 
@@ -352,9 +400,14 @@ void ssd1306_setup()
         return;
     }
 
-    memset(screen, 0x00, sizeof(screen));
-    load_nvs_blob("screen", screen, sizeof(screen));
-    ssd1306_flush_screen();
+    ssd1306_fb_init(&fb);
+    load_nvs_blob("screen", fb.draw, sizeof(fb.draw));
+
+    if (xTaskCreate(screen_task, "screen", 3072, NULL, SCREEN_TASK_PRIORITY, &screen_task_handle) != pdPASS) {
+        log_msg(TAG, "Error creating screen task");
+        return;
+    }
+    screen_update();
 
     log_msg(TAG, "ssd1306 initialized");
 }
@@ -365,10 +418,10 @@ void screen_full_on() {
     }
 
     if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE) {
-        memset(screen, 0xFF, sizeof(screen));   //pixels on
-        ssd1306_flush_screen();
-        log_msg(TAG, "Screen full on set");
+        ssd1306_fb_fill(&fb, 0xFF);   //pixels on
         xSemaphoreGive(xMutex);
+        screen_update();
+        log_msg(TAG, "Screen full on set");
     }
 }
 
@@ -378,9 +431,26 @@ void screen_full_off() {
     }
 
     if (xSemaphoreTake(xMutex, portMAX_DELAY) == pdTRUE) {
-        memset(screen, 0x00, sizeof(screen));   //pixels off
-        ssd1306_flush_screen();
-        log_msg(TAG, "Screen full off set");
+        ssd1306_fb_fill(&fb, 0x00);   //pixels off
         xSemaphoreGive(xMutex);
+        screen_update();
+        log_msg(TAG, "Screen full off set");
     }
-}
\ No newline at end of file
+}
+
+esp_err_t screen_get_stats(screen_stats_t *stats) {
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xMutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(xMutex, portMAX_DELAY);
+    stats->spans = fb.stats.spans;
+    stats->bytes_data = fb.stats.bytes_data;
+    stats->bytes_bus = fb.stats.bytes_bus;
+    xSemaphoreGive(xMutex);
+    stats->updates = updates;
+    stats->send_errors = send_errors;
+    return ESP_OK;
+}
@@ -3,6 +3,15 @@
 
 #include <stdio.h>
 #include <inttypes.h>
+#include <esp_err.h>
+
+typedef struct {
+    uint32_t updates;       // display task rounds that sent something
+    uint32_t spans;         // address windows sent
+    uint32_t bytes_data;
+    uint32_t bytes_bus;     // I2C bytes, addresses and commands included
+    uint32_t send_errors;
+} screen_stats_t;
 
 void ssd1306_setup();
 
@@ -10,6 +19,9 @@ void screen_full_on();
 
 void screen_full_off();
 
+// Draw into the framebuffer, sent by the display task (does not wait for I2C)
 void ssd1306_draw_string(const char *str, int x, int page);
 
-#endif
\ No newline at end of file
+esp_err_t screen_get_stats(screen_stats_t *stats);
+
+#endif
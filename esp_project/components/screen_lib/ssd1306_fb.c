@@ -0,0 +1,128 @@
+#include "ssd1306_fb.h"
+#include <string.h>
+
+#define FB_CLEAN_MIN SSD1306_FB_WIDTH
+#define FB_CLEAN_MAX 0
+
+static void mark_dirty(ssd1306_fb_t *fb, int page, int first, int last) {
+    if (first < fb->dirty_min[page]) {
+        fb->dirty_min[page] = (uint8_t)first;
+    }
+    if (last > fb->dirty_max[page]) {
+        fb->dirty_max[page] = (uint8_t)last;
+    }
+}
+
+static void mark_clean(ssd1306_fb_t *fb, int page) {
+    fb->dirty_min[page] = FB_CLEAN_MIN;
+    fb->dirty_max[page] = FB_CLEAN_MAX;
+    fb->forced[page] = false;
+}
+
+void ssd1306_fb_init(ssd1306_fb_t *fb) {
+    memset(fb, 0, sizeof(*fb));
+    ssd1306_fb_invalidate(fb);
+}
+
+void ssd1306_fb_invalidate(ssd1306_fb_t *fb) {
+    for (int page = 0; page < SSD1306_FB_PAGES; page++) {
+        fb->forced[page] = true;
+        fb->dirty_min[page] = 0;
+        fb->dirty_max[page] = SSD1306_FB_WIDTH - 1;
+    }
+}
+
+void ssd1306_fb_write(ssd1306_fb_t *fb, int page, int x, const uint8_t *data, size_t len) {
+    if (page < 0 || page >= SSD1306_FB_PAGES || x >= SSD1306_FB_WIDTH || data == NULL || len == 0) {
+        return;
+    }
+    if (x < 0) {
+        if ((size_t)-x >= len) {
+            return;
+        }
+        data += -x;
+        len -= (size_t)-x;
+        x = 0;
+    }
+    if (len > (size_t)(SSD1306_FB_WIDTH - x)) {
+        len = (size_t)(SSD1306_FB_WIDTH - x);
+    }
+    memcpy(&fb->draw[page * SSD1306_FB_WIDTH + x], data, len);
+    mark_dirty(fb, page, x, x + (int)len - 1);
+}
+
+void ssd1306_fb_fill_page(ssd1306_fb_t *fb, int page, uint8_t value) {
+    if (page < 0 || page >= SSD1306_FB_PAGES) {
+        return;
+    }
+    memset(&fb->draw[page * SSD1306_FB_WIDTH], value, SSD1306_FB_WIDTH);
+    mark_dirty(fb, page, 0, SSD1306_FB_WIDTH - 1);
+}
+
+void ssd1306_fb_fill(ssd1306_fb_t *fb, uint8_t value) {
+    for (int page = 0; page < SSD1306_FB_PAGES; page++) {
+        ssd1306_fb_fill_page(fb, page, value);
+    }
+}
+
+bool ssd1306_fb_dirty(const ssd1306_fb_t *fb) {
+    for (int page = 0; page < SSD1306_FB_PAGES; page++) {
+        if (fb->dirty_min[page] <= fb->dirty_max[page]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ssd1306_fb_take_span(ssd1306_fb_t *fb, ssd1306_span_t *span, uint8_t *out) {
+    for (int page = 0; page < SSD1306_FB_PAGES; page++) {
+        int min = fb->dirty_min[page];
+        int max = fb->dirty_max[page];
+        if (min > max) {
+            continue;
+        }
+        const uint8_t *draw = &fb->draw[page * SSD1306_FB_WIDTH];
+        uint8_t *shown = &fb->shown[page * SSD1306_FB_WIDTH];
+
+        int first = min;
+        int last = max;
+        if (!fb->forced[page]) {
+            while (first <= max && draw[first] == shown[first]) {
+                first++;
+            }
+            if (first > max) {
+                mark_clean(fb, page);
+                continue;
+            }
+            //extend over changes, through gaps cheaper to resend than a new window
+            last = first;
+            int gap = 0;
+            for (int col = first + 1; col <= max && gap < SSD1306_FB_SPAN_OVERHEAD; col++) {
+                if (draw[col] != shown[col]) {
+                    last = col;
+                    gap = 0;
+                } else {
+                    gap++;
+                }
+            }
+        }
+
+        int len = last - first + 1;
+        memcpy(out, &draw[first], (size_t)len);
+        memcpy(&shown[first], &draw[first], (size_t)len);
+        if (last >= max) {
+            mark_clean(fb, page);
+        } else {
+            fb->dirty_min[page] = (uint8_t)(last + 1);
+        }
+
+        span->page = (uint8_t)page;
+        span->col = (uint8_t)first;
+        span->len = (uint8_t)len;
+        fb->stats.spans++;
+        fb->stats.bytes_data += (uint32_t)len;
+        fb->stats.bytes_bus += (uint32_t)len + SSD1306_FB_SPAN_OVERHEAD;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,77 @@
+#ifndef SSD1306_FB_H_
+#define SSD1306_FB_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Shadow framebuffer of the SSD1306: drawing goes to `draw`, `shown` is what
+// the screen holds. Every page keeps the column range touched since its last
+// flush; a flush compares both buffers in that range only and sends the
+// changed bytes as spans, one column/page address window each
+// (0x21 start end, 0x22 page page, then the data).
+// Unchanged gaps shorter than a window's cost are sent within the span.
+// Pure code (no I2C, no FreeRTOS) so it can be run on the host.
+
+#define SSD1306_FB_WIDTH 128
+#define SSD1306_FB_PAGES 8
+
+// Bytes on the bus for one span besides its data: [addr][0x00][0x21 c0 c1 0x22 p p],
+// then [addr][0x40] before the data
+#define SSD1306_FB_SPAN_OVERHEAD 10
+// Bytes on the bus for the former full flush: per page [addr][0x00][0xB0|p 0x00 0x10]
+// then [addr][0x40][128 bytes]
+#define SSD1306_FB_FULL_FLUSH_BYTES (SSD1306_FB_PAGES * (5 + 2 + SSD1306_FB_WIDTH))
+
+typedef struct {
+    uint8_t page;
+    uint8_t col;        // first column
+    uint8_t len;        // 1..SSD1306_FB_WIDTH
+} ssd1306_span_t;
+
+typedef struct {
+    uint32_t spans;
+    uint32_t bytes_data;
+    uint32_t bytes_bus; // data + SSD1306_FB_SPAN_OVERHEAD per span
+} ssd1306_fb_stats_t;
+
+typedef struct {
+    uint8_t draw[SSD1306_FB_PAGES * SSD1306_FB_WIDTH];
+    uint8_t shown[SSD1306_FB_PAGES * SSD1306_FB_WIDTH];
+    uint8_t dirty_min[SSD1306_FB_PAGES];  // dirty_min > dirty_max: clean page
+    uint8_t dirty_max[SSD1306_FB_PAGES];
+    bool forced[SSD1306_FB_PAGES];        // screen content unknown, sent whole
+    ssd1306_fb_stats_t stats;
+} ssd1306_fb_t;
+
+/**
+ * Blank framebuffer, every page forced: the first flush sends the whole screen.
+ */
+void ssd1306_fb_init(ssd1306_fb_t *fb);
+
+/**
+ * The screen content is unknown (reset, other writer): everything is sent again.
+ */
+void ssd1306_fb_invalidate(ssd1306_fb_t *fb);
+
+/**
+ * Write `len` bytes (one column each) from column `x` of `page`, clipped.
+ */
+void ssd1306_fb_write(ssd1306_fb_t *fb, int page, int x, const uint8_t *data, size_t len);
+
+void ssd1306_fb_fill_page(ssd1306_fb_t *fb, int page, uint8_t value);
+
+void ssd1306_fb_fill(ssd1306_fb_t *fb, uint8_t value);
+
+/** @return true if a flush would send something (dirty ranges, not diffed) */
+bool ssd1306_fb_dirty(const ssd1306_fb_t *fb);
+
+/**
+ * Next changed span: its bytes are copied to `out` (SSD1306_FB_WIDTH bytes)
+ * and considered shown. Call until it returns false to flush everything.
+ *
+ * @return false if nothing changed
+ */
+bool ssd1306_fb_take_span(ssd1306_fb_t *fb, ssd1306_span_t *span, uint8_t *out);
+
+#endif
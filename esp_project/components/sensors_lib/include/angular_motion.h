@@ -0,0 +1,78 @@
+#ifndef ANGULAR_MOTION_H_
+#define ANGULAR_MOTION_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Common position/velocity/acceleration layer for angular sensors, fed
+// either with an absolute angle that wraps every revolution (AS5600) or
+// with an unbounded relative count (KY-040 on PCNT). Pure code (no I2C,
+// no PCNT, no FreeRTOS) so unwrapping and differentiation can be run on
+// the host against synthetic angle sequences.
+//
+// Velocity is the filtered derivative of the unwrapped position, and
+// acceleration the filtered derivative of that velocity; both filters are
+// first-order low-passes y += alpha * (x - y), alpha in (0, 1].
+
+// Angular frame payload (little-endian), sent after the usual telemetry
+// header as SENSOR_TYPE_ANGULAR:
+// [0] = source sensor type (SENSOR_TYPE_AS5600, SENSOR_TYPE_KY040, ...),
+// [1..4] = position in 1/100 degree (int32, unwrapped: keeps counting
+// past 360), [5..8] = velocity in 1/100 degree/s (int32),
+// [9..12] = acceleration in 1/100 degree/s^2 (int32).
+#define ANGULAR_FRAME_SIZE (sizeof(uint8_t) + 3 * sizeof(int32_t))
+
+typedef struct {
+    int32_t counts_per_rev; // raw counts for one full turn (4096 for the AS5600)
+    float velocity_alpha;
+    float accel_alpha;
+} angular_motion_config_t;
+
+typedef struct {
+    angular_motion_config_t cfg;
+    bool primed;
+    int32_t last_raw;      // last absolute reading, for unwrapping
+    int64_t position;      // unwrapped position, in counts
+    int64_t last_time_us;
+    float velocity_dps;    // filtered, degrees/s
+    float accel_dps2;      // filtered, degrees/s^2
+} angular_motion_t;
+
+/**
+ * Shortest signed step between two absolute readings of a sensor that wraps
+ * every `counts_per_rev` counts, e.g. 4090 -> 5 is +11, not -4085.
+ * Only correct if the shaft turned less than half a turn between the two
+ * readings, which sets the minimum sampling rate.
+ */
+int32_t angular_unwrap_delta(int32_t previous, int32_t current, int32_t counts_per_rev);
+
+/**
+ * @return false if the configuration is out of range
+ */
+bool angular_motion_init(angular_motion_t *motion, const angular_motion_config_t *cfg);
+
+/** Feed an absolute reading in [0, counts_per_rev), unwrapped internally. */
+void angular_motion_push_absolute(angular_motion_t *motion, int32_t raw, int64_t time_us);
+
+/** Feed an already unbounded position in counts (e.g. accumulated PCNT count). */
+void angular_motion_push_position(angular_motion_t *motion, int64_t position, int64_t time_us);
+
+/**
+ * The shaft is known to be at rest (e.g. no count for a whole period):
+ * clear the filtered velocity and acceleration instead of letting them
+ * decay, the position is kept.
+ */
+void angular_motion_stop(angular_motion_t *motion);
+
+/** Unwrapped position, in degrees. */
+float angular_motion_position_deg(const angular_motion_t *motion);
+
+/**
+ * Pack the current state into `buf` (see ANGULAR_FRAME_SIZE).
+ *
+ * @return number of bytes written, or 0 if `len` is too small
+ */
+size_t angular_motion_frame_pack(const angular_motion_t *motion, uint8_t source, uint8_t *buf, size_t len);
+
+#endif // ANGULAR_MOTION_H_
@@ -5,12 +5,27 @@
 
 // AS5600: 12-bit magnetic rotary position sensor over I2C.
 // Reads the ANGLE register (0x0E, post-filter output) — NOT RAW_ANGLE
-// (0x0C) — and sends the 2 raw register bytes over the wire as-is,
-// matching the original firmware exactly (no masking/repacking on-device).
+// (0x0C) — at a high rate, and feeds it to the angular layer
+// (angular_motion.h) which unwraps it past 360 degrees and derives
+// velocity and acceleration. Telemetry is a SENSOR_TYPE_ANGULAR frame,
+// sent only when the angle changed (deadband) or as a heartbeat.
 #define AS5600_I2C_ADDR 0x36
 #define AS5600_REG_ANGLE 0x0E
-#define AS5600_PERIOD_MS 100
+#define AS5600_SAMPLE_PERIOD_US 2000 // 500Hz: unwrapping holds up to 250 turns/s
+#define AS5600_PERIOD_MS 100         // minimum interval between two frames
+#define AS5600_HEARTBEAT_MS 1000     // maximum interval between two frames
+#define AS5600_DEADBAND_DEG 0.5f
+#define AS5600_VELOCITY_ALPHA 0.1f
+#define AS5600_ACCEL_ALPHA 0.02f
 
 esp_err_t init_as5600(void);
 
+/**
+ * Latest unwrapped angle and filtered velocity, for closed-loop use (e.g.
+ * steering feedback) without going through telemetry.
+ *
+ * @return ESP_ERR_INVALID_STATE until the first sample was read
+ */
+esp_err_t as5600_get_angle(float *position_deg, float *velocity_dps);
+
 #endif // AS5600_H_
@@ -4,11 +4,17 @@
 #include <esp_err.h>
 
 // DS18B20: 1-Wire digital temperature sensor.
-// Bit-banged manually (not via RMT) with critical sections around each
-// bit's precise timing, matching the original firmware exactly — this
-// sensor was entirely missing from the first pass of this refactor.
-// Payload: 16-bit big-endian temperature * 100 (e.g. 24.37C -> 2437).
+// Driven through the RMT 1-Wire master (peripherals/onewire_bus.h), so the
+// slot timings no longer need critical sections. Every DS18B20 found on the
+// bus at boot is read: one SKIP ROM + CONVERT T for all of them, a sleep
+// during the conversion, then MATCH ROM + READ SCRATCHPAD for each.
+// Payload: 16-bit big-endian temperature * 100 (e.g. 24.37C -> 2437),
+// then the device index on the bus and its 8-byte ROM code.
 #define DS18B20_GPIO 23 // shared with several other test sensors, see note in sensors_lib.c
+#define DS18B20_MAX_DEVICES 8
+#define DS18B20_CONVERSION_MS 750 // 12-bit conversion time
+#define DS18B20_PERIOD_MS 1000
+#define DS18B20_PAYLOAD_SIZE (2 + 1 + 8)
 
 esp_err_t init_ds18b20(void);
 
@@ -7,10 +7,9 @@
 // sensor (magnet pass detection). Event-driven: a UDP frame is sent only
 // when a new magnet pass is detected (not periodically), matching the
 // original firmware. Payload: [signal_count: u64][signal_duration_us: i64].
-#define KY035_ADC_UNIT ADC_UNIT_1
 #define KY035_ADC_CHANNEL ADC_CHANNEL_6 // GPIO34 on ESP32
 #define KY035_THRESHOLD_RAW 1800
-#define KY035_POLL_PERIOD_MS 10
+#define KY035_POLL_PERIOD_MS 10 // output period of the shared ADC engine (averaged in between)
 
 esp_err_t init_ky035(void);
 
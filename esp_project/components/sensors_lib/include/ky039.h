@@ -4,11 +4,15 @@
 #include <esp_err.h>
 
 // KY-039: optical heartbeat (IR photoplethysmography) sensor, analog output.
-// Sends the raw ADC reading as int32_t (no unit conversion), matching the
-// original firmware exactly.
-#define KY039_ADC_UNIT ADC_UNIT_1
+// Payload: [filtered ADC value: i32][heart rate in bpm: u16]. The value is
+// the raw ADC scale (no unit conversion) after the shared ADC engine's
+// CIC filter; bpm stays 0 unless CONFIG_KY039_HEART_RATE is enabled and
+// at least two beats were seen.
 #define KY039_ADC_CHANNEL ADC_CHANNEL_4 // GPIO32
 #define KY039_PERIOD_MS 50
+#define KY039_FILTER_RATE_HZ 100
+#define KY039_BEAT_HYSTERESIS 20       // raw ADC units above baseline
+#define KY039_BEAT_MIN_INTERVAL_MS 300 // caps detection at 200 bpm
 
 esp_err_t init_ky039(void);
 
@@ -12,6 +12,14 @@
 #define KY040_CLK_GPIO 23
 #define KY040_DT_GPIO  21
 #define KY040_SW_GPIO  22
+#define KY040_PERIOD_MS 20
+
+// Position/velocity/acceleration (see angular_motion.h). The PCNT counts
+// every edge of both channels, 4 counts per detent, 20 detents per turn.
+// The count keeps going past the PCNT limits (watch-point accumulation).
+#define KY040_COUNTS_PER_REV 80
+#define KY040_VELOCITY_ALPHA 0.5f
+#define KY040_ACCEL_ALPHA 0.3f
 
 esp_err_t init_ky040(void);
 
@@ -0,0 +1,102 @@
+#ifndef PERIPHERALS_ADC_FILTER_H_
+#define PERIPHERALS_ADC_FILTER_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+// Per-channel decimation filters for the continuous ADC engine (see
+// adc_helper.h), plus a beat detector for pulse-style signals (KY-039).
+// Pure integer code, no ESP-IDF dependency, so it can be built and
+// exercised on the host as-is.
+//
+// Every filter takes samples at the channel's raw rate and produces one
+// output every `decimation` inputs:
+// - MOVING_AVG: average of the last `decimation` samples (integrate & dump)
+// - CIC: `order`-stage cascaded integrator-comb, normalized by its gain;
+//   better alias rejection than a plain average for the same cost
+// - IIR: first-order low-pass y += (x - y) / 2^iir_shift, run on every
+//   input and sampled every `decimation` inputs
+// Any of them can be preceded by a median of 3 at the raw rate, which drops
+// single-sample spikes (ADC glitches) before they reach the average.
+
+#define ADC_FILTER_CIC_MAX_ORDER 3
+
+typedef enum {
+    ADC_FILTER_NONE = 0,
+    ADC_FILTER_MOVING_AVG,
+    ADC_FILTER_CIC,
+    ADC_FILTER_IIR,
+} adc_filter_type_t;
+
+typedef struct {
+    adc_filter_type_t type;
+    uint16_t decimation; // inputs per output, >= 1
+    uint8_t order;       // CIC stages, 1..ADC_FILTER_CIC_MAX_ORDER
+    uint8_t iir_shift;   // IIR smoothing, alpha = 1 / 2^iir_shift (0..15)
+    bool median3;        // median of the last 3 raw samples before the filter
+} adc_filter_config_t;
+
+typedef struct {
+    adc_filter_config_t cfg;
+    uint16_t count;
+    int64_t acc;                                       // MOVING_AVG sum
+    uint64_t integrators[ADC_FILTER_CIC_MAX_ORDER];    // CIC, wrap-around on purpose
+    uint64_t comb_delay[ADC_FILTER_CIC_MAX_ORDER];
+    uint64_t cic_gain;                                 // decimation^order
+    int32_t iir_q16;                                   // IIR state, Q16.16 (inputs must fit in 15 bits)
+    bool iir_primed;
+    int32_t median_hist[2];                            // median3, two previous raw samples
+    uint8_t median_count;
+} adc_filter_t;
+
+/**
+ * Reset a filter and apply its configuration.
+ *
+ * @return false if the configuration is out of range
+ */
+bool adc_filter_init(adc_filter_t *filter, const adc_filter_config_t *cfg);
+
+/**
+ * Feed one raw sample.
+ *
+ * @param out  written with the filtered value when an output is produced
+ * @return true when this sample completed a decimation period
+ */
+bool adc_filter_push(adc_filter_t *filter, int32_t sample, int32_t *out);
+
+/**
+ * Beat (peak) detector for a pulse-like signal already low-passed by an
+ * adc_filter_t: tracks a slow baseline, counts a beat on each rising
+ * crossing of baseline + hysteresis, and turns the interval between two
+ * beats into beats per minute. Crossings closer than the refractory
+ * period are ignored (dicrotic notch, noise).
+ */
+typedef struct {
+    uint32_t sample_rate_hz;
+    int32_t hysteresis;
+    uint32_t refractory_samples;
+    int32_t baseline_q8;
+    bool baseline_primed;
+    bool above;
+    uint32_t samples_since_beat;
+    bool has_previous_beat;
+    uint16_t bpm;
+} adc_beat_detector_t;
+
+/**
+ * @param sample_rate_hz   rate of the values that will be pushed
+ * @param hysteresis       raw units above the baseline needed to count a beat
+ * @param min_interval_ms  refractory period (e.g. 300ms caps at 200 bpm)
+ */
+void adc_beat_detector_init(adc_beat_detector_t *det, uint32_t sample_rate_hz,
+    int32_t hysteresis, uint32_t min_interval_ms);
+
+/**
+ * Feed one filtered value.
+ *
+ * @param bpm  written with the latest rate when a beat is detected
+ * @return true when this value is a new beat (and bpm is meaningful)
+ */
+bool adc_beat_detector_push(adc_beat_detector_t *det, int32_t value, uint16_t *bpm);
+
+#endif // PERIPHERALS_ADC_FILTER_H_
@@ -6,11 +6,16 @@
 #include "esp_adc/adc_oneshot.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_continuous.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "peripherals/adc_filter.h"
 
-// Generic building blocks for ADC-based sensors: single-shot polled reads
-// (photoresistors, analog hall sensors, heartbeat sensors...) and
-// continuous DMA-driven reads (multi-axis joysticks, anything needing two
-// channels sampled together at a fixed rate).
+// Generic building blocks for ADC-based sensors: single-shot polled reads,
+// continuous DMA-driven reads of two channels, and a shared continuous
+// engine (adc_stream_xxx) that samples every registered analog sensor
+// channel by DMA and hands each consumer a filtered, decimated value at the
+// rate it asked for. The engine owns ADC1 once started: sensors using it
+// must not also open a one-shot or dual-channel handle on the same unit.
 
 /**
  * Opaque handle for a one-shot single-channel ADC read, with optional
@@ -69,4 +74,54 @@ esp_err_t adc_continuous_dual_init(adc_continuous_dual_t *sensor, uint32_t sampl
  */
 esp_err_t adc_continuous_dual_read(adc_continuous_dual_t *sensor, int *raw_a, int *raw_b);
 
+/**
+ * Total conversion rate of the shared engine, split evenly across every
+ * registered channel (the hardware scans the channel pattern in turn).
+ */
+#define ADC_ENGINE_SAMPLE_FREQ_HZ 20000
+#define ADC_ENGINE_MAX_STREAMS 8
+
+/**
+ * One consumer channel of the shared continuous engine. Fill channel,
+ * atten, output_rate_hz and filter (type/order/iir_shift; decimation is
+ * derived from the rates at start) before registering.
+ */
+typedef struct {
+    adc_channel_t channel;
+    adc_atten_t atten;
+    uint32_t output_rate_hz;
+    adc_filter_config_t filter;
+    // Runtime state, owned by the engine
+    adc_filter_t state;
+    SemaphoreHandle_t ready_sem;
+    volatile int32_t value;
+    volatile uint32_t sequence; // incremented on every new filtered value
+} adc_stream_t;
+
+/**
+ * Add a channel to the shared engine. Must be called before
+ * adc_stream_engine_start() (sensors do it from their init function).
+ */
+esp_err_t adc_stream_register(adc_stream_t *stream);
+
+/**
+ * Configure the DMA pattern for every registered channel and start the
+ * engine task. No-op returning ESP_ERR_NOT_FOUND if nothing was registered.
+ */
+esp_err_t adc_stream_engine_start(void);
+
+/**
+ * Block until the stream produces its next filtered value.
+ *
+ * @return ESP_OK with *value set, or ESP_ERR_TIMEOUT
+ */
+esp_err_t adc_stream_wait(adc_stream_t *stream, TickType_t timeout_ticks, int32_t *value);
+
+/**
+ * Latest filtered value without blocking.
+ *
+ * @return ESP_ERR_INVALID_STATE if no value was produced yet
+ */
+esp_err_t adc_stream_read_latest(adc_stream_t *stream, int32_t *value);
+
 #endif // PERIPHERALS_ADC_HELPER_H_
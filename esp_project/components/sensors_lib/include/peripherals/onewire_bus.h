@@ -0,0 +1,61 @@
+#ifndef PERIPHERALS_ONEWIRE_BUS_H_
+#define PERIPHERALS_ONEWIRE_BUS_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include "peripherals/rmt_helper.h"
+#include "peripherals/onewire_rom.h"
+
+// 1-Wire master on top of the RMT helpers: an open-drain TX channel
+// generates the reset pulse and the time slots, and an RX channel on the
+// same GPIO captures the line to read presence and data bits back. The
+// timings are produced by the peripheral, so no critical section or busy
+// wait is needed, unlike a bit-banged bus.
+
+#define ONEWIRE_CMD_SEARCH_ROM 0xF0
+#define ONEWIRE_CMD_MATCH_ROM 0x55
+#define ONEWIRE_CMD_SKIP_ROM 0xCC
+
+typedef struct {
+    rmt_tx_helper_t tx;
+    rmt_rx_helper_t rx;
+    int gpio_num;
+} onewire_bus_t;
+
+/**
+ * Set up the RX and TX channels on the bus pin (internal pull-up enabled).
+ */
+esp_err_t onewire_bus_init(onewire_bus_t *bus, int gpio_num);
+
+/**
+ * Send a reset pulse and look for a presence pulse.
+ *
+ * @return ESP_OK if at least one device answered, ESP_ERR_NOT_FOUND if
+ *         nobody did, or the RMT error
+ */
+esp_err_t onewire_bus_reset(onewire_bus_t *bus);
+
+esp_err_t onewire_bus_write_bytes(onewire_bus_t *bus, const uint8_t *data, size_t len);
+esp_err_t onewire_bus_read_bytes(onewire_bus_t *bus, uint8_t *data, size_t len);
+
+esp_err_t onewire_bus_write_bit(onewire_bus_t *bus, uint8_t bit);
+esp_err_t onewire_bus_read_bit(onewire_bus_t *bus, uint8_t *bit);
+
+/**
+ * Reset the bus and address one device: MATCH ROM with its code, or
+ * SKIP ROM (every device) if rom is NULL. The function command follows.
+ */
+esp_err_t onewire_bus_select(onewire_bus_t *bus, const uint8_t *rom);
+
+/**
+ * Enumerate the devices on the bus (SEARCH ROM).
+ *
+ * @param roms       filled with up to max_roms CRC-checked ROM codes
+ * @param found      written with the number of codes stored
+ * @return ESP_OK (even with 0 device), or the first bus error
+ */
+esp_err_t onewire_bus_search(onewire_bus_t *bus, uint8_t (*roms)[ONEWIRE_ROM_SIZE],
+    size_t max_roms, size_t *found);
+
+#endif // PERIPHERALS_ONEWIRE_BUS_H_
@@ -0,0 +1,58 @@
+#ifndef PERIPHERALS_ONEWIRE_ROM_H_
+#define PERIPHERALS_ONEWIRE_ROM_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// 1-Wire ROM codes: Maxim CRC8 and the SEARCH ROM binary tree walk
+// (Maxim application note 187). No bus access here: the search is driven
+// through two bit callbacks, so the algorithm can be run on the host
+// against a simulated bus as well as on the RMT driver (onewire_bus.h).
+
+#define ONEWIRE_ROM_SIZE 8 // family code, 48-bit serial, CRC8
+
+/** Maxim/Dallas CRC8 (polynomial x^8 + x^5 + x^4 + 1), 0 over a full valid ROM. */
+uint8_t onewire_crc8(const uint8_t *data, size_t len);
+
+/** True if the last byte of the ROM code is the CRC8 of the first seven. */
+bool onewire_rom_is_valid(const uint8_t rom[ONEWIRE_ROM_SIZE]);
+
+/**
+ * Read one time slot from the bus.
+ * @return false on a bus error (aborts the search)
+ */
+typedef bool (*onewire_read_bit_fn)(void *ctx, uint8_t *bit);
+
+/**
+ * Write one time slot to the bus.
+ * @return false on a bus error (aborts the search)
+ */
+typedef bool (*onewire_write_bit_fn)(void *ctx, uint8_t bit);
+
+typedef enum {
+    ONEWIRE_SEARCH_FOUND = 0,  // rom holds a new, CRC-checked device
+    ONEWIRE_SEARCH_DONE,       // every device has been enumerated
+    ONEWIRE_SEARCH_NO_DEVICE,  // nobody answered the first bit
+    ONEWIRE_SEARCH_CRC_ERROR,  // a ROM was read but failed its CRC
+    ONEWIRE_SEARCH_BUS_ERROR,  // a bit callback failed
+} onewire_search_result_t;
+
+typedef struct {
+    uint8_t rom[ONEWIRE_ROM_SIZE];
+    uint8_t last_discrepancy; // 1-based bit position of the last 0-branch taken, 0 = none
+    bool last_device;
+} onewire_search_t;
+
+/** Restart the enumeration from the first device. */
+void onewire_search_init(onewire_search_t *search);
+
+/**
+ * Walk the 64 bits of the next ROM code. The caller must have sent a
+ * reset and the SEARCH ROM (0xF0) command just before; after a FOUND
+ * result, call again (new reset + command) to get the following device.
+ */
+onewire_search_result_t onewire_search_next(onewire_search_t *search,
+    onewire_read_bit_fn read_bit, onewire_write_bit_fn write_bit, void *ctx);
+
+#endif // PERIPHERALS_ONEWIRE_ROM_H_
@@ -2,6 +2,7 @@
 #define PERIPHERALS_PCNT_ENCODER_H_
 
 #include <inttypes.h>
+#include <stdbool.h>
 #include <esp_err.h>
 #include "driver/pulse_cnt.h"
 #include <soc/gpio_num.h>
@@ -61,6 +62,7 @@ typedef struct {
     int32_t high_limit;
     int32_t low_limit;
     uint32_t glitch_filter_ns;
+    bool accumulate; // keep counting past the limits (see pcnt_quadrature_read)
 } pcnt_quadrature_t;
 
 /**
@@ -76,4 +78,12 @@ esp_err_t pcnt_quadrature_init(pcnt_quadrature_t *encoder);
  */
 esp_err_t pcnt_quadrature_drain(pcnt_quadrature_t *encoder, int32_t *delta);
 
+/**
+ * Read the absolute position without resetting it. With `accumulate` set,
+ * the high/low limits are registered as watch points and the driver adds
+ * the limit to a software accumulator each time the hardware counter wraps,
+ * so the position is unbounded instead of restarting from 0 at the limits.
+ */
+esp_err_t pcnt_quadrature_read(pcnt_quadrature_t *encoder, int32_t *position);
+
 #endif // PERIPHERALS_PCNT_ENCODER_H_
@@ -21,6 +21,7 @@
 typedef struct {
     rmt_channel_handle_t channel;
     SemaphoreHandle_t done_sem;
+    volatile size_t received_symbols; // symbols in the last completed capture
 } rmt_rx_helper_t;
 
 /**
@@ -48,6 +49,22 @@ esp_err_t rmt_rx_helper_init(rmt_rx_helper_t *helper, int gpio_num,
 esp_err_t rmt_rx_helper_capture(rmt_rx_helper_t *helper, rmt_symbol_word_t *buffer,
     size_t buffer_size, uint32_t signal_min_ns, uint32_t signal_max_ns, TickType_t wait_ticks);
 
+/**
+ * Arm a capture without waiting for it, so that a TX channel looped back on
+ * the same GPIO can generate the waveform to be captured (1-Wire).
+ * Parameters are the same as rmt_rx_helper_capture().
+ */
+esp_err_t rmt_rx_helper_start(rmt_rx_helper_t *helper, rmt_symbol_word_t *buffer,
+    size_t buffer_size, uint32_t signal_min_ns, uint32_t signal_max_ns);
+
+/**
+ * Wait for a capture armed with rmt_rx_helper_start() to complete.
+ *
+ * @param symbol_count  written with the number of captured symbols (may be NULL)
+ * @return ESP_OK if a capture completed, ESP_ERR_TIMEOUT otherwise
+ */
+esp_err_t rmt_rx_helper_wait(rmt_rx_helper_t *helper, TickType_t wait_ticks, size_t *symbol_count);
+
 /**
  * Opaque handle for an RMT TX channel with a raw copy encoder — suitable for
  * any protocol where the caller builds the exact symbol sequence itself
@@ -56,6 +73,7 @@ esp_err_t rmt_rx_helper_capture(rmt_rx_helper_t *helper, rmt_symbol_word_t *buff
 typedef struct {
     rmt_channel_handle_t channel;
     rmt_encoder_handle_t encoder;
+    uint8_t idle_level; // level held once a transmission is over
 } rmt_tx_helper_t;
 
 /**
@@ -74,9 +92,31 @@ esp_err_t rmt_tx_helper_init(rmt_tx_helper_t *helper, int gpio_num,
     uint32_t resolution_hz, size_t mem_block_symbols,
     uint32_t carrier_freq_hz, float carrier_duty_cycle);
 
+/**
+ * Configure an open-drain RMT TX channel on a bidirectional bus line
+ * (1-Wire): the output is looped back into the GPIO input so that an RX
+ * channel on the same pin captures both what is sent and what the devices
+ * answer, and the line is released (high) between transmissions.
+ * The RX channel must be created first, on the same GPIO.
+ *
+ * @param helper             handle to initialize
+ * @param gpio_num           bus pin, shared with the RX channel
+ * @param resolution_hz      tick resolution (e.g. 1000000 for 1 tick = 1us)
+ * @param mem_block_symbols  internal RMT memory block size, in symbols
+ */
+esp_err_t rmt_tx_helper_init_open_drain(rmt_tx_helper_t *helper, int gpio_num,
+    uint32_t resolution_hz, size_t mem_block_symbols);
+
 /**
  * Transmit a raw symbol buffer once (no looping).
  */
 esp_err_t rmt_tx_helper_transmit(rmt_tx_helper_t *helper, const rmt_symbol_word_t *symbols, size_t symbol_count);
 
+/**
+ * Block until every queued transmission is done.
+ *
+ * @param timeout_ms  how long to wait, -1 to wait forever
+ */
+esp_err_t rmt_tx_helper_wait(rmt_tx_helper_t *helper, int timeout_ms);
+
 #endif // PERIPHERALS_RMT_HELPER_H_
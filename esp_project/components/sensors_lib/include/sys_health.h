@@ -0,0 +1,42 @@
+#ifndef SYS_HEALTH_H_
+#define SYS_HEALTH_H_
+
+#include <esp_err.h>
+#include "task_load.h"
+
+// ESP: health of the board itself, sampled every CONFIG_ESP_HEALTH_PERIOD_MS
+// and sent as one SENSOR_TYPE_ESP frame. Payload (little-endian):
+// [0..37] = base layout, read as is by the station:
+//   [0..3] = chip temperature (float, C), [4] = RSSI (int8, dBm),
+//   [5] = reset reason (esp_reset_reason_t),
+//   [6..9] / [10..13] = internal heap free / largest free block,
+//   [14..17] / [18..21] = PSRAM free / largest free block,
+//   [22] = servo angle, [23..24] = motor (int16), [25..28] = command packets received,
+//   [29..32] / [33..36] = core 0 / core 1 load (float, %), [37] = drive mode.
+// [38..] = extension, ignored by readers of the base layout:
+//   [38] = SYS_HEALTH_VERSION,
+//   [39..42] / [43..46] = internal heap / PSRAM minimum free since boot,
+//   [47..70] = UDP link: tx frames, tx bytes, tx errors, tx dropped, rx frames,
+//              rx bytes (udp_stats_t, uint32 each),
+//   [71..74] = Wi-Fi reconnects,
+//   [75] = queue count q, then q records [queue id][waiting][length]
+//          (queue id: SYS_HEALTH_QUEUE_UDP | udp_channel_t, SYS_HEALTH_QUEUE_ESPNOW | espnow_queue_t),
+//   then task count n, then n records
+//          [task number u16][core, 0xFF: any][priority][eTaskState]
+//          [load u16, per-mille of one core, SYS_HEALTH_LOAD_UNKNOWN without run time stats]
+//          [stack high-water mark u16, bytes][name length][name, no terminator].
+// Tasks need CONFIG_FREERTOS_USE_TRACE_FACILITY (n = 0 without), loads
+// CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+#define SYS_HEALTH_BASE_SIZE 38
+#define SYS_HEALTH_VERSION 1
+#define SYS_HEALTH_FIXED_SIZE 76 // base + extension up to the queue count
+#define SYS_HEALTH_QUEUE_RECORD_SIZE 3
+#define SYS_HEALTH_TASK_RECORD_SIZE TASK_LOAD_RECORD_SIZE // without the name, see task_load_encode
+#define SYS_HEALTH_QUEUE_UDP 0x00
+#define SYS_HEALTH_QUEUE_ESPNOW 0x10
+#define SYS_HEALTH_LOAD_UNKNOWN TASK_LOAD_UNKNOWN
+#define SYS_HEALTH_TASK_PRIORITY 10 // above the sensors: a busy task cannot hide by starving the sampler
+
+esp_err_t init_sys_health(void);
+
+#endif // SYS_HEALTH_H_
@@ -0,0 +1,68 @@
+#ifndef TASK_LOAD_H_
+#define TASK_LOAD_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Per task CPU load from two samples of the FreeRTOS run time counters
+// (uxTaskGetSystemState): the run time a task gained between the samples
+// over the time elapsed, in per-mille of one core. On a dual core chip the
+// loads add up to 2000. Tasks are matched by task number, so a deleted task
+// whose handle is reused is not mistaken for the new one; a task created
+// between the samples is charged its whole run time. Counters may wrap.
+// Also encodes the task section of the health frame (sys_health.h).
+// Pure code, no ESP-IDF dependency, so it can be run on the host.
+
+#define TASK_LOAD_MAX_TASKS 48
+#define TASK_LOAD_RECORD_SIZE 10    // task record of the health frame, without the name
+#define TASK_LOAD_UNKNOWN 0xFFFF    // load without run time stats
+
+typedef struct {
+    uint32_t id;        // FreeRTOS task number
+    uint32_t runtime;   // run time counter
+} task_load_sample_t;
+
+// What the health frame tells of a task (from its TaskStatus_t)
+typedef struct {
+    uint32_t id;            // FreeRTOS task number
+    uint8_t core;           // 0xFF: any
+    uint8_t priority;
+    uint8_t state;          // eTaskState
+    uint32_t stack_hwm;     // stack high-water mark, bytes
+    const char *name;
+    size_t name_len;        // without terminator
+} task_load_info_t;
+
+typedef struct {
+    task_load_sample_t prev[TASK_LOAD_MAX_TASKS];
+    size_t prev_count;
+    uint32_t prev_total;
+    bool primed;
+} task_load_t;
+
+void task_load_init(task_load_t *tl);
+
+/**
+ * Take a new sample and compute the load of each of its tasks since the
+ * previous one (samples beyond TASK_LOAD_MAX_TASKS are not remembered and
+ * are charged their whole run time next time).
+ *
+ * @param total_runtime run time counter total of the sample
+ * @param permille      written for each sample, in the same order
+ * @return false on the first sample: no reference yet, nothing written
+ */
+bool task_load_update(task_load_t *tl, const task_load_sample_t *samples, size_t count,
+    uint32_t total_runtime, uint16_t *permille);
+
+/**
+ * Write the task section of the health frame: task count, then one record per
+ * task, in order, while they fit in `capacity` (the count gives those written).
+ *
+ * @param loads per task (per-mille), NULL: TASK_LOAD_UNKNOWN for all
+ * @return bytes written, 0 if `capacity` is 0
+ */
+size_t task_load_encode(const task_load_info_t *tasks, const uint16_t *loads, size_t count,
+    uint8_t *buf, size_t capacity);
+
+#endif // TASK_LOAD_H_
@@ -0,0 +1,74 @@
+#ifndef TELEMETRY_POLICY_H_
+#define TELEMETRY_POLICY_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Change-driven publishing policy for slow sensors (temperature, humidity,
+// pressure, light...): a new reading is only published when one of its
+// values moved by more than a deadband, never faster than a minimum
+// interval, and at least every maximum interval (heartbeat) so the station
+// can tell a stable value from a dead sensor. Optionally, a change is sent
+// as small deltas against the last published values instead of a full
+// frame. Pure code, no ESP-IDF dependency, so the decisions can be
+// exercised on the host with synthetic timestamps.
+
+#define TELEMETRY_POLICY_MAX_VALUES 4
+#define TELEMETRY_DEADBAND_ALWAYS (-1) // publish every reading (no change detection)
+
+typedef struct {
+    // Per value, in the sensor's own units: publish when |value - last
+    // published| > deadband. 0 = any change, TELEMETRY_DEADBAND_ALWAYS =
+    // every reading.
+    int32_t deadband[TELEMETRY_POLICY_MAX_VALUES];
+    uint32_t min_interval_ms; // 0 = no limit
+    uint32_t max_interval_ms; // heartbeat, 0 = never forced
+    bool delta_encoding;      // send changes as int16 deltas when they fit
+} telemetry_policy_config_t;
+
+typedef enum {
+    TELEMETRY_SKIP = 0,   // nothing worth sending
+    TELEMETRY_SEND_FULL,  // send the usual frame
+    TELEMETRY_SEND_DELTA, // send the deltas written by telemetry_policy_evaluate()
+} telemetry_decision_t;
+
+typedef struct {
+    telemetry_policy_config_t cfg;
+    bool has_sent;
+    uint8_t value_count;
+    uint32_t last_sent_ms;
+    int32_t last_sent[TELEMETRY_POLICY_MAX_VALUES];
+    // Statistics since the last telemetry_policy_reset_stats()
+    uint32_t offered;   // readings evaluated
+    uint32_t published; // full frames + deltas
+    uint32_t deltas;
+} telemetry_policy_t;
+
+/** Apply a configuration and forget everything sent so far. */
+void telemetry_policy_init(telemetry_policy_t *policy, const telemetry_policy_config_t *cfg);
+
+/**
+ * Change the configuration at runtime. Statistics are kept; the next
+ * reading is published as a full frame so the station resynchronizes.
+ */
+void telemetry_policy_configure(telemetry_policy_t *policy, const telemetry_policy_config_t *cfg);
+
+/**
+ * Decide what to do with a new reading. When the decision is not SKIP the
+ * reading is recorded as published, so the caller must send it.
+ *
+ * @param values  the reading, `count` <= TELEMETRY_POLICY_MAX_VALUES values
+ * @param now_ms  monotonic time, may wrap
+ * @param deltas  written with value - last published for a SEND_DELTA
+ *                decision, may be NULL (delta encoding is then skipped)
+ */
+telemetry_decision_t telemetry_policy_evaluate(telemetry_policy_t *policy, const int32_t *values,
+    uint8_t count, uint32_t now_ms, int16_t *deltas);
+
+/** Share of readings that were not published, in percent. */
+uint8_t telemetry_policy_suppression_pct(const telemetry_policy_t *policy);
+
+void telemetry_policy_reset_stats(telemetry_policy_t *policy);
+
+#endif // TELEMETRY_POLICY_H_
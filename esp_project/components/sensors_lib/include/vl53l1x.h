@@ -16,6 +16,24 @@
 // and WILL conflict if you enable both at the same time.
 #define VL53L1X_XSHUT_GPIO 27
 
+// GPIO1 is the sensor's "data ready" interrupt output (open-drain, active
+// low with the default configuration table). Ranging is driven by its
+// falling edge instead of polling the status registers over I2C.
+#define VL53L1X_GPIO1_GPIO 14
+
+// Timing budget: one of 15 (short mode only), 20, 33, 50, 100, 200, 500 ms
+// (the values ST's ULD API has encoded macro-periods for). The
+// inter-measurement period must be >= the timing budget.
+#define VL53L1X_TIMING_BUDGET_MS 20
+#define VL53L1X_INTER_MEASUREMENT_MS 100
+
+// Multi-zone mode (CONFIG_VL53L1X_MULTIZONE): grid scanned by moving the
+// ROI center between measurements, see vl53l1x_zones.h. Every zone costs
+// one full measurement, so a sweep lasts ~ZONES * inter-measurement period.
+#define VL53L1X_ZONES_COLS 4
+#define VL53L1X_ZONES_ROWS 4
+#define VL53L1X_ZONES_INTER_MEASUREMENT_MS 25
+
 esp_err_t init_vl53l1x(void);
 
 #endif // VL53L1X_H_
@@ -0,0 +1,75 @@
+#ifndef VL53L1X_ZONES_H_
+#define VL53L1X_ZONES_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Multi-zone scanning for the VL53L1X: the 16x16 SPAD array is split into
+// a cols x rows grid, and the ROI center is moved from zone to zone between
+// two measurements to build a coarse depth map (e.g. 4x4 for obstacle
+// avoidance). Pure logic only (no I2C, no FreeRTOS) so the ROI sequencing
+// and the frame packing can be exercised on the host.
+
+#define VL53L1X_SPAD_GRID 16
+#define VL53L1X_ROI_MIN 4 // smallest ROI side accepted by the sensor
+#define VL53L1X_ZONES_MAX_SIDE (VL53L1X_SPAD_GRID / VL53L1X_ROI_MIN)
+#define VL53L1X_ZONES_MAX (VL53L1X_ZONES_MAX_SIDE * VL53L1X_ZONES_MAX_SIDE)
+
+// Zone frame payload (little-endian), sent after the usual telemetry header:
+// [0] = cols, [1] = rows, [2..3] = valid mask (bit n = zone n),
+// [4..5] = last sweep duration in ms, then cols * rows uint16_t distances
+// in mm, zone n = row * cols + col.
+#define VL53L1X_ZONE_FRAME_HEADER_SIZE (sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint16_t))
+#define VL53L1X_ZONE_FRAME_SIZE(zones) (VL53L1X_ZONE_FRAME_HEADER_SIZE + (zones) * sizeof(uint16_t))
+
+typedef struct {
+    uint8_t cols;
+    uint8_t rows;
+    uint8_t roi_width;   // SPADs per zone, horizontally
+    uint8_t roi_height;  // SPADs per zone, vertically
+    uint8_t zone_count;
+    uint8_t current;     // zone the sensor is ranging right now
+    uint16_t valid_mask; // zones that got a valid range during the current sweep
+    uint8_t centers[VL53L1X_ZONES_MAX];
+    uint16_t distance_mm[VL53L1X_ZONES_MAX];
+} vl53l1x_zone_seq_t;
+
+/**
+ * SPAD number of the (col, row) cell of the 16x16 array, as expected by
+ * ROI_CONFIG__USER_ROI_CENTRE_SPAD (numbering from ST UM2555, 199 being
+ * the optical center).
+ */
+uint8_t vl53l1x_spad_index(uint8_t col, uint8_t row);
+
+/**
+ * Split the SPAD array into a cols x rows grid and precompute every zone's
+ * ROI center. Each side must be in [1, 4] so zones stay >= 4x4 SPADs.
+ *
+ * @return false if the grid is not supported
+ */
+bool vl53l1x_zone_seq_init(vl53l1x_zone_seq_t *seq, uint8_t cols, uint8_t rows);
+
+/**
+ * ROI center of the zone that follows the one currently being ranged,
+ * to be programmed before the interrupt of the current measurement is
+ * cleared.
+ */
+uint8_t vl53l1x_zone_seq_next_center(const vl53l1x_zone_seq_t *seq);
+
+/**
+ * Store the result of the zone currently being ranged and move on to the
+ * next one. Invalid ranges are stored as 0 with their valid bit cleared.
+ *
+ * @return true when this result completed a full sweep of the grid
+ */
+bool vl53l1x_zone_seq_push(vl53l1x_zone_seq_t *seq, uint16_t distance_mm, bool valid);
+
+/**
+ * Pack the last completed sweep into `buf` (see VL53L1X_ZONE_FRAME_SIZE).
+ *
+ * @return number of bytes written, or 0 if `len` is too small
+ */
+size_t vl53l1x_zone_frame_pack(const vl53l1x_zone_seq_t *seq, uint16_t sweep_ms, uint8_t *buf, size_t len);
+
+#endif // VL53L1X_ZONES_H_
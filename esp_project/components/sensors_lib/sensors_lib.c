@@ -2,6 +2,14 @@
 #include "log_lib.h"
 #include <string.h>
 
+#if CONFIG_USE_UDPLIB
+#include "udp_lib.h"
+#endif
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
 // Every sensor's public init function.
 #include "hcsr04.h"
 #include "ina226.h"
@@ -30,6 +38,8 @@
 #include "ky032.h"
 #include "ky023.h"
 #include "ds18b20.h"
+#include "sys_health.h"
+#include "peripherals/adc_helper.h"
 
 static const char *TAG = "sensors_library";
 
@@ -50,6 +60,175 @@ esp_err_t serialize_header(const header_sensor_t *hd, uint8_t *buf) {
     return ESP_OK;
 }
 
+// --- Change-driven publishing ---
+
+#define POLICY_SLOTS 16                 // (type, instance) pairs tracked at once
+#define POLICY_STATS_PERIOD_MS 60000    // suppression ratio logged this often
+
+typedef struct {
+    bool used;
+    uint8_t type;
+    uint8_t instance;
+    uint32_t stats_since_ms;
+    telemetry_policy_t policy;
+} policy_slot_t;
+
+// Defaults for the slow sensors; every other type publishes every reading.
+// Deadbands are in each sensor's own units (see the values it publishes).
+static const struct { sensor_type_t type; telemetry_policy_config_t cfg; } default_policies[] = {
+    // humidity %, temperature C (integers): any change, 1 min heartbeat
+    { SENSOR_TYPE_DHT11,   { .deadband = { 0, 0 }, .max_interval_ms = 60000 } },
+    // pressure Pa, temperature 1/100 C: 0.2hPa / 0.1C
+    { SENSOR_TYPE_BMP,     { .deadband = { 20, 10 }, .min_interval_ms = 500, .max_interval_ms = 60000 } },
+    // temperature 1/100 C: 0.1C
+    { SENSOR_TYPE_DS18B20, { .deadband = { 10 }, .max_interval_ms = 60000 } },
+    // raw light level
+    { SENSOR_TYPE_KY018,   { .deadband = { 20 }, .max_interval_ms = 30000 } },
+};
+
+static portMUX_TYPE policy_lock = portMUX_INITIALIZER_UNLOCKED;
+static telemetry_policy_config_t type_policies[SENSOR_TYPE_MAX];
+static policy_slot_t policy_slots[POLICY_SLOTS];
+
+static void init_policies(void) {
+    telemetry_policy_config_t always = {
+        .deadband = { TELEMETRY_DEADBAND_ALWAYS, TELEMETRY_DEADBAND_ALWAYS,
+                      TELEMETRY_DEADBAND_ALWAYS, TELEMETRY_DEADBAND_ALWAYS },
+    };
+    for (size_t i = 0; i < SENSOR_TYPE_MAX; i++) {
+        type_policies[i] = always;
+    }
+    for (size_t i = 0; i < sizeof(default_policies) / sizeof(default_policies[0]); i++) {
+        type_policies[default_policies[i].type] = default_policies[i].cfg;
+    }
+}
+
+/** Must be called with policy_lock held. */
+static policy_slot_t *find_policy_slot(uint8_t type, uint8_t instance, uint32_t now_ms) {
+    policy_slot_t *free_slot = NULL;
+    for (size_t i = 0; i < POLICY_SLOTS; i++) {
+        if (policy_slots[i].used) {
+            if (policy_slots[i].type == type && policy_slots[i].instance == instance) {
+                return &policy_slots[i];
+            }
+        } else if (free_slot == NULL) {
+            free_slot = &policy_slots[i];
+        }
+    }
+    if (free_slot != NULL) {
+        free_slot->used = true;
+        free_slot->type = type;
+        free_slot->instance = instance;
+        free_slot->stats_since_ms = now_ms;
+        telemetry_policy_init(&free_slot->policy, &type_policies[type]);
+    }
+    return free_slot;
+}
+
+static void send_frame(const uint8_t *frame, size_t len) {
+#if CONFIG_USE_UDPLIB
+    send_udp_sensor(frame, len);
+#else
+    (void)frame;
+    (void)len;
+#endif
+}
+
+esp_err_t sensor_publish(sensor_type_t type, uint8_t instance, const int32_t *values, uint8_t count,
+    const uint8_t *frame, size_t frame_len) {
+    if (type >= SENSOR_TYPE_MAX || values == NULL || frame == NULL
+        || count == 0 || count > TELEMETRY_POLICY_MAX_VALUES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    int16_t deltas[TELEMETRY_POLICY_MAX_VALUES];
+    telemetry_decision_t decision;
+    bool log_stats = false;
+    uint32_t offered = 0, published = 0;
+    uint8_t suppression = 0;
+
+    taskENTER_CRITICAL(&policy_lock);
+    policy_slot_t *slot = find_policy_slot(type, instance, now_ms);
+    if (slot == NULL) {
+        taskEXIT_CRITICAL(&policy_lock);
+        send_frame(frame, frame_len); // pool exhausted: fall back to always publishing
+        return ESP_ERR_NO_MEM;
+    }
+    decision = telemetry_policy_evaluate(&slot->policy, values, count, now_ms, deltas);
+    if (now_ms - slot->stats_since_ms >= POLICY_STATS_PERIOD_MS) {
+        log_stats = true;
+        offered = slot->policy.offered;
+        published = slot->policy.published;
+        suppression = telemetry_policy_suppression_pct(&slot->policy);
+        telemetry_policy_reset_stats(&slot->policy);
+        slot->stats_since_ms = now_ms;
+    }
+    taskEXIT_CRITICAL(&policy_lock);
+
+    if (log_stats) {
+        log_msg(TAG, "Sensor type %d/%u: %" PRIu32 "/%" PRIu32 " readings published (%u%% suppressed)",
+            type, instance, published, offered, suppression);
+    }
+
+    if (decision == TELEMETRY_SEND_FULL) {
+        send_frame(frame, frame_len);
+    } else if (decision == TELEMETRY_SEND_DELTA) {
+        header_sensor_t header = {0};
+        header.esp_id = (uint8_t)CONFIG_ESP_ID;
+        header.timestamp = now_ms;
+        header.type = SENSOR_TYPE_DELTA;
+        uint8_t buf[HEADER_SENSOR_SIZE + SENSOR_DELTA_FRAME_SIZE(TELEMETRY_POLICY_MAX_VALUES)];
+        serialize_header(&header, buf);
+        buf[HEADER_SENSOR_SIZE] = (uint8_t)type;
+        buf[HEADER_SENSOR_SIZE + 1] = instance;
+        buf[HEADER_SENSOR_SIZE + 2] = count;
+        memcpy(&buf[HEADER_SENSOR_SIZE + 3], deltas, count * sizeof(int16_t));
+        send_frame(buf, HEADER_SENSOR_SIZE + SENSOR_DELTA_FRAME_SIZE(count));
+    }
+    return ESP_OK;
+}
+
+esp_err_t sensor_policy_set(sensor_type_t type, const telemetry_policy_config_t *cfg) {
+    if (type >= SENSOR_TYPE_MAX || cfg == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    taskENTER_CRITICAL(&policy_lock);
+    type_policies[type] = *cfg;
+    for (size_t i = 0; i < POLICY_SLOTS; i++) {
+        if (policy_slots[i].used && policy_slots[i].type == type) {
+            telemetry_policy_configure(&policy_slots[i].policy, cfg);
+        }
+    }
+    taskEXIT_CRITICAL(&policy_lock);
+    return ESP_OK;
+}
+
+esp_err_t sensor_policy_apply_config(const uint8_t *buf, size_t len) {
+    if (buf == NULL || len < SENSOR_POLICY_CONFIG_MIN_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t count = buf[10];
+    if (count > TELEMETRY_POLICY_MAX_VALUES || len < SENSOR_POLICY_CONFIG_MIN_SIZE + count * sizeof(int32_t)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    telemetry_policy_config_t cfg = {0};
+    memcpy(&cfg.min_interval_ms, &buf[1], sizeof(uint32_t));
+    memcpy(&cfg.max_interval_ms, &buf[5], sizeof(uint32_t));
+    cfg.delta_encoding = (buf[9] & 0x01) != 0;
+    // Values left out keep a 0 deadband: published on any change.
+    memcpy(cfg.deadband, &buf[SENSOR_POLICY_CONFIG_MIN_SIZE], count * sizeof(int32_t));
+
+    esp_err_t err = sensor_policy_set((sensor_type_t)buf[0], &cfg);
+    if (err == ESP_OK) {
+        log_msg(TAG, "Publishing policy of sensor type %u: min %" PRIu32 "ms, max %" PRIu32 "ms, delta %s",
+            buf[0], cfg.min_interval_ms, cfg.max_interval_ms, cfg.delta_encoding ? "on" : "off");
+    }
+    return err;
+}
+
 // Attempts every sensor's init unconditionally; each returns
 // ESP_ERR_NOT_SUPPORTED when its own CONFIG_USE_xxx is disabled, so no
 // #if guards are needed here — this keeps the orchestrator itself simple
@@ -60,6 +239,7 @@ esp_err_t init_sensors(void) {
         return ESP_ERR_INVALID_STATE;
     }
     sensors_initialized = true;
+    init_policies();
 
     struct { const char *name; esp_err_t (*init_fn)(void); } sensors[] = {
         { "HCSR04 (front+rear)", init_hcsr04 },
@@ -89,6 +269,7 @@ esp_err_t init_sensors(void) {
         { "KY032",          init_ky032 },
         { "KY023",          init_ky023 },
         { "DS18B20",        init_ds18b20 },
+        { "ESP health",     init_sys_health },
     };
 
     for (size_t i = 0; i < sizeof(sensors) / sizeof(sensors[0]); i++) {
@@ -100,5 +281,12 @@ esp_err_t init_sensors(void) {
         }
     }
 
+    // Analog sensors only registered their channels above; the shared
+    // DMA engine can only be configured once all of them are known.
+    esp_err_t err = adc_stream_engine_start();
+    if (err != ESP_OK && err != ESP_ERR_NOT_FOUND) {
+        log_msg(TAG, "Error (%s) starting ADC engine", esp_err_to_name(err));
+    }
+
     return ESP_OK;
 }
\ No newline at end of file
@@ -3,7 +3,9 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <esp_err.h>
+#include "telemetry_policy.h"
 
 // Telemetry frame header shared by every sensor. Wire layout (little-endian):
 // [0] = type, [1] = esp_id, [2..5] = timestamp (uint32_t).
@@ -51,6 +53,12 @@ typedef enum {
     SENSOR_TYPE_BREAK      = 30,
     SENSOR_TYPE_BMP        = 31,
     SENSOR_TYPE_DS18B20    = 32,
+    SENSOR_TYPE_VL53L1X_ZONES = 33,
+    SENSOR_TYPE_ANGULAR    = 34,
+    SENSOR_TYPE_DELTA      = 35,
+    SENSOR_TYPE_GATEWAY    = 36, // batch of ESP-NOW node frames, see espnow_gateway.h
+    SENSOR_TYPE_ZIGBEE     = 37, // ZCL attribute report of a Zigbee device, see zb_bridge.h
+    SENSOR_TYPE_ZIGBEE_DEVICE = 38, // Zigbee device joined/left, see zb_bridge.h
 
     SENSOR_TYPE_MAX
 } sensor_type_t;
@@ -66,6 +74,41 @@ esp_err_t serialize_header(const header_sensor_t *hd, uint8_t *buf);
  */
 esp_err_t init_sensors(void);
 
+// --- Change-driven publishing (see telemetry_policy.h) ---
+
+// Delta frame payload (little-endian), sent as SENSOR_TYPE_DELTA instead of
+// a full frame when the sensor's policy has delta encoding enabled:
+// [0] = original sensor type, [1] = instance, [2] = value count n,
+// then n int16_t deltas against the last published values.
+#define SENSOR_DELTA_FRAME_SIZE(count) (3 + (count) * sizeof(int16_t))
+
+// Runtime policy update (UDP config port, command 4), little-endian:
+// [0] = sensor type, [1..4] = min interval ms, [5..8] = max interval ms,
+// [9] = flags (bit 0: delta encoding), [10] = deadband count n,
+// then n int32_t deadbands.
+#define SENSOR_POLICY_CONFIG_MIN_SIZE 11
+
+/**
+ * Publish a reading through its sensor type's policy: sends `frame` (full
+ * telemetry frame, header included), a delta frame, or nothing.
+ *
+ * @param instance  tells apart several sensors of the same type (e.g. the
+ *                  DS18B20s of one bus), each tracked separately
+ * @param values    the reading's values the policy compares, in sensor units
+ */
+esp_err_t sensor_publish(sensor_type_t type, uint8_t instance, const int32_t *values, uint8_t count,
+    const uint8_t *frame, size_t frame_len);
+
+/**
+ * Replace the publishing policy of a sensor type, for every instance.
+ */
+esp_err_t sensor_policy_set(sensor_type_t type, const telemetry_policy_config_t *cfg);
+
+/**
+ * Parse a runtime policy update (see SENSOR_POLICY_CONFIG_MIN_SIZE) and apply it.
+ */
+esp_err_t sensor_policy_apply_config(const uint8_t *buf, size_t len);
+
 // --- Cross-component accessors (consumed by actuators_lib's h_bridge) ---
 
 /**
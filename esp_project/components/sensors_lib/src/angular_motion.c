@@ -0,0 +1,97 @@
+#include "angular_motion.h"
+#include <string.h>
+
+int32_t angular_unwrap_delta(int32_t previous, int32_t current, int32_t counts_per_rev) {
+    int32_t delta = (current - previous) % counts_per_rev;
+    if (delta > counts_per_rev / 2) {
+        delta -= counts_per_rev;
+    } else if (delta < -(counts_per_rev / 2)) {
+        delta += counts_per_rev;
+    }
+    return delta;
+}
+
+bool angular_motion_init(angular_motion_t *motion, const angular_motion_config_t *cfg) {
+    if (motion == NULL || cfg == NULL || cfg->counts_per_rev <= 0
+        || cfg->velocity_alpha <= 0.0f || cfg->velocity_alpha > 1.0f
+        || cfg->accel_alpha <= 0.0f || cfg->accel_alpha > 1.0f) {
+        return false;
+    }
+    memset(motion, 0, sizeof(*motion));
+    motion->cfg = *cfg;
+    return true;
+}
+
+void angular_motion_push_position(angular_motion_t *motion, int64_t position, int64_t time_us) {
+    if (!motion->primed) {
+        motion->position = position;
+        motion->last_time_us = time_us;
+        motion->primed = true;
+        return;
+    }
+
+    int64_t dt_us = time_us - motion->last_time_us;
+    if (dt_us <= 0) {
+        motion->position = position; // same timestamp: nothing to differentiate
+        return;
+    }
+    float dt = (float)dt_us * 1e-6f;
+
+    float step_deg = (float)(position - motion->position) * 360.0f / (float)motion->cfg.counts_per_rev;
+    float raw_velocity = step_deg / dt;
+    float previous_velocity = motion->velocity_dps;
+    motion->velocity_dps += motion->cfg.velocity_alpha * (raw_velocity - motion->velocity_dps);
+
+    float raw_accel = (motion->velocity_dps - previous_velocity) / dt;
+    motion->accel_dps2 += motion->cfg.accel_alpha * (raw_accel - motion->accel_dps2);
+
+    motion->position = position;
+    motion->last_time_us = time_us;
+}
+
+void angular_motion_push_absolute(angular_motion_t *motion, int32_t raw, int64_t time_us) {
+    if (!motion->primed) {
+        motion->last_raw = raw;
+        angular_motion_push_position(motion, raw, time_us);
+        return;
+    }
+    int32_t delta = angular_unwrap_delta(motion->last_raw, raw, motion->cfg.counts_per_rev);
+    motion->last_raw = raw;
+    angular_motion_push_position(motion, motion->position + delta, time_us);
+}
+
+void angular_motion_stop(angular_motion_t *motion) {
+    motion->velocity_dps = 0.0f;
+    motion->accel_dps2 = 0.0f;
+}
+
+float angular_motion_position_deg(const angular_motion_t *motion) {
+    return (float)motion->position * 360.0f / (float)motion->cfg.counts_per_rev;
+}
+
+static int32_t to_centi(float value) {
+    float scaled = value * 100.0f;
+    if (scaled > (float)INT32_MAX) return INT32_MAX;
+    if (scaled < (float)INT32_MIN) return INT32_MIN;
+    return (int32_t)scaled;
+}
+
+size_t angular_motion_frame_pack(const angular_motion_t *motion, uint8_t source, uint8_t *buf, size_t len) {
+    if (buf == NULL || len < ANGULAR_FRAME_SIZE) {
+        return 0;
+    }
+
+    // Position computed in 64-bit so many turns don't lose precision in a float.
+    int64_t position_cdeg = (motion->position * 36000) / motion->cfg.counts_per_rev;
+    if (position_cdeg > INT32_MAX) position_cdeg = INT32_MAX;
+    if (position_cdeg < INT32_MIN) position_cdeg = INT32_MIN;
+    int32_t position = (int32_t)position_cdeg;
+    int32_t velocity = to_centi(motion->velocity_dps);
+    int32_t accel = to_centi(motion->accel_dps2);
+
+    buf[0] = source;
+    memcpy(&buf[1], &position, sizeof(int32_t));
+    memcpy(&buf[5], &velocity, sizeof(int32_t));
+    memcpy(&buf[9], &accel, sizeof(int32_t));
+    return ANGULAR_FRAME_SIZE;
+}
@@ -1,5 +1,6 @@
 #include "as5600.h"
 #include "sensors_lib.h"
+#include "angular_motion.h"
 #include "peripherals/i2c_helper.h"
 #include "log_lib.h"
 
@@ -16,43 +17,137 @@ static const char *TAG = "as5600_sensor";
 
 #if CONFIG_USE_AS5600
 
+#define AS5600_COUNTS_PER_REV 4096
+
 static i2c_master_dev_handle_t dev;
+static TaskHandle_t as5600_task_handle = NULL;
+static angular_motion_t motion;
+
+// Latest state for as5600_get_angle(), copied out of the sampling task.
+static portMUX_TYPE state_lock = portMUX_INITIALIZER_UNLOCKED;
+static float shared_position_deg = 0.0f;
+static float shared_velocity_dps = 0.0f;
+static bool shared_valid = false;
+
+static void as5600_sample_timer_cb(void *arg) {
+    (void)arg;
+    xTaskNotifyGive(as5600_task_handle);
+}
 
+static void send_motion(void) {
+    header_sensor_t header = {0};
+    header.esp_id = (uint8_t)CONFIG_ESP_ID;
+    header.timestamp = (uint32_t)(esp_timer_get_time() / 1000);
+    header.type = SENSOR_TYPE_ANGULAR;
+    uint8_t buf[HEADER_SENSOR_SIZE + ANGULAR_FRAME_SIZE];
+    serialize_header(&header, buf);
+    angular_motion_frame_pack(&motion, SENSOR_TYPE_AS5600, &buf[HEADER_SENSOR_SIZE], ANGULAR_FRAME_SIZE);
+#if CONFIG_USE_UDPLIB
+    send_udp_sensor(buf, sizeof(buf));
+#endif
+}
+
+// Sampled at AS5600_SAMPLE_PERIOD_US from an esp_timer (faster than the
+// FreeRTOS tick allows), so the angle can be unwrapped reliably and
+// differentiated. Telemetry only goes out when the angle moved by more
+// than the deadband, at most every AS5600_PERIOD_MS, with a heartbeat.
 static void as5600_task(void *params) {
     (void)params;
 
+    angular_motion_config_t motion_cfg = {
+        .counts_per_rev = AS5600_COUNTS_PER_REV,
+        .velocity_alpha = AS5600_VELOCITY_ALPHA,
+        .accel_alpha = AS5600_ACCEL_ALPHA,
+    };
+    angular_motion_init(&motion, &motion_cfg);
+
     if (i2c_bus_add_device(AS5600_I2C_ADDR, 400000, &dev) != ESP_OK) {
         vTaskDelete(NULL);
         return;
     }
-    log_msg(TAG, "AS5600 initialized at address 0x%02X", AS5600_I2C_ADDR);
+
+    const esp_timer_create_args_t sample_timer_args = {
+        .callback = &as5600_sample_timer_cb,
+        .name = "as5600_sample",
+    };
+    esp_timer_handle_t sample_timer = NULL;
+    esp_err_t err = esp_timer_create(&sample_timer_args, &sample_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(sample_timer, AS5600_SAMPLE_PERIOD_US);
+    }
+    if (err != ESP_OK) {
+        log_msg(TAG, "Error (%s) starting AS5600 sample timer", esp_err_to_name(err));
+        vTaskDelete(NULL);
+        return;
+    }
+    log_msg(TAG, "AS5600 initialized at address 0x%02X, sampled every %dus",
+        AS5600_I2C_ADDR, AS5600_SAMPLE_PERIOD_US);
+
+    float last_sent_deg = 0.0f;
+    int64_t last_sent_us = 0;
+    uint32_t read_errors = 0;
 
     while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
         uint8_t data_rd[2] = {0};
-        if (i2c_bus_read_reg8(dev, AS5600_REG_ANGLE, data_rd, sizeof(data_rd)) == ESP_OK) {
-            header_sensor_t header = {0};
-            header.esp_id = (uint8_t)CONFIG_ESP_ID;
-            header.timestamp = (uint32_t)(esp_timer_get_time() / 1000);
-            header.type = SENSOR_TYPE_AS5600;
-            uint8_t buf[HEADER_SENSOR_SIZE + 2];
-            serialize_header(&header, buf);
-            memcpy(&buf[HEADER_SENSOR_SIZE], data_rd, 2); // sent raw, as-is
+        if (i2c_bus_read_reg8(dev, AS5600_REG_ANGLE, data_rd, sizeof(data_rd)) != ESP_OK) {
+            read_errors++;
+            continue;
+        }
+        int64_t now_us = esp_timer_get_time();
+        int32_t raw = ((data_rd[0] & 0x0F) << 8) | data_rd[1];
+        angular_motion_push_absolute(&motion, raw, now_us);
 
-#if CONFIG_USE_UDPLIB
-            send_udp_sensor(buf, sizeof(buf));
-#endif
+        float position_deg = angular_motion_position_deg(&motion);
+        taskENTER_CRITICAL(&state_lock);
+        shared_position_deg = position_deg;
+        shared_velocity_dps = motion.velocity_dps;
+        shared_valid = true;
+        taskEXIT_CRITICAL(&state_lock);
+
+        int64_t since_sent_ms = (now_us - last_sent_us) / 1000;
+        float moved = position_deg - last_sent_deg;
+        if (moved < 0.0f) moved = -moved;
+
+        if ((since_sent_ms >= AS5600_PERIOD_MS && moved >= AS5600_DEADBAND_DEG)
+            || since_sent_ms >= AS5600_HEARTBEAT_MS) {
+            send_motion();
+            last_sent_deg = position_deg;
+            last_sent_us = now_us;
+            if (read_errors > 0) {
+                log_msg(TAG, "AS5600: %" PRIu32 " read error(s) since last report", read_errors);
+                read_errors = 0;
+            }
         }
-        vTaskDelay(pdMS_TO_TICKS(AS5600_PERIOD_MS));
     }
 }
 
+esp_err_t as5600_get_angle(float *position_deg, float *velocity_dps) {
+    if (position_deg == NULL || velocity_dps == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&state_lock);
+    bool valid = shared_valid;
+    *position_deg = shared_position_deg;
+    *velocity_dps = shared_velocity_dps;
+    taskEXIT_CRITICAL(&state_lock);
+    return valid ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
 esp_err_t init_as5600(void) {
-    return xTaskCreate(as5600_task, "as5600_task", 2560, NULL, 5, NULL) == pdPASS
+    return xTaskCreate(as5600_task, "as5600_task", 3072, NULL, 6, &as5600_task_handle) == pdPASS
         ? ESP_OK : ESP_ERR_NO_MEM;
 }
 
 #else // !CONFIG_USE_AS5600
 
+esp_err_t as5600_get_angle(float *position_deg, float *velocity_dps) {
+    (void)position_deg;
+    (void)velocity_dps;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
 esp_err_t init_as5600(void) { return ESP_ERR_NOT_SUPPORTED; }
 
 #endif // CONFIG_USE_AS5600
@@ -4,10 +4,6 @@
 #include "log_lib.h"
 #include <string.h>
 
-#if CONFIG_USE_UDPLIB
-#include "udp_lib.h"
-#endif
-
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_timer.h"
@@ -147,9 +143,8 @@ static void bmp280_task(void *params) {
                 serialize_header(&header, buf);
                 serialize_bmp280(&info, buf);
 
-#if CONFIG_USE_UDPLIB
-                send_udp_sensor(buf, sizeof(buf));
-#endif
+                int32_t values[] = { info.pressure, info.temperature };
+                sensor_publish(SENSOR_TYPE_BMP, 0, values, 2, buf, sizeof(buf));
             }
         }
         vTaskDelay(pdMS_TO_TICKS(BMP_PERIOD));
@@ -4,10 +4,6 @@
 #include "log_lib.h"
 #include <string.h>
 
-#if CONFIG_USE_UDPLIB
-#include "udp_lib.h"
-#endif
-
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -86,9 +82,8 @@ static void dht11_task(void *params) {
                 buf[HEADER_SENSOR_SIZE] = data[0];     // humidity, integer part
                 buf[HEADER_SENSOR_SIZE + 1] = data[2]; // temperature, integer part
 
-#if CONFIG_USE_UDPLIB
-                send_udp_sensor(buf, sizeof(buf));
-#endif
+                int32_t values[] = { data[0], data[2] };
+                sensor_publish(SENSOR_TYPE_DHT11, 0, values, 2, buf, sizeof(buf));
             } else {
                 log_msg(TAG, "Checksum mismatch, discarding frame");
             }
@@ -1,169 +1,139 @@
 #include "ds18b20.h"
 #include "sensors_lib.h"
+#include "peripherals/onewire_bus.h"
 #include "log_lib.h"
+#include <string.h>
 
-#if CONFIG_USE_UDPLIB
-#include "udp_lib.h"
-#endif
-
-#include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_timer.h"
-#include "esp_rom_sys.h"
 
 static const char *TAG = "ds18b20_sensor";
 
 #if CONFIG_USE_DS18B20
 
-static portMUX_TYPE ds_spinlock = portMUX_INITIALIZER_UNLOCKED;
-
-/** Reset pulse + presence detection. Bit-banged with precise us timing. */
-static bool ds18b20_reset(void) {
-    bool presence = false;
-
-    taskENTER_CRITICAL(&ds_spinlock);
-
-    int64_t start = esp_timer_get_time();
-    gpio_set_level(DS18B20_GPIO, 0);
-    while ((esp_timer_get_time() - start) < 480);
-
-    gpio_set_level(DS18B20_GPIO, 1);
+#define DS18B20_CMD_CONVERT_T 0x44
+#define DS18B20_CMD_READ_SCRATCHPAD 0xBE
+#define DS18B20_FAMILY_CODE 0x28
+#define DS18B20_SCRATCHPAD_SIZE 9
+
+static onewire_bus_t bus;
+static uint8_t roms[DS18B20_MAX_DEVICES][ONEWIRE_ROM_SIZE];
+static size_t device_count = 0;
+
+static esp_err_t ds18b20_scan(void) {
+    size_t found = 0;
+    esp_err_t err = onewire_bus_search(&bus, roms, DS18B20_MAX_DEVICES, &found);
+    if (err != ESP_OK) {
+        log_msg(TAG, "Error (%s) searching the 1-Wire bus", esp_err_to_name(err));
+        return err;
+    }
 
-    start = esp_timer_get_time();
-    while ((esp_timer_get_time() - start) < 500) {
-        if (gpio_get_level(DS18B20_GPIO) == 0) {
-            presence = true;
+    // Other 1-Wire devices may share the bus: keep only the DS18B20s.
+    device_count = 0;
+    for (size_t i = 0; i < found; i++) {
+        if (roms[i][0] != DS18B20_FAMILY_CODE) {
+            continue;
+        }
+        if (device_count != i) {
+            memcpy(roms[device_count], roms[i], ONEWIRE_ROM_SIZE);
         }
+        log_msg(TAG, "DS18B20 #%u: %02X%02X%02X%02X%02X%02X%02X%02X", (unsigned)device_count,
+            roms[i][0], roms[i][1], roms[i][2], roms[i][3],
+            roms[i][4], roms[i][5], roms[i][6], roms[i][7]);
+        device_count++;
     }
-
-    taskEXIT_CRITICAL(&ds_spinlock);
-    return presence;
+    return ESP_OK;
 }
 
-static void ds18b20_write_bit(bool bit) {
-    taskENTER_CRITICAL(&ds_spinlock);
-    gpio_set_level(DS18B20_GPIO, 0);
-
-    if (bit) {
-        esp_rom_delay_us(6);
-        gpio_set_level(DS18B20_GPIO, 1);
-        esp_rom_delay_us(64);
-    } else {
-        esp_rom_delay_us(60);
-        gpio_set_level(DS18B20_GPIO, 1);
-        esp_rom_delay_us(10);
+static esp_err_t ds18b20_read(const uint8_t *rom, int16_t *raw_temp) {
+    esp_err_t err = onewire_bus_select(&bus, rom);
+    if (err != ESP_OK) {
+        return err;
     }
-    taskEXIT_CRITICAL(&ds_spinlock);
-}
-
-static bool ds18b20_read_bit(void) {
-    bool bit;
-    taskENTER_CRITICAL(&ds_spinlock);
-    gpio_set_level(DS18B20_GPIO, 0);
-    esp_rom_delay_us(2);
-    gpio_set_level(DS18B20_GPIO, 1);
-    esp_rom_delay_us(10);
-    bit = (gpio_get_level(DS18B20_GPIO) != 0);
-    taskEXIT_CRITICAL(&ds_spinlock);
-    esp_rom_delay_us(50);
-    return bit;
-}
-
-static void ds18b20_write_byte(uint8_t data) {
-    for (int i = 0; i < 8; i++) {
-        ds18b20_write_bit((data >> i) & 0x01);
+    uint8_t cmd = DS18B20_CMD_READ_SCRATCHPAD;
+    err = onewire_bus_write_bytes(&bus, &cmd, 1);
+    if (err != ESP_OK) {
+        return err;
     }
-}
 
-static uint8_t ds18b20_read_byte(void) {
-    uint8_t value = 0;
-    for (int i = 0; i < 8; i++) {
-        if (ds18b20_read_bit()) {
-            value |= (1 << i);
-        }
+    uint8_t scratchpad[DS18B20_SCRATCHPAD_SIZE];
+    err = onewire_bus_read_bytes(&bus, scratchpad, sizeof(scratchpad));
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (onewire_crc8(scratchpad, DS18B20_SCRATCHPAD_SIZE - 1) != scratchpad[DS18B20_SCRATCHPAD_SIZE - 1]) {
+        return ESP_ERR_INVALID_CRC;
     }
-    return value;
+
+    *raw_temp = (int16_t)((scratchpad[1] << 8) | scratchpad[0]);
+    return ESP_OK;
 }
 
-/** Maxim/Dallas CRC8 (polynomial x^8 + x^5 + x^4 + 1). */
-static uint8_t ds18b20_crc8(const uint8_t *addr, uint8_t len) {
-    uint8_t crc = 0;
-    while (len--) {
-        uint8_t inbyte = *addr++;
-        for (uint8_t i = 8; i; i--) {
-            uint8_t mix = (crc ^ inbyte) & 0x01;
-            crc >>= 1;
-            if (mix) crc ^= 0x8C;
-            inbyte >>= 1;
-        }
-    }
-    return crc;
+static void ds18b20_send(uint8_t index, const uint8_t *rom, int16_t raw_temp) {
+    float temp_c = raw_temp * 0.0625f; // 12-bit resolution: 0.0625C/LSB
+    int16_t temp_scaled = (int16_t)(temp_c * 100.0f); // e.g. 24.37C -> 2437
+
+    header_sensor_t header = {0};
+    header.esp_id = (uint8_t)CONFIG_ESP_ID;
+    header.timestamp = (uint32_t)(esp_timer_get_time() / 1000);
+    header.type = SENSOR_TYPE_DS18B20;
+    uint8_t buf[HEADER_SENSOR_SIZE + DS18B20_PAYLOAD_SIZE];
+    serialize_header(&header, buf);
+    // Temperature sent big-endian (MSB first), matching the original.
+    buf[HEADER_SENSOR_SIZE] = (uint8_t)((temp_scaled >> 8) & 0xFF);
+    buf[HEADER_SENSOR_SIZE + 1] = (uint8_t)(temp_scaled & 0xFF);
+    buf[HEADER_SENSOR_SIZE + 2] = index;
+    memcpy(&buf[HEADER_SENSOR_SIZE + 3], rom, ONEWIRE_ROM_SIZE);
+
+    int32_t value = temp_scaled;
+    sensor_publish(SENSOR_TYPE_DS18B20, index, &value, 1, buf, sizeof(buf));
 }
 
 static void ds18b20_task(void *params) {
     (void)params;
 
-    gpio_config_t io_conf = {
-        .pin_bit_mask = (1ULL << DS18B20_GPIO),
-        .mode = GPIO_MODE_INPUT_OUTPUT_OD,
-        .pull_up_en = GPIO_PULLUP_ENABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE,
-    };
-    gpio_config(&io_conf);
-    gpio_set_level(DS18B20_GPIO, 1);
-
-    if (!ds18b20_reset()) {
-        log_msg(TAG, "DS18B20 presence pulse not detected");
+    if (onewire_bus_init(&bus, DS18B20_GPIO) != ESP_OK) {
         vTaskDelete(NULL);
         return;
     }
-    log_msg(TAG, "DS18B20 initialized on GPIO %d", DS18B20_GPIO);
 
-    while (true) {
-        if (ds18b20_reset()) {
-            ds18b20_write_byte(0xCC); // SKIP ROM (single sensor on the bus)
-            ds18b20_write_byte(0x44); // CONVERT T
+    if (ds18b20_scan() != ESP_OK || device_count == 0) {
+        log_msg(TAG, "No DS18B20 found on GPIO %d", DS18B20_GPIO);
+        vTaskDelete(NULL);
+        return;
+    }
+    log_msg(TAG, "DS18B20 initialized on GPIO %d (%u device(s))", DS18B20_GPIO, (unsigned)device_count);
 
-            vTaskDelay(pdMS_TO_TICKS(800)); // 12-bit conversion takes up to 750ms
+    TickType_t last_wake = xTaskGetTickCount();
 
-            if (ds18b20_reset()) {
-                ds18b20_write_byte(0xCC);
-                ds18b20_write_byte(0xBE); // READ SCRATCHPAD
+    while (true) {
+        // One conversion for the whole bus: every device samples at once.
+        uint8_t cmd = DS18B20_CMD_CONVERT_T;
+        esp_err_t err = onewire_bus_select(&bus, NULL);
+        if (err == ESP_OK) {
+            err = onewire_bus_write_bytes(&bus, &cmd, 1);
+        }
 
-                uint8_t scratchpad[9];
-                for (int i = 0; i < 9; i++) {
-                    scratchpad[i] = ds18b20_read_byte();
-                }
+        if (err == ESP_OK) {
+            // The bus is idle during the conversion: sleep instead of
+            // polling, the rest of the system keeps running.
+            vTaskDelay(pdMS_TO_TICKS(DS18B20_CONVERSION_MS));
 
-                if (ds18b20_crc8(scratchpad, 8) == scratchpad[8]) {
-                    int16_t raw_temp = (scratchpad[1] << 8) | scratchpad[0];
-                    float temp_c = raw_temp * 0.0625f; // 12-bit resolution: 0.0625C/LSB
-                    int16_t temp_scaled = (int16_t)(temp_c * 100.0f); // e.g. 24.37C -> 2437
-
-                    header_sensor_t header = {0};
-                    header.esp_id = (uint8_t)CONFIG_ESP_ID;
-                    header.timestamp = (uint32_t)(esp_timer_get_time() / 1000);
-                    header.type = SENSOR_TYPE_DS18B20;
-                    uint8_t buf[HEADER_SENSOR_SIZE + 2];
-                    serialize_header(&header, buf);
-                    // Sent big-endian (MSB first), matching the original.
-                    buf[HEADER_SENSOR_SIZE] = (uint8_t)((temp_scaled >> 8) & 0xFF);
-                    buf[HEADER_SENSOR_SIZE + 1] = (uint8_t)(temp_scaled & 0xFF);
-
-#if CONFIG_USE_UDPLIB
-                    send_udp_sensor(buf, sizeof(buf));
-#endif
+            for (size_t i = 0; i < device_count; i++) {
+                int16_t raw_temp;
+                err = ds18b20_read(roms[i], &raw_temp);
+                if (err == ESP_OK) {
+                    ds18b20_send((uint8_t)i, roms[i], raw_temp);
                 } else {
-                    log_msg(TAG, "DS18B20 CRC mismatch");
+                    log_msg(TAG, "Error (%s) reading DS18B20 #%u", esp_err_to_name(err), (unsigned)i);
                 }
-            } else {
-                log_msg(TAG, "DS18B20 reset failed before read");
             }
         } else {
-            log_msg(TAG, "DS18B20 reset failed before convert");
+            log_msg(TAG, "Error (%s) starting DS18B20 conversion", esp_err_to_name(err));
         }
+
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(DS18B20_PERIOD_MS));
     }
 }
 
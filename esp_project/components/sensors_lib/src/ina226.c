@@ -8,6 +8,10 @@
 #include "udp_lib.h"
 #endif
 
+#if CONFIG_USE_LVGL_SCREEN
+#include "lcd_lvgl_lib.h"
+#endif
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_timer.h"
@@ -90,6 +94,10 @@ static void ina226_task(void *params) {
 
 #if CONFIG_USE_UDPLIB
             send_udp_sensor(buf, sizeof(buf));
+#endif
+#if CONFIG_USE_LVGL_SCREEN
+            // bus LSB 1.25 mV, current LSB 25 uA (CAL 2048), signed
+            lcd_set_power(info.bus * 5 / 4, (int16_t)info.current * 25 / 1000);
 #endif
         }
         vTaskDelay(pdMS_TO_TICKS(70)); // matches original INA_PERIOD
@@ -4,10 +4,6 @@
 #include "log_lib.h"
 #include <string.h>
 
-#if CONFIG_USE_UDPLIB
-#include "udp_lib.h"
-#endif
-
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_timer.h"
@@ -16,21 +12,20 @@ static const char *TAG = "ky018_sensor";
 
 #if CONFIG_USE_KY018
 
-static adc_oneshot_sensor_t sensor = { .unit = KY018_ADC_UNIT, .channel = KY018_ADC_CHANNEL };
+// Averaged over the whole period by the shared ADC engine.
+static adc_stream_t stream = {
+    .channel = KY018_ADC_CHANNEL, .atten = ADC_ATTEN_DB_0,
+    .output_rate_hz = 1000 / KY018_PERIOD_MS, .filter = { .type = ADC_FILTER_MOVING_AVG },
+};
 
 static void ky018_task(void *params) {
     (void)params;
 
-    if (adc_oneshot_sensor_init(&sensor, ADC_ATTEN_DB_0) != ESP_OK) {
-        vTaskDelete(NULL);
-        return;
-    }
     log_msg(TAG, "KY-018 initialized on ADC channel %d", KY018_ADC_CHANNEL);
 
     while (true) {
-        int raw = 0;
-        if (adc_oneshot_sensor_read_raw(&sensor, &raw) == ESP_OK) {
-            int32_t val = raw;
+        int32_t val = 0;
+        if (adc_stream_wait(&stream, pdMS_TO_TICKS(2 * KY018_PERIOD_MS), &val) == ESP_OK) {
 
             header_sensor_t header = {0};
             header.esp_id = (uint8_t)CONFIG_ESP_ID;
@@ -40,15 +35,16 @@ static void ky018_task(void *params) {
             serialize_header(&header, buf);
             memcpy(&buf[HEADER_SENSOR_SIZE], &val, sizeof(int32_t));
 
-#if CONFIG_USE_UDPLIB
-            send_udp_sensor(buf, sizeof(buf));
-#endif
+            sensor_publish(SENSOR_TYPE_KY018, 0, &val, 1, buf, sizeof(buf));
         }
-        vTaskDelay(pdMS_TO_TICKS(KY018_PERIOD_MS));
     }
 }
 
 esp_err_t init_ky018(void) {
+    esp_err_t err = adc_stream_register(&stream);
+    if (err != ESP_OK) {
+        return err;
+    }
     return xTaskCreate(ky018_task, "ky018_task", 2560, NULL, 5, NULL) == pdPASS
         ? ESP_OK : ESP_ERR_NO_MEM;
 }
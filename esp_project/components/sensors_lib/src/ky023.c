@@ -17,23 +17,26 @@ static const char *TAG = "ky023_sensor";
 
 #if CONFIG_USE_KY023
 
-static adc_continuous_dual_t joystick = {
-    .unit = KY023_ADC_UNIT, .channel_a = KY023_X_CHANNEL, .channel_b = KY023_Y_CHANNEL,
+// Both axes averaged over each period by the shared ADC engine.
+static adc_stream_t axis_x = {
+    .channel = KY023_X_CHANNEL, .atten = ADC_ATTEN_DB_12,
+    .output_rate_hz = 1000 / KY023_PERIOD_MS, .filter = { .type = ADC_FILTER_MOVING_AVG },
+};
+static adc_stream_t axis_y = {
+    .channel = KY023_Y_CHANNEL, .atten = ADC_ATTEN_DB_12,
+    .output_rate_hz = 1000 / KY023_PERIOD_MS, .filter = { .type = ADC_FILTER_MOVING_AVG },
 };
 static gpio_edge_input_t button = { .pin = KY023_SW_GPIO };
 
 static void ky023_xy_task(void *params) {
     (void)params;
 
-    if (adc_continuous_dual_init(&joystick, 20000) != ESP_OK) {
-        vTaskDelete(NULL);
-        return;
-    }
     log_msg(TAG, "KY-023 XY initialized (X: ch%d, Y: ch%d)", KY023_X_CHANNEL, KY023_Y_CHANNEL);
 
     while (true) {
-        int x = 0, y = 0;
-        if (adc_continuous_dual_read(&joystick, &x, &y) == ESP_OK) {
+        int32_t x = 0, y = 0;
+        if (adc_stream_wait(&axis_x, pdMS_TO_TICKS(2 * KY023_PERIOD_MS), &x) == ESP_OK
+            && adc_stream_read_latest(&axis_y, &y) == ESP_OK) {
             header_sensor_t header = {0};
             header.esp_id = (uint8_t)CONFIG_ESP_ID;
             header.timestamp = (uint32_t)(esp_timer_get_time() / 1000);
@@ -50,7 +53,6 @@ static void ky023_xy_task(void *params) {
             send_udp_sensor(buf, sizeof(buf));
 #endif
         }
-        vTaskDelay(pdMS_TO_TICKS(20));
     }
 }
 
@@ -84,6 +86,13 @@ static void ky023_button_task(void *params) {
 }
 
 esp_err_t init_ky023(void) {
+    esp_err_t err = adc_stream_register(&axis_x);
+    if (err == ESP_OK) {
+        err = adc_stream_register(&axis_y);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
     if (xTaskCreate(ky023_xy_task, "ky023_xy_task", 2560, NULL, 5, NULL) != pdPASS) {
         return ESP_ERR_NO_MEM;
     }
@@ -24,7 +24,10 @@ typedef struct {
     int64_t signal_duration;
 } ky035_info_t;
 
-static adc_oneshot_sensor_t sensor = { .unit = KY035_ADC_UNIT, .channel = KY035_ADC_CHANNEL };
+static adc_stream_t stream = {
+    .channel = KY035_ADC_CHANNEL, .atten = ADC_ATTEN_DB_12,
+    .output_rate_hz = 1000 / KY035_POLL_PERIOD_MS, .filter = { .type = ADC_FILTER_MOVING_AVG },
+};
 static ky035_info_t info = {0};
 
 static void serialize_ky035(const ky035_info_t *ky, uint8_t *buf) {
@@ -37,18 +40,14 @@ static void serialize_ky035(const ky035_info_t *ky, uint8_t *buf) {
 static void ky035_task(void *params) {
     (void)params;
 
-    if (adc_oneshot_sensor_init(&sensor, ADC_ATTEN_DB_12) != ESP_OK) {
-        vTaskDelete(NULL);
-        return;
-    }
     log_msg(TAG, "KY-035 initialized on ADC channel %d", KY035_ADC_CHANNEL);
 
     int64_t last_timestamp = 0;
     bool last_state = false;
 
     while (true) {
-        int raw;
-        if (adc_oneshot_sensor_read_raw(&sensor, &raw) == ESP_OK) {
+        int32_t raw;
+        if (adc_stream_wait(&stream, pdMS_TO_TICKS(10 * KY035_POLL_PERIOD_MS), &raw) == ESP_OK) {
             bool current_state = raw < KY035_THRESHOLD_RAW;
 
             if (current_state && !last_state) {
@@ -73,12 +72,14 @@ static void ky035_task(void *params) {
             }
             last_state = current_state;
         }
-
-        vTaskDelay(pdMS_TO_TICKS(KY035_POLL_PERIOD_MS));
     }
 }
 
 esp_err_t init_ky035(void) {
+    esp_err_t err = adc_stream_register(&stream);
+    if (err != ESP_OK) {
+        return err;
+    }
     return xTaskCreate(ky035_task, "ky035_task", 2560, NULL, 5, NULL) == pdPASS
         ? ESP_OK : ESP_ERR_NO_MEM;
 }
@@ -16,39 +16,62 @@ static const char *TAG = "ky039_sensor";
 
 #if CONFIG_USE_KY039
 
-static adc_oneshot_sensor_t sensor = { .unit = KY039_ADC_UNIT, .channel = KY039_ADC_CHANNEL };
+// Low-passed and decimated to KY039_FILTER_RATE_HZ by the shared ADC engine,
+// fast enough for the beat detector to time each pulse. The median drops the
+// isolated glitches that would otherwise show up as a false beat.
+static adc_stream_t stream = {
+    .channel = KY039_ADC_CHANNEL, .atten = ADC_ATTEN_DB_12,
+    .output_rate_hz = KY039_FILTER_RATE_HZ, .filter = { .type = ADC_FILTER_CIC, .order = 2, .median3 = true },
+};
 
 static void ky039_task(void *params) {
     (void)params;
 
-    if (adc_oneshot_sensor_init(&sensor, ADC_ATTEN_DB_12) != ESP_OK) {
-        vTaskDelete(NULL);
-        return;
-    }
     log_msg(TAG, "KY-039 initialized on ADC channel %d", KY039_ADC_CHANNEL);
 
+#if CONFIG_KY039_HEART_RATE
+    adc_beat_detector_t beat;
+    adc_beat_detector_init(&beat, KY039_FILTER_RATE_HZ, KY039_BEAT_HYSTERESIS, KY039_BEAT_MIN_INTERVAL_MS);
+#endif
+    uint16_t bpm = 0;
+    uint32_t outputs = 0;
+    const uint32_t outputs_per_frame = (KY039_FILTER_RATE_HZ * KY039_PERIOD_MS) / 1000;
+
     while (true) {
-        int raw = 0;
-        if (adc_oneshot_sensor_read_raw(&sensor, &raw) == ESP_OK) {
-            int32_t val = raw;
-
-            header_sensor_t header = {0};
-            header.esp_id = (uint8_t)CONFIG_ESP_ID;
-            header.timestamp = (uint32_t)(esp_timer_get_time() / 1000);
-            header.type = SENSOR_TYPE_KY039;
-            uint8_t buf[HEADER_SENSOR_SIZE + sizeof(int32_t)];
-            serialize_header(&header, buf);
-            memcpy(&buf[HEADER_SENSOR_SIZE], &val, sizeof(int32_t));
+        int32_t val = 0;
+        if (adc_stream_wait(&stream, pdMS_TO_TICKS(KY039_PERIOD_MS), &val) != ESP_OK) {
+            continue;
+        }
 
-#if CONFIG_USE_UDPLIB
-            send_udp_sensor(buf, sizeof(buf));
+#if CONFIG_KY039_HEART_RATE
+        adc_beat_detector_push(&beat, val, &bpm);
 #endif
+
+        if (++outputs < outputs_per_frame) {
+            continue;
         }
-        vTaskDelay(pdMS_TO_TICKS(KY039_PERIOD_MS));
+        outputs = 0;
+
+        header_sensor_t header = {0};
+        header.esp_id = (uint8_t)CONFIG_ESP_ID;
+        header.timestamp = (uint32_t)(esp_timer_get_time() / 1000);
+        header.type = SENSOR_TYPE_KY039;
+        uint8_t buf[HEADER_SENSOR_SIZE + sizeof(int32_t) + sizeof(uint16_t)];
+        serialize_header(&header, buf);
+        memcpy(&buf[HEADER_SENSOR_SIZE], &val, sizeof(int32_t));
+        memcpy(&buf[HEADER_SENSOR_SIZE + sizeof(int32_t)], &bpm, sizeof(uint16_t));
+
+#if CONFIG_USE_UDPLIB
+        send_udp_sensor(buf, sizeof(buf));
+#endif
     }
 }
 
 esp_err_t init_ky039(void) {
+    esp_err_t err = adc_stream_register(&stream);
+    if (err != ESP_OK) {
+        return err;
+    }
     return xTaskCreate(ky039_task, "ky039_task", 2560, NULL, 5, NULL) == pdPASS
         ? ESP_OK : ESP_ERR_NO_MEM;
 }
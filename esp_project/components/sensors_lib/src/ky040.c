@@ -1,5 +1,6 @@
 #include "ky040.h"
 #include "sensors_lib.h"
+#include "angular_motion.h"
 #include "peripherals/pcnt_encoder.h"
 #include "peripherals/gpio_digital.h"
 #include "log_lib.h"
@@ -26,7 +27,9 @@ static const char *TAG = "ky040_sensor";
 static pcnt_quadrature_t encoder = {
     .pin_a = KY040_CLK_GPIO, .pin_b = KY040_DT_GPIO,
     .high_limit = 1000, .low_limit = -1000, .glitch_filter_ns = 1000,
+    .accumulate = true,
 };
+static angular_motion_t motion;
 static gpio_edge_input_t button = { .pin = KY040_SW_GPIO };
 
 static void send_event(uint8_t value) {
@@ -42,29 +45,64 @@ static void send_event(uint8_t value) {
 #endif
 }
 
-// Polls the quadrature delta at a fixed rate and reports discrete
-// left/right events, since the original protocol is event-style rather
-// than an absolute position.
+static void send_motion(void) {
+    header_sensor_t header = {0};
+    header.esp_id = (uint8_t)CONFIG_ESP_ID;
+    header.timestamp = (uint32_t)(esp_timer_get_time() / 1000);
+    header.type = SENSOR_TYPE_ANGULAR;
+    uint8_t buf[HEADER_SENSOR_SIZE + ANGULAR_FRAME_SIZE];
+    serialize_header(&header, buf);
+    angular_motion_frame_pack(&motion, SENSOR_TYPE_KY040, &buf[HEADER_SENSOR_SIZE], ANGULAR_FRAME_SIZE);
+#if CONFIG_USE_UDPLIB
+    send_udp_sensor(buf, sizeof(buf));
+#endif
+}
+
+// Polls the unbounded quadrature position at a fixed rate. The original
+// left/right events are still reported, plus an angular frame (position,
+// velocity, acceleration) whenever the knob moved, and one more once it
+// stopped so the station sees the speed fall back to 0.
 static void ky040_rotation_task(void *params) {
     (void)params;
 
-    if (pcnt_quadrature_init(&encoder) != ESP_OK) {
+    angular_motion_config_t motion_cfg = {
+        .counts_per_rev = KY040_COUNTS_PER_REV,
+        .velocity_alpha = KY040_VELOCITY_ALPHA,
+        .accel_alpha = KY040_ACCEL_ALPHA,
+    };
+    if (!angular_motion_init(&motion, &motion_cfg) || pcnt_quadrature_init(&encoder) != ESP_OK) {
         vTaskDelete(NULL);
         return;
     }
     log_msg(TAG, "KY-040 rotation initialized on GPIO %d/%d", KY040_CLK_GPIO, KY040_DT_GPIO);
 
-    while (true) {
-        int32_t delta = 0;
-        pcnt_quadrature_drain(&encoder, &delta);
+    int32_t last_position = 0;
+    bool moving = false;
 
-        if (delta > 0) {
-            send_event(KY040_VAL_RIGHT);
-        } else if (delta < 0) {
-            send_event(KY040_VAL_LEFT);
+    while (true) {
+        int32_t position = 0;
+        if (pcnt_quadrature_read(&encoder, &position) == ESP_OK) {
+            int32_t delta = position - last_position;
+            last_position = position;
+            angular_motion_push_position(&motion, position, esp_timer_get_time());
+
+            if (delta > 0) {
+                send_event(KY040_VAL_RIGHT);
+            } else if (delta < 0) {
+                send_event(KY040_VAL_LEFT);
+            }
+
+            if (delta != 0) {
+                send_motion();
+            } else if (moving) {
+                // the low-pass would still hold part of the last speed
+                angular_motion_stop(&motion);
+                send_motion();
+            }
+            moving = (delta != 0);
         }
 
-        vTaskDelay(pdMS_TO_TICKS(20));
+        vTaskDelay(pdMS_TO_TICKS(KY040_PERIOD_MS));
     }
 }
 
@@ -12,6 +12,10 @@
 #include "freertos/task.h"
 #include "esp_timer.h"
 
+#if CONFIG_MPU9250_STORED_OFFSETS
+#include "nvs_lib.h"
+#endif
+
 static const char *TAG = "mpu9250_sensor";
 
 #if CONFIG_USE_MPU9250
@@ -29,6 +33,15 @@ typedef struct {
 static i2c_master_dev_handle_t dev;
 static int16_t accel_offset_x = 0, accel_offset_y = 0, accel_offset_z = 0;
 
+#if CONFIG_MPU9250_STORED_OFFSETS
+#define MPU_OFFSETS_KEY "MPU_OFFSETS"
+#define MPU_OFFSETS_VERSION 1
+
+typedef struct {
+    int16_t accel_x, accel_y, accel_z;
+} mpu9250_offsets_t;
+#endif
+
 static esp_err_t get_mpu_info(mpu9250_info_t *info) {
     uint8_t buf[14]; // accel(6) + temp(2) + gyro(6)
     esp_err_t err = i2c_bus_read_reg8(dev, 0x3B, buf, sizeof(buf));
@@ -70,6 +83,35 @@ static esp_err_t calibrate_accel_offset(void) {
     return ESP_OK;
 }
 
+#if CONFIG_MPU9250_STORED_OFFSETS
+/**
+ * Offsets of a previous calibration, so the car does not have to stay still
+ * at every boot. Missing or rejected record: calibrate and store it.
+ */
+static esp_err_t load_accel_offset(void) {
+    mpu9250_offsets_t offsets;
+    esp_err_t err = load_nvs_record(MPU_OFFSETS_KEY, NVS_RECORD_CALIBRATION, MPU_OFFSETS_VERSION,
+        &offsets, sizeof(offsets));
+    if (err != ESP_OK) {
+        return err;
+    }
+    accel_offset_x = offsets.accel_x;
+    accel_offset_y = offsets.accel_y;
+    accel_offset_z = offsets.accel_z;
+    log_msg(TAG, "Stored offsets: x=%d y=%d z=%d", accel_offset_x, accel_offset_y, accel_offset_z);
+    return ESP_OK;
+}
+
+static void save_accel_offset(void) {
+    mpu9250_offsets_t offsets = { accel_offset_x, accel_offset_y, accel_offset_z };
+    esp_err_t err = save_nvs_record(MPU_OFFSETS_KEY, NVS_RECORD_CALIBRATION, MPU_OFFSETS_VERSION,
+        &offsets, sizeof(offsets));
+    if (err != ESP_OK) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "Error (%s) saving offsets", esp_err_to_name(err));
+    }
+}
+#endif
+
 static void serialize_mpu9250(const mpu9250_info_t *info, uint8_t *buf) {
     uint16_t len = HEADER_SENSOR_SIZE;
     memcpy(&buf[len], &info->accel_x, sizeof(int16_t)); len += sizeof(int16_t);
@@ -104,7 +146,13 @@ static void mpu9250_task(void *params) {
 
     log_msg(TAG, "MPU9250 initialized at address 0x%02X", MPU9250_I2C_ADDR);
 
+#if CONFIG_MPU9250_STORED_OFFSETS
+    if (load_accel_offset() != ESP_OK && calibrate_accel_offset() == ESP_OK) {
+        save_accel_offset();
+    }
+#else
     calibrate_accel_offset();
+#endif
 
     while (true) {
         mpu9250_info_t info;
@@ -0,0 +1,168 @@
+#include "peripherals/adc_filter.h"
+#include <string.h>
+
+#define BEAT_BASELINE_SHIFT 6 // baseline follows the signal with alpha = 1/64
+
+bool adc_filter_init(adc_filter_t *filter, const adc_filter_config_t *cfg) {
+    if (filter == NULL || cfg == NULL || cfg->decimation == 0) {
+        return false;
+    }
+    if (cfg->type == ADC_FILTER_CIC && (cfg->order == 0 || cfg->order > ADC_FILTER_CIC_MAX_ORDER)) {
+        return false;
+    }
+    if (cfg->type == ADC_FILTER_IIR && cfg->iir_shift > 15) {
+        return false;
+    }
+
+    memset(filter, 0, sizeof(*filter));
+    filter->cfg = *cfg;
+
+    filter->cic_gain = 1;
+    if (cfg->type == ADC_FILTER_CIC) {
+        for (uint8_t i = 0; i < cfg->order; i++) {
+            filter->cic_gain *= cfg->decimation;
+        }
+    }
+    return true;
+}
+
+static bool cic_push(adc_filter_t *filter, int32_t sample, int32_t *out) {
+    uint8_t order = filter->cfg.order;
+
+    // Integrators run at the input rate. Unsigned wrap-around is harmless:
+    // the combs undo it as long as the final result fits (Hogenauer).
+    filter->integrators[0] += (uint64_t)(int64_t)sample;
+    for (uint8_t i = 1; i < order; i++) {
+        filter->integrators[i] += filter->integrators[i - 1];
+    }
+
+    if (++filter->count < filter->cfg.decimation) {
+        return false;
+    }
+    filter->count = 0;
+
+    // Combs run at the output rate (differential delay of 1).
+    uint64_t value = filter->integrators[order - 1];
+    for (uint8_t i = 0; i < order; i++) {
+        uint64_t delayed = filter->comb_delay[i];
+        filter->comb_delay[i] = value;
+        value -= delayed;
+    }
+
+    *out = (int32_t)((int64_t)value / (int64_t)filter->cic_gain);
+    return true;
+}
+
+// One sample of latency; the first two samples go through as they are.
+static int32_t median3_push(adc_filter_t *filter, int32_t sample) {
+    int32_t a = filter->median_hist[0];
+    int32_t b = filter->median_hist[1];
+    filter->median_hist[0] = b;
+    filter->median_hist[1] = sample;
+    if (filter->median_count < 2) {
+        filter->median_count++;
+        return sample;
+    }
+
+    int32_t lo = (a < b) ? a : b;
+    int32_t hi = (a < b) ? b : a;
+    if (sample < lo) {
+        return lo;
+    }
+    return (sample > hi) ? hi : sample;
+}
+
+bool adc_filter_push(adc_filter_t *filter, int32_t sample, int32_t *out) {
+    if (filter->cfg.median3) {
+        sample = median3_push(filter, sample);
+    }
+
+    switch (filter->cfg.type) {
+    case ADC_FILTER_MOVING_AVG:
+        filter->acc += sample;
+        if (++filter->count < filter->cfg.decimation) {
+            return false;
+        }
+        *out = (int32_t)(filter->acc / filter->cfg.decimation);
+        filter->acc = 0;
+        filter->count = 0;
+        return true;
+
+    case ADC_FILTER_CIC:
+        return cic_push(filter, sample, out);
+
+    case ADC_FILTER_IIR:
+        if (!filter->iir_primed) {
+            filter->iir_q16 = sample * 65536; // start on the first sample, not on 0
+            filter->iir_primed = true;
+        } else {
+            filter->iir_q16 += (sample * 65536 - filter->iir_q16) >> filter->cfg.iir_shift;
+        }
+        if (++filter->count < filter->cfg.decimation) {
+            return false;
+        }
+        filter->count = 0;
+        *out = (filter->iir_q16 + (1 << 15)) >> 16;
+        return true;
+
+    case ADC_FILTER_NONE:
+    default:
+        if (++filter->count < filter->cfg.decimation) {
+            return false;
+        }
+        filter->count = 0;
+        *out = sample;
+        return true;
+    }
+}
+
+void adc_beat_detector_init(adc_beat_detector_t *det, uint32_t sample_rate_hz,
+    int32_t hysteresis, uint32_t min_interval_ms) {
+    memset(det, 0, sizeof(*det));
+    det->sample_rate_hz = sample_rate_hz;
+    det->hysteresis = hysteresis;
+    det->refractory_samples = (sample_rate_hz * min_interval_ms) / 1000;
+}
+
+bool adc_beat_detector_push(adc_beat_detector_t *det, int32_t value, uint16_t *bpm) {
+    if (!det->baseline_primed) {
+        det->baseline_q8 = value * 256;
+        det->baseline_primed = true;
+    } else {
+        det->baseline_q8 += (value * 256 - det->baseline_q8) >> BEAT_BASELINE_SHIFT;
+    }
+    int32_t baseline = det->baseline_q8 >> 8;
+
+    if (det->samples_since_beat < UINT32_MAX) {
+        det->samples_since_beat++;
+    }
+
+    if (det->above) {
+        // Re-arm only once the signal went back under the baseline.
+        if (value < baseline) {
+            det->above = false;
+        }
+        return false;
+    }
+
+    if (value < baseline + det->hysteresis || det->samples_since_beat < det->refractory_samples) {
+        return false;
+    }
+
+    det->above = true;
+    bool has_interval = det->has_previous_beat;
+    uint32_t interval = det->samples_since_beat;
+    det->has_previous_beat = true;
+    det->samples_since_beat = 0;
+
+    if (!has_interval || interval == 0) {
+        return false; // first beat: nothing to measure against yet
+    }
+
+    uint32_t rate = (60u * det->sample_rate_hz) / interval;
+    det->bpm = (rate > UINT16_MAX) ? UINT16_MAX : (uint16_t)rate;
+    if (bpm != NULL) {
+        *bpm = det->bpm;
+    }
+    return true;
+}
@@ -2,6 +2,9 @@
 #include "log_lib.h"
 #include <string.h>
 #include <esp_adc/adc_cali_scheme.h>
+#include "freertos/task.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
 
 static const char *TAG = "adc_helper_peripheral";
 
@@ -171,3 +174,183 @@ esp_err_t adc_continuous_dual_read(adc_continuous_dual_t *sensor, int *raw_a, in
     }
     return ESP_OK;
 }
+
+// --- Shared continuous engine ---
+
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+#define ENGINE_OUTPUT_FORMAT ADC_DIGI_OUTPUT_FORMAT_TYPE1
+#define ENGINE_SAMPLE_CHANNEL(p) ((p)->type1.channel)
+#define ENGINE_SAMPLE_DATA(p) ((p)->type1.data)
+#else
+#define ENGINE_OUTPUT_FORMAT ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#define ENGINE_SAMPLE_CHANNEL(p) ((p)->type2.channel)
+#define ENGINE_SAMPLE_DATA(p) ((p)->type2.data)
+#endif
+
+#define ENGINE_FRAME_SIZE 512          // bytes per DMA conversion frame
+#define ENGINE_STATS_PERIOD_US 10000000 // log the per-sample cost every 10s
+
+static adc_stream_t *streams[ADC_ENGINE_MAX_STREAMS];
+static uint8_t stream_count = 0;
+// Channel -> stream lookup, so demultiplexing is one index per sample.
+static adc_stream_t *stream_by_channel[SOC_ADC_MAX_CHANNEL_NUM];
+static adc_continuous_handle_t engine_handle = NULL;
+
+esp_err_t adc_stream_register(adc_stream_t *stream) {
+    if (stream == NULL || stream->output_rate_hz == 0 || stream->channel >= SOC_ADC_MAX_CHANNEL_NUM) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (engine_handle != NULL) {
+        log_msg(TAG, "ADC engine already started, cannot add channel %d", stream->channel);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (stream_count >= ADC_ENGINE_MAX_STREAMS || stream_by_channel[stream->channel] != NULL) {
+        log_msg(TAG, "Cannot register ADC channel %d (full or already used)", stream->channel);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    stream->ready_sem = xSemaphoreCreateBinary();
+    if (stream->ready_sem == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    stream->sequence = 0;
+
+    streams[stream_count++] = stream;
+    stream_by_channel[stream->channel] = stream;
+    return ESP_OK;
+}
+
+static void adc_engine_task(void *params) {
+    (void)params;
+
+    uint8_t frame[ENGINE_FRAME_SIZE];
+    uint64_t samples = 0;
+    uint64_t cycles = 0;
+    int64_t stats_start_us = esp_timer_get_time();
+
+    while (true) {
+        uint32_t bytes_read = 0;
+        esp_err_t err = adc_continuous_read(engine_handle, frame, sizeof(frame), &bytes_read, 1000);
+        if (err != ESP_OK) {
+            if (err != ESP_ERR_TIMEOUT) {
+                log_msg(TAG, "Error (%s) reading ADC engine", esp_err_to_name(err));
+            }
+            continue;
+        }
+
+        uint32_t start = esp_cpu_get_cycle_count();
+        for (uint32_t i = 0; i < bytes_read; i += SOC_ADC_DIGI_RESULT_BYTES) {
+            adc_digi_output_data_t *p = (adc_digi_output_data_t *)&frame[i];
+            uint32_t channel = ENGINE_SAMPLE_CHANNEL(p);
+            if (channel >= SOC_ADC_MAX_CHANNEL_NUM || stream_by_channel[channel] == NULL) {
+                continue;
+            }
+
+            adc_stream_t *stream = stream_by_channel[channel];
+            int32_t out;
+            if (adc_filter_push(&stream->state, (int32_t)ENGINE_SAMPLE_DATA(p), &out)) {
+                stream->value = out;
+                stream->sequence++;
+                xSemaphoreGive(stream->ready_sem);
+            }
+        }
+        cycles += (uint32_t)(esp_cpu_get_cycle_count() - start);
+        samples += bytes_read / SOC_ADC_DIGI_RESULT_BYTES;
+
+        int64_t now = esp_timer_get_time();
+        if (now - stats_start_us >= ENGINE_STATS_PERIOD_US && samples > 0) {
+            log_msg(TAG, "ADC engine: %" PRIu64 " samples/s, %" PRIu64 " cycles/sample (demux + filter)",
+                samples * 1000000 / (uint64_t)(now - stats_start_us), cycles / samples);
+            samples = 0;
+            cycles = 0;
+            stats_start_us = now;
+        }
+    }
+}
+
+esp_err_t adc_stream_engine_start(void) {
+    if (stream_count == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (engine_handle != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t per_channel_hz = ADC_ENGINE_SAMPLE_FREQ_HZ / stream_count;
+    adc_digi_pattern_config_t patterns[ADC_ENGINE_MAX_STREAMS] = {0};
+
+    for (uint8_t i = 0; i < stream_count; i++) {
+        adc_stream_t *stream = streams[i];
+
+        adc_filter_config_t cfg = stream->filter;
+        uint32_t decimation = per_channel_hz / stream->output_rate_hz;
+        cfg.decimation = (decimation == 0) ? 1 : (decimation > UINT16_MAX ? UINT16_MAX : (uint16_t)decimation);
+        if (!adc_filter_init(&stream->state, &cfg)) {
+            log_msg(TAG, "Invalid filter configuration for ADC channel %d", stream->channel);
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        patterns[i].atten = stream->atten;
+        patterns[i].channel = stream->channel;
+        patterns[i].unit = ADC_UNIT_1; // only ADC1 supports DMA on every target we use
+        patterns[i].bit_width = ADC_BITWIDTH_DEFAULT;
+    }
+
+    adc_continuous_handle_cfg_t handle_cfg = {
+        .max_store_buf_size = 4 * ENGINE_FRAME_SIZE,
+        .conv_frame_size = ENGINE_FRAME_SIZE,
+    };
+    esp_err_t err = adc_continuous_new_handle(&handle_cfg, &engine_handle);
+    if (err != ESP_OK) {
+        log_msg(TAG, "Error (%s) creating ADC engine handle", esp_err_to_name(err));
+        return err;
+    }
+
+    adc_continuous_config_t continuous_config = {
+        .sample_freq_hz = ADC_ENGINE_SAMPLE_FREQ_HZ,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ENGINE_OUTPUT_FORMAT,
+        .pattern_num = stream_count,
+        .adc_pattern = patterns,
+    };
+    err = adc_continuous_config(engine_handle, &continuous_config);
+    if (err != ESP_OK) {
+        log_msg(TAG, "Error (%s) configuring ADC engine", esp_err_to_name(err));
+        return err;
+    }
+
+    err = adc_continuous_start(engine_handle);
+    if (err != ESP_OK) {
+        log_msg(TAG, "Error (%s) starting ADC engine", esp_err_to_name(err));
+        return err;
+    }
+
+    if (xTaskCreate(adc_engine_task, "adc_engine_task", 3072, NULL, 6, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    log_msg(TAG, "ADC engine started: %d channels, %" PRIu32 " Hz per channel", stream_count, per_channel_hz);
+    return ESP_OK;
+}
+
+esp_err_t adc_stream_wait(adc_stream_t *stream, TickType_t timeout_ticks, int32_t *value) {
+    if (stream == NULL || value == NULL || stream->ready_sem == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xSemaphoreTake(stream->ready_sem, timeout_ticks) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    *value = stream->value;
+    return ESP_OK;
+}
+
+esp_err_t adc_stream_read_latest(adc_stream_t *stream, int32_t *value) {
+    if (stream == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (stream->sequence == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    *value = stream->value;
+    return ESP_OK;
+}
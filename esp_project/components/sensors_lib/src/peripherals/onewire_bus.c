@@ -0,0 +1,257 @@
+#include "peripherals/onewire_bus.h"
+#include "log_lib.h"
+#include <string.h>
+
+static const char *TAG = "onewire_peripheral";
+
+#define ONEWIRE_RMT_RESOLUTION_HZ 1000000 // 1 tick = 1us
+#define ONEWIRE_RMT_MEM_SYMBOLS 64
+
+// Standard speed timings, in us
+#define ONEWIRE_RESET_PULSE 500
+#define ONEWIRE_RESET_WAIT 200          // presence window after the reset pulse
+#define ONEWIRE_PRESENCE_WAIT_MIN 15    // devices wait 15-60us before answering
+#define ONEWIRE_PRESENCE_MIN 60         // and then pull low for 60-240us
+#define ONEWIRE_SLOT_START 2            // low pulse opening a write-1/read slot
+#define ONEWIRE_SLOT_BIT 60             // rest of the slot
+#define ONEWIRE_SLOT_RECOVERY 2
+#define ONEWIRE_SLOT_SAMPLE 15          // low longer than this in a read slot = 0
+
+// Capture ends once the line stayed high longer than a whole reset sequence
+#define ONEWIRE_RX_MIN_NS 1000
+#define ONEWIRE_RX_MAX_NS ((ONEWIRE_RESET_PULSE + ONEWIRE_RESET_WAIT) * 1000)
+#define ONEWIRE_RX_TIMEOUT_MS 20
+
+static const rmt_symbol_word_t reset_symbol = {
+    .level0 = 0, .duration0 = ONEWIRE_RESET_PULSE,
+    .level1 = 1, .duration1 = ONEWIRE_RESET_WAIT,
+};
+
+static const rmt_symbol_word_t bit_symbols[2] = {
+    { .level0 = 0, .duration0 = ONEWIRE_SLOT_START + ONEWIRE_SLOT_BIT,
+      .level1 = 1, .duration1 = ONEWIRE_SLOT_RECOVERY },
+    { .level0 = 0, .duration0 = ONEWIRE_SLOT_START,
+      .level1 = 1, .duration1 = ONEWIRE_SLOT_BIT + ONEWIRE_SLOT_RECOVERY },
+};
+
+esp_err_t onewire_bus_init(onewire_bus_t *bus, int gpio_num) {
+    if (bus == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bus->gpio_num = gpio_num;
+
+    // RX first: the open-drain TX channel then takes the pin over and
+    // loops its output back into it.
+    esp_err_t err = rmt_rx_helper_init(&bus->rx, gpio_num,
+        ONEWIRE_RMT_RESOLUTION_HZ, ONEWIRE_RMT_MEM_SYMBOLS);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = rmt_tx_helper_init_open_drain(&bus->tx, gpio_num,
+        ONEWIRE_RMT_RESOLUTION_HZ, ONEWIRE_RMT_MEM_SYMBOLS);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    log_msg(TAG, "1-Wire bus initialized on GPIO %d", gpio_num);
+    return ESP_OK;
+}
+
+/** Send symbols while capturing the line, return the captured symbols. */
+static esp_err_t transact(onewire_bus_t *bus, const rmt_symbol_word_t *tx_symbols, size_t tx_count,
+    rmt_symbol_word_t *rx_symbols, size_t rx_size, size_t *rx_count) {
+    esp_err_t err = rmt_rx_helper_start(&bus->rx, rx_symbols, rx_size, ONEWIRE_RX_MIN_NS, ONEWIRE_RX_MAX_NS);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = rmt_tx_helper_transmit(&bus->tx, tx_symbols, tx_count);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = rmt_rx_helper_wait(&bus->rx, pdMS_TO_TICKS(ONEWIRE_RX_TIMEOUT_MS), rx_count);
+    if (err != ESP_OK) {
+        log_msg(TAG, "1-Wire capture timed out on GPIO %d", bus->gpio_num);
+        return err;
+    }
+    return rmt_tx_helper_wait(&bus->tx, ONEWIRE_RX_TIMEOUT_MS);
+}
+
+esp_err_t onewire_bus_reset(onewire_bus_t *bus) {
+    rmt_symbol_word_t rx_symbols[ONEWIRE_RMT_MEM_SYMBOLS];
+    size_t count = 0;
+
+    esp_err_t err = transact(bus, &reset_symbol, 1, rx_symbols, sizeof(rx_symbols), &count);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // Our own reset pulse, a short high, then the devices' presence pulse.
+    if (count >= 2 && rx_symbols[0].level0 == 0 && rx_symbols[0].level1 == 1
+        && rx_symbols[0].duration1 > ONEWIRE_PRESENCE_WAIT_MIN
+        && rx_symbols[1].level0 == 0 && rx_symbols[1].duration0 > ONEWIRE_PRESENCE_MIN) {
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t onewire_bus_write_bytes(onewire_bus_t *bus, const uint8_t *data, size_t len) {
+    if (bus == NULL || data == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    rmt_symbol_word_t symbols[8];
+    for (size_t i = 0; i < len; i++) {
+        for (int b = 0; b < 8; b++) {
+            symbols[b] = bit_symbols[(data[i] >> b) & 0x01]; // LSB first
+        }
+        esp_err_t err = rmt_tx_helper_transmit(&bus->tx, symbols, 8);
+        if (err == ESP_OK) {
+            // symbols is reused for the next byte: the copy encoder reads it
+            // while transmitting.
+            err = rmt_tx_helper_wait(&bus->tx, ONEWIRE_RX_TIMEOUT_MS);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t onewire_bus_read_bytes(onewire_bus_t *bus, uint8_t *data, size_t len) {
+    if (bus == NULL || data == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Read slots are write-1 slots: the device keeps the line low to send a 0.
+    rmt_symbol_word_t tx_symbols[8];
+    for (int b = 0; b < 8; b++) {
+        tx_symbols[b] = bit_symbols[1];
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        rmt_symbol_word_t rx_symbols[ONEWIRE_RMT_MEM_SYMBOLS];
+        size_t count = 0;
+        esp_err_t err = transact(bus, tx_symbols, 8, rx_symbols, sizeof(rx_symbols), &count);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (count < 8) {
+            log_msg(TAG, "1-Wire read: %u slots captured instead of 8", (unsigned)count);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+
+        uint8_t value = 0;
+        for (int b = 0; b < 8; b++) {
+            if (rx_symbols[b].level0 == 0 && rx_symbols[b].duration0 <= ONEWIRE_SLOT_SAMPLE) {
+                value |= (uint8_t)(1u << b);
+            }
+        }
+        data[i] = value;
+    }
+    return ESP_OK;
+}
+
+esp_err_t onewire_bus_write_bit(onewire_bus_t *bus, uint8_t bit) {
+    esp_err_t err = rmt_tx_helper_transmit(&bus->tx, &bit_symbols[bit ? 1 : 0], 1);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return rmt_tx_helper_wait(&bus->tx, ONEWIRE_RX_TIMEOUT_MS);
+}
+
+esp_err_t onewire_bus_read_bit(onewire_bus_t *bus, uint8_t *bit) {
+    rmt_symbol_word_t rx_symbols[ONEWIRE_RMT_MEM_SYMBOLS];
+    size_t count = 0;
+    esp_err_t err = transact(bus, &bit_symbols[1], 1, rx_symbols, sizeof(rx_symbols), &count);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (count < 1) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    *bit = (rx_symbols[0].level0 == 0 && rx_symbols[0].duration0 <= ONEWIRE_SLOT_SAMPLE) ? 1 : 0;
+    return ESP_OK;
+}
+
+esp_err_t onewire_bus_select(onewire_bus_t *bus, const uint8_t *rom) {
+    esp_err_t err = onewire_bus_reset(bus);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (rom == NULL) {
+        uint8_t cmd = ONEWIRE_CMD_SKIP_ROM;
+        return onewire_bus_write_bytes(bus, &cmd, 1);
+    }
+    uint8_t frame[1 + ONEWIRE_ROM_SIZE];
+    frame[0] = ONEWIRE_CMD_MATCH_ROM;
+    memcpy(&frame[1], rom, ONEWIRE_ROM_SIZE);
+    return onewire_bus_write_bytes(bus, frame, sizeof(frame));
+}
+
+// --- ROM search, bridged to the pure algorithm in onewire_rom.c ---
+
+typedef struct {
+    onewire_bus_t *bus;
+    esp_err_t err;
+} search_ctx_t;
+
+static bool search_read_bit(void *ctx, uint8_t *bit) {
+    search_ctx_t *search_ctx = (search_ctx_t *)ctx;
+    search_ctx->err = onewire_bus_read_bit(search_ctx->bus, bit);
+    return search_ctx->err == ESP_OK;
+}
+
+static bool search_write_bit(void *ctx, uint8_t bit) {
+    search_ctx_t *search_ctx = (search_ctx_t *)ctx;
+    search_ctx->err = onewire_bus_write_bit(search_ctx->bus, bit);
+    return search_ctx->err == ESP_OK;
+}
+
+esp_err_t onewire_bus_search(onewire_bus_t *bus, uint8_t (*roms)[ONEWIRE_ROM_SIZE],
+    size_t max_roms, size_t *found) {
+    if (bus == NULL || roms == NULL || found == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *found = 0;
+
+    onewire_search_t search;
+    onewire_search_init(&search);
+    search_ctx_t ctx = { .bus = bus, .err = ESP_OK };
+
+    while (*found < max_roms) {
+        esp_err_t err = onewire_bus_reset(bus);
+        if (err == ESP_ERR_NOT_FOUND) {
+            return ESP_OK; // empty bus
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        uint8_t cmd = ONEWIRE_CMD_SEARCH_ROM;
+        err = onewire_bus_write_bytes(bus, &cmd, 1);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        onewire_search_result_t result = onewire_search_next(&search, search_read_bit, search_write_bit, &ctx);
+        switch (result) {
+        case ONEWIRE_SEARCH_FOUND:
+            memcpy(roms[*found], search.rom, ONEWIRE_ROM_SIZE);
+            (*found)++;
+            break;
+        case ONEWIRE_SEARCH_CRC_ERROR:
+            // Keep walking: the remaining branches are still valid.
+            log_msg(TAG, "1-Wire search: ROM CRC mismatch, skipped");
+            break;
+        case ONEWIRE_SEARCH_BUS_ERROR:
+            return (ctx.err != ESP_OK) ? ctx.err : ESP_ERR_INVALID_RESPONSE;
+        case ONEWIRE_SEARCH_DONE:
+        case ONEWIRE_SEARCH_NO_DEVICE:
+        default:
+            return ESP_OK;
+        }
+        if (search.last_device) {
+            return ESP_OK;
+        }
+    }
+    return ESP_OK;
+}
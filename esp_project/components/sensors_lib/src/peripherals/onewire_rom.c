@@ -0,0 +1,91 @@
+#include "peripherals/onewire_rom.h"
+#include <string.h>
+
+uint8_t onewire_crc8(const uint8_t *data, size_t len) {
+    uint8_t crc = 0;
+    while (len--) {
+        uint8_t inbyte = *data++;
+        for (uint8_t i = 8; i; i--) {
+            uint8_t mix = (crc ^ inbyte) & 0x01;
+            crc >>= 1;
+            if (mix) crc ^= 0x8C;
+            inbyte >>= 1;
+        }
+    }
+    return crc;
+}
+
+bool onewire_rom_is_valid(const uint8_t rom[ONEWIRE_ROM_SIZE]) {
+    // An all-zero code has a matching CRC too, but only shows up when the
+    // line is stuck low.
+    bool all_zero = true;
+    for (size_t i = 0; i < ONEWIRE_ROM_SIZE; i++) {
+        if (rom[i] != 0) {
+            all_zero = false;
+            break;
+        }
+    }
+    return !all_zero && onewire_crc8(rom, ONEWIRE_ROM_SIZE - 1) == rom[ONEWIRE_ROM_SIZE - 1];
+}
+
+void onewire_search_init(onewire_search_t *search) {
+    memset(search, 0, sizeof(*search));
+}
+
+onewire_search_result_t onewire_search_next(onewire_search_t *search,
+    onewire_read_bit_fn read_bit, onewire_write_bit_fn write_bit, void *ctx) {
+    if (search->last_device) {
+        return ONEWIRE_SEARCH_DONE;
+    }
+
+    uint8_t last_zero = 0;
+
+    for (uint8_t position = 1; position <= ONEWIRE_ROM_SIZE * 8; position++) {
+        uint8_t byte = (position - 1) / 8;
+        uint8_t mask = (uint8_t)(1u << ((position - 1) % 8));
+
+        // Every device still in the race sends its bit, then its complement:
+        // the line is the wired-AND of all of them.
+        uint8_t id_bit, cmp_bit;
+        if (!read_bit(ctx, &id_bit) || !read_bit(ctx, &cmp_bit)) {
+            return ONEWIRE_SEARCH_BUS_ERROR;
+        }
+
+        uint8_t direction;
+        if (id_bit && cmp_bit) {
+            // Nobody left on the bus
+            return (position == 1) ? ONEWIRE_SEARCH_NO_DEVICE : ONEWIRE_SEARCH_BUS_ERROR;
+        } else if (id_bit != cmp_bit) {
+            direction = id_bit; // all remaining devices agree on this bit
+        } else {
+            // Discrepancy: before the last one, replay the previous path;
+            // on it, take the 1 branch this time; after it, take 0 first.
+            if (position < search->last_discrepancy) {
+                direction = (search->rom[byte] & mask) ? 1 : 0;
+            } else {
+                direction = (position == search->last_discrepancy) ? 1 : 0;
+            }
+            if (direction == 0) {
+                last_zero = position;
+            }
+        }
+
+        if (direction) {
+            search->rom[byte] |= mask;
+        } else {
+            search->rom[byte] &= (uint8_t)~mask;
+        }
+
+        // Devices whose bit differs from the chosen direction drop out.
+        if (!write_bit(ctx, direction)) {
+            return ONEWIRE_SEARCH_BUS_ERROR;
+        }
+    }
+
+    search->last_discrepancy = last_zero;
+    if (last_zero == 0) {
+        search->last_device = true;
+    }
+
+    return onewire_rom_is_valid(search->rom) ? ONEWIRE_SEARCH_FOUND : ONEWIRE_SEARCH_CRC_ERROR;
+}
@@ -99,6 +99,7 @@ esp_err_t pcnt_quadrature_init(pcnt_quadrature_t *encoder) {
     pcnt_unit_config_t unit_config = {
         .high_limit = encoder->high_limit,
         .low_limit = encoder->low_limit,
+        .flags.accum_count = encoder->accumulate,
     };
     err = pcnt_new_unit(&unit_config, &encoder->unit);
     if (err != ESP_OK) {
@@ -106,6 +107,19 @@ esp_err_t pcnt_quadrature_init(pcnt_quadrature_t *encoder) {
         return err;
     }
 
+    if (encoder->accumulate) {
+        // The driver only folds an overflow into its accumulator when the
+        // limit is a watch point.
+        err = pcnt_unit_add_watch_point(encoder->unit, encoder->high_limit);
+        if (err == ESP_OK) {
+            err = pcnt_unit_add_watch_point(encoder->unit, encoder->low_limit);
+        }
+        if (err != ESP_OK) {
+            log_msg(TAG, "Error (%s) adding PCNT limit watch points", esp_err_to_name(err));
+            return err;
+        }
+    }
+
     pcnt_glitch_filter_config_t filter_config = {
         .max_glitch_ns = encoder->glitch_filter_ns,
     };
@@ -175,3 +189,10 @@ esp_err_t pcnt_quadrature_drain(pcnt_quadrature_t *encoder, int32_t *delta) {
     }
     return pcnt_unit_clear_count(encoder->unit);
 }
+
+esp_err_t pcnt_quadrature_read(pcnt_quadrature_t *encoder, int32_t *position) {
+    if (encoder == NULL || position == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return pcnt_unit_get_count(encoder->unit, (int*)position);
+}
@@ -1,5 +1,6 @@
 #include "peripherals/rmt_helper.h"
 #include "log_lib.h"
+#include "driver/gpio.h"
 
 static const char *TAG = "rmt_helper_peripheral";
 
@@ -8,8 +9,8 @@ static const char *TAG = "rmt_helper_peripheral";
 static bool IRAM_ATTR rmt_rx_done_callback(rmt_channel_handle_t channel,
     const rmt_rx_done_event_data_t *edata, void *user_data) {
     (void)channel;
-    (void)edata;
     rmt_rx_helper_t *helper = (rmt_rx_helper_t *)user_data;
+    helper->received_symbols = edata->num_symbols;
     BaseType_t task_awoken = pdFALSE;
     xSemaphoreGiveFromISR(helper->done_sem, &task_awoken);
     return task_awoken == pdTRUE;
@@ -59,8 +60,8 @@ esp_err_t rmt_rx_helper_init(rmt_rx_helper_t *helper, int gpio_num,
     return ESP_OK;
 }
 
-esp_err_t rmt_rx_helper_capture(rmt_rx_helper_t *helper, rmt_symbol_word_t *buffer,
-    size_t buffer_size, uint32_t signal_min_ns, uint32_t signal_max_ns, TickType_t wait_ticks) {
+esp_err_t rmt_rx_helper_start(rmt_rx_helper_t *helper, rmt_symbol_word_t *buffer,
+    size_t buffer_size, uint32_t signal_min_ns, uint32_t signal_max_ns) {
     if (helper == NULL || buffer == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
@@ -70,37 +71,43 @@ esp_err_t rmt_rx_helper_capture(rmt_rx_helper_t *helper, rmt_symbol_word_t *buff
         .signal_range_max_ns = signal_max_ns,
     };
 
+    helper->received_symbols = 0;
     esp_err_t err = rmt_receive(helper->channel, buffer, buffer_size, &receive_config);
     if (err != ESP_OK) {
         log_msg(TAG, "Error (%s) starting RMT capture", esp_err_to_name(err));
-        return err;
     }
-
-    return (xSemaphoreTake(helper->done_sem, wait_ticks) == pdTRUE) ? ESP_OK : ESP_ERR_TIMEOUT;
+    return err;
 }
 
-// --- TX ---
-
-esp_err_t rmt_tx_helper_init(rmt_tx_helper_t *helper, int gpio_num,
-    uint32_t resolution_hz, size_t mem_block_symbols,
-    uint32_t carrier_freq_hz, float carrier_duty_cycle) {
+esp_err_t rmt_rx_helper_wait(rmt_rx_helper_t *helper, TickType_t wait_ticks, size_t *symbol_count) {
     if (helper == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
+    if (xSemaphoreTake(helper->done_sem, wait_ticks) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    if (symbol_count != NULL) {
+        *symbol_count = helper->received_symbols;
+    }
+    return ESP_OK;
+}
 
-    rmt_tx_channel_config_t tx_config = {
-        .clk_src = RMT_CLK_SRC_DEFAULT,
-        .gpio_num = gpio_num,
-        .mem_block_symbols = mem_block_symbols,
-        .resolution_hz = resolution_hz,
-        .trans_queue_depth = 4,
-        .flags.invert_out = false,
-        .flags.with_dma = false,
-    };
+esp_err_t rmt_rx_helper_capture(rmt_rx_helper_t *helper, rmt_symbol_word_t *buffer,
+    size_t buffer_size, uint32_t signal_min_ns, uint32_t signal_max_ns, TickType_t wait_ticks) {
+    esp_err_t err = rmt_rx_helper_start(helper, buffer, buffer_size, signal_min_ns, signal_max_ns);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return rmt_rx_helper_wait(helper, wait_ticks, NULL);
+}
 
-    esp_err_t err = rmt_new_tx_channel(&tx_config, &helper->channel);
+// --- TX ---
+
+static esp_err_t tx_helper_setup(rmt_tx_helper_t *helper, const rmt_tx_channel_config_t *tx_config,
+    uint32_t carrier_freq_hz, float carrier_duty_cycle) {
+    esp_err_t err = rmt_new_tx_channel(tx_config, &helper->channel);
     if (err != ESP_OK) {
-        log_msg(TAG, "Error (%s) creating RMT TX channel on GPIO %d", esp_err_to_name(err), gpio_num);
+        log_msg(TAG, "Error (%s) creating RMT TX channel on GPIO %d", esp_err_to_name(err), tx_config->gpio_num);
         return err;
     }
 
@@ -128,12 +135,69 @@ esp_err_t rmt_tx_helper_init(rmt_tx_helper_t *helper, int gpio_num,
         log_msg(TAG, "Error (%s) creating RMT copy encoder", esp_err_to_name(err));
         return err;
     }
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_helper_init(rmt_tx_helper_t *helper, int gpio_num,
+    uint32_t resolution_hz, size_t mem_block_symbols,
+    uint32_t carrier_freq_hz, float carrier_duty_cycle) {
+    if (helper == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    rmt_tx_channel_config_t tx_config = {
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .gpio_num = gpio_num,
+        .mem_block_symbols = mem_block_symbols,
+        .resolution_hz = resolution_hz,
+        .trans_queue_depth = 4,
+        .flags.invert_out = false,
+        .flags.with_dma = false,
+    };
+
+    helper->idle_level = 0;
+    esp_err_t err = tx_helper_setup(helper, &tx_config, carrier_freq_hz, carrier_duty_cycle);
+    if (err != ESP_OK) {
+        return err;
+    }
 
     log_msg(TAG, "RMT TX channel initialized on GPIO %d%s", gpio_num,
         carrier_freq_hz > 0 ? " (with carrier)" : "");
     return ESP_OK;
 }
 
+esp_err_t rmt_tx_helper_init_open_drain(rmt_tx_helper_t *helper, int gpio_num,
+    uint32_t resolution_hz, size_t mem_block_symbols) {
+    if (helper == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    rmt_tx_channel_config_t tx_config = {
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .gpio_num = gpio_num,
+        .mem_block_symbols = mem_block_symbols,
+        .resolution_hz = resolution_hz,
+        .trans_queue_depth = 4,
+        .flags.invert_out = false,
+        .flags.with_dma = false,
+        .flags.io_loop_back = true, // RX on the same pin sees the line
+        .flags.io_od_mode = true,   // devices can pull the line low
+    };
+
+    helper->idle_level = 1; // released: the pull-up keeps the bus high
+    esp_err_t err = tx_helper_setup(helper, &tx_config, 0, 0.0f);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // The bus needs a pull-up; the internal one is enough for short wires,
+    // add an external 4.7k for anything longer.
+    gpio_pullup_en(gpio_num);
+
+    log_msg(TAG, "RMT open-drain TX channel initialized on GPIO %d", gpio_num);
+    return ESP_OK;
+}
+
 esp_err_t rmt_tx_helper_transmit(rmt_tx_helper_t *helper, const rmt_symbol_word_t *symbols, size_t symbol_count) {
     if (helper == NULL || symbols == NULL) {
         return ESP_ERR_INVALID_ARG;
@@ -141,8 +205,16 @@ esp_err_t rmt_tx_helper_transmit(rmt_tx_helper_t *helper, const rmt_symbol_word_
 
     rmt_transmit_config_t transmit_config = {
         .loop_count = 0, // send once
+        .flags.eot_level = helper->idle_level,
     };
 
     return rmt_transmit(helper->channel, helper->encoder,
         symbols, symbol_count * sizeof(rmt_symbol_word_t), &transmit_config);
 }
+
+esp_err_t rmt_tx_helper_wait(rmt_tx_helper_t *helper, int timeout_ms) {
+    if (helper == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return rmt_tx_wait_all_done(helper->channel, timeout_ms);
+}
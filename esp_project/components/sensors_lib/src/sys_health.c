@@ -0,0 +1,283 @@
+#include "sys_health.h"
+#include "sensors_lib.h"
+#include "task_load.h"
+#include "log_lib.h"
+#include <string.h>
+
+#if CONFIG_USE_UDPLIB
+#include "udp_lib.h"
+#endif
+
+#if CONFIG_USE_WIFI
+#include "wifi_lib.h"
+#endif
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "soc/soc_caps.h"
+
+static const char *TAG = "sys_health";
+
+#if CONFIG_USE_ESP
+
+#include "espnow_lib.h"
+#include "cmd_lib.h"
+#include "h_bridge.h"
+#include "servo.h"
+
+#if SOC_TEMP_SENSOR_SUPPORTED
+#include "driver/temperature_sensor.h"
+#endif
+
+#define SYS_HEALTH_QUEUES_MAX 8
+#define SYS_HEALTH_FRAME_MAX (HEADER_SENSOR_SIZE + SYS_HEALTH_FIXED_SIZE \
+    + SYS_HEALTH_QUEUES_MAX * SYS_HEALTH_QUEUE_RECORD_SIZE + 1 \
+    + TASK_LOAD_MAX_TASKS * (SYS_HEALTH_TASK_RECORD_SIZE + configMAX_TASK_NAME_LEN))
+#define SYS_HEALTH_LOG_TASKS 5 // busiest tasks logged with CONFIG_FREE_RTOS_TASK_DEBUG
+
+// sampler task only
+static uint8_t frame[SYS_HEALTH_FRAME_MAX];
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+static TaskStatus_t tasks[TASK_LOAD_MAX_TASKS];
+static task_load_sample_t samples[TASK_LOAD_MAX_TASKS];
+static uint16_t loads[TASK_LOAD_MAX_TASKS];
+static task_load_info_t infos[TASK_LOAD_MAX_TASKS];
+static task_load_t task_load;
+#endif
+#if SOC_TEMP_SENSOR_SUPPORTED
+static temperature_sensor_handle_t tsens = NULL;
+#endif
+
+static size_t put_u32(uint8_t *buf, uint32_t value) {
+    memcpy(buf, &value, sizeof(value));
+    return sizeof(value);
+}
+
+static size_t put_u16(uint8_t *buf, uint16_t value) {
+    memcpy(buf, &value, sizeof(value));
+    return sizeof(value);
+}
+
+static size_t put_f32(uint8_t *buf, float value) {
+    memcpy(buf, &value, sizeof(value));
+    return sizeof(value);
+}
+
+/**
+ * Sample every task and write the task section.
+ *
+ * @param core_load per core load (per-mille), from the idle tasks
+ * @return bytes written
+ */
+static size_t encode_tasks(uint8_t *buf, size_t capacity, uint16_t *core_load) {
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    uint32_t total = 0;
+    // 0 if the array is too small: no task section rather than a partial one
+    UBaseType_t count = uxTaskGetSystemState(tasks, TASK_LOAD_MAX_TASKS, &total);
+    if (count == 0) {
+        static bool warned = false;
+        if (!warned) {
+            log_msg_lvl(ESP_LOG_WARN, TAG, "More than %d tasks, task section left out", TASK_LOAD_MAX_TASKS);
+            warned = true;
+        }
+        buf[0] = 0;
+        return 1;
+    }
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    for (UBaseType_t i = 0; i < count; i++) {
+        samples[i].id = (uint32_t)tasks[i].xTaskNumber;
+        samples[i].runtime = (uint32_t)tasks[i].ulRunTimeCounter;
+    }
+    bool has_load = task_load_update(&task_load, samples, count, total, loads);
+#else
+    bool has_load = false;
+#endif
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t *t = &tasks[i];
+        for (BaseType_t core = 0; core < configNUMBER_OF_CORES && has_load; core++) {
+            if (t->xHandle == xTaskGetIdleTaskHandleForCore(core)) {
+                core_load[core] = loads[i] < 1000 ? 1000 - loads[i] : 0;
+            }
+        }
+        BaseType_t core = xTaskGetCoreID(t->xHandle);
+        infos[i] = (task_load_info_t){
+            .id = (uint32_t)t->xTaskNumber,
+            .core = core < configNUMBER_OF_CORES ? (uint8_t)core : 0xFF,
+            .priority = (uint8_t)t->uxCurrentPriority,
+            .state = (uint8_t)t->eCurrentState,
+            .stack_hwm = (uint32_t)t->usStackHighWaterMark,
+            .name = t->pcTaskName,
+            .name_len = strnlen(t->pcTaskName, configMAX_TASK_NAME_LEN),
+        };
+    }
+    size_t len = task_load_encode(infos, has_load ? loads : NULL, count, buf, capacity);
+
+#if CONFIG_FREE_RTOS_TASK_DEBUG
+    if (has_load) {
+        // busiest first, selection over a handful of entries
+        bool shown[TASK_LOAD_MAX_TASKS] = {0};
+        for (int n = 0; n < SYS_HEALTH_LOG_TASKS && n < (int)count; n++) {
+            int best = -1;
+            for (UBaseType_t i = 0; i < count; i++) {
+                if (!shown[i] && (best < 0 || loads[i] > loads[best])) {
+                    best = (int)i;
+                }
+            }
+            shown[best] = true;
+            log_msg(TAG, "%-16s %3u.%u%% prio %2u stack free %5" PRIu32 " B", tasks[best].pcTaskName,
+                loads[best] / 10, loads[best] % 10, (unsigned)tasks[best].uxCurrentPriority,
+                (uint32_t)tasks[best].usStackHighWaterMark);
+        }
+    }
+#endif
+    return len;
+#else
+    (void)capacity;
+    (void)core_load;
+    buf[0] = 0;
+    return 1;
+#endif
+}
+
+static size_t encode_queue(uint8_t *buf, uint8_t id, esp_err_t err, uint8_t waiting, uint8_t length) {
+    if (err != ESP_OK) {
+        return 0;
+    }
+    buf[0] = id;
+    buf[1] = waiting;
+    buf[2] = length;
+    return SYS_HEALTH_QUEUE_RECORD_SIZE;
+}
+
+static size_t encode_frame(uint8_t *buf, size_t capacity) {
+    size_t len = 0;
+    uint16_t core_load[2] = {0};
+
+    // Base layout
+    float temp_c = 0.0f;
+#if SOC_TEMP_SENSOR_SUPPORTED
+    if (tsens != NULL) {
+        temperature_sensor_get_celsius(tsens, &temp_c);
+    }
+#endif
+    len += put_f32(&buf[len], temp_c);
+    int rssi = 0;
+#if CONFIG_USE_WIFI
+    sta_get_rssi(&rssi);
+#endif
+    buf[len++] = (uint8_t)(int8_t)rssi;
+    buf[len++] = (uint8_t)esp_reset_reason();
+    len += put_u32(&buf[len], (uint32_t)heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    len += put_u32(&buf[len], (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+    len += put_u32(&buf[len], (uint32_t)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    len += put_u32(&buf[len], (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+    uint8_t angle = 0;
+    get_servo_angle(&angle);
+    buf[len++] = angle;
+    int16_t motor = 0;
+    get_motor_percent(&motor);
+    len += put_u16(&buf[len], (uint16_t)motor);
+#if CONFIG_USE_UDPLIB
+    len += put_u32(&buf[len], (uint32_t)get_command_packet_received());
+#else
+    len += put_u32(&buf[len], 0);
+#endif
+    size_t core_load_at = len; // known once the tasks are sampled
+    len += 2 * sizeof(float);
+    buf[len++] = (uint8_t)get_drive_mode();
+
+    // Extension
+    buf[len++] = SYS_HEALTH_VERSION;
+    len += put_u32(&buf[len], (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    len += put_u32(&buf[len], (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+#if CONFIG_USE_UDPLIB
+    udp_stats_t udp = {0};
+    udp_get_stats(&udp);
+    len += put_u32(&buf[len], udp.tx_frames);
+    len += put_u32(&buf[len], udp.tx_bytes);
+    len += put_u32(&buf[len], udp.tx_errors);
+    len += put_u32(&buf[len], udp.tx_dropped);
+    len += put_u32(&buf[len], udp.rx_frames);
+    len += put_u32(&buf[len], udp.rx_bytes);
+#else
+    memset(&buf[len], 0, 6 * sizeof(uint32_t));
+    len += 6 * sizeof(uint32_t);
+#endif
+    uint32_t reconnects = 0;
+#if CONFIG_USE_WIFI
+    wifi_sta_stats_t wifi = {0};
+    if (wifi_get_sta_stats(&wifi) == ESP_OK) {
+        reconnects = wifi.reconnects;
+    }
+#endif
+    len += put_u32(&buf[len], reconnects);
+
+    size_t queue_count_at = len++;
+    uint8_t waiting = 0, length = 0;
+#if CONFIG_USE_UDPLIB
+    for (uint8_t ch = UDP_CHANNEL_SENSORS; ch <= UDP_CHANNEL_DUMP; ch++) {
+        esp_err_t err = udp_get_queue_fill((udp_channel_t)ch, &waiting, &length);
+        len += encode_queue(&buf[len], SYS_HEALTH_QUEUE_UDP | ch, err, waiting, length);
+    }
+#endif
+    for (uint8_t q = 0; q < ESPNOW_QUEUE_COUNT; q++) {
+        esp_err_t err = espnow_get_queue_fill((espnow_queue_t)q, &waiting, &length);
+        len += encode_queue(&buf[len], SYS_HEALTH_QUEUE_ESPNOW | q, err, waiting, length);
+    }
+    buf[queue_count_at] = (uint8_t)((len - queue_count_at - 1) / SYS_HEALTH_QUEUE_RECORD_SIZE);
+
+    len += encode_tasks(&buf[len], capacity - len, core_load);
+    put_f32(&buf[core_load_at], core_load[0] / 10.0f);
+    put_f32(&buf[core_load_at + sizeof(float)], configNUMBER_OF_CORES > 1 ? core_load[1] / 10.0f : 0.0f);
+    return len;
+}
+
+static void sys_health_task(void *params) {
+    (void)params;
+    TickType_t last_wake = xTaskGetTickCount();
+
+    while (true) {
+        header_sensor_t header = {0};
+        header.esp_id = (uint8_t)CONFIG_ESP_ID;
+        header.timestamp = (uint32_t)(esp_timer_get_time() / 1000);
+        header.type = SENSOR_TYPE_ESP;
+        serialize_header(&header, frame);
+        size_t len = encode_frame(&frame[HEADER_SENSOR_SIZE], sizeof(frame) - HEADER_SENSOR_SIZE);
+#if CONFIG_USE_UDPLIB
+        send_udp_sensor(frame, HEADER_SENSOR_SIZE + len);
+#else
+        (void)len;
+#endif
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONFIG_ESP_HEALTH_PERIOD_MS));
+    }
+}
+
+esp_err_t init_sys_health(void) {
+#if SOC_TEMP_SENSOR_SUPPORTED
+    temperature_sensor_config_t tsens_cfg = TEMPERATURE_SENSOR_CONFIG_DEFAULT(-10, 80);
+    esp_err_t err = temperature_sensor_install(&tsens_cfg, &tsens);
+    if (err == ESP_OK) {
+        err = temperature_sensor_enable(tsens);
+    }
+    if (err != ESP_OK) {
+        log_msg(TAG, "Error (%s) starting the chip temperature sensor", esp_err_to_name(err));
+        tsens = NULL;
+    }
+#endif
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    task_load_init(&task_load);
+#endif
+    return xTaskCreate(sys_health_task, "sys_health_task", 4096, NULL, SYS_HEALTH_TASK_PRIORITY, NULL) == pdPASS
+        ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+#else // !CONFIG_USE_ESP
+
+esp_err_t init_sys_health(void) { return ESP_ERR_NOT_SUPPORTED; }
+
+#endif // CONFIG_USE_ESP
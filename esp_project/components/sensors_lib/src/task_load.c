@@ -0,0 +1,69 @@
+#include "task_load.h"
+#include <string.h>
+
+void task_load_init(task_load_t *tl) {
+    memset(tl, 0, sizeof(*tl));
+}
+
+static const task_load_sample_t *find_prev(const task_load_t *tl, uint32_t id) {
+    for (size_t i = 0; i < tl->prev_count; i++) {
+        if (tl->prev[i].id == id) {
+            return &tl->prev[i];
+        }
+    }
+    return NULL;
+}
+
+bool task_load_update(task_load_t *tl, const task_load_sample_t *samples, size_t count,
+    uint32_t total_runtime, uint16_t *permille) {
+    bool computed = tl->primed;
+    if (computed) {
+        uint32_t elapsed = total_runtime - tl->prev_total;
+        for (size_t i = 0; i < count; i++) {
+            const task_load_sample_t *prev = find_prev(tl, samples[i].id);
+            uint32_t ran = samples[i].runtime - (prev != NULL ? prev->runtime : 0);
+            uint64_t load = elapsed > 0 ? (uint64_t)ran * 1000 / elapsed : 0;
+            // counters are read one task after the other: clamp the jitter
+            permille[i] = (uint16_t)(load > 1000 ? 1000 : load);
+        }
+    }
+
+    tl->prev_count = count < TASK_LOAD_MAX_TASKS ? count : TASK_LOAD_MAX_TASKS;
+    memcpy(tl->prev, samples, tl->prev_count * sizeof(task_load_sample_t));
+    tl->prev_total = total_runtime;
+    tl->primed = true;
+    return computed;
+}
+
+size_t task_load_encode(const task_load_info_t *tasks, const uint16_t *loads, size_t count,
+    uint8_t *buf, size_t capacity) {
+    if (capacity == 0) {
+        return 0;
+    }
+    size_t len = 1;
+    uint8_t written = 0;
+    for (size_t i = 0; i < count && written < UINT8_MAX; i++) {
+        const task_load_info_t *t = &tasks[i];
+        size_t name_len = t->name_len > UINT8_MAX ? UINT8_MAX : t->name_len;
+        if (len + TASK_LOAD_RECORD_SIZE + name_len > capacity) {
+            break;
+        }
+        uint16_t load = loads != NULL ? loads[i] : TASK_LOAD_UNKNOWN;
+        uint16_t hwm = (uint16_t)(t->stack_hwm > UINT16_MAX ? UINT16_MAX : t->stack_hwm);
+        buf[len++] = (uint8_t)t->id;
+        buf[len++] = (uint8_t)(t->id >> 8);
+        buf[len++] = t->core;
+        buf[len++] = t->priority;
+        buf[len++] = t->state;
+        buf[len++] = (uint8_t)load;
+        buf[len++] = (uint8_t)(load >> 8);
+        buf[len++] = (uint8_t)hwm;
+        buf[len++] = (uint8_t)(hwm >> 8);
+        buf[len++] = (uint8_t)name_len;
+        memcpy(&buf[len], t->name, name_len);
+        len += name_len;
+        written++;
+    }
+    buf[0] = written;
+    return len;
+}
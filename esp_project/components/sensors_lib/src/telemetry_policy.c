@@ -0,0 +1,86 @@
+#include "telemetry_policy.h"
+#include <string.h>
+
+void telemetry_policy_init(telemetry_policy_t *policy, const telemetry_policy_config_t *cfg) {
+    memset(policy, 0, sizeof(*policy));
+    policy->cfg = *cfg;
+}
+
+void telemetry_policy_configure(telemetry_policy_t *policy, const telemetry_policy_config_t *cfg) {
+    policy->cfg = *cfg;
+    policy->has_sent = false;
+}
+
+static telemetry_decision_t record(telemetry_policy_t *policy, telemetry_decision_t decision,
+    const int32_t *values, uint8_t count, uint32_t now_ms) {
+    memcpy(policy->last_sent, values, count * sizeof(int32_t));
+    policy->value_count = count;
+    policy->last_sent_ms = now_ms;
+    policy->has_sent = true;
+    policy->published++;
+    if (decision == TELEMETRY_SEND_DELTA) {
+        policy->deltas++;
+    }
+    return decision;
+}
+
+telemetry_decision_t telemetry_policy_evaluate(telemetry_policy_t *policy, const int32_t *values,
+    uint8_t count, uint32_t now_ms, int16_t *deltas) {
+    if (count > TELEMETRY_POLICY_MAX_VALUES) {
+        count = TELEMETRY_POLICY_MAX_VALUES;
+    }
+    policy->offered++;
+
+    // Nothing to compare against yet (or the reading changed shape).
+    if (!policy->has_sent || count != policy->value_count) {
+        return record(policy, TELEMETRY_SEND_FULL, values, count, now_ms);
+    }
+
+    uint32_t elapsed = now_ms - policy->last_sent_ms; // wrap-safe
+    if (elapsed < policy->cfg.min_interval_ms) {
+        return TELEMETRY_SKIP;
+    }
+    // Heartbeats are always full frames: they also repair a lost delta.
+    if (policy->cfg.max_interval_ms > 0 && elapsed >= policy->cfg.max_interval_ms) {
+        return record(policy, TELEMETRY_SEND_FULL, values, count, now_ms);
+    }
+
+    bool changed = false;
+    bool fits_delta = true;
+    for (uint8_t i = 0; i < count; i++) {
+        int64_t diff = (int64_t)values[i] - policy->last_sent[i];
+        int64_t magnitude = diff < 0 ? -diff : diff;
+        int32_t deadband = policy->cfg.deadband[i];
+        if (deadband < 0 || magnitude > deadband) {
+            changed = true;
+        }
+        if (diff < INT16_MIN || diff > INT16_MAX) {
+            fits_delta = false;
+        }
+    }
+    if (!changed) {
+        return TELEMETRY_SKIP;
+    }
+
+    if (policy->cfg.delta_encoding && fits_delta && deltas != NULL) {
+        for (uint8_t i = 0; i < count; i++) {
+            deltas[i] = (int16_t)(values[i] - policy->last_sent[i]);
+        }
+        return record(policy, TELEMETRY_SEND_DELTA, values, count, now_ms);
+    }
+    return record(policy, TELEMETRY_SEND_FULL, values, count, now_ms);
+}
+
+uint8_t telemetry_policy_suppression_pct(const telemetry_policy_t *policy) {
+    if (policy->offered == 0) {
+        return 0;
+    }
+    uint32_t suppressed = policy->offered - policy->published;
+    return (uint8_t)(((uint64_t)suppressed * 100) / policy->offered);
+}
+
+void telemetry_policy_reset_stats(telemetry_policy_t *policy) {
+    policy->offered = 0;
+    policy->published = 0;
+    policy->deltas = 0;
+}
@@ -1,6 +1,8 @@
 #include "vl53l1x.h"
 #include "sensors_lib.h"
 #include "peripherals/i2c_helper.h"
+#include "peripherals/gpio_digital.h"
+#include "vl53l1x_zones.h"
 #include "log_lib.h"
 #include <string.h>
 
@@ -40,6 +42,19 @@ static const char *TAG = "vl53l1x_sensor";
 #define REG_GPIO_HV_MUX_CTRL 0x0030
 #define REG_GPIO_TIO_HV_STATUS 0x0031
 
+// --- Timing / ROI registers, addresses from ST's ULD API (VL53L1X_api.h) ---
+#define REG_RANGE_CONFIG_TIMEOUT_MACROP_A_HI 0x005E
+#define REG_RANGE_CONFIG_TIMEOUT_MACROP_B_HI 0x0061
+#define REG_SYSTEM_INTERMEASUREMENT_PERIOD   0x006C
+#define REG_ROI_CONFIG_USER_ROI_CENTRE_SPAD  0x007F
+#define REG_ROI_CONFIG_USER_ROI_XY_SIZE      0x0080
+#define REG_RESULT_OSC_CALIBRATE_VAL         0x00DE
+
+// Extra time granted to GPIO1 on top of the inter-measurement period before
+// falling back to a status register poll (missed edge / hung sensor).
+#define VL53L1X_IRQ_MARGIN_MS 50
+#define VL53L1X_HUNG_TIMEOUTS 10
+
 static i2c_master_dev_handle_t dev;
 
 static esp_err_t wait_for_boot(void) {
@@ -82,7 +97,9 @@ static esp_err_t reset_vhv_config(void) {
     return ESP_OK;
 }
 
-// Configuration de la ROI (Zone d'intérêt) - Registres ST 0x004F à 0x0052
+// Configuration de la ROI (Zone d'intérêt) - registres ST 0x007F / 0x0080
+// (ROI_CONFIG__USER_ROI_CENTRE_SPAD / ROI_CONFIG__USER_ROI_REQUESTED_GLOBAL_XY_SIZE,
+// same as VL53L1X_SetROI() in the ULD API)
 static esp_err_t set_roi(uint8_t width, uint8_t height, uint8_t center_spad) {
     if (width < 4) width = 4;
     if (height < 4) height = 4;
@@ -90,10 +107,10 @@ static esp_err_t set_roi(uint8_t width, uint8_t height, uint8_t center_spad) {
     if (height > 16) height = 16;
 
     uint8_t reg_val = ((height - 1) << 4) | (width - 1);
-    esp_err_t err = i2c_bus_write_reg16addr(dev, 0x004F, reg_val); // ROI config
+    esp_err_t err = i2c_bus_write_reg16addr(dev, REG_ROI_CONFIG_USER_ROI_XY_SIZE, reg_val);
     if (err != ESP_OK) return err;
 
-    return i2c_bus_write_reg16addr(dev, 0x0050, center_spad); // Center SPAD
+    return i2c_bus_write_reg16addr(dev, REG_ROI_CONFIG_USER_ROI_CENTRE_SPAD, center_spad);
 }
 
 // Exemple pour configurer le mode SHORT (registres issus du driver officiel ST / Pololu)
@@ -126,6 +143,53 @@ static esp_err_t set_distance_mode_short(void) {
     return ESP_OK;
 }
 
+// Macro-period timeouts (A, B) per timing budget, short distance mode.
+// Values from ST's ULD VL53L1X_SetTimingBudgetInMs(): the budget is not a
+// raw millisecond register, it is encoded against the VCSEL periods set by
+// set_distance_mode_short(), so only these budgets are available.
+static const struct { uint16_t budget_ms; uint16_t macrop_a; uint16_t macrop_b; } TIMING_BUDGETS_SHORT[] = {
+    {  15, 0x001D, 0x0027 },
+    {  20, 0x0051, 0x006E },
+    {  33, 0x00D6, 0x006E },
+    {  50, 0x01AE, 0x01E8 },
+    { 100, 0x02E1, 0x0388 },
+    { 200, 0x03E1, 0x0496 },
+    { 500, 0x0591, 0x05C1 },
+};
+
+static esp_err_t set_timing_budget_ms(uint16_t budget_ms) {
+    for (size_t i = 0; i < sizeof(TIMING_BUDGETS_SHORT) / sizeof(TIMING_BUDGETS_SHORT[0]); i++) {
+        if (TIMING_BUDGETS_SHORT[i].budget_ms != budget_ms) {
+            continue;
+        }
+        uint8_t macrop_a[] = { (uint8_t)(TIMING_BUDGETS_SHORT[i].macrop_a >> 8), (uint8_t)TIMING_BUDGETS_SHORT[i].macrop_a };
+        uint8_t macrop_b[] = { (uint8_t)(TIMING_BUDGETS_SHORT[i].macrop_b >> 8), (uint8_t)TIMING_BUDGETS_SHORT[i].macrop_b };
+        esp_err_t err = i2c_bus_write_block16addr(dev, REG_RANGE_CONFIG_TIMEOUT_MACROP_A_HI, macrop_a, 2);
+        if (err != ESP_OK) return err;
+        return i2c_bus_write_block16addr(dev, REG_RANGE_CONFIG_TIMEOUT_MACROP_B_HI, macrop_b, 2);
+    }
+    log_msg(TAG, "Unsupported timing budget %u ms", budget_ms);
+    return ESP_ERR_INVALID_ARG;
+}
+
+static esp_err_t set_inter_measurement_ms(uint32_t inter_measurement_ms) {
+    uint8_t osc_buf[2];
+    esp_err_t err = i2c_bus_read_reg16addr(dev, REG_RESULT_OSC_CALIBRATE_VAL, osc_buf, 2);
+    if (err != ESP_OK) return err;
+    uint16_t clock_pll = ((uint16_t)osc_buf[0] << 8 | osc_buf[1]) & 0x03FF;
+
+    // Calcul précis ST : ClockPLL * InterMeasurementMs * 1.075
+    uint32_t clock_cycles = (uint32_t)(clock_pll * inter_measurement_ms * 1.075f);
+
+    uint8_t inter_meas_buf[4] = {
+        (uint8_t)(clock_cycles >> 24),
+        (uint8_t)(clock_cycles >> 16),
+        (uint8_t)(clock_cycles >> 8),
+        (uint8_t)(clock_cycles & 0xFF)
+    };
+    return i2c_bus_write_block16addr(dev, REG_SYSTEM_INTERMEASUREMENT_PERIOD, inter_meas_buf, 4);
+}
+
 // 91-byte factory default configuration table, loaded starting at 0x002D.
 // Matches ST's official VL51L1X_DEFAULT_CONFIGURATION array size and content.
 static const uint8_t DEFAULT_CONFIG[] = {
@@ -165,6 +229,50 @@ static const uint8_t ST_STATUS_LOOKUP[] = {
     255, 255, 10, 6, 255, 255, 11, 12
 };
 
+static gpio_edge_input_t gpio1 = { .pin = VL53L1X_GPIO1_GPIO };
+
+#if CONFIG_VL53L1X_MULTIZONE
+
+#define VL53L1X_RATE_LOG_SWEEPS 50 // log the measured per-zone rate every N sweeps
+
+static vl53l1x_zone_seq_t zones;
+static int64_t sweep_start_us = 0;
+static uint32_t sweep_count = 0;
+
+/**
+ * Send the sweep that just completed as one packed zone-distance frame,
+ * and keep track of the actual per-zone update rate.
+ */
+static void send_zone_frame(void) {
+    int64_t now_us = esp_timer_get_time();
+    uint16_t sweep_ms = 0;
+    if (sweep_start_us != 0) {
+        int64_t elapsed_ms = (now_us - sweep_start_us) / 1000;
+        sweep_ms = (elapsed_ms > UINT16_MAX) ? UINT16_MAX : (uint16_t)elapsed_ms;
+    }
+    sweep_start_us = now_us;
+
+    header_sensor_t header = {0};
+    header.esp_id = (uint8_t)CONFIG_ESP_ID;
+    header.timestamp = (uint32_t)(now_us / 1000);
+    header.type = SENSOR_TYPE_VL53L1X_ZONES;
+    uint8_t buf[HEADER_SENSOR_SIZE + VL53L1X_ZONE_FRAME_SIZE(VL53L1X_ZONES_MAX)];
+    serialize_header(&header, buf);
+    size_t len = vl53l1x_zone_frame_pack(&zones, sweep_ms, &buf[HEADER_SENSOR_SIZE], sizeof(buf) - HEADER_SENSOR_SIZE);
+
+#if CONFIG_USE_UDPLIB
+    send_udp_sensor(buf, HEADER_SENSOR_SIZE + len);
+#endif
+
+    sweep_count++;
+    if (sweep_ms != 0 && sweep_count % VL53L1X_RATE_LOG_SWEEPS == 0) {
+        log_msg(TAG, "Zone sweep %ums (%d zones): %.1f zones/s, %.2f Hz per zone",
+            sweep_ms, zones.zone_count, zones.zone_count * 1000.0f / sweep_ms, 1000.0f / sweep_ms);
+    }
+}
+
+#endif // CONFIG_VL53L1X_MULTIZONE
+
 static void vl53l1x_task(void *params) {
     (void)params;
 
@@ -214,52 +322,49 @@ static void vl53l1x_task(void *params) {
         return;
     }
 
-    if (set_roi(8, 8, 199) != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error setting distance mode");
+#if CONFIG_VL53L1X_MULTIZONE
+    if (!vl53l1x_zone_seq_init(&zones, VL53L1X_ZONES_COLS, VL53L1X_ZONES_ROWS)) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Unsupported zone grid %dx%d", VL53L1X_ZONES_COLS, VL53L1X_ZONES_ROWS);
         vTaskDelete(NULL);
         return;
     }
-
-    // Timing budget intentionally NOT set here. ST's real
-    // SetMeasurementTimingBudgetMicroSeconds() encodes the value through a
-    // macro-period calculation that depends on the currently configured
-    // VCSEL period (UM2356 section 2.4) — it is not a raw millisecond
-    // value written directly to a register. Writing an un-encoded value
-    // there produces an undefined, not a 50ms, budget. The default
-    // configuration table already sets a valid working timing mode; if you
-    // need a specific budget, port ST's SetMeasurementTimingBudget logic
-    // rather than hand-writing these registers.
-
-    esp_err_t err;
-
-    uint8_t osc_buf[2];
-    err= i2c_bus_read_reg16addr(dev, 0x00DE, osc_buf, 2);
+    uint32_t inter_measurement_ms = VL53L1X_ZONES_INTER_MEASUREMENT_MS;
+    esp_err_t err = set_roi(zones.roi_width, zones.roi_height, zones.centers[0]);
+#else
+    uint32_t inter_measurement_ms = VL53L1X_INTER_MEASUREMENT_MS;
+    esp_err_t err = set_roi(8, 8, 199);
+#endif
     if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Failed to set inter-measurement period");
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error setting ROI");
         vTaskDelete(NULL);
         return;
     }
-    uint16_t clock_pll = ((uint16_t)osc_buf[0] << 8 | osc_buf[1]) & 0x03FF;
 
-    // Calcul précis ST : ClockPLL * InterMeasurementMs * 1.075
-    uint32_t inter_measurement_ms = 100; // Utiliser au moins 100ms pour éviter le dépassement du Timing Budget
-    uint32_t clock_cycles = (uint32_t)(clock_pll * inter_measurement_ms * 1.075f);
+    if (inter_measurement_ms < VL53L1X_TIMING_BUDGET_MS) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "Inter-measurement period (%" PRIu32 " ms) shorter than timing budget (%d ms), clamping",
+            inter_measurement_ms, VL53L1X_TIMING_BUDGET_MS);
+        inter_measurement_ms = VL53L1X_TIMING_BUDGET_MS;
+    }
 
-    uint8_t inter_meas_buf[4] = {
-        (uint8_t)(clock_cycles >> 24),
-        (uint8_t)(clock_cycles >> 16),
-        (uint8_t)(clock_cycles >> 8),
-        (uint8_t)(clock_cycles & 0xFF)
-    };
+    if (set_timing_budget_ms(VL53L1X_TIMING_BUDGET_MS) != ESP_OK) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Failed to set timing budget");
+        vTaskDelete(NULL);
+        return;
+    }
 
-    // Registre SYSTEM__INTERMEASUREMENT_PERIOD = 0x006C
-    err = i2c_bus_write_block16addr(dev, 0x006C, inter_meas_buf, 4);
-    if (err != ESP_OK) {
+    if (set_inter_measurement_ms(inter_measurement_ms) != ESP_OK) {
         log_msg_lvl(ESP_LOG_ERROR, TAG, "Failed to set inter-measurement period");
         vTaskDelete(NULL);
         return;
     }
 
+    if (gpio_edge_input_init(&gpio1, GPIO_INTR_NEGEDGE) != ESP_OK) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Failed to set up GPIO1 interrupt");
+        vTaskDelete(NULL);
+        return;
+    }
+    gpio_set_pull_mode(VL53L1X_GPIO1_GPIO, GPIO_PULLUP_ONLY); // open-drain output on the sensor side
+
     err = i2c_bus_write_reg16addr(dev, REG_SYSTEM_MODE_START, 0x40); // start continuous ranging
     if (err != ESP_OK) {
         vTaskDelete(NULL);
@@ -274,13 +379,21 @@ static void vl53l1x_task(void *params) {
         return;
     }
 
-    log_msg(TAG, "VL53L1X initialized at address 0x%02X (XSHUT: GPIO%d)", VL53L1X_I2C_ADDR, VL53L1X_XSHUT_GPIO);
+    log_msg(TAG, "VL53L1X initialized at address 0x%02X (XSHUT: GPIO%d, GPIO1: GPIO%d, budget %d ms, period %" PRIu32 " ms)",
+        VL53L1X_I2C_ADDR, VL53L1X_XSHUT_GPIO, VL53L1X_GPIO1_GPIO, VL53L1X_TIMING_BUDGET_MS, inter_measurement_ms);
 
+    TickType_t irq_timeout = pdMS_TO_TICKS(inter_measurement_ms + VL53L1X_IRQ_MARGIN_MS);
     uint8_t ready_timeout_count = 0;
 
     while (true) {
-        bool ready = false;
-        if (data_ready(&ready) == ESP_OK && ready) 
+        bool ready = (gpio_edge_input_wait(&gpio1, irq_timeout) == ESP_OK);
+        if (!ready) {
+            // Edge missed (e.g. fired before the ISR was armed): the status
+            // register still tells whether a result is waiting.
+            data_ready(&ready);
+        }
+
+        if (ready) 
         {
             ready_timeout_count = 0; // Réinitialise le compteur sur succès
 
@@ -299,6 +412,15 @@ static void vl53l1x_task(void *params) {
             }
             uint16_t distance_mm = (uint16_t)((dist_raw[0] << 8) | dist_raw[1]);
 
+#if CONFIG_VL53L1X_MULTIZONE
+            // Next zone's ROI must be in place before the clear below
+            // releases the next measurement.
+            err = i2c_bus_write_reg16addr(dev, REG_ROI_CONFIG_USER_ROI_CENTRE_SPAD, vl53l1x_zone_seq_next_center(&zones));
+            if (err != ESP_OK) {
+                log_msg_lvl(ESP_LOG_ERROR, TAG, "ROI center update failed: %s", esp_err_to_name(err));
+            }
+#endif
+
             // Toujours effacer l'interruption pour permettre la mesure suivante
             err = i2c_bus_write_reg16addr(dev, REG_SYSTEM_INTERRUPT_CLEAR, 0x01);
             if (err != ESP_OK) {
@@ -309,6 +431,11 @@ static void vl53l1x_task(void *params) {
             uint8_t raw_code = status_raw & 0x1F;
             uint8_t range_status = (raw_code < sizeof(ST_STATUS_LOOKUP)) ? ST_STATUS_LOOKUP[raw_code] : 255;
 
+#if CONFIG_VL53L1X_MULTIZONE
+            if (vl53l1x_zone_seq_push(&zones, distance_mm, range_status == 0)) {
+                send_zone_frame();
+            }
+#else
             switch (range_status) { // 0 = mesure valide (ST ULD API)
                 case 0:
                     header_sensor_t header = {0};
@@ -331,17 +458,25 @@ static void vl53l1x_task(void *params) {
                         distance_mm, status_raw, range_status);
                     break;
             }
+#endif
         } 
         else 
         {
-            // Sécurité : Si ready reste à false pendant 5 cycles (1 seconde)
+            // Sécurité : si aucune donnée après plusieurs périodes complètes
             ready_timeout_count++;
-            if (ready_timeout_count >= 100) {
+            if (ready_timeout_count >= VL53L1X_HUNG_TIMEOUTS) {
                 log_msg_lvl(ESP_LOG_WARN, TAG, "Sensor hung, resetting ranging sequence...");
                 
                 // 1. Stopper explicitement le ranging
                 i2c_bus_write_reg16addr(dev, REG_SYSTEM_MODE_START, 0x00);
                 vTaskDelay(pdMS_TO_TICKS(10));
+
+#if CONFIG_VL53L1X_MULTIZONE
+                // Restart the sweep from zone 0 so results stay aligned with their ROI
+                vl53l1x_zone_seq_init(&zones, VL53L1X_ZONES_COLS, VL53L1X_ZONES_ROWS);
+                i2c_bus_write_reg16addr(dev, REG_ROI_CONFIG_USER_ROI_CENTRE_SPAD, zones.centers[0]);
+                sweep_start_us = 0;
+#endif
                 
                 // 2. Acquitter l'interruption
                 i2c_bus_write_reg16addr(dev, REG_SYSTEM_INTERRUPT_CLEAR, 0x01);
@@ -351,8 +486,6 @@ static void vl53l1x_task(void *params) {
                 ready_timeout_count = 0;
             }
         }
-
-        vTaskDelay(pdMS_TO_TICKS(10));
     }
 }
 
@@ -0,0 +1,69 @@
+#include "vl53l1x_zones.h"
+#include <string.h>
+
+uint8_t vl53l1x_spad_index(uint8_t col, uint8_t row) {
+    // The SPAD numbering is split in two halves: rows 8..15 count up from
+    // 128 column by column, rows 0..7 count down from the right edge.
+    if (row > 7) {
+        return (uint8_t)(128 + (col << 3) + (15 - row));
+    }
+    return (uint8_t)(((15 - col) << 3) + row);
+}
+
+bool vl53l1x_zone_seq_init(vl53l1x_zone_seq_t *seq, uint8_t cols, uint8_t rows) {
+    if (seq == NULL || cols == 0 || rows == 0
+        || cols > VL53L1X_ZONES_MAX_SIDE || rows > VL53L1X_ZONES_MAX_SIDE) {
+        return false;
+    }
+
+    memset(seq, 0, sizeof(*seq));
+    seq->cols = cols;
+    seq->rows = rows;
+    seq->roi_width = VL53L1X_SPAD_GRID / cols;
+    seq->roi_height = VL53L1X_SPAD_GRID / rows;
+    seq->zone_count = cols * rows;
+
+    // With an even ROI side the sensor takes the SPAD right/above the
+    // geometric center as the reference, hence start + side / 2.
+    for (uint8_t row = 0; row < rows; row++) {
+        for (uint8_t col = 0; col < cols; col++) {
+            uint8_t x = col * seq->roi_width + seq->roi_width / 2;
+            uint8_t y = row * seq->roi_height + seq->roi_height / 2;
+            seq->centers[row * cols + col] = vl53l1x_spad_index(x, y);
+        }
+    }
+    return true;
+}
+
+uint8_t vl53l1x_zone_seq_next_center(const vl53l1x_zone_seq_t *seq) {
+    uint8_t next = (uint8_t)((seq->current + 1) % seq->zone_count);
+    return seq->centers[next];
+}
+
+bool vl53l1x_zone_seq_push(vl53l1x_zone_seq_t *seq, uint16_t distance_mm, bool valid) {
+    if (seq->current == 0) {
+        seq->valid_mask = 0; // new sweep
+    }
+
+    seq->distance_mm[seq->current] = valid ? distance_mm : 0;
+    if (valid) {
+        seq->valid_mask |= (uint16_t)(1u << seq->current);
+    }
+
+    seq->current = (uint8_t)((seq->current + 1) % seq->zone_count);
+    return seq->current == 0;
+}
+
+size_t vl53l1x_zone_frame_pack(const vl53l1x_zone_seq_t *seq, uint16_t sweep_ms, uint8_t *buf, size_t len) {
+    size_t size = VL53L1X_ZONE_FRAME_SIZE(seq->zone_count);
+    if (buf == NULL || len < size) {
+        return 0;
+    }
+
+    buf[0] = seq->cols;
+    buf[1] = seq->rows;
+    memcpy(&buf[2], &seq->valid_mask, sizeof(uint16_t)); // little-endian
+    memcpy(&buf[4], &sweep_ms, sizeof(uint16_t));
+    memcpy(&buf[VL53L1X_ZONE_FRAME_HEADER_SIZE], seq->distance_mm, seq->zone_count * sizeof(uint16_t));
+    return size;
+}
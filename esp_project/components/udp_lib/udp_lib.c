@@ -2,6 +2,7 @@
 #include <esp_log.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include "actuators_lib.h"
 #include "log_lib.h"
 #include "cmd_lib.h"
@@ -30,6 +31,31 @@
 
 //TODO : IPv6 support, length commands buffer check, security
 
+/**
+ * During an OTA in safety mode (see ota_qos_t), traffic that stays alive:
+ * commands are still received, and only safety frames (see ota_safety_frame)
+ * are sent
+ */
+static bool ota_safety_mode() {
+    ota_qos_t qos;
+    return ota_get_qos(&qos) == ESP_OK && qos.mode == OTA_QOS_SAFETY;
+}
+
+/**
+ * Telemetry kept during a safety-mode OTA: power, motor, braking, ping
+ */
+static bool ota_safety_frame(const uint8_t *data, uint32_t len) {
+    if (len < HEADER_SENSOR_SIZE) {
+        return false;
+    }
+    uint8_t type = data[0];
+    if (type == SENSOR_TYPE_DELTA && len > HEADER_SENSOR_SIZE) {
+        type = data[HEADER_SENSOR_SIZE]; //original sensor type
+    }
+    return type == SENSOR_TYPE_INA226 || type == SENSOR_TYPE_MOTOR
+        || type == SENSOR_TYPE_BREAK || type == SENSOR_TYPE_PING;
+}
+
 static const char *TAG = "udp_library"; // tag of this library
 
 #if CONFIG_PACKET_DEBUG
@@ -140,6 +166,38 @@ static char * source_ip_to_str(int val) {
 
 static volatile int nb_packets_received = 0;
 
+static atomic_uint stat_tx_frames = 0;
+static atomic_uint stat_tx_bytes = 0;
+static atomic_uint stat_tx_errors = 0;
+static atomic_uint stat_tx_dropped = 0;
+static atomic_uint stat_rx_frames = 0;
+static atomic_uint stat_rx_bytes = 0;
+
+static void count_rx(int len) {
+    if (len > 0) {
+        atomic_fetch_add(&stat_rx_frames, 1);
+        atomic_fetch_add(&stat_rx_bytes, (unsigned)len);
+    }
+}
+
+static void count_tx(int err, size_t len) {
+    if (err < 0) {
+        atomic_fetch_add(&stat_tx_errors, 1);
+    } else {
+        atomic_fetch_add(&stat_tx_frames, 1);
+        atomic_fetch_add(&stat_tx_bytes, (unsigned)len);
+    }
+}
+
+void udp_get_stats(udp_stats_t *stats) {
+    stats->tx_frames = atomic_load(&stat_tx_frames);
+    stats->tx_bytes = atomic_load(&stat_tx_bytes);
+    stats->tx_errors = atomic_load(&stat_tx_errors);
+    stats->tx_dropped = atomic_load(&stat_tx_dropped);
+    stats->rx_frames = atomic_load(&stat_rx_frames);
+    stats->rx_bytes = atomic_load(&stat_rx_bytes);
+}
+
 static void udp_server_task(void *pvParameters)
 {
     int8_t temp_buffer[15];
@@ -307,6 +365,7 @@ static void udp_server_task(void *pvParameters)
             //wait to receive data, store source socket addr
             int len = recvfrom(sock, temp_buffer, sizeof(temp_buffer), 0, (struct sockaddr *)&source_addr, &socklen);
 #endif
+            count_rx(len);
 
             // Error occurred during receiving
             if (len < 0) {
@@ -314,7 +373,7 @@ static void udp_server_task(void *pvParameters)
                 log_msg_lvl(ESP_LOG_ERROR, TAG, "recvfrom failed: errno %d", errno);
     #endif
                 break;
-            } else if (atomic_load(&ota_lock)) {
+            } else if (atomic_load(&ota_lock) && !ota_safety_mode()) {
                 continue;
             } else { // Data received
 
@@ -402,7 +461,12 @@ static void udp_server_task(void *pvParameters)
 
                 send_udp_sensor(buf, sizeof(buf));
 
-                cmd_dispatch(temp_buffer);
+                //OTA in safety mode: the car is stopped, only the stop button still acts
+                if (atomic_load(&ota_lock)) {
+                    cmd_dispatch_stop(temp_buffer);
+                } else {
+                    cmd_dispatch(temp_buffer);
+                }
                 
             }
                 
@@ -425,6 +489,32 @@ static void udp_server_task(void *pvParameters)
 
 #define PORT_CMD_CAM 3334
 
+/**
+ * Lock commands and bring the car to a stop before an OTA
+ */
+static void ota_prepare() {
+    atomic_store(&ota_lock, true);
+
+    force_motor_stop();
+
+    int16_t motor = 0;
+    get_motor_percent(&motor);
+
+    // attend la décélération réelle, pas un délai arbitraire
+    const int max_wait_ms = 2000; // pire cas : plein régime + decel_param le plus doux possible
+    int waited = 0;
+    while (motor != 0 && waited < max_wait_ms) {
+        vTaskDelay(pdMS_TO_TICKS(20)); // aligné sur MOTOR_CTRL_PERIOD, laisse le ramp s'exécuter
+        waited += 20;
+        get_motor_percent(&motor);
+    }
+
+    // sécurité : force à 0 si le timeout est atteint malgré tout
+    if (motor != 0) {
+        force_motor_stop();
+    }
+}
+
 static void udp_server_cfg_task(void *pvParameters)
 {
     uint8_t temp_buffer[40];
@@ -465,6 +555,7 @@ static void udp_server_cfg_task(void *pvParameters)
 
             //wait to receive data, store source socket addr
             int len = recvfrom(sock, temp_buffer, sizeof(temp_buffer), 0, (struct sockaddr *)&source_addr, &socklen);
+            count_rx(len);
 
             // Error occurred during receiving
             if (len < 0) {
@@ -481,30 +572,25 @@ static void udp_server_cfg_task(void *pvParameters)
             #if CONFIG_USE_CAMERA
                     apply_camera_config(&temp_buffer[1], CAMCFG_FRAME_SIZE);
             #endif
-                case 3:
-                    atomic_store(&ota_lock, true);
-
-                    force_motor_stop();
-
-                    int16_t motor = 0;
-                    get_motor_percent(&motor);
-
-                    // attend la décélération réelle, pas un délai arbitraire
-                    const int max_wait_ms = 2000; // pire cas : plein régime + decel_param le plus doux possible
-                    int waited = 0;
-                    while (motor != 0 && waited < max_wait_ms) {
-                        vTaskDelay(pdMS_TO_TICKS(20)); // aligné sur MOTOR_CTRL_PERIOD, laisse le ramp s'exécuter
-                        waited += 20;
-                        get_motor_percent(&motor);
+                case 3: // optional QoS block, see OTA_QOS_CONFIG_SIZE
+                    if (len > OTA_QOS_CONFIG_SIZE) {
+                        ota_qos_apply_config(&temp_buffer[1], len - 1);
                     }
-
-                    // sécurité : force à 0 si le timeout est atteint malgré tout
-                    if (motor != 0) {
-                        force_motor_stop();
-                    }
-
+                    ota_prepare();
                     ota_init();
                     break;
+                case 4:
+                    sensor_policy_apply_config(&temp_buffer[1], len > 0 ? (size_t)(len - 1) : 0);
+                    break;
+            #if CONFIG_OTA_UDP
+                case 5: // image pushed by the station over UDP
+                    if (len > OTA_QOS_CONFIG_SIZE) {
+                        ota_qos_apply_config(&temp_buffer[1], len - 1);
+                    }
+                    ota_prepare();
+                    ota_udp_start();
+                    break;
+            #endif
                 default:
                     break;
                 }
@@ -555,12 +641,58 @@ void udp_server_init()
 
 static QueueHandle_t queue_send_log = NULL;
 static QueueHandle_t queue_send_sensor = NULL;
+static volatile udp_tap_cb_t tap_cbs[UDP_TAPS_MAX] = {0};
+
+esp_err_t udp_add_tap(udp_tap_cb_t tap) {
+    for (size_t i = 0; i < UDP_TAPS_MAX; i++) {
+        if (tap_cbs[i] == tap) {
+            return ESP_OK;
+        }
+    }
+    for (size_t i = 0; i < UDP_TAPS_MAX; i++) {
+        if (tap_cbs[i] == NULL) {
+            tap_cbs[i] = tap;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void udp_remove_tap(udp_tap_cb_t tap) {
+    for (size_t i = 0; i < UDP_TAPS_MAX; i++) {
+        if (tap_cbs[i] == tap) {
+            tap_cbs[i] = NULL;
+        }
+    }
+}
+
+static void tap_frame(udp_channel_t channel, const uint8_t *data, uint32_t len) {
+    if (data == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < UDP_TAPS_MAX; i++) {
+        udp_tap_cb_t tap = tap_cbs[i];
+        if (tap != NULL) {
+            tap(channel, data, len);
+        }
+    }
+}
 
 typedef struct udp_msg_st {
     uint8_t* data;
     uint32_t len;
+    udp_release_cb_t release; // NULL: malloc'd copy, freed once sent
+    void *release_ctx;
 } udp_msg_t;
 
+static void udp_msg_release(udp_msg_t *msg) {
+    if (msg->release != NULL) {
+        msg->release(msg->data, msg->release_ctx);
+    } else {
+        free(msg->data);
+    }
+}
+
 static void send_msg_to_queue(const uint8_t * data, uint32_t len, QueueHandle_t queue) {
     if (data == NULL) {
     #if CONFIG_CLIENT_DEBUG
@@ -588,9 +720,11 @@ static void send_msg_to_queue(const uint8_t * data, uint32_t len, QueueHandle_t
             ESP_LOGW(TAG, "Queue full, freeing data");
     #endif
             free(msg.data);
+            atomic_fetch_add(&stat_tx_dropped, 1);
         }
     } else {
         ESP_LOGE(TAG, "Failed allocating buf cpy");
+        atomic_fetch_add(&stat_tx_dropped, 1);
     }
 }
 
@@ -604,12 +738,13 @@ void send_udp_log(const uint8_t * data, uint32_t len){
         log_msg_lvl(ESP_LOG_WARN, TAG, "Size overflow, truncating msg from %u to %u", len, UDP_MAX_SIZE);
         size = UDP_MAX_SIZE;
     }
+    tap_frame(UDP_CHANNEL_LOGS, data, size);
     send_msg_to_queue(data, size, queue_send_log);
 }
 
 void send_udp_sensor(const uint8_t * data, uint32_t len){
 
-    if (atomic_load(&ota_lock)) {
+    if (atomic_load(&ota_lock) && !(ota_safety_mode() && ota_safety_frame(data, len))) {
         return; // skip tous les envois
     }
     uint32_t size = len;
@@ -618,6 +753,7 @@ void send_udp_sensor(const uint8_t * data, uint32_t len){
         log_msg_lvl(ESP_LOG_WARN, TAG, "Size overflow, truncating msg from %u to %u", len, UDP_MAX_SIZE);
         size = UDP_MAX_SIZE;
     }
+    tap_frame(UDP_CHANNEL_SENSORS, data, size);
     send_msg_to_queue(data, size, queue_send_sensor);
 }
 
@@ -658,7 +794,8 @@ static void udp_send_fragmented(int sock, const struct sockaddr_in *dest_addr, u
         header_serialize(&hd, buf);
         memcpy(&buf[HEADER_UDP_FRAG_SIZE], msg->data + offset, payload_size);
         
-        sendto(sock, buf, payload_size + HEADER_UDP_FRAG_SIZE, 0, (struct sockaddr *)dest_addr, sizeof(*dest_addr));
+        int err = sendto(sock, buf, payload_size + HEADER_UDP_FRAG_SIZE, 0, (struct sockaddr *)dest_addr, sizeof(*dest_addr));
+        count_tx(err, payload_size + HEADER_UDP_FRAG_SIZE);
     }
 
     (*running_frag_id)++;
@@ -712,6 +849,7 @@ static void udp_client_generic_task(void *pvParameters)
             }
             int err;
             err = sendto(sock, msg_tmp.data, frame_size, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+            count_tx(err, frame_size);
             #if CONFIG_CLIENT_DEBUG
             if (err < 0) {
                 ESP_LOGE(TAG, "Error occurred during sending (%s)", strerror(errno));
@@ -719,7 +857,7 @@ static void udp_client_generic_task(void *pvParameters)
             #endif
         }
         
-        free(msg_tmp.data);
+        udp_msg_release(&msg_tmp);
     }
     
     close(sock);
@@ -744,6 +882,69 @@ void send_udp_dump(const uint8_t *data, uint32_t len) {
     send_msg_to_queue(data, len, queue_send_dump);
 }
 
+static QueueHandle_t channel_queue(udp_channel_t channel) {
+    switch (channel) {
+    case UDP_CHANNEL_SENSORS:
+        return queue_send_sensor;
+    case UDP_CHANNEL_LOGS:
+        return queue_send_log;
+    case UDP_CHANNEL_VIDEO:
+        return queue_send_video;
+    case UDP_CHANNEL_DUMP:
+        return queue_send_dump;
+    default:
+        return NULL;
+    }
+}
+
+esp_err_t udp_get_queue_fill(udp_channel_t channel, uint8_t *waiting, uint8_t *length) {
+    if (waiting == NULL || length == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    QueueHandle_t queue = channel_queue(channel);
+    if (queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    UBaseType_t used = uxQueueMessagesWaiting(queue);
+    UBaseType_t total = used + uxQueueSpacesAvailable(queue);
+    *waiting = (uint8_t)(used > UINT8_MAX ? UINT8_MAX : used);
+    *length = (uint8_t)(total > UINT8_MAX ? UINT8_MAX : total);
+    return ESP_OK;
+}
+
+esp_err_t send_udp_buffer(udp_channel_t channel, uint8_t *data, uint32_t len, udp_release_cb_t release, void *ctx) {
+    udp_msg_t msg = {
+        .data = data,
+        .len = len,
+        .release = release,
+        .release_ctx = ctx,
+    };
+    if (data == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    QueueHandle_t queue = channel_queue(channel);
+
+    bool ota_blocked = atomic_load(&ota_lock) && !(channel == UDP_CHANNEL_SENSORS
+        && ota_safety_mode() && ota_safety_frame(data, len));
+    if (queue == NULL || (channel != UDP_CHANNEL_LOGS && ota_blocked)) {
+        udp_msg_release(&msg);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (channel == UDP_CHANNEL_SENSORS || channel == UDP_CHANNEL_LOGS) {
+        tap_frame(channel, data, len);
+    }
+    if (xQueueSend(queue, &msg, 0) != pdTRUE) {
+    #if CONFIG_CLIENT_DEBUG
+        ESP_LOGW(TAG, "Queue full, releasing data");
+    #endif
+        udp_msg_release(&msg);
+        atomic_fetch_add(&stat_tx_dropped, 1);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
 /**
  * Function to init clients : 
  * Create tasks udp client with 4 priority
@@ -25,6 +25,58 @@ void send_udp_jpeg(const uint8_t * data, uint32_t len);
 // Send a dump UDP message
 void send_udp_dump(const uint8_t * data, uint32_t len);
 
+typedef enum {
+    UDP_CHANNEL_SENSORS = 0,
+    UDP_CHANNEL_LOGS,
+    UDP_CHANNEL_VIDEO,
+    UDP_CHANNEL_DUMP,
+} udp_channel_t;
+
+// Copy of the sensor and log streams for another transport (ws_lib, mqtt_lib):
+// called with every frame queued on these channels, in the sender's task.
+// Must not block nor log (logs are a tapped stream too)
+typedef void (*udp_tap_cb_t)(udp_channel_t channel, const uint8_t *data, uint32_t len);
+
+#define UDP_TAPS_MAX 2
+
+// Add a tap, ESP_ERR_NO_MEM if UDP_TAPS_MAX are already set
+esp_err_t udp_add_tap(udp_tap_cb_t tap);
+
+void udp_remove_tap(udp_tap_cb_t tap);
+
+// Gives a buffer passed to send_udp_buffer back to its owner once sent
+typedef void (*udp_release_cb_t)(uint8_t *data, void *ctx);
+
+/**
+ * Send a buffer without copying it: the UDP client task sends `len` bytes
+ * from `data`, then calls `release(data, ctx)`. A NULL `release` means the
+ * buffer was malloc'd and is freed. The buffer is released right away if it
+ * cannot be queued, so it belongs to udp_lib in every case.
+ *
+ * @return ESP_ERR_INVALID_STATE if not initialized or during an OTA,
+ *         ESP_ERR_NO_MEM if the channel queue is full
+ */
+esp_err_t send_udp_buffer(udp_channel_t channel, uint8_t *data, uint32_t len, udp_release_cb_t release, void *ctx);
+
 int get_command_packet_received();
 
+/**
+ * Fill level of a channel's send queue.
+ *
+ * @return ESP_ERR_INVALID_STATE before udp_client_init
+ */
+esp_err_t udp_get_queue_fill(udp_channel_t channel, uint8_t *waiting, uint8_t *length);
+
+// Datagrams on the Wi-Fi link, every channel and server, since boot
+typedef struct {
+    uint32_t tx_frames;     // sent by the socket (one per fragment)
+    uint32_t tx_bytes;
+    uint32_t tx_errors;     // sendto failures
+    uint32_t tx_dropped;    // send queue full or no memory
+    uint32_t rx_frames;
+    uint32_t rx_bytes;
+} udp_stats_t;
+
+void udp_get_stats(udp_stats_t *stats);
+
 #endif
\ No newline at end of file
@@ -6,7 +6,10 @@
 #include <esp_netif.h>
 #include <freertos/event_groups.h>
 #include <string.h>
+#include <stdlib.h>
 #include <esp_mac.h>
+#include <esp_timer.h>
+#include <inttypes.h>
 #include "nvs_lib.h"
 
 /**
@@ -68,6 +71,7 @@ static EventGroupHandle_t s_wifi_event_group;
  * - we failed to connect after the maximum amount of retries */
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT      BIT1
+#define WIFI_STA_STARTED_BIT BIT2
 
 static const char *TAG = "wifi_library";
 
@@ -939,16 +943,146 @@ USEFUL FUNCTIONS
 */
 
 #if CONFIG_USE_STA_MODE
-static void first_scan() {
+/*
+ * Station connection, run by wifi_sta_task (not by the event handler, which
+ * must not block on scans or NVS):
+ * - fast connect: the AP of the last successful connection (SSID, BSSID,
+ *   channel, auth mode) is cached in NVS; a targeted connect to it skips the
+ *   all-channel scan, only probing one channel for one BSSID,
+ * - fallback: one full scan, best known network picked, then a direct
+ *   connect to the chosen BSSID/channel (no second scan by the driver),
+ * - roaming: on WIFI_EVENT_STA_BSS_RSSI_LOW, scan for the same SSID and
+ *   switch to a clearly stronger AP. The netif and its IP stay up, so open
+ *   UDP sockets are kept and only see a short gap.
+ */
+#define WIFI_FAST_CACHE_KEY "WIFI_FAST"
+#define WIFI_FAST_CACHE_VERSION 1
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 4000  // association + DHCP
+#define WIFI_DISCONNECT_TIMEOUT_MS 1000
+#define WIFI_RESCAN_DELAY_MS 5000          // no known network in range
+#define WIFI_MAX_KNOWN_NETWORKS 10
+
+#define WIFI_ROAM_RSSI_THRESHOLD -75       // dBm, below it a roaming scan is done
+#define WIFI_ROAM_HYSTERESIS_DB 8          // a candidate must be this much stronger
+#define WIFI_ROAM_MIN_INTERVAL_MS 30000    // between two roaming scans
+#define WIFI_ROAM_CONNECT_TIMEOUT_MS 5000
+
+//Last successful AP, NVS record WIFI_FAST_CACHE_KEY. No password: the SSID
+//refers to its WIFI_NETS entry, which holds it
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t authmode; // wifi_auth_mode_t
+    char ssid[SSID_MAX_LEN + 1];
+} wifi_fast_cache_t;
+
+static TaskHandle_t wifi_sta_task_handle = NULL;
+static wifi_sta_stats_t sta_stats = {0};
+static wifi_fast_cache_t fast_cache = {0};
+//true while wifi_sta_task drives a connection attempt itself: the event
+//handler then reports disconnections instead of reconnecting
+static volatile bool sta_targeted = false;
+
+//Known networks, one NVS record (see nvs_record.h), loaded once
+#define WIFI_NETWORKS_KEY "WIFI_NETS"
+#define WIFI_NETWORKS_VERSION 1
+
+typedef struct {
+    uint8_t count;
+    wifi_network_t networks[WIFI_MAX_KNOWN_NETWORKS];
+} wifi_networks_record_t;
+
+static wifi_networks_record_t known = {0};
+static uint32_t known_hashes[WIFI_MAX_KNOWN_NETWORKS];
+static bool known_loaded = false;
+
+//FNV-1a: known SSIDs are matched by hash, strcmp only confirms a hit
+static uint32_t ssid_hash(const char *ssid) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < SSID_MAX_LEN && ssid[i] != '\0'; i++) {
+        h ^= (uint8_t)ssid[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * Add or update a network in the record
+ * @return true if the record changed
+ */
+static bool known_network_put(const wifi_network_t *net) {
+    for (uint8_t j = 0; j < known.count; j++) {
+        wifi_network_t *cur = &known.networks[j];
+        if (strncmp(cur->ssid, net->ssid, SSID_MAX_LEN) == 0) {
+            if (memcmp(cur, net, sizeof(*net)) == 0) {
+                return false;
+            }
+            *cur = *net;
+            return true;
+        }
+    }
+    if (known.count >= WIFI_MAX_KNOWN_NETWORKS) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "Known networks full, %s not added", net->ssid);
+        return false;
+    }
+    known.networks[known.count++] = *net;
+    return true;
+}
+
+/**
+ * Former layout, one key per field (SSID_i / PASS_i / PRIORITY_i):
+ * read once to fill the record
+ */
+static void load_known_networks_per_key() {
 
     esp_err_t err;
-#if DEBUG_WIFI
-    sta_info_strings_t *info;
-#endif
+    char key[16];
+    int64_t start = esp_timer_get_time();
+    for (uint8_t i = 0; i < WIFI_MAX_KNOWN_NETWORKS; i++) {
+        wifi_network_t net = {0};
+
+        snprintf(key, sizeof(key), "SSID_%u", i);
+        err = load_nvs_strn(key, net.ssid, sizeof(net.ssid));
+        if (err != ESP_OK || net.ssid[0] == '\0') {
+            break;
+        } //if ssid does not exists on nvs, others don't
+        
+        snprintf(key, sizeof(key), "PASS_%u", i);
+        load_nvs_strn(key, net.password, sizeof(net.password));
+
+        snprintf(key, sizeof(key), "PRIORITY_%u", i);
+        int prio = 0;
+        load_nvs_int(key, &prio);
+        net.priority = prio;
+
+        known_network_put(&net);
+    }
+    log_msg(TAG, "Per-key networks load : %u networks in %" PRId64 " us",
+        known.count, esp_timer_get_time() - start);
+}
+
+static void load_known_networks() {
+
+    if (known_loaded) {
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = load_nvs_record(WIFI_NETWORKS_KEY, NVS_RECORD_WIFI_NETWORKS, WIFI_NETWORKS_VERSION,
+        &known, sizeof(known));
+    bool changed = false;
+    if (err == ESP_OK && known.count <= WIFI_MAX_KNOWN_NETWORKS) {
+        log_msg(TAG, "Networks record load : %u networks in %" PRId64 " us",
+            known.count, esp_timer_get_time() - start);
+    } else {
+        memset(&known, 0, sizeof(known));
+        load_known_networks_per_key();
+        changed = true;
+    }
 
     /*
-    To save your NVS wifi credentials, uncomment this and put your credentials
-    in "networks_put" and it will be store in encrypted nvs.
+    To save your NVS wifi credentials, put your credentials in "networks_put"
+    and they will be added to the networks record, stored in encrypted nvs.
     */
     wifi_network_t networks_put[] = {
         {
@@ -957,174 +1091,399 @@ static void first_scan() {
             0 //priority (higher means less priority)
         },
     };
-
-    char key_put[16];
     for (int i = 0; i < sizeof(networks_put)/sizeof(networks_put[0]); i++) {
-        snprintf(key_put, sizeof(key_put), "SSID_%u", i);
-        err = save_nvs_str(key_put, networks_put[i].ssid);
+        changed |= known_network_put(&networks_put[i]);
+    }
+
+    //one blob, written only when something changed
+    if (changed) {
+        err = save_nvs_record(WIFI_NETWORKS_KEY, NVS_RECORD_WIFI_NETWORKS, WIFI_NETWORKS_VERSION,
+            &known, sizeof(known));
         if (err != ESP_OK) {
-            log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) on saving %s to NVS",
-                esp_err_to_name(err), key_put);
+            log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) on saving networks to NVS", esp_err_to_name(err));
         } else {
-            log_msg(TAG, "SSID %s saved to NVS to %s",
-                networks_put[i].ssid, key_put);
-        }
-        
-        snprintf(key_put, sizeof(key_put), "PASS_%u", i);
-        err = save_nvs_str(key_put, networks_put[i].password);
-        if (err != ESP_OK) {
-            log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) on saving %s to NVS",
-                esp_err_to_name(err), key_put);
+            log_msg(TAG, "Networks saved to NVS");
         }
+    }
 
-        snprintf(key_put, sizeof(key_put), "PRIORITY_%u", i);
-        err = save_nvs_int(key_put, networks_put[i].priority);
-        if (err != ESP_OK) {
-            log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) on saving %s to NVS",
-                esp_err_to_name(err), key_put);
+    for (uint8_t j = 0; j < known.count; j++) {
+        known_hashes[j] = ssid_hash(known.networks[j].ssid);
+    }
+    known_loaded = true;
+    log_msg(TAG, "Known networks found : %d", known.count);
+}
+
+static const wifi_network_t *find_known_network(const char *ssid) {
+    uint32_t h = ssid_hash(ssid);
+    for (uint8_t j = 0; j < known.count; j++) {
+        if (known_hashes[j] == h && strncmp(ssid, known.networks[j].ssid, SSID_MAX_LEN) == 0) {
+            return &known.networks[j];
         }
     }
-    log_msg(TAG, "Networks saved to NVS");
-    
+    return NULL;
+}
 
-    log_msg(TAG, "=============== First scan APs ===============");
+/**
+ * Blocking scan, on every channel or for one SSID only (ssid != NULL)
+ * @param ap_info out, DEFAULT_SCAN_LIST_SIZE records, sorted by RSSI
+ * @param number out, records written
+ */
+static esp_err_t sta_scan(const char *ssid, wifi_ap_record_t *ap_info, uint16_t *number) {
 
-    wifi_scan_default_params_t params;
-    err = esp_wifi_get_scan_parameters(&params);
+    wifi_scan_config_t cfg = WIFI_SCAN_PARAMS_DEFAULT_CONFIG();
+    cfg.ssid = (uint8_t *)ssid;
+
+    scanning = true;
+    esp_err_t err = esp_wifi_scan_start(&cfg, true); //blocking
+    scanning = false;
     if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error on getting scan parameters : %d", err);
-    } else {
-#if CONFIG_DEBUG_WIFI
-        info = get_scan_params_info(params);
-        for (int i = 0; i < info->count; i++) {
-            log_msg(TAG, "scan params [%d] : %s", i, info->lines[i]);
-        }
-#endif
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Scan failed: %s", esp_err_to_name(err));
+        return err;
     }
 
-    //init info array
-    uint16_t number = DEFAULT_SCAN_LIST_SIZE;
-    uint16_t ap_count = 0;
-    wifi_ap_record_t* ap_info = malloc(sizeof(wifi_ap_record_t) * DEFAULT_SCAN_LIST_SIZE);
+    *number = DEFAULT_SCAN_LIST_SIZE;
+    err = esp_wifi_scan_get_ap_records(number, ap_info);
+    if (err != ESP_OK) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) getting AP records", esp_err_to_name(err));
+    }
+    return err;
+}
+
+/**
+ * Full scan, then pick the known network with the best priority, its
+ * strongest AP for equal priorities.
+ * @param wifi_sta_config out, locked on the chosen BSSID and channel
+ */
+static esp_err_t scan_select_network(wifi_config_t *wifi_sta_config) {
+
+    log_msg(TAG, "=============== Scan APs ===============");
+
+    load_known_networks();
+    if (known.count == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint16_t number = 0;
+    wifi_ap_record_t *ap_info = calloc(DEFAULT_SCAN_LIST_SIZE, sizeof(wifi_ap_record_t));
     if (!ap_info) {
         log_msg_lvl(ESP_LOG_ERROR, TAG, "Failed to allocate memory for AP scan");
-        return;
+        return ESP_ERR_NO_MEM;
     }
-    memset(ap_info, 0, sizeof(wifi_ap_record_t) * DEFAULT_SCAN_LIST_SIZE);
 
-    //launch scan
-    wifi_scan_config_t cfg = WIFI_SCAN_PARAMS_DEFAULT_CONFIG();
-    err = esp_wifi_scan_start(&cfg, true); //blocking
+    esp_err_t err = sta_scan(NULL, ap_info, &number);
     if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Scan failed: %s", esp_err_to_name(err));
-        return;
+        free(ap_info);
+        return err;
     }
 
-    //if fail : esp_wifi_clear_ap_list
+    //records come strongest first: first hit of a priority is its best AP
+    const wifi_network_t *best = NULL;
+    const wifi_ap_record_t *best_ap = NULL;
+    for (int i = 0; i < number; i++) {
 #if CONFIG_DEBUG_WIFI
-    log_msg(TAG, "Max AP number ap_info can hold = %u", number);
+        print_record(ap_info[i]);
 #endif
+        const wifi_network_t *net = find_known_network((const char *)ap_info[i].ssid);
+        if (net != NULL && (best == NULL || net->priority < best->priority)) {
+            best = net;
+            best_ap = &ap_info[i];
+        } //else to add : if open network and best null, store open wifi
+    }
 
-    //get num & records of scan
-    err = esp_wifi_scan_get_ap_num(&ap_count);
-    if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) getting AP number", esp_err_to_name(err));
+    if (best == NULL) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "No network found");
+        free(ap_info);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    //config of ESP station
+    memset(wifi_sta_config, 0, sizeof(*wifi_sta_config));
+    strncpy((char *)wifi_sta_config->sta.ssid, best->ssid, sizeof(wifi_sta_config->sta.ssid));
+    strncpy((char *)wifi_sta_config->sta.password, best->password,
+        sizeof(wifi_sta_config->sta.password));
+    /* Authmode threshold resets to WPA2 as default if password matches WPA2 standards (password len => 8).
+     * If you want to connect the device to deprecated WEP/WPA networks, Please set the threshold value
+     * to WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK and set the password with length and format matching to
+     * WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK standards.
+     */
+    wifi_sta_config->sta.bssid_set = true;
+    memcpy(wifi_sta_config->sta.bssid, best_ap->bssid, sizeof(wifi_sta_config->sta.bssid));
+    wifi_sta_config->sta.channel = best_ap->primary;
+    wifi_sta_config->sta.scan_method = WIFI_FAST_SCAN;
+
+    log_msg(TAG, "Selected %s, BSSID " MACSTR ", channel %u, RSSI %d",
+        best->ssid, MAC2STR(best_ap->bssid), best_ap->primary, best_ap->rssi);
+    free(ap_info);
+    return ESP_OK;
+}
+
+/**
+ * Drop the BSSID/channel lock of the station config, so that reconnections
+ * after a link loss may use any AP of the SSID.
+ */
+static void sta_unlock_bssid() {
+    wifi_config_t cfg;
+    if (esp_wifi_get_config(WIFI_IF_STA, &cfg) != ESP_OK || !cfg.sta.bssid_set) {
         return;
     }
-    
-    err = esp_wifi_scan_get_ap_records(&number, ap_info);
+    cfg.sta.bssid_set = false;
+    cfg.sta.channel = 0;
+    cfg.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    cfg.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    esp_wifi_set_config(WIFI_IF_STA, &cfg);
+}
+
+/**
+ * Disconnect, without the event handler reconnecting.
+ * Call with sta_targeted set.
+ */
+static void sta_disconnect() {
+    xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+    if (esp_wifi_disconnect() == ESP_OK) {
+        xEventGroupWaitBits(s_wifi_event_group, WIFI_FAIL_BIT,
+            pdTRUE, pdTRUE, pdMS_TO_TICKS(WIFI_DISCONNECT_TIMEOUT_MS));
+    }
+}
+
+/**
+ * One connection attempt to one AP, without retries.
+ * Call with sta_targeted set.
+ * @return true once an IP is obtained
+ */
+static bool sta_connect_targeted(wifi_config_t *cfg, uint32_t timeout_ms) {
+
+    xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, cfg);
+    if (err == ESP_OK) {
+        err = esp_wifi_connect();
+    }
     if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) getting AP records", esp_err_to_name(err));
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) connecting wifi", esp_err_to_name(err));
+        return false;
+    }
+
+    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+        pdFALSE, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+    if (bits & WIFI_CONNECTED_BIT) {
+        return true;
+    }
+    if (!(bits & WIFI_FAIL_BIT)) {
+        //still associating or waiting for DHCP: stop it before anything else
+        sta_disconnect();
+    }
+    return false;
+}
+
+/**
+ * Scan until a known network is in range, then connect to it. From then
+ * on the event handler retries by itself; returns once an IP is obtained.
+ */
+static void sta_connect_scan() {
+
+    wifi_config_t cfg;
+    while (scan_select_network(&cfg) != ESP_OK) {
+        vTaskDelay(pdMS_TO_TICKS(WIFI_RESCAN_DELAY_MS));
+    }
+
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, &cfg);
+    if (err != ESP_OK) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) setting wifi config", esp_err_to_name(err));
+    }
+    sta_targeted = false;
+    err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) connecting wifi", esp_err_to_name(err));
+    }
+    xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+#if CONFIG_WIFI_FAST_CONNECT
+static bool sta_connect_fast() {
+
+    //rejects a corrupted record or one of another layout (see nvs_record.h)
+    esp_err_t err = load_nvs_record(WIFI_FAST_CACHE_KEY, NVS_RECORD_WIFI_FAST_AP, WIFI_FAST_CACHE_VERSION,
+        &fast_cache, sizeof(fast_cache));
+    if (err != ESP_OK || fast_cache.ssid[0] == '\0' || fast_cache.ssid[SSID_MAX_LEN] != '\0') {
+        memset(&fast_cache, 0, sizeof(fast_cache));
+        return false;
+    }
+    load_known_networks();
+    const wifi_network_t *net = find_known_network(fast_cache.ssid);
+    if (net == NULL) {
+        log_msg(TAG, "Fast connect AP %s no longer known", fast_cache.ssid);
+        memset(&fast_cache, 0, sizeof(fast_cache));
+        return false;
+    }
+
+    wifi_config_t cfg = {0};
+    strncpy((char *)cfg.sta.ssid, fast_cache.ssid, sizeof(cfg.sta.ssid));
+    strncpy((char *)cfg.sta.password, net->password, sizeof(cfg.sta.password));
+    cfg.sta.bssid_set = true;
+    memcpy(cfg.sta.bssid, fast_cache.bssid, sizeof(cfg.sta.bssid));
+    cfg.sta.channel = fast_cache.channel;
+    cfg.sta.scan_method = WIFI_FAST_SCAN;
+    //never require more than the AP had, nor less than WPA2 if it had it
+    cfg.sta.threshold.authmode = (fast_cache.authmode < WIFI_AUTH_WPA2_PSK) ?
+        (wifi_auth_mode_t)fast_cache.authmode : WIFI_AUTH_WPA2_PSK;
+
+    log_msg(TAG, "Fast connect to %s, BSSID " MACSTR ", channel %u",
+        fast_cache.ssid, MAC2STR(fast_cache.bssid), fast_cache.channel);
+    if (sta_connect_targeted(&cfg, WIFI_FAST_CONNECT_TIMEOUT_MS)) {
+        return true;
+    }
+    log_msg_lvl(ESP_LOG_WARN, TAG, "Fast connect failed, falling back to full scan");
+    return false;
+}
+#endif
+
+/**
+ * Save the current AP as fast connect target, if it changed (flash wear).
+ */
+static void fast_cache_update() {
+#if CONFIG_WIFI_FAST_CONNECT
+    wifi_ap_record_t ap;
+    wifi_config_t cfg;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK || esp_wifi_get_config(WIFI_IF_STA, &cfg) != ESP_OK) {
         return;
     }
 
-#if CONFIG_DEBUG_WIFI
-    log_msg(TAG, "Total APs scanned = %u, actual AP number ap_info holds = %u", ap_count, number);
+    wifi_fast_cache_t cache = {0};
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    cache.channel = ap.primary;
+    cache.authmode = (uint8_t)ap.authmode;
+    strncpy(cache.ssid, (const char *)cfg.sta.ssid, SSID_MAX_LEN);
+    if (find_known_network(cache.ssid) == NULL) {
+        return; //nothing to refer to for the password
+    }
+
+    if (memcmp(&cache, &fast_cache, sizeof(cache)) == 0) {
+        return;
+    }
+    esp_err_t err = save_nvs_record(WIFI_FAST_CACHE_KEY, NVS_RECORD_WIFI_FAST_AP, WIFI_FAST_CACHE_VERSION,
+        &cache, sizeof(cache));
+    if (err != ESP_OK) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) saving fast connect AP", esp_err_to_name(err));
+        return;
+    }
+    fast_cache = cache;
+    log_msg(TAG, "Fast connect AP saved: BSSID " MACSTR ", channel %u",
+        MAC2STR(cache.bssid), cache.channel);
 #endif
+}
 
-    wifi_network_t *known_networks;
-    known_networks = (wifi_network_t*)malloc(sizeof(struct wifi_network_st)*10);
-    uint8_t count = 0;
-    char key[16];
-    for (uint8_t i = 0; i < 10; i++) {
-        snprintf(key, sizeof(key), "SSID_%u", i);
-        err = load_nvs_str(key, known_networks[i].ssid);
-        
-        if (err != ESP_OK || (strcmp(known_networks[i].ssid,"") == 0)) {
-            break;
-        } //if ssid does not exists on nvs, others don't
-        else {
-            log_msg(TAG, "Network %s loaded to %s", known_networks[i].ssid, key);
-        }
-        
-        snprintf(key, sizeof(key), "PASS_%u", i);
-        load_nvs_str(key, known_networks[i].password);
+#if CONFIG_WIFI_ROAMING
+/**
+ * Look for a stronger AP of the current SSID and switch to it.
+ */
+static void sta_roam() {
 
-        snprintf(key, sizeof(key), "PRIORITY_%u", i);
-        int prio;
-        load_nvs_int(key, &prio);
-        known_networks[i].priority = prio;
+    static int64_t last_scan_us = 0;
+    int64_t now_us = esp_timer_get_time();
+    if (last_scan_us != 0 && (now_us - last_scan_us) < (int64_t)WIFI_ROAM_MIN_INTERVAL_MS * 1000) {
+        return;
+    }
+    last_scan_us = now_us;
+
+    wifi_ap_record_t current;
+    if (esp_wifi_sta_get_ap_info(&current) != ESP_OK) {
+        return; //not connected: the event handler is already reconnecting
+    }
 
-        count++;
+    wifi_ap_record_t *ap_info = calloc(DEFAULT_SCAN_LIST_SIZE, sizeof(wifi_ap_record_t));
+    if (!ap_info) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Failed to allocate memory for AP scan");
+        return;
+    }
+
+    //background scan: the driver goes back to the home channel in between
+    sta_stats.roam_scans++;
+    uint16_t number = 0;
+    if (sta_scan((const char *)current.ssid, ap_info, &number) != ESP_OK) {
+        free(ap_info);
+        return;
     }
-    log_msg(TAG, "Known networks found : %d", count);
 
-    wifi_network_t *wifi_credentials = NULL;
-    //go through each record and compare ssid
+    const wifi_ap_record_t *target = NULL;
     for (int i = 0; i < number; i++) {
-#if CONFIG_DEBUG_WIFI
-        print_record(ap_info[i]);
-#endif
-        for (int j = 0; j < count; j++) {
-            if (strcmp((const char *)ap_info[i].ssid, known_networks[j].ssid) == 0) {
-                if (wifi_credentials == NULL) {
-                    wifi_credentials = &known_networks[j];
-                } else if (known_networks[j].priority < wifi_credentials->priority) {
-                    wifi_credentials = &known_networks[j];
-                }
-            } //else to add : if open network and wifi_credentials null, store open wifi
+        if (memcmp(ap_info[i].bssid, current.bssid, sizeof(current.bssid)) != 0
+            && ap_info[i].rssi >= current.rssi + WIFI_ROAM_HYSTERESIS_DB) {
+            target = &ap_info[i]; //strongest first
+            break;
         }
     }
-    free(ap_info);
-
-    if (wifi_credentials == NULL) {
-        log_msg_lvl(ESP_LOG_WARN, TAG, "No network found");
-        free(known_networks);
+    if (target == NULL) {
+        log_msg(TAG, "RSSI low (%d dBm), no better AP", current.rssi);
+        free(ap_info);
         return;
     }
 
-    //config of ESP station
-    wifi_config_t wifi_sta_config = {
-        .sta = {
-            .ssid = {0},
-            .password = {0},
-            .scan_method = WIFI_ALL_CHANNEL_SCAN
-            /* Authmode threshold resets to WPA2 as default if password matches WPA2 standards (password len => 8).
-             * If you want to connect the device to deprecated WEP/WPA networks, Please set the threshold value
-             * to WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK and set the password with length and format matching to
-            * WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK standards.
-             */
-        },
-    };
+    log_msg(TAG, "Roaming from " MACSTR " (%d dBm) to " MACSTR " (%d dBm), channel %u",
+        MAC2STR(current.bssid), current.rssi, MAC2STR(target->bssid), target->rssi, target->primary);
 
-    strncpy((char *)wifi_sta_config.sta.ssid,
-        (const char *)wifi_credentials->ssid, sizeof(wifi_sta_config.sta.ssid));
+    wifi_config_t cfg;
+    esp_wifi_get_config(WIFI_IF_STA, &cfg);
+    cfg.sta.bssid_set = true;
+    memcpy(cfg.sta.bssid, target->bssid, sizeof(cfg.sta.bssid));
+    cfg.sta.channel = target->primary;
+    cfg.sta.scan_method = WIFI_FAST_SCAN;
+    free(ap_info);
+
+    //netif is not torn down: DHCP renews the same lease, sockets stay open
+    sta_targeted = true;
+    sta_disconnect();
+    if (sta_connect_targeted(&cfg, WIFI_ROAM_CONNECT_TIMEOUT_MS)) {
+        sta_stats.roams++;
+        sta_targeted = false;
+        fast_cache_update();
+    } else {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "Roaming failed, reconnecting to any AP");
+        sta_stats.roam_failures++;
+        sta_unlock_bssid();
+        sta_targeted = false;
+        esp_wifi_connect();
+        xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+}
+#endif
 
-    strncpy((char *)wifi_sta_config.sta.password,
-        (const char *)wifi_credentials->password, sizeof(wifi_sta_config.sta.password));
+/**
+ * Station task: first connection (fast connect, else scan), then roaming
+ * on low RSSI events.
+ */
+static void wifi_sta_task(void *pvParameters) {
 
+    xEventGroupWaitBits(s_wifi_event_group, WIFI_STA_STARTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
 
-    //Apply station config to ESP
-    err = esp_wifi_set_config(WIFI_IF_STA, &wifi_sta_config);
-    if (err != ESP_OK) {
-        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) setting wifi config", esp_err_to_name(err));
-        free(known_networks);
-        return;
+    sta_targeted = true;
+#if CONFIG_WIFI_FAST_CONNECT
+    sta_stats.fast_connect = sta_connect_fast();
+#endif
+    if (!sta_stats.fast_connect) {
+        sta_connect_scan();
     }
+    sta_targeted = false;
 
-    free(known_networks);
+    log_msg(TAG, "Boot to IP : %" PRIu32 " ms (%s)", sta_stats.boot_to_ip_ms,
+        sta_stats.fast_connect ? "fast connect" : "scan");
+    fast_cache_update();
+
+#if CONFIG_WIFI_ROAMING
+    while (true) {
+        //the low RSSI event fires once per threshold setting: re-arm it
+        esp_wifi_set_rssi_threshold(WIFI_ROAM_RSSI_THRESHOLD);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        sta_roam();
+    }
+#endif
+    vTaskDelete(NULL);
+}
 
-    log_msg(TAG, "=============== First Scan End ===============");
+static esp_err_t wifi_sta_task_start() {
+    if (xTaskCreate(wifi_sta_task, "wifi_sta_task", 4096, NULL, 5, &wifi_sta_task_handle) != pdPASS) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error creating wifi station task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
 }
 #endif
 
@@ -1191,14 +1550,27 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
     //if wifi starting event
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
 #if CONFIG_USE_STA_MODE
-        first_scan();
-#endif
+        //connection is done by wifi_sta_task (scans block)
+        xEventGroupSetBits(s_wifi_event_group, WIFI_STA_STARTED_BIT);
+#else
         err = esp_wifi_connect(); // Start wifi connection : send request to router
         if (err != ESP_OK) {
             log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) connecting wifi", esp_err_to_name(err));
         }
+#endif
     //if wifi disconnect event, trying to reconnect
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+#if CONFIG_USE_STA_MODE
+        if (sta_targeted) {
+            //wifi_sta_task decides what comes next (fallback scan..)
+            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+            return;
+        }
+        //the AP we were locked on may be gone
+        sta_unlock_bssid();
+        sta_stats.reconnects++;
+#endif
         log_msg(TAG, "Disconnected, trying to reconnect..");
         err = esp_wifi_connect();
         if (err != ESP_OK) {
@@ -1216,8 +1588,20 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
         snprintf(s_ip_str, sizeof(s_ip_str),
                  IPSTR, IP2STR(&event->ip_info.ip));
 
+#if CONFIG_USE_STA_MODE
+        if (sta_stats.boot_to_ip_ms == 0) {
+            sta_stats.boot_to_ip_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        }
+#endif
+
         //update global handler to wifi connected to unlock tasks waiting for wifi
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+#if CONFIG_USE_STA_MODE && CONFIG_WIFI_ROAMING
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_BSS_RSSI_LOW) {
+        if (wifi_sta_task_handle != NULL) {
+            xTaskNotifyGive(wifi_sta_task_handle);
+        }
+#endif
     } else if (event_id == WIFI_EVENT_AP_STACONNECTED) {
         wifi_event_ap_staconnected_t* event = (wifi_event_ap_staconnected_t*) event_data;
         log_msg(TAG, "station " MACSTR " join, AID=%d, is mesh : %s",
@@ -1414,6 +1798,11 @@ static void wifi_init_sta(void)
     //esp_netif_t *esp_netif_sta = esp_netif_create_default_wifi_sta();
     esp_netif_create_default_wifi_sta();
 
+    err = wifi_sta_task_start();
+    if (err != ESP_OK) {
+        return;
+    }
+
     //start wifi : triggers WIFI_EVENT_STA_START handler
     err = esp_wifi_start();
     if (err != ESP_OK) {
@@ -1561,6 +1950,11 @@ static void wifi_init_apsta()
     /* Initialize STA */
     esp_netif_t *esp_netif_sta = esp_netif_create_default_wifi_sta();
 
+    err = wifi_sta_task_start();
+    if (err != ESP_OK) {
+        return;
+    }
+
     //start wifi : triggers WIFI_EVENT_STA_START handler
     err = esp_wifi_start();
     if (err != ESP_OK) {
@@ -2034,6 +2428,18 @@ void wifi_scan_esp() {
 }
 #endif
 
+esp_err_t wifi_get_sta_stats(wifi_sta_stats_t *stats) {
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+#if CONFIG_USE_STA_MODE
+    *stats = sta_stats;
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
 esp_err_t sta_get_rssi(int *rssi) {
     esp_err_t err;
     err = esp_wifi_sta_get_rssi(rssi);
@@ -2,6 +2,8 @@
 #define WIFI_LIB_H_
 
 #include <esp_err.h>
+#include <inttypes.h>
+#include <stdbool.h>
 
 //Get the IP address of ESP
 const char* wifi_get_ip(void);
@@ -25,4 +27,17 @@ bool is_scanning();
 
 esp_err_t sta_get_rssi(int *rssi);
 
+//Station connection metrics
+typedef struct {
+    uint32_t boot_to_ip_ms; // boot to first IP, 0 until connected
+    bool fast_connect;      // first connection made to the cached AP, without scan
+    uint32_t reconnects;    // link losses
+    uint32_t roam_scans;    // scans made on low RSSI
+    uint32_t roams;         // AP switches
+    uint32_t roam_failures; // switches that fell back to a plain reconnect
+} wifi_sta_stats_t;
+
+//get station metrics (ESP_ERR_NOT_SUPPORTED without station mode)
+esp_err_t wifi_get_sta_stats(wifi_sta_stats_t *stats);
+
 #endif
\ No newline at end of file
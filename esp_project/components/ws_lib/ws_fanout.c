@@ -0,0 +1,227 @@
+#include "ws_fanout.h"
+#include <string.h>
+
+static void queue_reset(ws_fanout_queue_t *q) {
+    q->head = 0;
+    q->tail = 0;
+    q->used = 0;
+    q->records = 0;
+}
+
+static void queue_write(ws_fanout_queue_t *q, const uint8_t *src, size_t len) {
+    size_t first = q->capacity - q->head;
+    first = (len < first) ? len : first;
+    memcpy(&q->buf[q->head], src, first);
+    memcpy(q->buf, &src[first], len - first);
+    q->head = (q->head + len) % q->capacity;
+    q->used += len;
+}
+
+static void queue_read(ws_fanout_queue_t *q, uint8_t *dst, size_t len) {
+    size_t first = q->capacity - q->tail;
+    first = (len < first) ? len : first;
+    memcpy(dst, &q->buf[q->tail], first);
+    memcpy(&dst[first], q->buf, len - first);
+    q->tail = (q->tail + len) % q->capacity;
+    q->used -= len;
+}
+
+/**
+ * Length of the oldest record, header included (header copied to `hdr`)
+ */
+static size_t queue_peek(const ws_fanout_queue_t *q, uint8_t *hdr) {
+    for (size_t i = 0; i < WS_FANOUT_RECORD_HEADER_SIZE; i++) {
+        hdr[i] = q->buf[(q->tail + i) % q->capacity];
+    }
+    uint16_t len;
+    memcpy(&len, &hdr[1], sizeof(len));
+    return WS_FANOUT_RECORD_HEADER_SIZE + len;
+}
+
+static void queue_drop_oldest(ws_fanout_queue_t *q) {
+    uint8_t hdr[WS_FANOUT_RECORD_HEADER_SIZE];
+    size_t len = queue_peek(q, hdr);
+    q->tail = (q->tail + len) % q->capacity;
+    q->used -= len;
+    q->records--;
+}
+
+void ws_fanout_init(ws_fanout_t *fanout, uint8_t *storage, size_t queue_size) {
+    memset(fanout, 0, sizeof(*fanout));
+    for (size_t i = 0; i < WS_FANOUT_CLIENTS_MAX; i++) {
+        fanout->clients[i].fd = -1;
+        fanout->clients[i].queue.buf = &storage[i * queue_size];
+        fanout->clients[i].queue.capacity = queue_size;
+    }
+}
+
+int ws_fanout_find(const ws_fanout_t *fanout, int fd) {
+    for (int i = 0; i < WS_FANOUT_CLIENTS_MAX; i++) {
+        if (fanout->clients[i].used && fanout->clients[i].fd == fd) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int ws_fanout_add(ws_fanout_t *fanout, int fd) {
+    int slot = ws_fanout_find(fanout, fd);
+    for (int i = 0; slot < 0 && i < WS_FANOUT_CLIENTS_MAX; i++) {
+        if (!fanout->clients[i].used && !fanout->clients[i].in_flight) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        fanout->rejected++;
+        return -1;
+    }
+
+    ws_fanout_client_t *client = &fanout->clients[slot];
+    ws_fanout_queue_t queue = client->queue;
+    bool in_flight = client->in_flight;
+    memset(client, 0, sizeof(*client));
+    client->queue = queue;
+    queue_reset(&client->queue);
+    client->in_flight = in_flight;
+    client->used = true;
+    client->fd = fd;
+    client->channels = WS_FANOUT_CHANNELS_ALL;
+    return slot;
+}
+
+bool ws_fanout_remove(ws_fanout_t *fanout, int fd) {
+    int slot = ws_fanout_find(fanout, fd);
+    if (slot < 0) {
+        return false;
+    }
+    fanout->clients[slot].used = false;
+    fanout->clients[slot].fd = -1;
+    queue_reset(&fanout->clients[slot].queue);
+    return true;
+}
+
+bool ws_fanout_set_channels(ws_fanout_t *fanout, int fd, uint8_t channels) {
+    int slot = ws_fanout_find(fanout, fd);
+    if (slot < 0) {
+        return false;
+    }
+    fanout->clients[slot].channels = channels;
+    return true;
+}
+
+size_t ws_fanout_count(const ws_fanout_t *fanout) {
+    size_t count = 0;
+    for (size_t i = 0; i < WS_FANOUT_CLIENTS_MAX; i++) {
+        count += fanout->clients[i].used ? 1 : 0;
+    }
+    return count;
+}
+
+size_t ws_fanout_publish(ws_fanout_t *fanout, uint8_t channel, const uint8_t *data, uint16_t len) {
+    uint8_t hdr[WS_FANOUT_RECORD_HEADER_SIZE];
+    hdr[0] = channel;
+    memcpy(&hdr[1], &len, sizeof(len)); // little-endian
+    size_t size = WS_FANOUT_RECORD_HEADER_SIZE + len;
+
+    size_t count = 0;
+    for (size_t i = 0; i < WS_FANOUT_CLIENTS_MAX; i++) {
+        ws_fanout_client_t *client = &fanout->clients[i];
+        if (!client->used || channel >= 8 || !(client->channels & (1u << channel))) {
+            continue;
+        }
+        ws_fanout_queue_t *q = &client->queue;
+        if (size > q->capacity) {
+            client->dropped++;
+            client->dropped_pending++;
+            continue;
+        }
+        //slow client: the oldest data goes, the latest always gets in
+        while (q->capacity - q->used < size) {
+            queue_drop_oldest(q);
+            client->dropped++;
+            client->dropped_pending++;
+        }
+        queue_write(q, hdr, sizeof(hdr));
+        queue_write(q, data, len);
+        q->records++;
+        client->queued++;
+        if (q->used > client->queue_peak) {
+            client->queue_peak = q->used;
+        }
+        count++;
+    }
+    return count;
+}
+
+size_t ws_fanout_take_batch(ws_fanout_t *fanout, int slot, uint8_t *out, size_t capacity) {
+    if (slot < 0 || slot >= WS_FANOUT_CLIENTS_MAX || capacity <= WS_FANOUT_BATCH_HEADER_SIZE) {
+        return 0;
+    }
+    ws_fanout_client_t *client = &fanout->clients[slot];
+    ws_fanout_queue_t *q = &client->queue;
+    if (!client->used || client->in_flight || q->records == 0) {
+        return 0;
+    }
+
+    size_t len = WS_FANOUT_BATCH_HEADER_SIZE;
+    while (q->records > 0) {
+        uint8_t hdr[WS_FANOUT_RECORD_HEADER_SIZE];
+        size_t size = queue_peek(q, hdr);
+        if (WS_FANOUT_BATCH_HEADER_SIZE + size > capacity) {
+            //would never fit
+            queue_drop_oldest(q);
+            client->dropped++;
+            client->dropped_pending++;
+            continue;
+        }
+        if (len + size > capacity) {
+            break;
+        }
+        queue_read(q, &out[len], size);
+        q->records--;
+        len += size;
+    }
+    if (len == WS_FANOUT_BATCH_HEADER_SIZE) {
+        return 0;
+    }
+
+    memcpy(&out[0], &client->seq, sizeof(uint32_t));
+    memcpy(&out[4], &client->dropped_pending, sizeof(uint32_t));
+    client->seq++;
+    client->dropped_pending = 0;
+    client->in_flight = true;
+    return len;
+}
+
+void ws_fanout_sent(ws_fanout_t *fanout, int slot, size_t len, bool ok) {
+    if (slot < 0 || slot >= WS_FANOUT_CLIENTS_MAX) {
+        return;
+    }
+    ws_fanout_client_t *client = &fanout->clients[slot];
+    client->in_flight = false;
+    if (ok) {
+        client->batches++;
+        client->bytes_sent += len;
+    } else {
+        client->send_errors++;
+    }
+}
+
+bool ws_fanout_batch_next(const uint8_t *buf, size_t len, size_t *offset, uint8_t *channel,
+    const uint8_t **data, uint16_t *data_len) {
+    if (*offset + WS_FANOUT_RECORD_HEADER_SIZE > len) {
+        return false;
+    }
+    const uint8_t *rec = &buf[*offset];
+    uint16_t rec_len;
+    memcpy(&rec_len, &rec[1], sizeof(uint16_t));
+    if (*offset + WS_FANOUT_RECORD_HEADER_SIZE + rec_len > len) {
+        return false;
+    }
+
+    *channel = rec[0];
+    *data = &rec[WS_FANOUT_RECORD_HEADER_SIZE];
+    *data_len = rec_len;
+    *offset += WS_FANOUT_RECORD_HEADER_SIZE + rec_len;
+    return true;
+}
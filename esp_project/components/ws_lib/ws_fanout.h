@@ -0,0 +1,117 @@
+#ifndef WS_FANOUT_H_
+#define WS_FANOUT_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Fan-out of the telemetry streams to the WebSocket clients:
+// - one send queue per client, records dropped oldest first when a slow
+//   client falls behind, so it always gets the latest data and never holds
+//   back the others,
+// - records taken out as one batch per tick, at most one batch per client in
+//   flight: a client whose last batch is not sent yet just keeps queueing.
+// Pure code (no esp_http_server, no FreeRTOS) so it can be run on the host.
+
+#define WS_FANOUT_CLIENTS_MAX 4
+
+// Stream of a record, as udp_channel_t (bit n of a client's channel mask)
+#define WS_FANOUT_CHANNEL_SENSORS 0
+#define WS_FANOUT_CHANNEL_LOGS 1
+#define WS_FANOUT_CHANNELS_ALL 0xFF
+
+// Batch (one binary WebSocket frame), little-endian:
+// [0..3] = batch sequence number, [4..7] = records dropped for this client
+// since the previous batch, then records: [channel][length (uint16_t)][data],
+// data being the frame udp_lib sends (sensor frame or log frame).
+#define WS_FANOUT_BATCH_HEADER_SIZE (sizeof(uint32_t) + sizeof(uint32_t))
+#define WS_FANOUT_RECORD_HEADER_SIZE (sizeof(uint8_t) + sizeof(uint16_t))
+
+typedef struct {
+    uint8_t *buf;       // caller-provided storage
+    size_t capacity;
+    size_t head;        // next write
+    size_t tail;        // oldest record
+    size_t used;
+    uint32_t records;
+} ws_fanout_queue_t;
+
+typedef struct {
+    bool used;
+    bool in_flight;     // batch handed to the server, slot not reusable until sent
+    int fd;
+    uint8_t channels;   // channel mask
+    ws_fanout_queue_t queue;
+    uint32_t seq;
+    uint32_t dropped_pending;
+    //stats
+    uint32_t queued;
+    uint32_t dropped;
+    uint32_t batches;
+    uint32_t send_errors;
+    uint32_t bytes_sent;
+    size_t queue_peak;
+} ws_fanout_client_t;
+
+typedef struct {
+    ws_fanout_client_t clients[WS_FANOUT_CLIENTS_MAX];
+    uint32_t rejected;  // connections refused while the table was full
+} ws_fanout_t;
+
+/**
+ * Empty table. `storage` holds WS_FANOUT_CLIENTS_MAX queues of
+ * `queue_size` bytes each, one per slot.
+ */
+void ws_fanout_init(ws_fanout_t *fanout, uint8_t *storage, size_t queue_size);
+
+/**
+ * Add a client (all channels), or reset it if `fd` is already known.
+ *
+ * @return slot, -1 if the table is full
+ */
+int ws_fanout_add(ws_fanout_t *fanout, int fd);
+
+/** @return slot of `fd`, -1 if unknown */
+int ws_fanout_find(const ws_fanout_t *fanout, int fd);
+
+/**
+ * Remove a client, its queued records are dropped. A batch still in flight
+ * keeps the slot until ws_fanout_sent.
+ */
+bool ws_fanout_remove(ws_fanout_t *fanout, int fd);
+
+bool ws_fanout_set_channels(ws_fanout_t *fanout, int fd, uint8_t channels);
+
+size_t ws_fanout_count(const ws_fanout_t *fanout);
+
+/**
+ * Queue one record for every client subscribed to `channel`, dropping their
+ * oldest records to make room.
+ *
+ * @return clients it was queued for
+ */
+size_t ws_fanout_publish(ws_fanout_t *fanout, uint8_t channel, const uint8_t *data, uint16_t len);
+
+/**
+ * Move the oldest records of a client into one batch and mark it in flight.
+ * A record too large for `capacity` is dropped.
+ *
+ * @return batch length, 0 if nothing to send or a batch is already in flight
+ */
+size_t ws_fanout_take_batch(ws_fanout_t *fanout, int slot, uint8_t *out, size_t capacity);
+
+/**
+ * The batch of `slot` left (or failed): the next one can be taken.
+ */
+void ws_fanout_sent(ws_fanout_t *fanout, int slot, size_t len, bool ok);
+
+/**
+ * Walk the records of a batch.
+ *
+ * @param offset  start at WS_FANOUT_BATCH_HEADER_SIZE, advanced past the record
+ * @return false at the end of the batch or on a truncated record
+ */
+bool ws_fanout_batch_next(const uint8_t *buf, size_t len, size_t *offset, uint8_t *channel,
+    const uint8_t **data, uint16_t *data_len);
+
+#endif
@@ -1,10 +1,23 @@
 #include "ws_lib.h"
 #include <esp_log.h>
 #include <string.h>
+#include <stdatomic.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <esp_http_server.h>
 #include "actuators_lib.h"
 #include "log_lib.h"
+#include "cmd_lib.h"
+#include "ota_lib.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#if CONFIG_WS_TELEMETRY
+#include "ws_fanout.h"
+#include "udp_lib.h"
+#include "freertos/semphr.h"
+#endif
 
 /**
  * How it works:
@@ -16,12 +29,220 @@
  * function handler : method type, get frame length first then payload, give instructions by payload
  * and return response to client
  * 
- * function send text : initialize frame and to send all clients, use send frame with server handler as request
+ * function send text : initialize frame and send it to every websocket client of the server
+ *
+ * controller : /ws/controller frames drive the car. The last session that sent one is the
+ * controlling one: commands go back to neutral when it closes or stays silent for
+ * CONFIG_WS_CONTROLLER_TIMEOUT_MS (esp_timer watchdog, restarted by every applied frame)
+ *
+ * telemetry (CONFIG_WS_TELEMETRY) : /ws/telemetry streams the sensor, motor and log frames udp_lib
+ * sends (tapped with udp_add_tap), as binary frames batched per tick (format in ws_fanout.h).
+ * Every client has its own send queue, the oldest records go when a slow client falls behind,
+ * and one batch at most in flight per client (httpd_ws_send_data_async). A client sends
+ * 1 byte to choose its streams: bit 0 sensors, bit 1 logs
  */
 
 static const char *TAG = "ws_library"; // tag of this library
 static httpd_handle_t server = NULL; // handler for server : configure server http
 
+#define WS_MAX_OPEN_SOCKETS 7 // httpd default
+#define WS_CMD_MAX_LEN 64 // text commands (LED_ON...)
+
+//controller frames: bare payload (6 axes, buttons), or cmd_lib frame as on UDP port 3333
+#define WS_CONTROLLER_PAYLOAD_SIZE 7
+#define WS_CONTROLLER_FRAME_SIZE 9 // [type][size][payload]
+#define WS_CONTROLLER_FRAME_TS_SIZE 13 // + timestamp (uint32_t)
+
+static ws_controller_stats_t controller_stats = {0};
+static int64_t controller_last_us = 0; // previous frame, for the gap
+static int controller_fd = -1; // session whose frames drive the car
+static portMUX_TYPE controller_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t controller_timer = NULL; // receive watchdog
+#define WS_CONTROLLER_TIMEOUT_US (CONFIG_WS_CONTROLLER_TIMEOUT_MS * 1000)
+
+#if CONFIG_WS_TELEMETRY
+#define WS_TELEMETRY_TICK_MS CONFIG_WS_TELEMETRY_TICK_MS
+#define WS_TELEMETRY_QUEUE_SIZE CONFIG_WS_TELEMETRY_QUEUE_SIZE
+#define WS_TELEMETRY_BATCH_SIZE CONFIG_WS_TELEMETRY_BATCH_SIZE
+
+static ws_fanout_t fanout;
+static SemaphoreHandle_t fanout_mutex = NULL;
+static uint8_t *batch_bufs = NULL; // one per slot, owned by the server while in flight
+static size_t batch_lens[WS_FANOUT_CLIENTS_MAX];
+static TaskHandle_t telemetry_task_handle = NULL;
+static volatile size_t nb_telemetry_clients = 0;
+static bool telemetry_ready = false; // telemetry_init succeeded
+static atomic_uint tap_dropped = 0; // frames lost to a busy lock
+
+/**
+ * udp_lib tap: runs in the publisher's task (the motor esp_timer for the
+ * motor channel), so no logs and no wait: a busy lock drops the frame
+ */
+static void telemetry_tap(udp_channel_t channel, const uint8_t *data, uint32_t len) {
+    if (nb_telemetry_clients == 0 || len > UINT16_MAX) {
+        return;
+    }
+    if (xSemaphoreTake(fanout_mutex, 0) != pdTRUE) {
+        atomic_fetch_add(&tap_dropped, 1);
+        return;
+    }
+    ws_fanout_publish(&fanout, (uint8_t)channel, data, (uint16_t)len);
+    xSemaphoreGive(fanout_mutex);
+}
+
+/**
+ * End of an async send, in the server task
+ */
+static void telemetry_sent(esp_err_t err, int sockfd, void *arg) {
+    int slot = (int)(intptr_t)arg;
+
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    ws_fanout_sent(&fanout, slot, batch_lens[slot], err == ESP_OK);
+    bool backlog = fanout.clients[slot].used && fanout.clients[slot].queue.records > 0;
+    xSemaphoreGive(fanout_mutex);
+
+    if (err != ESP_OK) {
+        httpd_sess_trigger_close(server, sockfd);
+    } else if (backlog) {
+        //behind: next batch now rather than at the next tick
+        xTaskNotifyGive(telemetry_task_handle);
+    }
+}
+
+static void ws_telemetry_task(void *pvParameters) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WS_TELEMETRY_TICK_MS));
+
+        for (int slot = 0; slot < WS_FANOUT_CLIENTS_MAX; slot++) {
+            uint8_t *buf = &batch_bufs[slot * WS_TELEMETRY_BATCH_SIZE];
+
+            xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+            size_t len = ws_fanout_take_batch(&fanout, slot, buf, WS_TELEMETRY_BATCH_SIZE);
+            int fd = fanout.clients[slot].fd;
+            xSemaphoreGive(fanout_mutex);
+            if (len == 0) {
+                continue;
+            }
+
+            batch_lens[slot] = len;
+            httpd_ws_frame_t frame = {
+                .final = true,
+                .type = HTTPD_WS_TYPE_BINARY,
+                .payload = buf,
+                .len = len,
+            };
+            if (httpd_ws_send_data_async(server, fd, &frame, telemetry_sent, (void *)(intptr_t)slot) != ESP_OK) {
+                xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+                ws_fanout_sent(&fanout, slot, len, false);
+                xSemaphoreGive(fanout_mutex);
+                httpd_sess_trigger_close(server, fd);
+            }
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+/**
+ * callback fonction for the telemetry endpoint: registers the client on the
+ * handshake, then only takes its channel mask
+ * @param req request info (uri, method, header..)
+ * @return success or error
+ */
+static esp_err_t telemetry_handler(httpd_req_t *req)
+{
+    int fd = httpd_req_to_sockfd(req);
+
+    if (req->method == HTTP_GET) {
+        xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+        int slot = ws_fanout_add(&fanout, fd);
+        nb_telemetry_clients = ws_fanout_count(&fanout);
+        xSemaphoreGive(fanout_mutex);
+        if (slot < 0) {
+            log_msg_lvl(ESP_LOG_WARN, TAG, "Telemetry client %d refused, %d clients max", fd, WS_FANOUT_CLIENTS_MAX);
+            return ESP_FAIL;
+        }
+        log_msg(TAG, "Telemetry client %d connected (slot %d)", fd, slot);
+        return ESP_OK;
+    }
+
+    uint8_t payload[8];
+    httpd_ws_frame_t ws_pkt = {0};
+    esp_err_t ret = httpd_ws_recv_frame(req, &ws_pkt, 0);
+    if (ret != ESP_OK) return ret;
+    if (ws_pkt.len > sizeof(payload)) return ESP_ERR_INVALID_SIZE; //not a telemetry client
+
+    ws_pkt.payload = payload;
+    ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
+    if (ret == ESP_OK && ws_pkt.type == HTTPD_WS_TYPE_BINARY && ws_pkt.len == 1) {
+        xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+        ws_fanout_set_channels(&fanout, fd, payload[0]);
+        xSemaphoreGive(fanout_mutex);
+    }
+    return ret;
+}
+
+/**
+ * Session closed: forget it if it was a telemetry client
+ */
+static void telemetry_close(int sockfd)
+{
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    int slot = ws_fanout_find(&fanout, sockfd);
+    ws_fanout_client_t client = {0};
+    if (slot >= 0) {
+        client = fanout.clients[slot];
+        ws_fanout_remove(&fanout, sockfd);
+        nb_telemetry_clients = ws_fanout_count(&fanout);
+    }
+    xSemaphoreGive(fanout_mutex);
+
+    if (slot >= 0) {
+        log_msg(TAG, "Telemetry client %d gone: %" PRIu32 " records, %" PRIu32 " dropped, %" PRIu32 " batches, %" PRIu32 " KB",
+            sockfd, client.queued, client.dropped, client.batches, client.bytes_sent / 1024);
+    }
+}
+
+static esp_err_t telemetry_init()
+{
+    fanout_mutex = xSemaphoreCreateMutex();
+    uint8_t *queues = malloc(WS_FANOUT_CLIENTS_MAX * WS_TELEMETRY_QUEUE_SIZE);
+    batch_bufs = malloc(WS_FANOUT_CLIENTS_MAX * WS_TELEMETRY_BATCH_SIZE);
+    if (fanout_mutex == NULL || queues == NULL || batch_bufs == NULL) {
+        free(queues);
+        free(batch_bufs);
+        batch_bufs = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    ws_fanout_init(&fanout, queues, WS_TELEMETRY_QUEUE_SIZE);
+    if (xTaskCreate(ws_telemetry_task, "ws_telemetry", 4096, NULL, 4, &telemetry_task_handle) != pdPASS) {
+        return ESP_FAIL;
+    }
+    return udp_add_tap(telemetry_tap);
+}
+
+esp_err_t ws_get_telemetry_stats(ws_telemetry_stats_t *stats)
+{
+    if (stats == NULL) return ESP_ERR_INVALID_ARG;
+    if (fanout_mutex == NULL) return ESP_ERR_INVALID_STATE;
+
+    memset(stats, 0, sizeof(*stats));
+    xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+    for (int i = 0; i < WS_FANOUT_CLIENTS_MAX; i++) {
+        const ws_fanout_client_t *client = &fanout.clients[i];
+        if (!client->used) continue;
+        stats->clients++;
+        stats->queued += client->queued;
+        stats->dropped += client->dropped;
+        stats->batches += client->batches;
+        stats->bytes_sent += client->bytes_sent;
+    }
+    stats->rejected = fanout.rejected;
+    xSemaphoreGive(fanout_mutex);
+    stats->dropped += atomic_load(&tap_dropped);
+    return ESP_OK;
+}
+#endif
+
 /**
  * callback fonction called at each request
  * @param req request info (uri, method, header..)
@@ -42,18 +263,14 @@ static esp_err_t ws_handler(httpd_req_t *req)
     esp_err_t ret = httpd_ws_recv_frame(req, &ws_pkt, 0);
     if (ret != ESP_OK) return ret;
 
-    //once length got, allocate memory to store the payload
-    ws_pkt.payload = malloc(ws_pkt.len + 1); //+1 for null terminator
-    if (!ws_pkt.payload) return ESP_ERR_NO_MEM; //check if memory ok
+    //commands are short: stack buffer, a longer frame closes the session
+    if (ws_pkt.len > WS_CMD_MAX_LEN) return ESP_ERR_INVALID_SIZE;
+    uint8_t payload[WS_CMD_MAX_LEN + 1]; //+1 for null terminator
+    ws_pkt.payload = payload;
 
     //read data of whole message
     ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
-    
-    //free buffer if error
-    if (ret != ESP_OK) {
-        free(ws_pkt.payload);
-        return ret;
-    }
+    if (ret != ESP_OK) return ret;
 
     //adding end character to have a valid string
     ws_pkt.payload[ws_pkt.len] = '\0'; 
@@ -78,93 +295,162 @@ static esp_err_t ws_handler(httpd_req_t *req)
     };
 
     //return respond to client (req has the client info)
-    ret = httpd_ws_send_frame(req, &resp);
+    return httpd_ws_send_frame(req, &resp);
+}
 
-    //free memory buffer
-    free(ws_pkt.payload);
-    return ret;
+static void controller_stats_add(int64_t start_us, bool applied)
+{
+    uint32_t us = (uint32_t)(esp_timer_get_time() - start_us);
+
+    taskENTER_CRITICAL(&controller_stats_mux);
+    if (!applied) {
+        controller_stats.rejected++;
+    } else {
+        if (controller_last_us != 0) {
+            uint32_t gap_ms = (uint32_t)((start_us - controller_last_us) / 1000);
+            if (gap_ms > controller_stats.max_gap_ms) {
+                controller_stats.max_gap_ms = gap_ms;
+            }
+        }
+        controller_last_us = start_us;
+        controller_stats.frames++;
+        controller_stats.last_us = us;
+        controller_stats.avg_us = (controller_stats.avg_us == 0) ? us : (controller_stats.avg_us * 7 + us) / 8;
+        if (us > controller_stats.max_us) {
+            controller_stats.max_us = us;
+        }
+    }
+    taskEXIT_CRITICAL(&controller_stats_mux);
 }
 
 /**
- * callback fonction called at each request for commands by controller
+ * Frame applied: this session drives the car, watchdog restarted
+ */
+static void controller_arm(int sockfd)
+{
+    taskENTER_CRITICAL(&controller_stats_mux);
+    controller_fd = sockfd;
+    taskEXIT_CRITICAL(&controller_stats_mux);
+
+    if (esp_timer_restart(controller_timer, WS_CONTROLLER_TIMEOUT_US) != ESP_OK) {
+        esp_timer_start_once(controller_timer, WS_CONTROLLER_TIMEOUT_US); //not running yet
+    }
+}
+
+/**
+ * callback fonction called at each request for commands by controller: fast path, no
+ * allocation and no log per frame. Accepts the gamepad frame of UDP port 3333
+ * ([type][size][payload], timestamp optional) or its bare 7-byte payload, applied
+ * with cmd_lib like the UDP commands
  * @param req request info (uri, method, header..)
  * @return success or error
  */
 static esp_err_t controller_handler(httpd_req_t *req)
 {
-    //using static buffer, not malloc, for better performance, as the size is constant
-    /*static int8_t commands_buffer[7]; //6 axis, 1 for buttons*/
-
-    static uint8_t temp_buffer[7]; //avoid doing malloc, as we know the size is 7
-
     //if get method, client connected and return ok
     if (req->method == HTTP_GET) { 
-        log_msg(TAG, "Client connected");
+        log_msg(TAG, "Controller connected");
+        taskENTER_CRITICAL(&controller_stats_mux);
+        controller_last_us = 0;
+        taskEXIT_CRITICAL(&controller_stats_mux);
         return ESP_OK;
     }
 
+    int64_t start = esp_timer_get_time();
+
     //initialize structure for ws frame
     httpd_ws_frame_t ws_pkt = {0};
-
     esp_err_t ret = httpd_ws_recv_frame(req, &ws_pkt, 0);
+    if (ret != ESP_OK) return ret;
 
-    //ws_pkt.payload = malloc(ws_pkt.len);
-    ws_pkt.payload = temp_buffer;
+    //cannot be drained without a buffer that large: the session is closed
+    if (ws_pkt.len > WS_CONTROLLER_FRAME_TS_SIZE) {
+        controller_stats_add(start, false);
+        return ESP_ERR_INVALID_SIZE;
+    }
 
-    //read data of whole message
+    int8_t frame[WS_CONTROLLER_FRAME_TS_SIZE];
+    bool bare = (ws_pkt.len == WS_CONTROLLER_PAYLOAD_SIZE);
+    ws_pkt.payload = (uint8_t *)(bare ? &frame[WS_CONTROLLER_FRAME_SIZE - WS_CONTROLLER_PAYLOAD_SIZE] : frame);
     ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
-    if (ret != ESP_OK) {
-        //free(ws_pkt.payload);
-        return ret;
-    }
-
-    log_msg(TAG, "Frame size : %d", ws_pkt.len);
-    log_msg(TAG, "Frame type : %d", ws_pkt.type);
-    log_msg(TAG, "Frame final : %d", ws_pkt.final);
-    log_msg(TAG, "Frame frag : %d", ws_pkt.fragmented);
-
-    /*
-    if (ws_pkt.len != 7) {
-        log_msg(TAG, "Unexpected size of ws frame : %d", ws_pkt.len);
-    }
-    */
-    
-    int8_t *p = (int8_t *)ws_pkt.payload;
-    log_msg(TAG, "Gamepad axes raw: [%d,%d,%d,%d,%d,%d]", 
-         p[0], p[1], p[2],
-         p[3], p[4], p[5]);
-    log_msg(TAG, "Gamepad button raw: [%d,%d,%d,%d,%d,%d,%d,%d]", 
-        (p[6] & 0x01) ? 1 : 0, (p[6] & 0x02) ? 1 : 0,
-        (p[6] & 0x04) ? 1 : 0, (p[6] & 0x08) ? 1 : 0,
-        (p[6] & 0x10) ? 1 : 0, (p[6] & 0x20) ? 1 : 0,
-        (p[6] & 0x40) ? 1 : 0, (p[6] & 0x80) ? 1 : 0);
-
-    ledc_angle((int16_t)((p[0] + 100) * 9 / 10)); //left_x
-    
-    if (p[5] > -95) {
-        ledc_motor((int16_t)((p[5] + 100) / 2)); //right_trigger
-    } else if (p[4] > -95) {
-        ledc_motor((int16_t)((p[4] + 100) / (-2))); //left_trigger
+    if (ret != ESP_OK) return ret;
+
+    if (bare) {
+        frame[0] = CMD_GAMEPAD;
+        frame[1] = WS_CONTROLLER_PAYLOAD_SIZE;
+    } else if (ws_pkt.len != WS_CONTROLLER_FRAME_SIZE && ws_pkt.len != WS_CONTROLLER_FRAME_TS_SIZE) {
+        controller_stats_add(start, false);
+        return ESP_OK;
+    }
+
+    command_type_t type = CMD_TYPE_MAX;
+    gamepad_t gamepad;
+    if (get_cmd_type(frame, &type) != ESP_OK || type != CMD_GAMEPAD
+        || gamepad_from_buffer(frame, &gamepad) != ESP_OK) {
+        controller_stats_add(start, false);
+        return ESP_OK;
+    }
+
+    //same rule as UDP port 3333: during an OTA only the stop button acts
+    if (atomic_load(&ota_lock)) {
+        cmd_dispatch_stop(frame);
     } else {
-        ledc_motor(0);
+        apply_gamepad_commands(&gamepad);
     }
+    controller_arm(httpd_req_to_sockfd(req));
+    controller_stats_add(start, true);
+    return ESP_OK;
+}
 
-    /*
-    //prepare response to client
-    httpd_ws_frame_t resp = {
-        .type = HTTPD_WS_TYPE_TEXT,
-        .payload = (uint8_t *)"OK", //cast to fit type
-        .len = 2
-    };
+esp_err_t ws_get_controller_stats(ws_controller_stats_t *stats)
+{
+    if (stats == NULL) return ESP_ERR_INVALID_ARG;
 
-    //return respond to client (req has the client info)
-    ret = httpd_ws_send_frame(req, &resp);
-    */
+    taskENTER_CRITICAL(&controller_stats_mux);
+    *stats = controller_stats;
+    taskEXIT_CRITICAL(&controller_stats_mux);
+    return ESP_OK;
+}
 
-    //free(ws_pkt.payload);
-    return ret;
+/**
+ * Controller silent for WS_CONTROLLER_TIMEOUT_MS (link lost, page frozen..):
+ * neutral commands, as udp_lib does on its receive timeout. Next frame drives again
+ */
+static void controller_timeout(void *arg)
+{
+    taskENTER_CRITICAL(&controller_stats_mux);
+    controller_stats.timeouts++;
+    controller_last_us = 0;
+    taskEXIT_CRITICAL(&controller_stats_mux);
+    reset_command();
 }
 
+/**
+ * Session closed (any URI): neutral commands if it was driving the car, forget it
+ * if it was a telemetry client
+ */
+static void ws_close_fn(httpd_handle_t hd, int sockfd)
+{
+    taskENTER_CRITICAL(&controller_stats_mux);
+    bool controlling = (sockfd == controller_fd);
+    if (controlling) {
+        controller_fd = -1;
+        controller_last_us = 0;
+    }
+    taskEXIT_CRITICAL(&controller_stats_mux);
+
+    if (controlling) {
+        esp_timer_stop(controller_timer);
+        reset_command();
+        log_msg(TAG, "Controller %d gone, commands reset", sockfd);
+    }
+#if CONFIG_WS_TELEMETRY
+    if (telemetry_ready) {
+        telemetry_close(sockfd);
+    }
+#endif
+    close(sockfd);
+}
 
 // Uri websocket : get, ws_handler
 static httpd_uri_t ws_uri = {
@@ -182,6 +468,16 @@ static httpd_uri_t controller_uri = {
     .is_websocket = true
 };
 
+#if CONFIG_WS_TELEMETRY
+// Uri websocket : get, telemetry_handler
+static httpd_uri_t telemetry_uri = {
+    .uri        = "/ws/telemetry",
+    .method     = HTTP_GET,
+    .handler    = telemetry_handler,
+    .is_websocket = true
+};
+#endif
+
 /**
  * Function to init server : 
  * Init server handler with default config on port 80 and register uri handlers
@@ -190,17 +486,41 @@ void ws_server_init()
 {
     if (server != NULL) {
         log_msg(TAG, "WS server already initialized");
+        return;
     }
 
     //get default config, on port 80
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
+    config.max_open_sockets = WS_MAX_OPEN_SOCKETS;
+
+#if CONFIG_WS_TELEMETRY
+    esp_err_t err = telemetry_init();
+    if (err != ESP_OK) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) initializing WS telemetry", esp_err_to_name(err));
+    }
+    telemetry_ready = (err == ESP_OK);
+#endif
+    const esp_timer_create_args_t controller_timer_args = {
+        .callback = &controller_timeout,
+        .name = "ws_controller"
+    };
+    if (esp_timer_create(&controller_timer_args, &controller_timer) != ESP_OK) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error creating the controller watchdog");
+        return;
+    }
+    config.close_fn = ws_close_fn;
 
     //start server on server handler with default config
     if (httpd_start(&server, &config) == ESP_OK) {
         //register uri handler from before
         httpd_register_uri_handler(server, &ws_uri);
         httpd_register_uri_handler(server, &controller_uri);
+    #if CONFIG_WS_TELEMETRY
+        if (err == ESP_OK) {
+            httpd_register_uri_handler(server, &telemetry_uri);
+        }
+    #endif
         log_msg(TAG, "WS server started");
     } else {
         log_msg(TAG, "Error on WS server startup");
@@ -225,8 +545,25 @@ esp_err_t ws_send_text(const char *msg)
     frame.payload = (uint8_t *)msg;
     frame.len = strlen(msg);
 
-    //send frame to all clients
-    //if server handler : all clients
-    //if request req : one client
-    return httpd_ws_send_frame(server, &frame);
+    //httpd_ws_send_frame needs a request (one client): every websocket session of the
+    //server gets its own send, telemetry ones excepted (binary stream only)
+    int client_fds[WS_MAX_OPEN_SOCKETS];
+    size_t nb_clients = WS_MAX_OPEN_SOCKETS;
+    esp_err_t ret = httpd_get_client_list(server, &nb_clients, client_fds);
+    if (ret != ESP_OK) return ret;
+
+    for (size_t i = 0; i < nb_clients; i++) {
+        if (httpd_ws_get_fd_info(server, client_fds[i]) != HTTPD_WS_CLIENT_WEBSOCKET) continue;
+    #if CONFIG_WS_TELEMETRY
+        xSemaphoreTake(fanout_mutex, portMAX_DELAY);
+        bool telemetry = ws_fanout_find(&fanout, client_fds[i]) >= 0;
+        xSemaphoreGive(fanout_mutex);
+        if (telemetry) continue;
+    #endif
+        esp_err_t err = httpd_ws_send_data(server, client_fds[i], &frame);
+        if (err != ESP_OK) {
+            ret = err;
+        }
+    }
+    return ret;
 }
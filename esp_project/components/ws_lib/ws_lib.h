@@ -1,6 +1,7 @@
 #ifndef WS_LIB_H_
 #define WS_LIB_H_
 
+#include <inttypes.h>
 #include <esp_err.h>
 
 // Initialize websocket server
@@ -9,4 +10,29 @@ void ws_server_init();
 // Send a message to all clients
 esp_err_t ws_send_text(const char *msg);
 
+typedef struct {
+    uint32_t frames;        // controller frames applied
+    uint32_t rejected;      // bad size or type
+    uint32_t last_us;       // receive + parse + apply of the last frame
+    uint32_t avg_us;        // smoothed over ~8 frames
+    uint32_t max_us;
+    uint32_t max_gap_ms;    // longest silence between two frames of a client
+    uint32_t timeouts;      // commands reset by the receive watchdog
+} ws_controller_stats_t;
+
+// Latency counters of the controller endpoint (/ws/controller)
+esp_err_t ws_get_controller_stats(ws_controller_stats_t *stats);
+
+typedef struct {
+    uint32_t clients;       // telemetry clients connected
+    uint32_t queued;        // records queued, summed over the clients
+    uint32_t dropped;       // records dropped by a full queue or a busy lock
+    uint32_t batches;
+    uint32_t bytes_sent;
+    uint32_t rejected;      // connections refused, table full
+} ws_telemetry_stats_t;
+
+// Counters of the telemetry endpoint (/ws/telemetry), CONFIG_WS_TELEMETRY
+esp_err_t ws_get_telemetry_stats(ws_telemetry_stats_t *stats);
+
 #endif
\ No newline at end of file
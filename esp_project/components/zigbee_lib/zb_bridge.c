@@ -0,0 +1,353 @@
+#include "zb_bridge.h"
+#include <string.h>
+
+void zb_bridge_init(zb_bridge_t *b) {
+    memset(b, 0, sizeof(*b));
+    for (size_t i = 0; i < ZB_BRIDGE_DEVICES; i++) {
+        b->devices[i].short_addr = ZB_BRIDGE_NO_ADDR;
+    }
+}
+
+size_t zb_zcl_type_size(uint8_t type) {
+    if (type >= 0x08 && type <= 0x0F) {         // data8..data64
+        return type - 0x07;
+    }
+    if (type >= 0x18 && type <= 0x1F) {         // map8..map64
+        return type - 0x17;
+    }
+    if (type >= 0x20 && type <= 0x27) {         // uint8..uint64
+        return type - 0x1F;
+    }
+    if (type >= 0x28 && type <= 0x2F) {         // int8..int64
+        return type - 0x27;
+    }
+    switch (type) {
+        case 0x10:  // bool
+        case 0x30:  // enum8
+            return 1;
+        case 0x31:  // enum16
+        case 0x38:  // semi-precision float
+        case 0xE8:  // cluster id
+        case 0xE9:  // attribute id
+            return 2;
+        case 0x39:  // single precision float
+        case 0xE0:  // time of day
+        case 0xE1:  // date
+        case 0xE2:  // UTC time
+        case 0xEA:  // BACnet OID
+            return 4;
+        case 0x3A:  // double precision float
+        case 0xF0:  // IEEE address
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+bool zb_zcl_type_analog(uint8_t type) {
+    return (type >= 0x20 && type <= 0x2F) || (type >= 0x38 && type <= 0x3A) || (type >= 0xE0 && type <= 0xE2);
+}
+
+static int device_index(const zb_bridge_t *b, uint16_t short_addr) {
+    if (short_addr == ZB_BRIDGE_NO_ADDR) {
+        return -1;
+    }
+    for (int i = 0; i < ZB_BRIDGE_DEVICES; i++) {
+        if (b->devices[i].short_addr == short_addr) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void drop_attrs(zb_bridge_t *b, int dev) {
+    for (size_t i = 0; i < ZB_BRIDGE_ATTRS; i++) {
+        if (b->attrs[i].ep != 0 && b->attrs[i].dev == dev) {
+            memset(&b->attrs[i], 0, sizeof(b->attrs[i]));
+        }
+    }
+}
+
+int zb_bridge_device_seen(zb_bridge_t *b, uint16_t short_addr, const uint8_t *ieee, uint32_t now_ms) {
+    int dev = device_index(b, short_addr);
+    if (dev < 0 && ieee != NULL) {
+        // rejoined with a new short address: same device
+        for (int i = 0; i < ZB_BRIDGE_DEVICES; i++) {
+            if (b->devices[i].short_addr != ZB_BRIDGE_NO_ADDR && memcmp(b->devices[i].ieee, ieee, 8) == 0) {
+                dev = i;
+                b->devices[i].short_addr = short_addr;
+                break;
+            }
+        }
+    }
+    if (dev < 0) {
+        int oldest = 0;
+        for (int i = 0; i < ZB_BRIDGE_DEVICES; i++) {
+            if (b->devices[i].short_addr == ZB_BRIDGE_NO_ADDR) {
+                dev = i;
+                break;
+            }
+            if ((int32_t)(b->devices[i].last_seen_ms - b->devices[oldest].last_seen_ms) < 0) {
+                oldest = i;
+            }
+        }
+        if (dev < 0) {
+            dev = oldest;
+            drop_attrs(b, dev);
+            b->stats.devices_evicted++;
+        }
+        memset(&b->devices[dev], 0, sizeof(b->devices[dev]));
+        b->devices[dev].short_addr = short_addr;
+    }
+    if (ieee != NULL) {
+        memcpy(b->devices[dev].ieee, ieee, 8);
+    }
+    b->devices[dev].last_seen_ms = now_ms;
+    return dev;
+}
+
+int zb_bridge_device_joined(zb_bridge_t *b, uint16_t short_addr, const uint8_t *ieee, uint32_t now_ms) {
+    int dev = zb_bridge_device_seen(b, short_addr, ieee, now_ms);
+    b->devices[dev].cfg_done = 0;
+    b->devices[dev].cfg_pending = 0;
+    b->devices[dev].cfg_unsupported = 0;
+    return dev;
+}
+
+void zb_bridge_device_left(zb_bridge_t *b, uint16_t short_addr) {
+    int dev = device_index(b, short_addr);
+    if (dev < 0) {
+        return;
+    }
+    drop_attrs(b, dev);
+    memset(&b->devices[dev], 0, sizeof(b->devices[dev]));
+    b->devices[dev].short_addr = ZB_BRIDGE_NO_ADDR;
+}
+
+zb_device_t *zb_bridge_device(zb_bridge_t *b, uint16_t short_addr) {
+    int dev = device_index(b, short_addr);
+    return dev < 0 ? NULL : &b->devices[dev];
+}
+
+size_t zb_bridge_device_count(const zb_bridge_t *b) {
+    size_t count = 0;
+    for (size_t i = 0; i < ZB_BRIDGE_DEVICES; i++) {
+        if (b->devices[i].short_addr != ZB_BRIDGE_NO_ADDR) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint16_t zb_bridge_cfg_missing(const zb_bridge_t *b, uint16_t short_addr, uint16_t wanted) {
+    int dev = device_index(b, short_addr);
+    if (dev < 0) {
+        return wanted;
+    }
+    const zb_device_t *d = &b->devices[dev];
+    return wanted & (uint16_t)~(d->cfg_done | d->cfg_pending | d->cfg_unsupported);
+}
+
+void zb_bridge_cfg_sent(zb_bridge_t *b, uint16_t short_addr, size_t idx) {
+    int dev = device_index(b, short_addr);
+    if (dev >= 0) {
+        b->devices[dev].cfg_pending |= (uint16_t)(1u << idx);
+    }
+}
+
+void zb_bridge_cfg_result(zb_bridge_t *b, uint16_t short_addr, size_t idx, zb_cfg_result_t result) {
+    int dev = device_index(b, short_addr);
+    if (dev < 0) {
+        return;
+    }
+    uint16_t bit = (uint16_t)(1u << idx);
+    zb_device_t *d = &b->devices[dev];
+    d->cfg_pending &= (uint16_t)~bit;
+    if (result == ZB_CFG_ACCEPTED) {
+        d->cfg_done |= bit;
+    } else if (result == ZB_CFG_REFUSED) {
+        d->cfg_unsupported |= bit;
+    }
+}
+
+static int attr_index(const zb_bridge_t *b, int dev, uint8_t ep, uint16_t cluster, uint16_t attr) {
+    for (int i = 0; i < ZB_BRIDGE_ATTRS; i++) {
+        const zb_attr_t *a = &b->attrs[i];
+        if (a->ep == ep && a->dev == dev && a->cluster == cluster && a->attr == attr) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool zb_bridge_attr_update(zb_bridge_t *b, uint16_t short_addr, uint8_t ep, uint16_t cluster,
+    const zb_report_attr_t *attr, uint32_t now_ms) {
+    size_t len = zb_zcl_type_size(attr->type);
+    if (len == 0 || len > ZB_BRIDGE_VALUE_MAX || attr->value == NULL || ep == 0) {
+        b->stats.attrs_unsupported++;
+        return false;
+    }
+    int dev = zb_bridge_device_seen(b, short_addr, NULL, now_ms);
+
+    int slot = attr_index(b, dev, ep, cluster, attr->attr);
+    if (slot < 0) {
+        int oldest = 0;
+        for (int i = 0; i < ZB_BRIDGE_ATTRS; i++) {
+            if (b->attrs[i].ep == 0) {
+                slot = i;
+                break;
+            }
+            if ((int32_t)(b->attrs[i].updated_ms - b->attrs[oldest].updated_ms) < 0) {
+                oldest = i;
+            }
+        }
+        if (slot < 0) {
+            slot = oldest;
+            b->stats.attrs_evicted++;
+        }
+    }
+    zb_attr_t *a = &b->attrs[slot];
+    a->dev = (uint8_t)dev;
+    a->ep = ep;
+    a->cluster = cluster;
+    a->attr = attr->attr;
+    a->type = attr->type;
+    a->len = (uint8_t)len;
+    memcpy(a->value, attr->value, len);
+    a->updated_ms = now_ms;
+    b->stats.attrs_updated++;
+    return true;
+}
+
+const zb_attr_t *zb_bridge_attr_get(const zb_bridge_t *b, uint16_t short_addr, uint8_t ep,
+    uint16_t cluster, uint16_t attr) {
+    int dev = device_index(b, short_addr);
+    if (dev < 0 || ep == 0) {
+        return NULL;
+    }
+    int slot = attr_index(b, dev, ep, cluster, attr);
+    return slot < 0 ? NULL : &b->attrs[slot];
+}
+
+bool zb_attr_to_int32(const zb_attr_t *attr, int32_t *value) {
+    uint8_t type = attr->type;
+    bool is_signed = type >= 0x28 && type <= 0x2F;
+    bool is_integer = is_signed || (type >= 0x08 && type <= 0x31 && type != 0x38);
+    if (!is_integer || attr->len == 0) {
+        return false;
+    }
+    size_t n = attr->len < 4 ? attr->len : 4;
+    uint32_t raw = 0;
+    for (size_t i = 0; i < n; i++) {
+        raw |= (uint32_t)attr->value[i] << (8 * i);
+    }
+    if (is_signed && n < 4 && (raw & (1u << (8 * n - 1)))) {
+        raw |= ~0u << (8 * n);
+    }
+    *value = (int32_t)raw;
+    return true;
+}
+
+static void put_u16(uint8_t *buf, uint16_t v) {
+    buf[0] = (uint8_t)v;
+    buf[1] = (uint8_t)(v >> 8);
+}
+
+static uint16_t get_u16(const uint8_t *buf) {
+    return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+size_t zb_bridge_report_payload(uint16_t short_addr, uint8_t ep, uint16_t cluster,
+    const zb_report_attr_t *attrs, size_t count, uint8_t *out, size_t capacity) {
+    if (capacity < ZB_REPORT_FRAME_HEADER_SIZE) {
+        return 0;
+    }
+    size_t len = ZB_REPORT_FRAME_HEADER_SIZE;
+    uint8_t n = 0;
+    for (size_t i = 0; i < count && n < ZB_BRIDGE_REPORT_MAX; i++) {
+        size_t size = zb_zcl_type_size(attrs[i].type);
+        if (size == 0 || attrs[i].value == NULL) {
+            continue;
+        }
+        if (len + ZB_REPORT_RECORD_HEADER_SIZE + size > capacity) {
+            return 0;
+        }
+        put_u16(&out[len], attrs[i].attr);
+        out[len + 2] = attrs[i].type;
+        out[len + 3] = (uint8_t)size;
+        memcpy(&out[len + ZB_REPORT_RECORD_HEADER_SIZE], attrs[i].value, size);
+        len += ZB_REPORT_RECORD_HEADER_SIZE + size;
+        n++;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    put_u16(&out[0], short_addr);
+    out[2] = ep;
+    put_u16(&out[3], cluster);
+    out[5] = n;
+    return len;
+}
+
+void zb_bridge_device_payload(const zb_bridge_t *b, uint16_t short_addr, const uint8_t *ieee,
+    zb_device_event_t event, uint8_t *out) {
+    put_u16(&out[0], short_addr);
+    if (ieee != NULL) {
+        memcpy(&out[2], ieee, 8);
+    } else {
+        memset(&out[2], 0, 8);
+    }
+    out[10] = (uint8_t)event;
+    out[11] = (uint8_t)zb_bridge_device_count(b);
+}
+
+size_t zb_report_cfg_encode(const zb_report_cfg_t *cfg, uint8_t *out) {
+    size_t size = zb_zcl_type_size(cfg->type);
+    bool analog = zb_zcl_type_analog(cfg->type);
+    if (size == 0 || (analog && size > 4)) {
+        return 0;
+    }
+    out[0] = 0x00;  // direction: reported by the device
+    put_u16(&out[1], cfg->attr);
+    out[3] = cfg->type;
+    put_u16(&out[4], cfg->min_interval_s);
+    put_u16(&out[6], cfg->max_interval_s);
+    size_t len = 8;
+    if (analog) {
+        for (size_t i = 0; i < size; i++) {
+            out[len++] = (uint8_t)(cfg->reportable_change >> (8 * i));
+        }
+    }
+    return len;
+}
+
+bool zb_report_cfg_decode(const uint8_t *buf, size_t len, zb_report_cfg_t *cfg) {
+    if (len < 8 || buf[0] != 0x00) {
+        return false;
+    }
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->attr = get_u16(&buf[1]);
+    cfg->type = buf[3];
+    cfg->min_interval_s = get_u16(&buf[4]);
+    cfg->max_interval_s = get_u16(&buf[6]);
+    if (!zb_zcl_type_analog(cfg->type)) {
+        return len == 8;
+    }
+    size_t size = zb_zcl_type_size(cfg->type);
+    if (size > 4 || len != 8 + size) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        cfg->reportable_change |= (uint32_t)buf[8 + i] << (8 * i);
+    }
+    return true;
+}
+
+int zb_report_cfg_find(const zb_report_cfg_t *profile, size_t count, uint16_t cluster, uint16_t attr) {
+    for (size_t i = 0; i < count; i++) {
+        if (profile[i].cluster == cluster && profile[i].attr == attr) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
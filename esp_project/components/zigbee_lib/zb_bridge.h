@@ -0,0 +1,197 @@
+#ifndef ZB_BRIDGE_H_
+#define ZB_BRIDGE_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Coordinator view of the Zigbee network, kept in RAM and read from there
+// instead of querying devices over the air:
+// - device table: short and IEEE address, last activity, reporting state,
+// - attribute cache: last value of every reported (device, endpoint,
+//   cluster, attribute), least recently updated entry reused when full,
+// - ZCL attribute reports translated into telemetry payloads, and the
+//   Configure Reporting records pushed to the devices.
+// Pure code (no Zigbee stack, no FreeRTOS) so it can be run on the host.
+
+#define ZB_BRIDGE_DEVICES 16
+#define ZB_BRIDGE_ATTRS 64
+#define ZB_BRIDGE_VALUE_MAX 8       // widest cached ZCL value (uint64)
+#define ZB_BRIDGE_REPORT_MAX 8      // attributes per telemetry frame
+
+#define ZB_BRIDGE_NO_ADDR 0xFFFF
+
+// ZCL global command: Configure Reporting
+#define ZB_ZCL_CMD_CONFIG_REPORT 0x06
+// Configure Reporting record: [direction][attr u16][type][min u16][max u16][reportable change]
+#define ZB_REPORT_CFG_RECORD_MAX (1 + 2 + 1 + 2 + 2 + 4)
+
+// SENSOR_TYPE_ZIGBEE payload, little-endian:
+// [0..1] = short address, [2] = endpoint, [3..4] = cluster, [5] = attribute count n,
+// then n records [attr id u16][ZCL type][length][value, ZCL byte order].
+#define ZB_REPORT_FRAME_HEADER_SIZE 6
+#define ZB_REPORT_RECORD_HEADER_SIZE 4
+
+// SENSOR_TYPE_ZIGBEE_DEVICE payload:
+// [0..1] = short address, [2..9] = IEEE address, [10] = zb_device_event_t, [11] = devices known
+#define ZB_DEVICE_FRAME_SIZE 12
+
+typedef enum {
+    ZB_DEVICE_JOINED = 1,   // announce: joined or rejoined
+    ZB_DEVICE_LEFT = 2,
+} zb_device_event_t;
+
+// Outcome of a Configure Reporting sent to a device
+typedef enum {
+    ZB_CFG_ACCEPTED = 0,
+    ZB_CFG_REFUSED,         // not asked again until the device rejoins
+    ZB_CFG_FAILED,          // no answer, or not on that endpoint: asked again on the next report
+} zb_cfg_result_t;
+
+typedef struct {
+    uint16_t short_addr;    // ZB_BRIDGE_NO_ADDR: free
+    uint8_t ieee[8];
+    uint32_t last_seen_ms;
+    uint32_t reports;
+    uint16_t cfg_done;      // per reporting profile entry: accepted by the device
+    uint16_t cfg_pending;   // sent, waiting for the response
+    uint16_t cfg_unsupported;
+} zb_device_t;
+
+typedef struct {
+    uint8_t dev;            // device table index
+    uint8_t ep;             // 0: free
+    uint16_t cluster;
+    uint16_t attr;
+    uint8_t type;           // ZCL data type
+    uint8_t len;
+    uint8_t value[ZB_BRIDGE_VALUE_MAX];
+    uint32_t updated_ms;
+} zb_attr_t;
+
+typedef struct {
+    uint32_t reports;
+    uint32_t attrs_updated;
+    uint32_t attrs_unsupported; // types with no fixed size (strings, arrays...)
+    uint32_t attrs_evicted;
+    uint32_t devices_evicted;
+} zb_bridge_stats_t;
+
+typedef struct {
+    zb_device_t devices[ZB_BRIDGE_DEVICES];
+    zb_attr_t attrs[ZB_BRIDGE_ATTRS];
+    zb_bridge_stats_t stats;
+} zb_bridge_t;
+
+// Reporting wanted for one attribute, pushed to the devices that have it
+typedef struct {
+    uint16_t cluster;
+    uint16_t attr;
+    uint8_t type;
+    uint16_t min_interval_s;
+    uint16_t max_interval_s;
+    uint32_t reportable_change; // analog types only
+} zb_report_cfg_t;
+
+// One attribute of a received report, value as received (ZCL byte order)
+typedef struct {
+    uint16_t attr;
+    uint8_t type;
+    const void *value;
+} zb_report_attr_t;
+
+void zb_bridge_init(zb_bridge_t *b);
+
+/**
+ * Size of a value of a ZCL data type.
+ *
+ * @return 0 for types without a fixed size (strings, arrays, structures)
+ */
+size_t zb_zcl_type_size(uint8_t type);
+
+/** @return true for analog ZCL types (integers, floats, time), which have a reportable change */
+bool zb_zcl_type_analog(uint8_t type);
+
+/**
+ * A device announced itself or sent something: add or refresh it. A full table
+ * reuses the least recently seen device (and drops its attributes).
+ *
+ * @param ieee  NULL if unknown (kept as is)
+ * @return device index
+ */
+int zb_bridge_device_seen(zb_bridge_t *b, uint16_t short_addr, const uint8_t *ieee, uint32_t now_ms);
+
+/**
+ * A device announced itself (joined or rejoined): as zb_bridge_device_seen, and
+ * its reporting configuration starts over (a rejoining device may have lost it).
+ *
+ * @return device index
+ */
+int zb_bridge_device_joined(zb_bridge_t *b, uint16_t short_addr, const uint8_t *ieee, uint32_t now_ms);
+
+/** Device left: forget it and its attributes */
+void zb_bridge_device_left(zb_bridge_t *b, uint16_t short_addr);
+
+zb_device_t *zb_bridge_device(zb_bridge_t *b, uint16_t short_addr);
+
+size_t zb_bridge_device_count(const zb_bridge_t *b);
+
+/**
+ * Reporting profile entries (bit i = entry i) among `wanted` still to be
+ * configured on a device: neither accepted, waiting for a response nor refused.
+ * All of them for an unknown device.
+ */
+uint16_t zb_bridge_cfg_missing(const zb_bridge_t *b, uint16_t short_addr, uint16_t wanted);
+
+/** Configure Reporting of profile entry `idx` sent, waiting for the response */
+void zb_bridge_cfg_sent(zb_bridge_t *b, uint16_t short_addr, size_t idx);
+
+void zb_bridge_cfg_result(zb_bridge_t *b, uint16_t short_addr, size_t idx, zb_cfg_result_t result);
+
+/**
+ * Cache the value of a reported attribute.
+ *
+ * @return false if the type has no fixed size (not cached)
+ */
+bool zb_bridge_attr_update(zb_bridge_t *b, uint16_t short_addr, uint8_t ep, uint16_t cluster,
+    const zb_report_attr_t *attr, uint32_t now_ms);
+
+/** @return cached attribute, NULL if never reported */
+const zb_attr_t *zb_bridge_attr_get(const zb_bridge_t *b, uint16_t short_addr, uint8_t ep,
+    uint16_t cluster, uint16_t attr);
+
+/**
+ * Numeric value of a cached attribute (booleans, bitmaps, enums and integers,
+ * 64-bit values truncated).
+ *
+ * @return false for floats and other types
+ */
+bool zb_attr_to_int32(const zb_attr_t *attr, int32_t *value);
+
+/**
+ * Build the SENSOR_TYPE_ZIGBEE payload of a report (attributes without a
+ * fixed size are left out).
+ *
+ * @return payload length, 0 if `capacity` is too small or nothing is left
+ */
+size_t zb_bridge_report_payload(uint16_t short_addr, uint8_t ep, uint16_t cluster,
+    const zb_report_attr_t *attrs, size_t count, uint8_t *out, size_t capacity);
+
+/** Build the SENSOR_TYPE_ZIGBEE_DEVICE payload (ZB_DEVICE_FRAME_SIZE bytes) */
+void zb_bridge_device_payload(const zb_bridge_t *b, uint16_t short_addr, const uint8_t *ieee,
+    zb_device_event_t event, uint8_t *out);
+
+/**
+ * Encode a Configure Reporting record (ZB_REPORT_CFG_RECORD_MAX bytes at most).
+ *
+ * @return record length, 0 if the type is not supported
+ */
+size_t zb_report_cfg_encode(const zb_report_cfg_t *cfg, uint8_t *out);
+
+/** Decode a record built by zb_report_cfg_encode, @return false if malformed */
+bool zb_report_cfg_decode(const uint8_t *buf, size_t len, zb_report_cfg_t *cfg);
+
+/** @return index of (cluster, attr) in a reporting profile, -1 if absent */
+int zb_report_cfg_find(const zb_report_cfg_t *profile, size_t count, uint16_t cluster, uint16_t attr);
+
+#endif
@@ -0,0 +1,220 @@
+#include "zb_cmdq.h"
+#include <string.h>
+
+// wrap-safe "a is at or after b" on millisecond timestamps
+#define TIME_REACHED(a, b) ((int32_t)((a) - (b)) >= 0)
+
+void zb_cmdq_init(zb_cmdq_t *q, const zb_cmdq_ops_t *ops, uint32_t timeout_ms,
+    uint8_t max_attempts, uint32_t backoff_ms) {
+    memset(q, 0, sizeof(*q));
+    q->ops = *ops;
+    q->timeout_ms = timeout_ms;
+    q->max_attempts = max_attempts > 0 ? max_attempts : 1;
+    q->backoff_ms = backoff_ms > 0 ? backoff_ms : 1;
+}
+
+size_t zb_cmdq_pending(const zb_cmdq_t *q) {
+    size_t count = 0;
+    for (size_t i = 0; i < ZB_CMDQ_SLOTS; i++) {
+        if (q->entries[i].state != ZB_CMDQ_FREE) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static bool same_destination(const zb_cmd_t *a, const zb_cmd_t *b) {
+    return a->dst_mode == b->dst_mode && a->addr == b->addr;
+}
+
+/**
+ * Free the entry, then report it: `done` may submit again
+ */
+static void complete(zb_cmdq_t *q, zb_cmdq_entry_t *entry, zb_cmd_result_t result, uint8_t status,
+    uint32_t now_ms) {
+    zb_cmdq_entry_t done = *entry;
+    memset(entry, 0, sizeof(*entry));
+    uint32_t latency = now_ms - done.submitted_ms;
+
+    switch (result) {
+        case ZB_CMD_DELIVERED:
+            q->stats.delivered++;
+            if (q->stats.delivered == 1 || latency < q->stats.latency_min_ms) {
+                q->stats.latency_min_ms = latency;
+            }
+            if (latency > q->stats.latency_max_ms) {
+                q->stats.latency_max_ms = latency;
+            }
+            q->stats.latency_sum_ms += latency;
+            break;
+        case ZB_CMD_REJECTED:
+            q->stats.rejected++;
+            break;
+        case ZB_CMD_TIMEOUT:
+            q->stats.timeouts++;
+            break;
+        case ZB_CMD_SENT:
+            q->stats.group_sent++;
+            break;
+        case ZB_CMD_REPLACED:
+            q->stats.replaced++;
+            break;
+        case ZB_CMD_SEND_FAILED:
+            break;
+    }
+    if (done.done != NULL) {
+        done.done(done.id, result, status, latency, done.arg);
+    }
+}
+
+static uint32_t backoff(const zb_cmdq_t *q, uint8_t attempts) {
+    uint32_t delay = q->backoff_ms;
+    for (uint8_t i = 1; i < attempts && delay < ZB_CMDQ_BACKOFF_MAX_MS; i++) {
+        delay <<= 1;
+    }
+    return delay < ZB_CMDQ_BACKOFF_MAX_MS ? delay : ZB_CMDQ_BACKOFF_MAX_MS;
+}
+
+bool zb_cmdq_submit(zb_cmdq_t *q, const zb_cmd_t *cmd, uint32_t id, zb_cmd_done_cb_t done,
+    void *arg, uint32_t now_ms) {
+    if (cmd == NULL || cmd->payload_len > ZB_CMDQ_PAYLOAD_MAX) {
+        return false;
+    }
+    zb_cmdq_entry_t *slot = NULL;
+    uint32_t seq = q->next_seq;
+
+    if (cmd->flags & ZB_CMD_FLAG_COALESCE) {
+        for (size_t i = 0; i < ZB_CMDQ_SLOTS; i++) {
+            zb_cmdq_entry_t *e = &q->entries[i];
+            if (e->state == ZB_CMDQ_QUEUED && e->attempts == 0 && (e->cmd.flags & ZB_CMD_FLAG_COALESCE)
+                && same_destination(&e->cmd, cmd) && e->cmd.ep == cmd->ep && e->cmd.cluster == cmd->cluster) {
+                // the new command takes the place of the replaced one in the queue
+                seq = e->seq;
+                complete(q, e, ZB_CMD_REPLACED, 0, now_ms);
+                slot = e;
+                break;
+            }
+        }
+    }
+    if (slot == NULL) {
+        for (size_t i = 0; i < ZB_CMDQ_SLOTS; i++) {
+            if (q->entries[i].state == ZB_CMDQ_FREE) {
+                slot = &q->entries[i];
+                break;
+            }
+        }
+        if (slot == NULL) {
+            q->stats.dropped++;
+            return false;
+        }
+        q->next_seq++;
+    }
+
+    slot->state = ZB_CMDQ_QUEUED;
+    slot->cmd = *cmd;
+    slot->id = id;
+    slot->seq = seq;
+    slot->attempts = 0;
+    slot->submitted_ms = now_ms;
+    slot->retry_ms = now_ms;
+    slot->done = done;
+    slot->arg = arg;
+    q->stats.submitted++;
+
+    size_t pending = zb_cmdq_pending(q);
+    if (pending > q->stats.queued_peak) {
+        q->stats.queued_peak = (uint8_t)pending;
+    }
+    return true;
+}
+
+bool zb_cmdq_response(zb_cmdq_t *q, uint16_t src_addr, uint8_t tsn, uint8_t status, uint32_t now_ms) {
+    for (size_t i = 0; i < ZB_CMDQ_SLOTS; i++) {
+        zb_cmdq_entry_t *e = &q->entries[i];
+        // a late response to an attempt already waiting for its retry counts too
+        if (e->attempts > 0 && e->state != ZB_CMDQ_FREE && e->cmd.dst_mode == ZB_DST_SHORT
+            && e->cmd.addr == src_addr && e->tsn == tsn) {
+            complete(q, e, status == ZB_CMDQ_STATUS_SUCCESS ? ZB_CMD_DELIVERED : ZB_CMD_REJECTED,
+                status, now_ms);
+            return true;
+        }
+    }
+    q->stats.unmatched++;
+    return false;
+}
+
+/**
+ * Oldest queued command that can be sent now: due, and its destination has
+ * nothing in flight nor older queued
+ */
+static zb_cmdq_entry_t *next_to_send(zb_cmdq_t *q, uint32_t now_ms) {
+    zb_cmdq_entry_t *best = NULL;
+    for (size_t i = 0; i < ZB_CMDQ_SLOTS; i++) {
+        zb_cmdq_entry_t *e = &q->entries[i];
+        if (e->state != ZB_CMDQ_QUEUED || !TIME_REACHED(now_ms, e->retry_ms)
+            || (best != NULL && (int32_t)(e->seq - best->seq) > 0)) {
+            continue;
+        }
+        bool blocked = false;
+        for (size_t j = 0; j < ZB_CMDQ_SLOTS && !blocked; j++) {
+            const zb_cmdq_entry_t *f = &q->entries[j];
+            blocked = f != e && f->state != ZB_CMDQ_FREE && same_destination(&f->cmd, &e->cmd)
+                && (f->state == ZB_CMDQ_INFLIGHT || (int32_t)(f->seq - e->seq) < 0);
+        }
+        if (!blocked) {
+            best = e;
+        }
+    }
+    return best;
+}
+
+size_t zb_cmdq_poll(zb_cmdq_t *q, uint32_t now_ms, bool network_up) {
+    size_t inflight = 0;
+    for (size_t i = 0; i < ZB_CMDQ_SLOTS; i++) {
+        zb_cmdq_entry_t *e = &q->entries[i];
+        if (e->state != ZB_CMDQ_INFLIGHT) {
+            continue;
+        }
+        if (!TIME_REACHED(now_ms, e->deadline_ms)) {
+            inflight++;
+        } else if (e->attempts < q->max_attempts) {
+            e->state = ZB_CMDQ_QUEUED;
+            e->retry_ms = now_ms + backoff(q, e->attempts);
+        } else {
+            complete(q, e, ZB_CMD_TIMEOUT, 0, now_ms);
+        }
+    }
+    if (!network_up) {
+        return 0;
+    }
+
+    size_t sent = 0;
+    zb_cmdq_entry_t *e;
+    while (inflight < ZB_CMDQ_INFLIGHT_MAX && (e = next_to_send(q, now_ms)) != NULL) {
+        if (e->attempts > 0) {
+            q->stats.retries++;
+        }
+        e->attempts++;
+        int tsn = q->ops.send(&e->cmd, q->ops.ctx);
+        if (tsn < 0) {
+            q->stats.send_errors++;
+            if (e->attempts < q->max_attempts) {
+                e->retry_ms = now_ms + backoff(q, e->attempts);
+            } else {
+                complete(q, e, ZB_CMD_SEND_FAILED, 0, now_ms);
+            }
+            continue;
+        }
+        q->stats.sent++;
+        sent++;
+        if (e->cmd.dst_mode != ZB_DST_SHORT) {
+            complete(q, e, ZB_CMD_SENT, 0, now_ms);
+            continue;
+        }
+        e->state = ZB_CMDQ_INFLIGHT;
+        e->tsn = (uint8_t)tsn;
+        e->deadline_ms = now_ms + q->timeout_ms;
+        inflight++;
+    }
+    return sent;
+}
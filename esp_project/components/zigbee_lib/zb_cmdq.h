@@ -0,0 +1,150 @@
+#ifndef ZB_CMDQ_H_
+#define ZB_CMDQ_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// ZCL command scheduler, owned by the Zigbee main loop:
+// - commands wait in a bounded table and are sent in submission order, with
+//   at most one command in flight per destination (an ON then an OFF stay
+//   in order) and ZB_CMDQ_INFLIGHT_MAX in flight overall,
+// - a unicast command is delivered when the ZCL default response with its
+//   transaction sequence number (TSN) comes back; without one it is sent
+//   again after a backoff doubling at each attempt,
+// - group and broadcast commands reach many devices in one frame and get no
+//   default response: they complete as sent,
+// - a ZB_CMD_FLAG_COALESCE command replaces the queued, not yet sent, command
+//   of the same cluster to the same destination (latest state wins).
+// Completion is reported through a callback (result, ZCL status, latency).
+// Pure code (no Zigbee stack, no FreeRTOS) so it can be run on the host.
+
+#define ZB_CMDQ_SLOTS 16
+#define ZB_CMDQ_INFLIGHT_MAX 4
+#define ZB_CMDQ_PAYLOAD_MAX 16    // one Configure Reporting record fits
+#define ZB_CMDQ_BACKOFF_MAX_MS 8000
+
+#define ZB_CMD_FLAG_COALESCE 0x01
+#define ZB_CMD_FLAG_PROFILE_WIDE 0x02    // ZCL global command (cmd_id of the whole profile)
+
+// ZCL status of a successful default response
+#define ZB_CMDQ_STATUS_SUCCESS 0x00
+
+typedef enum {
+    ZB_DST_SHORT = 0,   // one device, acknowledged by a default response
+    ZB_DST_GROUP,       // every member of a group, one frame
+    ZB_DST_BROADCAST,   // every device (0xFFFF), one frame
+} zb_dst_mode_t;
+
+typedef struct {
+    uint8_t dst_mode;   // zb_dst_mode_t
+    uint16_t addr;      // short address or group id
+    uint8_t ep;         // destination endpoint (not used for groups)
+    uint16_t cluster;
+    uint8_t cmd_id;
+    uint8_t flags;      // ZB_CMD_FLAG_*
+    uint8_t payload_len;
+    uint8_t payload[ZB_CMDQ_PAYLOAD_MAX];
+} zb_cmd_t;
+
+typedef enum {
+    ZB_CMD_DELIVERED = 0,   // default response, status success
+    ZB_CMD_REJECTED,        // default response with an error status
+    ZB_CMD_TIMEOUT,         // no response after every attempt
+    ZB_CMD_SENT,            // group/broadcast: sent, no response expected
+    ZB_CMD_REPLACED,        // coalesced into a later command before being sent
+    ZB_CMD_SEND_FAILED,     // the stack refused it at every attempt
+} zb_cmd_result_t;
+
+typedef void (*zb_cmd_done_cb_t)(uint32_t id, zb_cmd_result_t result, uint8_t status,
+    uint32_t latency_ms, void *arg);
+
+typedef struct {
+    /**
+     * Send a command frame.
+     *
+     * @return its TSN (0..255), negative if it could not be sent
+     */
+    int (*send)(const zb_cmd_t *cmd, void *ctx);
+    void *ctx;
+} zb_cmdq_ops_t;
+
+typedef enum {
+    ZB_CMDQ_FREE = 0,
+    ZB_CMDQ_QUEUED,     // waiting to be sent (first send, or retry at retry_ms)
+    ZB_CMDQ_INFLIGHT,   // sent, waiting for the default response until deadline_ms
+} zb_cmdq_state_t;
+
+typedef struct {
+    uint8_t state;      // zb_cmdq_state_t
+    uint8_t tsn;
+    uint8_t attempts;
+    zb_cmd_t cmd;
+    uint32_t id;
+    uint32_t seq;       // submission order
+    uint32_t submitted_ms;
+    uint32_t retry_ms;
+    uint32_t deadline_ms;
+    zb_cmd_done_cb_t done;
+    void *arg;
+} zb_cmdq_entry_t;
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t dropped;       // table full
+    uint32_t replaced;
+    uint32_t sent;          // frames, retries included
+    uint32_t retries;
+    uint32_t send_errors;
+    uint32_t delivered;
+    uint32_t rejected;
+    uint32_t timeouts;
+    uint32_t group_sent;    // group and broadcast commands
+    uint32_t unmatched;     // default responses matching nothing in flight
+    uint32_t latency_min_ms;
+    uint32_t latency_max_ms;
+    uint64_t latency_sum_ms;    // of delivered commands, submission to response
+    uint8_t queued_peak;
+} zb_cmdq_stats_t;
+
+typedef struct {
+    zb_cmdq_entry_t entries[ZB_CMDQ_SLOTS];
+    zb_cmdq_ops_t ops;
+    uint32_t timeout_ms;    // response wait of one attempt
+    uint8_t max_attempts;
+    uint32_t backoff_ms;    // before the second attempt, doubled at each one
+    uint32_t next_seq;
+    zb_cmdq_stats_t stats;
+} zb_cmdq_t;
+
+void zb_cmdq_init(zb_cmdq_t *q, const zb_cmdq_ops_t *ops, uint32_t timeout_ms,
+    uint8_t max_attempts, uint32_t backoff_ms);
+
+/**
+ * Queue a command, sent by the next zb_cmdq_poll.
+ *
+ * @param id  caller chosen, reported to `done` (may be NULL)
+ * @return false if the table is full
+ */
+bool zb_cmdq_submit(zb_cmdq_t *q, const zb_cmd_t *cmd, uint32_t id, zb_cmd_done_cb_t done,
+    void *arg, uint32_t now_ms);
+
+/**
+ * A ZCL default response was received.
+ *
+ * @return false if no command in flight to `src_addr` had this TSN
+ */
+bool zb_cmdq_response(zb_cmdq_t *q, uint16_t src_addr, uint8_t tsn, uint8_t status, uint32_t now_ms);
+
+/**
+ * Expire unanswered attempts (retry or fail them), then send what can be
+ * sent. Nothing is sent while `network_up` is false: commands wait.
+ *
+ * @return frames sent
+ */
+size_t zb_cmdq_poll(zb_cmdq_t *q, uint32_t now_ms, bool network_up);
+
+/** @return commands queued or in flight */
+size_t zb_cmdq_pending(const zb_cmdq_t *q);
+
+#endif
@@ -1,17 +1,243 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "nvs_flash.h"
 #include "esp_coexist.h"
+#include "esp_timer.h"
+#include <stdatomic.h>
+#include <string.h>
 
 #if CONFIG_IDF_TARGET_ESP32C6
 
 #include "esp_zigbee.h"
 #include "ezbee/zha.h"
 #include "log_lib.h"
+#include "sensors_lib.h"
+#include "zigbee_lib.h"
+
+#if CONFIG_USE_UDPLIB
+#include "udp_lib.h"
+#endif
 
 static const char *TAG = "zigbee_library";
 
+#define ZB_CMD_REQUESTS_LEN 16      // submissions waiting for the Zigbee main loop
+#define ZB_CMD_POLL_MS 20           // command scheduler pass, on the Zigbee main loop
+#define ZB_CMD_BACKOFF_MS 250       // before the first retry, doubled at each one
+#define ZB_COORDINATOR_EP 1
+#define ZB_CLUSTER_ON_OFF 0x0006
+#define ZB_CMD_OFF 0x00
+#define ZB_CMD_ON 0x01
+#define ZB_ATTR_ON_OFF 0x0000
+#define ZB_DEVICE_DEFAULT_EP 1      // reporting pushed there on announce, other endpoints on their first report
+#define ZB_STATUS_UNSUPPORTED_CLUSTER 0xC3  // not on this endpoint: may be on another one
+
+// Attribute reporting asked to every device that has these attributes
+static const zb_report_cfg_t report_profile[] = {
+    { .cluster = 0x0006, .attr = 0x0000, .type = 0x10, .min_interval_s = 0, .max_interval_s = 300 },                                  // on/off
+    { .cluster = 0x0402, .attr = 0x0000, .type = 0x29, .min_interval_s = 10, .max_interval_s = 300, .reportable_change = 10 },     // temperature, 0.1 degC
+    { .cluster = 0x0405, .attr = 0x0000, .type = 0x21, .min_interval_s = 10, .max_interval_s = 300, .reportable_change = 100 },    // humidity, 1 %RH
+    { .cluster = 0x0400, .attr = 0x0000, .type = 0x21, .min_interval_s = 5, .max_interval_s = 300, .reportable_change = 500 },     // illuminance
+    { .cluster = 0x0406, .attr = 0x0000, .type = 0x18, .min_interval_s = 0, .max_interval_s = 300 },                               // occupancy
+    { .cluster = 0x0001, .attr = 0x0021, .type = 0x20, .min_interval_s = 60, .max_interval_s = 3600, .reportable_change = 2 },     // battery, 1 %
+};
+#define REPORT_PROFILE_LEN (sizeof(report_profile) / sizeof(report_profile[0]))
+
+typedef struct {
+    zb_cmd_t cmd;
+    uint32_t id;
+    zb_cmd_done_cb_t done;
+    void *arg;
+} zb_cmd_request_t;
+
+// any task -> Zigbee main loop
+static QueueHandle_t cmd_requests = NULL;
+// Zigbee main loop only
+static zb_cmdq_t cmdq;
+static volatile bool network_up = false;
+static atomic_uint next_cmd_id = 1;
+
+static zb_cmdq_stats_t cmdq_stats;
+static portMUX_TYPE cmdq_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void zb_cmd_pump(uint8_t param);
+
+// written by the Zigbee main loop, read by any task through the getters
+static zb_bridge_t bridge;
+static portMUX_TYPE bridge_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t zb_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+#if CONFIG_USE_UDPLIB
+static void send_zigbee_frame(uint8_t type, const uint8_t *payload, size_t len)
+{
+    header_sensor_t header = {0};
+    header.esp_id = (uint8_t)CONFIG_ESP_ID;
+    header.timestamp = zb_now_ms();
+    header.type = type;
+    uint8_t buf[HEADER_SENSOR_SIZE + ZB_REPORT_FRAME_HEADER_SIZE
+        + ZB_BRIDGE_REPORT_MAX * (ZB_REPORT_RECORD_HEADER_SIZE + ZB_BRIDGE_VALUE_MAX)];
+    if (len > sizeof(buf) - HEADER_SENSOR_SIZE) {
+        return;
+    }
+    serialize_header(&header, buf);
+    memcpy(&buf[HEADER_SENSOR_SIZE], payload, len);
+    send_udp_sensor(buf, HEADER_SENSOR_SIZE + len);
+}
+#endif
+
+static void send_device_event(uint16_t short_addr, const uint8_t *ieee, zb_device_event_t event)
+{
+#if CONFIG_USE_UDPLIB
+    uint8_t payload[ZB_DEVICE_FRAME_SIZE];
+    taskENTER_CRITICAL(&bridge_mux);
+    zb_bridge_device_payload(&bridge, short_addr, ieee, event, payload);
+    taskEXIT_CRITICAL(&bridge_mux);
+    send_zigbee_frame(SENSOR_TYPE_ZIGBEE_DEVICE, payload, sizeof(payload));
+#endif
+}
+
+// Configure Reporting completion: arg = short address << 8 | profile index
+static void report_cfg_done(uint32_t id, zb_cmd_result_t result, uint8_t status, uint32_t latency_ms, void *arg)
+{
+    uint16_t short_addr = (uint16_t)((uintptr_t)arg >> 8);
+    uint8_t idx = (uint8_t)(uintptr_t)arg;
+    zb_cfg_result_t cfg = ZB_CFG_FAILED;  // timeouts are retried on the next report
+    if (result == ZB_CMD_DELIVERED) {
+        cfg = ZB_CFG_ACCEPTED;
+    } else if (result == ZB_CMD_REJECTED && status != ZB_STATUS_UNSUPPORTED_CLUSTER) {
+        cfg = ZB_CFG_REFUSED;
+    }
+
+    taskENTER_CRITICAL(&bridge_mux);
+    zb_bridge_cfg_result(&bridge, short_addr, idx, cfg);
+    taskEXIT_CRITICAL(&bridge_mux);
+
+    if (result == ZB_CMD_DELIVERED) {
+        log_msg(TAG, "Reporting of 0x%04x/0x%04x configured on 0x%04x in %" PRIu32 " ms",
+            report_profile[idx].cluster, report_profile[idx].attr, short_addr, latency_ms);
+    } else if (result == ZB_CMD_REJECTED) {
+        log_msg(TAG, "0x%04x refused reporting of 0x%04x/0x%04x (status 0x%02x)",
+            short_addr, report_profile[idx].cluster, report_profile[idx].attr, status);
+    } else {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "Reporting configuration %" PRIu32 " to 0x%04x failed (result %d)",
+            id, short_addr, result);
+    }
+}
+
+/**
+ * Queue the Configure Reporting of one profile entry (Zigbee main loop: submitted
+ * to the scheduler directly)
+ */
+static void push_report_cfg(uint16_t short_addr, uint8_t ep, size_t idx)
+{
+    zb_cmd_t cmd = {
+        .dst_mode = ZB_DST_SHORT,
+        .addr = short_addr,
+        .ep = ep,
+        .cluster = report_profile[idx].cluster,
+        .cmd_id = ZB_ZCL_CMD_CONFIG_REPORT,
+        .flags = ZB_CMD_FLAG_PROFILE_WIDE,
+    };
+    cmd.payload_len = (uint8_t)zb_report_cfg_encode(&report_profile[idx], cmd.payload);
+    void *arg = (void *)(uintptr_t)((uint32_t)short_addr << 8 | idx);
+    if (cmd.payload_len == 0
+        || !zb_cmdq_submit(&cmdq, &cmd, atomic_fetch_add(&next_cmd_id, 1), report_cfg_done, arg, zb_now_ms())) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "Reporting configuration to 0x%04x dropped", short_addr);
+        return;
+    }
+    taskENTER_CRITICAL(&bridge_mux);
+    zb_bridge_cfg_sent(&bridge, short_addr, idx);
+    taskEXIT_CRITICAL(&bridge_mux);
+}
+
+static void device_joined(uint16_t short_addr, const uint8_t *ieee)
+{
+    taskENTER_CRITICAL(&bridge_mux);
+    zb_bridge_device_joined(&bridge, short_addr, ieee, zb_now_ms());
+    taskEXIT_CRITICAL(&bridge_mux);
+
+    send_device_event(short_addr, ieee, ZB_DEVICE_JOINED);
+    for (size_t i = 0; i < REPORT_PROFILE_LEN; i++) {
+        push_report_cfg(short_addr, ZB_DEVICE_DEFAULT_EP, i);
+    }
+}
+
+static void device_left(uint16_t short_addr, const uint8_t *ieee)
+{
+    taskENTER_CRITICAL(&bridge_mux);
+    zb_bridge_device_left(&bridge, short_addr);
+    taskEXIT_CRITICAL(&bridge_mux);
+    send_device_event(short_addr, ieee, ZB_DEVICE_LEFT);
+}
+
+/**
+ * Attribute report: cache the values, forward them as one SENSOR_TYPE_ZIGBEE frame,
+ * and ask for the profile reporting of the attributes not configured yet
+ */
+static void handle_report(uint16_t short_addr, uint8_t ep, uint16_t cluster, const ezb_zcl_report_attr_variable_t *var)
+{
+    zb_report_attr_t attrs[ZB_BRIDGE_REPORT_MAX];
+    size_t count = 0;
+    for (; var != NULL && count < ZB_BRIDGE_REPORT_MAX; var = var->next) {
+        if (var->attr_value == NULL) {
+            continue;
+        }
+        attrs[count++] = (zb_report_attr_t){ .attr = var->attr_id, .type = var->attr_type, .value = var->attr_value };
+    }
+
+    uint32_t now_ms = zb_now_ms();
+    uint16_t cfg_missing = 0;
+    taskENTER_CRITICAL(&bridge_mux);
+    bridge.stats.reports++;
+    for (size_t i = 0; i < count; i++) {
+        zb_bridge_attr_update(&bridge, short_addr, ep, cluster, &attrs[i], now_ms);
+        int idx = zb_report_cfg_find(report_profile, REPORT_PROFILE_LEN, cluster, attrs[i].attr);
+        if (idx >= 0) {
+            cfg_missing |= 1u << idx;
+        }
+    }
+    zb_device_t *dev = zb_bridge_device(&bridge, short_addr);
+    if (dev != NULL) {
+        dev->reports++;
+    }
+    cfg_missing = zb_bridge_cfg_missing(&bridge, short_addr, cfg_missing);
+    taskEXIT_CRITICAL(&bridge_mux);
+
+    for (size_t i = 0; i < REPORT_PROFILE_LEN; i++) {
+        if (cfg_missing & (1u << i)) {
+            push_report_cfg(short_addr, ep, i);
+        }
+    }
+
+#if CONFIG_ZIGBEE_DEBUG_REPORTS
+    for (size_t i = 0; i < count; i++) {
+        zb_attr_t attr = { .type = attrs[i].type, .len = (uint8_t)zb_zcl_type_size(attrs[i].type) };
+        int32_t value;
+        memcpy(attr.value, attrs[i].value, attr.len);
+        if (zb_attr_to_int32(&attr, &value)) {
+            log_msg(TAG, "0x%04x ep %u 0x%04x/0x%04x (type 0x%02x) = %" PRId32,
+                short_addr, ep, cluster, attrs[i].attr, attrs[i].type, value);
+        } else {
+            log_msg(TAG, "0x%04x ep %u 0x%04x/0x%04x (type 0x%02x, %u bytes)",
+                short_addr, ep, cluster, attrs[i].attr, attrs[i].type, attr.len);
+        }
+    }
+#endif
+
+#if CONFIG_USE_UDPLIB
+    uint8_t payload[ZB_REPORT_FRAME_HEADER_SIZE + ZB_BRIDGE_REPORT_MAX * (ZB_REPORT_RECORD_HEADER_SIZE + ZB_BRIDGE_VALUE_MAX)];
+    size_t len = zb_bridge_report_payload(short_addr, ep, cluster, attrs, count, payload, sizeof(payload));
+    if (len > 0) {
+        send_zigbee_frame(SENSOR_TYPE_ZIGBEE, payload, len);
+    }
+#endif
+}
+
 static bool esp_zigbee_app_signal_handler(const ezb_app_signal_t *app_signal)
 {
     ezb_app_signal_type_t signal_type = ezb_app_signal_get_type(app_signal);
@@ -39,6 +265,7 @@ static bool esp_zigbee_app_signal_handler(const ezb_app_signal_t *app_signal)
                 }
             } else {
                 log_msg(TAG, "Existing network found. Automatic open..");
+                network_up = true;
                 ezb_bdb_open_network(180);
             }
         } else {
@@ -54,6 +281,7 @@ static bool esp_zigbee_app_signal_handler(const ezb_app_signal_t *app_signal)
             ezb_nwk_get_extended_panid(&extended_pan_id);
             log_msg(TAG, "Network succesfully formed. PAN ID: 0x%04hx, Channel: %d",
                      ezb_nwk_get_panid(), ezb_nwk_get_current_channel());
+            network_up = true;
             
             ezb_bdb_start_top_level_commissioning(EZB_BDB_MODE_NETWORK_STEERING);
         } else {
@@ -75,6 +303,16 @@ static bool esp_zigbee_app_signal_handler(const ezb_app_signal_t *app_signal)
     case EZB_ZDO_SIGNAL_DEVICE_ANNCE: {
         const ezb_zdo_signal_device_annce_params_t *dev_annce_params = (const ezb_zdo_signal_device_annce_params_t *)params;
         log_msg(TAG, "New device linked. Short addr: 0x%04hx", dev_annce_params->short_addr);
+        device_joined(dev_annce_params->short_addr, dev_annce_params->ieee_addr);
+        break;
+    }
+
+    case EZB_ZDO_SIGNAL_LEAVE_INDICATION: {
+        const ezb_zdo_signal_leave_indication_params_t *leave_params = (const ezb_zdo_signal_leave_indication_params_t *)params;
+        log_msg(TAG, "Device left. Short addr: 0x%04hx%s", leave_params->short_addr, leave_params->rejoin ? " (rejoining)" : "");
+        if (!leave_params->rejoin) {
+            device_left(leave_params->short_addr, leave_params->device_addr);
+        }
         break;
     }
 
@@ -109,59 +347,23 @@ switch (callback_id) {
     case EZB_ZCL_CORE_DEFAULT_RSP_CB_ID: {
         ezb_zcl_cmd_default_rsp_message_t *default_rsp = (ezb_zcl_cmd_default_rsp_message_t *)message;
         log_msg(TAG, "Default ZCL response recv. Status: 0x%02x", default_rsp->in.status_code);
+        zb_cmdq_response(&cmdq, default_rsp->info.src_addr.u.short_addr, default_rsp->info.header.tsn,
+            default_rsp->in.status_code, zb_now_ms());
         break;
     }
 
-case EZB_ZCL_CORE_REPORT_ATTR_CB_ID: {
+    case EZB_ZCL_CORE_CONFIG_REPORT_RSP_CB_ID: {
+        // one record per request: the status of the response is the one of the record
+        ezb_zcl_cmd_config_report_rsp_message_t *rsp = (ezb_zcl_cmd_config_report_rsp_message_t *)message;
+        zb_cmdq_response(&cmdq, rsp->info.src_addr.u.short_addr, rsp->info.header.tsn, rsp->info.status,
+            zb_now_ms());
+        break;
+    }
+
+    case EZB_ZCL_CORE_REPORT_ATTR_CB_ID: {
         ezb_zcl_cmd_report_attr_message_t *report = (ezb_zcl_cmd_report_attr_message_t *)message;
-        
-        log_msg(TAG, "--- ATTR REPORT RECV (ID: 5) ---");
-        log_msg(TAG, "Dest Endpoint: %d | Cluster ID: 0x%04x | Status: 0x%02x", 
-                 report->info.dst_ep, 
-                 report->info.cluster_id,
-                 report->info.status);
-
-        ezb_zcl_report_attr_variable_t *var = report->in.variables;
-        int i = 0;
-        while (var != NULL) {
-            log_msg(TAG, "  [%d] Attr ID: 0x%04x | Type: 0x%02x", i, var->attr_id, var->attr_type);
-            
-            if (var->attr_value != NULL) {
-                switch (var->attr_type) {
-                    case 0x10: // Boolean
-                        log_msg(TAG, "  [%d] Value (Bool): %s", i, *(bool *)var->attr_value ? "TRUE" : "FALSE");
-                        break;
-                    case 0x20: // uint8_t
-                        log_msg(TAG, "  [%d] Value (uint8): %u", i, *(uint8_t *)var->attr_value);
-                        break;
-                    case 0x21: // uint16_t
-                        log_msg(TAG, "  [%d] Value (uint16): %u", i, *(uint16_t *)var->attr_value);
-                        break;
-                    case 0x01: // Type unknown
-                        log_msg(TAG, "  [%d] Value (Type 0x01): 0x%02x (Raw)", i, *(uint8_t *)var->attr_value);
-                        break;
-                    case 0x23: // uint32_t
-                        log_msg(TAG, "  [%d] Value (uint32): %lu", i, *(uint32_t *)var->attr_value);
-                        break;
-                    case 0x25: // uint48_t (48 bits stored on uint64_t securely)
-                        {
-                            uint64_t val = 0;
-                            memcpy(&val, var->attr_value, 6);
-                            log_msg(TAG, "  [%d] Value (uint48): %llu", i, val);
-                        }
-                        break;
-                    default:
-                        log_msg(TAG, "  [%d] Value (raw): 0x%02x (first byte)", i, *(uint8_t *)var->attr_value);
-                        break;
-                }
-            } else {
-                log_msg_lvl(ESP_LOG_WARN, TAG, "  [%d] Value : NULL", i);
-            }
-            
-            var = var->next;
-            i++;
-        }
-        
+        handle_report(report->info.src_addr.u.short_addr, report->info.src_ep, report->info.cluster_id,
+            report->in.variables);
         report->out.result = EZB_ZCL_STATUS_SUCCESS;
         break;
     }
@@ -260,6 +462,9 @@ static void esp_zigbee_stack_main_task(void *pvParameters)
         return;
     }
 
+    // commands submitted from now on wait in the scheduler until the network is up
+    ezb_scheduler_alarm(zb_cmd_pump, 0, ZB_CMD_POLL_MS);
+
     err = esp_zigbee_launch_mainloop();
     if (err != ESP_OK) {
         log_msg_lvl(ESP_LOG_ERROR, TAG, "Error (%s) launching mainloop", esp_err_to_name(err));
@@ -268,23 +473,217 @@ static void esp_zigbee_stack_main_task(void *pvParameters)
     vTaskDelete(NULL);
 }
 
-void send_cmd_on_off(uint16_t short_addr, uint8_t ep, bool on)
+static void fill_cmd_ctrl(const zb_cmd_t *cmd, ezb_zcl_cmd_ctrl_t *ctrl)
 {
-    ezb_zcl_on_off_cmd_t cmd = {0};
+    if (cmd->dst_mode == ZB_DST_GROUP) {
+        ctrl->dst_addr.addr_mode = EZB_ADDR_MODE_GROUP;
+        ctrl->dst_addr.u.short_addr = cmd->addr;   // group id
+    } else {
+        ctrl->dst_addr.addr_mode = EZB_ADDR_MODE_SHORT;
+        ctrl->dst_addr.u.short_addr = cmd->dst_mode == ZB_DST_BROADCAST ? 0xFFFF : cmd->addr;
+        ctrl->dst_ep = cmd->ep;
+    }
+    ctrl->src_ep = ZB_COORDINATOR_EP;
+}
 
-    // device info 
-    cmd.cmd_ctrl.dst_addr.addr_mode = EZB_ADDR_MODE_SHORT;
-    cmd.cmd_ctrl.dst_addr.u.short_addr = short_addr;
-    cmd.cmd_ctrl.dst_ep = ep;
-    cmd.cmd_ctrl.src_ep = 1; // Coordinator endpoint
+/**
+ * Configure Reporting of the single record carried in the payload
+ *
+ * @return TSN of the frame, -1 if the record is malformed
+ */
+static int zcl_send_config_report(const zb_cmd_t *cmd)
+{
+    zb_report_cfg_t cfg;
+    if (!zb_report_cfg_decode(cmd->payload, cmd->payload_len, &cfg)) {
+        return -1;
+    }
+    // little-endian, only the first bytes of the attribute type are read
+    uint32_t change = cfg.reportable_change;
+    ezb_zcl_config_report_record_t record = {
+        .direction = EZB_ZCL_REPORT_DIRECTION_SEND,
+        .attr_id = cfg.attr,
+        .attr_type = cfg.type,
+        .min_interval = cfg.min_interval_s,
+        .max_interval = cfg.max_interval_s,
+        .reportable_change = zb_zcl_type_analog(cfg.type) ? &change : NULL,
+    };
+    ezb_zcl_config_report_cmd_t req = {0};
+    fill_cmd_ctrl(cmd, &req.cmd_ctrl);
+    req.cluster_id = cmd->cluster;
+    req.record_number = 1;
+    req.record_field = &record;
+
+    uint8_t tsn = ezb_zcl_config_report_cmd_req(&req);
+    log_msg(TAG, "Configure reporting 0x%04x/0x%04x sent to 0x%04x ep %u (tsn %u)",
+        cmd->cluster, cfg.attr, cmd->addr, cmd->ep, tsn);
+    return tsn;
+}
 
-    if (on) {
-        ezb_zcl_on_off_on_cmd_req(&cmd);
-        log_msg(TAG, "ON command sent to 0x%04x", short_addr);
-    } else {
-        ezb_zcl_on_off_off_cmd_req(&cmd);
-        log_msg(TAG, "OFF command sent to 0x%04x", short_addr);
+/**
+ * ZCL layer of the command scheduler: build and send one frame (Zigbee main loop)
+ *
+ * @return TSN of the frame, -1 if the command is not supported
+ */
+static int zcl_send(const zb_cmd_t *cmd, void *ctx)
+{
+    (void)ctx;
+    if (cmd->flags & ZB_CMD_FLAG_PROFILE_WIDE) {
+        return cmd->cmd_id == ZB_ZCL_CMD_CONFIG_REPORT ? zcl_send_config_report(cmd) : -1;
     }
+    if (cmd->cluster != ZB_CLUSTER_ON_OFF || (cmd->cmd_id != ZB_CMD_ON && cmd->cmd_id != ZB_CMD_OFF)) {
+        return -1;
+    }
+    ezb_zcl_on_off_cmd_t req = {0};
+    fill_cmd_ctrl(cmd, &req.cmd_ctrl);
+
+    // the request returns the TSN of the frame, echoed by the default response
+    uint8_t tsn = (cmd->cmd_id == ZB_CMD_ON) ? ezb_zcl_on_off_on_cmd_req(&req) : ezb_zcl_on_off_off_cmd_req(&req);
+    log_msg(TAG, "%s command sent to 0x%04x (tsn %u)", cmd->cmd_id == ZB_CMD_ON ? "ON" : "OFF", cmd->addr, tsn);
+    return tsn;
+}
+
+/**
+ * Command scheduler pass (scheduler alarm, Zigbee main loop): take the submitted commands,
+ * expire/retry the unanswered ones, send the next ones
+ */
+static void zb_cmd_pump(uint8_t param)
+{
+    uint32_t now_ms = zb_now_ms();
+    zb_cmd_request_t req;
+    while (xQueueReceive(cmd_requests, &req, 0) == pdTRUE) {
+        if (!zb_cmdq_submit(&cmdq, &req.cmd, req.id, req.done, req.arg, now_ms)) {
+            log_msg_lvl(ESP_LOG_WARN, TAG, "Command %" PRIu32 " dropped, scheduler full", req.id);
+        }
+    }
+    zb_cmdq_poll(&cmdq, now_ms, network_up);
+
+    taskENTER_CRITICAL(&cmdq_stats_mux);
+    cmdq_stats = cmdq.stats;
+    taskEXIT_CRITICAL(&cmdq_stats_mux);
+
+    ezb_scheduler_alarm(zb_cmd_pump, 0, ZB_CMD_POLL_MS);
+}
+
+esp_err_t zigbee_send_cmd(const zb_cmd_t *cmd, zb_cmd_done_cb_t done, void *arg, uint32_t *id)
+{
+    if (cmd == NULL || cmd->payload_len > ZB_CMDQ_PAYLOAD_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cmd_requests == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    zb_cmd_request_t req = {
+        .cmd = *cmd,
+        .id = atomic_fetch_add(&next_cmd_id, 1),
+        .done = done,
+        .arg = arg,
+    };
+    if (xQueueSend(cmd_requests, &req, 0) != pdTRUE) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (id != NULL) {
+        *id = req.id;
+    }
+    return ESP_OK;
+}
+
+// arg: short address << 16 | endpoint << 8 | on, NULL for groups
+static void on_off_done(uint32_t id, zb_cmd_result_t result, uint8_t status, uint32_t latency_ms, void *arg)
+{
+    if (result == ZB_CMD_DELIVERED && arg != NULL) {
+        // acknowledged: the cached state follows without waiting for the report
+        uintptr_t target = (uintptr_t)arg;
+        uint8_t on = (uint8_t)(target & 0x01);
+        zb_report_attr_t attr = { .attr = ZB_ATTR_ON_OFF, .type = 0x10, .value = &on };
+        taskENTER_CRITICAL(&bridge_mux);
+        zb_bridge_attr_update(&bridge, (uint16_t)(target >> 16), (uint8_t)(target >> 8), ZB_CLUSTER_ON_OFF,
+            &attr, zb_now_ms());
+        taskEXIT_CRITICAL(&bridge_mux);
+    }
+    if (result == ZB_CMD_DELIVERED || result == ZB_CMD_SENT) {
+        log_msg(TAG, "Command %" PRIu32 " %s in %" PRIu32 " ms", id,
+            result == ZB_CMD_DELIVERED ? "delivered" : "sent", latency_ms);
+    } else if (result != ZB_CMD_REPLACED) {
+        log_msg_lvl(ESP_LOG_WARN, TAG, "Command %" PRIu32 " failed (result %d, status 0x%02x) after %" PRIu32 " ms",
+            id, result, status, latency_ms);
+    }
+}
+
+esp_err_t send_cmd_on_off(uint16_t short_addr, uint8_t ep, bool on)
+{
+    zb_cmd_t cmd = {
+        .dst_mode = ZB_DST_SHORT,
+        .addr = short_addr,
+        .ep = ep,
+        .cluster = ZB_CLUSTER_ON_OFF,
+        .cmd_id = on ? ZB_CMD_ON : ZB_CMD_OFF,
+        .flags = ZB_CMD_FLAG_COALESCE,
+    };
+    void *target = (void *)(uintptr_t)((uint32_t)short_addr << 16 | (uint32_t)ep << 8 | (on ? 1 : 0));
+    return zigbee_send_cmd(&cmd, on_off_done, target, NULL);
+}
+
+esp_err_t send_cmd_on_off_group(uint16_t group_id, bool on)
+{
+    zb_cmd_t cmd = {
+        .dst_mode = ZB_DST_GROUP,
+        .addr = group_id,
+        .cluster = ZB_CLUSTER_ON_OFF,
+        .cmd_id = on ? ZB_CMD_ON : ZB_CMD_OFF,
+        .flags = ZB_CMD_FLAG_COALESCE,
+    };
+    return zigbee_send_cmd(&cmd, on_off_done, NULL, NULL);
+}
+
+esp_err_t zigbee_get_cmd_stats(zb_cmdq_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&cmdq_stats_mux);
+    *stats = cmdq_stats;
+    taskEXIT_CRITICAL(&cmdq_stats_mux);
+    return ESP_OK;
+}
+
+esp_err_t zigbee_get_attr(uint16_t short_addr, uint8_t ep, uint16_t cluster, uint16_t attr_id, zb_attr_t *attr)
+{
+    if (attr == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    taskENTER_CRITICAL(&bridge_mux);
+    const zb_attr_t *cached = zb_bridge_attr_get(&bridge, short_addr, ep, cluster, attr_id);
+    if (cached != NULL) {
+        *attr = *cached;
+        err = ESP_OK;
+    }
+    taskEXIT_CRITICAL(&bridge_mux);
+    return err;
+}
+
+size_t zigbee_get_devices(zb_device_t *devices, size_t max)
+{
+    size_t count = 0;
+    taskENTER_CRITICAL(&bridge_mux);
+    for (size_t i = 0; i < ZB_BRIDGE_DEVICES && count < max; i++) {
+        if (bridge.devices[i].short_addr != ZB_BRIDGE_NO_ADDR) {
+            devices[count++] = bridge.devices[i];
+        }
+    }
+    taskEXIT_CRITICAL(&bridge_mux);
+    return count;
+}
+
+esp_err_t zigbee_get_bridge_stats(zb_bridge_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&bridge_mux);
+    *stats = bridge.stats;
+    taskEXIT_CRITICAL(&bridge_mux);
+    return ESP_OK;
 }
 
 void init_zigbee(void)
@@ -302,6 +701,14 @@ void init_zigbee(void)
         err = nvs_flash_init_partition("zb_storage");
     }
 
+    zb_bridge_init(&bridge);
+    const zb_cmdq_ops_t ops = { .send = zcl_send, .ctx = NULL };
+    zb_cmdq_init(&cmdq, &ops, CONFIG_ZIGBEE_CMD_TIMEOUT_MS, CONFIG_ZIGBEE_CMD_ATTEMPTS, ZB_CMD_BACKOFF_MS);
+    cmd_requests = xQueueCreate(ZB_CMD_REQUESTS_LEN, sizeof(zb_cmd_request_t));
+    if (cmd_requests == NULL) {
+        log_msg_lvl(ESP_LOG_ERROR, TAG, "Error creating zigbee command queue");
+    }
+
     xTaskCreate(esp_zigbee_stack_main_task, "zigbee_task", 4096 * 2, NULL, 5, NULL);
 }
 
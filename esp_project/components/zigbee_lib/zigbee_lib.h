@@ -2,14 +2,41 @@
 #define ZIGBEE_LIB_H_
 
 #include <inttypes.h>
+#include <stdbool.h>
 #include <esp_err.h>
 
 #if CONFIG_IDF_TARGET_ESP32C6
 
+#include "zb_bridge.h"
+#include "zb_cmdq.h"
+
 void init_zigbee(void);
 
-void send_cmd_on_off(uint16_t short_addr, uint8_t ep, bool on);
+// Commands are queued from any task and sent by the Zigbee main loop, once the
+// network is up, then retried until their ZCL default response (see zb_cmdq.h).
+// `done` is called on the Zigbee main loop: it must not block.
+// ESP_ERR_NO_MEM if the submission queue is full.
+esp_err_t zigbee_send_cmd(const zb_cmd_t *cmd, zb_cmd_done_cb_t done, void *arg, uint32_t *id);
+
+// ON/OFF to one device; a queued, not yet sent ON/OFF to it is replaced
+esp_err_t send_cmd_on_off(uint16_t short_addr, uint8_t ep, bool on);
+
+// ON/OFF to every member of a group, in one frame
+esp_err_t send_cmd_on_off_group(uint16_t group_id, bool on);
+
+esp_err_t zigbee_get_cmd_stats(zb_cmdq_stats_t *stats);
+
+// Joined devices get the reporting profile of zigbee_lib.c; their reports are
+// cached and forwarded as SENSOR_TYPE_ZIGBEE frames (see zb_bridge.h).
+
+// Last reported value of an attribute, ESP_ERR_NOT_FOUND if never reported
+esp_err_t zigbee_get_attr(uint16_t short_addr, uint8_t ep, uint16_t cluster, uint16_t attr_id, zb_attr_t *attr);
+
+// Copy up to `max` known devices, @return devices copied
+size_t zigbee_get_devices(zb_device_t *devices, size_t max);
+
+esp_err_t zigbee_get_bridge_stats(zb_bridge_stats_t *stats);
 
 #endif
 
-#endif
\ No newline at end of file
+#endif
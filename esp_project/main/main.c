@@ -19,7 +19,7 @@
 #include "nvs_lib.h"
 
 #if CONFIG_USE_MQTTLIB
-#include "mqttLib.h"
+#include "mqtt_lib.h"
 #endif
 
 #include "log_lib.h"
@@ -64,7 +64,6 @@ void app_main()
 #if DEBUG_GPIO
     dump_gpio_stats();
 #endif
-    //init_queue_mqtt();
 
     //init memory first, wifi/led needs this..
     nvs_init(); 
@@ -79,7 +78,6 @@ void app_main()
 
 #if CONFIG_USE_ZIGBEE
     init_zigbee();
-    vTaskDelay(pdMS_TO_TICKS(3000));
 #endif
 
 #if CONFIG_USE_WIFI
@@ -133,18 +131,19 @@ void app_main()
     log_msg(TAG, "MAIN ENDING");
 
 #if CONFIG_USE_ZIGBEE
-    log_msg(TAG, "Sending ON command to 0xdaf3...");
+    // queued: sent once the network is up, retried until acknowledged (5 s apart to see the light blink)
+    log_msg(TAG, "Queueing ON command to 0xdaf3...");
     send_cmd_on_off(0xdaf3, 1, true); // TRUE = ON
 
     vTaskDelay(pdMS_TO_TICKS(5000));
 
-    log_msg(TAG, "Sending OFF command to 0xdaf3...");
+    log_msg(TAG, "Queueing OFF command to 0xdaf3...");
     send_cmd_on_off(0xdaf3, 1, false); // FALSE = OFF
 
     vTaskDelay(pdMS_TO_TICKS(5000));
 
-    log_msg(TAG, "Sending ON command to 0xdaf3...");
-    send_cmd_on_off(0xdaf3, 1, true); // FALSE = OFF
+    log_msg(TAG, "Queueing ON command to 0xdaf3...");
+    send_cmd_on_off(0xdaf3, 1, true); // TRUE = ON
 #endif
 
 }
\ No newline at end of file
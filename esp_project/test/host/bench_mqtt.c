@@ -0,0 +1,88 @@
+#include "host_test.h"
+#include "mqtt_cmd.h"
+#include "mqtt_router.h"
+#include <string.h>
+
+// Per-message cost of the MQTT command path on the host: topic routing
+// (hash table vs the strncmp chain it replaced) and command parsing (binary
+// vs in-place JSON). Numbers are for comparison only, not checked.
+
+#define ROUNDS 2000000
+
+static const char *topics[] = { "/commands", "/commands/bin", "/gamepad" };
+
+static volatile int sink;
+
+static void handler(const char *data, size_t len, void *arg) {
+    (void)data;
+    sink += (int)len + (int)(intptr_t)arg;
+}
+
+/** The former dispatch: every topic compared in turn */
+static bool dispatch_chain(const char *topic, size_t len) {
+    for (size_t i = 0; i < sizeof(topics) / sizeof(topics[0]); i++) {
+        if (strlen(topics[i]) == len && strncmp(topic, topics[i], len) == 0) {
+            handler(topic, len, (void *)(intptr_t)i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void bench_router(void) {
+    mqtt_router_t router;
+    mqtt_router_init(&router);
+    for (size_t i = 0; i < sizeof(topics) / sizeof(topics[0]); i++) {
+        mqtt_router_add(&router, topics[i], handler, (void *)(intptr_t)i);
+    }
+    //the gamepad topic is the busy one
+    const char *topic = "/gamepad";
+    size_t len = strlen(topic);
+    int missed = 0;
+
+    double start = test_now_us();
+    for (int i = 0; i < ROUNDS; i++) {
+        missed += !dispatch_chain(topic, len);
+    }
+    double chain_ns = (test_now_us() - start) * 1000 / ROUNDS;
+
+    start = test_now_us();
+    for (int i = 0; i < ROUNDS; i++) {
+        missed += !mqtt_router_dispatch(&router, topic, len, topic, len);
+    }
+    double table_ns = (test_now_us() - start) * 1000 / ROUNDS;
+    CHECK(missed == 0);
+    printf("route %s: strncmp chain %.1f ns, hash table %.1f ns\n", topic, chain_ns, table_ns);
+}
+
+static void bench_parse(void) {
+    mqtt_cmd_t cmd = { .op = MQTT_CMD_SET_MOTOR, .value = 40 };
+    uint8_t bin[8];
+    size_t bin_len = mqtt_cmd_encode_bin(&cmd, bin, sizeof(bin));
+    const char *json = "{\"command\":\"SET_MOTOR\",\"percent\":40}";
+    size_t json_len = strlen(json);
+    int failed = 0;
+
+    double start = test_now_us();
+    for (int i = 0; i < ROUNDS; i++) {
+        failed += mqtt_cmd_parse_bin(bin, bin_len, &cmd) != MQTT_CMD_OK;
+        sink += cmd.value;
+    }
+    double bin_ns = (test_now_us() - start) * 1000 / ROUNDS;
+
+    start = test_now_us();
+    for (int i = 0; i < ROUNDS; i++) {
+        failed += mqtt_cmd_parse_json(json, json_len, &cmd) != MQTT_CMD_OK;
+        sink += cmd.value;
+    }
+    double json_ns = (test_now_us() - start) * 1000 / ROUNDS;
+    CHECK(failed == 0);
+    printf("SET_MOTOR: binary %.1f ns (%zu bytes), JSON %.1f ns (%zu bytes)\n",
+        bin_ns, bin_len, json_ns, json_len);
+}
+
+int main(void) {
+    bench_router();
+    bench_parse();
+    return TEST_RESULT();
+}
@@ -0,0 +1,32 @@
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+// clock_gettime, also with -std=c11: include this header first
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <time.h>
+
+// Minimal checks for the host tests: a failed CHECK is printed and counted,
+// the test keeps going and main returns TEST_RESULT().
+
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_RESULT() (test_failures == 0 ? 0 : 1)
+
+static inline double test_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+#endif // HOST_TEST_H_
@@ -0,0 +1,25 @@
+#ifndef ESP_ERR_H_
+#define ESP_ERR_H_
+
+// Host stand-ins for the ESP-IDF / FreeRTOS APIs used by the components
+// tested in this directory. Single process: tasks are never started, their
+// notifications are counted (stub_task_notifications) for the tests to check.
+
+#include <inttypes.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                 0
+#define ESP_FAIL               -1
+#define ESP_ERR_NO_MEM         0x101
+#define ESP_ERR_INVALID_ARG    0x102
+#define ESP_ERR_INVALID_STATE  0x103
+#define ESP_ERR_INVALID_SIZE   0x104
+#define ESP_ERR_NOT_FOUND      0x105
+#define ESP_ERR_TIMEOUT        0x107
+#define ESP_ERR_INVALID_CRC    0x109
+#define ESP_ERR_INVALID_VERSION 0x10A
+
+const char *esp_err_to_name(esp_err_t code);
+
+#endif // ESP_ERR_H_
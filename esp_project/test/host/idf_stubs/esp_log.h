@@ -0,0 +1,6 @@
+#ifndef ESP_LOG_H_
+#define ESP_LOG_H_
+
+#include "esp_log_level.h"
+
+#endif // ESP_LOG_H_
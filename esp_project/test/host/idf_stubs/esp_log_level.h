@@ -0,0 +1,13 @@
+#ifndef ESP_LOG_LEVEL_H_
+#define ESP_LOG_LEVEL_H_
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+#endif // ESP_LOG_LEVEL_H_
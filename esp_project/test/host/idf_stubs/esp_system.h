@@ -0,0 +1,10 @@
+#ifndef ESP_SYSTEM_H_
+#define ESP_SYSTEM_H_
+
+#include "esp_err.h"
+
+typedef void (*shutdown_handler_t)(void);
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handle);
+
+#endif // ESP_SYSTEM_H_
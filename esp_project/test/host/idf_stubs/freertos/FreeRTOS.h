@@ -0,0 +1,18 @@
+#ifndef FREERTOS_H_
+#define FREERTOS_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms)) // 1 kHz tick
+
+#endif // FREERTOS_H_
@@ -0,0 +1,14 @@
+#ifndef SEMPHR_H_
+#define SEMPHR_H_
+
+#include "freertos/FreeRTOS.h"
+
+// pthread mutexes, so stubs can be shared by threaded tests
+typedef struct stub_semaphore *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+
+#endif // SEMPHR_H_
@@ -0,0 +1,26 @@
+#ifndef TASK_H_
+#define TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct stub_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+// Tasks are registered, not run
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack, void *param,
+    UBaseType_t priority, TaskHandle_t *handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+
+// Counted per task; ulTaskNotifyTake never sees them (no task runs)
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+
+// Notifications given to `task` since it was created
+uint32_t stub_task_notifications(TaskHandle_t task);
+
+// Task created under `name`, NULL if none
+TaskHandle_t stub_task_find(const char *name);
+
+#endif // TASK_H_
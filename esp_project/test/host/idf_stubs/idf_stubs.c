@@ -0,0 +1,124 @@
+#define _POSIX_C_SOURCE 200809L
+#include "esp_err.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct stub_semaphore {
+    pthread_mutex_t mutex;
+};
+
+struct stub_task {
+    const char *name;
+    TaskFunction_t code;
+    uint32_t given; // since creation
+};
+
+#define STUB_TASKS_MAX 8
+
+static struct stub_task tasks[STUB_TASKS_MAX];
+static int task_count = 0;
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        default: return "ERROR";
+    }
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handle) {
+    (void)handle;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t sem = malloc(sizeof(*sem));
+    if (sem != NULL) {
+        pthread_mutex_init(&sem->mutex, NULL);
+    }
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait) {
+    (void)wait;
+    return pthread_mutex_lock(&sem->mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    return pthread_mutex_unlock(&sem->mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    pthread_mutex_destroy(&sem->mutex);
+    free(sem);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack, void *param,
+    UBaseType_t priority, TaskHandle_t *handle) {
+    (void)stack; (void)param; (void)priority;
+    if (task_count >= STUB_TASKS_MAX) {
+        return pdFAIL;
+    }
+    struct stub_task *task = &tasks[task_count++];
+    task->name = name;
+    task->code = code;
+    if (handle != NULL) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    (void)task;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    (void)ticks;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    task->given++;
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+    (void)clear; (void)wait;
+    return 0; // no task runs on the host
+}
+
+uint32_t stub_task_notifications(TaskHandle_t task) {
+    return task->given;
+}
+
+TaskHandle_t stub_task_find(const char *name) {
+    for (int i = 0; i < task_count; i++) {
+        if (strcmp(tasks[i].name, name) == 0) {
+            return &tasks[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,211 @@
+#include "host_test.h"
+#include "peripherals/adc_filter.h"
+#include <stdlib.h>
+
+// Decimation filters of the shared ADC engine: step responses, the median
+// spike rejection, the beat detector, and the cost per raw sample.
+
+static bool make(adc_filter_t *f, adc_filter_type_t type, uint16_t decimation, uint8_t order, uint8_t shift, bool median3) {
+    adc_filter_config_t cfg = { .type = type, .decimation = decimation, .order = order, .iir_shift = shift, .median3 = median3 };
+    return adc_filter_init(f, &cfg);
+}
+
+/** Push `n` times `sample`, return how many outputs came out (last one in *out) */
+static int feed(adc_filter_t *f, int32_t sample, int n, int32_t *out) {
+    int outputs = 0;
+    for (int i = 0; i < n; i++) {
+        outputs += adc_filter_push(f, sample, out);
+    }
+    return outputs;
+}
+
+static void test_init(void) {
+    adc_filter_t f;
+    CHECK(!make(&f, ADC_FILTER_MOVING_AVG, 0, 0, 0, false));
+    CHECK(!make(&f, ADC_FILTER_CIC, 8, 0, 0, false));
+    CHECK(!make(&f, ADC_FILTER_CIC, 8, ADC_FILTER_CIC_MAX_ORDER + 1, 0, false));
+    CHECK(!make(&f, ADC_FILTER_IIR, 8, 0, 16, false));
+    CHECK(!adc_filter_init(NULL, NULL));
+    CHECK(make(&f, ADC_FILTER_CIC, 8, 3, 0, false));
+    CHECK(f.cic_gain == 512);
+
+    //NONE only decimates
+    int32_t out = 0;
+    CHECK(make(&f, ADC_FILTER_NONE, 3, 0, 0, false));
+    CHECK(!adc_filter_push(&f, 1, &out));
+    CHECK(!adc_filter_push(&f, 2, &out));
+    CHECK(adc_filter_push(&f, 3, &out) && out == 3);
+}
+
+static void test_step_moving_avg(void) {
+    adc_filter_t f;
+    int32_t out = -1;
+    make(&f, ADC_FILTER_MOVING_AVG, 4, 0, 0, false);
+    CHECK(feed(&f, 0, 4, &out) == 1 && out == 0);
+
+    //step in the middle of a period: one partial output, then the new level
+    CHECK(feed(&f, 0, 2, &out) == 0);
+    CHECK(feed(&f, 1000, 2, &out) == 1 && out == 500);
+    CHECK(feed(&f, 1000, 4, &out) == 1 && out == 1000);
+    CHECK(feed(&f, -1000, 4, &out) == 1 && out == -1000);
+}
+
+static void test_step_cic(void) {
+    for (uint8_t order = 1; order <= ADC_FILTER_CIC_MAX_ORDER; order++) {
+        adc_filter_t f;
+        int32_t out = -1;
+        make(&f, ADC_FILTER_CIC, 16, order, 0, false);
+
+        //exact DC gain once the combs are filled (order outputs)
+        feed(&f, 0, 16 * 4, &out);
+        CHECK(out == 0);
+        int32_t previous = 0;
+        int settled_after = -1;
+        for (int i = 0; i < 8; i++) {
+            feed(&f, 3000, 16, &out);
+            CHECK(out >= previous && out <= 3000); //monotonic, no overshoot
+            previous = out;
+            if (out == 3000 && settled_after < 0) {
+                settled_after = i + 1;
+            }
+        }
+        CHECK(settled_after == order);
+
+        //negative input, and back: the wrapping integrators cancel out
+        feed(&f, -2048, 16 * 4, &out);
+        CHECK(out == -2048);
+        feed(&f, 4095, 16 * 4, &out);
+        CHECK(out == 4095);
+    }
+}
+
+static void test_step_iir(void) {
+    adc_filter_t f;
+    int32_t out = -1;
+    make(&f, ADC_FILTER_IIR, 1, 0, 3, false);
+
+    //primed on the first sample, not from 0
+    CHECK(adc_filter_push(&f, 2000, &out) && out == 2000);
+
+    //step to 4000 with alpha 1/8: 1 - (7/8)^n of the way, within rounding
+    double expected = 2000;
+    int worst = 0;
+    for (int n = 1; n <= 64; n++) {
+        adc_filter_push(&f, 4000, &out);
+        expected += (4000 - expected) / 8;
+        int err = abs(out - (int32_t)(expected + 0.5));
+        worst = err > worst ? err : worst;
+    }
+    CHECK(worst <= 1);
+    CHECK(out >= 3999 && out <= 4000);
+
+    //decimated IIR still runs on every input
+    make(&f, ADC_FILTER_IIR, 4, 0, 2, false);
+    CHECK(feed(&f, 0, 4, &out) == 1 && out == 0);
+    CHECK(feed(&f, 1024, 4, &out) == 1 && out == 1024 - 1024 * 81 / 256);
+}
+
+static void test_median(void) {
+    adc_filter_t f;
+    int32_t out = -1;
+
+    //one glitch in a flat signal is gone, in either direction
+    make(&f, ADC_FILTER_NONE, 1, 0, 0, true);
+    const int32_t spiky[] = { 100, 100, 4095, 100, 100, 0, 100, 100 };
+    int passed = 0;
+    for (size_t i = 0; i < sizeof(spiky) / sizeof(spiky[0]); i++) {
+        adc_filter_push(&f, spiky[i], &out);
+        passed += out != 100;
+    }
+    CHECK(passed == 0);
+
+    //a real step goes through, one sample late
+    make(&f, ADC_FILTER_NONE, 1, 0, 0, true);
+    feed(&f, 100, 3, &out);
+    adc_filter_push(&f, 900, &out);
+    CHECK(out == 100);
+    adc_filter_push(&f, 900, &out);
+    CHECK(out == 900);
+
+    //the first two samples go through as they are
+    make(&f, ADC_FILTER_NONE, 1, 0, 0, true);
+    CHECK(adc_filter_push(&f, 7, &out) && out == 7);
+    CHECK(adc_filter_push(&f, 9, &out) && out == 9);
+    CHECK(adc_filter_push(&f, 8, &out) && out == 8);
+
+    //in front of the average: the outlier does not move the output at all
+    adc_filter_t plain;
+    make(&f, ADC_FILTER_MOVING_AVG, 8, 0, 0, true);
+    make(&plain, ADC_FILTER_MOVING_AVG, 8, 0, 0, false);
+    int32_t out_plain = -1;
+    for (int i = 0; i < 64; i++) {
+        int32_t sample = (i == 21) ? 4095 : 1000;
+        adc_filter_push(&f, sample, &out);
+        if (adc_filter_push(&plain, sample, &out_plain) && i == 23) {
+            CHECK(out == 1000);
+            CHECK(out_plain == 1000 + (4095 - 1000) / 8);
+        }
+    }
+}
+
+/** 75 bpm pulse sampled at 100 Hz, with a glitch right after one beat */
+static void test_beat_detector(void) {
+    adc_beat_detector_t det;
+    adc_beat_detector_init(&det, 100, 50, 300);
+    CHECK(det.refractory_samples == 30);
+
+    int beats = 0;
+    uint16_t bpm = 0;
+    for (int i = 0; i < 100 * 10; i++) {
+        int phase = i % 80; //0.8 s period
+        int32_t value = 2000 + (phase < 10 ? 400 : 0);
+        if (i == 170) {
+            value = 2600; //inside the refractory period of the beat at 160
+        }
+        if (adc_beat_detector_push(&det, value, &bpm)) {
+            beats++;
+            CHECK(bpm == 75);
+        }
+    }
+    CHECK(beats >= 10);
+}
+
+static double bench_type(adc_filter_type_t type, uint8_t order, bool median3) {
+    const int samples = 2000000;
+    adc_filter_t f;
+    make(&f, type, 50, order, 4, median3);
+    int32_t out = 0;
+    volatile int32_t sink = 0;
+    uint32_t x = 1;
+
+    double start = test_now_us();
+    for (int i = 0; i < samples; i++) {
+        x = x * 1103515245 + 12345;
+        if (adc_filter_push(&f, (int32_t)((x >> 16) & 0xFFF), &out)) {
+            sink ^= out;
+        }
+    }
+    (void)sink;
+    return (test_now_us() - start) * 1000.0 / samples;
+}
+
+static void bench_filters(void) {
+    printf("ns per raw sample (decimation 50): none %.1f, moving avg %.1f, CIC2 %.1f, CIC3 %.1f, IIR %.1f, CIC2 + median %.1f\n",
+        bench_type(ADC_FILTER_NONE, 0, false),
+        bench_type(ADC_FILTER_MOVING_AVG, 0, false),
+        bench_type(ADC_FILTER_CIC, 2, false),
+        bench_type(ADC_FILTER_CIC, 3, false),
+        bench_type(ADC_FILTER_IIR, 0, false),
+        bench_type(ADC_FILTER_CIC, 2, true));
+}
+
+int main(void) {
+    test_init();
+    test_step_moving_avg();
+    test_step_cic();
+    test_step_iir();
+    test_median();
+    test_beat_detector();
+    bench_filters();
+    return TEST_RESULT();
+}
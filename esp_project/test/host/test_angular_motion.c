@@ -0,0 +1,163 @@
+#include "host_test.h"
+#include "angular_motion.h"
+#include <math.h>
+#include <string.h>
+
+// Unwrapping and differentiation of the angular layer (AS5600 absolute
+// angle, KY-040 relative count) against synthetic angle sequences.
+
+#define AS5600_COUNTS 4096
+#define DT_US 1000
+
+static bool make(angular_motion_t *m, int32_t counts, float velocity_alpha, float accel_alpha) {
+    angular_motion_config_t cfg = { .counts_per_rev = counts, .velocity_alpha = velocity_alpha, .accel_alpha = accel_alpha };
+    return angular_motion_init(m, &cfg);
+}
+
+static bool near(float value, float expected, float tolerance) {
+    return fabsf(value - expected) <= tolerance;
+}
+
+static int32_t frame_i32(const uint8_t *frame, int offset) {
+    int32_t value;
+    memcpy(&value, &frame[offset], sizeof(value));
+    return value;
+}
+
+static void test_init(void) {
+    angular_motion_t m;
+    CHECK(!make(&m, 0, 1.0f, 1.0f));
+    CHECK(!make(&m, AS5600_COUNTS, 0.0f, 1.0f));
+    CHECK(!make(&m, AS5600_COUNTS, 1.0f, 1.5f));
+    CHECK(!angular_motion_init(NULL, NULL));
+    CHECK(make(&m, AS5600_COUNTS, 1.0f, 1.0f));
+}
+
+static void test_unwrap(void) {
+    CHECK(angular_unwrap_delta(4090, 5, AS5600_COUNTS) == 11);
+    CHECK(angular_unwrap_delta(5, 4090, AS5600_COUNTS) == -11);
+    CHECK(angular_unwrap_delta(4095, 0, AS5600_COUNTS) == 1);
+    CHECK(angular_unwrap_delta(0, 4095, AS5600_COUNTS) == -1);
+    CHECK(angular_unwrap_delta(100, 100, AS5600_COUNTS) == 0);
+    //half a turn is the limit, beyond it the short way round wins
+    CHECK(angular_unwrap_delta(0, 2048, AS5600_COUNTS) == 2048);
+    CHECK(angular_unwrap_delta(0, 2049, AS5600_COUNTS) == -2047);
+}
+
+/** Constant speed across 0/4095 in both directions: no jump, right sign */
+static void test_wrap_velocity(void) {
+    const float step_dps = 8.0f * 360.0f / AS5600_COUNTS / (DT_US * 1e-6f);
+
+    for (int dir = -1; dir <= 1; dir += 2) {
+        angular_motion_t m;
+        make(&m, AS5600_COUNTS, 1.0f, 1.0f);
+        int32_t raw = (dir > 0) ? 4000 : 100;
+        int64_t t = 0;
+        int jumps = 0;
+        int wraps = 0;
+        for (int i = 0; i < 400; i++) {
+            int64_t before = m.position;
+            angular_motion_push_absolute(&m, raw, t);
+            if (i > 0) {
+                jumps += (m.position - before) != dir * 8;
+                jumps += !near(m.velocity_dps, dir * step_dps, 0.01f);
+            }
+            int32_t next = raw + dir * 8;
+            wraps += next < 0 || next >= AS5600_COUNTS;
+            raw = (next + AS5600_COUNTS) % AS5600_COUNTS;
+            t += DT_US;
+        }
+        CHECK(jumps == 0);
+        CHECK(wraps >= 1);
+        //unbounded: 399 steps of 8 counts from the first reading
+        CHECK(m.position == ((dir > 0) ? 4000 : 100) + dir * 399 * 8);
+        CHECK(near(angular_motion_position_deg(&m), (float)m.position * 360.0f / AS5600_COUNTS, 1e-3f));
+    }
+}
+
+static void test_filtering(void) {
+    angular_motion_t m;
+    make(&m, 360, 0.5f, 1.0f); //1 count = 1 degree
+
+    //speed step to 1000 deg/s: velocity closes half the gap on each sample
+    angular_motion_push_position(&m, 0, 0);
+    float expected = 0.0f;
+    int off = 0;
+    for (int i = 1; i <= 12; i++) {
+        angular_motion_push_position(&m, i, (int64_t)i * DT_US);
+        float previous = expected;
+        expected += 0.5f * (1000.0f - expected);
+        off += !near(m.velocity_dps, expected, 0.05f);
+        //raw acceleration with alpha 1: the filtered velocity's own derivative
+        off += !near(m.accel_dps2, (expected - previous) / (DT_US * 1e-6f), 50.0f);
+    }
+    CHECK(off == 0);
+    CHECK(near(m.velocity_dps, 1000.0f, 1.0f));
+
+    //one sample without a count only takes the speed half way down
+    angular_motion_push_position(&m, 12, 13 * DT_US);
+    CHECK(near(m.velocity_dps, 500.0f, 1.0f));
+    CHECK(m.accel_dps2 < 0.0f);
+
+    //same timestamp: the position moves, nothing is differentiated
+    float velocity = m.velocity_dps;
+    angular_motion_push_position(&m, 20, 13 * DT_US);
+    CHECK(m.position == 20 && m.velocity_dps == velocity);
+}
+
+/** The KY-040 stop frame must carry a zero speed, not the decaying filter */
+static void test_stop(void) {
+    angular_motion_t m;
+    make(&m, 80, 0.5f, 0.5f);
+    for (int i = 0; i <= 10; i++) {
+        angular_motion_push_position(&m, -i * 4, (int64_t)i * 20000);
+    }
+    CHECK(m.velocity_dps < 0.0f);
+
+    angular_motion_stop(&m);
+    CHECK(m.velocity_dps == 0.0f && m.accel_dps2 == 0.0f);
+    CHECK(m.position == -40);
+
+    uint8_t frame[ANGULAR_FRAME_SIZE];
+    CHECK(angular_motion_frame_pack(&m, 13, frame, sizeof(frame)) == ANGULAR_FRAME_SIZE);
+    CHECK(frame_i32(frame, 5) == 0 && frame_i32(frame, 9) == 0);
+    CHECK(frame_i32(frame, 1) == -18000); //-40 counts of 80 = -180 degrees
+
+    //moving again after the stop starts from 0, not from a stale speed
+    angular_motion_push_position(&m, -40, 220000);
+    CHECK(m.velocity_dps == 0.0f);
+}
+
+static void test_frame(void) {
+    angular_motion_t m;
+    make(&m, AS5600_COUNTS, 1.0f, 1.0f);
+    angular_motion_push_position(&m, 0, 0);
+    angular_motion_push_position(&m, 10 * AS5600_COUNTS + AS5600_COUNTS / 4, 1000000);
+
+    uint8_t frame[ANGULAR_FRAME_SIZE + 1];
+    memset(frame, 0xEE, sizeof(frame));
+    CHECK(angular_motion_frame_pack(&m, 8, frame, ANGULAR_FRAME_SIZE - 1) == 0);
+    CHECK(angular_motion_frame_pack(&m, 8, frame, sizeof(frame)) == 13);
+    CHECK(frame[0] == 8);
+    CHECK(frame_i32(frame, 1) == 369000); //10.25 turns, in 1/100 degree
+    CHECK(frame_i32(frame, 5) == 369000); //in one second
+    CHECK(frame_i32(frame, 9) == 369000);
+    CHECK(frame[ANGULAR_FRAME_SIZE] == 0xEE);
+
+    //saturates instead of wrapping
+    m.position = (int64_t)AS5600_COUNTS * 100000;
+    m.velocity_dps = -1e12f;
+    angular_motion_frame_pack(&m, 8, frame, sizeof(frame));
+    CHECK(frame_i32(frame, 1) == INT32_MAX);
+    CHECK(frame_i32(frame, 5) == INT32_MIN);
+}
+
+int main(void) {
+    test_init();
+    test_unwrap();
+    test_wrap_velocity();
+    test_filtering();
+    test_stop();
+    test_frame();
+    return TEST_RESULT();
+}
@@ -0,0 +1,135 @@
+#include "host_test.h"
+#include "dash_mailbox.h"
+#include <pthread.h>
+#include <string.h>
+
+#define WRITERS 3
+#define WRITES_PER_WRITER 200000
+
+static dash_mailbox_t mb;
+
+static uint32_t read_u32(unsigned slot) {
+    uint32_t value = 0;
+    uint8_t out[DASH_MAILBOX_SLOT_SIZE];
+    if (dash_mailbox_read(&mb, slot, out) >= sizeof(value)) {
+        memcpy(&value, out, sizeof(value));
+    }
+    return value;
+}
+
+static void test_write_read(void) {
+    dash_mailbox_init(&mb);
+    uint32_t v = 7;
+    CHECK(dash_mailbox_write(&mb, 0, &v, sizeof(v)));
+    CHECK(!dash_mailbox_write(&mb, 0, &v, sizeof(v))); //same value, not a change
+    CHECK(dash_mailbox_take_changed(&mb) == 1);
+    CHECK(dash_mailbox_take_changed(&mb) == 0);
+    CHECK(read_u32(0) == 7);
+    CHECK(!dash_mailbox_write(&mb, DASH_MAILBOX_SLOTS, &v, sizeof(v)));
+
+    dash_mailbox_stats_t stats;
+    dash_mailbox_get_stats(&mb, &stats);
+    CHECK(stats.writes == 1 && stats.unchanged == 1);
+}
+
+/** A writer finding the slot busy hands its value over to the writer inside */
+static void test_handover(void) {
+    dash_mailbox_init(&mb);
+    uint32_t held = 1;
+    uint32_t later = 2;
+    dash_mailbox_write(&mb, 3, &held, sizeof(held));
+    dash_mailbox_take_changed(&mb);
+
+    //a writer is inside the slot
+    dash_slot_t *s = &mb.slots[3];
+    unsigned seq = atomic_load(&s->seq);
+    atomic_store(&s->seq, seq + 1);
+    CHECK(!dash_mailbox_write(&mb, 3, &later, sizeof(later)));
+    CHECK(atomic_load(&s->has_pending));
+
+    //it leaves: its own value was unchanged, the pending one is published
+    atomic_store(&s->seq, seq);
+    CHECK(dash_mailbox_write(&mb, 3, &held, sizeof(held)));
+    CHECK(!atomic_load(&s->has_pending));
+    CHECK(dash_mailbox_take_changed(&mb) == (1u << 3));
+    CHECK(read_u32(3) == 2);
+
+    //slot and pending copy both busy: superseded by the pending writer
+    atomic_store(&s->seq, atomic_load(&s->seq) + 1);
+    atomic_store(&s->pending_seq, atomic_load(&s->pending_seq) + 1);
+    CHECK(!dash_mailbox_write(&mb, 3, &held, sizeof(held)));
+
+    dash_mailbox_stats_t stats;
+    dash_mailbox_get_stats(&mb, &stats);
+    CHECK(stats.pending == 1 && stats.busy == 1);
+}
+
+static void *writer(void *arg) {
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+    for (uint32_t i = 1; i <= WRITES_PER_WRITER; i++) {
+        uint32_t value = (id << 24) | i;
+        uint8_t buf[DASH_MAILBOX_SLOT_SIZE];
+        for (size_t k = 0; k < sizeof(buf); k += sizeof(value)) {
+            memcpy(&buf[k], &value, sizeof(value));
+        }
+        dash_mailbox_write(&mb, 0, buf, sizeof(buf));
+    }
+    return NULL;
+}
+
+static volatile int writers_done = 0;
+
+static void *reader(void *arg) {
+    int *torn = arg;
+    uint8_t out[DASH_MAILBOX_SLOT_SIZE];
+    while (!writers_done) {
+        if (dash_mailbox_read(&mb, 0, out) != sizeof(out)) {
+            continue;
+        }
+        for (size_t k = sizeof(uint32_t); k < sizeof(out); k++) {
+            if (out[k] != out[k % sizeof(uint32_t)]) {
+                (*torn)++;
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Writers on one slot: no torn read, and once they are done the slot holds the
+ * last value of one of them with nothing left pending
+ */
+static void test_concurrent(void) {
+    dash_mailbox_init(&mb);
+    pthread_t writers[WRITERS];
+    pthread_t read_thread;
+    int torn = 0;
+    pthread_create(&read_thread, NULL, reader, &torn);
+    for (uintptr_t i = 0; i < WRITERS; i++) {
+        pthread_create(&writers[i], NULL, writer, (void *)(i + 1));
+    }
+    for (int i = 0; i < WRITERS; i++) {
+        pthread_join(writers[i], NULL);
+    }
+    writers_done = 1;
+    pthread_join(read_thread, NULL);
+
+    CHECK(torn == 0);
+    CHECK(!atomic_load(&mb.slots[0].has_pending));
+    CHECK((atomic_load(&mb.slots[0].seq) & 1) == 0);
+    uint32_t last = read_u32(0);
+    CHECK((last & 0xFFFFFF) == WRITES_PER_WRITER && (last >> 24) >= 1 && (last >> 24) <= WRITERS);
+
+    dash_mailbox_stats_t stats;
+    dash_mailbox_get_stats(&mb, &stats);
+    printf("%d writers x %d writes: %" PRIu32 " published, %" PRIu32 " handed over, %" PRIu32 " superseded\n",
+        WRITERS, WRITES_PER_WRITER, stats.writes, stats.pending, stats.busy);
+}
+
+int main(void) {
+    test_write_read();
+    test_handover();
+    test_concurrent();
+    return TEST_RESULT();
+}
@@ -0,0 +1,318 @@
+#include "host_test.h"
+#include "delta_patch.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Patches are built here with the layout of delta_patch.h (the station's
+// delta.rs makes them on the real path).
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+} bytes_t;
+
+static void put(bytes_t *b, const void *data, size_t len) {
+    b->data = realloc(b->data, b->len + len);
+    memcpy(&b->data[b->len], data, len);
+    b->len += len;
+}
+
+static void put_u8(bytes_t *b, uint8_t v) {
+    put(b, &v, 1);
+}
+
+static void put_u32(bytes_t *b, uint32_t v) {
+    uint8_t le[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    put(b, le, 4);
+}
+
+static void put_header(bytes_t *b, uint32_t old_size, uint32_t new_size) {
+    uint8_t sha[DELTA_PATCH_SHA_LEN];
+    put(b, DELTA_PATCH_MAGIC, 4);
+    put_u8(b, DELTA_PATCH_VERSION);
+    put_u32(b, old_size);
+    memset(sha, 0x0A, sizeof(sha));
+    put(b, sha, sizeof(sha));
+    put_u32(b, new_size);
+    memset(sha, 0x0B, sizeof(sha));
+    put(b, sha, sizeof(sha));
+}
+
+/** Run-length coded data of an ADD / INSERT command */
+static void put_data(bytes_t *b, const uint8_t *data, uint32_t n) {
+    uint32_t i = 0;
+    while (i < n) {
+        uint32_t zeros = 0;
+        while (i + zeros < n && data[i + zeros] == 0 && zeros < 0xFFFF) {
+            zeros++;
+        }
+        if (zeros >= 128) {
+            put_u8(b, 0xFF);
+            put_u8(b, (uint8_t)zeros);
+            put_u8(b, (uint8_t)(zeros >> 8));
+            i += zeros;
+        } else if (zeros >= 2) {
+            put_u8(b, (uint8_t)(0x80 | (zeros - 1)));
+            i += zeros;
+        } else {
+            uint32_t k = 0;
+            while (i + k < n && k < 127 && !(i + k + 1 < n && data[i + k] == 0 && data[i + k + 1] == 0)) {
+                k++;
+            }
+            put_u8(b, (uint8_t)(k - 1));
+            put(b, &data[i], k);
+            i += k;
+        }
+    }
+}
+
+static void put_op(bytes_t *b, delta_op_t op, uint32_t arg, const uint8_t *data) {
+    put_u8(b, op);
+    put_u32(b, arg);
+    if (data != NULL) {
+        put_data(b, data, arg);
+    }
+}
+
+// images seen by the callbacks
+static const uint8_t *old_image;
+static uint32_t old_image_len;
+static bytes_t new_image;
+static int fail_write_after = -1;
+
+static int read_old(void *arg, uint32_t offset, uint8_t *buf, size_t len) {
+    (void)arg;
+    if (offset + len > old_image_len) {
+        return -1;
+    }
+    memcpy(buf, &old_image[offset], len);
+    return 0;
+}
+
+static int write_new(void *arg, const uint8_t *buf, size_t len) {
+    (void)arg;
+    if (fail_write_after >= 0 && new_image.len + len > (size_t)fail_write_after) {
+        return -1;
+    }
+    put(&new_image, buf, len);
+    return 0;
+}
+
+static delta_patch_status_t apply(delta_patch_t *patch, const bytes_t *p, size_t chunk) {
+    free(new_image.data);
+    new_image.data = NULL;
+    new_image.len = 0;
+    delta_patch_init(patch, read_old, write_new, NULL);
+    for (size_t i = 0; i < p->len; i += chunk) {
+        size_t n = (p->len - i < chunk) ? p->len - i : chunk;
+        delta_patch_status_t status = delta_patch_feed(patch, &p->data[i], n);
+        if (status != DELTA_PATCH_OK) {
+            return status;
+        }
+    }
+    return delta_patch_finish(patch);
+}
+
+static uint8_t *make_image(uint32_t len, uint32_t seed) {
+    uint8_t *img = malloc(len);
+    for (uint32_t i = 0; i < len; i++) {
+        seed = seed * 1103515245u + 12345u;
+        img[i] = (uint8_t)(seed >> 16);
+    }
+    return img;
+}
+
+static delta_patch_t patch;
+
+/**
+ * new = old[0..1000) with a few bytes changed, 200 inserted bytes,
+ * old[1500..3000)
+ */
+static void test_round_trip(void) {
+    uint8_t *old = make_image(3000, 1);
+    old_image = old;
+    old_image_len = 3000;
+
+    uint8_t expected[2700];
+    uint8_t add1[1000] = {0};
+    add1[10] = 1;
+    add1[11] = 0xFF;
+    add1[500] = 7;
+    for (int i = 0; i < 1000; i++) {
+        expected[i] = (uint8_t)(old[i] + add1[i]);
+    }
+    uint8_t *insert = make_image(200, 2);
+    memcpy(&expected[1000], insert, 200);
+    uint8_t add2[1500] = {0};
+    memcpy(&expected[1200], &old[1500], 1500);
+
+    bytes_t p = {0};
+    put_header(&p, 3000, sizeof(expected));
+    put_op(&p, DELTA_OP_ADD, 1000, add1);
+    put_op(&p, DELTA_OP_INSERT, 200, insert);
+    put_op(&p, DELTA_OP_SEEK, 500, NULL);
+    put_op(&p, DELTA_OP_ADD, 1500, add2);
+    put_u8(&p, DELTA_OP_END);
+
+    const size_t chunks[] = { 1, 3, DELTA_PATCH_HEADER_SIZE, 512, p.len };
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        CHECK(apply(&patch, &p, chunks[c]) == DELTA_PATCH_OK);
+        CHECK(new_image.len == sizeof(expected));
+        CHECK(new_image.len == sizeof(expected) && memcmp(new_image.data, expected, sizeof(expected)) == 0);
+    }
+    CHECK(patch.header_done && patch.old_size == 3000 && patch.new_size == sizeof(expected));
+    CHECK(patch.old_sha[0] == 0x0A && patch.new_sha[DELTA_PATCH_SHA_LEN - 1] == 0x0B);
+    // mostly zero ADD data: the patch is much smaller than the image
+    CHECK(p.len < 400);
+
+    // backward seek
+    bytes_t back = {0};
+    put_header(&back, 3000, 20);
+    put_op(&back, DELTA_OP_SEEK, 100, NULL);
+    put_op(&back, DELTA_OP_ADD, 10, add2);
+    put_op(&back, DELTA_OP_SEEK, (uint32_t)-110, NULL);
+    put_op(&back, DELTA_OP_ADD, 10, add2);
+    put_u8(&back, DELTA_OP_END);
+    CHECK(apply(&patch, &back, 5) == DELTA_PATCH_OK);
+    CHECK(new_image.len == 20 && memcmp(new_image.data, &old[100], 10) == 0
+        && memcmp(&new_image.data[10], old, 10) == 0);
+
+    free(back.data);
+    free(p.data);
+    free(insert);
+    free(old);
+}
+
+static void test_rejections(void) {
+    uint8_t *old = make_image(1000, 3);
+    old_image = old;
+    old_image_len = 1000;
+    uint8_t zeros[64] = {0};
+
+    bytes_t p = {0};
+    put_header(&p, 1000, 10);
+    p.data[0] = 'X';
+    CHECK(apply(&patch, &p, 16) == DELTA_PATCH_ERR_MAGIC);
+    p.data[0] = 'R';
+    p.data[4] = DELTA_PATCH_VERSION + 1;
+    CHECK(apply(&patch, &p, 16) == DELTA_PATCH_ERR_MAGIC);
+    free(p.data);
+
+    // seek before the start / past the end of the old image
+    p = (bytes_t){0};
+    put_header(&p, 1000, 10);
+    put_op(&p, DELTA_OP_SEEK, (uint32_t)-1, NULL);
+    CHECK(apply(&patch, &p, 7) == DELTA_PATCH_ERR_RANGE);
+    free(p.data);
+    p = (bytes_t){0};
+    put_header(&p, 1000, 10);
+    put_op(&p, DELTA_OP_SEEK, 1001, NULL);
+    CHECK(apply(&patch, &p, 7) == DELTA_PATCH_ERR_RANGE);
+    free(p.data);
+
+    // ADD reading past the old image
+    p = (bytes_t){0};
+    put_header(&p, 1000, 20);
+    put_op(&p, DELTA_OP_SEEK, 995, NULL);
+    put_op(&p, DELTA_OP_ADD, 10, zeros);
+    CHECK(apply(&patch, &p, 7) == DELTA_PATCH_ERR_RANGE);
+    free(p.data);
+
+    // writing past the new size
+    p = (bytes_t){0};
+    put_header(&p, 1000, 10);
+    put_op(&p, DELTA_OP_INSERT, 11, zeros);
+    CHECK(apply(&patch, &p, 7) == DELTA_PATCH_ERR_RANGE);
+    free(p.data);
+
+    // unknown command, bytes after END
+    p = (bytes_t){0};
+    put_header(&p, 1000, 0);
+    put_u8(&p, DELTA_OP_INSERT + 1);
+    CHECK(apply(&patch, &p, 7) == DELTA_PATCH_ERR_FORMAT);
+    free(p.data);
+    p = (bytes_t){0};
+    put_header(&p, 1000, 0);
+    put_u8(&p, DELTA_OP_END);
+    put_u8(&p, DELTA_OP_END);
+    CHECK(apply(&patch, &p, 7) == DELTA_PATCH_ERR_FORMAT);
+    free(p.data);
+
+    // literal run longer than its command
+    p = (bytes_t){0};
+    put_header(&p, 1000, 10);
+    put_u8(&p, DELTA_OP_INSERT);
+    put_u32(&p, 2);
+    put_u8(&p, 3); // 4 literal bytes
+    put(&p, "abcd", 4);
+    CHECK(apply(&patch, &p, 7) == DELTA_PATCH_ERR_FORMAT);
+    free(p.data);
+
+    // truncated: no END, or END before the new size
+    p = (bytes_t){0};
+    put_header(&p, 1000, 10);
+    put_op(&p, DELTA_OP_INSERT, 10, zeros);
+    CHECK(apply(&patch, &p, 7) == DELTA_PATCH_ERR_INCOMPLETE);
+    free(p.data);
+    p = (bytes_t){0};
+    put_header(&p, 1000, 10);
+    put_op(&p, DELTA_OP_INSERT, 5, zeros);
+    put_u8(&p, DELTA_OP_END);
+    CHECK(apply(&patch, &p, 7) == DELTA_PATCH_ERR_INCOMPLETE);
+    free(p.data);
+    p = (bytes_t){0};
+    put(&p, DELTA_PATCH_MAGIC, 4);
+    CHECK(apply(&patch, &p, 7) == DELTA_PATCH_ERR_INCOMPLETE);
+    CHECK(!patch.header_done);
+    free(p.data);
+
+    // write callback failure, and the error sticks
+    p = (bytes_t){0};
+    put_header(&p, 1000, 2 * DELTA_PATCH_BUF_SIZE);
+    uint8_t *big = calloc(2 * DELTA_PATCH_BUF_SIZE, 1);
+    put_op(&p, DELTA_OP_INSERT, 2 * DELTA_PATCH_BUF_SIZE, big);
+    put_u8(&p, DELTA_OP_END);
+    fail_write_after = DELTA_PATCH_BUF_SIZE;
+    CHECK(apply(&patch, &p, p.len) == DELTA_PATCH_ERR_IO);
+    CHECK(delta_patch_feed(&patch, p.data, 1) == DELTA_PATCH_ERR_IO);
+    CHECK(delta_patch_finish(&patch) == DELTA_PATCH_ERR_IO);
+    fail_write_after = -1;
+    free(big);
+    free(p.data);
+
+    free(old);
+}
+
+/** Apply time of a 1 MiB image, small changes every 4 KiB */
+static void bench_apply(void) {
+    const uint32_t size = 1024 * 1024;
+    uint8_t *old = make_image(size, 4);
+    old_image = old;
+    old_image_len = size;
+    uint8_t *add = calloc(size, 1);
+    for (uint32_t i = 0; i < size; i += 4096) {
+        add[i] = 1;
+    }
+    bytes_t p = {0};
+    put_header(&p, size, size);
+    put_op(&p, DELTA_OP_ADD, size, add);
+    put_u8(&p, DELTA_OP_END);
+
+    double start = test_now_us();
+    CHECK(apply(&patch, &p, 1024) == DELTA_PATCH_OK);
+    double elapsed = test_now_us() - start;
+    CHECK(new_image.len == size && new_image.data[4096] == (uint8_t)(old[4096] + 1));
+    printf("1 MiB image, %zu B patch: applied in %.1f ms\n", p.len, elapsed / 1000);
+
+    free(p.data);
+    free(add);
+    free(old);
+}
+
+int main(void) {
+    test_round_trip();
+    test_rejections();
+    bench_apply();
+    free(new_image.data);
+    return TEST_RESULT();
+}
@@ -0,0 +1,228 @@
+#include "host_test.h"
+#include "espnow_gateway.h"
+#include <string.h>
+
+// Peer table and batch builder of the ESP-NOW -> UDP gateway. The batch tests
+// drive them the way espnow_lib.c does: add, flush when full and add again,
+// flush once the first record is ESPNOW_GW_BATCH_MS old; sent datagrams are
+// walked back with espnow_gw_batch_next as the station does.
+
+#define HEADER_SIZE 6   // sensor header of the datagram
+#define DATAGRAM_SIZE 200
+#define BATCH_MS 20
+
+static uint8_t buffers[2][DATAGRAM_SIZE];
+static int current;
+static espnow_gw_batch_t batch;
+
+static uint8_t sent[64][DATAGRAM_SIZE];
+static size_t sent_len[64];
+static int sent_count;
+
+static void batch_open(void) {
+    current ^= 1;
+    espnow_gw_batch_init(&batch, buffers[current], sizeof(buffers[current]));
+}
+
+/** Hands the datagram to the "UDP client", which keeps a copy */
+static void batch_flush(void) {
+    if (batch.records == 0) {
+        return;
+    }
+    memset(batch.buf, 0xEE, HEADER_SIZE);
+    memcpy(sent[sent_count], batch.buf, batch.len);
+    sent_len[sent_count++] = batch.len;
+    batch_open();
+}
+
+static bool forward(uint8_t node_id, const uint8_t *frame, uint16_t len, uint32_t now) {
+    if (espnow_gw_batch_add(&batch, HEADER_SIZE, node_id, frame, len, now)) {
+        return true;
+    }
+    batch_flush();
+    return espnow_gw_batch_add(&batch, HEADER_SIZE, node_id, frame, len, now);
+}
+
+static void make_frame(uint8_t *frame, uint16_t len, uint8_t seed) {
+    for (uint16_t i = 0; i < len; i++) {
+        frame[i] = (uint8_t)(seed + i);
+    }
+}
+
+/** Records of sent datagram `n`, checked against the frames of seed `first`.. */
+static int check_datagram(int n, uint8_t first_seed, uint16_t frame_len) {
+    size_t offset = HEADER_SIZE;
+    uint8_t node_id;
+    const uint8_t *frame;
+    uint16_t len;
+    int records = 0;
+    while (espnow_gw_batch_next(sent[n], sent_len[n], &offset, &node_id, &frame, &len)) {
+        uint8_t seed = (uint8_t)(first_seed + records);
+        uint8_t expected[DATAGRAM_SIZE];
+        make_frame(expected, frame_len, seed);
+        CHECK(node_id == seed % ESPNOW_GW_PEERS_MAX);
+        CHECK(len == frame_len);
+        CHECK(memcmp(frame, expected, len) == 0);
+        records++;
+    }
+    CHECK(offset == sent_len[n]);
+    return records;
+}
+
+static void reset(void) {
+    sent_count = 0;
+    current = 0;
+    batch_open();
+}
+
+static void test_peers(void) {
+    espnow_gw_peer_table_t table;
+    espnow_gw_peers_init(&table);
+    uint8_t mac[ESPNOW_GW_MAC_LEN] = {0x24, 0x6F, 0x28, 0, 0, 0};
+    bool is_new;
+
+    for (uint8_t i = 0; i < ESPNOW_GW_PEERS_MAX; i++) {
+        mac[5] = i;
+        CHECK(espnow_gw_peers_touch(&table, mac, 10, i * 100, &is_new) == i);
+        CHECK(is_new);
+    }
+    mac[5] = 3;
+    CHECK(espnow_gw_peers_touch(&table, mac, 10, 5000, &is_new) == 3);
+    CHECK(!is_new);
+    CHECK(table.peers[3].frames == 2 && table.peers[3].bytes == 20);
+    CHECK(espnow_gw_peers_count(&table) == ESPNOW_GW_PEERS_MAX);
+
+    //full: rejected, not added
+    mac[5] = 0xAA;
+    CHECK(espnow_gw_peers_touch(&table, mac, 10, 5000, NULL) == ESPNOW_GW_NODE_NONE);
+    CHECK(table.rejected == 1);
+    CHECK(espnow_gw_peers_find(&table, mac) == ESPNOW_GW_NODE_NONE);
+
+    //everyone but node 3 goes silent, one removal per call
+    uint8_t gone[ESPNOW_GW_MAC_LEN];
+    int removed = 0;
+    while (espnow_gw_peers_expire(&table, ESPNOW_GW_PEER_TIMEOUT_MS + 1200, gone)) {
+        CHECK(gone[5] != 3);
+        removed++;
+    }
+    CHECK(removed == ESPNOW_GW_PEERS_MAX - 1);
+    CHECK(espnow_gw_peers_count(&table) == 1);
+
+    //a freed slot is given to the next node
+    CHECK(espnow_gw_peers_touch(&table, mac, 10, 20000, &is_new) == 0);
+    CHECK(is_new);
+}
+
+static void test_packing(void) {
+    reset();
+    uint8_t frame[32];
+    for (uint8_t seed = 0; seed < 5; seed++) {
+        make_frame(frame, 20, seed);
+        CHECK(forward(seed % ESPNOW_GW_PEERS_MAX, frame, 20, 1000));
+    }
+    CHECK(batch.records == 5);
+    CHECK(batch.len == HEADER_SIZE + 5 * (ESPNOW_GW_RECORD_HEADER_SIZE + 20));
+    CHECK(batch.started_ms == 1000);
+    batch_flush();
+    CHECK(sent_count == 1);
+    CHECK(check_datagram(0, 0, 20) == 5);
+
+    //header area left to the caller, the new batch starts empty
+    CHECK(sent[0][0] == 0xEE && sent[0][HEADER_SIZE - 1] == 0xEE);
+    CHECK(batch.records == 0 && batch.len == 0);
+    batch_flush();
+    CHECK(sent_count == 1); //nothing to send
+}
+
+static void test_flush_on_full(void) {
+    reset();
+    uint8_t frame[64];
+    const uint16_t frame_len = 40;
+    const int per_datagram = (DATAGRAM_SIZE - HEADER_SIZE) / (ESPNOW_GW_RECORD_HEADER_SIZE + frame_len);
+    const int total = 3 * per_datagram + 1;
+
+    for (int i = 0; i < total; i++) {
+        make_frame(frame, frame_len, (uint8_t)i);
+        CHECK(forward((uint8_t)(i % ESPNOW_GW_PEERS_MAX), frame, frame_len, 1000 + i));
+    }
+    CHECK(sent_count == 3);
+    for (int n = 0; n < sent_count; n++) {
+        CHECK(check_datagram(n, (uint8_t)(n * per_datagram), frame_len) == per_datagram);
+    }
+    //the frame that did not fit opened the next batch, with its own deadline
+    CHECK(batch.records == 1);
+    CHECK(batch.started_ms == (uint32_t)(1000 + 3 * per_datagram));
+
+    //exactly full: the last record ends on the capacity
+    reset();
+    uint16_t exact = DATAGRAM_SIZE - HEADER_SIZE - ESPNOW_GW_RECORD_HEADER_SIZE;
+    uint8_t big[DATAGRAM_SIZE];
+    make_frame(big, exact, 0);
+    CHECK(espnow_gw_batch_add(&batch, HEADER_SIZE, 0, big, exact, 0));
+    CHECK(batch.len == DATAGRAM_SIZE);
+    CHECK(!espnow_gw_batch_add(&batch, HEADER_SIZE, 0, big, 0, 0));
+
+    //larger than a datagram: refused even by an empty batch
+    reset();
+    CHECK(!forward(0, big, exact + 1, 0));
+    CHECK(sent_count == 0 && batch.records == 0);
+
+    //no storage (pool exhausted on the target): refused
+    espnow_gw_batch_init(&batch, NULL, 0);
+    CHECK(!espnow_gw_batch_add(&batch, HEADER_SIZE, 0, big, 1, 0));
+}
+
+static void test_flush_on_timeout(void) {
+    reset();
+    uint8_t frame[8];
+    make_frame(frame, sizeof(frame), 0);
+
+    CHECK(!espnow_gw_batch_due(&batch, 5000, BATCH_MS)); //empty is never due
+    CHECK(forward(0, frame, sizeof(frame), 5000));
+    make_frame(frame, sizeof(frame), 1);
+    CHECK(forward(1, frame, sizeof(frame), 5015)); //does not move the deadline
+    CHECK(!espnow_gw_batch_due(&batch, 5019, BATCH_MS));
+    CHECK(espnow_gw_batch_due(&batch, 5020, BATCH_MS));
+    batch_flush();
+    CHECK(check_datagram(0, 0, sizeof(frame)) == 2);
+    CHECK(!espnow_gw_batch_due(&batch, 6000, BATCH_MS));
+
+    //millisecond counter wrapping between the first record and the check
+    make_frame(frame, sizeof(frame), 0);
+    CHECK(forward(0, frame, sizeof(frame), UINT32_MAX - 5));
+    CHECK(!espnow_gw_batch_due(&batch, 10, BATCH_MS));
+    CHECK(espnow_gw_batch_due(&batch, 14, BATCH_MS));
+}
+
+/** Truncated datagrams: only the complete records are walked */
+static void test_truncated(void) {
+    reset();
+    uint8_t frame[16];
+    for (uint8_t seed = 0; seed < 3; seed++) {
+        make_frame(frame, sizeof(frame), seed);
+        forward(seed, frame, sizeof(frame), 0);
+    }
+    batch_flush();
+    const size_t record = ESPNOW_GW_RECORD_HEADER_SIZE + sizeof(frame);
+    for (size_t cut = HEADER_SIZE; cut <= sent_len[0]; cut++) {
+        size_t offset = HEADER_SIZE;
+        uint8_t node_id;
+        const uint8_t *f;
+        uint16_t len;
+        size_t walked = 0;
+        while (espnow_gw_batch_next(sent[0], cut, &offset, &node_id, &f, &len)) {
+            walked++;
+        }
+        CHECK(walked == (cut - HEADER_SIZE) / record);
+        CHECK(offset <= cut);
+    }
+}
+
+int main(void) {
+    test_peers();
+    test_packing();
+    test_flush_on_full();
+    test_flush_on_timeout();
+    test_truncated();
+    return TEST_RESULT();
+}
@@ -0,0 +1,280 @@
+#include "host_test.h"
+#include "espnow_reassembly.h"
+#include <string.h>
+
+// Reassembly of fragmented ESP-NOW messages from several peers, fed with
+// shuffled, duplicated and lost fragments, plus the slot timeout and the
+// eviction when the pool is full.
+
+#define FRAG 240 // payload of a full fragment
+#define TIMEOUT 200
+
+static uint32_t rng = 7;
+
+static uint32_t next_rand(void) {
+    rng = rng * 1103515245 + 12345;
+    return rng >> 16;
+}
+
+static void fill_message(uint8_t *msg, uint32_t len, uint32_t seed) {
+    for (uint32_t i = 0; i < len; i++) {
+        msg[i] = (uint8_t)(seed * 31 + i * 7 + (i >> 8));
+    }
+}
+
+static uint8_t frag_count(uint32_t len) {
+    return (uint8_t)((len + FRAG - 1) / FRAG);
+}
+
+static espnow_reasm_result_t push_frag(espnow_reasm_t *r, const uint8_t *mac, uint8_t port, uint32_t id,
+    const uint8_t *msg, uint32_t len, uint8_t idx, uint32_t now_ms, espnow_reasm_slot_t **slot) {
+    uint8_t total = frag_count(len);
+    uint32_t offset = (uint32_t)idx * FRAG;
+    uint32_t frag_len = (idx == total - 1) ? len - offset : FRAG;
+    return espnow_reasm_push(r, mac, port, id, total, idx, &msg[offset], frag_len, now_ms, slot);
+}
+
+static void test_single(void) {
+    static espnow_reasm_t r;
+    espnow_reasm_init(&r, FRAG, TIMEOUT);
+    const uint8_t mac[6] = { 1, 2, 3, 4, 5, 6 };
+    static uint8_t msg[ESPNOW_REASM_MAX_SIZE];
+    uint32_t len = 1000; //4 full fragments + 40 bytes
+    fill_message(msg, len, 1);
+
+    espnow_reasm_slot_t *slot = NULL;
+    const uint8_t order[] = { 4, 1, 1, 0, 3, 4, 2 };
+    espnow_reasm_result_t expected[] = {
+        ESPNOW_REASM_INCOMPLETE, ESPNOW_REASM_INCOMPLETE, ESPNOW_REASM_DUPLICATE, ESPNOW_REASM_INCOMPLETE,
+        ESPNOW_REASM_INCOMPLETE, ESPNOW_REASM_DUPLICATE, ESPNOW_REASM_COMPLETE,
+    };
+    for (size_t i = 0; i < sizeof(order); i++) {
+        CHECK(push_frag(&r, mac, 0, 9, msg, len, order[i], 10, &slot) == expected[i]);
+    }
+    CHECK(slot != NULL && espnow_reasm_length(&r, slot) == len);
+    CHECK(slot != NULL && memcmp(slot->buffer, msg, len) == 0);
+    CHECK(r.stats.completed == 1 && r.stats.duplicates == 2);
+
+    //a late duplicate of a completed, unreleased message is still a duplicate
+    CHECK(push_frag(&r, mac, 0, 9, msg, len, 0, 11, NULL) == ESPNOW_REASM_DUPLICATE);
+    espnow_reasm_release(&r, slot);
+    CHECK(!slot->used);
+
+    //and once consumed, it must not open a new slot (or, alone, complete again)
+    CHECK(push_frag(&r, mac, 0, 9, msg, len, 2, 12, NULL) == ESPNOW_REASM_DUPLICATE);
+    CHECK(push_frag(&r, mac, 0, 10, msg, 5, 0, 12, &slot) == ESPNOW_REASM_COMPLETE);
+    espnow_reasm_release(&r, slot);
+    CHECK(push_frag(&r, mac, 0, 10, msg, 5, 0, 13, &slot) == ESPNOW_REASM_DUPLICATE);
+    for (size_t i = 0; i < ESPNOW_REASM_SLOTS; i++) {
+        CHECK(!r.slots[i].used);
+    }
+    //only for one timeout: after that the id is free again
+    CHECK(push_frag(&r, mac, 0, 10, msg, 5, 0, 12 + TIMEOUT, &slot) == ESPNOW_REASM_COMPLETE);
+    espnow_reasm_release(&r, slot);
+
+    //one fragment message, and one ending on a fragment boundary
+    CHECK(push_frag(&r, mac, 0, 12, msg, 5, 0, 12, &slot) == ESPNOW_REASM_COMPLETE);
+    CHECK(espnow_reasm_length(&r, slot) == 5);
+    espnow_reasm_release(&r, slot);
+    CHECK(push_frag(&r, mac, 0, 11, msg, 2 * FRAG, 1, 300, &slot) == ESPNOW_REASM_INCOMPLETE);
+    CHECK(push_frag(&r, mac, 0, 11, msg, 2 * FRAG, 0, 300, &slot) == ESPNOW_REASM_COMPLETE);
+    CHECK(espnow_reasm_length(&r, slot) == 2 * FRAG);
+    espnow_reasm_release(&r, slot);
+}
+
+static void test_invalid(void) {
+    static espnow_reasm_t r;
+    espnow_reasm_init(&r, FRAG, TIMEOUT);
+    const uint8_t mac[6] = { 1 };
+    uint8_t payload[FRAG + 1] = { 0 };
+
+    CHECK(espnow_reasm_push(&r, mac, 0, 1, 0, 0, payload, 10, 0, NULL) == ESPNOW_REASM_INVALID);
+    CHECK(espnow_reasm_push(&r, mac, 0, 1, 2, 2, payload, 10, 0, NULL) == ESPNOW_REASM_INVALID);
+    CHECK(espnow_reasm_push(&r, mac, 0, 1, 2, 0, payload, FRAG - 1, 0, NULL) == ESPNOW_REASM_INVALID); //short non-last
+    CHECK(espnow_reasm_push(&r, mac, 0, 1, 2, 1, payload, FRAG + 1, 0, NULL) == ESPNOW_REASM_INVALID);
+    CHECK(espnow_reasm_push(&r, mac, 0, 1, 2, 1, payload, 0, 0, NULL) == ESPNOW_REASM_INVALID);
+    CHECK(espnow_reasm_push(&r, mac, 0, 1, ESPNOW_REASM_MAX_FRAGS + 1, 0, payload, FRAG, 0, NULL) == ESPNOW_REASM_INVALID);
+    CHECK(espnow_reasm_push(&r, mac, 0, 1, 9, 8, payload, FRAG, 0, NULL) == ESPNOW_REASM_INVALID); //past 2048 bytes
+
+    //same message id announcing another fragment count
+    CHECK(espnow_reasm_push(&r, mac, 0, 1, 3, 0, payload, FRAG, 0, NULL) == ESPNOW_REASM_INCOMPLETE);
+    CHECK(espnow_reasm_push(&r, mac, 0, 1, 4, 1, payload, FRAG, 0, NULL) == ESPNOW_REASM_INVALID);
+    CHECK(r.stats.invalid == 8);
+}
+
+/** Same id from another peer or on another port is another message */
+static void test_keys(void) {
+    static espnow_reasm_t r;
+    espnow_reasm_init(&r, FRAG, TIMEOUT);
+    const uint8_t mac_a[6] = { 0xA };
+    const uint8_t mac_b[6] = { 0xB };
+    static uint8_t a[600], b[600], c[600];
+    fill_message(a, sizeof(a), 1);
+    fill_message(b, sizeof(b), 2);
+    fill_message(c, sizeof(c), 3);
+
+    espnow_reasm_slot_t *slot = NULL;
+    for (uint8_t idx = 0; idx < 2; idx++) {
+        CHECK(push_frag(&r, mac_a, 0, 5, a, sizeof(a), idx, 0, NULL) == ESPNOW_REASM_INCOMPLETE);
+        CHECK(push_frag(&r, mac_b, 0, 5, b, sizeof(b), idx, 0, NULL) == ESPNOW_REASM_INCOMPLETE);
+        CHECK(push_frag(&r, mac_a, 1, 5, c, sizeof(c), idx, 0, NULL) == ESPNOW_REASM_INCOMPLETE);
+    }
+    CHECK(push_frag(&r, mac_b, 0, 5, b, sizeof(b), 2, 1, &slot) == ESPNOW_REASM_COMPLETE);
+    CHECK(memcmp(slot->buffer, b, sizeof(b)) == 0);
+    CHECK(push_frag(&r, mac_a, 1, 5, c, sizeof(c), 2, 1, &slot) == ESPNOW_REASM_COMPLETE);
+    CHECK(memcmp(slot->buffer, c, sizeof(c)) == 0);
+    CHECK(push_frag(&r, mac_a, 0, 5, a, sizeof(a), 2, 1, &slot) == ESPNOW_REASM_COMPLETE);
+    CHECK(memcmp(slot->buffer, a, sizeof(a)) == 0);
+}
+
+static void test_timeout_eviction(void) {
+    static espnow_reasm_t r;
+    espnow_reasm_init(&r, FRAG, TIMEOUT);
+    static uint8_t msg[3 * FRAG];
+    fill_message(msg, sizeof(msg), 4);
+    uint8_t mac[6] = { 0 };
+
+    //incomplete message recycled exactly at the timeout, also across the ms wrap
+    uint32_t start = UINT32_MAX - 50;
+    push_frag(&r, mac, 0, 1, msg, sizeof(msg), 0, start, NULL);
+    CHECK(espnow_reasm_expire(&r, start + TIMEOUT - 1) == 0);
+    CHECK(espnow_reasm_expire(&r, start + TIMEOUT) == 1);
+    CHECK(r.stats.timed_out == 1);
+    //its late fragments start a new message, which never completes alone
+    CHECK(push_frag(&r, mac, 0, 1, msg, sizeof(msg), 1, start + TIMEOUT, NULL) == ESPNOW_REASM_INCOMPLETE);
+    CHECK(push_frag(&r, mac, 0, 1, msg, sizeof(msg), 2, start + TIMEOUT, NULL) == ESPNOW_REASM_INCOMPLETE);
+    espnow_reasm_expire(&r, start + 2 * TIMEOUT);
+
+    //pool full of waiting messages: the oldest one is taken over
+    espnow_reasm_slot_t *done = NULL;
+    mac[0] = 0xC0;
+    push_frag(&r, mac, 0, 1, msg, FRAG / 2, 0, 1000, &done); //complete, not released yet
+    for (uint8_t i = 1; i < ESPNOW_REASM_SLOTS; i++) {
+        mac[0] = i;
+        push_frag(&r, mac, 0, 1, msg, sizeof(msg), 0, 1000 + i, NULL);
+    }
+    mac[0] = 0x99;
+    CHECK(push_frag(&r, mac, 0, 1, msg, sizeof(msg), 0, 1010, NULL) == ESPNOW_REASM_INCOMPLETE);
+    CHECK(r.stats.evicted == 1);
+    mac[0] = 1; //the oldest incomplete one is gone: its next fragment restarts it
+    CHECK(push_frag(&r, mac, 0, 1, msg, sizeof(msg), 1, 1011, NULL) == ESPNOW_REASM_INCOMPLETE);
+    CHECK(r.stats.evicted == 2);
+    CHECK(done->used && done->port == 0 && done->mac[0] == 0xC0);
+
+    //a completed slot survives the timeout until it is released
+    CHECK(espnow_reasm_expire(&r, 1000 + 10 * TIMEOUT) == ESPNOW_REASM_SLOTS - 1);
+    CHECK(done->used);
+    espnow_reasm_release(&r, done);
+
+    //every slot completed and held by the reader: nothing left to take
+    for (uint8_t i = 0; i < ESPNOW_REASM_SLOTS; i++) {
+        mac[0] = (uint8_t)(0x40 + i);
+        CHECK(push_frag(&r, mac, 0, 1, msg, 10, 0, 5000, NULL) == ESPNOW_REASM_COMPLETE);
+    }
+    mac[0] = 0x50;
+    CHECK(push_frag(&r, mac, 0, 1, msg, 10, 0, 5000, NULL) == ESPNOW_REASM_INVALID);
+}
+
+typedef struct {
+    uint8_t mac[6];
+    uint8_t port;
+    uint32_t id;
+    uint32_t len;
+    bool lost;       // at least one fragment never sent
+    int sent;        // fragments sent, duplicates apart
+    bool completed;
+    uint8_t data[ESPNOW_REASM_MAX_SIZE];
+} message_t;
+
+typedef struct {
+    uint8_t msg;
+    uint8_t idx;
+} fragment_t;
+
+/**
+ * Rounds of up to ESPNOW_REASM_SLOTS messages from different peers sent at
+ * once, fragments shuffled, ~25% duplicated and ~3% lost: every message
+ * with all its fragments completes with the right content, the others time
+ * out, and nothing is evicted.
+ */
+static void test_shuffled_stress(void) {
+    static espnow_reasm_t r;
+    static message_t msgs[ESPNOW_REASM_SLOTS];
+    static fragment_t frags[ESPNOW_REASM_SLOTS * ESPNOW_REASM_MAX_FRAGS * 2];
+    espnow_reasm_init(&r, FRAG, TIMEOUT);
+
+    uint32_t now = 0;
+    uint32_t expected_complete = 0;
+    uint32_t expected_lost = 0;
+    int corrupted = 0;
+    for (int round = 0; round < 2000; round++) {
+        int count = 1 + (int)(next_rand() % ESPNOW_REASM_SLOTS);
+        size_t nfrags = 0;
+        for (int m = 0; m < count; m++) {
+            message_t *msg = &msgs[m];
+            memset(msg->mac, 0, sizeof(msg->mac));
+            msg->mac[5] = (uint8_t)(next_rand() % 3); //3 peers...
+            msg->port = (uint8_t)m;                   //...on distinct ports
+            msg->id = (uint32_t)round;
+            msg->len = 1 + next_rand() % ESPNOW_REASM_MAX_SIZE;
+            msg->lost = false;
+            msg->sent = 0;
+            msg->completed = false;
+            fill_message(msg->data, msg->len, next_rand());
+            for (uint8_t idx = 0; idx < frag_count(msg->len); idx++) {
+                if (next_rand() % 100 < 3) {
+                    msg->lost = true;
+                    continue;
+                }
+                frags[nfrags++] = (fragment_t){ (uint8_t)m, idx };
+                msg->sent++;
+                if (next_rand() % 4 == 0) {
+                    frags[nfrags++] = (fragment_t){ (uint8_t)m, idx };
+                }
+            }
+            expected_complete += !msg->lost;
+            expected_lost += msg->lost && msg->sent > 0; //waits in a slot until the timeout
+        }
+        for (size_t i = nfrags; i > 1; i--) {
+            size_t j = next_rand() % i;
+            fragment_t tmp = frags[i - 1];
+            frags[i - 1] = frags[j];
+            frags[j] = tmp;
+        }
+
+        for (size_t i = 0; i < nfrags; i++) {
+            message_t *msg = &msgs[frags[i].msg];
+            espnow_reasm_slot_t *slot = NULL;
+            espnow_reasm_result_t res = push_frag(&r, msg->mac, msg->port, msg->id, msg->data, msg->len,
+                frags[i].idx, now, &slot);
+            if (res == ESPNOW_REASM_COMPLETE) {
+                corrupted += msg->completed || espnow_reasm_length(&r, slot) != msg->len
+                    || memcmp(slot->buffer, msg->data, msg->len) != 0;
+                msg->completed = true;
+                espnow_reasm_release(&r, slot);
+            }
+            now += 1;
+        }
+        for (int m = 0; m < count; m++) {
+            corrupted += msgs[m].completed == msgs[m].lost;
+        }
+        now += TIMEOUT; //what is left of this round times out
+        espnow_reasm_expire(&r, now);
+    }
+
+    CHECK(corrupted == 0);
+    CHECK(r.stats.completed == expected_complete);
+    CHECK(r.stats.timed_out == expected_lost);
+    CHECK(r.stats.evicted == 0 && r.stats.invalid == 0);
+    printf("%" PRIu32 " messages completed, %" PRIu32 " timed out, %" PRIu32 " duplicate fragments\n",
+        r.stats.completed, r.stats.timed_out, r.stats.duplicates);
+}
+
+int main(void) {
+    test_single();
+    test_invalid();
+    test_keys();
+    test_timeout_eviction();
+    test_shuffled_stress();
+    return TEST_RESULT();
+}
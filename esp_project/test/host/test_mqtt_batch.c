@@ -0,0 +1,320 @@
+#include "host_test.h"
+#include "mqtt_batch.h"
+#include <string.h>
+
+// MQTT telemetry batcher: XOR + zero-run coding round trip, the ring of closed
+// batches under overflow, coalesced topics while offline, and a whole run
+// against a broker stand-in going offline. Every frame carries its topic and
+// a per-topic counter, so the broker can tell what was lost and where.
+
+#define SLOT_SIZE 1024   // Kconfig default of MQTT_TELEMETRY_BATCH_SIZE
+#define TOPICS 10        // more than MQTT_BATCH_SLOTS
+#define COALESCED_FIRST 8
+#define FRAME_HEADER 5   // topic, counter
+
+static uint8_t slots[(MQTT_BATCH_SLOTS + 1) * SLOT_SIZE];
+static uint8_t ring[16 * 1024];
+static mqtt_batch_t batcher;
+static uint32_t rng = 31;
+
+static uint32_t next_rand(void) {
+    rng = rng * 1103515245 + 12345;
+    return rng >> 8;
+}
+
+/** Sensor-like frame: header, then slowly changing values */
+static size_t make_frame(uint8_t *frame, uint8_t topic, uint32_t counter) {
+    size_t len = FRAME_HEADER + 12 + (topic % 3) * 8;
+    frame[0] = topic;
+    memcpy(&frame[1], &counter, sizeof(counter));
+    for (size_t i = FRAME_HEADER; i < len; i++) {
+        frame[i] = (uint8_t)((i * 7 + topic) ^ ((i == FRAME_HEADER) ? counter / 16 : 0));
+    }
+    return len;
+}
+
+/** Decoded body of the oldest batch, popped */
+static size_t take(uint8_t *body, size_t capacity, uint8_t *topic) {
+    static uint8_t payload[SLOT_SIZE];
+    uint32_t seq;
+    size_t len = mqtt_batch_peek(&batcher, payload, sizeof(payload), topic, &seq);
+    if (len == 0) {
+        return 0;
+    }
+    CHECK(mqtt_batch_pop(&batcher, seq));
+    size_t n = mqtt_batch_decode(payload, len, body, capacity);
+    CHECK(n > 0);
+    return n;
+}
+
+static void test_round_trip(void) {
+    static uint8_t body[SLOT_SIZE];
+    uint8_t frame[600];
+    uint8_t topic;
+
+    //similar frames: coded, and much smaller
+    mqtt_batch_init(&batcher, slots, SLOT_SIZE, ring, sizeof(ring), true);
+    uint8_t expected[SLOT_SIZE];
+    size_t expected_len = 0;
+    for (uint32_t c = 0; c < 30; c++) {
+        uint16_t len = (uint16_t)make_frame(frame, 1, c);
+        mqtt_batch_push(&batcher, 1, frame, len, 0, true);
+        memcpy(&expected[expected_len], &len, sizeof(len));
+        memcpy(&expected[expected_len + 2], frame, len);
+        expected_len += 2 + len;
+    }
+    CHECK(mqtt_batch_flush(&batcher, 0, 0, true) == 1);
+    CHECK(batcher.stats.bytes_out * 3 < batcher.stats.bytes_raw);
+    CHECK(take(body, sizeof(body), &topic) == expected_len && topic == 1);
+    CHECK(memcmp(body, expected, expected_len) == 0);
+
+    //zero runs longer than ZRLE_RUN_MAX, frames of other lengths in between
+    mqtt_batch_init(&batcher, slots, SLOT_SIZE, ring, sizeof(ring), true);
+    memset(frame, 0x42, sizeof(frame));
+    mqtt_batch_push(&batcher, 2, frame, 300, 0, true);
+    mqtt_batch_push(&batcher, 2, frame, 300, 0, true); //XOR: 300 zeros
+    mqtt_batch_push(&batcher, 2, frame, 10, 0, true);  //other length: as is
+    memset(frame, 0, sizeof(frame));
+    mqtt_batch_push(&batcher, 2, frame, 280, 0, true); //zeros of its own
+    mqtt_batch_flush(&batcher, 0, 0, true);
+    uint8_t payload[SLOT_SIZE];
+    uint32_t seq;
+    size_t len = mqtt_batch_peek(&batcher, payload, sizeof(payload), &topic, &seq);
+    CHECK(payload[0] & MQTT_BATCH_FLAG_COMPRESSED);
+    size_t n = mqtt_batch_decode(payload, len, body, sizeof(body));
+    CHECK(n == 4 * 2 + 300 + 300 + 10 + 280);
+    size_t offset = 0;
+    const uint8_t *f;
+    uint16_t flen;
+    uint16_t lens[] = { 300, 300, 10, 280 };
+    uint8_t bytes[] = { 0x42, 0x42, 0x42, 0x00 };
+    for (int i = 0; i < 4; i++) {
+        CHECK(mqtt_batch_next(body, n, &offset, &f, &flen) && flen == lens[i]);
+        for (uint16_t k = 0; k < flen; k++) {
+            if (f[k] != bytes[i]) {
+                CHECK(f[k] == bytes[i]);
+                break;
+            }
+        }
+    }
+    CHECK(!mqtt_batch_next(body, n, &offset, &f, &flen));
+
+    //malformed coded payloads are refused
+    CHECK(mqtt_batch_decode(payload, len - 1, body, sizeof(body)) == 0);
+    CHECK(mqtt_batch_decode(payload, len, body, n - 1) == 0);
+    CHECK(mqtt_batch_decode(payload, 3, body, sizeof(body)) == 0);
+    uint8_t zero_run[] = { MQTT_BATCH_FLAG_COMPRESSED, 1, 0, 4, 0, 0x00, 0x00, 0x01, 0x02 };
+    CHECK(mqtt_batch_decode(zero_run, sizeof(zero_run), body, sizeof(body)) == 0);
+
+    //random frames: not smaller coded, sent raw
+    mqtt_batch_init(&batcher, slots, SLOT_SIZE, ring, sizeof(ring), true);
+    for (int i = 0; i < 10; i++) {
+        for (int k = 0; k < 50; k++) {
+            frame[k] = (uint8_t)(next_rand() | 1);
+        }
+        mqtt_batch_push(&batcher, 3, frame, 50, 0, true);
+    }
+    mqtt_batch_flush(&batcher, 0, 0, true);
+    len = mqtt_batch_peek(&batcher, payload, sizeof(payload), &topic, &seq);
+    CHECK(!(payload[0] & MQTT_BATCH_FLAG_COMPRESSED) && len == MQTT_BATCH_HEADER_SIZE + 10 * 52);
+    CHECK(mqtt_batch_decode(payload, len, body, sizeof(body)) == 10 * 52);
+}
+
+/** Full ring: the oldest batches go, the ones left are the newest */
+static void test_ring_overflow(void) {
+    static uint8_t small_ring[1000];
+    mqtt_batch_init(&batcher, slots, SLOT_SIZE, small_ring, sizeof(small_ring), false);
+    uint8_t frame[100];
+    for (uint32_t c = 0; c < 40; c++) {
+        make_frame(frame, 0, c);
+        memset(&frame[FRAME_HEADER], (int)c, sizeof(frame) - FRAME_HEADER);
+        mqtt_batch_push(&batcher, 0, frame, sizeof(frame), c, false);
+        mqtt_batch_flush(&batcher, c, 0, false); //one batch per frame
+    }
+    //each record: ring header 3 + batch header 5 + frame header 2 + 100
+    size_t per_record = 3 + MQTT_BATCH_HEADER_SIZE + 2 + sizeof(frame);
+    CHECK(batcher.records == sizeof(small_ring) / per_record);
+    CHECK(batcher.stats.batches == 40);
+    CHECK(batcher.stats.batches_dropped == 40 - batcher.records);
+    CHECK(batcher.first_seq == batcher.stats.batches_dropped);
+    CHECK(batcher.stats.ring_peak <= sizeof(small_ring));
+
+    //a batch pushed out while being published is not popped twice
+    uint8_t payload[SLOT_SIZE];
+    uint8_t topic;
+    uint32_t seq;
+    CHECK(mqtt_batch_peek(&batcher, payload, sizeof(payload), &topic, &seq) > 0);
+    make_frame(frame, 0, 99);
+    mqtt_batch_push(&batcher, 0, frame, sizeof(frame), 99, false);
+    mqtt_batch_flush(&batcher, 99, 0, false);
+    CHECK(!mqtt_batch_pop(&batcher, seq));
+    CHECK(mqtt_batch_pop(&batcher, seq + 1));
+
+    //what is left: counters in order, up to the newest
+    uint8_t body[SLOT_SIZE];
+    uint32_t last = 0;
+    size_t n;
+    int batches = 0;
+    while ((n = take(body, sizeof(body), &topic)) > 0) {
+        uint32_t counter;
+        memcpy(&counter, &body[2 + 1], sizeof(counter));
+        CHECK(batches == 0 || counter > last);
+        last = counter;
+        batches++;
+    }
+    CHECK(last == 99);
+    CHECK(mqtt_batch_peek(&batcher, payload, sizeof(payload), &topic, &seq) == 0);
+
+    //capacity too small for the oldest batch: nothing copied, still queued
+    mqtt_batch_push(&batcher, 0, frame, sizeof(frame), 0, true);
+    mqtt_batch_flush(&batcher, 0, 0, true);
+    CHECK(mqtt_batch_peek(&batcher, payload, 10, &topic, &seq) == 0 && batcher.records == 1);
+}
+
+static void test_coalesce(void) {
+    mqtt_batch_init(&batcher, slots, SLOT_SIZE, ring, sizeof(ring), true);
+    mqtt_batch_set_topic(&batcher, 5, MQTT_BATCH_COALESCE_LATEST, 0);
+    CHECK(!mqtt_batch_set_topic(&batcher, MQTT_BATCH_TOPICS_MAX, MQTT_BATCH_COALESCE_LATEST, 0));
+    uint8_t frame[64];
+    for (uint32_t c = 0; c < 5; c++) {
+        size_t len = make_frame(frame, 5, c);
+        mqtt_batch_push(&batcher, 5, frame, len, c * 1000, false);
+    }
+    CHECK(mqtt_batch_flush(&batcher, 10000, 100, false) == 0); //kept open offline
+    CHECK(batcher.stats.frames_coalesced == 4);
+    CHECK(mqtt_batch_flush(&batcher, 10000, 100, true) == 1);
+
+    uint8_t body[SLOT_SIZE];
+    uint8_t topic;
+    size_t n = take(body, sizeof(body), &topic);
+    size_t offset = 0;
+    const uint8_t *f;
+    uint16_t flen;
+    CHECK(mqtt_batch_next(body, n, &offset, &f, &flen));
+    uint32_t counter;
+    memcpy(&counter, &f[1], sizeof(counter));
+    CHECK(counter == 4 && offset == n && topic == 5);
+
+    //too large, or out of range: dropped
+    static uint8_t big[SLOT_SIZE];
+    CHECK(!mqtt_batch_push(&batcher, 1, big, SLOT_SIZE - MQTT_BATCH_HEADER_SIZE - 1, 0, true));
+    CHECK(mqtt_batch_push(&batcher, 1, big, SLOT_SIZE - MQTT_BATCH_HEADER_SIZE - 2, 0, true));
+    CHECK(!mqtt_batch_push(&batcher, MQTT_BATCH_TOPICS_MAX, frame, 8, 0, true));
+    CHECK(batcher.stats.frames_dropped == 2);
+}
+
+typedef struct {
+    uint32_t pushed[TOPICS];
+    uint32_t delivered[TOPICS];
+    int64_t last[TOPICS];
+    uint32_t gaps[TOPICS];
+    uint32_t errors;
+} broker_t;
+
+/** Broker stand-in: decodes a published batch and checks its frames */
+static void broker_receive(broker_t *broker, uint8_t topic, const uint8_t *payload, size_t len) {
+    static uint8_t body[SLOT_SIZE];
+    size_t n = mqtt_batch_decode(payload, len, body, sizeof(body));
+    uint16_t count;
+    memcpy(&count, &payload[1], sizeof(count));
+    broker->errors += (n == 0 || topic >= TOPICS);
+    size_t offset = 0;
+    const uint8_t *f;
+    uint16_t flen;
+    uint16_t frames = 0;
+    while (n > 0 && mqtt_batch_next(body, n, &offset, &f, &flen)) {
+        uint32_t counter;
+        memcpy(&counter, &f[1], sizeof(counter));
+        uint8_t expected[64];
+        size_t elen = make_frame(expected, topic, counter);
+        broker->errors += (f[0] != topic || flen != elen || memcmp(f, expected, elen) != 0);
+        broker->errors += ((int64_t)counter <= broker->last[topic]);
+        broker->gaps[topic] += ((int64_t)counter != broker->last[topic] + 1);
+        broker->last[topic] = counter;
+        broker->delivered[topic]++;
+        frames++;
+    }
+    broker->errors += (frames != count || offset != n);
+}
+
+static void publish(broker_t *broker, int burst) {
+    static uint8_t payload[SLOT_SIZE];
+    for (int i = 0; i < burst; i++) {
+        uint8_t topic;
+        uint32_t seq;
+        size_t len = mqtt_batch_peek(&batcher, payload, sizeof(payload), &topic, &seq);
+        if (len == 0) {
+            return;
+        }
+        broker_receive(broker, topic, payload, len);
+        CHECK(mqtt_batch_pop(&batcher, seq));
+    }
+}
+
+/**
+ * 100 s of telemetry, 10 ms steps, flushed and published every 100 ms like
+ * the telemetry task, broker unreachable during `outages`
+ */
+static void run(const char *name, const uint32_t (*outages)[2], int outage_count) {
+    broker_t broker = {0};
+    mqtt_batch_init(&batcher, slots, SLOT_SIZE, ring, sizeof(ring), true);
+    for (uint8_t t = 0; t < TOPICS; t++) {
+        broker.last[t] = -1;
+        mqtt_batch_set_topic(&batcher, t, t >= COALESCED_FIRST ? MQTT_BATCH_COALESCE_LATEST : MQTT_BATCH_DROP_OLDEST, 0);
+    }
+
+    uint32_t now = 0;
+    for (; now < 100000; now += 10) {
+        bool online = true;
+        for (int i = 0; i < outage_count; i++) {
+            online &= !(now >= outages[i][0] && now < outages[i][1]);
+        }
+        for (int k = 0; k < 3; k++) {
+            uint8_t topic = (uint8_t)(next_rand() % TOPICS);
+            uint8_t frame[64];
+            size_t len = make_frame(frame, topic, broker.pushed[topic]++);
+            CHECK(mqtt_batch_push(&batcher, topic, frame, len, now, online));
+        }
+        if (now % 100 == 0) {
+            mqtt_batch_flush(&batcher, now, 100, online);
+            if (online) {
+                publish(&broker, 8);
+            }
+        }
+    }
+    mqtt_batch_flush(&batcher, now, 0, true);
+    publish(&broker, 1000000);
+    CHECK(batcher.records == 0 && batcher.used == 0);
+
+    uint32_t pushed = 0;
+    uint32_t delivered = 0;
+    for (int t = 0; t < TOPICS; t++) {
+        pushed += broker.pushed[t];
+        delivered += broker.delivered[t];
+        //drop-oldest: at most one gap per outage, the newest data always kept
+        if (t < COALESCED_FIRST) {
+            CHECK(broker.gaps[t] <= (uint32_t)outage_count);
+            CHECK(broker.last[t] == (int64_t)broker.pushed[t] - 1);
+        }
+    }
+    uint32_t lost = pushed - delivered - batcher.stats.frames_coalesced;
+    CHECK(broker.errors == 0);
+    CHECK(delivered + batcher.stats.frames_coalesced <= pushed);
+    CHECK(batcher.stats.frames == pushed);
+    CHECK((lost == 0) == (batcher.stats.batches_dropped == 0));
+    CHECK(outage_count > 0 || (lost == 0 && batcher.stats.frames_coalesced == 0));
+    printf("%s: %" PRIu32 " frames, %" PRIu32 " delivered, %" PRIu32 " coalesced, %" PRIu32
+        " lost in %" PRIu32 " dropped batches, coded %.0f%% of raw, ring peak %zu\n",
+        name, pushed, delivered, batcher.stats.frames_coalesced, lost, batcher.stats.batches_dropped,
+        100.0 * batcher.stats.bytes_out / batcher.stats.bytes_raw, batcher.stats.ring_peak);
+}
+
+int main(void) {
+    test_round_trip();
+    test_ring_overflow();
+    test_coalesce();
+    run("always online", NULL, 0);
+    const uint32_t outages[][2] = { { 20000, 40000 }, { 60000, 61000 } };
+    run("two outages", outages, 2);
+    return TEST_RESULT();
+}
@@ -0,0 +1,173 @@
+#include "host_test.h"
+#include "mqtt_cmd.h"
+#include <string.h>
+
+// MQTT command payloads: binary round trip of every command, size checks,
+// and the in-place JSON reader (field order, numbers, escapes, malformed
+// input). Garbage input must only ever give an error.
+
+static mqtt_cmd_status_t json(const char *text, mqtt_cmd_t *cmd) {
+    memset(cmd, 0xAA, sizeof(*cmd));
+    return mqtt_cmd_parse_json(text, strlen(text), cmd);
+}
+
+static void test_bin_round_trip(void) {
+    for (int op = MQTT_CMD_NONE + 1; op < MQTT_CMD_MAX; op++) {
+        const mqtt_cmd_info_t *info = mqtt_cmd_info((mqtt_cmd_op_t)op);
+        CHECK(info != NULL && info->name[0] != '\0');
+        mqtt_cmd_t cmd = { .op = (mqtt_cmd_op_t)op, .value = -1234, .x = 7, .page = 3 };
+        strcpy(cmd.text, "hello");
+        uint8_t buf[64];
+        size_t len = mqtt_cmd_encode_bin(&cmd, buf, sizeof(buf));
+        CHECK(len > 0);
+
+        mqtt_cmd_t out = {0};
+        CHECK(mqtt_cmd_parse_bin(buf, len, &out) == MQTT_CMD_OK);
+        CHECK((int)out.op == op);
+        if (info->arg == MQTT_CMD_ARG_VALUE) {
+            CHECK(len == 3 && out.value == -1234);
+            CHECK(mqtt_cmd_parse_bin(buf, len - 1, &out) == MQTT_CMD_ERR_SIZE);
+            CHECK(mqtt_cmd_encode_bin(&cmd, buf, 2) == 0);
+        } else if (info->arg == MQTT_CMD_ARG_SCREEN) {
+            CHECK(out.x == 7 && out.page == 3 && strcmp(out.text, "hello") == 0);
+        } else {
+            CHECK(len == 1);
+        }
+        buf[len] = 0;
+        CHECK(info->arg == MQTT_CMD_ARG_SCREEN || mqtt_cmd_parse_bin(buf, len + 1, &out) == MQTT_CMD_ERR_SIZE);
+    }
+    CHECK(mqtt_cmd_info(MQTT_CMD_NONE) == NULL && mqtt_cmd_info(MQTT_CMD_MAX) == NULL);
+
+    mqtt_cmd_t out;
+    uint8_t unknown[] = { MQTT_CMD_MAX };
+    CHECK(mqtt_cmd_parse_bin(unknown, 1, &out) == MQTT_CMD_ERR_UNKNOWN);
+    CHECK(mqtt_cmd_parse_bin(unknown, 0, &out) == MQTT_CMD_ERR_SIZE);
+    CHECK(mqtt_cmd_parse_bin(NULL, 1, &out) == MQTT_CMD_ERR_SIZE);
+}
+
+/** Screen text: at most MQTT_CMD_TEXT_MAX, terminated, encoded without terminator */
+static void test_bin_text(void) {
+    uint8_t buf[3 + MQTT_CMD_TEXT_MAX + 1] = { MQTT_CMD_WRITE_SCREEN, 1, 2 };
+    mqtt_cmd_t cmd;
+    CHECK(mqtt_cmd_parse_bin(buf, 3, &cmd) == MQTT_CMD_OK && cmd.text[0] == '\0');
+    CHECK(mqtt_cmd_parse_bin(buf, 2, &cmd) == MQTT_CMD_ERR_SIZE);
+    memset(&buf[3], 'A', MQTT_CMD_TEXT_MAX + 1);
+    CHECK(mqtt_cmd_parse_bin(buf, sizeof(buf), &cmd) == MQTT_CMD_ERR_SIZE);
+    CHECK(mqtt_cmd_parse_bin(buf, sizeof(buf) - 1, &cmd) == MQTT_CMD_OK);
+    CHECK(strlen(cmd.text) == MQTT_CMD_TEXT_MAX);
+
+    //a full text has no terminator in its MQTT_CMD_TEXT_MAX bytes
+    uint8_t out[64];
+    CHECK(mqtt_cmd_encode_bin(&cmd, out, sizeof(out)) == 3 + MQTT_CMD_TEXT_MAX);
+    CHECK(mqtt_cmd_encode_bin(&cmd, out, 3 + MQTT_CMD_TEXT_MAX - 1) == 0);
+    CHECK(memcmp(&out[3], &buf[3], MQTT_CMD_TEXT_MAX) == 0);
+}
+
+static void test_json(void) {
+    mqtt_cmd_t cmd;
+    CHECK(json("{\"command\":\"SET_MOTOR\",\"percent\":40}", &cmd) == MQTT_CMD_OK);
+    CHECK(cmd.op == MQTT_CMD_SET_MOTOR && cmd.value == 40);
+    //arguments first, spaces, unknown keys, fraction
+    CHECK(json(" { \"angle\" : -12.7 , \"id\" : null, \"command\" : \"SET_ANGLE\" } ", &cmd) == MQTT_CMD_OK);
+    CHECK(cmd.op == MQTT_CMD_SET_ANGLE && cmd.value == -12);
+    CHECK(json("{\"command\":\"SERVO_DUTY\",\"duty\":99999999999}", &cmd) == MQTT_CMD_OK);
+    CHECK(cmd.value == INT16_MAX);
+    CHECK(json("{\"command\":\"LED_ON\"}", &cmd) == MQTT_CMD_OK && cmd.op == MQTT_CMD_LED_ON);
+    CHECK(json("{\"command\":\"WRITE_SCREEN\",\"x\":4,\"page\":2,\"text\":\"hi\"}", &cmd) == MQTT_CMD_OK);
+    CHECK(cmd.x == 4 && cmd.page == 2 && strcmp(cmd.text, "hi") == 0);
+
+    //value under another command's key
+    CHECK(json("{\"command\":\"SET_MOTOR\",\"duty\":40}", &cmd) == MQTT_CMD_ERR_FORMAT);
+    CHECK(json("{\"command\":\"SET_MOTOR\",\"percent\":\"40\"}", &cmd) == MQTT_CMD_ERR_FORMAT);
+    CHECK(json("{\"command\":\"FLY\"}", &cmd) == MQTT_CMD_ERR_UNKNOWN);
+    CHECK(json("{\"command\":\"WRITE_SCREEN\",\"x\":4,\"text\":\"hi\"}", &cmd) == MQTT_CMD_ERR_FORMAT);
+}
+
+static void test_json_escapes(void) {
+    mqtt_cmd_t cmd;
+    CHECK(json("{\"command\":\"WRITE_SCREEN\",\"x\":0,\"page\":0,"
+        "\"text\":\"a\\\"b\\\\c\\/d\\ne\\tf\\u0041\\u007e\"}", &cmd) == MQTT_CMD_OK);
+    CHECK(strcmp(cmd.text, "a\"b\\c/d\ne\tfA~") == 0);
+    //escaped command name
+    CHECK(json("{\"command\":\"LED\\u005fOFF\"}", &cmd) == MQTT_CMD_OK && cmd.op == MQTT_CMD_LED_OFF);
+    //an escaped quote does not end the string
+    CHECK(json("{\"command\":\"LED_ON\\\"\"}", &cmd) == MQTT_CMD_ERR_UNKNOWN);
+
+    //not ASCII, NUL, unknown or cut escapes: refused, not passed through
+    const char *bad[] = {
+        "{\"command\":\"WRITE_SCREEN\",\"x\":0,\"page\":0,\"text\":\"\\u00e9\"}",
+        "{\"command\":\"WRITE_SCREEN\",\"x\":0,\"page\":0,\"text\":\"\\u0000\"}",
+        "{\"command\":\"WRITE_SCREEN\",\"x\":0,\"page\":0,\"text\":\"\\q\"}",
+        "{\"command\":\"WRITE_SCREEN\",\"x\":0,\"page\":0,\"text\":\"\\u12\"}",
+        "{\"command\":\"WRITE_SCREEN\",\"x\":0,\"page\":0,\"text\":\"\\u00zz\"}",
+        "{\"command\":\"LED\\x\"}",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        CHECK(json(bad[i], &cmd) == MQTT_CMD_ERR_FORMAT);
+    }
+
+    //long text: cut to MQTT_CMD_TEXT_MAX after decoding
+    char payload[MQTT_CMD_JSON_MAX];
+    int n = snprintf(payload, sizeof(payload), "{\"command\":\"WRITE_SCREEN\",\"x\":0,\"page\":0,\"text\":\"");
+    for (int i = 0; i < MQTT_CMD_TEXT_MAX + 5; i++) {
+        n += snprintf(&payload[n], sizeof(payload) - n, "\\n");
+    }
+    snprintf(&payload[n], sizeof(payload) - n, "\"}");
+    CHECK(json(payload, &cmd) == MQTT_CMD_OK);
+    CHECK(strlen(cmd.text) == MQTT_CMD_TEXT_MAX && cmd.text[0] == '\n');
+    //a bad escape past the cut is still seen
+    snprintf(&payload[n - 2], sizeof(payload) - n + 2, "\\x\"}");
+    CHECK(json(payload, &cmd) == MQTT_CMD_ERR_FORMAT);
+}
+
+static void test_json_malformed(void) {
+    mqtt_cmd_t cmd;
+    const char *bad[] = {
+        "", "{", "}", "[]", "{\"command\"}", "{\"command\":}", "{\"command\":\"LED_ON\"",
+        "{\"command\":\"LED_ON}", "{\"command\":{\"a\":1}}", "{\"command\":[1]}",
+        "{command:\"LED_ON\"}", "{\"command\":-}", "{\"command\":\"LED_ON\\",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        mqtt_cmd_status_t status = json(bad[i], &cmd);
+        CHECK(status == MQTT_CMD_ERR_FORMAT || status == MQTT_CMD_ERR_SIZE);
+    }
+    char big[MQTT_CMD_JSON_MAX + 1];
+    memset(big, ' ', sizeof(big));
+    CHECK(mqtt_cmd_parse_json(big, sizeof(big), &cmd) == MQTT_CMD_ERR_SIZE);
+
+    //not terminated: only `len` bytes are read
+    const char text[] = "{\"command\":\"LED_ON\"}garbage";
+    CHECK(mqtt_cmd_parse_json(text, 20, &cmd) == MQTT_CMD_OK);
+    CHECK(mqtt_cmd_parse_json(text, 19, &cmd) == MQTT_CMD_ERR_FORMAT);
+
+    //random mutations of valid payloads: any status, never a crash
+    const char *seed = "{\"command\":\"WRITE_SCREEN\",\"x\":1,\"page\":2,\"text\":\"a\\\"b\\u0041\"}";
+    uint32_t rng = 7;
+    char buf[128];
+    int ok = 0;
+    for (int i = 0; i < 200000; i++) {
+        size_t len = strlen(seed);
+        memcpy(buf, seed, len);
+        for (int k = 0; k < 3; k++) {
+            rng = rng * 1103515245 + 12345;
+            buf[(rng >> 8) % len] = "{}[]\":,\\u0aZ \x01"[(rng >> 20) % 15];
+        }
+        rng = rng * 1103515245 + 12345;
+        len -= (rng >> 8) % 4;
+        memset(&cmd, 0xAA, sizeof(cmd));
+        if (mqtt_cmd_parse_json(buf, len, &cmd) == MQTT_CMD_OK) {
+            CHECK(cmd.op != MQTT_CMD_WRITE_SCREEN || memchr(cmd.text, '\0', sizeof(cmd.text)) != NULL);
+            ok++;
+        }
+    }
+    printf("JSON mutations: %d of 200000 still valid\n", ok);
+}
+
+int main(void) {
+    test_bin_round_trip();
+    test_bin_text();
+    test_json();
+    test_json_escapes();
+    test_json_malformed();
+    return TEST_RESULT();
+}
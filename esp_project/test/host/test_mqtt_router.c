@@ -0,0 +1,89 @@
+#include "host_test.h"
+#include "mqtt_router.h"
+#include <string.h>
+
+// Topic router: exact matches only, lookups on unterminated topics as
+// esp-mqtt gives them, collisions in the open-addressing table.
+
+static int calls[8];
+
+static void handler(const char *data, size_t len, void *arg) {
+    int i = (int)(intptr_t)arg;
+    calls[i]++;
+    (void)data;
+    (void)len;
+}
+
+static void test_routes(void) {
+    mqtt_router_t router;
+    mqtt_router_init(&router);
+    CHECK(mqtt_router_add(&router, "/commands", handler, (void *)0));
+    CHECK(mqtt_router_add(&router, "/commands/bin", handler, (void *)1));
+    CHECK(mqtt_router_add(&router, "/gamepad", handler, (void *)2));
+    CHECK(router.count == 3);
+
+    //the topic is not terminated in the event
+    const char event[] = "/commands/binXYZ";
+    CHECK(mqtt_router_dispatch(&router, event, 13, "d", 1));
+    CHECK(mqtt_router_dispatch(&router, event, 9, "d", 1));
+    CHECK(!mqtt_router_dispatch(&router, event, 10, "d", 1));
+    CHECK(!mqtt_router_dispatch(&router, event, 16, "d", 1));
+    CHECK(calls[0] == 1 && calls[1] == 1 && calls[2] == 0);
+    CHECK(mqtt_router_find(&router, NULL, 0) == NULL);
+    CHECK(mqtt_router_find(&router, "", 0) == NULL);
+
+    //replace: same slot, count unchanged
+    CHECK(mqtt_router_add(&router, "/gamepad", handler, (void *)3));
+    CHECK(router.count == 3);
+    CHECK(mqtt_router_dispatch(&router, "/gamepad", 8, NULL, 0));
+    CHECK(calls[2] == 0 && calls[3] == 1);
+}
+
+/** Half full at most, so an unknown topic always ends on a free slot */
+static void test_full(void) {
+    static char topics[MQTT_ROUTER_SLOTS][16];
+    mqtt_router_t router;
+    mqtt_router_init(&router);
+    for (int i = 0; i < MQTT_ROUTER_SLOTS; i++) {
+        snprintf(topics[i], sizeof(topics[i]), "/t/%d", i);
+        CHECK(mqtt_router_add(&router, topics[i], handler, (void *)4) == (i < MQTT_ROUTER_SLOTS / 2));
+    }
+    for (int i = 0; i < MQTT_ROUTER_SLOTS; i++) {
+        const mqtt_route_t *route = mqtt_router_find(&router, topics[i], strlen(topics[i]));
+        CHECK((route != NULL) == (i < MQTT_ROUTER_SLOTS / 2));
+        CHECK(route == NULL || route->topic == topics[i]);
+    }
+}
+
+/** Topics all hashing to the same home slot still resolve each to its own route */
+static void test_collisions(void) {
+    static char topics[MQTT_ROUTER_SLOTS / 2][24];
+    int found = 0;
+    uint32_t home = mqtt_router_hash("/a", 2) & (MQTT_ROUTER_SLOTS - 1);
+    for (int n = 0; found < MQTT_ROUTER_SLOTS / 2 && n < 100000; n++) {
+        char t[24];
+        snprintf(t, sizeof(t), "/c/%d", n);
+        if ((mqtt_router_hash(t, strlen(t)) & (MQTT_ROUTER_SLOTS - 1)) == home) {
+            strcpy(topics[found++], t);
+        }
+    }
+    CHECK(found == MQTT_ROUTER_SLOTS / 2);
+
+    mqtt_router_t router;
+    mqtt_router_init(&router);
+    for (int i = 0; i < found; i++) {
+        CHECK(mqtt_router_add(&router, topics[i], handler, (void *)(intptr_t)i));
+    }
+    for (int i = 0; i < found; i++) {
+        const mqtt_route_t *route = mqtt_router_find(&router, topics[i], strlen(topics[i]));
+        CHECK(route != NULL && route->arg == (void *)(intptr_t)i);
+    }
+    CHECK(mqtt_router_find(&router, "/a", 2) == NULL);
+}
+
+int main(void) {
+    test_routes();
+    test_full();
+    test_collisions();
+    return TEST_RESULT();
+}
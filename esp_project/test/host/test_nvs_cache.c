@@ -0,0 +1,259 @@
+#include "host_test.h"
+#include "nvs_lib.h"
+#include "log_lib.h"
+#include "freertos/task.h"
+#include <string.h>
+
+// Write-back cache over a fake NVS (this file), single-threaded: the commit
+// task is not run, flushes are explicit and its wake-ups are counted by the
+// stubs (idf_stubs/). Write failures are injected to check that dirty keys
+// survive them and that the commit task is woken again.
+
+#define FAKE_KEYS 16
+#define FAKE_DATA_MAX 64
+
+typedef struct {
+    char key[NVS_CACHE_KEY_LEN];
+    bool is_record;
+    int value;
+    uint8_t data[FAKE_DATA_MAX];
+    size_t length;
+    uint8_t schema;
+    uint8_t version;
+} fake_entry_t;
+
+static fake_entry_t fake[FAKE_KEYS];
+static int fake_count;
+static int fake_loads;
+static int fake_writes;
+static int fake_fail_writes; // next writes failing
+static int fake_batches;
+
+static fake_entry_t *fake_find(const char *key, bool create) {
+    for (int i = 0; i < fake_count; i++) {
+        if (strcmp(fake[i].key, key) == 0) {
+            return &fake[i];
+        }
+    }
+    if (!create || fake_count >= FAKE_KEYS) {
+        return NULL;
+    }
+    fake_entry_t *e = &fake[fake_count++];
+    memset(e, 0, sizeof(*e));
+    strncpy(e->key, key, sizeof(e->key) - 1);
+    return e;
+}
+
+static esp_err_t fake_write_allowed(void) {
+    if (fake_fail_writes > 0) {
+        fake_fail_writes--;
+        return ESP_FAIL;
+    }
+    fake_writes++;
+    return ESP_OK;
+}
+
+esp_err_t load_nvs_int(const char *key, int *val) {
+    fake_loads++;
+    fake_entry_t *e = fake_find(key, false);
+    if (e == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *val = e->value;
+    return ESP_OK;
+}
+
+esp_err_t save_nvs_int(const char *key, const int value) {
+    esp_err_t err = fake_write_allowed();
+    fake_entry_t *e = (err == ESP_OK) ? fake_find(key, true) : NULL;
+    if (e != NULL) {
+        e->value = value;
+    }
+    return err;
+}
+
+esp_err_t load_nvs_blob(const char *key, uint8_t *val, size_t length) {
+    fake_loads++;
+    fake_entry_t *e = fake_find(key, false);
+    if (e == NULL || e->is_record) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    memcpy(val, e->data, e->length < length ? e->length : length);
+    return ESP_OK;
+}
+
+esp_err_t save_nvs_blob(const char *key, uint8_t *value, size_t length) {
+    esp_err_t err = fake_write_allowed();
+    fake_entry_t *e = (err == ESP_OK) ? fake_find(key, true) : NULL;
+    if (e != NULL) {
+        e->is_record = false;
+        memcpy(e->data, value, length);
+        e->length = length;
+    }
+    return err;
+}
+
+esp_err_t load_nvs_record(const char *key, uint8_t schema, uint8_t version, void *val, size_t length) {
+    fake_loads++;
+    fake_entry_t *e = fake_find(key, false);
+    if (e == NULL || !e->is_record) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (e->schema != schema || e->version != version || e->length != length) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    memcpy(val, e->data, length);
+    return ESP_OK;
+}
+
+esp_err_t save_nvs_record(const char *key, uint8_t schema, uint8_t version, const void *val, size_t length) {
+    esp_err_t err = fake_write_allowed();
+    fake_entry_t *e = (err == ESP_OK) ? fake_find(key, true) : NULL;
+    if (e != NULL) {
+        e->is_record = true;
+        e->schema = schema;
+        e->version = version;
+        memcpy(e->data, val, length);
+        e->length = length;
+    }
+    return err;
+}
+
+esp_err_t nvs_batch_begin() {
+    fake_batches++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_batch_end() {
+    return ESP_OK;
+}
+
+void log_msg_lvl(const log_level_t level, const char *tag, const char *fmt, ...) {
+    (void)level; (void)tag; (void)fmt;
+}
+
+void log_msg(const char *tag, const char *fmt, ...) {
+    (void)tag; (void)fmt;
+}
+
+static TaskHandle_t commit_task(void) {
+    return stub_task_find("nvs_commit_task");
+}
+
+static nvs_cache_stats_t get_stats(void) {
+    nvs_cache_stats_t s;
+    nvs_cache_get_stats(&s);
+    return s;
+}
+
+static void test_int(void) {
+    nvs_cache_stats_t before = get_stats();
+    uint32_t wakeups = stub_task_notifications(commit_task());
+
+    CHECK(nvs_cache_set_int("led", 1) == ESP_OK);
+    CHECK(nvs_cache_set_int("led", 2) == ESP_OK);
+    CHECK(nvs_cache_set_int("led", 2) == ESP_OK);
+    CHECK(get_stats().sets == before.sets + 2);
+    CHECK(get_stats().unchanged == before.unchanged + 1);
+    CHECK(stub_task_notifications(commit_task()) == wakeups + 2);
+    CHECK(fake_find("led", false) == NULL); //nothing on flash before the flush
+
+    //a burst costs one write
+    int writes = fake_writes;
+    CHECK(nvs_cache_flush() == ESP_OK);
+    CHECK(fake_writes == writes + 1);
+    CHECK(fake_find("led", false)->value == 2);
+    CHECK(nvs_cache_flush() == ESP_OK);
+    CHECK(fake_writes == writes + 1); //clean: nothing written
+
+    //reads: flash once, RAM afterwards
+    fake_find("boot", true)->value = 42;
+    int loads = fake_loads;
+    int val = 0;
+    CHECK(nvs_cache_get_int("boot", &val) == ESP_OK && val == 42);
+    CHECK(nvs_cache_get_int("boot", &val) == ESP_OK && val == 42);
+    CHECK(fake_loads == loads + 1);
+    CHECK(nvs_cache_get_int("missing", &val) == ESP_ERR_NOT_FOUND);
+}
+
+/** A failed write keeps the key dirty and wakes the commit task again */
+static void test_write_failure(void) {
+    CHECK(nvs_cache_set_int("speed", 10) == ESP_OK);
+    uint8_t blob[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    CHECK(nvs_cache_set_blob("pattern", blob, sizeof(blob)) == ESP_OK);
+    nvs_cache_stats_t before = get_stats();
+    uint32_t wakeups = stub_task_notifications(commit_task());
+
+    fake_fail_writes = 2;
+    CHECK(nvs_cache_flush() == ESP_FAIL);
+    CHECK(get_stats().write_errors == before.write_errors + 2);
+    CHECK(get_stats().commits == before.commits);
+    CHECK(fake_find("speed", false) == NULL && fake_find("pattern", false) == NULL);
+    CHECK(stub_task_notifications(commit_task()) == wakeups + 1);
+
+    //the retry writes both, and needs no further wake-up
+    int writes = fake_writes;
+    CHECK(nvs_cache_flush() == ESP_OK);
+    CHECK(fake_writes == writes + 2);
+    CHECK(fake_find("speed", false)->value == 10);
+    CHECK(memcmp(fake_find("pattern", false)->data, blob, sizeof(blob)) == 0);
+    CHECK(stub_task_notifications(commit_task()) == wakeups + 1);
+    CHECK(get_stats().commits == before.commits + 1);
+
+    //one of two failing: only that one stays dirty
+    CHECK(nvs_cache_set_int("speed", 11) == ESP_OK);
+    blob[0] = 9;
+    CHECK(nvs_cache_set_blob("pattern", blob, sizeof(blob)) == ESP_OK);
+    fake_fail_writes = 1;
+    CHECK(nvs_cache_flush() == ESP_FAIL);
+    writes = fake_writes;
+    CHECK(nvs_cache_flush() == ESP_OK);
+    CHECK(fake_writes == writes + 1);
+    CHECK(fake_find("speed", false)->value == 11);
+    CHECK(fake_find("pattern", false)->data[0] == 9);
+}
+
+/** The unchanged shortcut needs the same bytes, schema and version */
+static void test_record_layout(void) {
+    uint8_t profile[12];
+    memset(profile, 0x5A, sizeof(profile));
+    CHECK(nvs_cache_set_record("drive", NVS_RECORD_DRIVE_PROFILE, 1, profile, sizeof(profile)) == ESP_OK);
+    CHECK(nvs_cache_flush() == ESP_OK);
+    CHECK(fake_find("drive", false)->version == 1);
+
+    nvs_cache_stats_t before = get_stats();
+    CHECK(nvs_cache_set_record("drive", NVS_RECORD_DRIVE_PROFILE, 1, profile, sizeof(profile)) == ESP_OK);
+    CHECK(get_stats().unchanged == before.unchanged + 1);
+
+    //same bytes, new layout version: written again
+    CHECK(nvs_cache_set_record("drive", NVS_RECORD_DRIVE_PROFILE, 2, profile, sizeof(profile)) == ESP_OK);
+    CHECK(get_stats().sets == before.sets + 1);
+    CHECK(nvs_cache_flush() == ESP_OK);
+    CHECK(fake_find("drive", false)->version == 2);
+
+    //same bytes, other schema
+    CHECK(nvs_cache_set_record("drive", NVS_RECORD_CALIBRATION, 2, profile, sizeof(profile)) == ESP_OK);
+    CHECK(get_stats().sets == before.sets + 2);
+    CHECK(nvs_cache_flush() == ESP_OK);
+    CHECK(fake_find("drive", false)->schema == NVS_RECORD_CALIBRATION);
+
+    //a record of another layout on flash is not cached: the caller keeps its defaults
+    fake_entry_t *old = fake_find("cam", true);
+    old->is_record = true;
+    old->schema = NVS_RECORD_CAMERA_CONFIG;
+    old->version = 1;
+    old->length = 4;
+    uint8_t cfg[4] = {7, 7, 7, 7};
+    CHECK(nvs_cache_get_record("cam", NVS_RECORD_CAMERA_CONFIG, 2, cfg, sizeof(cfg)) != ESP_OK);
+    CHECK(cfg[0] == 7);
+}
+
+int main(void) {
+    CHECK(nvs_cache_get_stats(NULL) == ESP_ERR_INVALID_ARG);
+    CHECK(nvs_cache_init() == ESP_OK);
+    CHECK(nvs_cache_init() == ESP_ERR_INVALID_STATE);
+    test_int();
+    test_write_failure();
+    test_record_layout();
+    return TEST_RESULT();
+}
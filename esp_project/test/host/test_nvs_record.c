@@ -0,0 +1,130 @@
+#include "host_test.h"
+#include "nvs_record.h"
+#include <string.h>
+
+// same shape as wifi_lib's known networks record
+typedef struct {
+    char ssid[33];
+    char password[64];
+    int8_t priority;
+} network_t;
+
+typedef struct {
+    uint8_t count;
+    network_t networks[10];
+} networks_t;
+
+static void test_crc32(void) {
+    // standard CRC-32 check value
+    CHECK(nvs_record_crc32(0, (const uint8_t *)"123456789", 9) == 0xCBF43926);
+    // chainable
+    uint32_t crc = nvs_record_crc32(0, (const uint8_t *)"12345", 5);
+    CHECK(nvs_record_crc32(crc, (const uint8_t *)"6789", 4) == 0xCBF43926);
+    CHECK(nvs_record_crc32(0, NULL, 0) == 0);
+}
+
+static void test_round_trip(void) {
+    networks_t in = { .count = 2 };
+    strcpy(in.networks[0].ssid, "home");
+    strcpy(in.networks[0].password, "secret");
+    in.networks[1].priority = -3;
+
+    uint8_t buf[NVS_RECORD_HEADER_SIZE + sizeof(in)];
+    size_t len = nvs_record_encode(NVS_RECORD_WIFI_NETWORKS, 1, &in, sizeof(in), buf, sizeof(buf));
+    CHECK(len == sizeof(buf));
+    CHECK(buf[0] == 'R' && buf[1] == 'C'); // little-endian magic
+    CHECK(buf[2] == NVS_RECORD_WIFI_NETWORKS && buf[3] == 1);
+    CHECK((buf[4] | (buf[5] << 8)) == sizeof(in));
+
+    networks_t out;
+    memset(&out, 0xAA, sizeof(out));
+    CHECK(nvs_record_decode(buf, len, NVS_RECORD_WIFI_NETWORKS, 1, &out, sizeof(out)) == NVS_RECORD_OK);
+    CHECK(memcmp(&in, &out, sizeof(in)) == 0);
+
+    // empty payload
+    CHECK(nvs_record_encode(NVS_RECORD_CALIBRATION, 1, NULL, 0, buf, sizeof(buf)) == NVS_RECORD_HEADER_SIZE);
+    CHECK(nvs_record_decode(buf, NVS_RECORD_HEADER_SIZE, NVS_RECORD_CALIBRATION, 1, &out, 0) == NVS_RECORD_OK);
+}
+
+static void test_encode_capacity(void) {
+    uint8_t payload[8] = {0};
+    uint8_t buf[NVS_RECORD_HEADER_SIZE + sizeof(payload)];
+    CHECK(nvs_record_encode(NVS_RECORD_CALIBRATION, 1, payload, sizeof(payload), buf, sizeof(buf) - 1) == 0);
+    CHECK(nvs_record_encode(NVS_RECORD_CALIBRATION, 1, payload, NVS_RECORD_MAX_PAYLOAD + 1, buf, (size_t)-1) == 0);
+}
+
+/** Every rejection leaves the output untouched */
+static void check_rejected(const uint8_t *buf, size_t len, uint8_t schema, uint8_t version, size_t expected,
+    nvs_record_status_t status) {
+    uint8_t out[16];
+    memset(out, 0x5A, sizeof(out));
+    CHECK(nvs_record_decode(buf, len, schema, version, out, expected) == status);
+    for (size_t i = 0; i < sizeof(out); i++) {
+        CHECK(out[i] == 0x5A);
+    }
+}
+
+static void test_rejections(void) {
+    const uint8_t payload[6] = { 1, 2, 3, 4, 5, 6 };
+    uint8_t buf[NVS_RECORD_HEADER_SIZE + sizeof(payload)];
+    size_t len = nvs_record_encode(NVS_RECORD_CALIBRATION, 2, payload, sizeof(payload), buf, sizeof(buf));
+    CHECK(len == sizeof(buf));
+
+    check_rejected(buf, NVS_RECORD_HEADER_SIZE - 1, NVS_RECORD_CALIBRATION, 2, sizeof(payload), NVS_RECORD_ERR_SIZE);
+    check_rejected(buf, len - 1, NVS_RECORD_CALIBRATION, 2, sizeof(payload), NVS_RECORD_ERR_SIZE);
+    check_rejected(buf, len, NVS_RECORD_CAMERA_CONFIG, 2, sizeof(payload), NVS_RECORD_ERR_SCHEMA);
+    check_rejected(buf, len, NVS_RECORD_CALIBRATION, 1, sizeof(payload), NVS_RECORD_ERR_VERSION);
+    check_rejected(buf, len, NVS_RECORD_CALIBRATION, 3, sizeof(payload), NVS_RECORD_ERR_VERSION);
+    // layout grew without a version bump
+    check_rejected(buf, len, NVS_RECORD_CALIBRATION, 2, sizeof(payload) + 2, NVS_RECORD_ERR_SIZE);
+
+    uint8_t bad[sizeof(buf)];
+    memcpy(bad, buf, sizeof(buf));
+    bad[0] ^= 0xFF;
+    check_rejected(bad, len, NVS_RECORD_CALIBRATION, 2, sizeof(payload), NVS_RECORD_ERR_MAGIC);
+
+    // any flipped bit of the payload or of the covered header
+    for (size_t bit = 0; bit < sizeof(payload) * 8; bit++) {
+        memcpy(bad, buf, sizeof(buf));
+        bad[NVS_RECORD_HEADER_SIZE + bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        check_rejected(bad, len, NVS_RECORD_CALIBRATION, 2, sizeof(payload), NVS_RECORD_ERR_CRC);
+    }
+    memcpy(bad, buf, sizeof(buf));
+    bad[6] ^= 0x01; // stored CRC itself
+    check_rejected(bad, len, NVS_RECORD_CALIBRATION, 2, sizeof(payload), NVS_RECORD_ERR_CRC);
+}
+
+/**
+ * Codec cost of loading the networks record. On the target the record is one
+ * nvs_get_blob; the per-key layout was 3 NVS reads per network (wifi_lib logs
+ * both load times at boot).
+ */
+static void bench_networks_load(void) {
+    networks_t in = { .count = 10 };
+    for (int i = 0; i < 10; i++) {
+        snprintf(in.networks[i].ssid, sizeof(in.networks[i].ssid), "network-%d", i);
+        snprintf(in.networks[i].password, sizeof(in.networks[i].password), "password-%d", i);
+    }
+    uint8_t buf[NVS_RECORD_HEADER_SIZE + sizeof(in)];
+    size_t len = nvs_record_encode(NVS_RECORD_WIFI_NETWORKS, 1, &in, sizeof(in), buf, sizeof(buf));
+
+    const int runs = 10000;
+    networks_t out;
+    int ok = 0;
+    double start = test_now_us();
+    for (int i = 0; i < runs; i++) {
+        ok += nvs_record_decode(buf, len, NVS_RECORD_WIFI_NETWORKS, 1, &out, sizeof(out)) == NVS_RECORD_OK;
+    }
+    double elapsed = test_now_us() - start;
+    CHECK(ok == runs);
+    printf("networks record (%zu bytes): decode %.2f us\n", len, elapsed / runs);
+}
+
+int main(void) {
+    test_crc32();
+    test_round_trip();
+    test_encode_capacity();
+    test_rejections();
+    bench_networks_load();
+    return TEST_RESULT();
+}
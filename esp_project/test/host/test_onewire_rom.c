@@ -0,0 +1,270 @@
+#include "host_test.h"
+#include "peripherals/onewire_rom.h"
+#include <string.h>
+
+// Maxim CRC8 vectors, and SEARCH ROM against a simulated bus: every device
+// answers with its bit then the complement, the line is their wired-AND,
+// and devices whose bit differs from the master's choice drop out.
+
+#define MAX_DEVICES 32
+
+typedef struct {
+    uint8_t roms[MAX_DEVICES][ONEWIRE_ROM_SIZE];
+    int count;
+    bool active[MAX_DEVICES];
+    int position;       // bit being searched, 0..63
+    bool complement;    // next read is the complement slot
+    int fail_after;     // bit slots before a bus error, -1 = never
+    int slots;
+    int unplug_at;      // position at which every device goes away, -1 = never
+} sim_bus_t;
+
+static uint8_t rom_bit(const uint8_t *rom, int position) {
+    return (rom[position / 8] >> (position % 8)) & 1;
+}
+
+/** Reset pulse + SEARCH ROM command: every device joins in again */
+static void sim_reset(sim_bus_t *bus) {
+    for (int i = 0; i < bus->count; i++) {
+        bus->active[i] = true;
+    }
+    bus->position = 0;
+    bus->complement = false;
+}
+
+static bool sim_read_bit(void *ctx, uint8_t *bit) {
+    sim_bus_t *bus = ctx;
+    if (bus->fail_after >= 0 && bus->slots++ >= bus->fail_after) {
+        return false;
+    }
+    uint8_t line = 1; //pulled up when nobody drives it
+    if (bus->position != bus->unplug_at) {
+        for (int i = 0; i < bus->count; i++) {
+            if (bus->active[i]) {
+                uint8_t b = rom_bit(bus->roms[i], bus->position);
+                line &= bus->complement ? (uint8_t)!b : b;
+            }
+        }
+    }
+    bus->complement = !bus->complement;
+    *bit = line;
+    return true;
+}
+
+static bool sim_write_bit(void *ctx, uint8_t bit) {
+    sim_bus_t *bus = ctx;
+    if (bus->fail_after >= 0 && bus->slots++ >= bus->fail_after) {
+        return false;
+    }
+    for (int i = 0; i < bus->count; i++) {
+        if (bus->active[i] && rom_bit(bus->roms[i], bus->position) != bit) {
+            bus->active[i] = false;
+        }
+    }
+    bus->position++;
+    return true;
+}
+
+static uint32_t rng = 2024;
+
+static uint8_t next_byte(void) {
+    rng = rng * 1103515245 + 12345;
+    return (uint8_t)(rng >> 16);
+}
+
+/** Random DS18B20-like ROM, sharing the first `shared_bits` with `like` */
+static void make_rom(uint8_t *rom, const uint8_t *like, int shared_bits) {
+    rom[0] = 0x28;
+    for (int i = 1; i < ONEWIRE_ROM_SIZE - 1; i++) {
+        rom[i] = next_byte();
+    }
+    for (int p = 0; like != NULL && p < shared_bits && p < 56; p++) {
+        uint8_t mask = (uint8_t)(1u << (p % 8));
+        rom[p / 8] = (uint8_t)((rom[p / 8] & ~mask) | (like[p / 8] & mask));
+    }
+    rom[ONEWIRE_ROM_SIZE - 1] = onewire_crc8(rom, ONEWIRE_ROM_SIZE - 1);
+}
+
+/** Serial numbers are unique: true if device i repeats an earlier one */
+static bool rom_taken(const sim_bus_t *bus, int i) {
+    for (int j = 0; j < i; j++) {
+        if (memcmp(bus->roms[i], bus->roms[j], ONEWIRE_ROM_SIZE) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Search order: LSB first, 0 branch before 1 */
+static int rom_order(const uint8_t *a, const uint8_t *b) {
+    for (int p = 0; p < ONEWIRE_ROM_SIZE * 8; p++) {
+        if (rom_bit(a, p) != rom_bit(b, p)) {
+            return rom_bit(a, p) ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+static void test_crc8(void) {
+    //Maxim AN27 example ROM, CRC 0xA2
+    const uint8_t an27[ONEWIRE_ROM_SIZE] = { 0x02, 0x1C, 0xB8, 0x01, 0x00, 0x00, 0x00, 0xA2 };
+    CHECK(onewire_crc8(an27, 7) == 0xA2);
+    CHECK(onewire_crc8(an27, 8) == 0); //0 over a full valid ROM
+    CHECK(onewire_rom_is_valid(an27));
+
+    //CRC-8/MAXIM check value
+    CHECK(onewire_crc8((const uint8_t *)"123456789", 9) == 0xA1);
+    CHECK(onewire_crc8(NULL, 0) == 0);
+
+    //one flipped bit anywhere is caught
+    uint8_t rom[ONEWIRE_ROM_SIZE];
+    int missed = 0;
+    for (int p = 0; p < ONEWIRE_ROM_SIZE * 8; p++) {
+        memcpy(rom, an27, sizeof(rom));
+        rom[p / 8] ^= (uint8_t)(1u << (p % 8));
+        missed += onewire_rom_is_valid(rom);
+    }
+    CHECK(missed == 0);
+
+    //stuck-low line: all zero has a matching CRC but is refused
+    memset(rom, 0, sizeof(rom));
+    CHECK(onewire_crc8(rom, 7) == 0);
+    CHECK(!onewire_rom_is_valid(rom));
+}
+
+/** Enumerate the bus, compare with its devices in search order */
+static int search_all(sim_bus_t *bus, uint8_t found[][ONEWIRE_ROM_SIZE], onewire_search_result_t *last) {
+    onewire_search_t search;
+    onewire_search_init(&search);
+    int n = 0;
+    for (int guard = 0; guard <= MAX_DEVICES + 1; guard++) {
+        sim_reset(bus);
+        onewire_search_result_t res = onewire_search_next(&search, sim_read_bit, sim_write_bit, bus);
+        *last = res;
+        if (res != ONEWIRE_SEARCH_FOUND) {
+            return n;
+        }
+        memcpy(found[n++], search.rom, ONEWIRE_ROM_SIZE);
+    }
+    return n;
+}
+
+static void test_search(void) {
+    static sim_bus_t bus;
+    uint8_t found[MAX_DEVICES + 2][ONEWIRE_ROM_SIZE];
+    onewire_search_result_t last;
+
+    int bad_runs = 0;
+    for (int run = 0; run < 300; run++) {
+        memset(&bus, 0, sizeof(bus));
+        bus.fail_after = -1;
+        bus.unplug_at = -1;
+        bus.count = 1 + run % MAX_DEVICES;
+        for (int i = 0; i < bus.count; i++) {
+            //half of them close to another device: long common prefixes
+            const uint8_t *like = (i > 0 && (next_byte() & 1)) ? bus.roms[next_byte() % i] : NULL;
+            do {
+                make_rom(bus.roms[i], like, next_byte() % 64);
+            } while (rom_taken(&bus, i));
+        }
+
+        int n = search_all(&bus, found, &last);
+        bool ok = n == bus.count && last == ONEWIRE_SEARCH_DONE;
+        for (int i = 1; ok && i < n; i++) {
+            ok = rom_order(found[i - 1], found[i]) < 0; //strictly increasing: no device twice
+        }
+        for (int i = 0; ok && i < bus.count; i++) {
+            bool seen = false;
+            for (int j = 0; j < n; j++) {
+                seen |= memcmp(found[j], bus.roms[i], ONEWIRE_ROM_SIZE) == 0;
+            }
+            ok = seen;
+        }
+        bad_runs += !ok;
+    }
+    CHECK(bad_runs == 0);
+
+    //two devices differing only on the last bit: the walk branches on the
+    //very last slot, one of them then fails its CRC
+    memset(&bus, 0, sizeof(bus));
+    bus.fail_after = -1;
+    bus.unplug_at = -1;
+    bus.count = 2;
+    make_rom(bus.roms[0], NULL, 0);
+    memcpy(bus.roms[1], bus.roms[0], ONEWIRE_ROM_SIZE);
+    bus.roms[0][7] &= 0x7F;
+    bus.roms[1][7] |= 0x80;
+    onewire_search_t search;
+    onewire_search_init(&search);
+    int found_count = 0;
+    int crc_errors = 0;
+    for (int i = 0; i < 2; i++) {
+        sim_reset(&bus);
+        onewire_search_result_t res = onewire_search_next(&search, sim_read_bit, sim_write_bit, &bus);
+        found_count += res == ONEWIRE_SEARCH_FOUND;
+        crc_errors += res == ONEWIRE_SEARCH_CRC_ERROR;
+        CHECK(memcmp(search.rom, bus.roms[i], ONEWIRE_ROM_SIZE) == 0);
+    }
+    CHECK(found_count == 1 && crc_errors == 1);
+    sim_reset(&bus);
+    CHECK(onewire_search_next(&search, sim_read_bit, sim_write_bit, &bus) == ONEWIRE_SEARCH_DONE);
+}
+
+static void test_errors(void) {
+    static sim_bus_t bus;
+    onewire_search_t search;
+    uint8_t found[MAX_DEVICES + 2][ONEWIRE_ROM_SIZE];
+    onewire_search_result_t last;
+
+    //empty bus
+    memset(&bus, 0, sizeof(bus));
+    bus.fail_after = -1;
+    bus.unplug_at = -1;
+    CHECK(search_all(&bus, found, &last) == 0 && last == ONEWIRE_SEARCH_NO_DEVICE);
+
+    //corrupted ROM: reported, and the search goes on to the next device
+    bus.count = 3;
+    for (int i = 0; i < bus.count; i++) {
+        make_rom(bus.roms[i], NULL, 0);
+        bus.roms[i][1] = (uint8_t)((const uint8_t[]){ 0x00, 0x02, 0x01 })[i]; //LSB first: search order = device order
+        bus.roms[i][7] = onewire_crc8(bus.roms[i], 7);
+    }
+    bus.roms[1][7] ^= 0x01;
+    onewire_search_init(&search);
+    onewire_search_result_t results[4];
+    for (int i = 0; i < 4; i++) {
+        sim_reset(&bus);
+        results[i] = onewire_search_next(&search, sim_read_bit, sim_write_bit, &bus);
+    }
+    CHECK(results[0] == ONEWIRE_SEARCH_FOUND);
+    CHECK(results[1] == ONEWIRE_SEARCH_CRC_ERROR);
+    CHECK(results[2] == ONEWIRE_SEARCH_FOUND);
+    CHECK(memcmp(search.rom, bus.roms[2], ONEWIRE_ROM_SIZE) == 0);
+    CHECK(results[3] == ONEWIRE_SEARCH_DONE);
+
+    //failing read and write slots
+    bus.roms[1][7] ^= 0x01;
+    int wrong = 0;
+    for (int fail = 0; fail < ONEWIRE_ROM_SIZE * 8 * 3; fail++) {
+        bus.fail_after = fail;
+        bus.slots = 0;
+        sim_reset(&bus);
+        onewire_search_init(&search);
+        wrong += onewire_search_next(&search, sim_read_bit, sim_write_bit, &bus) != ONEWIRE_SEARCH_BUS_ERROR;
+    }
+    CHECK(wrong == 0);
+
+    //devices gone in the middle of the walk
+    bus.fail_after = -1;
+    bus.unplug_at = 20;
+    sim_reset(&bus);
+    onewire_search_init(&search);
+    CHECK(onewire_search_next(&search, sim_read_bit, sim_write_bit, &bus) == ONEWIRE_SEARCH_BUS_ERROR);
+}
+
+int main(void) {
+    test_crc8();
+    test_search();
+    test_errors();
+    return TEST_RESULT();
+}
@@ -0,0 +1,254 @@
+#include "host_test.h"
+#include "ota_udp_rx.h"
+#include <stdlib.h>
+#include <string.h>
+
+// UDP OTA receive window against a lossy link: the station side is modelled
+// here from the ack packets only (next expected + selective bitmap), the
+// link drops, duplicates and reorders chunks. The image written in order by
+// the callback must be the image sent.
+
+#define CHUNK 100
+#define IMAGE_MAX (200 * CHUNK)
+
+static uint8_t image[IMAGE_MAX];
+static uint8_t written[IMAGE_MAX];
+static size_t written_len;
+static int fail_write_at = -1; // write call failing, -1 = none
+static int write_calls;
+static uint8_t slots[OTA_UDP_WINDOW * CHUNK];
+
+static uint32_t rng = 2024;
+
+static uint32_t next_rand(void) {
+    rng = rng * 1103515245 + 12345;
+    return rng >> 8;
+}
+
+static int write_image(void *arg, const uint8_t *data, size_t len) {
+    (void)arg;
+    if (write_calls++ == fail_write_at || written_len + len > sizeof(written)) {
+        return -1;
+    }
+    memcpy(&written[written_len], data, len);
+    written_len += len;
+    return 0;
+}
+
+static void start(ota_udp_rx_t *rx, uint32_t image_size) {
+    for (uint32_t i = 0; i < image_size; i++) {
+        image[i] = (uint8_t)next_rand();
+    }
+    written_len = 0;
+    write_calls = 0;
+    fail_write_at = -1;
+    CHECK(ota_udp_rx_init(rx, slots, CHUNK, image_size, write_image, NULL));
+}
+
+static size_t len_of(const ota_udp_rx_t *rx, uint32_t seq) {
+    uint32_t left = rx->image_size - seq * CHUNK;
+    return left < CHUNK ? left : CHUNK;
+}
+
+static ota_udp_rx_result_t push(ota_udp_rx_t *rx, uint32_t seq) {
+    return ota_udp_rx_push(rx, seq, &image[seq * CHUNK], len_of(rx, seq));
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool image_ok(const ota_udp_rx_t *rx) {
+    return written_len == rx->image_size && memcmp(written, image, written_len) == 0;
+}
+
+static void test_init(void) {
+    ota_udp_rx_t rx;
+    CHECK(!ota_udp_rx_init(&rx, NULL, CHUNK, 1000, write_image, NULL));
+    CHECK(!ota_udp_rx_init(&rx, slots, 0, 1000, write_image, NULL));
+    CHECK(!ota_udp_rx_init(&rx, slots, OTA_UDP_CHUNK_MAX + 1, 1000, write_image, NULL));
+    CHECK(!ota_udp_rx_init(&rx, slots, CHUNK, 0, write_image, NULL));
+    CHECK(ota_udp_rx_init(&rx, slots, CHUNK, 1, write_image, NULL) && rx.chunks == 1);
+    CHECK(ota_udp_rx_init(&rx, slots, CHUNK, 2 * CHUNK, write_image, NULL) && rx.chunks == 2);
+    CHECK(ota_udp_rx_init(&rx, slots, CHUNK, 2 * CHUNK + 1, write_image, NULL) && rx.chunks == 3);
+}
+
+/** The last chunk is shorter, and only that length is taken for it */
+static void test_final_short_chunk(void) {
+    ota_udp_rx_t rx;
+    start(&rx, 10 * CHUNK + 37);
+    CHECK(rx.chunks == 11);
+    for (uint32_t seq = 0; seq < 10; seq++) {
+        CHECK(ota_udp_rx_push(&rx, seq, image, CHUNK - 1) == OTA_UDP_RX_INVALID);
+        CHECK(push(&rx, seq) == OTA_UDP_RX_STORED);
+    }
+    CHECK(ota_udp_rx_push(&rx, 10, &image[10 * CHUNK], CHUNK) == OTA_UDP_RX_INVALID);
+    CHECK(ota_udp_rx_push(&rx, 10, &image[10 * CHUNK], 36) == OTA_UDP_RX_INVALID);
+    CHECK(ota_udp_rx_push(&rx, 11, &image[10 * CHUNK], 37) == OTA_UDP_RX_INVALID);
+    CHECK(!ota_udp_rx_complete(&rx));
+    CHECK(push(&rx, 10) == OTA_UDP_RX_STORED);
+    CHECK(ota_udp_rx_complete(&rx));
+    CHECK(image_ok(&rx));
+
+    //short last chunk buffered out of order, written by the chunk before it
+    start(&rx, 3 * CHUNK + 1);
+    CHECK(push(&rx, 3) == OTA_UDP_RX_STORED);
+    CHECK(push(&rx, 0) == OTA_UDP_RX_STORED);
+    CHECK(push(&rx, 2) == OTA_UDP_RX_STORED);
+    CHECK(written_len == CHUNK);
+    CHECK(push(&rx, 1) == OTA_UDP_RX_STORED);
+    CHECK(ota_udp_rx_complete(&rx) && image_ok(&rx));
+    CHECK(rx.stats.reordered == 2);
+}
+
+/** Chunks next + 1 .. next + OTA_UDP_WINDOW - 1 are buffered, not one more */
+static void test_window_edges(void) {
+    ota_udp_rx_t rx;
+    start(&rx, 100 * CHUNK);
+    for (uint32_t seq = 0; seq < 5; seq++) {
+        push(&rx, seq);
+    }
+    const uint32_t next = 5;
+    CHECK(push(&rx, next + OTA_UDP_WINDOW) == OTA_UDP_RX_OUT_OF_WINDOW);
+    CHECK(push(&rx, next + OTA_UDP_WINDOW - 1) == OTA_UDP_RX_STORED);
+    CHECK(rx.mask == 1u << (OTA_UDP_WINDOW - 2)); //highest bit in use
+    CHECK(push(&rx, next + 1) == OTA_UDP_RX_STORED);
+    CHECK(rx.mask == ((1u << (OTA_UDP_WINDOW - 2)) | 1u));
+
+    uint8_t ack[OTA_UDP_ACK_SIZE];
+    CHECK(ota_udp_rx_ack(&rx, 0xA1B2C3D4, OTA_UDP_STATUS_RECEIVING, ack) == OTA_UDP_ACK_SIZE);
+    CHECK(ack[0] == OTA_UDP_ACK);
+    CHECK(get_u32(&ack[1]) == 0xA1B2C3D4);
+    CHECK(get_u32(&ack[5]) == next);
+    CHECK(get_u32(&ack[9]) == rx.mask);
+    CHECK(ack[13] == OTA_UDP_STATUS_RECEIVING && ack[14] == OTA_UDP_WINDOW);
+
+    //every slot of the window full, in reverse order
+    for (uint32_t seq = next + OTA_UDP_WINDOW - 2; seq > next + 1; seq--) {
+        CHECK(push(&rx, seq) == OTA_UDP_RX_STORED);
+    }
+    CHECK(rx.mask == (1u << (OTA_UDP_WINDOW - 1)) - 1);
+    CHECK(written_len == next * CHUNK);
+
+    //the missing one releases the whole window, which slides by as much
+    CHECK(push(&rx, next) == OTA_UDP_RX_STORED);
+    CHECK(rx.next == next + OTA_UDP_WINDOW && rx.mask == 0);
+    CHECK(written_len == (next + OTA_UDP_WINDOW) * CHUNK);
+    CHECK(memcmp(written, image, written_len) == 0);
+    CHECK(push(&rx, rx.next + OTA_UDP_WINDOW - 1) == OTA_UDP_RX_STORED);
+    CHECK(push(&rx, rx.next + OTA_UDP_WINDOW) == OTA_UDP_RX_OUT_OF_WINDOW);
+    CHECK(rx.stats.out_of_window == 2);
+}
+
+static void test_duplicates(void) {
+    ota_udp_rx_t rx;
+    start(&rx, 20 * CHUNK);
+    push(&rx, 0);
+    CHECK(push(&rx, 0) == OTA_UDP_RX_DUPLICATE); //written
+    CHECK(push(&rx, 3) == OTA_UDP_RX_STORED);
+    CHECK(push(&rx, 3) == OTA_UDP_RX_DUPLICATE); //buffered
+    CHECK(rx.stats.duplicates == 2 && rx.stats.received == 2);
+    push(&rx, 1);
+    push(&rx, 2);
+    CHECK(rx.next == 4 && rx.mask == 0);
+    CHECK(push(&rx, 3) == OTA_UDP_RX_DUPLICATE);
+    CHECK(written_len == 4 * CHUNK && memcmp(written, image, written_len) == 0);
+}
+
+static void test_write_error(void) {
+    ota_udp_rx_t rx;
+    start(&rx, 20 * CHUNK);
+    fail_write_at = 0;
+    CHECK(push(&rx, 0) == OTA_UDP_RX_WRITE_ERROR);
+    CHECK(rx.next == 0);
+
+    //failing on a buffered chunk released by the next one
+    start(&rx, 20 * CHUNK);
+    push(&rx, 1);
+    fail_write_at = 1;
+    CHECK(push(&rx, 0) == OTA_UDP_RX_WRITE_ERROR);
+}
+
+typedef struct {
+    uint32_t seq;
+} link_packet_t;
+
+/**
+ * Whole transfers: each round the station sends every chunk of the window
+ * not acked yet, the link loses, duplicates and shuffles them, then the
+ * receiver acks
+ */
+static void transfer(uint32_t image_size, int loss_pct, int dup_pct, bool shuffle) {
+    ota_udp_rx_t rx;
+    start(&rx, image_size);
+    uint32_t acked_next = 0;
+    uint32_t acked_mask = 0;
+    link_packet_t link[4 * OTA_UDP_WINDOW];
+    uint32_t sent = 0;
+    int rounds = 0;
+
+    while (!ota_udp_rx_complete(&rx) && rounds < 10000) {
+        rounds++;
+        int n = 0;
+        for (uint32_t seq = acked_next; seq < acked_next + OTA_UDP_WINDOW && seq < rx.chunks; seq++) {
+            if (seq > acked_next && (acked_mask & (1u << (seq - acked_next - 1)))) {
+                continue; //selectively acked
+            }
+            sent++;
+            if ((int)(next_rand() % 100) < loss_pct) {
+                continue;
+            }
+            link[n++].seq = seq;
+            if ((int)(next_rand() % 100) < dup_pct) {
+                link[n++].seq = seq;
+            }
+        }
+        //stale chunks from earlier rounds, still on the way
+        if (acked_next > 0 && (int)(next_rand() % 100) < dup_pct) {
+            link[n++].seq = next_rand() % acked_next;
+        }
+        if (shuffle) {
+            for (int i = n - 1; i > 0; i--) {
+                int j = (int)(next_rand() % (uint32_t)(i + 1));
+                link_packet_t t = link[i];
+                link[i] = link[j];
+                link[j] = t;
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            ota_udp_rx_result_t res = push(&rx, link[i].seq);
+            CHECK(res == OTA_UDP_RX_STORED || res == OTA_UDP_RX_DUPLICATE);
+        }
+
+        //the ack may be lost too: the station then resends the same window
+        if ((int)(next_rand() % 100) >= loss_pct) {
+            uint8_t ack[OTA_UDP_ACK_SIZE];
+            ota_udp_rx_ack(&rx, 1, OTA_UDP_STATUS_RECEIVING, ack);
+            acked_next = get_u32(&ack[5]);
+            acked_mask = get_u32(&ack[9]);
+        }
+    }
+    CHECK(ota_udp_rx_complete(&rx));
+    CHECK(image_ok(&rx));
+    CHECK(rx.stats.received == rx.chunks);
+    CHECK(rx.stats.out_of_window == 0);
+    printf("%6" PRIu32 " bytes, loss %2d%%, dup %2d%%%s: %4d rounds, %5" PRIu32 " chunks sent for %4" PRIu32
+        ", %4" PRIu32 " reordered, %4" PRIu32 " duplicates\n",
+        image_size, loss_pct, dup_pct, shuffle ? ", shuffled" : "", rounds, sent, rx.chunks,
+        rx.stats.reordered, rx.stats.duplicates);
+}
+
+int main(void) {
+    test_init();
+    test_final_short_chunk();
+    test_window_edges();
+    test_duplicates();
+    test_write_error();
+    transfer(IMAGE_MAX, 0, 0, false);
+    transfer(IMAGE_MAX - 1, 0, 0, true);
+    transfer(IMAGE_MAX, 10, 0, false);
+    transfer(IMAGE_MAX - 55, 20, 10, true);
+    transfer(CHUNK / 2, 30, 30, true);
+    transfer(7 * CHUNK + 1, 50, 20, true);
+    return TEST_RESULT();
+}
@@ -0,0 +1,244 @@
+#include "host_test.h"
+#include "ssd1306_fb.h"
+#include <string.h>
+
+// SSD1306 shadow framebuffer against a model of the controller: 40k random
+// draws, flushed at random points. Each span is turned into the I2C
+// transactions screen_task sends, replayed into a shadow GDDRAM (horizontal
+// addressing, column/page window), which must then match the framebuffer.
+// A plain array, drawn the same way with its own clipping, checks the draws.
+
+#define W SSD1306_FB_WIDTH
+#define PAGES SSD1306_FB_PAGES
+#define I2C_ADDR 0x3C
+#define DRAWS 40000
+
+typedef struct {
+    uint8_t ram[PAGES * W];
+    uint8_t col_start, col_end, page_start, page_end;
+    uint8_t col, page;
+    uint32_t bus_bytes;
+    uint32_t errors;    // unknown commands or control bytes
+} gddram_t;
+
+static ssd1306_fb_t fb;
+static gddram_t screen;
+static uint8_t reference[PAGES * W];
+static uint32_t rng = 4242;
+
+static uint32_t next_rand(void) {
+    rng = rng * 1103515245 + 12345;
+    return rng >> 8;
+}
+
+static void model_commands(gddram_t *m, const uint8_t *cmd, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if ((cmd[i] == 0x21 || cmd[i] == 0x22) && i + 2 < len) {
+            uint8_t start = cmd[i + 1];
+            uint8_t end = cmd[i + 2];
+            if (cmd[i] == 0x21) {
+                m->col_start = m->col = start & 0x7F;
+                m->col_end = end & 0x7F;
+            } else {
+                m->page_start = m->page = start & 0x07;
+                m->page_end = end & 0x07;
+            }
+            i += 2;
+        } else {
+            m->errors++;
+        }
+    }
+}
+
+/** Horizontal addressing: column first, wrapping inside the window */
+static void model_data(gddram_t *m, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        m->ram[m->page * W + m->col] = data[i];
+        if (m->col == m->col_end) {
+            m->col = m->col_start;
+            m->page = (m->page == m->page_end) ? m->page_start : m->page + 1;
+        } else {
+            m->col++;
+        }
+    }
+}
+
+/** One I2C write: [address][control byte][bytes] */
+static void model_transaction(gddram_t *m, const uint8_t *bytes, size_t len) {
+    m->bus_bytes += (uint32_t)len;
+    if (len < 2 || bytes[0] != I2C_ADDR) {
+        m->errors++;
+    } else if (bytes[1] == 0x00) {
+        model_commands(m, &bytes[2], len - 2);
+    } else if (bytes[1] == 0x40) {
+        model_data(m, &bytes[2], len - 2);
+    } else {
+        m->errors++;
+    }
+}
+
+/** The transactions of ssd1306_send_span */
+static void send_span(const ssd1306_span_t *span, const uint8_t *data) {
+    uint8_t cmd[] = {
+        I2C_ADDR, 0x00,
+        0x21, span->col, (uint8_t)(span->col + span->len - 1),
+        0x22, span->page, span->page,
+    };
+    model_transaction(&screen, cmd, sizeof(cmd));
+    uint8_t frame[2 + W] = { I2C_ADDR, 0x40 };
+    memcpy(&frame[2], data, span->len);
+    model_transaction(&screen, frame, 2 + (size_t)span->len);
+}
+
+/** The longest run of bytes already on screen inside a span */
+static int longest_unchanged(const ssd1306_span_t *span, const uint8_t *data) {
+    int longest = 0;
+    int run = 0;
+    for (int i = 0; i < span->len; i++) {
+        run = (data[i] == screen.ram[span->page * W + span->col + i]) ? run + 1 : 0;
+        longest = (run > longest) ? run : longest;
+    }
+    return longest;
+}
+
+/** Flush as screen_task does, checking every span on the way */
+static int flush(void) {
+    bool forced[PAGES];
+    memcpy(forced, fb.forced, sizeof(forced));
+    ssd1306_span_t span;
+    uint8_t data[W];
+    int spans = 0;
+    while (ssd1306_fb_take_span(&fb, &span, data)) {
+        CHECK(span.page < PAGES && span.len >= 1 && span.col + span.len <= W);
+        if (!forced[span.page]) {
+            //starts and ends on a change, no gap worth a new window inside
+            CHECK(data[0] != screen.ram[span.page * W + span.col]);
+            CHECK(data[span.len - 1] != screen.ram[span.page * W + span.col + span.len - 1]);
+            CHECK(longest_unchanged(&span, data) < SSD1306_FB_SPAN_OVERHEAD);
+        }
+        send_span(&span, data);
+        spans++;
+        CHECK(spans <= PAGES * W);
+        if (spans > PAGES * W) {
+            break;
+        }
+    }
+    CHECK(!ssd1306_fb_dirty(&fb));
+    CHECK(memcmp(fb.shown, fb.draw, sizeof(fb.draw)) == 0);
+    return spans;
+}
+
+static void reference_write(int page, int x, const uint8_t *data, int len) {
+    for (int i = 0; i < len; i++) {
+        if (page >= 0 && page < PAGES && x + i >= 0 && x + i < W) {
+            reference[page * W + x + i] = data[i];
+        }
+    }
+}
+
+static void random_draw(void) {
+    uint32_t kind = next_rand() % 100;
+    int page = (int)(next_rand() % (PAGES + 2)) - 1;    //some off screen
+    if (kind < 85) {
+        //text-like write, often the same bytes again
+        uint8_t data[24];
+        int len = 1 + (int)(next_rand() % sizeof(data));
+        int x = (int)(next_rand() % (W + 20)) - 10;
+        bool same = next_rand() % 3 == 0 && page >= 0 && page < PAGES;
+        for (int i = 0; i < len; i++) {
+            int col = x + i;
+            data[i] = (same && col >= 0 && col < W) ? reference[page * W + col] : (uint8_t)next_rand();
+        }
+        ssd1306_fb_write(&fb, page, x, data, (size_t)len);
+        reference_write(page, x, data, len);
+    } else if (kind < 97) {
+        uint8_t value = (next_rand() % 2) ? 0x00 : (uint8_t)next_rand();
+        ssd1306_fb_fill_page(&fb, page, value);
+        if (page >= 0 && page < PAGES) {
+            memset(&reference[page * W], value, W);
+        }
+    } else if (kind < 99) {
+        uint8_t value = (next_rand() % 2) ? 0x00 : 0xFF;
+        ssd1306_fb_fill(&fb, value);
+        memset(reference, value, sizeof(reference));
+    } else {
+        //failed send: the screen holds anything, the next flush sends it all
+        for (size_t i = 0; i < 64; i++) {
+            screen.ram[next_rand() % sizeof(screen.ram)] = (uint8_t)next_rand();
+        }
+        ssd1306_fb_invalidate(&fb);
+    }
+}
+
+static void test_random_draws(void) {
+    ssd1306_fb_init(&fb);
+    memset(&screen, 0, sizeof(screen));
+    for (size_t i = 0; i < sizeof(screen.ram); i++) {
+        screen.ram[i] = (uint8_t)next_rand(); //power-on content
+    }
+    memset(reference, 0, sizeof(reference));
+
+    //first flush: the whole screen, one span per page
+    CHECK(flush() == PAGES);
+    CHECK(memcmp(screen.ram, fb.draw, sizeof(fb.draw)) == 0);
+
+    int flushes = 1;
+    int mismatches = 0;
+    for (int i = 0; i < DRAWS; i++) {
+        random_draw();
+        if (next_rand() % 8 == 0 || i == DRAWS - 1) {
+            flush();
+            flushes++;
+            mismatches += memcmp(screen.ram, fb.draw, sizeof(fb.draw)) != 0;
+            mismatches += memcmp(reference, fb.draw, sizeof(fb.draw)) != 0;
+        }
+    }
+    CHECK(mismatches == 0);
+    CHECK(screen.errors == 0);
+    CHECK(screen.bus_bytes == fb.stats.bytes_bus);
+    printf("%d draws, %d flushes: %" PRIu32 " spans, %" PRIu32 " data bytes, %" PRIu32
+        " bus bytes (full flushes: %d)\n", DRAWS, flushes, fb.stats.spans, fb.stats.bytes_data,
+        fb.stats.bytes_bus, flushes * SSD1306_FB_FULL_FLUSH_BYTES);
+}
+
+static void test_small_updates(void) {
+    ssd1306_fb_init(&fb);
+    flush();
+    ssd1306_fb_stats_t before = fb.stats;
+
+    //same bytes again: dirty range, but nothing sent
+    uint8_t zeros[5] = {0};
+    ssd1306_fb_write(&fb, 3, 10, zeros, sizeof(zeros));
+    CHECK(ssd1306_fb_dirty(&fb));
+    CHECK(flush() == 0);
+
+    //two changes closer than a window's cost: one span through the gap
+    uint8_t glyph[5] = { 0x7C, 0x12, 0x11, 0x12, 0x7C };
+    ssd1306_fb_write(&fb, 3, 10, glyph, sizeof(glyph));
+    ssd1306_fb_write(&fb, 3, 10 + 5 + SSD1306_FB_SPAN_OVERHEAD - 1, glyph, sizeof(glyph));
+    CHECK(flush() == 1);
+    //and farther: two spans
+    ssd1306_fb_fill_page(&fb, 3, 0);
+    flush();
+    ssd1306_fb_write(&fb, 3, 10, glyph, sizeof(glyph));
+    ssd1306_fb_write(&fb, 3, 10 + 5 + SSD1306_FB_SPAN_OVERHEAD, glyph, sizeof(glyph));
+    CHECK(flush() == 2);
+
+    //clipped at both edges
+    ssd1306_fb_write(&fb, 0, -3, glyph, sizeof(glyph));
+    ssd1306_fb_write(&fb, 7, W - 2, glyph, sizeof(glyph));
+    ssd1306_fb_write(&fb, 8, 0, glyph, sizeof(glyph));
+    ssd1306_fb_write(&fb, 1, -5, glyph, sizeof(glyph));
+    ssd1306_fb_write(&fb, 1, W, glyph, sizeof(glyph));
+    CHECK(flush() == 2);
+    CHECK(fb.draw[0] == 0x12 && fb.draw[1] == 0x7C && fb.draw[2] == 0);
+    CHECK(fb.draw[7 * W + W - 1] == 0x12 && fb.draw[7 * W + W - 2] == 0x7C);
+    CHECK(memcmp(screen.ram, fb.draw, sizeof(fb.draw)) == 0);
+    CHECK(fb.stats.bytes_bus - before.bytes_bus < SSD1306_FB_FULL_FLUSH_BYTES / 4);
+}
+
+int main(void) {
+    test_random_draws();
+    test_small_updates();
+    return TEST_RESULT();
+}
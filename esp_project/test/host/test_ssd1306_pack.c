@@ -0,0 +1,143 @@
+#include "host_test.h"
+#include "ssd1306_pack.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ssd1306_pack_i1 (8x8 block transpose) against ssd1306_pack_i1_pixels, the
+// per-pixel loop the LVGL flush used before, which stays the reference.
+
+#define LCD_W 128
+#define LCD_H 64
+#define STRIDE (LCD_W / 8)
+#define FRAME_SIZE (LCD_W * LCD_H / 8)
+
+static uint32_t rng = 12345;
+
+static uint8_t next_byte(void) {
+    rng = rng * 1103515245 + 12345;
+    return (uint8_t)(rng >> 16);
+}
+
+static void fill(uint8_t *px, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        px[i] = next_byte();
+    }
+}
+
+/** Both versions on the area (x, y, w, h) of the frame px, outputs compared */
+static int same_area(const uint8_t *px, int x, int y, int w, int h) {
+    static uint8_t blocks[FRAME_SIZE];
+    static uint8_t pixels[FRAME_SIZE];
+    const uint8_t *first = &px[y * STRIDE + x / 8];
+    memset(blocks, 0x55, sizeof(blocks));
+    memset(pixels, 0x55, sizeof(pixels));
+    ssd1306_pack_i1(first, STRIDE, w, h, blocks);
+    ssd1306_pack_i1_pixels(first, STRIDE, 0, w, h, pixels);
+    return memcmp(blocks, pixels, (size_t)w * h / 8) == 0;
+}
+
+static void test_layout(void) {
+    uint8_t px[FRAME_SIZE];
+    uint8_t out[FRAME_SIZE];
+
+    //blank frame: nothing drawn, every bit set (SSD1306 drawn = 0)
+    memset(px, 0, sizeof(px));
+    ssd1306_pack_i1(px, STRIDE, LCD_W, LCD_H, out);
+    for (int i = 0; i < FRAME_SIZE; i++) {
+        CHECK(out[i] == 0xFF);
+    }
+
+    //top-left pixel: column 0 of page 0, LSB = top row
+    px[0] = 0x80;
+    ssd1306_pack_i1(px, STRIDE, LCD_W, LCD_H, out);
+    CHECK(out[0] == 0xFE);
+    CHECK(out[1] == 0xFF);
+
+    //bottom-right pixel: last column of the last page, MSB = bottom row
+    memset(px, 0, sizeof(px));
+    px[FRAME_SIZE - 1] = 0x01;
+    ssd1306_pack_i1(px, STRIDE, LCD_W, LCD_H, out);
+    CHECK(out[FRAME_SIZE - 1] == 0x7F);
+    CHECK(out[FRAME_SIZE - 2] == 0xFF);
+
+    //full row 9: bit 1 of every column of page 1
+    memset(px, 0, sizeof(px));
+    memset(&px[9 * STRIDE], 0xFF, STRIDE);
+    ssd1306_pack_i1(px, STRIDE, LCD_W, LCD_H, out);
+    for (int col = 0; col < LCD_W; col++) {
+        CHECK(out[LCD_W + col] == 0xFD);
+        CHECK(out[col] == 0xFF);
+    }
+}
+
+static void test_against_pixels(void) {
+    uint8_t px[FRAME_SIZE];
+    for (int round = 0; round < 8; round++) {
+        fill(px, sizeof(px));
+        CHECK(same_area(px, 0, 0, LCD_W, LCD_H));
+    }
+
+    //every 8-aligned sub-area, as the rounder gives them to the flush
+    fill(px, sizeof(px));
+    int mismatches = 0;
+    for (int y = 0; y < LCD_H; y += 8) {
+        for (int x = 0; x < LCD_W; x += 8) {
+            for (int h = 8; y + h <= LCD_H; h += 8) {
+                for (int w = 8; x + w <= LCD_W; w += 8) {
+                    mismatches += !same_area(px, x, y, w, h);
+                }
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+/** The pixel version of a non-aligned area only writes the area's bits */
+static void test_pixels_partial(void) {
+    uint8_t px[FRAME_SIZE];
+    uint8_t out[LCD_W];
+    memset(px, 0xFF, sizeof(px)); //all drawn
+    memset(out, 0xAA, sizeof(out));
+    ssd1306_pack_i1_pixels(px, STRIDE, 3, 5, 3, out);
+    for (int col = 0; col < 5; col++) {
+        CHECK(out[col] == (0xAA & ~0x07));
+    }
+    CHECK(out[5] == 0xAA);
+}
+
+/** Full frame, the size flushed by the old full render mode */
+static void bench_pack(void) {
+    const int rounds = 20000;
+    static uint8_t px[FRAME_SIZE];
+    static uint8_t out[FRAME_SIZE];
+    fill(px, sizeof(px));
+    volatile uint8_t sink = 0;
+
+    double start = test_now_us();
+    for (int i = 0; i < rounds; i++) {
+        px[i % FRAME_SIZE] ^= 1;
+        ssd1306_pack_i1_pixels(px, STRIDE, 0, LCD_W, LCD_H, out);
+        sink ^= out[i % FRAME_SIZE];
+    }
+    double pixels_us = (test_now_us() - start) / rounds;
+
+    start = test_now_us();
+    for (int i = 0; i < rounds; i++) {
+        px[i % FRAME_SIZE] ^= 1;
+        ssd1306_pack_i1(px, STRIDE, LCD_W, LCD_H, out);
+        sink ^= out[i % FRAME_SIZE];
+    }
+    double blocks_us = (test_now_us() - start) / rounds;
+    (void)sink;
+
+    printf("128x64 frame: pixel loop %.2f us, block transpose %.2f us (x%.1f)\n",
+        pixels_us, blocks_us, blocks_us > 0 ? pixels_us / blocks_us : 0);
+}
+
+int main(void) {
+    test_layout();
+    test_against_pixels();
+    test_pixels_partial();
+    bench_pack();
+    return TEST_RESULT();
+}
@@ -0,0 +1,293 @@
+#include "host_test.h"
+#include "sys_health.h"
+#include "task_load.h"
+#include <string.h>
+
+// task_load against synthetic uxTaskGetSystemState snapshots: a two core
+// scheduler stand-in hands out run time to tasks created and deleted between
+// samples, counters starting close to their wrap. The task section of the
+// health frame is decoded back as the station reads it.
+
+#define CORES 2
+#define SIM_TASKS 64        // task numbers handed out over the run
+#define SAMPLES 2000
+
+typedef struct {
+    bool alive;
+    uint32_t runtime;
+    uint32_t weight;    // share of a core when it runs
+} sim_task_t;
+
+static sim_task_t sim[SIM_TASKS];
+static uint32_t sim_clock;
+static uint32_t rng = 777;
+
+static uint32_t next_rand(void) {
+    rng = rng * 1103515245 + 12345;
+    return rng >> 8;
+}
+
+/** Snapshot of the living tasks, in a shuffled order like the scheduler lists */
+static size_t snapshot(task_load_sample_t *samples) {
+    size_t count = 0;
+    for (uint32_t id = 0; id < SIM_TASKS; id++) {
+        if (sim[id].alive) {
+            samples[count++] = (task_load_sample_t){ .id = id + 1, .runtime = sim[id].runtime };
+        }
+    }
+    for (size_t i = count; i > 1; i--) {
+        size_t j = next_rand() % i;
+        task_load_sample_t tmp = samples[i - 1];
+        samples[i - 1] = samples[j];
+        samples[j] = tmp;
+    }
+    return count;
+}
+
+/** A living task by weight, other than `exclude` (running on the other core) */
+static int pick_task(int exclude) {
+    uint32_t weights = 0;
+    for (int id = 0; id < SIM_TASKS; id++) {
+        weights += (sim[id].alive && id != exclude) ? sim[id].weight : 0;
+    }
+    uint32_t pick = next_rand() % weights;
+    int id = 0;
+    for (;; id++) {
+        uint32_t w = (sim[id].alive && id != exclude) ? sim[id].weight : 0;
+        if (pick < w) {
+            return id;
+        }
+        pick -= w;
+    }
+}
+
+/**
+ * Run both cores for `ticks`, each core giving each tick to a different living
+ * task picked by weight (tasks 0 and 1 are the idle tasks, always alive).
+ * `ran` gets the run time of each task.
+ */
+static void run(uint32_t ticks, uint32_t *ran) {
+    for (uint32_t t = 0; t < ticks; t++) {
+        int running = -1;
+        for (int core = 0; core < CORES; core++) {
+            running = pick_task(running);
+            sim[running].runtime++;
+            ran[running]++;
+        }
+        sim_clock++;
+    }
+}
+
+static void test_first_sample(void) {
+    task_load_t tl;
+    task_load_init(&tl);
+    task_load_sample_t samples[2] = { { 1, 100 }, { 2, 900 } };
+    uint16_t permille[2] = { 42, 42 };
+    CHECK(!task_load_update(&tl, samples, 2, 1000, permille));
+    CHECK(permille[0] == 42 && permille[1] == 42);
+
+    //+250 and +750 over 1000: a quarter and three quarters of a core
+    samples[0].runtime += 250;
+    samples[1].runtime += 750;
+    CHECK(task_load_update(&tl, samples, 2, 2000, permille));
+    CHECK(permille[0] == 250 && permille[1] == 750);
+
+    //no time elapsed: 0, not a division by zero
+    CHECK(task_load_update(&tl, samples, 2, 2000, permille));
+    CHECK(permille[0] == 0 && permille[1] == 0);
+
+    //a task read after the total moved on: clamped to one core
+    samples[0].runtime += 1200;
+    CHECK(task_load_update(&tl, samples, 2, 3000, permille));
+    CHECK(permille[0] == 1000);
+}
+
+/** Counters and total wrap between samples */
+static void test_wrap(void) {
+    task_load_t tl;
+    task_load_init(&tl);
+    task_load_sample_t samples[2] = { { 7, UINT32_MAX - 99 }, { 8, 5 } };
+    uint16_t permille[2];
+    task_load_update(&tl, samples, 2, UINT32_MAX - 499, permille);
+    samples[0].runtime += 400;      //wraps to 300
+    samples[1].runtime += 100;
+    CHECK(samples[0].runtime == 300);
+    CHECK(task_load_update(&tl, samples, 2, 500, permille)); //1000 elapsed
+    CHECK(permille[0] == 400 && permille[1] == 100);
+}
+
+/** Tasks matched by number: deleted, created, reordered between samples */
+static void test_create_delete(void) {
+    task_load_t tl;
+    task_load_init(&tl);
+    task_load_sample_t first[3] = { { 1, 1000 }, { 2, 2000 }, { 3, 3000 } };
+    uint16_t permille[3];
+    task_load_update(&tl, first, 3, 10000, permille);
+
+    //task 2 deleted, task 9 created in its array slot with a small counter
+    task_load_sample_t second[3] = { { 3, 3100 }, { 9, 300 }, { 1, 1200 } };
+    CHECK(task_load_update(&tl, second, 3, 11000, permille));
+    CHECK(permille[0] == 100 && permille[1] == 300 && permille[2] == 200);
+
+    //task 9 deleted and a new one reuses its counter value: still a new task
+    task_load_sample_t third[2] = { { 10, 350 }, { 3, 3200 } };
+    CHECK(task_load_update(&tl, third, 2, 12000, permille));
+    CHECK(permille[0] == 350 && permille[1] == 100);
+}
+
+/** Beyond TASK_LOAD_MAX_TASKS, tasks are not remembered: charged their whole run time */
+static void test_too_many(void) {
+    static task_load_t tl;
+    task_load_sample_t samples[TASK_LOAD_MAX_TASKS + 2];
+    uint16_t permille[TASK_LOAD_MAX_TASKS + 2];
+    for (size_t i = 0; i < TASK_LOAD_MAX_TASKS + 2; i++) {
+        samples[i] = (task_load_sample_t){ (uint32_t)i + 1, 10 };
+    }
+    task_load_init(&tl);
+    task_load_update(&tl, samples, TASK_LOAD_MAX_TASKS + 2, 1000, permille);
+    for (size_t i = 0; i < TASK_LOAD_MAX_TASKS + 2; i++) {
+        samples[i].runtime += 1;
+    }
+    CHECK(task_load_update(&tl, samples, TASK_LOAD_MAX_TASKS + 2, 2000, permille));
+    CHECK(permille[0] == 1 && permille[TASK_LOAD_MAX_TASKS - 1] == 1);
+    CHECK(permille[TASK_LOAD_MAX_TASKS] == 11 && permille[TASK_LOAD_MAX_TASKS + 1] == 11);
+}
+
+/**
+ * Long run against the scheduler stand-in: every load is the exact per-mille
+ * of the run time the task got, and without deletions the loads add up to
+ * the two cores.
+ */
+static void test_simulated(void) {
+    memset(sim, 0, sizeof(sim));
+    sim_clock = UINT32_MAX - 20000;     //wraps early in the run
+    for (int id = 0; id < 6; id++) {
+        sim[id] = (sim_task_t){ .alive = true, .runtime = UINT32_MAX - 5000 * (uint32_t)id, .weight = id < CORES ? 40 : 1 + next_rand() % 20 };
+    }
+
+    static task_load_t tl;
+    task_load_init(&tl);
+    task_load_sample_t samples[SIM_TASKS];
+    uint16_t permille[SIM_TASKS];
+    size_t count = snapshot(samples);
+    task_load_update(&tl, samples, count, sim_clock, permille);
+
+    int wrong = 0;
+    int sums_off = 0;
+    int deleted_runs = 0;
+    int creations = 0;
+    for (int s = 0; s < SAMPLES; s++) {
+        uint32_t ran[SIM_TASKS] = {0};
+        bool deleted = false;
+        uint32_t ticks = 500 + next_rand() % 3000;
+        uint32_t done = 0;
+        //a few creations and deletions happen in the middle of the interval
+        while (done < ticks) {
+            uint32_t step = 1 + next_rand() % (ticks - done);
+            run(step, ran);
+            done += step;
+            uint32_t id = CORES + next_rand() % (SIM_TASKS - CORES);
+            uint32_t event = next_rand() % 10;
+            if (event == 0 && !sim[id].alive && count < TASK_LOAD_MAX_TASKS) {
+                //task numbers are not reused: a slot is created once
+                if (sim[id].runtime == 0 && sim[id].weight == 0) {
+                    sim[id] = (sim_task_t){ .alive = true, .weight = 1 + next_rand() % 20 };
+                    creations++;
+                }
+            } else if (event == 1 && sim[id].alive) {
+                sim[id].alive = false;
+                deleted = true;
+            }
+        }
+
+        count = snapshot(samples);
+        CHECK(task_load_update(&tl, samples, count, sim_clock, permille));
+        uint32_t sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t id = samples[i].id - 1;
+            uint64_t expected = (uint64_t)ran[id] * 1000 / ticks;
+            expected = expected > 1000 ? 1000 : expected;
+            wrong += permille[i] != expected;
+            sum += permille[i];
+        }
+        if (deleted) {
+            deleted_runs++;
+            sums_off += sum > CORES * 1000;
+        } else {
+            //rounding down: at most one per-mille per task
+            sums_off += sum > CORES * 1000 || sum + count < CORES * 1000;
+        }
+    }
+    CHECK(wrong == 0);
+    CHECK(sums_off == 0);
+    CHECK(deleted_runs > 0 && creations > 0);
+    printf("%d samples: %d with deletions, %d tasks created\n", SAMPLES, deleted_runs, creations);
+}
+
+static const uint8_t *decode_u16(const uint8_t *p, uint16_t *v) {
+    *v = (uint16_t)(p[0] | (p[1] << 8));
+    return p + 2;
+}
+
+/** Task section of the health frame, walked as the station reads it */
+static void test_encode(void) {
+    const task_load_info_t infos[] = {
+        { .id = 1, .core = 0, .priority = 0, .state = 1, .stack_hwm = 900, .name = "IDLE0", .name_len = 5 },
+        { .id = 0x1234, .core = 0xFF, .priority = 10, .state = 2, .stack_hwm = 70000, .name = "sys_health_task", .name_len = 15 },
+        { .id = 3, .core = 1, .priority = 5, .state = 3, .stack_hwm = 12, .name = "", .name_len = 0 },
+    };
+    const uint16_t loads[] = { 875, 12, 1000 };
+    uint8_t buf[128];
+    memset(buf, 0xEE, sizeof(buf));
+    size_t len = task_load_encode(infos, loads, 3, buf, sizeof(buf));
+    CHECK(len == 1 + 3 * SYS_HEALTH_TASK_RECORD_SIZE + 5 + 15);
+    CHECK(buf[len] == 0xEE);
+    CHECK(buf[0] == 3);
+
+    const uint8_t *p = &buf[1];
+    for (size_t i = 0; i < 3; i++) {
+        uint16_t id, load, hwm;
+        p = decode_u16(p, &id);
+        CHECK(id == (uint16_t)infos[i].id);
+        CHECK(p[0] == infos[i].core && p[1] == infos[i].priority && p[2] == infos[i].state);
+        p = decode_u16(p + 3, &load);
+        CHECK(load == loads[i]);
+        p = decode_u16(p, &hwm);
+        CHECK(hwm == (infos[i].stack_hwm > UINT16_MAX ? UINT16_MAX : infos[i].stack_hwm));
+        CHECK(p[0] == infos[i].name_len && memcmp(&p[1], infos[i].name, infos[i].name_len) == 0);
+        p += 1 + p[0];
+    }
+    CHECK((size_t)(p - buf) == len);
+
+    //no run time stats: every load unknown
+    task_load_encode(infos, NULL, 3, buf, sizeof(buf));
+    CHECK(buf[1 + 5] == 0xFF && buf[1 + 6] == 0xFF);
+    CHECK(SYS_HEALTH_LOAD_UNKNOWN == 0xFFFF);
+
+    //a record that does not fit is left out with those after it
+    size_t fits_two = 1 + 2 * SYS_HEALTH_TASK_RECORD_SIZE + 5 + 15;
+    CHECK(task_load_encode(infos, loads, 3, buf, fits_two + SYS_HEALTH_TASK_RECORD_SIZE - 1) == fits_two);
+    CHECK(buf[0] == 2);
+    CHECK(task_load_encode(infos, loads, 3, buf, 1) == 1 && buf[0] == 0);
+    CHECK(task_load_encode(infos, loads, 3, buf, 0) == 0);
+
+    //largest section the health frame reserves for
+    task_load_info_t full[TASK_LOAD_MAX_TASKS];
+    uint16_t full_loads[TASK_LOAD_MAX_TASKS] = {0};
+    for (size_t i = 0; i < TASK_LOAD_MAX_TASKS; i++) {
+        full[i] = (task_load_info_t){ .id = (uint32_t)i, .name = "0123456789abcdef", .name_len = 16 };
+    }
+    static uint8_t big[1 + TASK_LOAD_MAX_TASKS * (SYS_HEALTH_TASK_RECORD_SIZE + 16)];
+    CHECK(task_load_encode(full, full_loads, TASK_LOAD_MAX_TASKS, big, sizeof(big)) == sizeof(big));
+    CHECK(big[0] == TASK_LOAD_MAX_TASKS);
+}
+
+int main(void) {
+    test_first_sample();
+    test_wrap();
+    test_create_delete();
+    test_too_many();
+    test_simulated();
+    test_encode();
+    return TEST_RESULT();
+}
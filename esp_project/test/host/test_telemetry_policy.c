@@ -0,0 +1,168 @@
+#include "host_test.h"
+#include "telemetry_policy.h"
+
+// Publishing decisions of the change-driven policy, with synthetic
+// timestamps: deadband, rate limit, heartbeat, and DELTA vs full frame.
+
+static telemetry_policy_t make(int32_t deadband, uint32_t min_ms, uint32_t max_ms, bool delta) {
+    telemetry_policy_config_t cfg = {
+        .deadband = { deadband, deadband, deadband, deadband },
+        .min_interval_ms = min_ms,
+        .max_interval_ms = max_ms,
+        .delta_encoding = delta,
+    };
+    telemetry_policy_t policy;
+    telemetry_policy_init(&policy, &cfg);
+    return policy;
+}
+
+static telemetry_decision_t eval1(telemetry_policy_t *p, int32_t value, uint32_t now_ms) {
+    int16_t deltas[TELEMETRY_POLICY_MAX_VALUES];
+    return telemetry_policy_evaluate(p, &value, 1, now_ms, deltas);
+}
+
+static void test_deadband(void) {
+    telemetry_policy_t p = make(10, 0, 0, false);
+    CHECK(eval1(&p, 2000, 0) == TELEMETRY_SEND_FULL); //first reading always goes out
+    CHECK(eval1(&p, 2010, 100) == TELEMETRY_SKIP);    //|change| == deadband: not enough
+    CHECK(eval1(&p, 1990, 200) == TELEMETRY_SKIP);
+    CHECK(eval1(&p, 2011, 300) == TELEMETRY_SEND_FULL);
+
+    //compared with the last published value, not the last reading: a slow
+    //drift is published once it adds up
+    int sent = 0;
+    for (int i = 1; i <= 30; i++) {
+        sent += eval1(&p, 2011 + i, 300 + i * 100) != TELEMETRY_SKIP;
+    }
+    CHECK(sent == 2);
+
+    //0 = any change, ALWAYS = every reading
+    p = make(0, 0, 0, false);
+    eval1(&p, 5, 0);
+    CHECK(eval1(&p, 5, 1) == TELEMETRY_SKIP);
+    CHECK(eval1(&p, 6, 2) == TELEMETRY_SEND_FULL);
+    p = make(TELEMETRY_DEADBAND_ALWAYS, 0, 0, false);
+    eval1(&p, 5, 0);
+    CHECK(eval1(&p, 5, 1) == TELEMETRY_SEND_FULL);
+
+    //one value over its own deadband is enough
+    telemetry_policy_config_t cfg = { .deadband = { 20, 10 } };
+    telemetry_policy_init(&p, &cfg);
+    int32_t v[2] = { 101300, 2150 };
+    CHECK(telemetry_policy_evaluate(&p, v, 2, 0, NULL) == TELEMETRY_SEND_FULL);
+    v[0] += 15;
+    CHECK(telemetry_policy_evaluate(&p, v, 2, 1, NULL) == TELEMETRY_SKIP);
+    v[1] -= 11;
+    CHECK(telemetry_policy_evaluate(&p, v, 2, 2, NULL) == TELEMETRY_SEND_FULL);
+}
+
+static void test_intervals(void) {
+    //min interval: changes inside it are dropped
+    telemetry_policy_t p = make(0, 500, 0, false);
+    eval1(&p, 1, 1000);
+    CHECK(eval1(&p, 2, 1499) == TELEMETRY_SKIP);
+    CHECK(eval1(&p, 3, 1500) == TELEMETRY_SEND_FULL);
+
+    //heartbeat: a stable value still goes out every max interval, full frame
+    p = make(100, 0, 60000, true);
+    eval1(&p, 42, 0);
+    int beats = 0;
+    for (uint32_t t = 1000; t <= 600000; t += 1000) {
+        telemetry_decision_t d = eval1(&p, 42, t);
+        CHECK(d != TELEMETRY_SEND_DELTA);
+        beats += d == TELEMETRY_SEND_FULL;
+    }
+    CHECK(beats == 10);
+
+    //a change resets the heartbeat
+    p = make(0, 0, 1000, false);
+    eval1(&p, 1, 0);
+    CHECK(eval1(&p, 2, 600) == TELEMETRY_SEND_FULL);
+    CHECK(eval1(&p, 2, 1500) == TELEMETRY_SKIP);
+    CHECK(eval1(&p, 2, 1600) == TELEMETRY_SEND_FULL);
+
+    //millisecond clock wrapping between two readings
+    p = make(0, 500, 1000, false);
+    eval1(&p, 1, UINT32_MAX - 100);
+    CHECK(eval1(&p, 2, UINT32_MAX) == TELEMETRY_SKIP);
+    CHECK(eval1(&p, 2, 400) == TELEMETRY_SEND_FULL); //501 ms later
+    CHECK(eval1(&p, 2, 1000) == TELEMETRY_SKIP);
+    CHECK(eval1(&p, 2, 1400) == TELEMETRY_SEND_FULL); //heartbeat
+}
+
+static void test_delta(void) {
+    telemetry_policy_t p = make(0, 0, 0, true);
+    int16_t deltas[TELEMETRY_POLICY_MAX_VALUES];
+    int32_t v[3] = { 1000, -5, 70000 };
+
+    CHECK(telemetry_policy_evaluate(&p, v, 3, 0, deltas) == TELEMETRY_SEND_FULL);
+    v[0] += 300;
+    v[2] -= 32768;
+    CHECK(telemetry_policy_evaluate(&p, v, 3, 1, deltas) == TELEMETRY_SEND_DELTA);
+    CHECK(deltas[0] == 300 && deltas[1] == 0 && deltas[2] == INT16_MIN);
+
+    //one value out of int16 range: full frame for all of them
+    v[1] += 40000;
+    CHECK(telemetry_policy_evaluate(&p, v, 3, 2, deltas) == TELEMETRY_SEND_FULL);
+    v[1] += INT16_MAX;
+    CHECK(telemetry_policy_evaluate(&p, v, 3, 3, deltas) == TELEMETRY_SEND_DELTA);
+    CHECK(deltas[1] == INT16_MAX);
+
+    //no room for the deltas, or a reading with another shape: full frame
+    v[0]++;
+    CHECK(telemetry_policy_evaluate(&p, v, 3, 4, NULL) == TELEMETRY_SEND_FULL);
+    v[0]++;
+    CHECK(telemetry_policy_evaluate(&p, v, 2, 5, deltas) == TELEMETRY_SEND_FULL);
+
+    //delta encoding off
+    p = make(0, 0, 0, false);
+    eval1(&p, 1, 0);
+    CHECK(eval1(&p, 2, 1) == TELEMETRY_SEND_FULL);
+
+    //summing the deltas on the last full frame gives the reading back
+    p = make(3, 0, 5000, true);
+    int32_t value = 20000;
+    int32_t station = 0;
+    uint32_t rng = 99;
+    int mismatches = 0;
+    for (uint32_t t = 0; t < 200000; t += 100) {
+        rng = rng * 1103515245 + 12345;
+        value += (int32_t)((rng >> 16) % 21) - 10;
+        int16_t d[1];
+        telemetry_decision_t decision = telemetry_policy_evaluate(&p, &value, 1, t, d);
+        if (decision == TELEMETRY_SEND_FULL) {
+            station = value;
+        } else if (decision == TELEMETRY_SEND_DELTA) {
+            station += d[0];
+        }
+        mismatches += (value - station > 3) || (station - value > 3);
+    }
+    CHECK(mismatches == 0);
+}
+
+static void test_stats(void) {
+    telemetry_policy_t p = make(0, 0, 0, true);
+    CHECK(telemetry_policy_suppression_pct(&p) == 0);
+    for (uint32_t t = 0; t < 100; t++) {
+        eval1(&p, (int32_t)(t / 4), t); //a change every 4 readings
+    }
+    CHECK(p.offered == 100 && p.published == 25 && p.deltas == 24);
+    CHECK(telemetry_policy_suppression_pct(&p) == 75);
+
+    //reconfiguring keeps the statistics and forces a full frame
+    telemetry_policy_config_t cfg = p.cfg;
+    cfg.deadband[0] = 1000;
+    telemetry_policy_configure(&p, &cfg);
+    CHECK(eval1(&p, 24, 200) == TELEMETRY_SEND_FULL);
+    CHECK(p.offered == 101);
+    telemetry_policy_reset_stats(&p);
+    CHECK(p.offered == 0 && p.published == 0 && p.deltas == 0);
+}
+
+int main(void) {
+    test_deadband();
+    test_intervals();
+    test_delta();
+    test_stats();
+    return TEST_RESULT();
+}
@@ -0,0 +1,119 @@
+#include "host_test.h"
+#include "vl53l1x_zones.h"
+#include <string.h>
+
+// ROI sequencing of the multi-zone VL53L1X scan: SPAD numbering, zone
+// centers, sweep bookkeeping and the frame decoded by the station.
+
+static void test_spad_index(void) {
+    //UM2555 table corners and the optical center
+    CHECK(vl53l1x_spad_index(0, 0) == 120);
+    CHECK(vl53l1x_spad_index(15, 0) == 0);
+    CHECK(vl53l1x_spad_index(0, 15) == 128);
+    CHECK(vl53l1x_spad_index(15, 15) == 248);
+    CHECK(vl53l1x_spad_index(8, 8) == 199);
+
+    //every cell gets its own SPAD number
+    uint8_t seen[256] = {0};
+    int duplicates = 0;
+    for (uint8_t row = 0; row < VL53L1X_SPAD_GRID; row++) {
+        for (uint8_t col = 0; col < VL53L1X_SPAD_GRID; col++) {
+            duplicates += seen[vl53l1x_spad_index(col, row)]++ != 0;
+        }
+    }
+    CHECK(duplicates == 0);
+}
+
+static void test_init(void) {
+    vl53l1x_zone_seq_t seq;
+    CHECK(!vl53l1x_zone_seq_init(&seq, 0, 1));
+    CHECK(!vl53l1x_zone_seq_init(&seq, 1, 0));
+    CHECK(!vl53l1x_zone_seq_init(&seq, 5, 4)); //zones under 4x4 SPADs
+    CHECK(!vl53l1x_zone_seq_init(NULL, 2, 2));
+
+    //single zone: the whole array around the optical center
+    CHECK(vl53l1x_zone_seq_init(&seq, 1, 1));
+    CHECK(seq.zone_count == 1 && seq.roi_width == 16 && seq.roi_height == 16);
+    CHECK(seq.centers[0] == 199);
+    CHECK(vl53l1x_zone_seq_next_center(&seq) == 199);
+
+    //4x4: 4x4 SPADs per zone, zone n = row * cols + col
+    CHECK(vl53l1x_zone_seq_init(&seq, 4, 4));
+    CHECK(seq.zone_count == 16 && seq.roi_width == 4 && seq.roi_height == 4);
+    CHECK(seq.centers[0] == vl53l1x_spad_index(2, 2));
+    CHECK(seq.centers[3] == vl53l1x_spad_index(14, 2));
+    CHECK(seq.centers[4] == vl53l1x_spad_index(2, 6));
+    CHECK(seq.centers[15] == vl53l1x_spad_index(14, 14));
+
+    //non-square grid
+    CHECK(vl53l1x_zone_seq_init(&seq, 4, 2));
+    CHECK(seq.zone_count == 8 && seq.roi_width == 4 && seq.roi_height == 8);
+    CHECK(seq.centers[5] == vl53l1x_spad_index(6, 12));
+}
+
+static void test_sweep(void) {
+    vl53l1x_zone_seq_t seq;
+    vl53l1x_zone_seq_init(&seq, 2, 2);
+
+    //the center programmed ahead is always the zone after the current one
+    CHECK(vl53l1x_zone_seq_next_center(&seq) == seq.centers[1]);
+    CHECK(!vl53l1x_zone_seq_push(&seq, 100, true));
+    CHECK(vl53l1x_zone_seq_next_center(&seq) == seq.centers[2]);
+    CHECK(!vl53l1x_zone_seq_push(&seq, 200, false));
+    CHECK(!vl53l1x_zone_seq_push(&seq, 300, true));
+    CHECK(vl53l1x_zone_seq_next_center(&seq) == seq.centers[0]);
+    CHECK(vl53l1x_zone_seq_push(&seq, 400, true)); //sweep complete
+    CHECK(seq.current == 0);
+    CHECK(seq.valid_mask == 0x0D);
+    CHECK(seq.distance_mm[1] == 0); //invalid range stored as 0
+    CHECK(seq.distance_mm[3] == 400);
+
+    //the next sweep starts from an empty mask
+    CHECK(!vl53l1x_zone_seq_push(&seq, 150, false));
+    CHECK(seq.valid_mask == 0);
+
+    //4x4: the sixteenth result completes the sweep, with every bit set
+    vl53l1x_zone_seq_init(&seq, 4, 4);
+    int completed = 0;
+    for (int i = 0; i < 16; i++) {
+        completed += vl53l1x_zone_seq_push(&seq, (uint16_t)(i * 10), true);
+    }
+    CHECK(completed == 1);
+    CHECK(seq.valid_mask == 0xFFFF);
+}
+
+static void test_frame(void) {
+    vl53l1x_zone_seq_t seq;
+    vl53l1x_zone_seq_init(&seq, 2, 2);
+    vl53l1x_zone_seq_push(&seq, 0x0102, true);
+    vl53l1x_zone_seq_push(&seq, 0, false);
+    vl53l1x_zone_seq_push(&seq, 0x0304, true);
+    vl53l1x_zone_seq_push(&seq, 0x0506, true);
+
+    uint8_t buf[VL53L1X_ZONE_FRAME_SIZE(VL53L1X_ZONES_MAX)];
+    CHECK(vl53l1x_zone_frame_pack(&seq, 48, buf, VL53L1X_ZONE_FRAME_SIZE(4) - 1) == 0);
+    CHECK(vl53l1x_zone_frame_pack(&seq, 48, NULL, sizeof(buf)) == 0);
+
+    memset(buf, 0xEE, sizeof(buf));
+    size_t size = vl53l1x_zone_frame_pack(&seq, 48, buf, sizeof(buf));
+    const uint8_t expected[] = {
+        2, 2,       //cols, rows
+        0x0D, 0x00, //valid mask
+        48, 0,      //sweep ms
+        0x02, 0x01, 0x00, 0x00, 0x04, 0x03, 0x06, 0x05,
+    };
+    CHECK(size == sizeof(expected) && size == VL53L1X_ZONE_FRAME_SIZE(4));
+    CHECK(memcmp(buf, expected, sizeof(expected)) == 0);
+    CHECK(buf[size] == 0xEE);
+
+    //largest grid still fits an ESP-NOW frame
+    CHECK(VL53L1X_ZONE_FRAME_SIZE(VL53L1X_ZONES_MAX) == 38);
+}
+
+int main(void) {
+    test_spad_index();
+    test_init();
+    test_sweep();
+    test_frame();
+    return TEST_RESULT();
+}
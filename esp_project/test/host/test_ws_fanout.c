@@ -0,0 +1,231 @@
+#include "host_test.h"
+#include "ws_fanout.h"
+#include <string.h>
+
+// WebSocket telemetry fan-out with client stand-ins of different speeds: a
+// client's batch stays in flight for a number of ticks (its send latency),
+// as with httpd_ws_send_data_async. Every record carries its publish number,
+// so each client can check what it got: in order, no duplicate, intact, and
+// every gap announced by the dropped count of the batch that follows it.
+
+#define QUEUE_SIZE 8192  // Kconfig defaults of ws_lib
+#define BATCH_SIZE 2048
+#define RECORDS 100000
+#define RECORDS_PER_TICK 15 // ~1.5 kB per tick: below one batch per tick
+#define RECORD_MAX 200
+
+typedef struct {
+    int fd;
+    uint8_t channels;
+    int latency;            // ticks a batch stays in flight
+    //batch in flight
+    int done_at;
+    size_t in_flight_len;
+    //what came out
+    uint32_t next_batch;
+    int64_t last_id;
+    uint32_t received;
+    uint32_t announced_dropped;
+    uint32_t gaps;
+    uint32_t errors;        // order, content or accounting mismatches
+} client_t;
+
+static ws_fanout_t fanout;
+static uint8_t storage[WS_FANOUT_CLIENTS_MAX * QUEUE_SIZE];
+static uint8_t channel_of[RECORDS];
+static uint32_t rng = 99;
+
+static uint32_t next_rand(void) {
+    rng = rng * 1103515245 + 12345;
+    return rng >> 8;
+}
+
+static bool subscribed(const client_t *c, uint8_t channel) {
+    return (c->channels & (1u << channel)) != 0;
+}
+
+static void publish(uint32_t id) {
+    uint8_t data[RECORD_MAX];
+    uint16_t len = (uint16_t)(sizeof(id) + next_rand() % (RECORD_MAX - sizeof(id)));
+    channel_of[id] = (next_rand() % 4 == 0) ? WS_FANOUT_CHANNEL_LOGS : WS_FANOUT_CHANNEL_SENSORS;
+    memcpy(data, &id, sizeof(id));
+    for (uint16_t i = sizeof(id); i < len; i++) {
+        data[i] = (uint8_t)(id + i);
+    }
+    ws_fanout_publish(&fanout, channel_of[id], data, len);
+}
+
+/** Checks one batch as the client would read it */
+static void receive(client_t *c, const uint8_t *buf, size_t len) {
+    uint32_t seq;
+    uint32_t dropped;
+    memcpy(&seq, &buf[0], sizeof(seq));
+    memcpy(&dropped, &buf[4], sizeof(dropped));
+    c->errors += (seq != c->next_batch);
+    c->next_batch = seq + 1;
+    c->announced_dropped += dropped;
+
+    size_t offset = WS_FANOUT_BATCH_HEADER_SIZE;
+    uint8_t channel;
+    const uint8_t *data;
+    uint16_t data_len;
+    bool first = true;
+    while (ws_fanout_batch_next(buf, len, &offset, &channel, &data, &data_len)) {
+        uint32_t id;
+        memcpy(&id, data, sizeof(id));
+        c->errors += (id >= RECORDS || (int64_t)id <= c->last_id);
+        if (id >= RECORDS) {
+            return;
+        }
+        c->errors += (channel != channel_of[id] || !subscribed(c, channel));
+        for (uint16_t i = sizeof(id); i < data_len; i++) {
+            if (data[i] != (uint8_t)(id + i)) {
+                c->errors++;
+                break;
+            }
+        }
+        //records of its channels skipped since the last one received
+        uint32_t skipped = 0;
+        for (int64_t k = c->last_id + 1; k < id; k++) {
+            skipped += subscribed(c, channel_of[k]);
+        }
+        //drops are oldest first: they all sit before this batch, none inside it
+        c->errors += first ? (skipped != dropped) : (skipped != 0);
+        c->gaps += skipped;
+        first = false;
+        c->last_id = id;
+        c->received++;
+    }
+    c->errors += (offset != len);
+}
+
+/** One telemetry task tick: sends that completed, then a batch per idle client */
+static void tick(client_t *clients, int now) {
+    static uint8_t buf[BATCH_SIZE];
+    for (int slot = 0; slot < WS_FANOUT_CLIENTS_MAX; slot++) {
+        client_t *c = &clients[slot];
+        if (fanout.clients[slot].in_flight && now >= c->done_at) {
+            ws_fanout_sent(&fanout, slot, c->in_flight_len, true);
+        }
+        size_t len = ws_fanout_take_batch(&fanout, slot, buf, sizeof(buf));
+        if (len > 0) {
+            receive(c, buf, len);
+            c->in_flight_len = len;
+            c->done_at = now + c->latency;
+        }
+    }
+}
+
+static void test_clients_table(void) {
+    ws_fanout_init(&fanout, storage, QUEUE_SIZE);
+    for (int fd = 10; fd < 10 + WS_FANOUT_CLIENTS_MAX; fd++) {
+        CHECK(ws_fanout_add(&fanout, fd) == fd - 10);
+    }
+    CHECK(ws_fanout_add(&fanout, 99) == -1 && fanout.rejected == 1);
+    CHECK(ws_fanout_add(&fanout, 11) == 1); //known fd: reset, same slot
+    CHECK(ws_fanout_count(&fanout) == WS_FANOUT_CLIENTS_MAX);
+
+    //a client gone with a batch in flight keeps its slot until the send ends
+    uint8_t rec[8] = {0};
+    uint8_t buf[64];
+    ws_fanout_publish(&fanout, WS_FANOUT_CHANNEL_SENSORS, rec, sizeof(rec));
+    CHECK(ws_fanout_take_batch(&fanout, 2, buf, sizeof(buf)) > 0);
+    CHECK(ws_fanout_take_batch(&fanout, 2, buf, sizeof(buf)) == 0); //in flight
+    CHECK(ws_fanout_remove(&fanout, 12));
+    CHECK(!ws_fanout_remove(&fanout, 12));
+    CHECK(ws_fanout_add(&fanout, 20) == -1);
+    ws_fanout_sent(&fanout, 2, 0, false);
+    CHECK(ws_fanout_add(&fanout, 20) == 2);
+    CHECK(fanout.clients[2].send_errors == 0 && fanout.clients[2].queue.records == 0);
+
+    //channel mask
+    CHECK(ws_fanout_set_channels(&fanout, 20, 1u << WS_FANOUT_CHANNEL_LOGS));
+    CHECK(!ws_fanout_set_channels(&fanout, 77, 0));
+    CHECK(ws_fanout_publish(&fanout, WS_FANOUT_CHANNEL_SENSORS, rec, sizeof(rec)) == WS_FANOUT_CLIENTS_MAX - 1);
+    CHECK(ws_fanout_publish(&fanout, WS_FANOUT_CHANNEL_LOGS, rec, sizeof(rec)) == WS_FANOUT_CLIENTS_MAX);
+    CHECK(ws_fanout_publish(&fanout, 8, rec, sizeof(rec)) == 0);
+}
+
+/** Records larger than a queue or a batch are dropped and accounted */
+static void test_oversized(void) {
+    static uint8_t small[WS_FANOUT_CLIENTS_MAX * 256];
+    static uint8_t big[300];
+    uint8_t buf[128];
+    ws_fanout_init(&fanout, small, 256);
+    int slot = ws_fanout_add(&fanout, 5);
+
+    CHECK(ws_fanout_publish(&fanout, 0, big, sizeof(big)) == 0);
+    CHECK(fanout.clients[slot].dropped == 1);
+    CHECK(ws_fanout_publish(&fanout, 0, big, 200) == 1);
+    CHECK(ws_fanout_publish(&fanout, 0, big, 10) == 1);
+    size_t len = ws_fanout_take_batch(&fanout, slot, buf, sizeof(buf));
+    CHECK(len == WS_FANOUT_BATCH_HEADER_SIZE + WS_FANOUT_RECORD_HEADER_SIZE + 10);
+    uint32_t dropped;
+    memcpy(&dropped, &buf[4], sizeof(dropped));
+    CHECK(dropped == 2);
+    CHECK(fanout.clients[slot].dropped == 2 && fanout.clients[slot].queue.records == 0);
+}
+
+static void test_stream(void) {
+    client_t clients[WS_FANOUT_CLIENTS_MAX] = {
+        { .fd = 1, .channels = WS_FANOUT_CHANNELS_ALL, .latency = 0 },
+        { .fd = 2, .channels = WS_FANOUT_CHANNELS_ALL, .latency = 6 },
+        { .fd = 3, .channels = 1u << WS_FANOUT_CHANNEL_SENSORS, .latency = 2 },
+        { .fd = 4, .channels = 1u << WS_FANOUT_CHANNEL_LOGS, .latency = 40 },
+    };
+    ws_fanout_init(&fanout, storage, QUEUE_SIZE);
+    for (int i = 0; i < WS_FANOUT_CLIENTS_MAX; i++) {
+        clients[i].last_id = -1;
+        CHECK(ws_fanout_add(&fanout, clients[i].fd) == i);
+        ws_fanout_set_channels(&fanout, clients[i].fd, clients[i].channels);
+    }
+
+    double start = test_now_us();
+    int now = 0;
+    for (uint32_t id = 0; id < RECORDS; now++) {
+        for (int k = 0; k < RECORDS_PER_TICK && id < RECORDS; k++) {
+            publish(id++);
+        }
+        tick(clients, now);
+    }
+    //drain
+    for (int left = 1; left > 0 && now < 1000000; now++) {
+        tick(clients, now);
+        left = 0;
+        for (int i = 0; i < WS_FANOUT_CLIENTS_MAX; i++) {
+            left += fanout.clients[i].queue.records > 0 || fanout.clients[i].in_flight;
+        }
+    }
+    double elapsed_us = test_now_us() - start;
+
+    for (int i = 0; i < WS_FANOUT_CLIENTS_MAX; i++) {
+        client_t *c = &clients[i];
+        const ws_fanout_client_t *fc = &fanout.clients[i];
+        uint32_t expected = 0;
+        for (uint32_t id = 0; id < RECORDS; id++) {
+            expected += subscribed(c, channel_of[id]);
+        }
+        CHECK(c->errors == 0);
+        CHECK(fc->queue.records == 0 && fc->queue.used == 0 && !fc->in_flight);
+        CHECK(c->received + fc->dropped == expected);
+        CHECK(c->announced_dropped == fc->dropped);
+        CHECK(c->gaps == fc->dropped);
+        CHECK(fc->queued == expected);
+        CHECK(fc->batches == c->next_batch);
+        CHECK(fc->queue_peak <= QUEUE_SIZE);
+        printf("client %d (latency %2d ticks): %6" PRIu32 " of %6" PRIu32 " records, %6" PRIu32
+            " dropped, %5" PRIu32 " batches, peak %4zu bytes\n",
+            i, c->latency, c->received, expected, fc->dropped, fc->batches, fc->queue_peak);
+    }
+    CHECK(fanout.clients[0].dropped == 0); //keeps up: loses nothing
+    CHECK(fanout.clients[1].dropped > 0 && fanout.clients[3].dropped > 0);
+    printf("%d records to %d clients in %.1f ms (%.2f us per record)\n",
+        RECORDS, WS_FANOUT_CLIENTS_MAX, elapsed_us / 1000, elapsed_us / RECORDS);
+}
+
+int main(void) {
+    test_clients_table();
+    test_oversized();
+    test_stream();
+    return TEST_RESULT();
+}
@@ -0,0 +1,319 @@
+#include "host_test.h"
+#include "zb_bridge.h"
+#include "zb_cmdq.h"
+#include <string.h>
+
+// zb_bridge: device table and attribute cache reuse (least recently seen or
+// updated entry), telemetry payloads, and the reporting configuration driven
+// through zb_cmdq as zigbee_lib does it: Configure Reporting completed by the
+// default response with its TSN, refused entries not asked again until the
+// device rejoins.
+
+#define TIMEOUT_MS 500
+#define ATTEMPTS 2
+#define BACKOFF_MS 100
+#define STATUS_UNSUPPORTED_ATTRIBUTE 0x86
+#define STATUS_UNSUPPORTED_CLUSTER 0xC3
+
+static zb_bridge_t bridge;
+
+static const zb_report_cfg_t profile[] = {
+    { 0x0006, 0x0000, 0x10, 0, 300, 0 },      // on/off
+    { 0x0402, 0x0000, 0x29, 30, 600, 10 },    // temperature
+    { 0x0405, 0x0000, 0x21, 30, 600, 100 },   // humidity
+};
+#define PROFILE_LEN (sizeof(profile) / sizeof(profile[0]))
+
+typedef struct {
+    zb_cmd_t frames[64];
+    uint8_t tsns[64];
+    size_t count;
+    uint8_t next_tsn;
+} fake_stack_t;
+
+static fake_stack_t stack;
+
+static int fake_send(const zb_cmd_t *cmd, void *ctx) {
+    fake_stack_t *s = ctx;
+    s->frames[s->count] = *cmd;
+    s->tsns[s->count] = s->next_tsn;
+    s->count++;
+    return s->next_tsn++;
+}
+
+static void ieee_of(uint16_t n, uint8_t *ieee) {
+    for (int i = 0; i < 8; i++) {
+        ieee[i] = (uint8_t)(0xA0 + i + n);
+    }
+}
+
+static zb_report_attr_t u16_attr(uint16_t attr, uint16_t value, uint8_t *buf) {
+    buf[0] = (uint8_t)value;
+    buf[1] = (uint8_t)(value >> 8);
+    return (zb_report_attr_t){ .attr = attr, .type = 0x21, .value = buf };
+}
+
+static void test_device_lru(void) {
+    zb_bridge_init(&bridge);
+    uint8_t ieee[8];
+    for (uint16_t i = 0; i < ZB_BRIDGE_DEVICES; i++) {
+        ieee_of(i, ieee);
+        CHECK(zb_bridge_device_seen(&bridge, 0x100 + i, ieee, 1000 + i) == i);
+    }
+    CHECK(zb_bridge_device_count(&bridge) == ZB_BRIDGE_DEVICES);
+
+    //the first device keeps reporting: the second one is now the oldest
+    uint8_t buf[2];
+    zb_report_attr_t attr = u16_attr(0x0000, 1, buf);
+    CHECK(zb_bridge_attr_update(&bridge, 0x100, 1, 0x0405, &attr, 2000));
+    CHECK(zb_bridge_attr_update(&bridge, 0x101, 1, 0x0405, &attr, 900));
+    zb_bridge_device_seen(&bridge, 0x101, NULL, 900);
+    CHECK(zb_bridge_device_seen(&bridge, 0x200, NULL, 3000) == 1);
+    CHECK(zb_bridge_device(&bridge, 0x101) == NULL);
+    CHECK(zb_bridge_attr_get(&bridge, 0x101, 1, 0x0405, 0x0000) == NULL);
+    CHECK(zb_bridge_attr_get(&bridge, 0x100, 1, 0x0405, 0x0000) != NULL);
+    CHECK(bridge.stats.devices_evicted == 1);
+    CHECK(zb_bridge_device_count(&bridge) == ZB_BRIDGE_DEVICES);
+
+    //the reused entry does not inherit the attributes (new device, same index)
+    CHECK(zb_bridge_attr_get(&bridge, 0x200, 1, 0x0405, 0x0000) == NULL);
+
+    //rejoin under a new short address: same entry, attributes kept
+    ieee_of(0, ieee);
+    CHECK(zb_bridge_device_seen(&bridge, 0x300, ieee, 3100) == 0);
+    CHECK(zb_bridge_device(&bridge, 0x100) == NULL);
+    CHECK(zb_bridge_attr_get(&bridge, 0x300, 1, 0x0405, 0x0000) != NULL);
+
+    //ages compared across the millisecond clock wrap
+    zb_bridge_init(&bridge);
+    for (uint16_t i = 0; i < ZB_BRIDGE_DEVICES; i++) {
+        zb_bridge_device_seen(&bridge, 0x100 + i, NULL, UINT32_MAX - 100 + i * 10);
+    }
+    zb_bridge_device_seen(&bridge, 0x100, NULL, 5);   //after the wrap: the newest
+    CHECK(zb_bridge_device_seen(&bridge, 0x200, NULL, 6) == 1);
+
+    //left: entry and attributes freed
+    zb_bridge_attr_update(&bridge, 0x102, 1, 0x0405, &attr, 7);
+    zb_bridge_device_left(&bridge, 0x102);
+    CHECK(zb_bridge_device(&bridge, 0x102) == NULL);
+    CHECK(zb_bridge_device_count(&bridge) == ZB_BRIDGE_DEVICES - 1);
+    CHECK(zb_bridge_attr_get(&bridge, 0x102, 1, 0x0405, 0x0000) == NULL);
+}
+
+static void test_attr_lru(void) {
+    zb_bridge_init(&bridge);
+    uint8_t buf[2];
+    uint32_t now = 0;
+    //4 devices x 2 endpoints x 8 attributes fill the cache
+    for (uint16_t dev = 0; dev < 4; dev++) {
+        for (uint8_t ep = 1; ep <= 2; ep++) {
+            for (uint16_t a = 0; a < 8; a++) {
+                zb_report_attr_t attr = u16_attr(a, (uint16_t)(dev * 100 + a), buf);
+                CHECK(zb_bridge_attr_update(&bridge, 0x10 + dev, ep, 0x0402, &attr, now++));
+            }
+        }
+    }
+    CHECK(bridge.stats.attrs_evicted == 0);
+
+    //refresh the oldest one: updated in place, the next oldest goes first
+    zb_report_attr_t attr = u16_attr(0, 4242, buf);
+    CHECK(zb_bridge_attr_update(&bridge, 0x10, 1, 0x0402, &attr, now++));
+    CHECK(bridge.stats.attrs_evicted == 0);
+    attr = u16_attr(0x0100, 1, buf);
+    CHECK(zb_bridge_attr_update(&bridge, 0x20, 1, 0x0402, &attr, now++));
+    CHECK(bridge.stats.attrs_evicted == 1);
+    CHECK(zb_bridge_attr_get(&bridge, 0x10, 1, 0x0402, 1) == NULL);
+    const zb_attr_t *kept = zb_bridge_attr_get(&bridge, 0x10, 1, 0x0402, 0);
+    int32_t value = 0;
+    CHECK(kept != NULL && zb_attr_to_int32(kept, &value) && value == 4242);
+
+    //a stream of new attributes: the cache keeps the 64 most recent ones
+    for (uint16_t a = 0; a < 500; a++) {
+        attr = u16_attr(0x1000 + a, a, buf);
+        zb_bridge_attr_update(&bridge, 0x30 + (a % 5), 1 + (a % 3), 0x0400, &attr, now++);
+    }
+    int found = 0;
+    for (uint16_t a = 0; a < 500; a++) {
+        found += zb_bridge_attr_get(&bridge, 0x30 + (a % 5), 1 + (a % 3), 0x0400, 0x1000 + a) != NULL;
+    }
+    CHECK(found == ZB_BRIDGE_ATTRS);
+    for (uint16_t a = 500 - ZB_BRIDGE_ATTRS; a < 500; a++) {
+        CHECK(zb_bridge_attr_get(&bridge, 0x30 + (a % 5), 1 + (a % 3), 0x0400, 0x1000 + a) != NULL);
+    }
+
+    //not cached: strings, endpoint 0
+    uint8_t str[] = { 3, 'a', 'b', 'c' };
+    zb_report_attr_t text = { .attr = 5, .type = 0x42, .value = str };
+    CHECK(!zb_bridge_attr_update(&bridge, 0x30, 1, 0x0000, &text, now));
+    CHECK(!zb_bridge_attr_update(&bridge, 0x30, 0, 0x0402, &attr, now));
+    CHECK(bridge.stats.attrs_unsupported == 2);
+
+    //signed values widened
+    uint8_t temp[2] = { 0x38, 0xFF };   // -200 (int16)
+    zb_report_attr_t t = { .attr = 0, .type = 0x29, .value = temp };
+    zb_bridge_attr_update(&bridge, 0x30, 1, 0x0402, &t, now);
+    CHECK(zb_attr_to_int32(zb_bridge_attr_get(&bridge, 0x30, 1, 0x0402, 0), &value) && value == -200);
+}
+
+/** Frame layouts decoded by the station (SENSOR_TYPE_ZIGBEE and _DEVICE) */
+static void test_payloads(void) {
+    zb_bridge_init(&bridge);
+    uint8_t on = 1;
+    uint8_t temp[2] = { 0x38, 0xFF };
+    uint8_t str[] = { 1, 'x' };
+    zb_report_attr_t attrs[] = {
+        { .attr = 0x0000, .type = 0x10, .value = &on },
+        { .attr = 0x0005, .type = 0x42, .value = str },     //left out
+        { .attr = 0x0001, .type = 0x29, .value = temp },
+    };
+    uint8_t out[64];
+    size_t len = zb_bridge_report_payload(0x1234, 2, 0x0402, attrs, 3, out, sizeof(out));
+    const uint8_t expected[] = {
+        0x34, 0x12, 2, 0x02, 0x04, 2,
+        0x00, 0x00, 0x10, 1, 1,
+        0x01, 0x00, 0x29, 2, 0x38, 0xFF,
+    };
+    CHECK(len == sizeof(expected) && memcmp(out, expected, len) == 0);
+    CHECK(zb_bridge_report_payload(0x1234, 2, 0x0402, attrs, 3, out, sizeof(expected) - 1) == 0);
+    CHECK(zb_bridge_report_payload(0x1234, 2, 0x0402, &attrs[1], 1, out, sizeof(out)) == 0);
+
+    uint8_t ieee[8];
+    ieee_of(0, ieee);
+    zb_bridge_device_joined(&bridge, 0xBEEF, ieee, 0);
+    zb_bridge_device_payload(&bridge, 0xBEEF, ieee, ZB_DEVICE_JOINED, out);
+    CHECK(out[0] == 0xEF && out[1] == 0xBE && memcmp(&out[2], ieee, 8) == 0);
+    CHECK(out[10] == ZB_DEVICE_JOINED && out[11] == 1);
+}
+
+/** Completion of a Configure Reporting, as report_cfg_done in zigbee_lib */
+static void cfg_done(uint32_t id, zb_cmd_result_t result, uint8_t status, uint32_t latency_ms, void *arg) {
+    (void)id;
+    (void)latency_ms;
+    zb_cfg_result_t cfg = ZB_CFG_FAILED;
+    if (result == ZB_CMD_DELIVERED) {
+        cfg = ZB_CFG_ACCEPTED;
+    } else if (result == ZB_CMD_REJECTED && status != STATUS_UNSUPPORTED_CLUSTER) {
+        cfg = ZB_CFG_REFUSED;
+    }
+    zb_bridge_cfg_result(&bridge, (uint16_t)((uintptr_t)arg >> 8), (uint8_t)(uintptr_t)arg, cfg);
+}
+
+static void push_cfg(zb_cmdq_t *q, uint16_t short_addr, size_t idx, uint32_t now) {
+    zb_cmd_t cmd = {
+        .dst_mode = ZB_DST_SHORT, .addr = short_addr, .ep = 1, .cluster = profile[idx].cluster,
+        .cmd_id = ZB_ZCL_CMD_CONFIG_REPORT, .flags = ZB_CMD_FLAG_PROFILE_WIDE,
+    };
+    cmd.payload_len = (uint8_t)zb_report_cfg_encode(&profile[idx], cmd.payload);
+    CHECK(cmd.payload_len > 0);
+    CHECK(zb_cmdq_submit(q, &cmd, (uint32_t)idx, cfg_done, (void *)(uintptr_t)((uint32_t)short_addr << 8 | idx), now));
+    zb_bridge_cfg_sent(&bridge, short_addr, idx);
+}
+
+/** A report of every profile attribute: entries still to configure are pushed */
+static uint16_t report_all(zb_cmdq_t *q, uint16_t short_addr, uint32_t now) {
+    uint16_t missing = zb_bridge_cfg_missing(&bridge, short_addr, (1u << PROFILE_LEN) - 1);
+    for (size_t i = 0; i < PROFILE_LEN; i++) {
+        if (missing & (1u << i)) {
+            push_cfg(q, short_addr, i, now);
+        }
+    }
+    return missing;
+}
+
+/** The frame sent for (device, profile entry), -1 if none */
+static int frame_of(uint16_t short_addr, size_t idx, size_t from) {
+    for (size_t i = from; i < stack.count; i++) {
+        if (stack.frames[i].addr == short_addr && stack.frames[i].cluster == profile[idx].cluster) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void test_reporting_cfg(void) {
+    zb_cmdq_t q;
+    memset(&stack, 0, sizeof(stack));
+    stack.next_tsn = 250;   //TSNs wrap during the test
+    zb_cmdq_ops_t ops = { .send = fake_send, .ctx = &stack };
+    zb_cmdq_init(&q, &ops, TIMEOUT_MS, ATTEMPTS, BACKOFF_MS);
+    zb_bridge_init(&bridge);
+
+    uint8_t ieee_a[8];
+    uint8_t ieee_b[8];
+    ieee_of(1, ieee_a);
+    ieee_of(2, ieee_b);
+    zb_bridge_device_joined(&bridge, 0x0A0A, ieee_a, 0);
+    zb_bridge_device_joined(&bridge, 0x0B0B, ieee_b, 0);
+    uint32_t now = 0;
+    CHECK(report_all(&q, 0x0A0A, now) == 0x7);
+    CHECK(report_all(&q, 0x0B0B, now) == 0x7);
+    //in flight: not pushed twice
+    CHECK(report_all(&q, 0x0A0A, now) == 0);
+
+    //one in flight per destination: three passes send them all
+    for (int pass = 0; pass < 3; pass++) {
+        zb_cmdq_poll(&q, now, true);
+        size_t sent = stack.count;
+        int a = frame_of(0x0A0A, (size_t)pass, 0);
+        int b = frame_of(0x0B0B, (size_t)pass, 0);
+        CHECK(a >= 0 && b >= 0 && (size_t)a < sent && (size_t)b < sent);
+        zb_report_cfg_t cfg;
+        CHECK(zb_report_cfg_decode(stack.frames[a].payload, stack.frames[a].payload_len, &cfg));
+        CHECK(cfg.attr == profile[pass].attr && cfg.max_interval_s == profile[pass].max_interval_s);
+
+        //the other device's TSN, and a TSN of nothing in flight: unmatched
+        CHECK(!zb_cmdq_response(&q, 0x0A0A, stack.tsns[b], ZB_CMDQ_STATUS_SUCCESS, now));
+        CHECK(!zb_cmdq_response(&q, 0x0A0A, (uint8_t)(stack.tsns[a] + 100), ZB_CMDQ_STATUS_SUCCESS, now));
+
+        //device A accepts all; B refuses humidity, has no temperature cluster on ep 1
+        CHECK(zb_cmdq_response(&q, 0x0A0A, stack.tsns[a], ZB_CMDQ_STATUS_SUCCESS, now + 10));
+        uint8_t status = ZB_CMDQ_STATUS_SUCCESS;
+        if (pass == 1) {
+            status = STATUS_UNSUPPORTED_CLUSTER;
+        } else if (pass == 2) {
+            status = STATUS_UNSUPPORTED_ATTRIBUTE;
+        }
+        CHECK(zb_cmdq_response(&q, 0x0B0B, stack.tsns[b], status, now + 10));
+        now += 20;
+    }
+    CHECK(q.stats.unmatched == 6);
+    CHECK(zb_cmdq_pending(&q) == 0);
+    CHECK(zb_bridge_device(&bridge, 0x0A0A)->cfg_done == 0x7);
+    zb_device_t *b = zb_bridge_device(&bridge, 0x0B0B);
+    CHECK(b->cfg_done == 0x1 && b->cfg_unsupported == 0x4 && b->cfg_pending == 0);
+
+    //later reports: A is done, B is asked again for temperature only, never for humidity
+    for (int i = 0; i < 5; i++) {
+        CHECK(report_all(&q, 0x0A0A, now) == 0);
+        uint16_t missing = report_all(&q, 0x0B0B, now);
+        CHECK(missing == (i == 0 ? 0x2 : 0));
+        zb_cmdq_poll(&q, now, true);
+        now += TIMEOUT_MS / 2;
+    }
+    //the temperature retry gets no answer: times out, asked again on the next report
+    for (int i = 0; i < 10; i++) {
+        zb_cmdq_poll(&q, now, true);
+        now += TIMEOUT_MS;
+    }
+    CHECK(zb_cmdq_pending(&q) == 0 && q.stats.timeouts == 1);
+    CHECK(report_all(&q, 0x0B0B, now) == 0x2);
+    size_t from = stack.count;
+    zb_cmdq_poll(&q, now, true);
+    int t = frame_of(0x0B0B, 1, from);
+    CHECK(t >= 0 && zb_cmdq_response(&q, 0x0B0B, stack.tsns[t], ZB_CMDQ_STATUS_SUCCESS, now + 1));
+    CHECK(b->cfg_done == 0x3 && b->cfg_unsupported == 0x4);
+
+    //B rejoins under a new address: everything asked again, humidity included
+    zb_bridge_device_joined(&bridge, 0x0C0C, ieee_b, now);
+    CHECK(zb_bridge_device(&bridge, 0x0C0C) == b);
+    CHECK(report_all(&q, 0x0C0C, now) == 0x7);
+    CHECK(zb_bridge_cfg_missing(&bridge, 0xDEAD, 0x5) == 0x5);
+}
+
+int main(void) {
+    test_device_lru();
+    test_attr_lru();
+    test_payloads();
+    test_reporting_cfg();
+    return TEST_RESULT();
+}
@@ -0,0 +1,268 @@
+#include "host_test.h"
+#include "zb_cmdq.h"
+#include <string.h>
+
+// zb_cmdq against a fake stack: send() records the frames and hands out TSNs,
+// completions are recorded by the done callback.
+
+#define TIMEOUT_MS 500
+#define ATTEMPTS 3
+#define BACKOFF_MS 100
+
+typedef struct {
+    zb_cmd_t frames[64];
+    uint8_t tsns[64];
+    size_t count;
+    uint8_t next_tsn;
+    int fail;           // next sends refused by the stack
+} fake_stack_t;
+
+typedef struct {
+    uint32_t id;
+    zb_cmd_result_t result;
+    uint8_t status;
+    uint32_t latency_ms;
+} done_t;
+
+static fake_stack_t stack;
+static done_t dones[64];
+static size_t nb_dones;
+
+static int fake_send(const zb_cmd_t *cmd, void *ctx) {
+    fake_stack_t *s = ctx;
+    if (s->fail > 0) {
+        s->fail--;
+        return -1;
+    }
+    s->frames[s->count] = *cmd;
+    s->tsns[s->count] = s->next_tsn;
+    s->count++;
+    return s->next_tsn++;
+}
+
+static void on_done(uint32_t id, zb_cmd_result_t result, uint8_t status, uint32_t latency_ms, void *arg) {
+    (void)arg;
+    dones[nb_dones++] = (done_t){ id, result, status, latency_ms };
+}
+
+static void setup(zb_cmdq_t *q, uint8_t first_tsn) {
+    memset(&stack, 0, sizeof(stack));
+    stack.next_tsn = first_tsn;
+    nb_dones = 0;
+    zb_cmdq_ops_t ops = { .send = fake_send, .ctx = &stack };
+    zb_cmdq_init(q, &ops, TIMEOUT_MS, ATTEMPTS, BACKOFF_MS);
+}
+
+static zb_cmd_t unicast(uint16_t addr, uint16_t cluster, uint8_t cmd_id) {
+    zb_cmd_t cmd = { .dst_mode = ZB_DST_SHORT, .addr = addr, .ep = 1, .cluster = cluster, .cmd_id = cmd_id };
+    return cmd;
+}
+
+/** One in flight per destination, sent in submission order */
+static void test_ordering(void) {
+    zb_cmdq_t q;
+    setup(&q, 10);
+    zb_cmd_t on = unicast(0x1234, 0x0006, 1);
+    zb_cmd_t off = unicast(0x1234, 0x0006, 0);
+    zb_cmd_t other = unicast(0x5678, 0x0006, 1);
+    CHECK(zb_cmdq_submit(&q, &on, 1, on_done, NULL, 0));
+    CHECK(zb_cmdq_submit(&q, &off, 2, on_done, NULL, 0));
+    CHECK(zb_cmdq_submit(&q, &other, 3, on_done, NULL, 0));
+
+    //nothing sent while the network is down
+    CHECK(zb_cmdq_poll(&q, 0, false) == 0);
+
+    //ON and the other device's command; OFF waits for ON
+    CHECK(zb_cmdq_poll(&q, 1, true) == 2);
+    CHECK(stack.count == 2);
+    CHECK(stack.frames[0].addr == 0x1234 && stack.frames[0].cmd_id == 1);
+    CHECK(stack.frames[1].addr == 0x5678);
+    CHECK(zb_cmdq_poll(&q, 2, true) == 0);
+
+    CHECK(zb_cmdq_response(&q, 0x1234, stack.tsns[0], ZB_CMDQ_STATUS_SUCCESS, 20));
+    CHECK(nb_dones == 1 && dones[0].id == 1 && dones[0].result == ZB_CMD_DELIVERED && dones[0].latency_ms == 20);
+    CHECK(zb_cmdq_poll(&q, 21, true) == 1);
+    CHECK(stack.frames[2].addr == 0x1234 && stack.frames[2].cmd_id == 0);
+
+    //at most ZB_CMDQ_INFLIGHT_MAX in flight overall
+    setup(&q, 0);
+    for (uint16_t i = 0; i < ZB_CMDQ_INFLIGHT_MAX + 2; i++) {
+        zb_cmd_t cmd = unicast(0x100 + i, 0x0006, 1);
+        CHECK(zb_cmdq_submit(&q, &cmd, i, NULL, NULL, 0));
+    }
+    CHECK(zb_cmdq_poll(&q, 0, true) == ZB_CMDQ_INFLIGHT_MAX);
+    CHECK(zb_cmdq_pending(&q) == ZB_CMDQ_INFLIGHT_MAX + 2);
+
+    //a full table drops
+    setup(&q, 0);
+    zb_cmd_t cmd = unicast(0x1111, 0x0006, 1);
+    for (int i = 0; i < ZB_CMDQ_SLOTS; i++) {
+        CHECK(zb_cmdq_submit(&q, &cmd, i, NULL, NULL, 0));
+    }
+    CHECK(!zb_cmdq_submit(&q, &cmd, 99, NULL, NULL, 0));
+    CHECK(q.stats.dropped == 1);
+}
+
+/** Default responses complete the command of their source and TSN only */
+static void test_tsn_matching(void) {
+    zb_cmdq_t q;
+    setup(&q, 200);
+    zb_cmd_t a = unicast(0x0001, 0x0006, 1);
+    zb_cmd_t b = unicast(0x0002, 0x0006, 1);
+    zb_cmdq_submit(&q, &a, 1, on_done, NULL, 0);
+    zb_cmdq_submit(&q, &b, 2, on_done, NULL, 0);
+    zb_cmdq_poll(&q, 0, true);
+
+    //right TSN, wrong source; unknown TSN
+    CHECK(!zb_cmdq_response(&q, 0x0002, stack.tsns[0], ZB_CMDQ_STATUS_SUCCESS, 5));
+    CHECK(!zb_cmdq_response(&q, 0x0001, 42, ZB_CMDQ_STATUS_SUCCESS, 5));
+    CHECK(q.stats.unmatched == 2 && nb_dones == 0);
+
+    //error status: rejected, not retried
+    CHECK(zb_cmdq_response(&q, 0x0002, stack.tsns[1], 0x86, 7));
+    CHECK(nb_dones == 1 && dones[0].id == 2 && dones[0].result == ZB_CMD_REJECTED && dones[0].status == 0x86);
+    CHECK(zb_cmdq_response(&q, 0x0001, stack.tsns[0], ZB_CMDQ_STATUS_SUCCESS, 9));
+    CHECK(nb_dones == 2 && dones[1].id == 1 && dones[1].result == ZB_CMD_DELIVERED);
+
+    //the same response again matches nothing
+    CHECK(!zb_cmdq_response(&q, 0x0001, stack.tsns[0], ZB_CMDQ_STATUS_SUCCESS, 10));
+    CHECK(zb_cmdq_pending(&q) == 0);
+}
+
+/** Unanswered attempts are sent again after a doubling backoff, then time out */
+static void test_retry_backoff(void) {
+    zb_cmdq_t q;
+    setup(&q, 0);
+    zb_cmd_t cmd = unicast(0x0042, 0x0008, 4);
+    zb_cmdq_submit(&q, &cmd, 7, on_done, NULL, 0);
+
+    CHECK(zb_cmdq_poll(&q, 0, true) == 1);
+    CHECK(zb_cmdq_poll(&q, TIMEOUT_MS - 1, true) == 0);
+    //expired: second attempt after BACKOFF_MS
+    CHECK(zb_cmdq_poll(&q, TIMEOUT_MS, true) == 0);
+    CHECK(zb_cmdq_poll(&q, TIMEOUT_MS + BACKOFF_MS - 1, true) == 0);
+    uint32_t t2 = TIMEOUT_MS + BACKOFF_MS;
+    CHECK(zb_cmdq_poll(&q, t2, true) == 1);
+    //third attempt after twice the backoff
+    CHECK(zb_cmdq_poll(&q, t2 + TIMEOUT_MS, true) == 0);
+    CHECK(zb_cmdq_poll(&q, t2 + TIMEOUT_MS + 2 * BACKOFF_MS - 1, true) == 0);
+    uint32_t t3 = t2 + TIMEOUT_MS + 2 * BACKOFF_MS;
+    CHECK(zb_cmdq_poll(&q, t3, true) == 1);
+    CHECK(stack.count == 3 && q.stats.retries == 2);
+    CHECK(nb_dones == 0);
+
+    CHECK(zb_cmdq_response(&q, 0x0042, stack.tsns[2], ZB_CMDQ_STATUS_SUCCESS, t3 + 1));
+    CHECK(nb_dones == 1 && dones[0].result == ZB_CMD_DELIVERED);
+
+    //a late response while the retry waits still counts, nothing sent again
+    setup(&q, 0);
+    zb_cmdq_submit(&q, &cmd, 7, on_done, NULL, 0);
+    zb_cmdq_poll(&q, 0, true);
+    zb_cmdq_poll(&q, TIMEOUT_MS, true);
+    CHECK(zb_cmdq_response(&q, 0x0042, stack.tsns[0], ZB_CMDQ_STATUS_SUCCESS, TIMEOUT_MS + 1));
+    CHECK(nb_dones == 1 && dones[0].result == ZB_CMD_DELIVERED);
+    CHECK(zb_cmdq_poll(&q, TIMEOUT_MS + BACKOFF_MS, true) == 0 && stack.count == 1);
+
+    //no answer at all: timeout after the last attempt
+    setup(&q, 0);
+    zb_cmdq_submit(&q, &cmd, 8, on_done, NULL, 0);
+    uint32_t now = 0;
+    for (int i = 0; i < 100 && nb_dones == 0; i++, now += BACKOFF_MS) {
+        zb_cmdq_poll(&q, now, true);
+    }
+    CHECK(stack.count == ATTEMPTS);
+    CHECK(nb_dones == 1 && dones[0].id == 8 && dones[0].result == ZB_CMD_TIMEOUT);
+    CHECK(q.stats.timeouts == 1);
+
+    //refused by the stack at every attempt
+    setup(&q, 0);
+    stack.fail = ATTEMPTS;
+    zb_cmdq_submit(&q, &cmd, 9, on_done, NULL, 0);
+    now = 0;
+    for (int i = 0; i < 100 && nb_dones == 0; i++, now += BACKOFF_MS) {
+        zb_cmdq_poll(&q, now, true);
+    }
+    CHECK(nb_dones == 1 && dones[0].result == ZB_CMD_SEND_FAILED);
+    CHECK(q.stats.send_errors == ATTEMPTS && stack.count == 0);
+
+    //group commands complete as sent
+    setup(&q, 0);
+    zb_cmd_t group = { .dst_mode = ZB_DST_GROUP, .addr = 0x0003, .cluster = 0x0006, .cmd_id = 1 };
+    zb_cmdq_submit(&q, &group, 10, on_done, NULL, 0);
+    CHECK(zb_cmdq_poll(&q, 0, true) == 1);
+    CHECK(nb_dones == 1 && dones[0].result == ZB_CMD_SENT && zb_cmdq_pending(&q) == 0);
+}
+
+/** A coalescing command replaces the queued one, and keeps its place */
+static void test_coalescing(void) {
+    zb_cmdq_t q;
+    setup(&q, 0);
+    zb_cmd_t level = unicast(0x0042, 0x0008, 4);
+    level.flags = ZB_CMD_FLAG_COALESCE;
+    zb_cmd_t color = unicast(0x0042, 0x0300, 7);
+
+    level.payload_len = 1;
+    level.payload[0] = 10;
+    zb_cmdq_submit(&q, &level, 1, on_done, NULL, 0);
+    zb_cmdq_submit(&q, &color, 2, on_done, NULL, 0);
+    level.payload[0] = 200;
+    zb_cmdq_submit(&q, &level, 3, on_done, NULL, 1);
+
+    CHECK(nb_dones == 1 && dones[0].id == 1 && dones[0].result == ZB_CMD_REPLACED);
+    CHECK(zb_cmdq_pending(&q) == 2 && q.stats.replaced == 1);
+
+    //the latest level goes first, where the replaced one was
+    CHECK(zb_cmdq_poll(&q, 2, true) == 1);
+    CHECK(stack.frames[0].cluster == 0x0008 && stack.frames[0].payload[0] == 200);
+
+    //once sent, it is not replaced any more
+    level.payload[0] = 50;
+    zb_cmdq_submit(&q, &level, 4, on_done, NULL, 3);
+    CHECK(nb_dones == 1 && zb_cmdq_pending(&q) == 3);
+    zb_cmdq_response(&q, 0x0042, stack.tsns[0], ZB_CMDQ_STATUS_SUCCESS, 4);
+    CHECK(dones[1].id == 3 && dones[1].result == ZB_CMD_DELIVERED);
+    CHECK(zb_cmdq_poll(&q, 5, true) == 1);
+    CHECK(stack.frames[1].cluster == 0x0300);
+}
+
+/** Deadlines and backoffs across the 32-bit millisecond wrap */
+static void test_clock_wrap(void) {
+    zb_cmdq_t q;
+    setup(&q, 0);
+    uint32_t start = UINT32_MAX - TIMEOUT_MS / 2;
+    zb_cmd_t cmd = unicast(0x0042, 0x0006, 1);
+    zb_cmdq_submit(&q, &cmd, 1, on_done, NULL, start);
+
+    CHECK(zb_cmdq_poll(&q, start, true) == 1);
+    //deadline past the wrap: not expired just after it
+    CHECK(zb_cmdq_poll(&q, start + TIMEOUT_MS - 1, true) == 0);
+    CHECK(q.stats.retries == 0);
+    uint32_t expired = start + TIMEOUT_MS;
+    CHECK(zb_cmdq_poll(&q, expired, true) == 0);
+    CHECK(zb_cmdq_poll(&q, expired + BACKOFF_MS, true) == 1);
+    CHECK(q.stats.retries == 1);
+
+    CHECK(zb_cmdq_response(&q, 0x0042, stack.tsns[1], ZB_CMDQ_STATUS_SUCCESS, expired + BACKOFF_MS + 10));
+    CHECK(nb_dones == 1 && dones[0].result == ZB_CMD_DELIVERED);
+    CHECK(dones[0].latency_ms == TIMEOUT_MS + BACKOFF_MS + 10);
+
+    //TSN wrap: 255 then 0 both matched
+    setup(&q, 255);
+    zb_cmd_t a = unicast(0x0001, 0x0006, 1);
+    zb_cmd_t b = unicast(0x0002, 0x0006, 1);
+    zb_cmdq_submit(&q, &a, 1, on_done, NULL, 0);
+    zb_cmdq_submit(&q, &b, 2, on_done, NULL, 0);
+    zb_cmdq_poll(&q, 0, true);
+    CHECK(stack.tsns[0] == 255 && stack.tsns[1] == 0);
+    CHECK(zb_cmdq_response(&q, 0x0002, 0, ZB_CMDQ_STATUS_SUCCESS, 1));
+    CHECK(zb_cmdq_response(&q, 0x0001, 255, ZB_CMDQ_STATUS_SUCCESS, 1));
+}
+
+int main(void) {
+    test_ordering();
+    test_tsn_matching();
+    test_retry_backoff();
+    test_coalescing();
+    test_clock_wrap();
+    return TEST_RESULT();
+}
@@ -0,0 +1,297 @@
+//! Delta OTA patches: the new firmware as a diff against the image an ESP
+//! is running, applied on the ESP by ota_lib/delta_patch.c (see there for the
+//! format). bsdiff style: matched regions are sent as byte-wise differences
+//! with the old image, so code that only moved (shifted addresses) becomes
+//! mostly zeros, which the run-length coding of the data removes.
+
+use std::collections::HashMap;
+
+use crate::ota::sha256;
+
+pub const MAGIC: &[u8; 4] = b"RCDP";
+pub const VERSION: u8 = 1;
+pub const HEADER_SIZE: usize = 77;
+
+const OP_END: u8 = 0;
+const OP_SEEK: u8 = 1;
+const OP_ADD: u8 = 2;
+const OP_INSERT: u8 = 3;
+
+const KEY_LEN: usize = 8;       // bytes hashed to find match candidates
+const MIN_MATCH: usize = 16;    // shorter exact matches are inserted instead
+const EXTEND_SLACK: i64 = 32;   // mismatches tolerated past the best extension
+
+fn key(bytes: &[u8]) -> u64 {
+    let mut k = [0u8; KEY_LEN];
+    k.copy_from_slice(&bytes[..KEY_LEN]);
+    u64::from_le_bytes(k)
+}
+
+fn exact_len(old: &[u8], new: &[u8]) -> usize {
+    old.iter().zip(new).take_while(|(a, b)| a == b).count()
+}
+
+/// Length worth adding past an exact match: stops once mismatches outweigh
+/// matches by more than EXTEND_SLACK.
+fn approx_len(old: &[u8], new: &[u8]) -> usize {
+    let (mut score, mut best_score, mut best_len) = (0i64, 0i64, 0usize);
+    for (k, (a, b)) in old.iter().zip(new).enumerate() {
+        score += if a == b { 1 } else { -1 };
+        if score > best_score {
+            best_score = score;
+            best_len = k + 1;
+        } else if score < best_score - EXTEND_SLACK {
+            break;
+        }
+    }
+    best_len
+}
+
+/// Run-length coding of ADD / INSERT data: 0x80 | (k - 1) = k zeros (k < 128),
+/// 0xFF + uint16_t k = k zeros, k - 1 then k literal bytes.
+fn put_data(out: &mut Vec<u8>, data: &[u8]) {
+    let zeros_at = |k: usize| data[k..].iter().take(0xFFFF).take_while(|&&b| b == 0).count();
+    let mut k = 0;
+    while k < data.len() {
+        let zeros = zeros_at(k);
+        if zeros >= 128 {
+            out.push(0xFF);
+            out.extend_from_slice(&(zeros as u16).to_le_bytes());
+            k += zeros;
+            continue;
+        }
+        if zeros > 0 {
+            out.push(0x80 | (zeros - 1) as u8);
+            k += zeros;
+            continue;
+        }
+        let start = k;
+        while k < data.len() && k - start < 128 && !(data[k] == 0 && zeros_at(k) >= 3) {
+            k += 1;
+        }
+        out.push((k - start - 1) as u8);
+        out.extend_from_slice(&data[start..k]);
+    }
+}
+
+fn put_op(out: &mut Vec<u8>, op: u8, arg: u32) {
+    out.push(op);
+    out.extend_from_slice(&arg.to_le_bytes());
+}
+
+/// Patch turning `old` into `new`.
+pub fn make_patch(old: &[u8], new: &[u8]) -> Vec<u8> {
+    let mut out = Vec::with_capacity(HEADER_SIZE + new.len() / 8);
+    out.extend_from_slice(MAGIC);
+    out.push(VERSION);
+    out.extend_from_slice(&(old.len() as u32).to_le_bytes());
+    out.extend_from_slice(&sha256(old));
+    out.extend_from_slice(&(new.len() as u32).to_le_bytes());
+    out.extend_from_slice(&sha256(new));
+
+    //first occurrence of every key of the old image
+    let mut index: HashMap<u64, usize> = HashMap::with_capacity(old.len());
+    for j in 0..old.len().saturating_sub(KEY_LEN - 1) {
+        index.entry(key(&old[j..])).or_insert(j);
+    }
+
+    let mut old_pos = 0usize;   // applier's old position
+    let mut pending = 0usize;   // new bytes not covered by a command yet
+    let mut i = 0usize;
+    while i + KEY_LEN <= new.len() {
+        //the region following the last match first (no seek), then the index
+        let lockstep = old_pos + (i - pending);
+        let candidate = [Some(lockstep), index.get(&key(&new[i..])).copied()]
+            .into_iter()
+            .flatten()
+            .filter(|&j| j < old.len())
+            .map(|j| (j, exact_len(&old[j..], &new[i..])))
+            .find(|&(_, len)| len >= MIN_MATCH);
+        let Some((j, len)) = candidate else {
+            i += 1;
+            continue;
+        };
+
+        //grow the match back into the pending bytes
+        let (mut start_i, mut start_j) = (i, j);
+        while start_i > pending && start_j > 0 && new[start_i - 1] == old[start_j - 1] {
+            start_i -= 1;
+            start_j -= 1;
+        }
+        let end_i = i + len;
+        let end_i = end_i + approx_len(&old[j + len..], &new[end_i..]);
+
+        if start_i > pending {
+            put_op(&mut out, OP_INSERT, (start_i - pending) as u32);
+            put_data(&mut out, &new[pending..start_i]);
+        }
+        if start_j != old_pos {
+            put_op(&mut out, OP_SEEK, (start_j as i64 - old_pos as i64) as i32 as u32);
+        }
+        let diff: Vec<u8> = new[start_i..end_i].iter()
+            .zip(&old[start_j..])
+            .map(|(n, o)| n.wrapping_sub(*o))
+            .collect();
+        put_op(&mut out, OP_ADD, diff.len() as u32);
+        put_data(&mut out, &diff);
+
+        old_pos = start_j + diff.len();
+        pending = end_i;
+        i = end_i;
+    }
+
+    if pending < new.len() {
+        put_op(&mut out, OP_INSERT, (new.len() - pending) as u32);
+        put_data(&mut out, &new[pending..]);
+    }
+    out.push(OP_END);
+    out
+}
+
+/// Reference applier (the ESP one is delta_patch.c), checks both hashes.
+pub fn apply_patch(old: &[u8], patch: &[u8]) -> Result<Vec<u8>, String> {
+    let u32_at = |p: usize| -> Result<u32, String> {
+        patch.get(p..p + 4)
+            .map(|b| u32::from_le_bytes([b[0], b[1], b[2], b[3]]))
+            .ok_or_else(|| "truncated".to_string())
+    };
+    if patch.len() < HEADER_SIZE || &patch[..4] != MAGIC || patch[4] != VERSION {
+        return Err("not a patch".into());
+    }
+    if u32_at(5)? as usize != old.len() || patch[9..41] != sha256(old) {
+        return Err("patch is for another image".into());
+    }
+    let new_size = u32_at(41)? as usize;
+
+    let mut new = Vec::with_capacity(new_size);
+    let mut old_pos = 0i64;
+    let mut p = HEADER_SIZE;
+    loop {
+        let op = *patch.get(p).ok_or("truncated")?;
+        p += 1;
+        match op {
+            OP_END => break,
+            OP_SEEK => {
+                old_pos += u32_at(p)? as i32 as i64;
+                p += 4;
+            }
+            OP_ADD | OP_INSERT => {
+                let mut left = u32_at(p)? as usize;
+                p += 4;
+                while left > 0 {
+                    let token = *patch.get(p).ok_or("truncated")?;
+                    p += 1;
+                    let run: Vec<u8> = if token == 0xFF {
+                        p += 2;
+                        let n = patch.get(p - 2..p).ok_or("truncated")?;
+                        vec![0; u16::from_le_bytes([n[0], n[1]]) as usize]
+                    } else if token & 0x80 != 0 {
+                        vec![0; (token & 0x7F) as usize + 1]
+                    } else {
+                        let n = token as usize + 1;
+                        p += n;
+                        patch.get(p - n..p).ok_or("truncated")?.to_vec()
+                    };
+                    if run.len() > left {
+                        return Err("run past command".into());
+                    }
+                    left -= run.len();
+                    for d in run {
+                        if op == OP_ADD {
+                            let o = *old.get(old_pos as usize).filter(|_| old_pos >= 0).ok_or("old range")?;
+                            old_pos += 1;
+                            new.push(o.wrapping_add(d));
+                        } else {
+                            new.push(d);
+                        }
+                    }
+                }
+            }
+            _ => return Err(format!("bad command {}", op)),
+        }
+    }
+
+    if new.len() != new_size || patch[45..77] != sha256(&new) {
+        return Err("result does not match the new image".into());
+    }
+    Ok(new)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Fake firmware: pseudo-random code words, one in eight an absolute
+    /// address into the image (like literal pools and call targets).
+    fn firmware(len: usize, seed: u32) -> Vec<u8> {
+        let mut x = seed;
+        let mut out = Vec::with_capacity(len);
+        while out.len() < len {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            let word = if x % 8 == 0 { 0x4200_0000 + (x >> 8) % len as u32 } else { x };
+            out.extend_from_slice(&word.to_le_bytes());
+        }
+        out.truncate(len);
+        out
+    }
+
+    /// Insert `code` at `at`, shifting every address past it, as a rebuild does.
+    fn rebuild_with_insert(old: &[u8], at: usize, code: &[u8]) -> Vec<u8> {
+        let mut new = old[..at].to_vec();
+        new.extend_from_slice(code);
+        new.extend_from_slice(&old[at..]);
+        for w in new.chunks_exact_mut(4) {
+            let v = u32::from_le_bytes([w[0], w[1], w[2], w[3]]);
+            if (0x4200_0000..0x4300_0000).contains(&v) && v - 0x4200_0000 >= at as u32 {
+                w.copy_from_slice(&(v + code.len() as u32).to_le_bytes());
+            }
+        }
+        new
+    }
+
+    #[test]
+    fn identical_image_is_tiny() {
+        let old = firmware(200_000, 1);
+        let patch = make_patch(&old, &old);
+        assert!(patch.len() < HEADER_SIZE + 64, "{}", patch.len());
+        assert_eq!(apply_patch(&old, &patch).unwrap(), old);
+    }
+
+    #[test]
+    fn small_change_gives_small_patch() {
+        let old = firmware(500_000, 7);
+        let new = rebuild_with_insert(&old, 123_456, &firmware(64, 99));
+        let patch = make_patch(&old, &new);
+        assert_eq!(apply_patch(&old, &patch).unwrap(), new);
+        //shifted addresses cost a few bytes each, still far from a full image
+        assert!(patch.len() * 5 < new.len(), "patch {} vs image {}", patch.len(), new.len());
+    }
+
+    #[test]
+    fn unrelated_images_round_trip() {
+        let old = firmware(50_000, 3);
+        let new = firmware(60_000, 4);
+        let patch = make_patch(&old, &new);
+        assert_eq!(apply_patch(&old, &patch).unwrap(), new);
+        assert!(apply_patch(&new, &patch).is_err());
+        assert_eq!(apply_patch(&[], &make_patch(&[], &new)).unwrap(), new);
+        assert_eq!(apply_patch(&old, &make_patch(&old, &[])).unwrap(), Vec::<u8>::new());
+    }
+
+    /// Real build artifacts: DELTA_OLD=old.bin DELTA_NEW=new.bin cargo test -- --nocapture
+    #[test]
+    fn build_artifacts() {
+        let (Ok(old), Ok(new)) = (std::env::var("DELTA_OLD"), std::env::var("DELTA_NEW")) else {
+            return;
+        };
+        let (old, new) = (std::fs::read(old).unwrap(), std::fs::read(new).unwrap());
+        let start = std::time::Instant::now();
+        let patch = make_patch(&old, &new);
+        let made = start.elapsed();
+        assert_eq!(apply_patch(&old, &patch).unwrap(), new);
+        println!("patch {} bytes vs image {} bytes ({:.1}%), made in {:?}",
+            patch.len(), new.len(), patch.len() as f64 * 100.0 / new.len() as f64, made);
+    }
+}
@@ -1,13 +1,18 @@
 use std::{net::UdpSocket, sync::{Arc, Mutex}};
 
-use crate::{config::AppConfig, gui::ScreensTypes, ota::{OtaServerStatus, fetch_latest_bin, serve_firmware}};
+use crate::{config::AppConfig, gui::ScreensTypes, ota::{OtaServerStatus, fetch_latest_bin, serve_firmware}, ota_udp::{self, UdpOtaStatus, push_firmware_udp}};
 
 pub struct OtaScreen {
     pub firmware_path: Option<std::path::PathBuf>,
     pub server_status: Arc<Mutex<OtaServerStatus>>,
+    pub udp_status: Arc<Mutex<UdpOtaStatus>>,
     pub server_started: bool,
     pub port: u16,
     pub socket_udp_config: UdpSocket,
+    /// Keep stop commands and battery / motor telemetry alive during the update
+    pub safety_mode: bool,
+    /// Download cap in safety mode, 0 for none
+    pub rate_limit_kbps: u32,
 }
 
 impl Default for OtaScreen {
@@ -15,14 +20,25 @@ impl Default for OtaScreen {
         Self {
             firmware_path: None,
             server_status: Arc::new(Mutex::new(OtaServerStatus::default())),
+            udp_status: Arc::new(Mutex::new(UdpOtaStatus::default())),
             server_started: false,
             port: 8070,
             socket_udp_config: UdpSocket::bind("0.0.0.0:0").unwrap(),
+            safety_mode: true,
+            rate_limit_kbps: 200,
         }
     }
 }
 
 impl OtaScreen {
+    /// OTA command with its QoS block: [cmd][mode u8][rate limit bytes/s u32 LE]
+    fn ota_command(&self, cmd: u8) -> Vec<u8> {
+        let rate = if self.safety_mode { self.rate_limit_kbps * 1024 } else { 0 };
+        let mut frame = vec![cmd, self.safety_mode as u8];
+        frame.extend_from_slice(&rate.to_le_bytes());
+        frame
+    }
+
     pub fn show(&mut self, ctx: &egui::Context, screen: &mut ScreensTypes, config_ota: &AppConfig) {
         egui::CentralPanel::default().show(ctx, |ui| {
             ui.heading("OTA Firmware Update");
@@ -47,6 +63,12 @@ impl OtaScreen {
 
             ui.add(egui::DragValue::new(&mut self.port).prefix("Port: "));
 
+            ui.horizontal(|ui| {
+                ui.checkbox(&mut self.safety_mode, "Safety mode (stop + battery/motor telemetry, no video)");
+                ui.add_enabled(self.safety_mode,
+                    egui::DragValue::new(&mut self.rate_limit_kbps).prefix("Cap: ").suffix(" KB/s"));
+            });
+
             ui.horizontal(|ui| {
                 let can_start = self.firmware_path.is_some() && !self.server_started;
                 if ui.add_enabled(can_start, egui::Button::new("Start OTA server")).clicked() {
@@ -57,10 +79,27 @@ impl OtaScreen {
 
                 let can_trigger = self.server_started;
                 if ui.add_enabled(can_trigger, egui::Button::new("Launch OTA update on ESP")).clicked() {
-                    let cmd = vec![3];
+                    let cmd = self.ota_command(3);
                     self.socket_udp_config.send_to(&cmd, "192.168.1.58:3334")
                         .expect("couldn't bind to address");
                 }
+
+                //no HTTP server: the image is pushed to the ESP
+                let can_push = self.firmware_path.is_some() && !self.udp_status.lock().unwrap().running;
+                if ui.add_enabled(can_push, egui::Button::new("Push OTA over UDP")).clicked() {
+                    if let Ok(image) = std::fs::read(self.firmware_path.as_ref().unwrap()) {
+                        self.socket_udp_config.send_to(&self.ota_command(5), "192.168.1.58:3334")
+                            .expect("couldn't bind to address");
+                        let status = self.udp_status.clone();
+                        status.lock().unwrap().running = true;
+                        let device = std::net::SocketAddr::from(([192, 168, 1, 58], ota_udp::PORT));
+                        std::thread::spawn(move || {
+                            if let Err(e) = push_firmware_udp(device, &image, &status) {
+                                eprintln!("UDP OTA failed: {}", e);
+                            }
+                        });
+                    }
+                }
             });
 
             ui.separator();
@@ -72,6 +111,16 @@ impl OtaScreen {
             ui.label(format!("Bytes served: {} KB", status.bytes_served / 1024));
             drop(status);
 
+            let udp = self.udp_status.lock().unwrap();
+            if udp.running || udp.result.is_some() {
+                ui.label(format!("UDP push: {} / {} KB, {} resent",
+                    udp.bytes_acked / 1024, udp.image_size / 1024, udp.retransmits));
+                if let Some(result) = &udp.result {
+                    ui.label(result);
+                }
+            }
+            drop(udp);
+
             ui.with_layout(egui::Layout::bottom_up(egui::Align::LEFT), |ui| {
                 if ui.button("Back").clicked() {
                     *screen = ScreensTypes::Main;
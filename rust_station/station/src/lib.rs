@@ -8,6 +8,8 @@ pub mod sensors;
 pub mod udp;
 pub mod recorder;
 pub mod ota;
+pub mod ota_udp;
+pub mod delta;
 pub mod ai;
 
 use config::AppConfig;
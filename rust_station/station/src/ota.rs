@@ -1,5 +1,7 @@
-use std::{fs::File, process::Command, sync::{Arc, Mutex}};
-use tiny_http::{Response, Server};
+use std::{fs, path::{Path, PathBuf}, process::Command, sync::{Arc, Mutex}, time::Instant};
+use tiny_http::{Header, Request, Response, Server};
+
+use crate::delta::make_patch;
 
 #[derive(Clone, Default)]
 pub struct OtaServerStatus {
@@ -25,26 +27,322 @@ pub fn fetch_latest_bin(server_path: &str) -> Result<(), Box<dyn std::error::Err
     Ok(())
 }
 
-pub fn serve_firmware(bind_addr: &str, firmware_path: String, status: Arc<Mutex<OtaServerStatus>>) {
-    let server = Server::http(bind_addr).unwrap();
-    status.lock().unwrap().running = true;
+/// SHA-256 of the whole image, served as `/firmware.bin.sha256` so the ESP can
+/// check what it streamed to flash.
+pub fn sha256(data: &[u8]) -> [u8; 32] {
+    const K: [u32; 64] = [
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    ];
+    let mut h: [u32; 8] = [
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    ];
+
+    let mut msg = data.to_vec();
+    msg.push(0x80);
+    while msg.len() % 64 != 56 {
+        msg.push(0);
+    }
+    msg.extend_from_slice(&((data.len() as u64) * 8).to_be_bytes());
+
+    for block in msg.chunks(64) {
+        let mut w = [0u32; 64];
+        for i in 0..16 {
+            w[i] = u32::from_be_bytes([block[4 * i], block[4 * i + 1], block[4 * i + 2], block[4 * i + 3]]);
+        }
+        for i in 16..64 {
+            let s0 = w[i - 15].rotate_right(7) ^ w[i - 15].rotate_right(18) ^ (w[i - 15] >> 3);
+            let s1 = w[i - 2].rotate_right(17) ^ w[i - 2].rotate_right(19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16].wrapping_add(s0).wrapping_add(w[i - 7]).wrapping_add(s1);
+        }
+
+        let [mut a, mut b, mut c, mut d, mut e, mut f, mut g, mut hh] = h;
+        for i in 0..64 {
+            let s1 = e.rotate_right(6) ^ e.rotate_right(11) ^ e.rotate_right(25);
+            let ch = (e & f) ^ (!e & g);
+            let t1 = hh.wrapping_add(s1).wrapping_add(ch).wrapping_add(K[i]).wrapping_add(w[i]);
+            let s0 = a.rotate_right(2) ^ a.rotate_right(13) ^ a.rotate_right(22);
+            let maj = (a & b) ^ (a & c) ^ (b & c);
+            let t2 = s0.wrapping_add(maj);
+            hh = g;
+            g = f;
+            f = e;
+            e = d.wrapping_add(t1);
+            d = c;
+            c = b;
+            b = a;
+            a = t1.wrapping_add(t2);
+        }
+        for (x, y) in h.iter_mut().zip([a, b, c, d, e, f, g, hh]) {
+            *x = x.wrapping_add(y);
+        }
+    }
+
+    let mut out = [0u8; 32];
+    for (i, x) in h.iter().enumerate() {
+        out[4 * i..4 * i + 4].copy_from_slice(&x.to_be_bytes());
+    }
+    out
+}
+
+fn to_hex(bytes: &[u8]) -> String {
+    bytes.iter().map(|b| format!("{:02x}", b)).collect()
+}
+
+/// Byte range asked by a `Range` header, as `[start, end)` of a `len` bytes file.
+/// Only single ranges are supported (`bytes=N-`, `bytes=N-M`, `bytes=-N`), which
+/// is all the ESP sends; anything else is served whole.
+pub fn parse_range(value: &str, len: u64) -> Option<(u64, u64)> {
+    let spec = value.trim().strip_prefix("bytes=")?;
+    if spec.contains(',') {
+        return None;
+    }
+    let (start, end) = spec.split_once('-')?;
+    let (start, end) = match (start.trim(), end.trim()) {
+        ("", suffix) => {
+            let n: u64 = suffix.parse().ok()?;
+            (len.saturating_sub(n), len)
+        }
+        (start, "") => (start.parse().ok()?, len),
+        (start, end) => (start.parse().ok()?, end.parse::<u64>().ok()?.saturating_add(1).min(len)),
+    };
+    if start < end && end <= len {
+        Some((start, end))
+    } else {
+        None
+    }
+}
+
+/// What to send for a firmware request: 206 with a range, or 200 with it all
+/// (no range, or `If-Range` names another version of the image).
+pub fn plan_response(range: Option<&str>, if_range: Option<&str>, etag: &str, len: u64) -> (u16, u64, u64) {
+    let same_image = if_range.map_or(true, |tag| tag.trim() == etag);
+    match range.and_then(|r| parse_range(r, len)) {
+        Some((start, end)) if same_image => (206, start, end),
+        _ => (200, 0, len),
+    }
+}
+
+fn header_value(request: &Request, name: &'static str) -> Option<String> {
+    request.headers().iter()
+        .find(|h| h.field.equiv(name))
+        .map(|h| h.value.as_str().to_string())
+}
+
+/// Every image served is kept here under its SHA-256: the ESP running it
+/// can then be sent a delta patch.
+fn history_dir(firmware_path: &str) -> PathBuf {
+    Path::new(firmware_path).with_extension("history")
+}
+
+fn remember_image(firmware_path: &str, hex: &str, data: &[u8]) {
+    let dir = history_dir(firmware_path);
+    let path = dir.join(format!("{}.bin", hex));
+    if !path.exists() {
+        let _ = fs::create_dir_all(&dir).and_then(|_| fs::write(path, data));
+    }
+}
+
+/// Patch from the image named by `from` (hex SHA-256) to the current one,
+/// None when that image is unknown or already the current one.
+fn patch_for(firmware_path: &str, from: &str, data: &[u8], hex: &str) -> Option<Vec<u8>> {
+    if from.len() != 64 || !from.bytes().all(|b| b.is_ascii_hexdigit()) || from == hex {
+        return None;
+    }
+    let dir = history_dir(firmware_path);
+    let cached = dir.join(format!("{}_{}.patch", &from[..16], &hex[..16]));
+    if let Ok(patch) = fs::read(&cached) {
+        return Some(patch);
+    }
+    let old = fs::read(dir.join(format!("{}.bin", from))).ok()?;
+
+    let start = Instant::now();
+    let patch = make_patch(&old, data);
+    println!("Delta patch {} bytes vs image {} bytes ({:.1}%), made in {:?}",
+        patch.len(), data.len(), patch.len() as f64 * 100.0 / data.len() as f64, start.elapsed());
+    let _ = fs::write(cached, &patch);
+    Some(patch)
+}
+
+fn respond_patch(request: Request, firmware_path: &str, from: &str, status: &Arc<Mutex<OtaServerStatus>>) {
+    let patch = fs::read(firmware_path).ok().and_then(|data| {
+        let hex = to_hex(&sha256(&data));
+        remember_image(firmware_path, &hex, &data);
+        patch_for(firmware_path, from, &data, &hex)
+    });
+    let Some(patch) = patch else {
+        //ESP falls back to the full image
+        let _ = request.respond(Response::empty(404));
+        return;
+    };
+
+    let mut s = status.lock().unwrap();
+    s.last_client_ip = Some(format!("{:?}", request.remote_addr()));
+    s.bytes_served += patch.len() as u64;
+    drop(s);
+    let _ = request.respond(Response::from_data(patch));
+}
+
+fn respond_firmware(request: Request, firmware_path: &str, sha_only: bool, status: &Arc<Mutex<OtaServerStatus>>) {
+    let Ok(data) = fs::read(firmware_path) else {
+        let _ = request.respond(Response::empty(404));
+        return;
+    };
+    let digest = sha256(&data);
+    remember_image(firmware_path, &to_hex(&digest), &data);
+    if sha_only {
+        let _ = request.respond(Response::from_string(format!("{}  firmware.bin\n", to_hex(&digest))));
+        return;
+    }
+
+    //content validator: a rebuilt image gets another ETag, so an ESP resuming
+    //with If-Range restarts instead of mixing two images
+    let etag = format!("\"{}\"", to_hex(&digest[..8]));
+    let len = data.len() as u64;
+    let (code, start, end) = plan_response(
+        header_value(&request, "Range").as_deref(),
+        header_value(&request, "If-Range").as_deref(),
+        &etag, len);
+
+    let mut s = status.lock().unwrap();
+    s.last_client_ip = Some(format!("{:?}", request.remote_addr()));
+    s.bytes_served += end - start;
+    drop(s);
+
+    let mut response = Response::from_data(data[start as usize..end as usize].to_vec())
+        .with_status_code(code)
+        .with_header(Header::from_bytes("Accept-Ranges", "bytes").unwrap())
+        .with_header(Header::from_bytes("ETag", etag.as_bytes()).unwrap());
+    if code == 206 {
+        let range = format!("bytes {}-{}/{}", start, end - 1, len);
+        response = response.with_header(Header::from_bytes("Content-Range", range.as_bytes()).unwrap());
+    }
+    let _ = request.respond(response);
+}
 
-    std::thread::spawn(move || {
-        for request in server.incoming_requests() {
-            if request.url() == "/firmware.bin" {
-                if let Ok(file) = File::open(&firmware_path) {
-                    let len = file.metadata().map(|m| m.len()).unwrap_or(0);
-                    let mut s = status.lock().unwrap();
-                    s.last_client_ip = Some(format!("{:?}", request.remote_addr()));
-                    s.bytes_served += len;
-                    drop(s);
-                    let _ = request.respond(Response::from_file(file));
-                } else {
-                    let _ = request.respond(Response::empty(404));
-                }
-            } else {
+fn run_server(server: Server, firmware_path: String, status: Arc<Mutex<OtaServerStatus>>) {
+    for request in server.incoming_requests() {
+        let url = request.url().to_string();
+        match url.as_str() {
+            "/firmware.bin" => respond_firmware(request, &firmware_path, false, &status),
+            "/firmware.bin.sha256" => respond_firmware(request, &firmware_path, true, &status),
+            _ if url.starts_with("/firmware.bin.patch?from=") => {
+                respond_patch(request, &firmware_path, &url["/firmware.bin.patch?from=".len()..], &status)
+            }
+            _ => {
                 let _ = request.respond(Response::empty(404));
             }
         }
-    });
-}
\ No newline at end of file
+    }
+}
+
+/// Serve `firmware_path` to the ESPs: `/firmware.bin` (with Range / If-Range
+/// resume), `/firmware.bin.sha256` and `/firmware.bin.patch?from=<sha256>`
+/// (delta against an image served before).
+pub fn serve_firmware(bind_addr: &str, firmware_path: String, status: Arc<Mutex<OtaServerStatus>>) {
+    let server = Server::http(bind_addr).unwrap();
+    status.lock().unwrap().running = true;
+
+    std::thread::spawn(move || run_server(server, firmware_path, status));
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::{Read, Write};
+    use std::net::TcpStream;
+
+    #[test]
+    fn sha256_known_vectors() {
+        assert_eq!(to_hex(&sha256(b"")), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        assert_eq!(to_hex(&sha256(b"abc")), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        assert_eq!(
+            to_hex(&sha256(b"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")),
+            "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    }
+
+    #[test]
+    fn range_parsing() {
+        assert_eq!(parse_range("bytes=100-", 1000), Some((100, 1000)));
+        assert_eq!(parse_range("bytes=0-99", 1000), Some((0, 100)));
+        assert_eq!(parse_range("bytes=900-5000", 1000), Some((900, 1000)));
+        assert_eq!(parse_range("bytes=-10", 1000), Some((990, 1000)));
+        assert_eq!(parse_range("bytes=1000-", 1000), None);
+        assert_eq!(parse_range("bytes=0-1,5-9", 1000), None);
+        assert_eq!(parse_range("items=0-1", 1000), None);
+    }
+
+    #[test]
+    fn if_range_mismatch_sends_whole_image() {
+        assert_eq!(plan_response(Some("bytes=10-"), None, "\"a\"", 100), (206, 10, 100));
+        assert_eq!(plan_response(Some("bytes=10-"), Some("\"a\""), "\"a\"", 100), (206, 10, 100));
+        assert_eq!(plan_response(Some("bytes=10-"), Some("\"b\""), "\"a\"", 100), (200, 0, 100));
+        assert_eq!(plan_response(None, None, "\"a\"", 100), (200, 0, 100));
+    }
+
+    fn get(addr: &str, path: &str, headers: &str) -> (String, Vec<u8>) {
+        let mut stream = TcpStream::connect(addr).unwrap();
+        write!(stream, "GET {} HTTP/1.1\r\nHost: esp\r\nConnection: close\r\n{}\r\n", path, headers).unwrap();
+        let mut raw = Vec::new();
+        stream.read_to_end(&mut raw).unwrap();
+        let split = raw.windows(4).position(|w| w == b"\r\n\r\n").unwrap();
+        (String::from_utf8_lossy(&raw[..split]).to_string(), raw[split + 4..].to_vec())
+    }
+
+    /// Interrupted download resumed the way the ESP does it, against the real server loop.
+    #[test]
+    fn resume_against_local_server() {
+        let image: Vec<u8> = (0..50_000u32).map(|i| (i * 7 % 251) as u8).collect();
+        let path = std::env::temp_dir().join(format!("ota_test_{}.bin", std::process::id()));
+        fs::write(&path, &image).unwrap();
+
+        let server = Server::http("127.0.0.1:0").unwrap();
+        let addr = server.server_addr().to_ip().unwrap().to_string();
+        let status = Arc::new(Mutex::new(OtaServerStatus::default()));
+        let path_str = path.to_string_lossy().to_string();
+        let server_status = status.clone();
+        std::thread::spawn(move || run_server(server, path_str, server_status));
+
+        let (head, body) = get(&addr, "/firmware.bin", "");
+        assert!(head.starts_with("HTTP/1.1 200"));
+        assert_eq!(body, image);
+        let etag = head.lines()
+            .find_map(|l| l.strip_prefix("ETag: ").or_else(|| l.strip_prefix("etag: ")))
+            .unwrap().to_string();
+
+        let (head, body) = get(&addr, "/firmware.bin", &format!("Range: bytes=20000-\r\nIf-Range: {}\r\n", etag));
+        assert!(head.starts_with("HTTP/1.1 206"));
+        assert!(head.contains("bytes 20000-49999/50000"));
+        assert_eq!(body, &image[20000..]);
+
+        let (head, body) = get(&addr, "/firmware.bin", "Range: bytes=20000-\r\nIf-Range: \"old\"\r\n");
+        assert!(head.starts_with("HTTP/1.1 200"));
+        assert_eq!(body.len(), image.len());
+
+        let (_, body) = get(&addr, "/firmware.bin.sha256", "");
+        assert!(String::from_utf8(body).unwrap().starts_with(&to_hex(&sha256(&image))));
+
+        assert_eq!(status.lock().unwrap().bytes_served, 50_000 + 30_000 + 50_000);
+
+        //new build: the image served above gets a patch, an unknown one does not
+        let mut rebuilt = image.clone();
+        rebuilt[1000..1010].copy_from_slice(b"new string");
+        fs::write(&path, &rebuilt).unwrap();
+        let from = to_hex(&sha256(&image));
+        let (head, patch) = get(&addr, &format!("/firmware.bin.patch?from={}", from), "");
+        assert!(head.starts_with("HTTP/1.1 200"));
+        assert!(patch.len() < 1000);
+        assert_eq!(crate::delta::apply_patch(&image, &patch).unwrap(), rebuilt);
+        let (head, _) = get(&addr, &format!("/firmware.bin.patch?from={}", "0".repeat(64)), "");
+        assert!(head.starts_with("HTTP/1.1 404"));
+
+        let _ = fs::remove_file(&path);
+        let _ = fs::remove_dir_all(history_dir(&path.to_string_lossy()));
+    }
+}
@@ -0,0 +1,357 @@
+//! UDP OTA sender: pushes an image to an ESP (ota_lib, CONFIG_OTA_UDP) with
+//! no HTTP server. Chunks are numbered and sent with a sliding window; the
+//! ESP acks the next chunk it expects plus a bitmap of the ones it holds
+//! past it, so only lost chunks are sent again. Packet layout: ota_udp_rx.h.
+
+use std::{
+    net::{SocketAddr, UdpSocket},
+    sync::{Arc, Mutex},
+    time::{Duration, Instant, SystemTime, UNIX_EPOCH},
+};
+
+use crate::ota::sha256;
+
+pub const PORT: u16 = 3335;
+pub const CHUNK_SIZE: usize = 1024;
+pub const WINDOW_MAX: u32 = 16;   // ESP receive window, OTA_UDP_WINDOW
+
+const START: u8 = 1;
+const DATA: u8 = 2;
+const END: u8 = 3;
+const ABORT: u8 = 4;
+const ACK: u8 = 0x81;
+const ACK_SIZE: usize = 15;
+
+const STATUS_DONE: u8 = 1;
+const STATUS_ERROR: u8 = 2;
+
+const ACK_WAIT: Duration = Duration::from_millis(5);
+const RETRANSMIT_AFTER: Duration = Duration::from_millis(150); // chunk never acked
+const HOLE_RESEND_AFTER: Duration = Duration::from_millis(20); // chunk behind a sacked one
+const CONTROL_RETRY: Duration = Duration::from_millis(200);     // START / END without answer
+const IDLE_TIMEOUT: Duration = Duration::from_secs(5);
+
+#[derive(Clone, Default)]
+pub struct UdpOtaStatus {
+    pub running: bool,
+    pub image_size: usize,
+    pub bytes_acked: usize,
+    pub retransmits: u32,
+    pub result: Option<String>,
+}
+
+#[derive(Debug, Clone)]
+pub struct UdpOtaReport {
+    pub bytes: usize,
+    pub elapsed: Duration,
+    pub chunks_sent: u32,
+    pub retransmits: u32,
+}
+
+impl UdpOtaReport {
+    pub fn throughput_bps(&self) -> f64 {
+        self.bytes as f64 / self.elapsed.as_secs_f64().max(1e-6)
+    }
+}
+
+struct Ack {
+    next: u32,
+    mask: u32,
+    status: u8,
+    window: u32,
+}
+
+fn parse_ack(buf: &[u8], session: u32) -> Option<Ack> {
+    let u32_at = |p: usize| u32::from_le_bytes([buf[p], buf[p + 1], buf[p + 2], buf[p + 3]]);
+    if buf.len() < ACK_SIZE || buf[0] != ACK || u32_at(1) != session {
+        return None;
+    }
+    Some(Ack { next: u32_at(5), mask: u32_at(9), status: buf[13], window: buf[14] as u32 })
+}
+
+fn control(kind: u8, session: u32) -> Vec<u8> {
+    let mut p = vec![kind];
+    p.extend_from_slice(&session.to_le_bytes());
+    p
+}
+
+/// Push `image` to the ESP at `device` (its OTA_UDP port). The ESP must be
+/// waiting for it: command 5 on the UDP config port.
+pub fn push_firmware_udp(device: SocketAddr, image: &[u8], status: &Arc<Mutex<UdpOtaStatus>>)
+    -> Result<UdpOtaReport, String> {
+    let socket = UdpSocket::bind("0.0.0.0:0").map_err(|e| e.to_string())?;
+    socket.connect(device).map_err(|e| e.to_string())?;
+    socket.set_read_timeout(Some(ACK_WAIT)).map_err(|e| e.to_string())?;
+
+    let session = SystemTime::now().duration_since(UNIX_EPOCH)
+        .map_or(0, |d| d.subsec_nanos()) ^ image.len() as u32;
+    let chunks = image.len().div_ceil(CHUNK_SIZE) as u32;
+    let chunk = |seq: u32| {
+        let start = seq as usize * CHUNK_SIZE;
+        &image[start..(start + CHUNK_SIZE).min(image.len())]
+    };
+    {
+        let mut s = status.lock().unwrap();
+        *s = UdpOtaStatus { running: true, image_size: image.len(), ..Default::default() };
+    }
+    let fail = |msg: String| {
+        let _ = socket.send(&control(ABORT, session));
+        let mut s = status.lock().unwrap();
+        s.running = false;
+        s.result = Some(msg.clone());
+        msg
+    };
+
+    let mut start = control(START, session);
+    start.extend_from_slice(&(image.len() as u32).to_le_bytes());
+    start.extend_from_slice(&sha256(image));
+    start.extend_from_slice(&(CHUNK_SIZE as u16).to_le_bytes());
+
+    let begin = Instant::now();
+    let mut buf = [0u8; 64];
+    let mut last_heard = Instant::now();
+    let mut last_control: Option<Instant> = None;
+    let mut started = false;
+    let mut window = WINDOW_MAX;
+
+    let mut next_new = 0u32;                          // first chunk never sent
+    let mut base = 0u32;                              // ESP has every chunk before it
+    let mut held = vec![false; chunks as usize];      // sacked past base
+    let mut sent_at: Vec<Option<Instant>> = vec![None; chunks as usize];
+    let (mut chunks_sent, mut retransmits) = (0u32, 0u32);
+
+    let send_chunk = |seq: u32, sent_at: &mut Vec<Option<Instant>>| {
+        let mut p = control(DATA, session);
+        p.extend_from_slice(&seq.to_le_bytes());
+        p.extend_from_slice(chunk(seq));
+        let _ = socket.send(&p);
+        sent_at[seq as usize] = Some(Instant::now());
+    };
+
+    loop {
+        //START until acked, END once everything is in
+        let control_due = last_control.map_or(true, |t| t.elapsed() >= CONTROL_RETRY);
+        if !started && control_due {
+            let _ = socket.send(&start);
+            last_control = Some(Instant::now());
+        } else if started && base == chunks && control_due {
+            let _ = socket.send(&control(END, session));
+            last_control = Some(Instant::now());
+        }
+
+        if started {
+            while next_new < chunks && next_new < base + window {
+                send_chunk(next_new, &mut sent_at);
+                chunks_sent += 1;
+                next_new += 1;
+            }
+            //lost: never acked for long, or behind a chunk the ESP already holds
+            let highest_held = (base..next_new).rev().find(|&s| held[s as usize]);
+            for seq in base..next_new {
+                if held[seq as usize] {
+                    continue;
+                }
+                let age = sent_at[seq as usize].map_or(Duration::MAX, |t| t.elapsed());
+                let hole = highest_held.is_some_and(|h| seq < h);
+                if age >= RETRANSMIT_AFTER || (hole && age >= HOLE_RESEND_AFTER) {
+                    send_chunk(seq, &mut sent_at);
+                    chunks_sent += 1;
+                    retransmits += 1;
+                }
+            }
+        }
+
+        match socket.recv(&mut buf) {
+            Ok(len) => {
+                let Some(ack) = parse_ack(&buf[..len], session) else { continue };
+                last_heard = Instant::now();
+                if ack.status == STATUS_ERROR {
+                    return Err(fail("ESP reported an error".into()));
+                }
+                if ack.status == STATUS_DONE {
+                    let report = UdpOtaReport { bytes: image.len(), elapsed: begin.elapsed(), chunks_sent, retransmits };
+                    let mut s = status.lock().unwrap();
+                    s.running = false;
+                    s.bytes_acked = image.len();
+                    s.result = Some(format!("Done, {:.0} KB/s", report.throughput_bps() / 1024.0));
+                    return Ok(report);
+                }
+                if !started {
+                    started = true;
+                    last_control = None;
+                }
+                window = ack.window.clamp(1, WINDOW_MAX);
+                base = base.max(ack.next.min(chunks));
+                for i in 0..31 {
+                    let seq = ack.next + 1 + i;
+                    if ack.mask & (1 << i) != 0 && seq < chunks {
+                        held[seq as usize] = true;
+                    }
+                }
+                let mut s = status.lock().unwrap();
+                s.bytes_acked = (base as usize * CHUNK_SIZE).min(image.len());
+                s.retransmits = retransmits;
+            }
+            Err(_) => {
+                if last_heard.elapsed() >= IDLE_TIMEOUT {
+                    return Err(fail("ESP not answering".into()));
+                }
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Stand-in for the ESP receiver (ota_udp_rx.c + ota_udp_task): same
+    /// window, same ack rules, drops some packets on purpose.
+    fn receiver_stand_in(socket: UdpSocket, loss_every: usize) -> Vec<u8> {
+        let mut buf = vec![0u8; 2048];
+        socket.set_read_timeout(Some(Duration::from_millis(20))).unwrap();
+        let (mut session, mut image, mut chunk_size, mut chunks) = (0u32, Vec::new(), 0usize, 0u32);
+        let mut next = 0u32;
+        let mut slots: Vec<Option<Vec<u8>>> = vec![None; WINDOW_MAX as usize];
+        let (mut packets, mut unacked) = (0usize, 0u32);
+        let mut peer = None;
+        let mut expected_sha = [0u8; 32];
+
+        let ack = |socket: &UdpSocket, peer: Option<SocketAddr>, session: u32, next: u32, slots: &Vec<Option<Vec<u8>>>, status: u8| {
+            let mut mask = 0u32;
+            for i in 0..WINDOW_MAX - 1 {
+                if slots[((next + 1 + i) % WINDOW_MAX) as usize].is_some() {
+                    mask |= 1 << i;
+                }
+            }
+            let mut p = control(ACK, session);
+            p.extend_from_slice(&next.to_le_bytes());
+            p.extend_from_slice(&mask.to_le_bytes());
+            p.push(status);
+            p.push(WINDOW_MAX as u8);
+            let _ = socket.send_to(&p, peer.unwrap());
+        };
+
+        loop {
+            let Ok((len, from)) = socket.recv_from(&mut buf) else {
+                if unacked > 0 {
+                    ack(&socket, peer, session, next, &slots, 0);
+                    unacked = 0;
+                }
+                continue;
+            };
+            packets += 1;
+            if loss_every > 0 && packets % loss_every == 0 {
+                continue;
+            }
+            let p = &buf[..len];
+            let u32_at = |o: usize| u32::from_le_bytes([p[o], p[o + 1], p[o + 2], p[o + 3]]);
+            match p[0] {
+                START => {
+                    if peer.is_none() {
+                        session = u32_at(1);
+                        let size = u32_at(5) as usize;
+                        expected_sha.copy_from_slice(&p[9..41]);
+                        chunk_size = u16::from_le_bytes([p[41], p[42]]) as usize;
+                        chunks = size.div_ceil(chunk_size) as u32;
+                        image = Vec::with_capacity(size);
+                        peer = Some(from);
+                    }
+                    ack(&socket, peer, session, next, &slots, 0);
+                }
+                DATA => {
+                    let seq = u32_at(5);
+                    let data = p[9..].to_vec();
+                    let mut gap = false;
+                    if seq == next {
+                        image.extend_from_slice(&data);
+                        next += 1;
+                        while let Some(d) = slots[(next % WINDOW_MAX) as usize].take() {
+                            image.extend_from_slice(&d);
+                            next += 1;
+                        }
+                    } else if seq > next && seq - next < WINDOW_MAX {
+                        slots[(seq % WINDOW_MAX) as usize] = Some(data);
+                    } else {
+                        gap = true;
+                    }
+                    unacked += 1;
+                    let holding = slots.iter().any(|s| s.is_some());
+                    if unacked >= 4 || gap || holding {
+                        ack(&socket, peer, session, next, &slots, 0);
+                        unacked = 0;
+                    }
+                }
+                END => {
+                    if next == chunks {
+                        let status = if sha256(&image) == expected_sha { STATUS_DONE } else { STATUS_ERROR };
+                        for _ in 0..3 {
+                            ack(&socket, peer, session, next, &slots, status);
+                        }
+                        assert_eq!(chunk_size, CHUNK_SIZE);
+                        return image;
+                    }
+                    ack(&socket, peer, session, next, &slots, 0);
+                }
+                _ => {}
+            }
+        }
+    }
+
+    fn run(image: Vec<u8>, loss_every: usize) -> (Vec<u8>, UdpOtaReport) {
+        let socket = UdpSocket::bind("127.0.0.1:0").unwrap();
+        let addr = socket.local_addr().unwrap();
+        let receiver = std::thread::spawn(move || receiver_stand_in(socket, loss_every));
+        let status = Arc::new(Mutex::new(UdpOtaStatus::default()));
+        let report = push_firmware_udp(addr, &image, &status).unwrap();
+        assert!(!status.lock().unwrap().running);
+        (receiver.join().unwrap(), report)
+    }
+
+    fn image(len: usize) -> Vec<u8> {
+        (0..len).map(|i| (i * 31 % 253) as u8).collect()
+    }
+
+    #[test]
+    fn clean_link() {
+        let img = image(300_001);
+        let (got, report) = run(img.clone(), 0);
+        assert_eq!(got, img);
+        assert_eq!(report.chunks_sent as usize, img.len().div_ceil(CHUNK_SIZE));
+    }
+
+    #[test]
+    fn lossy_link_resends_only_what_is_missing() {
+        let img = image(200_000);
+        let (got, report) = run(img.clone(), 9);
+        assert_eq!(got, img);
+        assert!(report.retransmits > 0);
+        //selective acks: far fewer resends than go-back-N would need
+        assert!(report.retransmits < report.chunks_sent / 3, "{:?}", report);
+    }
+
+    /// Loopback throughput, UDP push vs the HTTP server:
+    /// cargo test bench_udp_vs_http -- --ignored --nocapture
+    #[test]
+    #[ignore]
+    fn bench_udp_vs_http() {
+        use std::io::{Read, Write};
+        let img = image(1_500_000);
+        let (_, report) = run(img.clone(), 0);
+
+        let path = std::env::temp_dir().join(format!("ota_bench_{}.bin", std::process::id()));
+        std::fs::write(&path, &img).unwrap();
+        let status = Arc::new(Mutex::new(crate::ota::OtaServerStatus::default()));
+        crate::ota::serve_firmware("127.0.0.1:18070", path.to_string_lossy().to_string(), status);
+        let start = Instant::now();
+        let mut stream = std::net::TcpStream::connect("127.0.0.1:18070").unwrap();
+        write!(stream, "GET /firmware.bin HTTP/1.1\r\nHost: esp\r\nConnection: close\r\n\r\n").unwrap();
+        let mut raw = Vec::new();
+        stream.read_to_end(&mut raw).unwrap();
+        let http = start.elapsed();
+        let _ = std::fs::remove_file(path);
+
+        println!("UDP  {:.0} KB/s ({} retransmits)", report.throughput_bps() / 1024.0, report.retransmits);
+        println!("HTTP {:.0} KB/s", img.len() as f64 / 1024.0 / http.as_secs_f64());
+    }
+}
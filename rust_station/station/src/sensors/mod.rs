@@ -1,4 +1,4 @@
-use std::{error::Error, f64::consts::PI, io, println, string::FromUtf8Error};
+use std::{collections::HashMap, error::Error, f64::consts::PI, io, println, string::FromUtf8Error};
 
 use log::error;
 use serde::{Deserialize, Serialize};
@@ -43,8 +43,14 @@ pub enum SensorType {
     Break     = 30,
     Bmp280    = 31,
     Ds18b20   = 32,
-
-    Max       = 33,
+    Vl53l1xZones = 33,
+    Angular   = 34,
+    Delta     = 35,
+    Gateway   = 36,
+    Zigbee    = 37,
+    ZigbeeDevice = 38,
+
+    Max       = 39,
 }
 
 impl TryFrom<u8> for SensorType {
@@ -85,7 +91,13 @@ impl TryFrom<u8> for SensorType {
             30 => Ok(SensorType::Break),
             31 => Ok(SensorType::Bmp280),
             32 => Ok(SensorType::Ds18b20),
-            33 => Ok(SensorType::Max),
+            33 => Ok(SensorType::Vl53l1xZones),
+            34 => Ok(SensorType::Angular),
+            35 => Ok(SensorType::Delta),
+            36 => Ok(SensorType::Gateway),
+            37 => Ok(SensorType::Zigbee),
+            38 => Ok(SensorType::ZigbeeDevice),
+            39 => Ok(SensorType::Max),
             _ => Err("Sensor code not valid"),
         }
     }
@@ -360,6 +372,10 @@ pub enum TelemetryEnum {
     BMP(PacketBmp),
     DHT11(PacketDht11),
     PHOTOSENSOR(PacketPhotosensor),
+    VL53L1XZONES(PacketVl53l1xZones),
+    ANGULAR(PacketAngular),
+    ZIGBEE(PacketZigbee),
+    ZIGBEEDEVICE(PacketZigbeeDevice),
 }
 
 //Buffer from ESP
@@ -504,3 +520,184 @@ pub struct PacketDht11 {
     pub temperature: u8,
 }
 
+//VL53L1X multi-zone sweep, zone n = row * cols + col
+#[derive(Debug, Serialize, Deserialize, Clone)]
+pub struct PacketVl53l1xZones {
+    pub cols: u8,
+    pub rows: u8,
+    pub valid_mask: u16,
+    pub sweep_ms: u16,
+    pub distance_mm: Vec<u16>,
+}
+
+impl PacketVl53l1xZones {
+    /// None when the zone is out of the grid or got no valid range this sweep
+    pub fn get_distance_mm(&self, col: u8, row: u8) -> Option<u16> {
+        if col >= self.cols || row >= self.rows {
+            return None;
+        }
+        let zone = row as usize * self.cols as usize + col as usize;
+        if self.valid_mask & (1 << zone) == 0 {
+            return None;
+        }
+        self.distance_mm.get(zone).copied()
+    }
+}
+
+//AS5600 / KY-040 angular state, in 1/100 degree
+#[derive(Debug, Serialize, Deserialize, Clone)]
+pub struct PacketAngular {
+    pub source: SensorType,
+    pub position_cdeg: i32, // unwrapped, keeps counting past 360
+    pub velocity_cdps: i32,
+    pub accel_cdps2: i32,
+}
+
+impl PacketAngular {
+    pub fn get_position_deg(&self) -> f64 {
+        self.position_cdeg as f64 / 100.0
+    }
+
+    pub fn get_velocity_dps(&self) -> f64 {
+        self.velocity_cdps as f64 / 100.0
+    }
+
+    pub fn get_rpm(&self) -> f64 {
+        self.get_velocity_dps() / 6.0
+    }
+
+    pub fn get_accel_dps2(&self) -> f64 {
+        self.accel_cdps2 as f64 / 100.0
+    }
+}
+
+//Zigbee attribute report forwarded by the coordinator, value in ZCL byte order
+#[derive(Debug, Serialize, Deserialize, Clone)]
+pub struct ZigbeeAttr {
+    pub attr: u16,
+    pub zcl_type: u8,
+    pub value: Vec<u8>,
+}
+
+impl ZigbeeAttr {
+    /// Booleans, bitmaps, enums and integers (as zb_attr_to_int32 on the ESP), None for floats and others
+    pub fn get_i64(&self) -> Option<i64> {
+        let is_signed = (0x28 ..= 0x2F).contains(&self.zcl_type);
+        let is_integer = is_signed || ((0x08 ..= 0x31).contains(&self.zcl_type) && self.zcl_type != 0x38);
+        if !is_integer || self.value.is_empty() || self.value.len() > 8 {
+            return None;
+        }
+        let mut raw = [0u8; 8];
+        raw[.. self.value.len()].copy_from_slice(&self.value);
+        let bits = 64 - 8 * self.value.len() as u32;
+        let value = i64::from_le_bytes(raw);
+        if is_signed {
+            Some(value.wrapping_shl(bits).wrapping_shr(bits))
+        } else {
+            Some(value)
+        }
+    }
+}
+
+#[derive(Debug, Serialize, Deserialize, Clone)]
+pub struct PacketZigbee {
+    pub short_addr: u16,
+    pub endpoint: u8,
+    pub cluster: u16,
+    pub attrs: Vec<ZigbeeAttr>,
+}
+
+impl PacketZigbee {
+    pub fn get_attr(&self, attr: u16) -> Option<&ZigbeeAttr> {
+        self.attrs.iter().find(|a| a.attr == attr)
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
+#[repr(u8)]
+pub enum ZigbeeDeviceEvent {
+    Joined = 1,
+    Left = 2,
+}
+
+impl TryFrom<u8> for ZigbeeDeviceEvent {
+    type Error = &'static str;
+
+    fn try_from(value: u8) -> Result<Self, Self::Error> {
+        match value {
+            1 => Ok(ZigbeeDeviceEvent::Joined),
+            2 => Ok(ZigbeeDeviceEvent::Left),
+            _ => Err("Invalid Zigbee device event"),
+        }
+    }
+}
+
+//Zigbee device joined or left the coordinator's network
+#[derive(Debug, Serialize, Deserialize, Clone)]
+pub struct PacketZigbeeDevice {
+    pub short_addr: u16,
+    pub ieee: [u8; 8],
+    pub event: ZigbeeDeviceEvent,
+    pub devices_known: u8,
+}
+
+impl PacketZigbeeDevice {
+    /// IEEE address as usually written (most significant byte first)
+    pub fn get_ieee_string(&self) -> String {
+        self.ieee.iter().rev().map(|b| format!("{:02x}", b)).collect::<Vec<_>>().join(":")
+    }
+}
+
+//change-driven sensors: values moved since the last published reading
+#[derive(Debug, Serialize, Deserialize, Clone)]
+pub struct PacketDelta {
+    pub source: SensorType,
+    pub instance: u8,
+    pub deltas: Vec<i16>,
+}
+
+/// Last published values of the sensors behind sensor_publish() (ESP side),
+/// in the order the ESP publishes them, so a delta frame can be turned back
+/// into the sensor's usual packet.
+#[derive(Debug, Default)]
+pub struct PublishedValues {
+    last: HashMap<(u8, SensorType, u8), Vec<i32>>,
+}
+
+impl PublishedValues {
+    /// Keep the values of a full frame; packets not sent through the policy are ignored
+    pub fn record(&mut self, esp_id: u8, packet: &TelemetryEnum) {
+        let (source, values) = match packet {
+            TelemetryEnum::DHT11(p) => (SensorType::Dht11, vec![p.humidity as i32, p.temperature as i32]),
+            TelemetryEnum::BMP(p) => (SensorType::Bmp280, vec![p.pressure, p.temperature]),
+            TelemetryEnum::PHOTOSENSOR(p) => (SensorType::Ky018, vec![p.raw_value]),
+            _ => return,
+        };
+        self.last.insert((esp_id, source, 0), values);
+    }
+
+    /// Full packet rebuilt from a delta, None until a full frame of that sensor was seen
+    pub fn apply(&mut self, esp_id: u8, delta: &PacketDelta) -> Option<TelemetryEnum> {
+        let values = self.last.get_mut(&(esp_id, delta.source, delta.instance))?;
+        if values.len() != delta.deltas.len() {
+            return None;
+        }
+        for (value, d) in values.iter_mut().zip(&delta.deltas) {
+            *value = value.wrapping_add(*d as i32);
+        }
+        match delta.source {
+            SensorType::Dht11 => Some(TelemetryEnum::DHT11(PacketDht11 {
+                humidity: values[0] as u8,
+                temperature: values[1] as u8,
+            })),
+            SensorType::Bmp280 => Some(TelemetryEnum::BMP(PacketBmp {
+                pressure: values[0],
+                temperature: values[1],
+            })),
+            SensorType::Ky018 => Some(TelemetryEnum::PHOTOSENSOR(PacketPhotosensor {
+                raw_value: values[0],
+            })),
+            _ => None,
+        }
+    }
+}
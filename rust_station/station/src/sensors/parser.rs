@@ -4,7 +4,7 @@ use std::{error::Error, time::Instant};
 use eframe::Frame;
 use serde::{Deserialize, Serialize};
 
-use crate::{error::AppError, gui::screens::tuning::CurveType, sensors::{BreakPacket, DriveMode, EspPacket, EspResetReason, PacketBmp, PacketDht11, PacketImu, PacketMotor, PacketPhotosensor, PacketPong, PacketTemperature, PacketUltrasonic, SensorType}};
+use crate::{error::AppError, gui::screens::tuning::CurveType, sensors::{BreakPacket, DriveMode, EspPacket, EspResetReason, PacketBmp, PacketDht11, PacketImu, PacketMotor, PacketPhotosensor, PacketPong, PacketTemperature, PacketAngular, PacketDelta, PacketUltrasonic, PacketVl53l1xZones, PacketZigbee, PacketZigbeeDevice, SensorType, ZigbeeAttr, ZigbeeDeviceEvent}};
 
 pub fn parse_buffer_ina(buffer : &[u8]) -> Result<super::PacketIna, AppError> {
     let bus_voltage       = i16::from_le_bytes(buffer[0..2].try_into()?);
@@ -198,4 +198,248 @@ pub fn parse_buffer_photosensor(buf: &[u8]) -> Result<PacketPhotosensor, AppErro
     Ok(PacketPhotosensor {
         raw_value,
     })
-}
\ No newline at end of file
+}
+
+const VL53L1X_ZONES_MAX_SIDE: u8 = 4;
+const VL53L1X_ZONE_FRAME_HEADER_SIZE: usize = 1 + 1 + 2 + 2;
+
+pub fn parse_buffer_vl53l1x_zones(buf: &[u8]) -> Result<PacketVl53l1xZones, AppError> {
+    if buf.len() < VL53L1X_ZONE_FRAME_HEADER_SIZE {
+        return Err("VL53L1X zone frame too short".into());
+    }
+    let cols = buf[0];
+    let rows = buf[1];
+    if cols == 0 || rows == 0 || cols > VL53L1X_ZONES_MAX_SIDE || rows > VL53L1X_ZONES_MAX_SIDE {
+        return Err(AppError::Other(format!("VL53L1X zone grid {}x{} not valid", cols, rows)));
+    }
+    let zones = cols as usize * rows as usize;
+    if buf.len() < VL53L1X_ZONE_FRAME_HEADER_SIZE + zones * 2 {
+        return Err("VL53L1X zone frame truncated".into());
+    }
+    let valid_mask = u16::from_le_bytes(buf[2 .. 4].try_into()?);
+    let sweep_ms = u16::from_le_bytes(buf[4 .. 6].try_into()?);
+    let distance_mm = buf[VL53L1X_ZONE_FRAME_HEADER_SIZE .. VL53L1X_ZONE_FRAME_HEADER_SIZE + zones * 2]
+        .chunks_exact(2)
+        .map(|d| u16::from_le_bytes([d[0], d[1]]))
+        .collect();
+
+    Ok(PacketVl53l1xZones {
+        cols,
+        rows,
+        valid_mask,
+        sweep_ms,
+        distance_mm,
+    })
+}
+
+const ANGULAR_FRAME_SIZE: usize = 1 + 3 * 4;
+
+pub fn parse_buffer_angular(buf: &[u8]) -> Result<PacketAngular, AppError> {
+    if buf.len() < ANGULAR_FRAME_SIZE {
+        return Err("Angular frame too short".into());
+    }
+    let source = SensorType::try_from(buf[0])?;
+    let position_cdeg = i32::from_le_bytes(buf[1 .. 5].try_into()?);
+    let velocity_cdps = i32::from_le_bytes(buf[5 .. 9].try_into()?);
+    let accel_cdps2 = i32::from_le_bytes(buf[9 .. 13].try_into()?);
+
+    Ok(PacketAngular {
+        source,
+        position_cdeg,
+        velocity_cdps,
+        accel_cdps2,
+    })
+}
+
+const DELTA_FRAME_HEADER_SIZE: usize = 1 + 1 + 1;
+
+pub fn parse_buffer_delta(buf: &[u8]) -> Result<PacketDelta, AppError> {
+    if buf.len() < DELTA_FRAME_HEADER_SIZE {
+        return Err("Delta frame too short".into());
+    }
+    let source = SensorType::try_from(buf[0])?;
+    let instance = buf[1];
+    let count = buf[2] as usize;
+    if buf.len() < DELTA_FRAME_HEADER_SIZE + count * 2 {
+        return Err("Delta frame truncated".into());
+    }
+    let deltas = buf[DELTA_FRAME_HEADER_SIZE .. DELTA_FRAME_HEADER_SIZE + count * 2]
+        .chunks_exact(2)
+        .map(|d| i16::from_le_bytes([d[0], d[1]]))
+        .collect();
+
+    Ok(PacketDelta {
+        source,
+        instance,
+        deltas,
+    })
+}
+
+const ZIGBEE_FRAME_HEADER_SIZE: usize = 2 + 1 + 2 + 1;
+const ZIGBEE_RECORD_HEADER_SIZE: usize = 2 + 1 + 1;
+
+pub fn parse_buffer_zigbee(buf: &[u8]) -> Result<PacketZigbee, AppError> {
+    if buf.len() < ZIGBEE_FRAME_HEADER_SIZE {
+        return Err("Zigbee frame too short".into());
+    }
+    let short_addr = u16::from_le_bytes(buf[0 .. 2].try_into()?);
+    let endpoint = buf[2];
+    let cluster = u16::from_le_bytes(buf[3 .. 5].try_into()?);
+    let count = buf[5] as usize;
+
+    let mut attrs = Vec::with_capacity(count);
+    let mut pos = ZIGBEE_FRAME_HEADER_SIZE;
+    for _ in 0 .. count {
+        if buf.len() < pos + ZIGBEE_RECORD_HEADER_SIZE {
+            return Err("Zigbee frame truncated".into());
+        }
+        let attr = u16::from_le_bytes(buf[pos .. pos + 2].try_into()?);
+        let zcl_type = buf[pos + 2];
+        let len = buf[pos + 3] as usize;
+        pos += ZIGBEE_RECORD_HEADER_SIZE;
+        if buf.len() < pos + len {
+            return Err("Zigbee frame truncated".into());
+        }
+        attrs.push(ZigbeeAttr {
+            attr,
+            zcl_type,
+            value: buf[pos .. pos + len].to_vec(),
+        });
+        pos += len;
+    }
+
+    Ok(PacketZigbee {
+        short_addr,
+        endpoint,
+        cluster,
+        attrs,
+    })
+}
+
+const ZIGBEE_DEVICE_FRAME_SIZE: usize = 2 + 8 + 1 + 1;
+
+pub fn parse_buffer_zigbee_device(buf: &[u8]) -> Result<PacketZigbeeDevice, AppError> {
+    if buf.len() < ZIGBEE_DEVICE_FRAME_SIZE {
+        return Err("Zigbee device frame too short".into());
+    }
+    let short_addr = u16::from_le_bytes(buf[0 .. 2].try_into()?);
+    let ieee: [u8; 8] = buf[2 .. 10].try_into()?;
+    let event = ZigbeeDeviceEvent::try_from(buf[10])?;
+    let devices_known = buf[11];
+
+    Ok(PacketZigbeeDevice {
+        short_addr,
+        ieee,
+        event,
+        devices_known,
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn vl53l1x_zones_frame() {
+        // 2x2 grid, zone 2 (col 0, row 1) without a valid range
+        let mut buf = vec![2u8, 2, 0b1011, 0, 40, 0];
+        for d in [100u16, 200, 0, 400] {
+            buf.extend_from_slice(&d.to_le_bytes());
+        }
+        let zones = parse_buffer_vl53l1x_zones(&buf).unwrap();
+        assert_eq!(zones.distance_mm, vec![100, 200, 0, 400]);
+        assert_eq!(zones.sweep_ms, 40);
+        assert_eq!(zones.get_distance_mm(1, 0), Some(200));
+        assert_eq!(zones.get_distance_mm(0, 1), None);
+        assert_eq!(zones.get_distance_mm(2, 0), None);
+
+        assert!(parse_buffer_vl53l1x_zones(&buf[.. buf.len() - 1]).is_err());
+        assert!(parse_buffer_vl53l1x_zones(&[5, 1, 0, 0, 0, 0, 0, 0]).is_err());
+        assert!(parse_buffer_vl53l1x_zones(&[1]).is_err());
+    }
+
+    #[test]
+    fn angular_frame() {
+        // KY-040 turning backwards at 2.5 turns/s, -180 degrees from the start
+        let mut buf = vec![SensorType::Ky040 as u8];
+        for v in [-18000i32, -90000, 123] {
+            buf.extend_from_slice(&v.to_le_bytes());
+        }
+        let angular = parse_buffer_angular(&buf).unwrap();
+        assert_eq!(angular.source, SensorType::Ky040);
+        assert_eq!(angular.get_position_deg(), -180.0);
+        assert_eq!(angular.get_rpm(), -150.0);
+        assert_eq!(angular.accel_cdps2, 123);
+
+        assert!(parse_buffer_angular(&buf[.. 12]).is_err());
+        buf[0] = 250;
+        assert!(parse_buffer_angular(&buf).is_err());
+    }
+
+    #[test]
+    fn delta_frame() {
+        // BMP280: +12 Pa, -3 (1/100 C)
+        let buf = [SensorType::Bmp280 as u8, 0, 2, 12, 0, 0xFD, 0xFF];
+        let delta = parse_buffer_delta(&buf).unwrap();
+        assert_eq!(delta.source, SensorType::Bmp280);
+        assert_eq!(delta.deltas, vec![12, -3]);
+
+        let mut published = crate::sensors::PublishedValues::default();
+        assert!(published.apply(1, &delta).is_none()); // no full frame yet
+        published.record(1, &crate::sensors::TelemetryEnum::BMP(PacketBmp { pressure: 101300, temperature: 2150 }));
+        assert!(published.apply(2, &delta).is_none()); // other ESP
+        match published.apply(1, &delta) {
+            Some(crate::sensors::TelemetryEnum::BMP(p)) => assert_eq!((p.pressure, p.temperature), (101312, 2147)),
+            other => panic!("{:?}", other),
+        }
+        match published.apply(1, &delta) {
+            Some(crate::sensors::TelemetryEnum::BMP(p)) => assert_eq!((p.pressure, p.temperature), (101324, 2144)),
+            other => panic!("{:?}", other),
+        }
+
+        assert!(parse_buffer_delta(&buf[.. 6]).is_err());
+        assert!(parse_buffer_delta(&[SensorType::Bmp280 as u8, 0]).is_err());
+    }
+
+    #[test]
+    fn zigbee_frame() {
+        // 0x1234 ep 2, temperature cluster: on/off = 1 (bool), 0x0001 = -200 (int16)
+        let buf = [
+            0x34, 0x12, 2, 0x02, 0x04, 2,
+            0x00, 0x00, 0x10, 1, 1,
+            0x01, 0x00, 0x29, 2, 0x38, 0xFF,
+        ];
+        let zb = parse_buffer_zigbee(&buf).unwrap();
+        assert_eq!((zb.short_addr, zb.endpoint, zb.cluster), (0x1234, 2, 0x0402));
+        assert_eq!(zb.attrs.len(), 2);
+        assert_eq!(zb.get_attr(0x0000).unwrap().get_i64(), Some(1));
+        assert_eq!(zb.get_attr(0x0001).unwrap().get_i64(), Some(-200));
+        assert!(zb.get_attr(0x0002).is_none());
+
+        let float = ZigbeeAttr { attr: 0, zcl_type: 0x39, value: vec![0, 0, 0x80, 0x3F] };
+        assert_eq!(float.get_i64(), None);
+        let humidity = ZigbeeAttr { attr: 0, zcl_type: 0x21, value: vec![0x38, 0xFF] };
+        assert_eq!(humidity.get_i64(), Some(65336));
+
+        assert!(parse_buffer_zigbee(&buf[.. 16]).is_err());
+        assert!(parse_buffer_zigbee(&buf[.. 8]).is_err());
+        assert!(parse_buffer_zigbee(&buf[.. 5]).is_err());
+    }
+
+    #[test]
+    fn zigbee_device_frame() {
+        let buf = [0xEF, 0xBE, 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 1, 3];
+        let dev = parse_buffer_zigbee_device(&buf).unwrap();
+        assert_eq!(dev.short_addr, 0xBEEF);
+        assert_eq!(dev.event, ZigbeeDeviceEvent::Joined);
+        assert_eq!(dev.devices_known, 3);
+        assert_eq!(dev.get_ieee_string(), "a7:a6:a5:a4:a3:a2:a1:a0");
+
+        let mut left = buf;
+        left[10] = 2;
+        assert_eq!(parse_buffer_zigbee_device(&left).unwrap().event, ZigbeeDeviceEvent::Left);
+        left[10] = 9;
+        assert!(parse_buffer_zigbee_device(&left).is_err());
+        assert!(parse_buffer_zigbee_device(&buf[.. 11]).is_err());
+    }
+}
@@ -2,9 +2,10 @@ use std::{collections::VecDeque, net::UdpSocket, sync::{Arc, atomic::{AtomicBool
 
 use log::{debug, error, info, warn};
 
-use crate::{config::{self, AppConfig}, error::AppError, gui::screens::logs::LogPacket, sensors::{EspPacket, PacketKy033, PacketRcwl0515, PacketRfidRc522, SensorType, TelemetryEnum, TelemetryPacket, parser::{SENSORS_HEADER_SIZE, SensorsUdpHeader, parse_buffer_bmp, parse_buffer_break, parse_buffer_dht11, parse_buffer_esp, parse_buffer_hall, parse_buffer_ina, parse_buffer_motor, parse_buffer_mpu, parse_buffer_photosensor, parse_buffer_pong, parse_buffer_ultrasonic}}};
+use crate::{config::{self, AppConfig}, error::AppError, gui::screens::logs::LogPacket, sensors::{EspPacket, PacketKy033, PacketRcwl0515, PacketRfidRc522, PublishedValues, SensorType, TelemetryEnum, TelemetryPacket, parser::{SENSORS_HEADER_SIZE, SensorsUdpHeader, parse_buffer_angular, parse_buffer_bmp, parse_buffer_break, parse_buffer_delta, parse_buffer_dht11, parse_buffer_esp, parse_buffer_hall, parse_buffer_ina, parse_buffer_motor, parse_buffer_mpu, parse_buffer_photosensor, parse_buffer_pong, parse_buffer_ultrasonic, parse_buffer_vl53l1x_zones, parse_buffer_zigbee, parse_buffer_zigbee_device}}};
 
-const MAX_SIZE_TELEMETRY_BUF: usize = 256;
+const MAX_SIZE_TELEMETRY_BUF: usize = 1500; // gateway batches are up to one UDP_MAX_SIZE datagram
+const GATEWAY_RECORD_HEADER_SIZE: usize = 1 + 2;
 
 //return Result, allows us to use ? error propagation in fn 
 pub fn udp_sensors_server_init(
@@ -40,6 +41,7 @@ fn udp_sensors_loop(
     // Receives a single datagram message on the socket. If `buf` is too small to hold
     // the message, it will be cut off.
     let mut buf = [0; MAX_SIZE_TELEMETRY_BUF];
+    let mut published = PublishedValues::default();
     loop {
         
         let (amt, src) = socket.recv_from(&mut buf)?;
@@ -61,190 +63,302 @@ fn udp_sensors_loop(
         debug!("buf raw received : {:?}, size: {}, from: {:?}", buf, amt, src);
         debug!("{}", String::from_utf8_lossy(buf));
 
-        let frame_udp_header = SensorsUdpHeader::header_from_buffer(buf)?;
-
-        match frame_udp_header.ftype {
-            SensorType::Ky003 => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::KY003(parse_buffer_hall(&buf[SENSORS_HEADER_SIZE .. amt])?),
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
-                }
-                tx.send(packet)?;
-            },
-            SensorType::Hcsr04 => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::HCSR04(parse_buffer_ultrasonic(&buf[SENSORS_HEADER_SIZE .. amt])?),
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
-                }
-                tx.send(packet)?;
-            },
-            SensorType::Mpu9250 => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::MPU(parse_buffer_mpu(&buf[SENSORS_HEADER_SIZE .. amt])?),
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
-                }
-                tx.send(packet)?;
-            },
-            SensorType::Ina226 => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::INA226(parse_buffer_ina(&buf[SENSORS_HEADER_SIZE .. amt])?),
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
-                }
-                tx.send(packet)?;
-            },
-            SensorType::RfidRc522 => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::RFIDRC522(
-                        PacketRfidRc522 {
-                            uid : (&buf[SENSORS_HEADER_SIZE .. amt]).to_vec(),
-                        }),
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
-                }
-                tx.send(packet)?;
-            },
-            SensorType::Rcwl0515 => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::RCWL0515(
-                        PacketRcwl0515 {
-                            detection : buf[amt - 1] != 0,
-                        }),
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
-                }
-                tx.send(packet)?;
-            },
-            SensorType::Ky033 => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::KY033(
-                        PacketKy033 {
-                            pulses: buf[amt - 4],
-                            motor: i16::from_le_bytes(buf[amt - 3 .. amt - 1].try_into().expect("ky033 motor")),
-                            sign_motor_positive : match buf[amt - 1] {0 => false, 1 => true, _ => false},
-                        }
-                    )
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
-                }
-                tx.send(packet)?;
-            },
-            SensorType::Esp => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::ESP(parse_buffer_esp(&buf[SENSORS_HEADER_SIZE .. amt]).expect("esp"))
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
-                }
-                tx.send(packet)?;
-            },
-            SensorType::Pong => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::PONG(parse_buffer_pong(&buf[SENSORS_HEADER_SIZE .. amt], start_instant)?)
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
-                }
-                tx.send(packet)?;
-            },
-            SensorType::Motor => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::MOTOR(parse_buffer_motor(&buf[SENSORS_HEADER_SIZE .. amt])?)
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
-                }
-                tx.send(packet)?;
-            },
-            SensorType::Break => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::BREAK(parse_buffer_break(&buf[SENSORS_HEADER_SIZE .. amt])?)
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
+        // A gateway batch carries the frames of several ESP-NOW nodes:
+        // [sensor header][node id][len u16 LE][frame]...
+        if buf.first() == Some(&(SensorType::Gateway as u8)) {
+            let mut offset = SENSORS_HEADER_SIZE;
+            while offset + GATEWAY_RECORD_HEADER_SIZE <= amt {
+                let node_id = buf[offset];
+                let len = u16::from_le_bytes([buf[offset + 1], buf[offset + 2]]) as usize;
+                let frame_start = offset + GATEWAY_RECORD_HEADER_SIZE;
+                if frame_start + len > amt {
+                    warn!("Truncated gateway record from node {}", node_id);
+                    break;
                 }
-                tx.send(packet)?;
-            },
-            SensorType::Bmp280 => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::BMP(parse_buffer_bmp(&buf[SENSORS_HEADER_SIZE .. amt])?),
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
+                debug!("gateway record, node {}: {} bytes", node_id, len);
+                // one bad node must not take the whole batch (and the others) down
+                if let Err(e) = handle_frame(&buf[frame_start .. frame_start + len], &tx, &sensors_connected, &config_udp_recv, start_instant, &tx_record, ts, &mut published) {
+                    warn!("Gateway record from node {} dropped: {:?}", node_id, e);
                 }
-                tx.send(packet)?;
-            },
-            SensorType::Dht11 => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::DHT11(parse_buffer_dht11(&buf[SENSORS_HEADER_SIZE .. amt])?),
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
-                }
-                tx.send(packet)?;
-            },
-            SensorType::Ky018 => {
-                sensors_connected.store(true, Ordering::Relaxed);
-                let packet = TelemetryPacket {
-                    hd_info: frame_udp_header,
-                    packet: TelemetryEnum::PHOTOSENSOR(parse_buffer_photosensor(&buf[SENSORS_HEADER_SIZE .. amt])?),
-                };
-                debug!("{:?}", packet);
-                if config_udp_recv.recording {
-                    let _ = tx_record.send((packet.clone(), ts));
-                }
-                tx.send(packet)?;
-            },
-            _ => return Err("Invalid frame type".into()),
+                offset = frame_start + len;
+            }
+        } else if let Err(e) = handle_frame(buf, &tx, &sensors_connected, &config_udp_recv, start_instant, &tx_record, ts, &mut published) {
+            // nobody left to read the packets: stop, anything else only costs this datagram
+            if let AppError::Send(_) = e {
+                return Err(e);
+            }
+            warn!("Frame from {:?} dropped: {:?}", src, e);
         }
     }
-}
\ No newline at end of file
+}
+
+fn handle_frame(
+    buf: &[u8],
+    tx: &Sender<TelemetryPacket>,
+    sensors_connected: &AtomicBool,
+    config_udp_recv: &AppConfig,
+    start_instant: Instant,
+    tx_record: &Sender<(TelemetryPacket, f64)>,
+    ts: f64,
+    published: &mut PublishedValues,
+) -> Result<(), AppError> {
+    let amt = buf.len();
+    let frame_udp_header = SensorsUdpHeader::header_from_buffer(buf)?;
+
+    match frame_udp_header.ftype {
+        SensorType::Ky003 => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::KY003(parse_buffer_hall(&buf[SENSORS_HEADER_SIZE .. amt])?),
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Hcsr04 => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::HCSR04(parse_buffer_ultrasonic(&buf[SENSORS_HEADER_SIZE .. amt])?),
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Mpu9250 => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::MPU(parse_buffer_mpu(&buf[SENSORS_HEADER_SIZE .. amt])?),
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Ina226 => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::INA226(parse_buffer_ina(&buf[SENSORS_HEADER_SIZE .. amt])?),
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::RfidRc522 => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::RFIDRC522(
+                    PacketRfidRc522 {
+                        uid : (&buf[SENSORS_HEADER_SIZE .. amt]).to_vec(),
+                    }),
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Rcwl0515 => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::RCWL0515(
+                    PacketRcwl0515 {
+                        detection : buf[amt - 1] != 0,
+                    }),
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Ky033 => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::KY033(
+                    PacketKy033 {
+                        pulses: buf[amt - 4],
+                        motor: i16::from_le_bytes(buf[amt - 3 .. amt - 1].try_into().expect("ky033 motor")),
+                        sign_motor_positive : match buf[amt - 1] {0 => false, 1 => true, _ => false},
+                    }
+                )
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Esp => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::ESP(parse_buffer_esp(&buf[SENSORS_HEADER_SIZE .. amt]).expect("esp"))
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Pong => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::PONG(parse_buffer_pong(&buf[SENSORS_HEADER_SIZE .. amt], start_instant)?)
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Motor => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::MOTOR(parse_buffer_motor(&buf[SENSORS_HEADER_SIZE .. amt])?)
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Break => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::BREAK(parse_buffer_break(&buf[SENSORS_HEADER_SIZE .. amt])?)
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Bmp280 => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::BMP(parse_buffer_bmp(&buf[SENSORS_HEADER_SIZE .. amt])?),
+            };
+            published.record(packet.hd_info.esp_id, &packet.packet);
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Dht11 => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::DHT11(parse_buffer_dht11(&buf[SENSORS_HEADER_SIZE .. amt])?),
+            };
+            published.record(packet.hd_info.esp_id, &packet.packet);
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Ky018 => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::PHOTOSENSOR(parse_buffer_photosensor(&buf[SENSORS_HEADER_SIZE .. amt])?),
+            };
+            published.record(packet.hd_info.esp_id, &packet.packet);
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Vl53l1xZones => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::VL53L1XZONES(parse_buffer_vl53l1x_zones(&buf[SENSORS_HEADER_SIZE .. amt])?),
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Angular => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::ANGULAR(parse_buffer_angular(&buf[SENSORS_HEADER_SIZE .. amt])?),
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Delta => {
+            let delta = parse_buffer_delta(&buf[SENSORS_HEADER_SIZE .. amt])?;
+            // rebuilt into the sensor's own packet, as if the full frame had been sent
+            let Some(rebuilt) = published.apply(frame_udp_header.esp_id, &delta) else {
+                debug!("Delta without a full frame to apply to (next heartbeat resyncs): {:?}", delta);
+                return Ok(());
+            };
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: SensorsUdpHeader { ftype: delta.source, ..frame_udp_header },
+                packet: rebuilt,
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::Zigbee => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::ZIGBEE(parse_buffer_zigbee(&buf[SENSORS_HEADER_SIZE .. amt])?),
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        SensorType::ZigbeeDevice => {
+            sensors_connected.store(true, Ordering::Relaxed);
+            let packet = TelemetryPacket {
+                hd_info: frame_udp_header,
+                packet: TelemetryEnum::ZIGBEEDEVICE(parse_buffer_zigbee_device(&buf[SENSORS_HEADER_SIZE .. amt])?),
+            };
+            debug!("{:?}", packet);
+            if config_udp_recv.recording {
+                let _ = tx_record.send((packet.clone(), ts));
+            }
+            tx.send(packet)?;
+        },
+        // a type this station does not decode (newer firmware): skipped, the next frames still are
+        other => {
+            warn!("Frame type {:?} not handled, skipped", other);
+        },
+    }
+    Ok(())
+}